@@ -43,12 +43,15 @@
 #include "itkImage.h"
 #include "itkObject.h"
 #include "itkNaryAddImageFilter.h"
+#include "itkMultiThreader.h"
+#include "itkSimpleFastMutexLock.h"
 
 #include <vector>
 
 #include "BRAINSFitHelper.h"
+#include "BRAINSRegistrationCache.h"
 #include "BRAINSABCUtilities.h"
-#include "itkAverageImageFilter.h"
+#include "itkStreamingAverageImageAccumulator.h"
 #include "itkBinaryThresholdImageFilter.h"
 #include <string>
 
@@ -114,22 +117,22 @@ AverageImageList(const std::vector<typename TImage::Pointer> & inputImageList)
   averageMask = multIF->GetOutput();
   }
 
-  typedef itk::AverageImageFilter<TImage,TImage> AvgFilterType;
-  typename AvgFilterType::Pointer filter = AvgFilterType::New();
+  // Each intensity matched image is added to the running sums as soon as it
+  // is computed, so only one of them is in memory at a time.
+  typedef itk::StreamingAverageImageAccumulator<TImage,TImage> AccumulatorType;
+  typename AccumulatorType::Pointer accumulator = AccumulatorType::New();
   typename TImage::Pointer referenceScaleImg = inputImageList[0];
-  filter->SetInput(0,referenceScaleImg);
+  accumulator->AddImage(referenceScaleImg);
   for(unsigned int i = 1; i < inputImageList.size(); ++i)
     {
-      //Modify inputImageList in place.
       typename TImage::Pointer temp=LinearRegressionIntensityMatching<TImage,TImage>(referenceScaleImg.GetPointer(),
                                                           averageMask.GetPointer(),
                                                           inputImageList[i].GetPointer());
-      filter->SetInput(i,  temp);
+      accumulator->AddImage(temp);
     }
-  filter->Update();
   typename MultiplyFilterType::Pointer multIF = MultiplyFilterType::New();
   multIF->SetInput1(averageMask);
-  multIF->SetInput2(filter->GetOutput());
+  multIF->SetInput2(accumulator->GetMeanImage());
   multIF->Update();
 
   return multIF->GetOutput();
@@ -248,6 +251,15 @@ public:
     return m_IntraSubjectTransforms;
   }
 
+  /** Directory of the registration cache (see BRAINSUtils::RegistrationCache)
+   * used for the intra subject and the atlas to subject registrations.  When
+   * empty, the BRAINS_REGISTRATION_CACHE environment variable is used.  A
+   * cached transform is reused when the images, the masks and the
+   * registration settings are the same, so reruns only register the images
+   * that changed. */
+  itkSetMacro(RegistrationCacheDirectory, std::string);
+  itkGetConstMacro(RegistrationCacheDirectory, std::string);
+
   // Set/Get the Debugging level for filter verboseness
   itkSetMacro(DebugLevel, unsigned int);
   itkGetMacro(DebugLevel, unsigned int);
@@ -303,6 +315,28 @@ protected:
   ProbabilityImagePointer CopyProbabilityImage(InternalImagePointer img);
 
 private:
+  /** One intra subject image registered to the key image */
+  struct IntraSubjectRegistrationJob
+    {
+    std::string                   Modality;
+    size_t                        Position;          // in the modality list
+    unsigned int                  ModalityNumber;    // for the messages
+    unsigned int                  RegistrationNumber;
+    InternalImagePointer          MovingImage;
+    std::string                   TransformFileName;
+    GenericTransformType::Pointer Transform;
+    std::string                   ErrorMessage;
+    };
+
+  static ITK_THREAD_RETURN_TYPE IntraSubjectRegistrationThreaderCallback(void *arg);
+
+  void RunIntraSubjectRegistrationJob(IntraSubjectRegistrationJob & job);
+
+  GenericTransformType::Pointer RegisterIntraSubjectImage(const IntraSubjectRegistrationJob & job);
+
+  void GenerateKeySubjectTissueRegion(void);
+
+  BRAINSUtils::RegistrationCacheKey IntraSubjectRegistrationCacheKey(const InternalImageType *movingImage) const;
 
   std::string m_Suffix;
   std::string m_OutputDebugDir;
@@ -340,6 +374,14 @@ private:
   CompositeTransformPointer     m_RestoreState;
 
   unsigned int m_DebugLevel;
+
+  std::string m_RegistrationCacheDirectory;
+
+  // Intra subject registrations run concurrently
+  std::vector<IntraSubjectRegistrationJob> m_IntraSubjectRegistrationJobs;
+  size_t                                   m_NextIntraSubjectRegistrationJob;
+  itk::SimpleFastMutexLock                 m_IntraSubjectRegistrationLock;
+  BRAINSUtils::RegistrationCacheKey        m_IntraSubjectRegistrationBaseKey;
 };
 
 #ifndef MU_MANUAL_INSTANTIATION
@@ -42,6 +42,23 @@
 #include <iomanip>
 
 #include "itkBRAINSROIAutoImageFilter.h"
+#include "itkMutexLockHolder.h"
+#include "BRAINSThreadControl.h"
+#include "itksys/SystemTools.hxx"
+
+// Sizes in mm of the head masks of the intra subject registrations
+static const int IntraSubjectClosingSize = 15;
+static const int IntraSubjectDilateSize = 15;
+
+// Settings of the registrations that are part of the keys of the
+// registration cache, to be changed along with RegisterIntraSubjectImage()
+// and RegisterAtlasToSubjectImages().
+static const char IntraSubjectRegistrationSignature[] =
+  "IntraSubject v1: Rigid,ScaleVersor3D,ScaleSkewVersor3D,Affine; sampling 0.05; bins 50; iterations 1500; "
+  "minimum steps 0.00005,0.005,0.005,0.005; scales 1000,1,1; masks 15,15; useCenterOfHeadAlign; cutoff 65";
+static const char AtlasToSubjectRegistrationSignature[] =
+  "AtlasToSubject v1: sampling 0.05; bins 50; iterations 1500; scales 1000,1,1; masks 15,10; "
+  "useCenterOfHeadAlign; cutoff 65; minimum steps 0.0025 or 0.00005,0.005; BSpline displacement 6";
 
 itk::Transform<double, 3, 3>::Pointer MakeRigidIdentity(void)
 {
@@ -63,7 +80,9 @@ AtlasRegistrationMethod<TOutputPixel, TProbabilityPixel>
   m_ImageLinearTransformChoice("Rigid"),
   m_SaveState(""),
   m_RestoreState(ITK_NULLPTR),
-  m_DebugLevel(0)
+  m_DebugLevel(0),
+  m_RegistrationCacheDirectory(""),
+  m_NextIntraSubjectRegistrationJob(0)
 {
   m_InputImageTissueRegion = ITK_NULLPTR;
   m_InputSpatialObjectTissueRegion = ITK_NULLPTR;
@@ -143,7 +162,10 @@ AtlasRegistrationMethod<TOutputPixel, TProbabilityPixel>
 {
   muLogMacro(<< "Register Intra subject images" << std::endl);
 
-  int i = 0;
+  // Transforms read from disk and identities are set in place, the images
+  // that need a registration are collected and registered concurrently.
+  m_IntraSubjectRegistrationJobs.clear();
+  unsigned int i = 0;
   for(auto mapOfModalImageListsIt = this->m_IntraSubjectOriginalImageList.begin();
       mapOfModalImageListsIt != this->m_IntraSubjectOriginalImageList.end();
       ++mapOfModalImageListsIt)
@@ -151,7 +173,8 @@ AtlasRegistrationMethod<TOutputPixel, TProbabilityPixel>
     FloatImageVector::iterator currModeImageListIt = mapOfModalImageListsIt->second.begin();
     FloatImageVector::iterator intraImIt = this->m_IntraSubjectOriginalImageList[mapOfModalImageListsIt->first].begin();
     StringVector::iterator isNamesIt = this->m_IntraSubjectTransformFileNames[mapOfModalImageListsIt->first].begin();
-    this->m_IntraSubjectTransforms[mapOfModalImageListsIt->first].clear(); //Ensure that pushing onto clean list
+    TransformList & modalityTransforms = this->m_IntraSubjectTransforms[mapOfModalImageListsIt->first];
+    modalityTransforms.clear(); //Ensure that pushing onto clean list
     while(currModeImageListIt != mapOfModalImageListsIt->second.end() )
       {
       if( itksys::SystemTools::FileExists( (*isNamesIt).c_str() ) )
@@ -160,7 +183,7 @@ AtlasRegistrationMethod<TOutputPixel, TProbabilityPixel>
           {
           muLogMacro(<< "Reading transform from file: "
                      << (*isNamesIt).c_str() << "." << std::endl);
-          m_IntraSubjectTransforms[mapOfModalImageListsIt->first].push_back(itk::ReadTransformFromDisk((*isNamesIt).c_str()));
+          modalityTransforms.push_back(itk::ReadTransformFromDisk((*isNamesIt).c_str()));
           }
         catch( ... )
           {
@@ -171,138 +194,25 @@ AtlasRegistrationMethod<TOutputPixel, TProbabilityPixel>
       else if( m_ImageLinearTransformChoice == "Identity" )
         {
         muLogMacro(<< "Registering (Identity) image to key image." << std::endl);
-        m_IntraSubjectTransforms[mapOfModalImageListsIt->first].push_back(MakeRigidIdentity());
+        modalityTransforms.push_back(MakeRigidIdentity());
         }
       else if ( (*intraImIt).GetPointer() == this->m_KeySubjectImage.GetPointer() )
         {
         muLogMacro(<< "Key image registered to itself with Identity transform." << std::endl);
-        m_IntraSubjectTransforms[mapOfModalImageListsIt->first].push_back(MakeRigidIdentity());
+        modalityTransforms.push_back(MakeRigidIdentity());
         }
       else // when m_ImageLinearTransformChoice == "Rigid"
         {
-        typedef itk::BRAINSFitHelper HelperType;
-        HelperType::Pointer intraSubjectRegistrationHelper = HelperType::New();
-        intraSubjectRegistrationHelper->SetSamplingPercentage(0.05); //Sample 5% of image
-        intraSubjectRegistrationHelper->SetNumberOfHistogramBins(50);
-        std::vector<int> numberOfIterations(1);
-        numberOfIterations[0] = 1500;
-        intraSubjectRegistrationHelper->SetNumberOfIterations(numberOfIterations);
-        //
-        //
-        //
-        // intraSubjectRegistrationHelper->SetMaximumStepLength(maximumStepSize);
-        intraSubjectRegistrationHelper->SetTranslationScale(1000);
-        intraSubjectRegistrationHelper->SetReproportionScale(1.0);
-        intraSubjectRegistrationHelper->SetSkewScale(1.0);
-        // Register each intrasubject image mode to first image
-        intraSubjectRegistrationHelper->SetFixedVolume(this->GetModifiableKeySubjectImage() );
-        // TODO: Find way to turn on histogram equalization for same mode images
-        const int dilateSize = 15;
-        const int closingSize = 15;
-        intraSubjectRegistrationHelper->SetMovingVolume((*intraImIt).GetPointer());
-        muLogMacro( << "Generating MovingImage Mask (Intrasubject  " << i << ")" <<  std::endl );
-        typedef itk::BRAINSROIAutoImageFilter<InternalImageType, itk::Image<unsigned char, 3> > ROIAutoType;
-        typename ROIAutoType::Pointer  ROIFilter = ROIAutoType::New();
-        ROIFilter->SetInput((*intraImIt));
-        ROIFilter->SetClosingSize(closingSize);
-        ROIFilter->SetDilateSize(dilateSize); // Only use a very small non-tissue
-                                              // region outside of head during initial
-                                              // runnings
-        ROIFilter->Update();
-        ByteImageType::Pointer movingMaskImage = ROIFilter->GetOutput();
-        intraSubjectRegistrationHelper->SetMovingBinaryVolume(ROIFilter->GetSpatialObjectROI() );
-        if( this->m_DebugLevel > 7 )
-          {
-          typedef itk::ImageFileWriter<ByteImageType> ByteWriterType;
-          ByteWriterType::Pointer writer = ByteWriterType::New();
-          writer->UseCompressionOn();
-
-          std::ostringstream oss;
-          oss << this->m_OutputDebugDir << "IntraSubject_MovingMask_" << i <<  ".nii.gz" << std::ends;
-          std::string fn = oss.str();
-
-          writer->SetInput( movingMaskImage );
-          writer->SetFileName(fn.c_str() );
-          writer->Update();
-          muLogMacro( << __FILE__ << " " << __LINE__ << " "  <<  std::endl );
-          }
-
-        // Delayed until first use, but only create it once.
-        if( m_InputImageTissueRegion.IsNull() || m_InputSpatialObjectTissueRegion.IsNull() )
-          {
-          muLogMacro( << "Generating FixedImage Mask (Intrasubject)" <<  std::endl );
-          typedef itk::BRAINSROIAutoImageFilter<InternalImageType, itk::Image<unsigned char, 3> > LocalROIAutoType;
-          ROIFilter = LocalROIAutoType::New();
-          ROIFilter->SetInput(this->GetModifiableKeySubjectImage());
-          ROIFilter->SetClosingSize(closingSize);
-          ROIFilter->SetDilateSize(dilateSize); // Only use a very small non-tissue
-                                                // region outside of head during
-                                                // initial runnings
-          ROIFilter->Update();
-          m_InputImageTissueRegion = ROIFilter->GetOutput();
-          m_InputSpatialObjectTissueRegion = ROIFilter->GetSpatialObjectROI();
-          if( this->m_DebugLevel > 7 )
-            {
-            typedef itk::ImageFileWriter<ByteImageType> ByteWriterType;
-            ByteWriterType::Pointer writer = ByteWriterType::New();
-            writer->UseCompressionOn();
-
-            std::ostringstream oss;
-            oss << this->m_OutputDebugDir << "IntraSubject_FixedMask_" << 0 <<  ".nii.gz" << std::ends;
-            std::string fn = oss.str();
-
-            writer->SetInput( m_InputImageTissueRegion );
-            writer->SetFileName(fn.c_str() );
-            writer->Update();
-            muLogMacro( << __FILE__ << " " << __LINE__ << " "  <<  std::endl );
-            }
-          }
-        intraSubjectRegistrationHelper->SetFixedBinaryVolume(m_InputSpatialObjectTissueRegion);
-
-        muLogMacro(<< "Registering (Rigid) image " << i << " to first image." << std::endl);
-        // For better registration, several linear registration methods are run,
-        // but at the end, rigid component is extracted from output linear transform.
-        std::vector<double> minimumStepSize(4);
-        minimumStepSize[0] = 0.00005;
-        minimumStepSize[1] = 0.005;
-        minimumStepSize[2] = 0.005;
-        minimumStepSize[3] = 0.005;
-        intraSubjectRegistrationHelper->SetMinimumStepLength(minimumStepSize);
-        std::vector<std::string> transformType(4);
-        transformType[0] = "Rigid";
-        transformType[1] = "ScaleVersor3D";
-        transformType[2] = "ScaleSkewVersor3D";
-        transformType[3] = "Affine";
-        intraSubjectRegistrationHelper->SetTransformType(transformType);
-        //
-        // intraSubjectRegistrationHelper->SetBackgroundFillValue(backgroundFillValue);
-        // NOT VALID When using initializeTransformMode
-        //
-        const std::string initializeTransformMode("useCenterOfHeadAlign");
-        intraSubjectRegistrationHelper->SetInitializeTransformMode(initializeTransformMode);
-        intraSubjectRegistrationHelper->SetMaskInferiorCutOffFromCenter(65.0); //
-        //
-        // maskInferiorCutOffFromCenter);
-        intraSubjectRegistrationHelper->SetCurrentGenericTransform(ITK_NULLPTR);
-        if( this->m_DebugLevel > 9 )
-          {
-          static unsigned int IntraSubjectRegistration = 0;
-          std::stringstream   ss;
-          ss << std::setw(3) << std::setfill('0') << IntraSubjectRegistration;
-          intraSubjectRegistrationHelper->PrintCommandLine(true, std::string("IntraSubjectRegistration") + ss.str() );
-          muLogMacro( << __FILE__ << " " << __LINE__ << " "  <<  std::endl );
-          IntraSubjectRegistration++;
-          }
-        intraSubjectRegistrationHelper->Update();
-        const unsigned int actualIterations = intraSubjectRegistrationHelper->GetActualNumberOfIterations();
-        muLogMacro( << "Registration tool " << actualIterations << " iterations." << std::endl );
-        itk::VersorRigid3DTransform<double>::Pointer versorRigid = itk::ComputeRigidTransformFromGeneric(
-          intraSubjectRegistrationHelper->GetCurrentGenericTransform()->GetNthTransform(0).GetPointer() );
-        GenericTransformType::Pointer p = versorRigid.GetPointer();
-        this->m_IntraSubjectTransforms[mapOfModalImageListsIt->first].push_back(p);
-        // Write out intermodal matricies
-        muLogMacro(<< "Writing " << (*isNamesIt) << "." << std::endl);
-        itk::WriteTransformToDisk<double, float>(p, (*isNamesIt));
+        static unsigned int IntraSubjectRegistration = 0;
+        IntraSubjectRegistrationJob job;
+        job.Modality = mapOfModalImageListsIt->first;
+        job.Position = modalityTransforms.size();
+        job.ModalityNumber = i;
+        job.RegistrationNumber = IntraSubjectRegistration++;
+        job.MovingImage = *intraImIt;
+        job.TransformFileName = *isNamesIt;
+        m_IntraSubjectRegistrationJobs.push_back(job);
+        modalityTransforms.push_back(ITK_NULLPTR);
         }
       ++currModeImageListIt;
       ++isNamesIt;
@@ -310,6 +220,267 @@ AtlasRegistrationMethod<TOutputPixel, TProbabilityPixel>
       }
     i++;
     }
+
+  if( m_IntraSubjectRegistrationJobs.empty() )
+    {
+    return;
+    }
+
+  this->GenerateKeySubjectTissueRegion();
+  if( BRAINSUtils::RegistrationCache(m_RegistrationCacheDirectory).IsEnabled() )
+    {
+    // The key image is hashed once for all the registrations
+    m_IntraSubjectRegistrationBaseKey = BRAINSUtils::RegistrationCacheKey("BRAINSABC IntraSubject");
+    m_IntraSubjectRegistrationBaseKey.AddParameter("settings", std::string(IntraSubjectRegistrationSignature) );
+    m_IntraSubjectRegistrationBaseKey.AddImage("fixed", this->m_KeySubjectImage.GetPointer() );
+    }
+
+  // The thread budget is shared: each of the concurrent registrations
+  // creates its filters with an equal part of the threads.
+  const unsigned int threadBudget = itk::MultiThreader::GetGlobalDefaultNumberOfThreads();
+  const unsigned int numberOfConcurrentRegistrations =
+    std::max(1U, std::min<unsigned int>(threadBudget, m_IntraSubjectRegistrationJobs.size() ) );
+  muLogMacro(<< "Running " << m_IntraSubjectRegistrationJobs.size() << " intra subject registrations, "
+             << numberOfConcurrentRegistrations << " at a time." << std::endl);
+    {
+    itk::MultiThreader::Pointer threader = itk::MultiThreader::New();
+    threader->SetNumberOfThreads(numberOfConcurrentRegistrations);
+    const BRAINSUtils::StackPushITKDefaultNumberOfThreads registrationThreads(
+      std::max(1U, threadBudget / numberOfConcurrentRegistrations) );
+    m_NextIntraSubjectRegistrationJob = 0;
+    threader->SetSingleMethod(IntraSubjectRegistrationThreaderCallback, this);
+    threader->SingleMethodExecute();
+    }
+
+  for( size_t j = 0; j < m_IntraSubjectRegistrationJobs.size(); ++j )
+    {
+    const IntraSubjectRegistrationJob & job = m_IntraSubjectRegistrationJobs[j];
+    if( !job.ErrorMessage.empty() )
+      {
+      muLogMacro(<< "Registration of " << job.TransformFileName << " failed." << std::endl);
+      itkExceptionMacro(<< "Registration of " << job.TransformFileName << " failed: " << job.ErrorMessage);
+      }
+    this->m_IntraSubjectTransforms[job.Modality][job.Position] = job.Transform;
+    }
+  m_IntraSubjectRegistrationJobs.clear();
+}
+
+template <class TOutputPixel, class TProbabilityPixel>
+ITK_THREAD_RETURN_TYPE
+AtlasRegistrationMethod<TOutputPixel, TProbabilityPixel>
+::IntraSubjectRegistrationThreaderCallback(void *arg)
+{
+  Self *self = static_cast<Self *>( ( (itk::MultiThreader::ThreadInfoStruct *)(arg) )->UserData );
+
+  for( ;; )
+    {
+    self->m_IntraSubjectRegistrationLock.Lock();
+    const size_t next = self->m_NextIntraSubjectRegistrationJob++;
+    self->m_IntraSubjectRegistrationLock.Unlock();
+    if( next >= self->m_IntraSubjectRegistrationJobs.size() )
+      {
+      break;
+      }
+    IntraSubjectRegistrationJob & job = self->m_IntraSubjectRegistrationJobs[next];
+    // Exceptions can not leave the thread, they are thrown again after all
+    // the registrations are done.
+    try
+      {
+      self->RunIntraSubjectRegistrationJob(job);
+      }
+    catch( itk::ExceptionObject & e )
+      {
+      std::ostringstream msg;
+      msg << e;
+      job.ErrorMessage = msg.str();
+      }
+    catch( std::exception & e )
+      {
+      job.ErrorMessage = e.what();
+      }
+    }
+  return ITK_THREAD_RETURN_VALUE;
+}
+
+template <class TOutputPixel, class TProbabilityPixel>
+void
+AtlasRegistrationMethod<TOutputPixel, TProbabilityPixel>
+::RunIntraSubjectRegistrationJob(IntraSubjectRegistrationJob & job)
+{
+  const BRAINSUtils::RegistrationCache cache(m_RegistrationCacheDirectory);
+  BRAINSUtils::RegistrationCacheKey    key;
+
+  if( cache.IsEnabled() )
+    {
+    key = this->IntraSubjectRegistrationCacheKey(job.MovingImage);
+    job.Transform = cache.FetchTransform(key);
+    if( job.Transform.IsNotNull() )
+      {
+      muLogMacro(<< "Reusing cached registration " << key.GetDigest()
+                 << " for image " << job.RegistrationNumber << "." << std::endl);
+      }
+    }
+
+  if( job.Transform.IsNull() )
+    {
+    job.Transform = this->RegisterIntraSubjectImage(job);
+    cache.StoreTransform(key, job.Transform);
+    }
+
+  // Write out intermodal matricies
+  muLogMacro(<< "Writing " << job.TransformFileName << "." << std::endl);
+  const itk::MutexLockHolder<itk::SimpleFastMutexLock> holder(BRAINSUtils::RegistrationCache::GetIOLock() );
+  itk::WriteTransformToDisk<double, float>(job.Transform, job.TransformFileName);
+}
+
+template <class TOutputPixel, class TProbabilityPixel>
+void
+AtlasRegistrationMethod<TOutputPixel, TProbabilityPixel>
+::GenerateKeySubjectTissueRegion()
+{
+  // Delayed until first use, but only create it once.
+  if( m_InputImageTissueRegion.IsNull() || m_InputSpatialObjectTissueRegion.IsNull() )
+    {
+    muLogMacro( << "Generating FixedImage Mask (Intrasubject)" <<  std::endl );
+    typedef itk::BRAINSROIAutoImageFilter<InternalImageType, itk::Image<unsigned char, 3> > LocalROIAutoType;
+    typename LocalROIAutoType::Pointer ROIFilter = LocalROIAutoType::New();
+    ROIFilter->SetInput(this->GetModifiableKeySubjectImage());
+    ROIFilter->SetClosingSize(IntraSubjectClosingSize);
+    ROIFilter->SetDilateSize(IntraSubjectDilateSize); // Only use a very small non-tissue
+                                                      // region outside of head during
+                                                      // initial runnings
+    ROIFilter->Update();
+    m_InputImageTissueRegion = ROIFilter->GetOutput();
+    m_InputSpatialObjectTissueRegion = ROIFilter->GetSpatialObjectROI();
+    if( this->m_DebugLevel > 7 )
+      {
+      typedef itk::ImageFileWriter<ByteImageType> ByteWriterType;
+      ByteWriterType::Pointer writer = ByteWriterType::New();
+      writer->UseCompressionOn();
+
+      std::ostringstream oss;
+      oss << this->m_OutputDebugDir << "IntraSubject_FixedMask_" << 0 <<  ".nii.gz" << std::ends;
+      std::string fn = oss.str();
+
+      writer->SetInput( m_InputImageTissueRegion );
+      writer->SetFileName(fn.c_str() );
+      writer->Update();
+      muLogMacro( << __FILE__ << " " << __LINE__ << " "  <<  std::endl );
+      }
+    }
+}
+
+template <class TOutputPixel, class TProbabilityPixel>
+typename AtlasRegistrationMethod<TOutputPixel, TProbabilityPixel>::GenericTransformType::Pointer
+AtlasRegistrationMethod<TOutputPixel, TProbabilityPixel>
+::RegisterIntraSubjectImage(const IntraSubjectRegistrationJob & job)
+{
+  // The registrations run concurrently, so each one uses its own image
+  // objects that share the pixels of the inputs.
+  InternalImagePointer fixedImage = InternalImageType::New();
+  fixedImage->Graft( this->m_KeySubjectImage );
+  InternalImagePointer movingImage = InternalImageType::New();
+  movingImage->Graft( job.MovingImage );
+
+  typedef itk::BRAINSFitHelper HelperType;
+  HelperType::Pointer intraSubjectRegistrationHelper = HelperType::New();
+  intraSubjectRegistrationHelper->SetSamplingPercentage(0.05); //Sample 5% of image
+  intraSubjectRegistrationHelper->SetNumberOfHistogramBins(50);
+  std::vector<int> numberOfIterations(1);
+  numberOfIterations[0] = 1500;
+  intraSubjectRegistrationHelper->SetNumberOfIterations(numberOfIterations);
+  //
+  //
+  //
+  // intraSubjectRegistrationHelper->SetMaximumStepLength(maximumStepSize);
+  intraSubjectRegistrationHelper->SetTranslationScale(1000);
+  intraSubjectRegistrationHelper->SetReproportionScale(1.0);
+  intraSubjectRegistrationHelper->SetSkewScale(1.0);
+  // Register each intrasubject image mode to first image
+  intraSubjectRegistrationHelper->SetFixedVolume(fixedImage);
+  // TODO: Find way to turn on histogram equalization for same mode images
+  intraSubjectRegistrationHelper->SetMovingVolume(movingImage);
+  muLogMacro( << "Generating MovingImage Mask (Intrasubject  " << job.ModalityNumber << ")" <<  std::endl );
+  typedef itk::BRAINSROIAutoImageFilter<InternalImageType, itk::Image<unsigned char, 3> > ROIAutoType;
+  typename ROIAutoType::Pointer  ROIFilter = ROIAutoType::New();
+  ROIFilter->SetInput(movingImage);
+  ROIFilter->SetClosingSize(IntraSubjectClosingSize);
+  ROIFilter->SetDilateSize(IntraSubjectDilateSize); // Only use a very small non-tissue
+                                                    // region outside of head during initial
+                                                    // runnings
+  ROIFilter->Update();
+  ByteImageType::Pointer movingMaskImage = ROIFilter->GetOutput();
+  intraSubjectRegistrationHelper->SetMovingBinaryVolume(ROIFilter->GetSpatialObjectROI() );
+  if( this->m_DebugLevel > 7 )
+    {
+    typedef itk::ImageFileWriter<ByteImageType> ByteWriterType;
+    ByteWriterType::Pointer writer = ByteWriterType::New();
+    writer->UseCompressionOn();
+
+    std::ostringstream oss;
+    oss << this->m_OutputDebugDir << "IntraSubject_MovingMask_" << job.ModalityNumber <<  ".nii.gz" << std::ends;
+    std::string fn = oss.str();
+
+    writer->SetInput( movingMaskImage );
+    writer->SetFileName(fn.c_str() );
+      {
+      const itk::MutexLockHolder<itk::SimpleFastMutexLock> holder(BRAINSUtils::RegistrationCache::GetIOLock() );
+      writer->Update();
+      }
+    muLogMacro( << __FILE__ << " " << __LINE__ << " "  <<  std::endl );
+    }
+  intraSubjectRegistrationHelper->SetFixedBinaryVolume(m_InputSpatialObjectTissueRegion);
+
+  muLogMacro(<< "Registering (Rigid) image " << job.ModalityNumber << " to first image." << std::endl);
+  // For better registration, several linear registration methods are run,
+  // but at the end, rigid component is extracted from output linear transform.
+  std::vector<double> minimumStepSize(4);
+  minimumStepSize[0] = 0.00005;
+  minimumStepSize[1] = 0.005;
+  minimumStepSize[2] = 0.005;
+  minimumStepSize[3] = 0.005;
+  intraSubjectRegistrationHelper->SetMinimumStepLength(minimumStepSize);
+  std::vector<std::string> transformType(4);
+  transformType[0] = "Rigid";
+  transformType[1] = "ScaleVersor3D";
+  transformType[2] = "ScaleSkewVersor3D";
+  transformType[3] = "Affine";
+  intraSubjectRegistrationHelper->SetTransformType(transformType);
+  //
+  // intraSubjectRegistrationHelper->SetBackgroundFillValue(backgroundFillValue);
+  // NOT VALID When using initializeTransformMode
+  //
+  const std::string initializeTransformMode("useCenterOfHeadAlign");
+  intraSubjectRegistrationHelper->SetInitializeTransformMode(initializeTransformMode);
+  intraSubjectRegistrationHelper->SetMaskInferiorCutOffFromCenter(65.0); //
+  //
+  // maskInferiorCutOffFromCenter);
+  intraSubjectRegistrationHelper->SetCurrentGenericTransform(ITK_NULLPTR);
+  if( this->m_DebugLevel > 9 )
+    {
+    std::stringstream   ss;
+    ss << std::setw(3) << std::setfill('0') << job.RegistrationNumber;
+    intraSubjectRegistrationHelper->PrintCommandLine(true, std::string("IntraSubjectRegistration") + ss.str() );
+    muLogMacro( << __FILE__ << " " << __LINE__ << " "  <<  std::endl );
+    }
+  intraSubjectRegistrationHelper->Update();
+  const unsigned int actualIterations = intraSubjectRegistrationHelper->GetActualNumberOfIterations();
+  muLogMacro( << "Registration tool " << actualIterations << " iterations." << std::endl );
+  itk::VersorRigid3DTransform<double>::Pointer versorRigid = itk::ComputeRigidTransformFromGeneric(
+    intraSubjectRegistrationHelper->GetCurrentGenericTransform()->GetNthTransform(0).GetPointer() );
+  GenericTransformType::Pointer p = versorRigid.GetPointer();
+  return p;
+}
+
+template <class TOutputPixel, class TProbabilityPixel>
+BRAINSUtils::RegistrationCacheKey
+AtlasRegistrationMethod<TOutputPixel, TProbabilityPixel>
+::IntraSubjectRegistrationCacheKey(const InternalImageType *movingImage) const
+{
+  BRAINSUtils::RegistrationCacheKey key(m_IntraSubjectRegistrationBaseKey);
+
+  key.AddImage("moving", movingImage);
+  return key;
 }
 
 template <class TOutputPixel, class TProbabilityPixel>
@@ -392,7 +563,9 @@ AtlasRegistrationMethod<TOutputPixel, TProbabilityPixel>
   /*****  Shortcut if the registration has been done previously. ******/
   // If this final transform filename exists,
   // it will be just read in and will be used directly
-  // without doing the registration.
+  // without doing the registration.  Otherwise a registration of the same
+  // images, masks, initial transform and settings is reused from the
+  // registration cache further down, like the intra subject ones.
   if( itksys::SystemTools::FileExists( this->m_AtlasToSubjectTransformFileName.c_str() ) )
     {
     try
@@ -488,6 +661,8 @@ AtlasRegistrationMethod<TOutputPixel, TProbabilityPixel>
       }
     // Register all atlas images to first image
     // Set the fixed and moving image
+    InternalImagePointer fixedImage2;
+    InternalImagePointer movingImage2;
     atlasToSubjectRegistrationHelper->SetFixedVolume(this->m_ModalityAveragedOfIntraSubjectImages[0]); // by AverageIntraSubjectRegisteredImages function
     atlasToSubjectRegistrationHelper->SetMovingVolume(this->GetFirstAtlasOriginalImage());
     InternalImagePointer SecondImagePointer = this->GetSecondModalityAtlasOriginalImage("T2");
@@ -501,8 +676,10 @@ AtlasRegistrationMethod<TOutputPixel, TProbabilityPixel>
         muLogMacro( << "Multimodal registration will be run using the first two modalities." <<   std::endl );
         muLogMacro( << "Number of modalities is: " << this->m_ModalityAveragedOfIntraSubjectImages.size() <<  std::endl );
         //std::cout<<this->GetSecondModalityAtlasOriginalImage("T2")<<std::endl;
-        atlasToSubjectRegistrationHelper->SetFixedVolume2(this->m_ModalityAveragedOfIntraSubjectImages[1]); // by AverageIntraSubjectRegisteredImages function
-        atlasToSubjectRegistrationHelper->SetMovingVolume2(SecondImagePointer);
+        fixedImage2 = this->m_ModalityAveragedOfIntraSubjectImages[1];
+        movingImage2 = SecondImagePointer;
+        atlasToSubjectRegistrationHelper->SetFixedVolume2(fixedImage2); // by AverageIntraSubjectRegisteredImages function
+        atlasToSubjectRegistrationHelper->SetMovingVolume2(movingImage2);
         }
     else
         {
@@ -518,7 +695,8 @@ AtlasRegistrationMethod<TOutputPixel, TProbabilityPixel>
     ROIFilter->SetClosingSize(closingSize);
     ROIFilter->SetDilateSize(dilateSize);
     ROIFilter->Update();
-    atlasToSubjectRegistrationHelper->SetMovingBinaryVolume(ROIFilter->GetSpatialObjectROI() );
+    ImageMaskPointer movingMask = ROIFilter->GetSpatialObjectROI();
+    atlasToSubjectRegistrationHelper->SetMovingBinaryVolume(movingMask);
     if( this->m_DebugLevel > 7 )
       {
       ByteImageType::Pointer movingMaskImage = ROIFilter->GetOutput();
@@ -543,7 +721,8 @@ AtlasRegistrationMethod<TOutputPixel, TProbabilityPixel>
     ROIFilter->SetClosingSize(closingSize);
     ROIFilter->SetDilateSize(dilateSize);
     ROIFilter->Update();
-    atlasToSubjectRegistrationHelper->SetFixedBinaryVolume(ROIFilter->GetSpatialObjectROI() );
+    ImageMaskPointer fixedMask = ROIFilter->GetSpatialObjectROI();
+    atlasToSubjectRegistrationHelper->SetFixedBinaryVolume(fixedMask);
     if( this->m_DebugLevel > 7 )
       {
       ByteImageType::Pointer fixedMaskImage = ROIFilter->GetOutput();
@@ -689,10 +868,43 @@ AtlasRegistrationMethod<TOutputPixel, TProbabilityPixel>
       muLogMacro( << __FILE__ << " " << __LINE__ << " "  <<   std::endl );
       originalAtlasToSubject++;
       }
-    atlasToSubjectRegistrationHelper->Update();
-    const unsigned int actualIterations = atlasToSubjectRegistrationHelper->GetActualNumberOfIterations();
-    muLogMacro( << "Registration tool " << actualIterations << " iterations." << std::endl );
-    m_AtlasToSubjectTransform = atlasToSubjectRegistrationHelper->GetCurrentGenericTransform();
+
+    // A SyN registration that saves or restores its state is not cached,
+    // the state is a result of its own.
+    const BRAINSUtils::RegistrationCache cache(m_RegistrationCacheDirectory);
+    const bool                           useCache = cache.IsEnabled() && m_SaveState.empty() && m_RestoreState.IsNull();
+    BRAINSUtils::RegistrationCacheKey    key("BRAINSABC AtlasToSubject");
+    GenericTransformType::Pointer        cachedTransform;
+    if( useCache )
+      {
+      key.AddParameter("settings", std::string(AtlasToSubjectRegistrationSignature) );
+      key.AddParameter("transform choice", m_AtlasLinearTransformChoice);
+      key.AddParameter("warp grid", m_WarpGrid);
+      key.AddImage("fixed", this->m_ModalityAveragedOfIntraSubjectImages[0].GetPointer() );
+      key.AddImage("moving", this->GetFirstAtlasOriginalImage().GetPointer() );
+      key.AddImage("fixed2", fixedImage2.GetPointer() );
+      key.AddImage("moving2", movingImage2.GetPointer() );
+      key.AddMask("fixed mask", fixedMask.GetPointer() );
+      key.AddMask("moving mask", movingMask.GetPointer() );
+      key.AddTransform("initial", this->m_AtlasToSubjectInitialTransform.GetPointer() );
+      cachedTransform = cache.FetchTransform(key);
+      }
+    if( cachedTransform.IsNotNull() )
+      {
+      muLogMacro(<< "Reusing cached atlas to subject registration " << key.GetDigest() << "." << std::endl);
+      m_AtlasToSubjectTransform = cachedTransform;
+      }
+    else
+      {
+      atlasToSubjectRegistrationHelper->Update();
+      const unsigned int actualIterations = atlasToSubjectRegistrationHelper->GetActualNumberOfIterations();
+      muLogMacro( << "Registration tool " << actualIterations << " iterations." << std::endl );
+      m_AtlasToSubjectTransform = atlasToSubjectRegistrationHelper->GetCurrentGenericTransform();
+      if( useCache )
+        {
+        cache.StoreTransform(key, m_AtlasToSubjectTransform);
+        }
+      }
 /*
     if( this->m_DebugLevel > 9 )
       {
@@ -870,6 +870,7 @@ int main(int argc, char * *argv)
 
   atlasreg->SetAtlasLinearTransformChoice(atlasToSubjectTransformType);
   atlasreg->SetImageLinearTransformChoice(subjectIntermodeTransformType);
+  atlasreg->SetRegistrationCacheDirectory(registrationCacheDirectory);
 
   atlasreg->SetWarpGrid(gridSize[0], gridSize[1], gridSize[2]);
   muLogMacro(<< "Registering and resampling images..." << std::endl);
@@ -56,6 +56,7 @@
 #include "BRAINSComputeLabels.h"
 #include "itkBRAINSROIAutoImageFilter.h"
 #include "BRAINSFitUtils.h"
+#include "BRAINSTransformOptimization.h"
 #ifdef USE_ANTS
 #include "BRAINSFitSyN.h"
 #endif
@@ -1640,12 +1641,17 @@ EMSegmentationFilter<TInputImage, TProbabilityImage>
     }
   std::vector<typename TInputImage::Pointer> warpedList(originalList.size() );
 
+  // All the images are mapped on the same grid
+  const GenericTransformType::ConstPointer fastTransform = ( originalList.size() > 1 )
+    ? BRAINSUtils::PrecomposeTransform(warpTransform, referenceOutput)
+    : BRAINSUtils::FlattenTransform(warpTransform);
+
   typedef itk::ResampleImageFilter<TInputImage, TInputImage> ResamplerType;
   for( unsigned int vIndex = 0; vIndex < originalList.size(); vIndex++ )
     {
     typename ResamplerType::Pointer warper = ResamplerType::New();
     warper->SetInput(originalList[vIndex]);
-    warper->SetTransform(warpTransform);
+    warper->SetTransform(fastTransform);
 
     // warper->SetInterpolator(linearInt); // Default is linear
     warper->SetOutputParametersFromImage(referenceOutput);
@@ -1667,6 +1673,10 @@ EMSegmentationFilter<TInputImage, TProbabilityImage>
 
   MapOfInputImageVectors warpedList;
 
+  // All the images are mapped on the same grid
+  const GenericTransformType::ConstPointer fastTransform =
+    BRAINSUtils::PrecomposeTransform(warpTransform, referenceOutput);
+
   for(typename MapOfInputImageVectors::iterator mapIt = originalList.begin();
       mapIt != originalList.end(); ++mapIt)
     {
@@ -1675,7 +1685,7 @@ EMSegmentationFilter<TInputImage, TProbabilityImage>
       {
       typename ResamplerType::Pointer warper = ResamplerType::New();
       warper->SetInput(*imIt);
-      warper->SetTransform(warpTransform);
+      warper->SetTransform(fastTransform);
 
       // warper->SetInterpolator(linearInt); // Default is linear
       warper->SetOutputParametersFromImage(referenceOutput);
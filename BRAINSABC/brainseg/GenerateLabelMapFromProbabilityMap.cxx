@@ -23,7 +23,7 @@
 #include "itkImage.h"
 #include "itkImageFileReader.h"
 #include "itkImageFileWriter.h"
-#include "itkImageRegionIterator.h"
+#include "itkMaximumProbabilityLabelImageFilter.h"
 #include <map>
 
 #include "GenerateLabelMapFromProbabilityMapCLP.h"
@@ -76,53 +76,21 @@ main(int argc, char *argv[])
     probabilityImages[indexInputImages] = probabilityReader->GetOutput();
     }
 
-  // crerate empty label maps
+  // create the label map: the index of the map of maximum probability
   std::cout << "Create Label Map" << std::endl;
   typedef unsigned int                             LabelMapPixelType;
   typedef itk::Image<LabelMapPixelType, Dimension> LabelMapImageType;
 
-  LabelMapImageType::Pointer labelImage = LabelMapImageType::New();
-
-  std::cerr << "here" << __FILE__ << " " << __LINE__ << std::endl;
-  std::cerr << " ProbImage:  " << probabilityImages[0] << std::endl;
-  labelImage->CopyInformation( probabilityImages[0] );
-  std::cerr << "here" << __FILE__ << " " << __LINE__ << std::endl;
-  labelImage->SetRegions( probabilityImages[0]->GetLargestPossibleRegion() );
-  std::cerr << "here" << __FILE__ << " " << __LINE__ << std::endl;
-  labelImage->Allocate();
-  std::cerr << "here" << __FILE__ << " " << __LINE__ << std::endl;
-  labelImage->FillBuffer(0);
-  std::cerr << "here" << __FILE__ << " " << __LINE__ << std::endl;
-
-  std::cout << "start iteration " << std::endl;
-  // Iterate Images
-  typedef itk::ImageRegionIterator<ProbabilityMapImageType> IteratorType;
-
-  IteratorType probabilityIterator( probabilityImages[0],
-                                    probabilityImages[0]->GetLargestPossibleRegion() );
-
-  typedef itk::ImageRegionIterator<LabelMapImageType> LabelIteratorType;
-  LabelIteratorType labelIterator( labelImage, labelImage->GetLargestPossibleRegion() );
-  for( probabilityIterator.GoToBegin(), labelIterator.GoToBegin();
-       !probabilityIterator.IsAtEnd();
-       ++probabilityIterator, ++labelIterator )
+  typedef itk::MaximumProbabilityLabelImageFilter<ProbabilityMapImageType, LabelMapImageType> LabelFilterType;
+  LabelFilterType::Pointer labelFilter = LabelFilterType::New();
+  for( unsigned int indexInputImages = 0;
+       indexInputImages < numberOfProbabilityMaps;
+       indexInputImages++ )
     {
-    ProbabilityMapPixelType max = probabilityIterator.Get();
-    LabelMapPixelType       label = 0;
-    for( unsigned int indexInputImages = 1; indexInputImages < numberOfProbabilityMaps;
-         indexInputImages++ )
-      {
-      ProbabilityMapPixelType pixelValue =
-        probabilityImages[indexInputImages]->GetPixel( probabilityIterator.GetIndex() );
-      if(  pixelValue > max )
-        {
-        max = pixelValue;
-        label = indexInputImages;
-        }
-      }
-
-    labelIterator.Set( label );
+    labelFilter->SetProbabilityImage( indexInputImages, probabilityImages[indexInputImages] );
     }
+  labelFilter->Update();
+  LabelMapImageType::Pointer labelImage = labelFilter->GetOutput();
 
   // Image Writer
   typedef itk::ImageFileWriter<LabelMapImageType> LabelWriterType;
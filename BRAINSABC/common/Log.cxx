@@ -98,6 +98,7 @@ Log
     return;
     }
 
+  m_WriteLock.Lock();
   if( m_Output.good() )
     {
     m_Output << s;
@@ -109,6 +110,7 @@ Log
     std::cout << s;
     (std::cout).flush();
     }
+  m_WriteLock.Unlock();
 }
 
 void
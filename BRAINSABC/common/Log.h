@@ -34,6 +34,8 @@
 #include <string>
 #include <sstream>
 
+#include "itkSimpleFastMutexLock.h"
+
 namespace mu
 {
 /** \class Log
@@ -82,6 +84,9 @@ private:
   std::ofstream m_Output;
 
   std::string m_OutputFileName;
+
+  // Messages written from several threads are not interleaved
+  itk::SimpleFastMutexLock m_WriteLock;
 };
 } // namespace mu
 
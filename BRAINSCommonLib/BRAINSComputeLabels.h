@@ -20,18 +20,16 @@
 #define BRAINSComputeLabels_h
 
 #include <iostream>
+#include <map>
 #include <vector>
 #include <itkImage.h>
 #include <vnl/vnl_vector.h>
 #include "ExtractSingleLargestRegion.h"
 #include "itkMultiplyImageFilter.h"
-
-#include "itkLabelStatisticsImageFilter.h"
+#include "itkMaximumProbabilityLabelImageFilter.h"
 
 typedef std::map<size_t,size_t> LabelCountMapType;
 typedef itk::Image<unsigned char, 3>       ByteImageType;
-extern LabelCountMapType GetMinLabelCount(ByteImageType::Pointer & labelsImage,
-                                          const vnl_vector<unsigned int> & PriorLabelCodeVector);
 // Labeling using maximum a posteriori, also do brain stripping using
 // mathematical morphology and connected component
 template <class TProbabilityImage, class TByteImage,
@@ -54,16 +52,14 @@ void ComputeLabels(
     reverseLabelMap[PriorLabelCodeVector[i] ] = i;
     }
 
-  const unsigned int numClasses = Posteriors.size();
-  const typename TProbabilityImage::RegionType region = Posteriors[0]->GetLargestPossibleRegion();
-  DirtyLabels = TByteImage::New();
-  DirtyLabels->CopyInformation(Posteriors[0]);
-  DirtyLabels->SetRegions(region);
-  DirtyLabels->Allocate();
-  typename TByteImage::Pointer foregroundMask = TByteImage::New();
-  foregroundMask->CopyInformation(Posteriors[0]);
-  foregroundMask->SetRegions(region);
-  foregroundMask->Allocate();
+  typedef itk::MaximumProbabilityLabelImageFilter<TProbabilityImage, TByteImage> LabelFilterType;
+  typename LabelFilterType::LabelCodeVectorType labelCodes(PriorLabelCodeVector.size() );
+  for( size_t i = 0; i < PriorLabelCodeVector.size(); ++i )
+    {
+    labelCodes[i] = static_cast<typename TByteImage::PixelType>( PriorLabelCodeVector[i] );
+    }
+
+  typename TByteImage::Pointer foregroundMask;
 
   size_t currentMinLabelSize = 0;
   const unsigned short max_iterations = 10; // Prevent infinite looping, just fail
@@ -77,64 +73,38 @@ void ComputeLabels(
       std::cout << "        Check input images to ensure proper intializaiton was completed." << std::endl;
       exit(-1);
       }
-    DirtyLabels->FillBuffer(0);
-    foregroundMask->FillBuffer(0);
-    typedef unsigned int LocalLOOPITERTYPE;
-    const typename TByteImage::SizeType size = DirtyLabels->GetLargestPossibleRegion().GetSize();
+    // Outside the tissue region the label is zero.  Inside, the label of the
+    // class of maximum posterior, or 99 when that posterior is not above the
+    // inclusion threshold.  Only foreground classes with a posterior of at
+    // least 0.001 are part of the foreground mask.  The label counts are
+    // computed in the same pass.
+    typename LabelFilterType::Pointer labelFilter = LabelFilterType::New();
+    for( unsigned int iclass = 0; iclass < Posteriors.size(); iclass++ )
       {
-      for( LocalLOOPITERTYPE kk = 0; kk < (LocalLOOPITERTYPE)size[2]; kk++ )
-        {
-        for( LocalLOOPITERTYPE jj = 0; jj < (LocalLOOPITERTYPE)size[1]; jj++ )
-          {
-          for( LocalLOOPITERTYPE ii = 0; ii < (LocalLOOPITERTYPE)size[0]; ii++ )
-            {
-            const typename TProbabilityImage::IndexType currIndex = {{ii, jj, kk}};
-            if( NonAirRegion->GetPixel(currIndex) == 0 ) // If outside the tissue
-              // region, then set to
-              // zero vIndex!
-              {
-              // TODO:  May want to specify this explicitly in the XML file for
-              // the proper background value
-              DirtyLabels->SetPixel(currIndex, 0); // This is implied by the
-              // FillBuffer(0) above;
-              continue;
-              }
-
-            TFloatingPrecision maxPosteriorClassValue = Posteriors[0]->GetPixel(currIndex);
-            unsigned int       indexMaxPosteriorClassValue = 0;
-            for( unsigned int iclass = 1; iclass < numClasses; iclass++ )
-              {
-              const TFloatingPrecision currentPosteriorClassValue = Posteriors[iclass]->GetPixel(currIndex);
-              if( currentPosteriorClassValue > maxPosteriorClassValue )
-                {
-                maxPosteriorClassValue = currentPosteriorClassValue;
-                indexMaxPosteriorClassValue = iclass;
-                }
-              }
-
-              {
-              bool         fgflag = PriorIsForegroundPriorVector[indexMaxPosteriorClassValue];
-              unsigned int label = 99;
-              if( maxPosteriorClassValue > InclusionThreshold )
-                {
-                label = PriorLabelCodeVector[indexMaxPosteriorClassValue];
-                }
+      labelFilter->SetProbabilityImage(iclass, Posteriors[iclass]);
+      }
+    labelFilter->SetMaskImage(NonAirRegion);
+    labelFilter->SetLabelCodes(labelCodes);
+    labelFilter->SetForegroundClasses(PriorIsForegroundPriorVector);
+    labelFilter->SetBackgroundLabel(0);
+    labelFilter->SetBelowThresholdLabel(99);
+    labelFilter->SetInclusionThreshold(InclusionThreshold);
+    labelFilter->SetMinimumForegroundProbability(0.001);
+    labelFilter->Update();
+    DirtyLabels = labelFilter->GetOutput();
+    foregroundMask = labelFilter->GetForegroundMask();
 
-              // Only use non-zero probabilities and foreground classes
-              if( !fgflag || ( maxPosteriorClassValue < 0.001 ) )
-                {
-                fgflag = false; // If priors are zero or negative, then set the
-                // fgflag back to false
-                }
-              DirtyLabels->SetPixel(currIndex, label);
-              foregroundMask->SetPixel(currIndex, fgflag);
-              }
-            }
-          }
-        }
+    LabelCountMapType currentLabelsMapCounts;
+    for( size_t iclass = 0; iclass < PriorLabelCodeVector.size(); ++iclass )
+      {
+      currentLabelsMapCounts[static_cast<size_t>( PriorLabelCodeVector[iclass] )] =
+        labelFilter->GetLabelCount(labelCodes[iclass]);
+      }
+    for( LabelCountMapType::const_iterator it = currentLabelsMapCounts.begin();
+         it != currentLabelsMapCounts.end(); ++it )
+      {
+      std::cout << "label: " << it->first << " count: " << it->second << std::endl;
       }
-    //
-    LabelCountMapType currentLabelsMapCounts = GetMinLabelCount( DirtyLabels, PriorLabelCodeVector );
     currentMinLabelSize = currentLabelsMapCounts.begin()->second;
     for( typename LabelCountMapType::const_iterator it = currentLabelsMapCounts.begin();
           it != currentLabelsMapCounts.end(); ++it)
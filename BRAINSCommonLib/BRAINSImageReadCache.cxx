@@ -0,0 +1,155 @@
+/*=========================================================================
+ *
+ *  Copyright SINAPSE: Scalable Informatics for Neuroscience, Processing and Software Engineering
+ *            The University of Iowa
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#include "BRAINSImageReadCache.h"
+#include "itkMutexLockHolder.h"
+#include "itksys/SystemTools.hxx"
+#include <cstdlib>
+#include <sstream>
+
+namespace itkUtil
+{
+ImageReadCache::ImageReadCache() :
+  m_MaximumSize(2048ULL << 20),
+  m_Size(0)
+{
+  std::string environmentValue;
+  if( itksys::SystemTools::GetEnv("BRAINS_IMAGE_CACHE_SIZE_MIB", environmentValue) )
+    {
+    m_MaximumSize = static_cast<unsigned long long>( std::strtoul(environmentValue.c_str(), ITK_NULLPTR, 10) ) << 20;
+    }
+}
+
+ImageReadCache &
+ImageReadCache::GetInstance()
+{
+  static ImageReadCache instance;
+
+  return instance;
+}
+
+std::string
+ImageReadCache::MakeKey(const std::string & fileName, const std::string & typeName)
+{
+  if( !itksys::SystemTools::FileExists(fileName.c_str(), true) )
+    {
+    return std::string();
+    }
+  std::ostringstream key;
+  key << itksys::SystemTools::GetRealPath(fileName) << '\n'
+      << itksys::SystemTools::ModifiedTime(fileName) << '\n'
+      << itksys::SystemTools::FileLength(fileName) << '\n'
+      << typeName;
+  return key.str();
+}
+
+std::string
+ImageReadCache::MakeDirectoryKey(const std::string & directory)
+{
+  std::ostringstream key;
+
+  key << itksys::SystemTools::GetRealPath(directory) << '\n'
+      << itksys::SystemTools::ModifiedTime(directory);
+  return key.str();
+}
+
+itk::DataObject::Pointer
+ImageReadCache::Find(const std::string & key)
+{
+  itk::MutexLockHolder<itk::SimpleFastMutexLock> holder(m_Lock);
+
+  std::map<std::string, EntryListType::iterator>::iterator it = m_Index.find(key);
+  if( it == m_Index.end() )
+    {
+    return ITK_NULLPTR;
+    }
+  m_Entries.splice(m_Entries.begin(), m_Entries, it->second);
+  return it->second->Image;
+}
+
+void
+ImageReadCache::Insert(const std::string & key, itk::DataObject *image, const unsigned long long sizeInBytes)
+{
+  if( !this->IsEnabled() || key.empty() || sizeInBytes > m_MaximumSize )
+    {
+    return;
+    }
+  itk::MutexLockHolder<itk::SimpleFastMutexLock> holder(m_Lock);
+
+  if( m_Index.find(key) != m_Index.end() )
+    {
+    return; // read concurrently by another thread
+    }
+  Entry entry;
+  entry.Key = key;
+  entry.Image = image;
+  entry.Size = sizeInBytes;
+  m_Entries.push_front(entry);
+  m_Index[key] = m_Entries.begin();
+  m_Size += sizeInBytes;
+  while( m_Size > m_MaximumSize )
+    {
+    m_Size -= m_Entries.back().Size;
+    m_Index.erase(m_Entries.back().Key);
+    m_Entries.pop_back();
+    }
+}
+
+bool
+ImageReadCache::FindDICOMSeries(const std::string & directory, std::vector<std::string> & fileNames)
+{
+  const std::string key = MakeDirectoryKey(directory);
+
+  itk::MutexLockHolder<itk::SimpleFastMutexLock> holder(m_Lock);
+  std::map<std::string, std::vector<std::string> >::const_iterator it = m_DICOMSeries.find(key);
+  if( it == m_DICOMSeries.end() )
+    {
+    return false;
+    }
+  fileNames = it->second;
+  return true;
+}
+
+void
+ImageReadCache::InsertDICOMSeries(const std::string & directory, const std::vector<std::string> & fileNames)
+{
+  const std::string key = MakeDirectoryKey(directory);
+
+  itk::MutexLockHolder<itk::SimpleFastMutexLock> holder(m_Lock);
+  m_DICOMSeries[key] = fileNames;
+}
+
+bool
+ImageReadCache::IsEmpty()
+{
+  itk::MutexLockHolder<itk::SimpleFastMutexLock> holder(m_Lock);
+
+  return m_Entries.empty();
+}
+
+void
+ImageReadCache::Clear()
+{
+  itk::MutexLockHolder<itk::SimpleFastMutexLock> holder(m_Lock);
+
+  m_Entries.clear();
+  m_Index.clear();
+  m_DICOMSeries.clear();
+  m_Size = 0;
+}
+}
@@ -0,0 +1,95 @@
+/*=========================================================================
+ *
+ *  Copyright SINAPSE: Scalable Informatics for Neuroscience, Processing and Software Engineering
+ *            The University of Iowa
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#ifndef __BRAINSImageReadCache_h
+#define __BRAINSImageReadCache_h
+
+#include "itkDataObject.h"
+#include "itkSimpleFastMutexLock.h"
+#include <list>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace itkUtil
+{
+/**
+ * \class ImageReadCache
+ * \brief Process wide cache of the images read by itkUtil::ReadConstImage().
+ *
+ * Images are keyed by the full path, the modification time and the size of
+ * their file and by the image type they were read as, so a file that is
+ * rewritten is read again.  The cached images are shared read-only; the
+ * least recently used ones are released when the total size of the pixels
+ * goes over the limit, 2048 MiB unless the BRAINS_IMAGE_CACHE_SIZE_MIB
+ * environment variable says otherwise (0 disables the cache).
+ *
+ * The file names of the first DICOM series of a directory are also kept,
+ * keyed by the directory and its modification time, so the slices of a
+ * series are not scanned again for every read.
+ */
+class ImageReadCache
+{
+public:
+  static ImageReadCache & GetInstance();
+
+  /** Key of a file read as typeName, empty when the file does not exist */
+  static std::string MakeKey(const std::string & fileName, const std::string & typeName);
+
+  bool IsEnabled() const
+  {
+    return m_MaximumSize > 0;
+  }
+
+  /** True when no image is cached, so a lookup cannot hit */
+  bool IsEmpty();
+
+  /** Cached image of key, or null */
+  itk::DataObject::Pointer Find(const std::string & key);
+
+  void Insert(const std::string & key, itk::DataObject *image, const unsigned long long sizeInBytes);
+
+  bool FindDICOMSeries(const std::string & directory, std::vector<std::string> & fileNames);
+
+  void InsertDICOMSeries(const std::string & directory, const std::vector<std::string> & fileNames);
+
+  void Clear();
+
+private:
+  ImageReadCache();
+
+  struct Entry
+    {
+    std::string              Key;
+    itk::DataObject::Pointer Image;
+    unsigned long long       Size;
+    };
+  typedef std::list<Entry> EntryListType; // most recently used first
+
+  static std::string MakeDirectoryKey(const std::string & directory);
+
+  itk::SimpleFastMutexLock                             m_Lock;
+  unsigned long long                                   m_MaximumSize;
+  unsigned long long                                   m_Size;
+  EntryListType                                        m_Entries;
+  std::map<std::string, EntryListType::iterator>       m_Index;
+  std::map<std::string, std::vector<std::string> >     m_DICOMSeries;
+};
+}
+
+#endif // __BRAINSImageReadCache_h
@@ -0,0 +1,360 @@
+/*=========================================================================
+ *
+ *  Copyright SINAPSE: Scalable Informatics for Neuroscience, Processing and Software Engineering
+ *            The University of Iowa
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#include "BRAINSRegistrationCache.h"
+#include "BRAINSToolsVersion.h"
+#include "GenericTransformImage.h"
+#include "itkCompositeTransform.h"
+#include "itkMutexLockHolder.h"
+#include "itksys/Directory.hxx"
+#include "itksys/MD5.h"
+#include "itksys/SystemTools.hxx"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <utility>
+#ifdef _WIN32
+#include <process.h>
+#define BRAINSRegistrationCacheGetPID _getpid
+#else
+#include <unistd.h>
+#define BRAINSRegistrationCacheGetPID getpid
+#endif
+
+namespace BRAINSUtils
+{
+RegistrationCacheKey::RegistrationCacheKey(const std::string & kind) :
+  m_Valid(true)
+{
+  this->AddText("BRAINSTools", BRAINSTools::Version::ExtendedVersionString() );
+  this->AddText("kind", kind);
+}
+
+void
+RegistrationCacheKey::AddMask(const std::string & name, const itk::SpatialObject<3> *mask)
+{
+  if( mask == ITK_NULLPTR )
+    {
+    this->AddText(name, "none");
+    return;
+    }
+  typedef itk::ImageMaskSpatialObject<3> ImageMaskSpatialObjectType;
+  const ImageMaskSpatialObjectType *imageMask = dynamic_cast<const ImageMaskSpatialObjectType *>( mask );
+  if( imageMask == ITK_NULLPTR )
+    {
+    m_Valid = false;
+    return;
+    }
+  this->AddImage(name, imageMask->GetImage() );
+}
+
+void
+RegistrationCacheKey::AddTransform(const std::string & name, const itk::TransformBase *transform)
+{
+  if( transform == ITK_NULLPTR )
+    {
+    this->AddText(name, "none");
+    return;
+    }
+
+  std::vector<const itk::TransformBase *> components;
+  typedef itk::CompositeTransform<double, 3> CompositeTransformType;
+  const CompositeTransformType *composite = dynamic_cast<const CompositeTransformType *>( transform );
+  if( composite != ITK_NULLPTR )
+    {
+    for( size_t i = 0; i < composite->GetNumberOfTransforms(); ++i )
+      {
+      components.push_back( composite->GetNthTransformConstPointer(i) );
+      }
+    }
+  else
+    {
+    components.push_back(transform);
+    }
+
+  std::ostringstream text;
+  for( size_t i = 0; i < components.size(); ++i )
+    {
+    const itk::TransformBase::ParametersType & parameters = components[i]->GetParameters();
+    const itk::TransformBase::ParametersType & fixedParameters = components[i]->GetFixedParameters();
+    text << components[i]->GetTransformTypeAsString()
+         << " " << ComputeDigest(parameters.data_block(), parameters.size() * sizeof( parameters[0] ) )
+         << " " << ComputeDigest(fixedParameters.data_block(), fixedParameters.size() * sizeof( fixedParameters[0] ) )
+         << ";";
+    }
+  this->AddText(name, text.str() );
+}
+
+std::string
+RegistrationCacheKey::GetDigest() const
+{
+  return ComputeDigest(m_Text.data(), m_Text.size() );
+}
+
+std::string
+RegistrationCacheKey::ComputeDigest(const void *data, size_t length)
+{
+  itksysMD5 *md5 = itksysMD5_New();
+
+  itksysMD5_Initialize(md5);
+  const unsigned char *bytes = static_cast<const unsigned char *>( data );
+  const size_t         chunk = 1UL << 30;
+  while( length > 0 )
+    {
+    const size_t n = std::min(length, chunk);
+    itksysMD5_Append(md5, bytes, static_cast<int>( n ) );
+    bytes += n;
+    length -= n;
+    }
+  char digest[32];
+  itksysMD5_FinalizeHex(md5, digest);
+  itksysMD5_Delete(md5);
+  return std::string(digest, 32);
+}
+
+void
+RegistrationCacheKey::AddText(const std::string & name, const std::string & text)
+{
+  // Length prefixes keep the concatenation unambiguous
+  std::ostringstream entry;
+
+  entry << name.size() << ':' << name << text.size() << ':' << text << '\n';
+  m_Text += entry.str();
+}
+
+RegistrationCache::RegistrationCache(const std::string & directory, const unsigned long maximumSizeInMiB) :
+  m_Directory(directory),
+  m_MaximumSize(static_cast<unsigned long long>( maximumSizeInMiB ) << 20)
+{
+  std::string environmentValue;
+  if( m_Directory.empty() && itksys::SystemTools::GetEnv("BRAINS_REGISTRATION_CACHE", environmentValue) )
+    {
+    m_Directory = environmentValue;
+    }
+  if( m_MaximumSize == 0 && itksys::SystemTools::GetEnv("BRAINS_REGISTRATION_CACHE_SIZE_MIB", environmentValue) )
+    {
+    m_MaximumSize = static_cast<unsigned long long>( std::strtoul(environmentValue.c_str(), ITK_NULLPTR, 10) ) << 20;
+    }
+  if( !m_Directory.empty() && !itksys::SystemTools::MakeDirectory(m_Directory.c_str() ) )
+    {
+    std::cerr << "WARNING: Can not create the registration cache directory " << m_Directory
+              << ", the cache is disabled." << std::endl;
+    m_Directory.clear();
+    }
+}
+
+RegistrationCache::GenericTransformType::Pointer
+RegistrationCache::FetchTransform(const RegistrationCacheKey & key) const
+{
+  GenericTransformType::Pointer transform;
+
+  if( !this->IsEnabled() || !key.IsValid() )
+    {
+    return transform;
+    }
+  const std::string entryFileName = this->EntryFileName(key, ".h5");
+  if( !itksys::SystemTools::FileExists(entryFileName.c_str(), true) )
+    {
+    return transform;
+    }
+  try
+    {
+    itk::MutexLockHolder<itk::SimpleFastMutexLock> holder(GetIOLock() );
+    transform = itk::ReadTransformFromDisk(entryFileName);
+    }
+  catch( itk::ExceptionObject & )
+    {
+    // An entry that can not be read is a miss; it is replaced by the next store
+    transform = ITK_NULLPTR;
+    return transform;
+    }
+  itksys::SystemTools::Touch(entryFileName, false);
+  return transform;
+}
+
+void
+RegistrationCache::StoreTransform(const RegistrationCacheKey & key, const GenericTransformType *transform) const
+{
+  if( !this->IsEnabled() || !key.IsValid() || transform == ITK_NULLPTR )
+    {
+    return;
+    }
+  const std::string temporaryFileName = this->TemporaryFileName(".h5");
+  try
+    {
+    itk::MutexLockHolder<itk::SimpleFastMutexLock> holder(GetIOLock() );
+    itk::WriteTransformToDisk<double, double>(transform, temporaryFileName);
+    }
+  catch( itk::ExceptionObject & excp )
+    {
+    std::cerr << "WARNING: Can not write to the registration cache: " << excp << std::endl;
+    itksys::SystemTools::RemoveFile(temporaryFileName.c_str() );
+    return;
+    }
+  this->Commit(temporaryFileName, this->EntryFileName(key, ".h5") );
+}
+
+bool
+RegistrationCache::FetchFile(const RegistrationCacheKey & key, const std::string & extension,
+                             const std::string & destination) const
+{
+  if( !this->IsEnabled() || !key.IsValid() || !IsEntryExtension(extension) )
+    {
+    return false;
+    }
+  const std::string entryFileName = this->EntryFileName(key, extension);
+  if( !itksys::SystemTools::FileExists(entryFileName.c_str(), true)
+      || !itksys::SystemTools::CopyFileAlways(entryFileName, destination) )
+    {
+    return false;
+    }
+  itksys::SystemTools::Touch(entryFileName, false);
+  return true;
+}
+
+void
+RegistrationCache::StoreFile(const RegistrationCacheKey & key, const std::string & extension,
+                             const std::string & source) const
+{
+  if( !this->IsEnabled() || !key.IsValid() )
+    {
+    return;
+    }
+  if( !IsEntryExtension(extension) )
+    {
+    std::cerr << "WARNING: Can not store " << extension << " files in the registration cache." << std::endl;
+    return;
+    }
+  const std::string temporaryFileName = this->TemporaryFileName(extension);
+  if( !itksys::SystemTools::CopyFileAlways(source, temporaryFileName) )
+    {
+    std::cerr << "WARNING: Can not write " << source << " to the registration cache." << std::endl;
+    itksys::SystemTools::RemoveFile(temporaryFileName.c_str() );
+    return;
+    }
+  this->Commit(temporaryFileName, this->EntryFileName(key, extension) );
+}
+
+bool
+RegistrationCache::IsEntryExtension(const std::string & extension)
+{
+  return extension == ".h5" || extension == ".nrrd" || extension == ".nii.gz"
+         || extension == ".mat" || extension == ".txt";
+}
+
+bool
+RegistrationCache::IsEntryName(const std::string & name)
+{
+  const size_t digestLength = 32;
+
+  if( name.size() <= digestLength )
+    {
+    return false;
+    }
+  for( size_t i = 0; i < digestLength; ++i )
+    {
+    if( !( ( name[i] >= '0' && name[i] <= '9' ) || ( name[i] >= 'a' && name[i] <= 'f' ) ) )
+      {
+      return false;
+      }
+    }
+  return IsEntryExtension(name.substr(digestLength) );
+}
+
+itk::SimpleFastMutexLock &
+RegistrationCache::GetIOLock()
+{
+  static itk::SimpleFastMutexLock ioLock;
+
+  return ioLock;
+}
+
+std::string
+RegistrationCache::EntryFileName(const RegistrationCacheKey & key, const std::string & extension) const
+{
+  return m_Directory + "/" + key.GetDigest() + extension;
+}
+
+std::string
+RegistrationCache::TemporaryFileName(const std::string & extension) const
+{
+  static itk::SimpleFastMutexLock counterLock;
+  static unsigned long            counter = 0;
+  unsigned long                   n;
+  {
+  itk::MutexLockHolder<itk::SimpleFastMutexLock> holder(counterLock);
+  n = counter++;
+  }
+  std::ostringstream name;
+  name << m_Directory << "/tmp-" << BRAINSRegistrationCacheGetPID() << "-" << n << extension;
+  return name.str();
+}
+
+void
+RegistrationCache::Commit(const std::string & temporaryFileName, const std::string & entryFileName) const
+{
+  // Another process may have stored the same entry in the meantime, which is
+  // harmless: both hold the same result.
+  itksys::SystemTools::RemoveFile(entryFileName.c_str() );
+  if( std::rename(temporaryFileName.c_str(), entryFileName.c_str() ) != 0 )
+    {
+    itksys::SystemTools::RemoveFile(temporaryFileName.c_str() );
+    return;
+    }
+  this->Evict();
+}
+
+void
+RegistrationCache::Evict() const
+{
+  if( m_MaximumSize == 0 )
+    {
+    return;
+    }
+  itksys::Directory directory;
+  if( !directory.Load(m_Directory) )
+    {
+    return;
+    }
+
+  typedef std::pair<long int, std::string> EntryType; // modified time, file name
+  std::vector<EntryType> entries;
+  unsigned long long     totalSize = 0;
+  for( unsigned long i = 0; i < directory.GetNumberOfFiles(); ++i )
+    {
+    // Temporary files, and anything else that is not an entry, are left alone
+    const std::string name = directory.GetFile(i);
+    const std::string fileName = m_Directory + "/" + name;
+    if( !IsEntryName(name) || itksys::SystemTools::FileIsDirectory(fileName) )
+      {
+      continue;
+      }
+    totalSize += itksys::SystemTools::FileLength(fileName);
+    entries.push_back(EntryType(itksys::SystemTools::ModifiedTime(fileName), fileName) );
+    }
+  std::sort(entries.begin(), entries.end() );
+  for( size_t i = 0; i < entries.size() && totalSize > m_MaximumSize; ++i )
+    {
+    const unsigned long long size = itksys::SystemTools::FileLength(entries[i].second);
+    if( itksys::SystemTools::RemoveFile(entries[i].second) )
+      {
+      totalSize -= std::min(size, totalSize);
+      }
+    }
+}
+}
@@ -0,0 +1,246 @@
+/*=========================================================================
+ *
+ *  Copyright SINAPSE: Scalable Informatics for Neuroscience, Processing and Software Engineering
+ *            The University of Iowa
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#ifndef __BRAINSRegistrationCache_h
+#define __BRAINSRegistrationCache_h
+
+#include "itkImageMaskSpatialObject.h"
+#include "itkImageFileReader.h"
+#include "itkImageFileWriter.h"
+#include "itkSimpleFastMutexLock.h"
+#include "itkTransform.h"
+#include "itksys/SystemTools.hxx"
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace BRAINSUtils
+{
+/**
+ * \class RegistrationCacheKey
+ * \brief Digest of everything the result of a registration depends on.
+ *
+ * Images and masks are hashed by content (pixels and geometry), so a key
+ * does not depend on file names, and transforms by their parameters.  The
+ * BRAINSTools version is part of every key, so results computed by another
+ * build are never reused.  A key is not valid when one of its inputs can
+ * not be hashed, e.g. a mask that is not an image mask.
+ */
+class RegistrationCacheKey
+{
+public:
+  explicit RegistrationCacheKey(const std::string & kind = "");
+
+  template <class TImage>
+  void AddImage(const std::string & name, const TImage *image)
+  {
+    if( image == ITK_NULLPTR )
+      {
+      this->AddText(name, "none");
+      return;
+      }
+    std::ostringstream geometry;
+    geometry.precision(17);
+    geometry << image->GetBufferedRegion().GetIndex() << image->GetBufferedRegion().GetSize()
+             << image->GetSpacing() << image->GetOrigin() << image->GetDirection()
+             << image->GetNumberOfComponentsPerPixel();
+    this->AddText(name, geometry.str() + " "
+                  + ComputeDigest(image->GetBufferPointer(),
+                                  image->GetPixelContainer()->Size()
+                                  * sizeof( typename TImage::PixelContainer::Element ) ) );
+  }
+
+  void AddMask(const std::string & name, const itk::SpatialObject<3> *mask);
+
+  void AddTransform(const std::string & name, const itk::TransformBase *transform);
+
+  template <class T>
+  void AddParameter(const std::string & name, const T & value)
+  {
+    std::ostringstream text;
+
+    text.precision(17);
+    text << value;
+    this->AddText(name, text.str() );
+  }
+
+  template <class T>
+  void AddParameter(const std::string & name, const std::vector<T> & values)
+  {
+    std::ostringstream text;
+
+    text.precision(17);
+    for( size_t i = 0; i < values.size(); ++i )
+      {
+      text << values[i] << ',';
+      }
+    this->AddText(name, text.str() );
+  }
+
+  bool IsValid() const
+  {
+    return m_Valid;
+  }
+
+  /** Hexadecimal MD5 of the key, the name of its cache entries */
+  std::string GetDigest() const;
+
+  static std::string ComputeDigest(const void *data, size_t length);
+
+private:
+  void AddText(const std::string & name, const std::string & text);
+
+  std::string m_Text;
+  bool        m_Valid;
+};
+
+/**
+ * \class RegistrationCache
+ * \brief On disk cache of registration results shared by the BRAINSTools
+ * executables.
+ *
+ * Entries are files named after the digest of their key, with one of the
+ * extensions of IsEntryExtension(); only those files are counted and
+ * removed, so the directory may hold other files.  They are written
+ * to a temporary file that is renamed into place, so concurrent processes
+ * never read a partial entry.  The entries are touched when they are
+ * reused, and the least recently used ones are removed when the total size
+ * goes over the limit.
+ *
+ * The cache directory and the size limit are taken from the
+ * BRAINS_REGISTRATION_CACHE and BRAINS_REGISTRATION_CACHE_SIZE_MIB
+ * environment variables unless they are given explicitly.  Without a
+ * directory the cache is disabled: fetches miss and stores do nothing.
+ *
+ * Transform files are read and written under GetIOLock(), which callers
+ * that write transforms from several threads should use as well, because
+ * the HDF5 library is not thread safe.
+ */
+class RegistrationCache
+{
+public:
+  typedef itk::Transform<double, 3, 3> GenericTransformType;
+
+  explicit RegistrationCache(const std::string & directory = "", const unsigned long maximumSizeInMiB = 0);
+
+  bool IsEnabled() const
+  {
+    return !m_Directory.empty();
+  }
+
+  const std::string & GetDirectory() const
+  {
+    return m_Directory;
+  }
+
+  /** Transform of the entry of key, or null on a miss */
+  GenericTransformType::Pointer FetchTransform(const RegistrationCacheKey & key) const;
+
+  void StoreTransform(const RegistrationCacheKey & key, const GenericTransformType *transform) const;
+
+  /** Copy the file of the entry of key to destination, false on a miss */
+  bool FetchFile(const RegistrationCacheKey & key, const std::string & extension,
+                 const std::string & destination) const;
+
+  void StoreFile(const RegistrationCacheKey & key, const std::string & extension,
+                 const std::string & source) const;
+
+  /** Image of the entry of key, or null on a miss */
+  template <class TImage>
+  typename TImage::Pointer FetchImage(const RegistrationCacheKey & key) const
+  {
+    typename TImage::Pointer image;
+
+    if( !this->IsEnabled() || !key.IsValid() )
+      {
+      return image;
+      }
+    const std::string entryFileName = this->EntryFileName(key, ".nrrd");
+    if( !itksys::SystemTools::FileExists(entryFileName.c_str(), true) )
+      {
+      return image;
+      }
+    try
+      {
+      typename itk::ImageFileReader<TImage>::Pointer reader = itk::ImageFileReader<TImage>::New();
+      reader->SetFileName(entryFileName);
+      reader->Update();
+      image = reader->GetOutput();
+      }
+    catch( itk::ExceptionObject & )
+      {
+      // An entry that can not be read is a miss; it is replaced by the next store
+      image = ITK_NULLPTR;
+      return image;
+      }
+    itksys::SystemTools::Touch(entryFileName, false);
+    return image;
+  }
+
+  template <class TImage>
+  void StoreImage(const RegistrationCacheKey & key, const TImage *image) const
+  {
+    if( !this->IsEnabled() || !key.IsValid() || image == ITK_NULLPTR )
+      {
+      return;
+      }
+    const std::string temporaryFileName = this->TemporaryFileName(".nrrd");
+    try
+      {
+      typename itk::ImageFileWriter<TImage>::Pointer writer = itk::ImageFileWriter<TImage>::New();
+      writer->SetFileName(temporaryFileName);
+      writer->SetInput(image);
+      writer->Update();
+      }
+    catch( itk::ExceptionObject & excp )
+      {
+      std::cerr << "WARNING: Can not write to the registration cache: " << excp << std::endl;
+      itksys::SystemTools::RemoveFile(temporaryFileName.c_str() );
+      return;
+      }
+    this->Commit(temporaryFileName, this->EntryFileName(key, ".nrrd") );
+  }
+
+  /** Extensions of the cache entries: ".h5" for transforms, ".nrrd" for
+   * images, and the extensions accepted by FetchFile() and StoreFile(),
+   * ".nii.gz", ".mat" and ".txt". */
+  static bool IsEntryExtension(const std::string & extension);
+
+  static itk::SimpleFastMutexLock & GetIOLock();
+
+private:
+  std::string EntryFileName(const RegistrationCacheKey & key, const std::string & extension) const;
+
+  std::string TemporaryFileName(const std::string & extension) const;
+
+  /** Rename a complete temporary file to its entry and enforce the limit */
+  void Commit(const std::string & temporaryFileName, const std::string & entryFileName) const;
+
+  /** True for the names made by EntryFileName(), the 32 hexadecimal
+   * digits of a digest and an entry extension */
+  static bool IsEntryName(const std::string & name);
+
+  void Evict() const;
+
+  std::string        m_Directory;
+  unsigned long long m_MaximumSize;
+};
+}
+
+#endif // __BRAINSRegistrationCache_h
@@ -0,0 +1,267 @@
+/*=========================================================================
+ *
+ *  Copyright SINAPSE: Scalable Informatics for Neuroscience, Processing and Software Engineering
+ *            The University of Iowa
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#include "BRAINSTransformOptimization.h"
+#include "itkBRAINSTransformToDisplacementFieldFilter.h"
+#include "itkAffineTransform.h"
+#include "itkCompositeTransform.h"
+#include "itkDisplacementFieldTransform.h"
+#include "itkIdentityTransform.h"
+#include "itkMatrixOffsetTransformBase.h"
+#include "itkTranslationTransform.h"
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace BRAINSUtils
+{
+namespace
+{
+typedef itk::Transform<double, 3, 3>                 TransformType;
+typedef itk::CompositeTransform<double, 3>           CompositeTransformType;
+typedef itk::MatrixOffsetTransformBase<double, 3, 3> MatrixOffsetTransformType;
+typedef itk::TranslationTransform<double, 3>         TranslationTransformType;
+typedef itk::IdentityTransform<double, 3>            IdentityTransformType;
+typedef itk::AffineTransform<double, 3>              AffineTransformType;
+typedef itk::DisplacementFieldTransform<double, 3>   DisplacementFieldTransformType;
+typedef itk::Matrix<double, 3, 3>                    MatrixType;
+typedef itk::Vector<double, 3>                       VectorType;
+typedef std::vector<TransformType::ConstPointer>     TransformListType;
+
+/** Gets T(x) = M x + offset, or returns false when the transform is not linear */
+bool
+GetLinearMap(const TransformType *transform, MatrixType & M, VectorType & offset)
+{
+  if( const MatrixOffsetTransformType *matrixOffset = dynamic_cast<const MatrixOffsetTransformType *>( transform ) )
+    {
+    M = matrixOffset->GetMatrix();
+    offset = matrixOffset->GetOffset();
+    return true;
+    }
+  if( const TranslationTransformType *translation = dynamic_cast<const TranslationTransformType *>( transform ) )
+    {
+    M.SetIdentity();
+    offset = translation->GetOffset();
+    return true;
+    }
+  if( dynamic_cast<const IdentityTransformType *>( transform ) != ITK_NULLPTR )
+    {
+    M.SetIdentity();
+    offset.Fill(0.0);
+    return true;
+    }
+  return false;
+}
+
+bool
+IsIdentity(const MatrixType & M, const VectorType & offset)
+{
+  for( unsigned int i = 0; i < 3; ++i )
+    {
+    for( unsigned int j = 0; j < 3; ++j )
+      {
+      if( M(i, j) != ( i == j ? 1.0 : 0.0 ) )
+        {
+        return false;
+        }
+      }
+    if( offset[i] != 0.0 )
+      {
+      return false;
+      }
+    }
+  return true;
+}
+
+/** Appends the components of a transform in the order they are applied to
+ * a point.  A composite transform applies its last component first. */
+void
+AppendInApplicationOrder(const TransformType *transform, TransformListType & list, bool & changed)
+{
+  const CompositeTransformType *composite = dynamic_cast<const CompositeTransformType *>( transform );
+  if( composite == ITK_NULLPTR )
+    {
+    list.push_back(transform);
+    return;
+    }
+  for( size_t n = composite->GetNumberOfTransforms(); n-- > 0; )
+    {
+    const TransformType *component = composite->GetNthTransform(n).GetPointer();
+    if( dynamic_cast<const CompositeTransformType *>( component ) != ITK_NULLPTR )
+      {
+      changed = true;
+      }
+    AppendInApplicationOrder(component, list, changed);
+    }
+}
+
+/** Largest distance between the two transforms at the centers of a
+ * sample of the grid cells */
+double
+MeasureMaximumError(const TransformType *transform, const TransformType *approximation,
+                    const itk::ImageBase<3> *grid)
+{
+  // At most 32 cell centers along each axis
+  const itk::ImageBase<3>::RegionType & region = grid->GetLargestPossibleRegion();
+  itk::SizeValueType                   stride[3];
+  for( unsigned int i = 0; i < 3; ++i )
+    {
+    stride[i] = std::max<itk::SizeValueType>(1, region.GetSize(i) / 32);
+    }
+  double                          maximumSquaredError = 0.0;
+  itk::ContinuousIndex<double, 3> cellCenter;
+  itk::ImageBase<3>::PointType    point;
+  for( itk::SizeValueType k = 0; k + 1 < region.GetSize(2); k += stride[2] )
+    {
+    cellCenter[2] = region.GetIndex(2) + k + 0.5;
+    for( itk::SizeValueType j = 0; j + 1 < region.GetSize(1); j += stride[1] )
+      {
+      cellCenter[1] = region.GetIndex(1) + j + 0.5;
+      for( itk::SizeValueType i = 0; i + 1 < region.GetSize(0); i += stride[0] )
+        {
+        cellCenter[0] = region.GetIndex(0) + i + 0.5;
+        grid->TransformContinuousIndexToPhysicalPoint(cellCenter, point);
+        maximumSquaredError = std::max(maximumSquaredError,
+                                       transform->TransformPoint(point).SquaredEuclideanDistanceTo(
+                                         approximation->TransformPoint(point) ) );
+        }
+      }
+    }
+  return std::sqrt(maximumSquaredError);
+}
+}
+
+itk::Transform<double, 3, 3>::ConstPointer
+FlattenTransform(const itk::Transform<double, 3, 3> *transform)
+{
+  if( dynamic_cast<const CompositeTransformType *>( transform ) == ITK_NULLPTR )
+    {
+    return transform;
+    }
+
+  bool              changed = false;
+  TransformListType components;
+  AppendInApplicationOrder(transform, components, changed);
+
+  // Fold each run of linear components: applying M1,o1 then M2,o2 gives
+  // M2 M1 x + M2 o1 + o2.
+  TransformListType flattened;
+  for( TransformListType::const_iterator it = components.begin(); it != components.end(); )
+    {
+    MatrixType M;
+    VectorType offset;
+    if( !GetLinearMap(*it, M, offset) )
+      {
+      flattened.push_back(*it);
+      ++it;
+      continue;
+      }
+    TransformListType::const_iterator runBegin = it;
+    MatrixType                        nextM;
+    VectorType                        nextOffset;
+    for( ++it; it != components.end() && GetLinearMap(*it, nextM, nextOffset); ++it )
+      {
+      offset = nextM * offset + nextOffset;
+      M = nextM * M;
+      }
+    if( IsIdentity(M, offset) )
+      {
+      changed = true;
+      }
+    else if( it - runBegin == 1 )
+      {
+      flattened.push_back(*runBegin);
+      }
+    else
+      {
+      AffineTransformType::Pointer affine = AffineTransformType::New();
+      affine->SetMatrix(M);
+      affine->SetOffset(offset);
+      flattened.push_back(affine.GetPointer() );
+      changed = true;
+      }
+    }
+
+  if( flattened.empty() )
+    {
+    return IdentityTransformType::New().GetPointer();
+    }
+  if( flattened.size() == 1 )
+    {
+    return flattened.front();
+    }
+  if( !changed )
+    {
+    return transform;
+    }
+  CompositeTransformType::Pointer composite = CompositeTransformType::New();
+  for( TransformListType::const_reverse_iterator it = flattened.rbegin(); it != flattened.rend(); ++it )
+    {
+    // CompositeTransform only holds non-const components; they are not modified.
+    composite->AddTransform(const_cast<TransformType *>( it->GetPointer() ) );
+    }
+  return composite.GetPointer();
+}
+
+itk::Transform<double, 3, 3>::ConstPointer
+PrecomposeTransform(const itk::Transform<double, 3, 3> *transform,
+                    const itk::ImageBase<3> *grid,
+                    double tolerance,
+                    double *maximumError)
+{
+  if( maximumError != ITK_NULLPTR )
+    {
+    *maximumError = 0.0;
+    }
+  const TransformType::ConstPointer flattened = FlattenTransform(transform);
+  if( grid == ITK_NULLPTR || flattened.IsNull()
+      || flattened->GetTransformCategory() == TransformType::Linear
+      || dynamic_cast<const DisplacementFieldTransformType *>( flattened.GetPointer() ) != ITK_NULLPTR )
+    {
+    return flattened;
+    }
+  if( tolerance < 0.0 )
+    {
+    const itk::ImageBase<3>::SpacingType & spacing = grid->GetSpacing();
+    tolerance = 0.1 * std::min(spacing[0], std::min(spacing[1], spacing[2]) );
+    }
+
+  typedef DisplacementFieldTransformType::DisplacementFieldType              FieldType;
+  typedef itk::BRAINSTransformToDisplacementFieldFilter<FieldType, double> FieldFilterType;
+  FieldFilterType::Pointer fieldFilter = FieldFilterType::New();
+  fieldFilter->SetReferenceImage(grid);
+  fieldFilter->SetTransform(flattened);
+  fieldFilter->Update();
+  FieldType::Pointer field = fieldFilter->GetOutput();
+  field->DisconnectPipeline();
+
+  DisplacementFieldTransformType::Pointer fieldTransform = DisplacementFieldTransformType::New();
+  fieldTransform->SetDisplacementField(field);
+
+  const double error = MeasureMaximumError(flattened, fieldTransform, grid);
+  if( maximumError != ITK_NULLPTR )
+    {
+    *maximumError = error;
+    }
+  if( error > tolerance )
+    {
+    return flattened;
+    }
+  return fieldTransform.GetPointer();
+}
+}
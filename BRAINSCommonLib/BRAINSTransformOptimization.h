@@ -0,0 +1,62 @@
+/*=========================================================================
+ *
+ *  Copyright SINAPSE: Scalable Informatics for Neuroscience, Processing and Software Engineering
+ *            The University of Iowa
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#ifndef __BRAINSTransformOptimization_h
+#define __BRAINSTransformOptimization_h
+
+#include "itkImageBase.h"
+#include "itkTransform.h"
+
+namespace BRAINSUtils
+{
+/**
+ * Returns a transform that maps every point like the given one but is
+ * cheaper to evaluate:
+ *  - nested composite transforms are expanded into one composite,
+ *  - adjacent linear components (affine, versor, scale-skew, similarity,
+ *    translation, ...) are folded into one AffineTransform,
+ *  - identity components are dropped,
+ *  - a composite left with one component is replaced by that component.
+ * The components that are kept are shared with the given transform, not
+ * copied.  The given transform itself is returned when nothing can be
+ * simplified.
+ */
+itk::Transform<double, 3, 3>::ConstPointer
+FlattenTransform(const itk::Transform<double, 3, 3> *transform);
+
+/**
+ * For a transform that will map the points of the same grid many times,
+ * e.g. to resample many images on one reference image: returns the whole
+ * (flattened) transform sampled as one DisplacementFieldTransform on the
+ * grid, so that each point costs one linear interpolation of the field
+ * instead of the evaluation of every component.  The field is exact on the
+ * voxels of the grid; the largest distance between the field and the
+ * transform at the centers of the grid cells, where the interpolation is
+ * the least accurate, is returned in maximumError.  When it exceeds the
+ * tolerance (in mm, a tenth of the smallest grid spacing when negative), or
+ * when the transform has no BSpline or displacement field stage, the
+ * flattened transform is returned instead.
+ */
+itk::Transform<double, 3, 3>::ConstPointer
+PrecomposeTransform(const itk::Transform<double, 3, 3> *transform,
+                    const itk::ImageBase<3> *grid,
+                    double tolerance = -1.0,
+                    double *maximumError = ITK_NULLPTR);
+}
+
+#endif // __BRAINSTransformOptimization_h
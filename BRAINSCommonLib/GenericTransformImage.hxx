@@ -24,6 +24,7 @@
 #include "itkResampleInPlaceImageFilter.h"
 #include "itkConstantBoundaryCondition.h"
 #include "itkIO.h"
+#include "BRAINSTransformOptimization.h"
 
 template <class InputImageType, class OutputImageType>
 typename OutputImageType::Pointer
@@ -38,7 +39,10 @@ TransformResample(
   typedef typename itk::ResampleImageFilter<InputImageType, OutputImageType> ResampleImageFilter;
   typename ResampleImageFilter::Pointer resample = ResampleImageFilter::New();
   resample->SetInput(inputImage);
-  resample->SetTransform(transform.GetPointer());
+  // Composite transforms are evaluated at every voxel; fold them first.
+  const itk::Transform<double, 3, 3>::ConstPointer flattenedTransform =
+    BRAINSUtils::FlattenTransform(transform.GetPointer() );
+  resample->SetTransform(flattenedTransform.GetPointer() );
   resample->SetInterpolator(interp.GetPointer());
 
   if( ReferenceImage.IsNotNull() )
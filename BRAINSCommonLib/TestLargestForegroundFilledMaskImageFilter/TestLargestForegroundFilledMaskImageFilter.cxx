@@ -18,20 +18,75 @@
  *=========================================================================*/
 #include "itkLargestForegroundFilledMaskImageFilter.h"
 #include "itkIO.h"
+#include "itkImageRegionIteratorWithIndex.h"
+#include "itkImageRegionConstIteratorWithIndex.h"
 #include <string>
 
+typedef itk::Image<float, 3> ImageType;
+typedef itk::LargestForegroundFilledMaskImageFilter<ImageType>
+  FilterType;
+
+/* A slab across the image splits the background in two components, one
+ * with the first four corners and one with the last four.  Only the
+ * component of the last corner is outside, so the other one is filled as
+ * a hole, as with the single seed of the original pipeline. */
+static int TestHoleFillingSeed()
+{
+  const itk::IndexValueType slabBegin = 14;
+  const itk::IndexValueType slabEnd = 18;
+  ImageType::SizeType       size;
+
+  size.Fill(32);
+  ImageType::Pointer image = ImageType::New();
+  image->SetRegions(size);
+  image->Allocate();
+  image->FillBuffer(0.0F);
+  itk::ImageRegionIteratorWithIndex<ImageType> it(image, image->GetLargestPossibleRegion() );
+  for( ; !it.IsAtEnd(); ++it )
+    {
+    if( it.GetIndex()[2] >= slabBegin && it.GetIndex()[2] < slabEnd )
+      {
+      it.Set(100.0F);
+      }
+    }
+
+  FilterType::Pointer filter = FilterType::New();
+  filter->SetInput(image);
+  filter->Update();
+
+  unsigned int errors = 0;
+  itk::ImageRegionConstIteratorWithIndex<ImageType> out(filter->GetOutput(),
+                                                        filter->GetOutput()->GetLargestPossibleRegion() );
+  for( ; !out.IsAtEnd(); ++out )
+    {
+    const float expected = ( out.GetIndex()[2] < slabEnd ) ? 1.0F : 0.0F;
+    if( out.Get() != expected )
+      {
+      ++errors;
+      }
+    }
+  if( errors > 0 )
+    {
+    std::cerr << errors << " voxels differ from the slab with the background of the first corner filled"
+              << std::endl;
+    return EXIT_FAILURE;
+    }
+  return EXIT_SUCCESS;
+}
+
 int
 main(int argc, char * *argv)
 {
+  if( argc == 1 )
+    {
+    return TestHoleFillingSeed();
+    }
   if( argc < 3 )
     {
-    std::cerr << "TestLargestForegrounFilledMaskImageFilter <input image> <output image>"
+    std::cerr << "TestLargestForegrounFilledMaskImageFilter [<input image> <output image>]"
               << std::endl;
     return EXIT_FAILURE;
     }
-  typedef itk::Image<float, 3> ImageType;
-  typedef itk::LargestForegroundFilledMaskImageFilter<ImageType>
-    FilterType;
   std::string         inputname(argv[1]);
   std::string         outputname(argv[2]);
   ImageType::Pointer  image = itkUtil::ReadImage<ImageType>(inputname);
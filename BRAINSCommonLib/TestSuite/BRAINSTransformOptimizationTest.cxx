@@ -0,0 +1,257 @@
+/*=========================================================================
+ *
+ *  Copyright SINAPSE: Scalable Informatics for Neuroscience, Processing and Software Engineering
+ *            The University of Iowa
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#include <itkImage.h>
+#include <itkAffineTransform.h>
+#include <itkBSplineDeformableTransform.h>
+#include <itkCompositeTransform.h>
+#include <itkDisplacementFieldTransform.h>
+#include <itkScaleTransform.h>
+#include <itkTranslationTransform.h>
+#include <itkVersorRigid3DTransform.h>
+
+#include "BRAINSTransformOptimization.h"
+
+#include <algorithm>
+#include <cmath>
+
+typedef itk::Transform<double, 3, 3>                  TransformType;
+typedef itk::CompositeTransform<double, 3>            CompositeTransformType;
+typedef itk::AffineTransform<double, 3>               AffineTransformType;
+typedef itk::BSplineDeformableTransform<double, 3, 3> BSplineTransformType;
+typedef itk::DisplacementFieldTransform<double, 3>    DisplacementFieldTransformType;
+typedef itk::Image<float, 3>                          GridImageType;
+
+/** Largest distance between two transforms over a lattice of points */
+static double
+MaximumDistance(const TransformType *a, const TransformType *b)
+{
+  double                   maximum = 0.0;
+  TransformType::PointType point;
+
+  for( int k = 0; k < 5; ++k )
+    {
+    for( int j = 0; j < 5; ++j )
+      {
+      for( int i = 0; i < 5; ++i )
+        {
+        point[0] = 2.0 + 4.3 * i;
+        point[1] = 1.0 + 3.9 * j;
+        point[2] = 3.0 + 3.1 * k;
+        maximum = std::max(maximum, a->TransformPoint(point).EuclideanDistanceTo(b->TransformPoint(point) ) );
+        }
+      }
+    }
+  return maximum;
+}
+
+static itk::VersorRigid3DTransform<double>::Pointer
+MakeRigid()
+{
+  itk::VersorRigid3DTransform<double>::Pointer rigid = itk::VersorRigid3DTransform<double>::New();
+  itk::VersorRigid3DTransform<double>::AxisType axis;
+  axis[0] = 0.2;
+  axis[1] = 1.0;
+  axis[2] = -0.4;
+  rigid->SetRotation(axis, 0.35);
+  itk::VersorRigid3DTransform<double>::InputPointType center;
+  center[0] = 12.0;
+  center[1] = 8.0;
+  center[2] = 9.0;
+  rigid->SetCenter(center);
+  itk::VersorRigid3DTransform<double>::OutputVectorType translation;
+  translation[0] = 1.5;
+  translation[1] = -2.0;
+  translation[2] = 0.75;
+  rigid->SetTranslation(translation);
+  return rigid;
+}
+
+static itk::TranslationTransform<double, 3>::Pointer
+MakeTranslation()
+{
+  itk::TranslationTransform<double, 3>::Pointer translation = itk::TranslationTransform<double, 3>::New();
+  itk::TranslationTransform<double, 3>::OutputVectorType offset;
+  offset[0] = -3.0;
+  offset[1] = 0.5;
+  offset[2] = 2.25;
+  translation->Translate(offset);
+  return translation;
+}
+
+static itk::ScaleTransform<double, 3>::Pointer
+MakeScale()
+{
+  itk::ScaleTransform<double, 3>::Pointer scale = itk::ScaleTransform<double, 3>::New();
+  itk::ScaleTransform<double, 3>::ScaleType factors;
+  factors[0] = 1.1;
+  factors[1] = 0.9;
+  factors[2] = 1.2;
+  scale->SetScale(factors);
+  return scale;
+}
+
+/** BSpline on [2, 22) x [1, 21) x [1, 19), with coefficients of the given
+ * amplitude; the parameters must outlive the transform */
+static BSplineTransformType::Pointer
+MakeBSpline(BSplineTransformType::ParametersType & parameters, const double amplitude)
+{
+  BSplineTransformType::Pointer bspline = BSplineTransformType::New();
+  BSplineTransformType::RegionType::SizeType gridSize;
+  gridSize[0] = 8;
+  gridSize[1] = 7;
+  gridSize[2] = 6;
+  BSplineTransformType::RegionType gridRegion;
+  gridRegion.SetSize(gridSize);
+  BSplineTransformType::SpacingType gridSpacing;
+  gridSpacing[0] = 4.0;
+  gridSpacing[1] = 5.0;
+  gridSpacing[2] = 6.0;
+  BSplineTransformType::OriginType gridOrigin;
+  gridOrigin[0] = -2.0;
+  gridOrigin[1] = -4.0;
+  gridOrigin[2] = -5.0;
+  BSplineTransformType::DirectionType gridDirection;
+  gridDirection.SetIdentity();
+  bspline->SetGridSpacing(gridSpacing);
+  bspline->SetGridOrigin(gridOrigin);
+  bspline->SetGridRegion(gridRegion);
+  bspline->SetGridDirection(gridDirection);
+
+  parameters.SetSize(bspline->GetNumberOfParameters() );
+  for( unsigned int p = 0; p < parameters.Size(); ++p )
+    {
+    parameters[p] = amplitude * std::sin(1.9 * p);
+    }
+  bspline->SetParameters(parameters);
+  return bspline;
+}
+
+static GridImageType::Pointer
+MakeGrid(const double spacing)
+{
+  GridImageType::Pointer     grid = GridImageType::New();
+  GridImageType::SizeType    size;
+  GridImageType::SpacingType spacings;
+  GridImageType::PointType   origin;
+
+  for( unsigned int i = 0; i < 3; ++i )
+    {
+    size[i] = static_cast<itk::SizeValueType>( 24.0 / spacing );
+    spacings[i] = spacing;
+    origin[i] = 0.0;
+    }
+  grid->SetRegions(size);
+  grid->SetSpacing(spacings);
+  grid->SetOrigin(origin);
+  return grid;
+}
+
+int main( int, char * [] )
+{
+  int status = EXIT_SUCCESS;
+
+  BSplineTransformType::ParametersType parameters;
+  BSplineTransformType::Pointer        bspline = MakeBSpline(parameters, 1.5);
+
+  // Composite order: the last added transform is applied first.  A nested
+  // composite is expanded and the adjacent rigid and translation folded.
+    {
+    CompositeTransformType::Pointer nested = CompositeTransformType::New();
+    nested->AddTransform(MakeTranslation() );
+    nested->AddTransform(MakeRigid() );
+
+    CompositeTransformType::Pointer composite = CompositeTransformType::New();
+    composite->AddTransform(MakeScale() );
+    composite->AddTransform(bspline);
+    composite->AddTransform(nested);
+
+    TransformType::PointType point;
+    point[0] = 9.0;
+    point[1] = 7.5;
+    point[2] = 11.0;
+    const TransformType::PointType byHand =
+      MakeScale()->TransformPoint(bspline->TransformPoint(MakeTranslation()->TransformPoint(
+                                                            MakeRigid()->TransformPoint(point) ) ) );
+    const double orderError = byHand.EuclideanDistanceTo(composite->TransformPoint(point) );
+
+    const TransformType::ConstPointer flattened = BRAINSUtils::FlattenTransform(composite);
+    const CompositeTransformType *    flattenedComposite =
+      dynamic_cast<const CompositeTransformType *>( flattened.GetPointer() );
+    const double flattenError = MaximumDistance(flattened, composite);
+    std::cout << "Composite order: " << orderError << " flattened: " << flattenError << std::endl;
+    if( !( orderError < 1.0e-9 ) || !( flattenError < 1.0e-9 )
+        || flattenedComposite == ITK_NULLPTR || flattenedComposite->GetNumberOfTransforms() != 3 )
+      {
+      std::cerr << "The flattened composite does not match" << std::endl;
+      status = EXIT_FAILURE;
+      }
+    }
+
+  // An affine only chain is folded into one affine transform, and stays
+  // linear when precomposed
+    {
+    CompositeTransformType::Pointer composite = CompositeTransformType::New();
+    composite->AddTransform(MakeRigid() );
+    composite->AddTransform(MakeScale() );
+    composite->AddTransform(MakeTranslation() );
+
+    const TransformType::ConstPointer flattened = BRAINSUtils::FlattenTransform(composite);
+    const TransformType::ConstPointer precomposed =
+      BRAINSUtils::PrecomposeTransform(composite, MakeGrid(2.0) );
+    const double error = MaximumDistance(flattened, composite);
+    std::cout << "Affine chain: " << error << std::endl;
+    if( dynamic_cast<const AffineTransformType *>( flattened.GetPointer() ) == ITK_NULLPTR
+        || !( error < 1.0e-9 )
+        || precomposed->GetTransformCategory() != TransformType::Linear )
+      {
+      std::cerr << "The affine chain is not one affine transform" << std::endl;
+      status = EXIT_FAILURE;
+      }
+    }
+
+  // The displacement field replaces a BSpline chain when it is accurate
+  // enough on the grid, and the flattened transform is kept otherwise
+    {
+    CompositeTransformType::Pointer composite = CompositeTransformType::New();
+    composite->AddTransform(MakeRigid() );
+    composite->AddTransform(bspline);
+
+    double                            coarseError = 0.0;
+    const TransformType::ConstPointer coarse =
+      BRAINSUtils::PrecomposeTransform(composite, MakeGrid(6.0), 1.0e-3, &coarseError);
+    double                            fineError = 0.0;
+    const TransformType::ConstPointer fine =
+      BRAINSUtils::PrecomposeTransform(composite, MakeGrid(1.0), 1.0e3, &fineError);
+    std::cout << "Precomposed errors: coarse " << coarseError << " fine " << fineError << std::endl;
+    if( !( coarseError > 1.0e-3 )
+        || dynamic_cast<const DisplacementFieldTransformType *>( coarse.GetPointer() ) != ITK_NULLPTR
+        || !( MaximumDistance(coarse, composite) < 1.0e-9 ) )
+      {
+      std::cerr << "The inaccurate displacement field was not rejected" << std::endl;
+      status = EXIT_FAILURE;
+      }
+    if( dynamic_cast<const DisplacementFieldTransformType *>( fine.GetPointer() ) == ITK_NULLPTR )
+      {
+      std::cerr << "The displacement field was not used" << std::endl;
+      status = EXIT_FAILURE;
+      }
+    }
+
+  return status;
+}
@@ -0,0 +1,194 @@
+/*=========================================================================
+ *
+ *  Copyright SINAPSE: Scalable Informatics for Neuroscience, Processing and Software Engineering
+ *            The University of Iowa
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#include <itkImage.h>
+#include <itkVector.h>
+#include <itkAffineTransform.h>
+#include <itkBSplineDeformableTransform.h>
+#include <itkImageRegionConstIteratorWithIndex.h>
+
+#include "itkBRAINSTransformToDisplacementFieldFilter.h"
+
+#include <algorithm>
+#include <cmath>
+
+typedef itk::Image<float, 3>                                                   ReferenceImageType;
+typedef itk::Image<itk::Vector<double, 3>, 3>                                  DisplacementFieldType;
+typedef itk::BRAINSTransformToDisplacementFieldFilter<DisplacementFieldType, double> FilterType;
+typedef itk::AffineTransform<double, 3>                                        AffineTransformType;
+typedef itk::BSplineDeformableTransform<double, 3, 3>                          BSplineTransformType;
+
+/** largest distance between the field and T(p) - p over all the voxels */
+static double
+MaximumFieldError(const FilterType::TransformType *transform, const ReferenceImageType *reference)
+{
+  FilterType::Pointer filter = FilterType::New();
+
+  filter->SetTransform(transform);
+  filter->SetReferenceImage(reference);
+  filter->Update();
+
+  const DisplacementFieldType *field = filter->GetOutput();
+  double                       maximum = 0.0;
+  for( itk::ImageRegionConstIteratorWithIndex<DisplacementFieldType> it(field, field->GetLargestPossibleRegion() );
+       !it.IsAtEnd(); ++it )
+    {
+    DisplacementFieldType::PointType point;
+    field->TransformIndexToPhysicalPoint(it.GetIndex(), point);
+    const DisplacementFieldType::PointType mapped = transform->TransformPoint(point);
+    for( unsigned int d = 0; d < 3; ++d )
+      {
+      maximum = std::max(maximum, std::fabs(it.Get()[d] - ( mapped[d] - point[d] ) ) );
+      }
+    }
+  return maximum;
+}
+
+static ReferenceImageType::Pointer
+MakeReference(const double spacing, const double origin, const bool oblique)
+{
+  ReferenceImageType::SizeType size;
+  size[0] = 23;
+  size[1] = 19;
+  size[2] = 17;
+  ReferenceImageType::IndexType start;
+  start[0] = 3;
+  start[1] = -2;
+  start[2] = 0;
+  ReferenceImageType::RegionType region(start, size);
+
+  ReferenceImageType::Pointer reference = ReferenceImageType::New();
+  reference->SetRegions(region);
+  ReferenceImageType::SpacingType spacings;
+  spacings[0] = spacing;
+  spacings[1] = 1.25 * spacing;
+  spacings[2] = 1.5 * spacing;
+  reference->SetSpacing(spacings);
+  ReferenceImageType::PointType origins;
+  origins.Fill(origin);
+  reference->SetOrigin(origins);
+  ReferenceImageType::DirectionType direction;
+  direction.SetIdentity();
+  if( oblique )
+    {
+    const double angle = 0.3;
+    direction[1][1] = std::cos(angle);
+    direction[1][2] = -std::sin(angle);
+    direction[2][1] = std::sin(angle);
+    direction[2][2] = std::cos(angle);
+    }
+  reference->SetDirection(direction);
+  return reference;
+}
+
+static AffineTransformType::Pointer
+MakeAffine()
+{
+  AffineTransformType::Pointer affine = AffineTransformType::New();
+  AffineTransformType::MatrixType matrix;
+  for( unsigned int i = 0; i < 3; ++i )
+    {
+    for( unsigned int j = 0; j < 3; ++j )
+      {
+      matrix[i][j] = ( i == j ? 1.05 : 0.0 ) + 0.02 * ( i + 1 ) - 0.03 * j;
+      }
+    }
+  affine->SetMatrix(matrix);
+  AffineTransformType::OutputVectorType translation;
+  translation[0] = 2.5;
+  translation[1] = -1.75;
+  translation[2] = 0.5;
+  affine->SetTranslation(translation);
+  AffineTransformType::InputPointType center;
+  center[0] = 10.0;
+  center[1] = 12.0;
+  center[2] = -4.0;
+  affine->SetCenter(center);
+  return affine;
+}
+
+int main( int, char * [] )
+{
+  const double tolerance = 1.0e-6;
+  int          status = EXIT_SUCCESS;
+
+  // Affine, on an oblique grid
+    {
+    const double error = MaximumFieldError(MakeAffine(), MakeReference(1.5, -7.0, true) );
+    std::cout << "Affine: " << error << std::endl;
+    if( !( error < tolerance ) )
+      {
+      status = EXIT_FAILURE;
+      }
+    }
+
+  // BSpline whose coefficient grid covers only the middle of the reference,
+  // so the voxels outside its valid region are evaluated by the transform
+  BSplineTransformType::Pointer bspline = BSplineTransformType::New();
+  BSplineTransformType::RegionType::SizeType gridSize;
+  gridSize[0] = 8;
+  gridSize[1] = 7;
+  gridSize[2] = 6;
+  BSplineTransformType::RegionType gridRegion;
+  gridRegion.SetSize(gridSize);
+  BSplineTransformType::SpacingType gridSpacing;
+  gridSpacing[0] = 4.0;
+  gridSpacing[1] = 5.0;
+  gridSpacing[2] = 6.0;
+  BSplineTransformType::OriginType gridOrigin;
+  gridOrigin[0] = -2.0;
+  gridOrigin[1] = -4.0;
+  gridOrigin[2] = -5.0;
+  BSplineTransformType::DirectionType gridDirection;
+  gridDirection.SetIdentity();
+  bspline->SetGridSpacing(gridSpacing);
+  bspline->SetGridOrigin(gridOrigin);
+  bspline->SetGridRegion(gridRegion);
+  bspline->SetGridDirection(gridDirection);
+
+  // The transform keeps a reference to the parameters
+  BSplineTransformType::ParametersType parameters(bspline->GetNumberOfParameters() );
+  for( unsigned int p = 0; p < parameters.Size(); ++p )
+    {
+    parameters[p] = 3.0 * std::sin(0.7 * p) + 0.01 * ( p % 13 );
+    }
+  bspline->SetParameters(parameters);
+
+  const ReferenceImageType::Pointer reference = MakeReference(1.25, -3.0, false);
+    {
+    const double error = MaximumFieldError(bspline, reference);
+    std::cout << "BSpline: " << error << std::endl;
+    if( !( error < tolerance ) )
+      {
+      status = EXIT_FAILURE;
+      }
+    }
+
+  // BSpline with an affine bulk transform, added incrementally along rows
+    {
+    bspline->SetBulkTransform(MakeAffine() );
+    const double error = MaximumFieldError(bspline, reference);
+    std::cout << "BSpline with bulk transform: " << error << std::endl;
+    if( !( error < tolerance ) )
+      {
+      status = EXIT_FAILURE;
+      }
+    }
+
+  return status;
+}
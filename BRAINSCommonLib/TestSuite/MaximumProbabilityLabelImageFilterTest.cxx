@@ -0,0 +1,212 @@
+/*=========================================================================
+ *
+ *  Copyright SINAPSE: Scalable Informatics for Neuroscience, Processing and Software Engineering
+ *            The University of Iowa
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#include <itkImage.h>
+#include <itkImageRegionConstIteratorWithIndex.h>
+#include <itkImageRegionIteratorWithIndex.h>
+
+#include "itkMaximumProbabilityLabelImageFilter.h"
+
+#include <cmath>
+#include <map>
+#include <vector>
+
+typedef itk::Image<float, 3>                                                         ProbabilityImageType;
+typedef itk::Image<unsigned char, 3>                                                 ByteImageType;
+typedef itk::MaximumProbabilityLabelImageFilter<ProbabilityImageType, ByteImageType> LabelFilterType;
+typedef std::vector<ProbabilityImageType::Pointer>                                   ProbabilityVectorType;
+
+static ByteImageType::Pointer
+MakeByteImage(const ProbabilityImageType *reference)
+{
+  ByteImageType::Pointer image = ByteImageType::New();
+
+  image->CopyInformation(reference);
+  image->SetRegions(reference->GetLargestPossibleRegion() );
+  image->Allocate();
+  image->FillBuffer(0);
+  return image;
+}
+
+/** The voxel by voxel labeling that ComputeLabels did before the filter */
+static void
+ReferenceLabels(const ProbabilityVectorType & posteriors, const std::vector<bool> & isForeground,
+                const std::vector<unsigned char> & labelCodes, const ByteImageType *nonAirRegion,
+                const float inclusionThreshold, ByteImageType *labels, ByteImageType *foregroundMask)
+{
+  for( itk::ImageRegionConstIteratorWithIndex<ByteImageType> it(nonAirRegion, nonAirRegion->GetLargestPossibleRegion() );
+       !it.IsAtEnd(); ++it )
+    {
+    const ByteImageType::IndexType index = it.GetIndex();
+    labels->SetPixel(index, 0);
+    foregroundMask->SetPixel(index, 0);
+    if( it.Get() == 0 )
+      {
+      continue;
+      }
+    float        maxPosterior = posteriors[0]->GetPixel(index);
+    unsigned int maxClass = 0;
+    for( unsigned int c = 1; c < posteriors.size(); ++c )
+      {
+      if( posteriors[c]->GetPixel(index) > maxPosterior )
+        {
+        maxPosterior = posteriors[c]->GetPixel(index);
+        maxClass = c;
+        }
+      }
+    labels->SetPixel(index, maxPosterior > inclusionThreshold ? labelCodes[maxClass] : 99);
+    foregroundMask->SetPixel(index, isForeground[maxClass] && !( maxPosterior < 0.001 ) );
+    }
+}
+
+int main( int, char * [] )
+{
+  ProbabilityImageType::SizeType size;
+  size[0] = 7;
+  size[1] = 5;
+  size[2] = 3;
+
+  const unsigned int    numberOfClasses = 3;
+  ProbabilityVectorType posteriors;
+  for( unsigned int c = 0; c < numberOfClasses; ++c )
+    {
+    ProbabilityImageType::Pointer posterior = ProbabilityImageType::New();
+    posterior->SetRegions(size);
+    posterior->Allocate();
+    for( itk::ImageRegionIteratorWithIndex<ProbabilityImageType> it(posterior, posterior->GetLargestPossibleRegion() );
+         !it.IsAtEnd(); ++it )
+      {
+      const ProbabilityImageType::IndexType index = it.GetIndex();
+      it.Set(0.5F + 0.5F * static_cast<float>( std::sin(1.3 * index[0] + 2.1 * index[1] + 0.7 * index[2] + 1.9 * c) ) );
+      }
+    posteriors.push_back(posterior);
+    }
+
+  ProbabilityImageType::IndexType index;
+  // ties go to the first class: classes 0 and 1, then classes 1 and 2
+  index[0] = 1;
+  index[1] = 1;
+  index[2] = 1;
+  posteriors[0]->SetPixel(index, 0.6F);
+  posteriors[1]->SetPixel(index, 0.6F);
+  posteriors[2]->SetPixel(index, 0.2F);
+  index[0] = 2;
+  posteriors[0]->SetPixel(index, 0.1F);
+  posteriors[1]->SetPixel(index, 0.45F);
+  posteriors[2]->SetPixel(index, 0.45F);
+  // a voxel without probability
+  index[0] = 3;
+  for( unsigned int c = 0; c < numberOfClasses; ++c )
+    {
+    posteriors[c]->SetPixel(index, 0.0F);
+    }
+
+  // The non air region excludes a whole row and a few single voxels
+  ByteImageType::Pointer nonAirRegion = MakeByteImage(posteriors[0]);
+  nonAirRegion->FillBuffer(1);
+  index[1] = 3;
+  index[2] = 2;
+  for( index[0] = 0; index[0] < static_cast<ProbabilityImageType::IndexValueType>( size[0] ); ++index[0] )
+    {
+    nonAirRegion->SetPixel(index, 0);
+    }
+  index[1] = 0;
+  index[2] = 0;
+  for( index[0] = 0; index[0] < 3; ++index[0] )
+    {
+    nonAirRegion->SetPixel(index, 0);
+    }
+
+  std::vector<unsigned char> labelCodes;
+  labelCodes.push_back(1);
+  labelCodes.push_back(4);
+  labelCodes.push_back(23);
+  std::vector<bool> isForeground;
+  isForeground.push_back(true);
+  isForeground.push_back(false);
+  isForeground.push_back(true);
+
+  int         status = EXIT_SUCCESS;
+  const float thresholds[] = { 0.0F, 0.6F };
+  for( unsigned int t = 0; t < 2; ++t )
+    {
+    LabelFilterType::Pointer filter = LabelFilterType::New();
+    for( unsigned int c = 0; c < numberOfClasses; ++c )
+      {
+      filter->SetProbabilityImage(c, posteriors[c]);
+      }
+    filter->SetMaskImage(nonAirRegion);
+    filter->SetLabelCodes(labelCodes);
+    filter->SetForegroundClasses(isForeground);
+    filter->SetBackgroundLabel(0);
+    filter->SetBelowThresholdLabel(99);
+    filter->SetInclusionThreshold(thresholds[t]);
+    filter->SetMinimumForegroundProbability(0.001);
+    filter->SetNumberOfThreads(3);
+    filter->Update();
+
+    ByteImageType::Pointer labels = MakeByteImage(posteriors[0]);
+    ByteImageType::Pointer foregroundMask = MakeByteImage(posteriors[0]);
+    ReferenceLabels(posteriors, isForeground, labelCodes, nonAirRegion, thresholds[t], labels, foregroundMask);
+
+    std::map<unsigned char, itk::SizeValueType> counts;
+    unsigned int                                mismatches = 0;
+    for( itk::ImageRegionConstIteratorWithIndex<ByteImageType> it(labels, labels->GetLargestPossibleRegion() );
+         !it.IsAtEnd(); ++it )
+      {
+      ++counts[it.Get()];
+      if( filter->GetOutput()->GetPixel(it.GetIndex() ) != it.Get()
+          || filter->GetForegroundMask()->GetPixel(it.GetIndex() ) != foregroundMask->GetPixel(it.GetIndex() ) )
+        {
+        ++mismatches;
+        }
+      }
+
+    const unsigned char countedLabels[] = { 0, 1, 4, 23, 99 };
+    for( unsigned int l = 0; l < 5; ++l )
+      {
+      if( filter->GetLabelCount(countedLabels[l]) != counts[countedLabels[l]] )
+        {
+        std::cerr << "Label " << static_cast<int>( countedLabels[l] ) << " counted "
+                  << filter->GetLabelCount(countedLabels[l]) << " times, expected " << counts[countedLabels[l]]
+                  << std::endl;
+        status = EXIT_FAILURE;
+        }
+      }
+
+    // the ties and the voxel without probability, without thresholding
+    index[1] = 1;
+    index[2] = 1;
+    const unsigned char expectedLabels[] = { 1, 4, 99 };
+    for( index[0] = 1; t == 0 && index[0] < 4; ++index[0] )
+      {
+      if( filter->GetOutput()->GetPixel(index) != expectedLabels[index[0] - 1] )
+        {
+        ++mismatches;
+        }
+      }
+
+    std::cout << "Inclusion threshold " << thresholds[t] << ": " << mismatches << " mismatches" << std::endl;
+    if( mismatches != 0 )
+      {
+      status = EXIT_FAILURE;
+      }
+    }
+
+  return status;
+}
@@ -0,0 +1,170 @@
+/*=========================================================================
+ *
+ *  Copyright SINAPSE: Scalable Informatics for Neuroscience, Processing and Software Engineering
+ *            The University of Iowa
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#include <itkImage.h>
+
+#include <itkRandomImageSource.h>
+#include <itkCastImageFilter.h>
+#include <itkImageRegionConstIterator.h>
+
+#include "itkAverageImageFilter.h"
+#include "itkStreamingAverageImageAccumulator.h"
+
+#include <algorithm>
+#include <limits>
+
+typedef itk::Image<float, 3>                                       FloatImage3DType;
+typedef itk::StreamingAverageImageAccumulator<FloatImage3DType>    AccumulatorType;
+typedef itk::ImageRegionConstIterator<FloatImage3DType>            FloatImageConstIterator;
+
+/** largest absolute difference of two images of the same region */
+static double
+MaximumDifference(const FloatImage3DType *a, const FloatImage3DType *b)
+{
+  FloatImageConstIterator aIt(a, a->GetLargestPossibleRegion() );
+  FloatImageConstIterator bIt(b, b->GetLargestPossibleRegion() );
+  double                  maximum = 0.0;
+
+  for( ; !aIt.IsAtEnd(); ++aIt, ++bIt )
+    {
+    maximum = std::max(maximum, static_cast<double>( vcl_abs(aIt.Get() - bIt.Get() ) ) );
+    }
+  return maximum;
+}
+
+/** true when every pixel of the image is within eps of value */
+static bool
+IsConstant(const FloatImage3DType *image, const double value, const double eps)
+{
+  for( FloatImageConstIterator it(image, image->GetLargestPossibleRegion() ); !it.IsAtEnd(); ++it )
+    {
+    if( !( vcl_abs(it.Get() - value) < eps ) )
+      {
+      std::cerr << "Expected " << value << ", got " << it.Get() << std::endl;
+      return false;
+      }
+    }
+  return true;
+}
+
+int main( int , char * [] )
+{
+  const unsigned int numTestImages(5);
+
+  FloatImage3DType::SizeType randomSize;
+  randomSize[0] = 9;
+  randomSize[1] = 7;
+  randomSize[2] = 6;
+
+  std::vector<FloatImage3DType::Pointer> inputImages;
+  for( unsigned int i = 0; i < numTestImages; ++i )
+    {
+    itk::RandomImageSource<FloatImage3DType>::Pointer random = itk::RandomImageSource<FloatImage3DType>::New();
+    // different ranges, in case the sources share their random sequence
+    random->SetMin(-100.0 * i);
+    random->SetMax(1000.0 + 250.0 * i);
+    random->SetSize(randomSize);
+    random->Update();
+    inputImages.push_back(random->GetOutput() );
+    }
+
+  int status = EXIT_SUCCESS;
+
+  // The unweighted mean matches AverageImageFilter
+    {
+    typedef itk::AverageImageFilter<FloatImage3DType, FloatImage3DType> AverageImageFilterType;
+    AverageImageFilterType::Pointer avgFilter = AverageImageFilterType::New();
+    AccumulatorType::Pointer        accumulator = AccumulatorType::New();
+    for( unsigned int i = 0; i < numTestImages; ++i )
+      {
+      avgFilter->SetInput(i, inputImages[i]);
+      accumulator->AddImage(inputImages[i]);
+      }
+    avgFilter->Update();
+
+    const double difference = MaximumDifference(avgFilter->GetOutput(), accumulator->GetMeanImage() );
+    std::cout << "Mean vs AverageImageFilter: " << difference << std::endl;
+    if( !( difference < 1.0e-3 ) )
+      {
+      status = EXIT_FAILURE;
+      }
+    }
+
+  // Streaming the inputs slab by slab gives the same weighted sums
+    {
+    AccumulatorType::Pointer inMemory = AccumulatorType::New();
+    AccumulatorType::Pointer streamed = AccumulatorType::New();
+    streamed->SetNumberOfStreamDivisions(4);
+    for( unsigned int i = 0; i < numTestImages; ++i )
+      {
+      const double weight = 1.0 + 0.5 * i;
+      inMemory->AddImage(inputImages[i], weight);
+
+      typedef itk::CastImageFilter<FloatImage3DType, FloatImage3DType> CastFilterType;
+      CastFilterType::Pointer cast = CastFilterType::New();
+      cast->SetInput(inputImages[i]);
+      cast->InPlaceOff();
+      streamed->AddImageSource(cast, weight);
+      }
+
+    const double meanDifference = MaximumDifference(inMemory->GetMeanImage(), streamed->GetMeanImage() );
+    const double varianceDifference = MaximumDifference(inMemory->GetVarianceImage(), streamed->GetVarianceImage() );
+    std::cout << "AddImageSource vs AddImage: mean " << meanDifference
+              << " variance " << varianceDifference << std::endl;
+    if( !( meanDifference < 1.0e-6 ) || !( varianceDifference < 1.0e-3 ) )
+      {
+      status = EXIT_FAILURE;
+      }
+    }
+
+  // Median and trimmed mean of known values with one unit wide bins.  The
+  // infinite value counts in the last bin and the NaN value is not counted.
+    {
+    const float values[] = { 10.0F, 2.0F, std::numeric_limits<float>::infinity(), 1.0F,
+                             std::numeric_limits<float>::quiet_NaN(), 3.0F };
+    AccumulatorType::Pointer accumulator = AccumulatorType::New();
+    accumulator->SetNumberOfHistogramBins(128);
+    accumulator->SetHistogramMinimum(0.0);
+    accumulator->SetHistogramMaximum(128.0);
+    for( unsigned int i = 0; i < sizeof( values ) / sizeof( values[0] ); ++i )
+      {
+      FloatImage3DType::Pointer image = FloatImage3DType::New();
+      image->CopyInformation(inputImages[0]);
+      image->SetRegions(randomSize);
+      image->Allocate();
+      image->FillBuffer(values[i]);
+      accumulator->AddImage(image);
+      }
+
+    // half of the 5 counted values falls in the middle of bin 3
+    const bool medianOK = IsConstant(accumulator->GetMedianImage(), 3.5, 1.0e-5);
+    // bins 2, 3 and 10 are kept, at their centers
+    const bool trimmedOK = IsConstant(accumulator->GetTrimmedMeanImage(0.2), 5.5, 1.0e-5);
+    // all the bin centers, including the last one
+    const bool untrimmedOK = IsConstant(accumulator->GetTrimmedMeanImage(0.0),
+                                        ( 1.5 + 2.5 + 3.5 + 10.5 + 127.5 ) / 5.0, 1.0e-4);
+    std::cout << "Median " << medianOK << " trimmed mean " << trimmedOK
+              << " untrimmed mean " << untrimmedOK << std::endl;
+    if( !medianOK || !trimmedOK || !untrimmedOK )
+      {
+      status = EXIT_FAILURE;
+      }
+    }
+
+  return status;
+}
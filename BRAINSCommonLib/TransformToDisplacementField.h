@@ -22,7 +22,7 @@
 #include "itkIO.h"
 #include "CrossOverAffineSystem.h"
 
-#include <itkTransformToDisplacementFieldFilter.h>
+#include "itkBRAINSTransformToDisplacementFieldFilter.h"
 
 /**
   * Go from any subclass of Transform, to the corresponding deformation field
@@ -33,9 +33,8 @@ TransformToDisplacementField(itk::ImageBase<DisplacementFieldPointerType::Object
                              TransformPointerType xfrm)
 {
   typedef typename DisplacementFieldPointerType::ObjectType OutputType;
-  typedef typename itk::TransformToDisplacementFieldFilter<OutputType, double> TodefType;
+  typedef typename itk::BRAINSTransformToDisplacementFieldFilter<OutputType, double> TodefType;
   typename TodefType::Pointer todef( TodefType::New() );
-  todef->SetUseReferenceImage(true);
   todef->SetReferenceImage(templateImage);
   todef->SetTransform(xfrm);
   try
@@ -45,6 +45,11 @@ namespace itk
  * to that type by a cast operation. There is currently no rounding
  * implemented.
  *
+ * All inputs must be in memory at the same time; to average many images,
+ * or images read slab by slab, use StreamingAverageImageAccumulator.
+ *
+ * \sa StreamingAverageImageAccumulator
+ *
  * \author Torsten Rohlfing, SRI International, Neuroscience Program
  *
  * Funding for the implementation of this class was provided by NIAAA under
@@ -0,0 +1,170 @@
+/*=========================================================================
+ *
+ *  Copyright SINAPSE: Scalable Informatics for Neuroscience, Processing and Software Engineering
+ *            The University of Iowa
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#ifndef __itkBRAINSTransformToDisplacementFieldFilter_h
+#define __itkBRAINSTransformToDisplacementFieldFilter_h
+
+#include "itkImageSource.h"
+#include "itkTransform.h"
+#include "itkMatrix.h"
+#include <vector>
+
+namespace itk
+{
+/** \class BRAINSTransformToDisplacementFieldFilter
+ *
+ * \brief Multithreaded computation of the displacement field of a transform
+ * on the grid of a reference image.
+ *
+ * Each output voxel receives T(x) - x, where x is the physical point of the
+ * voxel, like itk::TransformToDisplacementFieldFilter.  The output is
+ * computed one row at a time, and the work done per voxel depends on the
+ * kind of transform:
+ *
+ *  - Linear transforms (MatrixOffsetTransformBase and TranslationTransform):
+ *    the displacement is an affine function of the voxel index, so it is
+ *    computed exactly at the start of each row and then incremented by a
+ *    constant step along the row.
+ *  - Cubic BSpline transforms whose coefficient grid is axis aligned with
+ *    the reference grid: the BSpline weights and support start of every
+ *    column, row and slice are tabulated once per axis.  For each row the
+ *    coefficients are first reduced along the slice and row axes, so each
+ *    voxel only needs the 4 column weights per component.  A linear bulk
+ *    transform is added incrementally as above.  The voxels whose support
+ *    is not fully inside the coefficient grid are evaluated by the
+ *    transform itself, so the result matches TransformPoint() everywhere.
+ *  - Any other transform is evaluated by TransformPoint() at each voxel.
+ *
+ * The transform must be thread safe for TransformPoint(), which is the case
+ * of the ITK transforms.
+ *
+ * \ingroup ITKBRAINSFilterPack
+ */
+template <typename TOutputImage, typename TParametersValueType = double>
+class ITK_EXPORT BRAINSTransformToDisplacementFieldFilter :
+  public ImageSource<TOutputImage>
+{
+public:
+  /** Standard class typedefs. */
+  typedef BRAINSTransformToDisplacementFieldFilter Self;
+  typedef ImageSource<TOutputImage>                Superclass;
+  typedef SmartPointer<Self>                       Pointer;
+  typedef SmartPointer<const Self>                 ConstPointer;
+
+  /** Method for creation through the object factory. */
+  itkNewMacro(Self);
+
+  /** Run-time type information (and related methods) */
+  itkTypeMacro(BRAINSTransformToDisplacementFieldFilter, ImageSource);
+
+  itkStaticConstMacro(ImageDimension, unsigned int, TOutputImage::ImageDimension);
+
+  typedef TOutputImage                                     OutputImageType;
+  typedef typename OutputImageType::PixelType              PixelType;
+  typedef typename PixelType::ValueType                    PixelValueType;
+  typedef typename OutputImageType::RegionType             OutputImageRegionType;
+  typedef ImageBase<itkGetStaticConstMacro(ImageDimension)> ReferenceImageBaseType;
+
+  typedef Transform<TParametersValueType,
+                    itkGetStaticConstMacro(ImageDimension),
+                    itkGetStaticConstMacro(ImageDimension)> TransformType;
+  typedef typename TransformType::InputPointType            TransformPointType;
+
+  /** The transform to sample */
+  itkSetConstObjectMacro(Transform, TransformType);
+  itkGetConstObjectMacro(Transform, TransformType);
+
+  /** The output has the region, spacing, origin and direction of this image */
+  itkSetConstObjectMacro(ReferenceImage, ReferenceImageBaseType);
+  itkGetConstObjectMacro(ReferenceImage, ReferenceImageBaseType);
+
+protected:
+  BRAINSTransformToDisplacementFieldFilter();
+  virtual ~BRAINSTransformToDisplacementFieldFilter() {}
+
+  void GenerateOutputInformation() ITK_OVERRIDE;
+
+  void BeforeThreadedGenerateData() ITK_OVERRIDE;
+
+  void ThreadedGenerateData(const OutputImageRegionType & outputRegionForThread,
+                            ThreadIdType threadId) ITK_OVERRIDE;
+
+  void AfterThreadedGenerateData() ITK_OVERRIDE;
+
+  void PrintSelf(std::ostream &, Indent) const ITK_OVERRIDE;
+
+private:
+  ITK_DISALLOW_COPY_AND_ASSIGN(BRAINSTransformToDisplacementFieldFilter);
+
+  typedef Matrix<double, itkGetStaticConstMacro(ImageDimension), itkGetStaticConstMacro(ImageDimension)> MatrixType;
+  typedef Vector<double, itkGetStaticConstMacro(ImageDimension)> VectorType;
+
+  enum EvaluationType
+    {
+    GENERIC_EVALUATION,
+    LINEAR_EVALUATION,
+    BSPLINE_EVALUATION
+    };
+
+  /** Cubic BSpline support of one index along one axis of the output */
+  struct SupportType
+    {
+    bool            Valid;
+    OffsetValueType Start;  // relative to the coefficient buffer
+    double          Weights[4];
+    };
+
+  /** Gets the displacement d(x) = A x + b of a linear transform */
+  bool GetLinearDisplacement(const TransformType *transform, MatrixType & A, VectorType & b) const;
+
+  /** Sets up the BSpline tables, or returns false when the BSpline path
+   * does not apply to this transform */
+  bool InitializeBSpline();
+
+  /** Sums the coefficients of the support of a row along all the axes but
+   * the first one.  Returns false when no voxel of the row is inside the
+   * valid region of the BSpline. */
+  bool ReduceBSplineRow(const typename OutputImageType::IndexType & rowIndex, SizeValueType rowLength,
+                        std::vector<double> & reduced) const;
+
+  typename TransformType::ConstPointer          m_Transform;
+  typename ReferenceImageBaseType::ConstPointer m_ReferenceImage;
+
+  // Working state of one update
+  EvaluationType m_Evaluation;
+  MatrixType     m_IndexToPhysicalPoint;
+  VectorType     m_Origin;
+  // d(x) = m_LinearMatrix * x + m_LinearOffset for the linear transform,
+  // or for the bulk transform of a BSpline when m_HasLinearBulk is set.
+  bool                                      m_HasLinearBulk;
+  MatrixType                                m_LinearMatrix;
+  VectorType                                m_LinearOffset;
+  const TransformType *                     m_GenericBulkTransform;
+  std::vector<SupportType>                  m_Supports[ImageDimension];
+  std::vector<const TParametersValueType *> m_CoefficientBuffers;
+  OffsetValueType                           m_CoefficientStride[ImageDimension];
+  OffsetValueType                           m_CoefficientSize[ImageDimension];
+};
+
+} // end namespace itk
+
+#ifndef ITK_MANUAL_INSTANTIATION
+#include "itkBRAINSTransformToDisplacementFieldFilter.hxx"
+#endif
+
+#endif
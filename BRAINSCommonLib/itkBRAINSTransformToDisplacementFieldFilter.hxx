@@ -0,0 +1,462 @@
+/*=========================================================================
+ *
+ *  Copyright SINAPSE: Scalable Informatics for Neuroscience, Processing and Software Engineering
+ *            The University of Iowa
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#ifndef __itkBRAINSTransformToDisplacementFieldFilter_hxx
+#define __itkBRAINSTransformToDisplacementFieldFilter_hxx
+
+#include "itkBRAINSTransformToDisplacementFieldFilter.h"
+#include "itkMatrixOffsetTransformBase.h"
+#include "itkTranslationTransform.h"
+#include "itkBSplineBaseTransform.h"
+#include "itkBSplineDeformableTransform.h"
+#include "itkImageScanlineIterator.h"
+#include <algorithm>
+#include <cmath>
+
+namespace itk
+{
+template <typename TOutputImage, typename TParametersValueType>
+BRAINSTransformToDisplacementFieldFilter<TOutputImage, TParametersValueType>
+::BRAINSTransformToDisplacementFieldFilter() :
+  m_Transform(ITK_NULLPTR),
+  m_ReferenceImage(ITK_NULLPTR),
+  m_Evaluation(GENERIC_EVALUATION),
+  m_HasLinearBulk(false),
+  m_GenericBulkTransform(ITK_NULLPTR)
+{
+  this->m_IndexToPhysicalPoint.SetIdentity();
+  this->m_Origin.Fill(0.0);
+  this->m_LinearMatrix.Fill(0.0);
+  this->m_LinearOffset.Fill(0.0);
+  for( unsigned int i = 0; i < ImageDimension; ++i )
+    {
+    this->m_CoefficientStride[i] = 0;
+    this->m_CoefficientSize[i] = 0;
+    }
+}
+
+template <typename TOutputImage, typename TParametersValueType>
+void
+BRAINSTransformToDisplacementFieldFilter<TOutputImage, TParametersValueType>
+::GenerateOutputInformation()
+{
+  if( this->m_ReferenceImage.IsNull() )
+    {
+    itkExceptionMacro(<< "A reference image is required");
+    }
+  OutputImageType *output = this->GetOutput();
+  output->SetLargestPossibleRegion(this->m_ReferenceImage->GetLargestPossibleRegion() );
+  output->SetSpacing(this->m_ReferenceImage->GetSpacing() );
+  output->SetOrigin(this->m_ReferenceImage->GetOrigin() );
+  output->SetDirection(this->m_ReferenceImage->GetDirection() );
+}
+
+template <typename TOutputImage, typename TParametersValueType>
+bool
+BRAINSTransformToDisplacementFieldFilter<TOutputImage, TParametersValueType>
+::GetLinearDisplacement(const TransformType *transform, MatrixType & A, VectorType & b) const
+{
+  typedef MatrixOffsetTransformBase<TParametersValueType, ImageDimension, ImageDimension> MatrixOffsetTransformType;
+  typedef TranslationTransform<TParametersValueType, ImageDimension>                     TranslationTransformType;
+
+  if( const MatrixOffsetTransformType *matrixOffset = dynamic_cast<const MatrixOffsetTransformType *>( transform ) )
+    {
+    // T(x) = M x + offset, so d(x) = (M - I) x + offset
+    for( unsigned int i = 0; i < ImageDimension; ++i )
+      {
+      for( unsigned int j = 0; j < ImageDimension; ++j )
+        {
+        A(i, j) = matrixOffset->GetMatrix()(i, j) - ( i == j ? 1.0 : 0.0 );
+        }
+      b[i] = matrixOffset->GetOffset()[i];
+      }
+    return true;
+    }
+  if( const TranslationTransformType *translation = dynamic_cast<const TranslationTransformType *>( transform ) )
+    {
+    A.Fill(0.0);
+    for( unsigned int i = 0; i < ImageDimension; ++i )
+      {
+      b[i] = translation->GetOffset()[i];
+      }
+    return true;
+    }
+  return false;
+}
+
+template <typename TOutputImage, typename TParametersValueType>
+bool
+BRAINSTransformToDisplacementFieldFilter<TOutputImage, TParametersValueType>
+::InitializeBSpline()
+{
+  typedef BSplineBaseTransform<TParametersValueType, ImageDimension, 3>       BSplineTransformType;
+  typedef BSplineDeformableTransform<TParametersValueType, ImageDimension, 3> BSplineDeformableTransformType;
+  typedef typename BSplineTransformType::ImageType                            CoefficientImageType;
+
+  const BSplineTransformType *bspline = dynamic_cast<const BSplineTransformType *>( this->m_Transform.GetPointer() );
+  if( bspline == ITK_NULLPTR )
+    {
+    return false;
+    }
+  const typename BSplineTransformType::CoefficientImageArray coefficients = bspline->GetCoefficientImages();
+  const CoefficientImageType *                               grid = coefficients[0];
+  if( grid == ITK_NULLPTR
+      || grid->GetBufferedRegion() != grid->GetLargestPossibleRegion() )
+    {
+    return false;
+    }
+  this->m_CoefficientBuffers.resize(ImageDimension);
+  for( unsigned int d = 0; d < ImageDimension; ++d )
+    {
+    if( coefficients[d].IsNull() || coefficients[d]->GetBufferPointer() == ITK_NULLPTR
+        || coefficients[d]->GetBufferedRegion() != grid->GetBufferedRegion() )
+      {
+      return false;
+      }
+    this->m_CoefficientBuffers[d] = coefficients[d]->GetBufferPointer();
+    }
+
+  // Continuous index in the coefficient grid of the output index i:
+  //   c = G i + c0.
+  // The tables only apply when G is diagonal.
+  const OutputImageType *output = this->GetOutput();
+  const MatrixType       G = grid->GetPhysicalPointToIndex() * this->m_IndexToPhysicalPoint;
+  VectorType             originDifference;
+  for( unsigned int i = 0; i < ImageDimension; ++i )
+    {
+    originDifference[i] = this->m_Origin[i] - grid->GetOrigin()[i];
+    }
+  const VectorType                   c0 = grid->GetPhysicalPointToIndex() * originDifference;
+  const OutputImageRegionType &      region = output->GetLargestPossibleRegion();
+  const typename CoefficientImageType::RegionType & gridRegion = grid->GetBufferedRegion();
+  for( unsigned int i = 0; i < ImageDimension; ++i )
+    {
+    for( unsigned int j = 0; j < ImageDimension; ++j )
+      {
+      if( i != j && std::fabs(G(i, j) ) * region.GetSize(j) > 1e-9 )
+        {
+        return false;
+        }
+      }
+    }
+
+  OffsetValueType stride = 1;
+  for( unsigned int a = 0; a < ImageDimension; ++a )
+    {
+    this->m_CoefficientStride[a] = stride;
+    this->m_CoefficientSize[a] = gridRegion.GetSize(a);
+    stride *= gridRegion.GetSize(a);
+
+    // Valid region of a cubic BSpline, as in BSplineBaseTransform, with a
+    // small margin so that the voxels on its border are left to the
+    // transform itself.
+    const double minLimit = gridRegion.GetIndex(a) + 1.0 + 1e-6;
+    const double maxLimit = gridRegion.GetIndex(a) + static_cast<double>( gridRegion.GetSize(a) ) - 2.0 - 1e-6;
+
+    this->m_Supports[a].resize(region.GetSize(a) );
+    for( SizeValueType k = 0; k < region.GetSize(a); ++k )
+      {
+      SupportType & support = this->m_Supports[a][k];
+      const double  c = c0[a] + G(a, a) * static_cast<double>( region.GetIndex(a) + static_cast<OffsetValueType>( k ) );
+      support.Valid = ( c >= minLimit && c < maxLimit );
+      if( !support.Valid )
+        {
+        support.Start = 0;
+        std::fill(support.Weights, support.Weights + 4, 0.0);
+        continue;
+        }
+      const double floorC = std::floor(c);
+      const double u = c - floorC;
+      const double u2 = u * u;
+      const double u3 = u2 * u;
+      support.Start = static_cast<OffsetValueType>( floorC ) - 1 - gridRegion.GetIndex(a);
+      support.Weights[0] = ( 1.0 - u ) * ( 1.0 - u ) * ( 1.0 - u ) / 6.0;
+      support.Weights[1] = ( 3.0 * u3 - 6.0 * u2 + 4.0 ) / 6.0;
+      support.Weights[2] = ( -3.0 * u3 + 3.0 * u2 + 3.0 * u + 1.0 ) / 6.0;
+      support.Weights[3] = u3 / 6.0;
+      }
+    }
+
+  // The bulk transform of a BSplineDeformableTransform is applied to every
+  // point, inside the valid region or not.
+  if( const BSplineDeformableTransformType *deformable =
+        dynamic_cast<const BSplineDeformableTransformType *>( bspline ) )
+    {
+    const TransformType *bulk = deformable->GetBulkTransform();
+    if( bulk != ITK_NULLPTR )
+      {
+      this->m_HasLinearBulk = this->GetLinearDisplacement(bulk, this->m_LinearMatrix, this->m_LinearOffset);
+      if( !this->m_HasLinearBulk )
+        {
+        this->m_GenericBulkTransform = bulk;
+        }
+      }
+    }
+  return true;
+}
+
+template <typename TOutputImage, typename TParametersValueType>
+void
+BRAINSTransformToDisplacementFieldFilter<TOutputImage, TParametersValueType>
+::BeforeThreadedGenerateData()
+{
+  if( this->m_Transform.IsNull() )
+    {
+    itkExceptionMacro(<< "A transform is required");
+    }
+  const OutputImageType *output = this->GetOutput();
+  this->m_IndexToPhysicalPoint = output->GetIndexToPhysicalPoint();
+  for( unsigned int i = 0; i < ImageDimension; ++i )
+    {
+    this->m_Origin[i] = output->GetOrigin()[i];
+    }
+
+  this->m_HasLinearBulk = false;
+  this->m_GenericBulkTransform = ITK_NULLPTR;
+  this->m_LinearMatrix.Fill(0.0);
+  this->m_LinearOffset.Fill(0.0);
+  if( this->GetLinearDisplacement(this->m_Transform, this->m_LinearMatrix, this->m_LinearOffset) )
+    {
+    this->m_Evaluation = LINEAR_EVALUATION;
+    }
+  else if( this->InitializeBSpline() )
+    {
+    this->m_Evaluation = BSPLINE_EVALUATION;
+    }
+  else
+    {
+    this->m_Evaluation = GENERIC_EVALUATION;
+    }
+}
+
+template <typename TOutputImage, typename TParametersValueType>
+bool
+BRAINSTransformToDisplacementFieldFilter<TOutputImage, TParametersValueType>
+::ReduceBSplineRow(const typename OutputImageType::IndexType & rowIndex, const SizeValueType rowLength,
+                   std::vector<double> & reduced) const
+{
+  const typename OutputImageType::IndexType & largestIndex =
+    this->GetOutput()->GetLargestPossibleRegion().GetIndex();
+
+  const SupportType *rowSupports[ImageDimension];
+  OffsetValueType    rowOffset = 0;
+  for( unsigned int a = 1; a < ImageDimension; ++a )
+    {
+    rowSupports[a] = &this->m_Supports[a][rowIndex[a] - largestIndex[a]];
+    if( !rowSupports[a]->Valid )
+      {
+      return false;
+      }
+    rowOffset += rowSupports[a]->Start * this->m_CoefficientStride[a];
+    }
+
+  // Columns of the coefficient grid used by this row
+  OffsetValueType firstColumn = this->m_CoefficientSize[0];
+  OffsetValueType lastColumn = -1;
+  const SupportType *columnSupports = &this->m_Supports[0][rowIndex[0] - largestIndex[0]];
+  for( SizeValueType i = 0; i < rowLength; ++i )
+    {
+    if( columnSupports[i].Valid )
+      {
+      firstColumn = std::min(firstColumn, columnSupports[i].Start);
+      lastColumn = std::max(lastColumn, columnSupports[i].Start + 3);
+      }
+    }
+  if( lastColumn < firstColumn )
+    {
+    return false;
+    }
+
+  const OffsetValueType columns = this->m_CoefficientSize[0];
+  for( unsigned int d = 0; d < ImageDimension; ++d )
+    {
+    std::fill(reduced.begin() + d * columns + firstColumn, reduced.begin() + d * columns + lastColumn + 1, 0.0);
+    }
+
+  // Each of the 4^(N-1) nodes of the support in the other axes
+  unsigned int numberOfNodes = 1;
+  for( unsigned int a = 1; a < ImageDimension; ++a )
+    {
+    numberOfNodes *= 4;
+    }
+  for( unsigned int node = 0; node < numberOfNodes; ++node )
+    {
+    double          weight = 1.0;
+    OffsetValueType offset = rowOffset;
+    unsigned int    digits = node;
+    for( unsigned int a = 1; a < ImageDimension; ++a, digits /= 4 )
+      {
+      weight *= rowSupports[a]->Weights[digits % 4];
+      offset += static_cast<OffsetValueType>( digits % 4 ) * this->m_CoefficientStride[a];
+      }
+    for( unsigned int d = 0; d < ImageDimension; ++d )
+      {
+      const TParametersValueType *coefficient = this->m_CoefficientBuffers[d] + offset;
+      double *                    sum = &reduced[d * columns];
+      for( OffsetValueType x = firstColumn; x <= lastColumn; ++x )
+        {
+        sum[x] += weight * coefficient[x];
+        }
+      }
+    }
+  return true;
+}
+
+template <typename TOutputImage, typename TParametersValueType>
+void
+BRAINSTransformToDisplacementFieldFilter<TOutputImage, TParametersValueType>
+::ThreadedGenerateData(const OutputImageRegionType & outputRegionForThread, ThreadIdType)
+{
+  if( outputRegionForThread.GetNumberOfPixels() == 0 )
+    {
+    return;
+    }
+  OutputImageType *                           output = this->GetOutput();
+  const typename OutputImageType::IndexType & largestIndex = output->GetLargestPossibleRegion().GetIndex();
+  const TransformType *                       transform = this->m_Transform.GetPointer();
+  const SizeValueType                         rowLength = outputRegionForThread.GetSize(0);
+
+  const bool isLinear = ( this->m_Evaluation == LINEAR_EVALUATION )
+    || ( this->m_Evaluation == BSPLINE_EVALUATION && this->m_HasLinearBulk );
+  VectorType step;
+  for( unsigned int i = 0; i < ImageDimension; ++i )
+    {
+    step[i] = this->m_IndexToPhysicalPoint(i, 0);
+    }
+  const VectorType linearStep = this->m_LinearMatrix * step;
+
+  std::vector<double> reduced;
+  if( this->m_Evaluation == BSPLINE_EVALUATION )
+    {
+    reduced.resize(ImageDimension * this->m_CoefficientSize[0]);
+    }
+  const OffsetValueType columns = this->m_CoefficientSize[0];
+
+  ImageScanlineIterator<OutputImageType> it(output, outputRegionForThread);
+  while( !it.IsAtEnd() )
+    {
+    const typename OutputImageType::IndexType rowIndex = it.GetIndex();
+    VectorType                                rowStart = this->m_Origin;
+    for( unsigned int i = 0; i < ImageDimension; ++i )
+      {
+      for( unsigned int j = 0; j < ImageDimension; ++j )
+        {
+        rowStart[i] += this->m_IndexToPhysicalPoint(i, j) * rowIndex[j];
+        }
+      }
+    // The linear part is exact at the start of the row and stepped along it
+    VectorType linear;
+    linear.Fill(0.0);
+    if( isLinear )
+      {
+      linear = this->m_LinearMatrix * rowStart + this->m_LinearOffset;
+      }
+    const bool         rowInside = ( this->m_Evaluation == BSPLINE_EVALUATION )
+      && this->ReduceBSplineRow(rowIndex, rowLength, reduced);
+    const SupportType *columnSupports = ( this->m_Evaluation == BSPLINE_EVALUATION )
+      ? &this->m_Supports[0][rowIndex[0] - largestIndex[0]] : ITK_NULLPTR;
+
+    for( SizeValueType i = 0; !it.IsAtEndOfLine(); ++i, ++it )
+      {
+      VectorType displacement;
+      if( this->m_Evaluation == LINEAR_EVALUATION )
+        {
+        displacement = linear;
+        }
+      else if( rowInside && columnSupports[i].Valid )
+        {
+        if( this->m_GenericBulkTransform != ITK_NULLPTR )
+          {
+          TransformPointType point;
+          for( unsigned int d = 0; d < ImageDimension; ++d )
+            {
+            point[d] = static_cast<TParametersValueType>( rowStart[d] + i * step[d] );
+            }
+          const TransformPointType bulkPoint = this->m_GenericBulkTransform->TransformPoint(point);
+          for( unsigned int d = 0; d < ImageDimension; ++d )
+            {
+            displacement[d] = bulkPoint[d] - point[d];
+            }
+          }
+        else
+          {
+          displacement = linear;
+          }
+        const SupportType & support = columnSupports[i];
+        for( unsigned int d = 0; d < ImageDimension; ++d )
+          {
+          const double *sum = &reduced[d * columns + support.Start];
+          displacement[d] += support.Weights[0] * sum[0] + support.Weights[1] * sum[1]
+            + support.Weights[2] * sum[2] + support.Weights[3] * sum[3];
+          }
+        }
+      else
+        {
+        TransformPointType point;
+        for( unsigned int d = 0; d < ImageDimension; ++d )
+          {
+          point[d] = static_cast<TParametersValueType>( rowStart[d] + i * step[d] );
+          }
+        const TransformPointType mappedPoint = transform->TransformPoint(point);
+        for( unsigned int d = 0; d < ImageDimension; ++d )
+          {
+          displacement[d] = mappedPoint[d] - point[d];
+          }
+        }
+
+      PixelType value;
+      for( unsigned int d = 0; d < ImageDimension; ++d )
+        {
+        value[d] = static_cast<PixelValueType>( displacement[d] );
+        }
+      it.Set(value);
+      if( isLinear )
+        {
+        linear += linearStep;
+        }
+      }
+    it.NextLine();
+    }
+}
+
+template <typename TOutputImage, typename TParametersValueType>
+void
+BRAINSTransformToDisplacementFieldFilter<TOutputImage, TParametersValueType>
+::AfterThreadedGenerateData()
+{
+  for( unsigned int a = 0; a < ImageDimension; ++a )
+    {
+    std::vector<SupportType>().swap(this->m_Supports[a]);
+    }
+  this->m_CoefficientBuffers.clear();
+  this->m_GenericBulkTransform = ITK_NULLPTR;
+}
+
+template <typename TOutputImage, typename TParametersValueType>
+void
+BRAINSTransformToDisplacementFieldFilter<TOutputImage, TParametersValueType>
+::PrintSelf(std::ostream & os, Indent indent) const
+{
+  Superclass::PrintSelf(os, indent);
+  os << indent << "Transform: " << this->m_Transform.GetPointer() << std::endl;
+  os << indent << "ReferenceImage: " << this->m_ReferenceImage.GetPointer() << std::endl;
+}
+
+} // end namespace itk
+
+#endif
@@ -36,37 +36,75 @@
 #include "itkGDCMSeriesFileNames.h"
 #include "itkImageSeriesReader.h"
 #include "itkGDCMImageIO.h"
+#include "BRAINSImageReadCache.h"
+#include <typeinfo>
 
 namespace itkUtil
 {
 typedef itk::SpatialOrientationAdapter SOAdapterType;
 typedef SOAdapterType::DirectionType   DirectionType;
 
-/**
-  *
-  *
-  *
-  */
-/** read an image using ITK -- image-based template */
+/** Whether fileName can be DICOM: GDCM is only asked about the files that
+ * do not have the extension of another image format. */
+inline bool MayBeDICOMFile(const std::string & fileName)
+{
+  static const char * const nonDICOMExtensions[] =
+    {
+    ".nii", ".gz", ".nrrd", ".nhdr", ".mha", ".mhd", ".hdr", ".img", ".gipl", ".vtk", ".png", ".jpg", ".tif",
+    ".tiff", ".bmp", ITK_NULLPTR
+    };
+  const std::string extension =
+    itksys::SystemTools::LowerCase( itksys::SystemTools::GetFilenameLastExtension(fileName) );
+  if( extension == ".dcm" )
+    {
+    return true;
+    }
+  for( const char * const *e = nonDICOMExtensions; *e != ITK_NULLPTR; ++e )
+    {
+    if( extension == *e )
+      {
+      return false;
+      }
+    }
+  itk::GDCMImageIO::Pointer dicomIO = itk::GDCMImageIO::New();
+  return dicomIO->CanReadFile( fileName.c_str() );
+}
+
+/** File names of the first DICOM series in a directory, remembered by the
+ * ImageReadCache until the directory changes. */
+inline std::vector<std::string> GetDICOMSeriesFileNames(const std::string & dicomDir)
+{
+  std::vector<std::string> fileNames;
+  if( ImageReadCache::GetInstance().FindDICOMSeries(dicomDir, fileNames) )
+    {
+    return fileNames;
+    }
+  itk::GDCMSeriesFileNames::Pointer FileNameGenerator = itk::GDCMSeriesFileNames::New();
+  FileNameGenerator->SetUseSeriesDetails(true);
+  FileNameGenerator->SetDirectory(dicomDir);
+  typedef const std::vector<std::string> ContainerType;
+  const ContainerType & seriesUIDs = FileNameGenerator->GetSeriesUIDs();
+  if( !seriesUIDs.empty() )
+    {
+    fileNames = FileNameGenerator->GetFileNames(seriesUIDs[0]);
+    }
+  ImageReadCache::GetInstance().InsertDICOMSeries(dicomDir, fileNames);
+  return fileNames;
+}
+
+/** read an image from disk, bypassing the image cache */
 template <typename TImage>
-typename TImage::Pointer ReadImage(const std::string & fileName)
+typename TImage::Pointer ReadImageFromDisk(const std::string & fileName)
 {
   typename TImage::Pointer image;
-  std::string               extension = itksys::SystemTools::GetFilenameLastExtension(fileName);
-  itk::GDCMImageIO::Pointer dicomIO = itk::GDCMImageIO::New();
-  if( dicomIO->CanReadFile( fileName.c_str() ) || ( itksys::SystemTools::LowerCase(extension) == ".dcm" ) )
+  if( MayBeDICOMFile(fileName) )
     {
     std::string dicomDir = itksys::SystemTools::GetParentDirectory( fileName.c_str() );
 
-    itk::GDCMSeriesFileNames::Pointer FileNameGenerator = itk::GDCMSeriesFileNames::New();
-    FileNameGenerator->SetUseSeriesDetails(true);
-    FileNameGenerator->SetDirectory(dicomDir);
-    typedef const std::vector<std::string> ContainerType;
-    const ContainerType & seriesUIDs = FileNameGenerator->GetSeriesUIDs();
-
+    itk::GDCMImageIO::Pointer dicomIO = itk::GDCMImageIO::New();
     typedef typename itk::ImageSeriesReader<TImage> ReaderType;
     typename ReaderType::Pointer reader = ReaderType::New();
-    reader->SetFileNames( FileNameGenerator->GetFileNames(seriesUIDs[0]) );
+    reader->SetFileNames( GetDICOMSeriesFileNames(dicomDir) );
     reader->SetImageIO(dicomIO);
     try
       {
@@ -114,6 +152,62 @@ typename TImage::Pointer ReadImage(const std::string & fileName)
   return image;
 }
 
+/** read an image that is shared through the process wide ImageReadCache.
+ * The image must not be modified; repeated reads of an unchanged file
+ * return the same image without reading the file again.  Updating a filter
+ * writes the requested region of its input, so the image must only be read
+ * directly, never connected as the input of a filter; use ReadImage() for
+ * a pipeline input. */
+template <typename TImage>
+typename TImage::ConstPointer ReadConstImage(const std::string & fileName)
+{
+  ImageReadCache &  cache = ImageReadCache::GetInstance();
+  const std::string key = cache.IsEnabled() ? ImageReadCache::MakeKey(fileName, typeid( TImage ).name() ) : "";
+
+  if( !key.empty() )
+    {
+    typename TImage::ConstPointer cached = dynamic_cast<const TImage *>( cache.Find(key).GetPointer() );
+    if( cached.IsNotNull() )
+      {
+      return cached;
+      }
+    }
+  typename TImage::Pointer image = ReadImageFromDisk<TImage>(fileName);
+  image->DisconnectPipeline();
+  cache.Insert(key, image,
+               static_cast<unsigned long long>( image->GetPixelContainer()->Size() )
+               * sizeof( typename TImage::PixelContainer::Element ) );
+  typename TImage::ConstPointer constImage = image.GetPointer();
+  return constImage;
+}
+
+/** read an image using ITK -- image-based template.  The image belongs to
+ * the caller: an image that an earlier ReadConstImage() put in the
+ * ImageReadCache is copied rather than read again, but the images read here
+ * are not cached.  Callers that do not modify the image should use
+ * ReadConstImage(). */
+template <typename TImage>
+typename TImage::Pointer ReadImage(const std::string & fileName)
+{
+  ImageReadCache &  cache = ImageReadCache::GetInstance();
+  const std::string key = ( cache.IsEnabled() && !cache.IsEmpty() ) ?
+    ImageReadCache::MakeKey(fileName, typeid( TImage ).name() ) : "";
+
+  if( !key.empty() )
+    {
+    typename TImage::ConstPointer cached = dynamic_cast<const TImage *>( cache.Find(key).GetPointer() );
+    if( cached.IsNotNull() )
+      {
+      typedef itk::ImageDuplicator<TImage> ImageDupeType;
+      typename ImageDupeType::Pointer MyDuplicator = ImageDupeType::New();
+      MyDuplicator->SetInputImage(cached);
+      MyDuplicator->Update();
+      return MyDuplicator->GetModifiableOutput();
+      }
+    }
+  return ReadImageFromDisk<TImage>(fileName);
+}
+
 /**
   *
   *
@@ -191,6 +285,12 @@ ReadImageAndOrient(const std::string & filename,
 {
   typename ImageType::Pointer img =
     ReadImage<ImageType>(filename);
+  // An image that already has the orientation is returned as it is read,
+  // the orient filter would only copy it.
+  if( SOAdapterType().FromDirectionCosines( img->GetDirection() ) == orient )
+    {
+    return img;
+    }
   typename ImageType::ConstPointer constImg(img);
   typename ImageType::Pointer image = itkUtil::OrientImage<ImageType>(constImg,
                                                                       orient);
@@ -296,7 +396,7 @@ TypeCast(const typename InputImageType::Pointer & input)
   */
 template <class InputImageType, class OutputImageType>
 typename OutputImageType::Pointer
-ScaleAndCast(const typename InputImageType::Pointer & image,
+ScaleAndCast(const InputImageType * image,
              const typename OutputImageType::PixelType OutputMin,
              const typename OutputImageType::PixelType OutputMax)
 {
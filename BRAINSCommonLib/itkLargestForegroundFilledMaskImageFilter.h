@@ -21,7 +21,9 @@
 
 #include <itkImage.h>
 #include <itkImageToImageFilter.h>
+#include <itkMultiThreader.h>
 #include <itkNumericTraits.h>
+#include <vector>
 
 namespace itk
 {
@@ -31,7 +33,7 @@ namespace itk
   *
   * This filter does a good job of finding a single largest connected
   * mask that separates the foreground object from the background.
-  * It assumes that the corner voxels of the image belong to the backgound.
+  * It assumes that the last corner voxel of the image belongs to the backgound.
   * This filter was written for the purpose of finding the tissue
   * region of a brain image with no internal holes.
   *
@@ -52,6 +54,25 @@ namespace itk
   *background
   * values specified by the user (defaults to 1 and 0 respectively).
   *
+  * After the threshold is computed, the mask is processed by a dedicated
+  * multithreaded engine instead of a pipeline of image filters.  The mask
+  * is kept as one bit per voxel, with every image row starting on a new
+  * word:
+  *  - The connected components (face connectivity) are labeled by a
+  *    union-find over the runs of foreground voxels of each row.  The
+  *    image is split in slabs of slices that are labeled concurrently and
+  *    the slabs are merged at the end.  The largest component is kept.
+  *  - The closing (and the final dilation) by the ball structuring element
+  *    is computed by three separable passes over a buffer of 16 bit ranks of
+  *    the exact squared ellipsoidal distance, one pass per axis.  It gives
+  *    the same result as BinaryDilateImageFilter and BinaryErodeImageFilter
+  *    with a BinaryBallStructuringElement, and the voxels outside the image
+  *    count as foreground for the erosion.
+  *  - The holes are filled by labeling the background runs and keeping as
+  *    background only the component that contains the last corner of the
+  *    image, the seed of the original ConnectedThresholdImageFilter.
+  * The input must be three dimensional and the whole image is processed.
+  *
   */
 template <class TInputImage, class TOutputImage = TInputImage>
 class LargestForegroundFilledMaskImageFilter :
@@ -119,14 +140,90 @@ public:
   itkGetMacro(OutsideValue, IntegerPixelType);
   itkSetMacro(ThresholdCorrectionFactor, double);
   itkGetConstMacro(ThresholdCorrectionFactor, double);
+
+#ifdef ITK_USE_CONCEPT_CHECKING
+  /** Begin concept checking */
+  itkConceptMacro( InputImageDimensionIs3Check,
+                   ( Concept::SameDimension<TInputImage::ImageDimension, 3> ) );
+  itkConceptMacro( OutputImageDimensionIs3Check,
+                   ( Concept::SameDimension<TOutputImage::ImageDimension, 3> ) );
+  /** End concept checking */
+#endif
 protected:
   LargestForegroundFilledMaskImageFilter();
   ~LargestForegroundFilledMaskImageFilter();
   void PrintSelf(std::ostream & os, Indent indent) const ITK_OVERRIDE;
 
+  void GenerateInputRequestedRegion() ITK_OVERRIDE;
+
+  void EnlargeOutputRequestedRegion(DataObject *) ITK_OVERRIDE;
+
   virtual void GenerateData() ITK_OVERRIDE;
 
 private:
+  ITK_DISALLOW_COPY_AND_ASSIGN(LargestForegroundFilledMaskImageFilter);
+
+  typedef uint64_t MaskWordType;
+
+  /** Half open range [Begin, End) of voxels of one image row */
+  struct RunType
+    {
+    unsigned int Begin;
+    unsigned int End;
+    };
+
+  enum StageType
+    {
+    THRESHOLD_STAGE,
+    COUNT_RUNS_STAGE,
+    EXTRACT_RUNS_STAGE,
+    UNION_RUNS_STAGE,
+    KEEP_LARGEST_STAGE,
+    FILL_HOLES_STAGE,
+    DISTANCE_X_STAGE,
+    DISTANCE_Y_STAGE,
+    DILATE_Z_STAGE,
+    OUTPUT_STAGE
+    };
+
+  struct ThreadStruct
+    {
+    Self *Filter;
+    StageType Stage;
+    };
+
+  static ITK_THREAD_RETURN_TYPE StageThreaderCallback(void *arg);
+
+  /** Run a stage over slabs of slices, one slab per thread */
+  void ExecuteStage(const StageType stage);
+
+  void ThreadedStage(const StageType stage, const SizeValueType zStart, const SizeValueType zEnd);
+
+  /** Label the runs of foreground (or background) voxels of the mask.  On
+    * return m_RunParent holds the root run of every run, which is the
+    * first run of its component in raster order. */
+  void LabelRuns(const bool background);
+
+  /** Number of runs of selected voxels of a row, written to runs unless it
+    * is null */
+  SizeValueType ScanRuns(const SizeValueType row, RunType *runs) const;
+
+  /** Union of the overlapping runs of two rows */
+  void UnionRows(const SizeValueType rowA, const SizeValueType rowB);
+
+  SizeValueType FindRoot(SizeValueType run);
+
+  /** Replace the mask with its dilation by the ball of the given radius,
+    * or with its erosion when invert is set. */
+  void DilateMask(const SizeValueType radius[3], const bool invert);
+
+  bool GetMaskBit(const SizeValueType row, const SizeValueType x) const
+  {
+    return ( m_Mask[row * m_WordsPerRow + ( x >> 6 )] >> ( x & 63 ) ) & 1;
+  }
+
+  void SetMaskBits(const SizeValueType row, const SizeValueType begin, const SizeValueType end, const bool value);
+
   /** Returns true if more than two bins of informaiton are found,
     * returns false if only two bins of informaiton are found (i.e. found a
     *binary image).
@@ -143,6 +240,32 @@ private:
   double           m_DilateSize;
   IntegerPixelType m_InsideValue;
   IntegerPixelType m_OutsideValue;
+
+  // Working state of one GenerateData() call
+  SizeValueType              m_Size[3];
+  SizeValueType              m_NumberOfRows;
+  SizeValueType              m_WordsPerRow;
+  ThreadIdType               m_NumberOfSlabs;
+  InputPixelType             m_ForegroundThreshold;
+  std::vector<MaskWordType>  m_Mask;
+  bool                       m_LabelBackground;
+  std::vector<SizeValueType> m_RowRunOffsets;
+  std::vector<RunType>       m_Runs;
+  std::vector<SizeValueType> m_RunParent;
+  SizeValueType              m_SelectedRoot;
+  std::vector<unsigned char> m_RootIsOutside;
+
+  // Separable ball morphology: the squared ellipsoidal distance of an
+  // offset o is sum_d m_BallCoefficient[d] * o[d]^2, and o is in the ball
+  // when that distance is at most m_BallScale.  The distances of the in
+  // plane offsets are stored as ranks into the sorted m_BallValues.
+  SizeValueType               m_BallRadius[3];
+  uint64_t                    m_BallCoefficient[3];
+  uint64_t                    m_BallScale;
+  std::vector<uint64_t>       m_BallValues;
+  std::vector<unsigned short> m_BallRank;  // [dx][dy]
+  std::vector<unsigned short> m_Distance;  // per voxel
+  bool                        m_InvertMask;
 };
 } // end namespace itk
 
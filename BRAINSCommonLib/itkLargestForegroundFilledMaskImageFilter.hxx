@@ -21,18 +21,7 @@
 #include "itkLargestForegroundFilledMaskImageFilter.h"
 #include "itkComputeHistogramQuantileThresholds.h"
 
-#include <itkConnectedComponentImageFilter.h>
-#include <itkRelabelComponentImageFilter.h>
-#include <itkBinaryThresholdImageFilter.h>
-#include <itkImageRegionIterator.h>
-// #include <itkSimpleFilterWatcher.h>
-#include <itkImageRegionIterator.h>
-#include <itkBinaryBallStructuringElement.h>
-#include <itkBinaryDilateImageFilter.h>
-#include <itkBinaryErodeImageFilter.h>
-#include <vnl/vnl_sample.h>
 #include <vnl/vnl_math.h>
-#include <itkConnectedThresholdImageFilter.h>
 
 #include <itkNumericTraits.h>
 #include <itkMinimumMaximumImageFilter.h>
@@ -40,7 +29,7 @@
 // Not this:   #include <itkOtsuMultipleThresholdsCalculator.h>
 #include <itkImageToHistogramFilter.h>
 #include <itkOtsuThresholdCalculator.h>
-#include <itkCastImageFilter.h>
+#include <algorithm>
 
 namespace itk
 {
@@ -82,6 +71,28 @@ LargestForegroundFilledMaskImageFilter<TInputImage, TOutputImage>
      << m_OutsideValue << std::endl;
 }
 
+template <class TInputImage, class TOutputImage>
+void
+LargestForegroundFilledMaskImageFilter<TInputImage, TOutputImage>
+::GenerateInputRequestedRegion()
+{
+  Superclass::GenerateInputRequestedRegion();
+  InputImageType *input = const_cast<InputImageType *>( this->GetInput() );
+  if( input )
+    {
+    input->SetRequestedRegionToLargestPossibleRegion();
+    }
+}
+
+template <class TInputImage, class TOutputImage>
+void
+LargestForegroundFilledMaskImageFilter<TInputImage, TOutputImage>
+::EnlargeOutputRequestedRegion(DataObject *data)
+{
+  Superclass::EnlargeOutputRequestedRegion(data);
+  data->SetRequestedRegionToLargestPossibleRegion();
+}
+
 template <class TInputImage, class TOutputImage>
 void
 LargestForegroundFilledMaskImageFilter<TInputImage, TOutputImage>
@@ -173,221 +184,607 @@ LargestForegroundFilledMaskImageFilter<TInputImage, TOutputImage>
     threshold_low_foreground = otsuThresholdResult;
     }
 
-  typedef BinaryThresholdImageFilter<TInputImage,
-                                     IntegerImageType>
-    InputThresholdFilterType;
-  typename InputThresholdFilterType::Pointer threshold =
-    InputThresholdFilterType::New();
-  threshold->SetInput( this->GetInput() );
-  threshold->SetInsideValue(this->m_InsideValue);
-  threshold->SetOutsideValue(this->m_OutsideValue);
-  threshold->SetLowerThreshold(threshold_low_foreground);
   const typename TInputImage::PixelType threshold_hi_foreground = NumericTraits<typename TInputImage::PixelType>::max();
-  threshold->SetUpperThreshold(threshold_hi_foreground);
-  threshold->Update();
 //  typename TInputImage::PixelType threshold_low = ImageCalc->GetLowerIntensityThresholdValue();
   std::cout << "LowHigh Thresholds: ["
             << static_cast<int>( threshold_low_foreground ) << ","
             << static_cast<int>( threshold_hi_foreground ) << "]"
             << std::endl;
 
-  typedef ConnectedComponentImageFilter<IntegerImageType,
-                                        IntegerImageType> FilterType;
-  typename FilterType::Pointer labelConnectedComponentsFilter = FilterType::New();
-  //  SimpleFilterWatcher watcher(labelConnectedComponentsFilter);
-  //  watcher.QuietOn();
-  labelConnectedComponentsFilter->SetInput( threshold->GetOutput() );
-  // labelConnectedComponentsFilter->Update();
-
-  typedef RelabelComponentImageFilter<IntegerImageType,
-                                      IntegerImageType> RelabelType;
-  typename RelabelType::Pointer relabel = RelabelType::New();
-  relabel->SetInput( labelConnectedComponentsFilter->GetOutput() );
-
-  try
+  const InputImageType *                      input = this->GetInput();
+  const typename InputImageType::SizeType &   size = input->GetBufferedRegion().GetSize();
+  const typename InputImageType::SpacingType &spacing = input->GetSpacing();
+  for( unsigned int d = 0; d < 3; ++d )
     {
-    relabel->Update();
+    m_Size[d] = size[d];
     }
-  catch( ExceptionObject & excep )
+  m_NumberOfRows = m_Size[1] * m_Size[2];
+  m_WordsPerRow = ( m_Size[0] + 63 ) / 64;
+  m_ForegroundThreshold = threshold_low_foreground;
+  m_Mask.assign(m_NumberOfRows * m_WordsPerRow, 0);
+  this->ExecuteStage(THRESHOLD_STAGE);
+
+  // Keep the largest connected component, the first one in raster order
+  // when several have the same size.
+  this->LabelRuns(false);
     {
-    std::cerr << "Relabel: exception caught !" << std::endl;
-    std::cerr << excep << std::endl;
-    }
-
-  typedef BinaryThresholdImageFilter<IntegerImageType,
-                                     IntegerImageType> ThresholdFilterType;
-  // unsigned short numObjects = relabel->GetNumberOfObjects();
-  // std::cout << "Removed " << numObjects - 1 << " smaller objects." <<
-  // std::endl;
-  typename ThresholdFilterType::Pointer LargestFilter =
-    ThresholdFilterType::New();
-  LargestFilter->SetInput( relabel->GetOutput() );
-  LargestFilter->SetInsideValue(this->m_InsideValue);
-  LargestFilter->SetOutsideValue(this->m_OutsideValue);
-  LargestFilter->SetLowerThreshold(1);
-  LargestFilter->SetUpperThreshold(1);
-  LargestFilter->Update();
-
-  typedef BinaryBallStructuringElement<typename IntegerImageType::
-                                       PixelType,
-                                       IntegerImageType::ImageDimension>
-    myKernelType;
-
-  typedef BinaryErodeImageFilter<IntegerImageType, IntegerImageType,
-                                 myKernelType> ErodeFilterType;
-  typename ErodeFilterType::Pointer ErodeFilter = ErodeFilterType::New();
-    {
-    myKernelType dilateBall;
-    myKernelType erodeBall;
-    typename myKernelType::SizeType dilateBallSize;
-    typename myKernelType::SizeType erodeBallSize;
-    for( unsigned int d = 0; d < 3; ++d )
+    std::vector<SizeValueType> componentSize(m_Runs.size(), 0);
+    for( SizeValueType r = 0; r < m_Runs.size(); ++r )
+      {
+      componentSize[m_RunParent[r]] += m_Runs[r].End - m_Runs[r].Begin;
+      }
+    SizeValueType largestSize = 0;
+    m_SelectedRoot = NumericTraits<SizeValueType>::max();
+    for( SizeValueType r = 0; r < m_Runs.size(); ++r )
       {
-      const unsigned int ClosingVoxels = vnl_math_ceil( m_ClosingSize / ( relabel->GetOutput()->GetSpacing()[d] ) );
-      if( ClosingVoxels > 20 )
+      if( componentSize[r] > largestSize )
         {
-        std::cout << "WARNING:  Attempting to close with a very large number of voxels:  "
-                  << m_ClosingSize << " / " << ( relabel->GetOutput()->GetSpacing()[d] ) << " = " << ClosingVoxels
-                  << std::endl;
-        std::cout << "Perhaps there is a mis-match between the voxel spacing"
-                  << " and the assumption that  ClosingSize is given in mm"
-                  << std::endl;
+        largestSize = componentSize[r];
+        m_SelectedRoot = r;
         }
-      dilateBallSize[d] = ClosingVoxels;
-      erodeBallSize[d]  = ClosingVoxels;
       }
-    dilateBall.SetRadius(dilateBallSize);
-    dilateBall.CreateStructuringElement();
-    erodeBall.SetRadius(erodeBallSize);
-    erodeBall.CreateStructuringElement();
-
-    typedef BinaryDilateImageFilter<IntegerImageType, IntegerImageType,
-                                    myKernelType> DilateFilterType;
-    typename DilateFilterType::Pointer DilateFilter = DilateFilterType::New();
-
-    // DilateFilter->SetForegroundValue(1);
-    DilateFilter->SetDilateValue(1);
-    DilateFilter->SetBackgroundValue(0);
-    DilateFilter->SetInput( LargestFilter->GetOutput() );
-    DilateFilter->SetKernel(dilateBall);
-    DilateFilter->Update();
-
-    // ErodeFilter->SetForegroundValue(1);
-    ErodeFilter->SetErodeValue(1);
-    ErodeFilter->SetBackgroundValue(0);
-    ErodeFilter->SetInput( DilateFilter->GetOutput() );
-    ErodeFilter->SetKernel(erodeBall);
-    ErodeFilter->Update();
     }
+  this->ExecuteStage(KEEP_LARGEST_STAGE);
 
-  // silence warnings by converting the size to index
-  typename IntegerImageType::IndexType IndImageSize;
-  for(unsigned int _i = 0; _i < IntegerImageType::ImageDimension; ++_i)
+  SizeValueType closingRadius[3];
+  for( unsigned int d = 0; d < 3; ++d )
     {
-    IndImageSize[_i] = static_cast<typename IntegerImageType::IndexValueType>
-      (ErodeFilter->GetOutput()->GetLargestPossibleRegion().GetSize()[_i]);
+    const unsigned int ClosingVoxels = vnl_math_ceil( m_ClosingSize / ( spacing[d] ) );
+    if( ClosingVoxels > 20 )
+      {
+      std::cout << "WARNING:  Attempting to close with a very large number of voxels:  "
+                << m_ClosingSize << " / " << ( spacing[d] ) << " = " << ClosingVoxels
+                << std::endl;
+      std::cout << "Perhaps there is a mis-match between the voxel spacing"
+                << " and the assumption that  ClosingSize is given in mm"
+                << std::endl;
+      }
+    closingRadius[d] = ClosingVoxels;
     }
+  this->DilateMask(closingRadius, false);
+  this->DilateMask(closingRadius, true);
+
   // NOTE:  The most robust way to do this would be to find the largest
   // background labeled image, and then choose one of those locations as the
   // seed.
-  // For now just choose all the corners as seed points
-  typedef ConnectedThresholdImageFilter<IntegerImageType,
-                                        IntegerImageType>
-    seededConnectedThresholdFilterType;
-  typename seededConnectedThresholdFilterType::Pointer
-  seededConnectedThresholdFilter = seededConnectedThresholdFilterType::New();
+  // For now the background component that contains the last corner of the
+  // image is outside, all the other background components are holes.  This
+  // is the seed that was used by the ConnectedThresholdImageFilter of the
+  // original pipeline, where each SetSeed() replaced the previous corner.
+  this->LabelRuns(true);
+  m_RootIsOutside.assign(m_Runs.size(), 0);
+    {
+    const SizeValueType x = m_Size[0] - 1;
+    const SizeValueType row = ( m_Size[2] - 1 ) * m_Size[1] + m_Size[1] - 1;
+    for( SizeValueType r = m_RowRunOffsets[row]; r < m_RowRunOffsets[row + 1]; ++r )
+      {
+      if( m_Runs[r].Begin <= x && x < m_Runs[r].End )
+        {
+        m_RootIsOutside[m_RunParent[r]] = 1;
+        }
+      }
+    }
+  this->ExecuteStage(FILL_HOLES_STAGE);
 
+  if( m_DilateSize > 0.0 )
     {
-    const typename IntegerImageType::IndexType SeedLocation = { { 0, 0, 0 } };
-    seededConnectedThresholdFilter->SetSeed(SeedLocation);
+    // Dilate to get some background to better drive BSplineRegistration
+    SizeValueType dilateRadius[3];
+    for( unsigned int d = 0; d < 3; ++d )
+      {
+      const unsigned int DilateVoxels = vnl_math_ceil( m_DilateSize / ( spacing[d] ) );
+      dilateRadius[d] = DilateVoxels;
+      }
+    this->DilateMask(dilateRadius, false);
     }
+
+  this->ExecuteStage(OUTPUT_STAGE);
+
+  // Release the working memory
+  std::vector<MaskWordType>().swap(m_Mask);
+  std::vector<SizeValueType>().swap(m_RowRunOffsets);
+  std::vector<RunType>().swap(m_Runs);
+  std::vector<SizeValueType>().swap(m_RunParent);
+  std::vector<unsigned char>().swap(m_RootIsOutside);
+  std::vector<unsigned short>().swap(m_Distance);
+}
+
+template <class TInputImage, class TOutputImage>
+void
+LargestForegroundFilledMaskImageFilter<TInputImage, TOutputImage>
+::ExecuteStage(const StageType stage)
+{
+  ThreadStruct str;
+
+  str.Filter = this;
+  str.Stage = stage;
+  this->GetMultiThreader()->SetNumberOfThreads( this->GetNumberOfThreads() );
+  // The slabs of the stages that label runs must be the same
+  m_NumberOfSlabs = this->GetMultiThreader()->GetNumberOfThreads();
+  this->GetMultiThreader()->SetSingleMethod(this->StageThreaderCallback, &str);
+  this->GetMultiThreader()->SingleMethodExecute();
+}
+
+template <class TInputImage, class TOutputImage>
+ITK_THREAD_RETURN_TYPE
+LargestForegroundFilledMaskImageFilter<TInputImage, TOutputImage>
+::StageThreaderCallback(void *arg)
+{
+  const ThreadIdType threadId = ( (MultiThreader::ThreadInfoStruct *)(arg) )->ThreadID;
+  const ThreadIdType threadCount = ( (MultiThreader::ThreadInfoStruct *)(arg) )->NumberOfThreads;
+  ThreadStruct *     str = (ThreadStruct *)( ( (MultiThreader::ThreadInfoStruct *)(arg) )->UserData);
+  Self *             filter = str->Filter;
+
+  const SizeValueType slices = filter->m_Size[2];
+  const SizeValueType chunk = ( slices + threadCount - 1 ) / threadCount;
+  const SizeValueType zStart = std::min(slices, threadId * chunk);
+  const SizeValueType zEnd = std::min(slices, zStart + chunk);
+  if( zStart < zEnd )
     {
-    const typename IntegerImageType::IndexType SeedLocation = { { IndImageSize[0] - 1, 0, 0 } };
-    seededConnectedThresholdFilter->SetSeed(SeedLocation);
+    filter->ThreadedStage(str->Stage, zStart, zEnd);
     }
+  return ITK_THREAD_RETURN_VALUE;
+}
+
+template <class TInputImage, class TOutputImage>
+void
+LargestForegroundFilledMaskImageFilter<TInputImage, TOutputImage>
+::ThreadedStage(const StageType stage, const SizeValueType zStart, const SizeValueType zEnd)
+{
+  const SizeValueType nx = m_Size[0];
+  const SizeValueType ny = m_Size[1];
+  const SizeValueType rowStart = zStart * ny;
+  const SizeValueType rowEnd = zEnd * ny;
+
+  switch( stage )
     {
-    const typename IntegerImageType::IndexType SeedLocation = { { 0, IndImageSize[1] - 1, 0 } };
-    seededConnectedThresholdFilter->SetSeed(SeedLocation);
+    case THRESHOLD_STAGE:
+      {
+      const InputPixelType *input = this->GetInput()->GetBufferPointer();
+      for( SizeValueType row = rowStart; row < rowEnd; ++row )
+        {
+        const InputPixelType *line = input + row * nx;
+        MaskWordType *        words = &m_Mask[row * m_WordsPerRow];
+        for( SizeValueType x = 0; x < nx; ++x )
+          {
+          if( line[x] >= m_ForegroundThreshold )
+            {
+            words[x >> 6] |= MaskWordType(1) << ( x & 63 );
+            }
+          }
+        }
+      }
+      break;
+    case COUNT_RUNS_STAGE:
+      for( SizeValueType row = rowStart; row < rowEnd; ++row )
+        {
+        m_RowRunOffsets[row + 1] = this->ScanRuns(row, ITK_NULLPTR);
+        }
+      break;
+    case EXTRACT_RUNS_STAGE:
+      for( SizeValueType row = rowStart; row < rowEnd; ++row )
+        {
+        const SizeValueType first = m_RowRunOffsets[row];
+        if( first == m_RowRunOffsets[row + 1] )
+          {
+          continue;
+          }
+        this->ScanRuns(row, &m_Runs[first]);
+        for( SizeValueType r = first; r < m_RowRunOffsets[row + 1]; ++r )
+          {
+          m_RunParent[r] = r;
+          }
+        }
+      break;
+    case UNION_RUNS_STAGE:
+      for( SizeValueType z = zStart; z < zEnd; ++z )
+        {
+        for( SizeValueType y = 0; y < ny; ++y )
+          {
+          const SizeValueType row = z * ny + y;
+          if( y > 0 )
+            {
+            this->UnionRows(row, row - 1);
+            }
+          if( z > zStart )
+            {
+            this->UnionRows(row, row - ny);
+            }
+          }
+        }
+      break;
+    case KEEP_LARGEST_STAGE:
+      for( SizeValueType row = rowStart; row < rowEnd; ++row )
+        {
+        this->SetMaskBits(row, 0, nx, false);
+        for( SizeValueType r = m_RowRunOffsets[row]; r < m_RowRunOffsets[row + 1]; ++r )
+          {
+          if( m_RunParent[r] == m_SelectedRoot )
+            {
+            this->SetMaskBits(row, m_Runs[r].Begin, m_Runs[r].End, true);
+            }
+          }
+        }
+      break;
+    case FILL_HOLES_STAGE:
+      for( SizeValueType row = rowStart; row < rowEnd; ++row )
+        {
+        this->SetMaskBits(row, 0, nx, true);
+        for( SizeValueType r = m_RowRunOffsets[row]; r < m_RowRunOffsets[row + 1]; ++r )
+          {
+          if( m_RootIsOutside[m_RunParent[r]] )
+            {
+            this->SetMaskBits(row, m_Runs[r].Begin, m_Runs[r].End, false);
+            }
+          }
+        }
+      break;
+    case DISTANCE_X_STAGE:
+      {
+      // Distance along the row to the closest source voxel, clamped to one
+      // past the radius.
+      const SizeValueType farDistance = m_BallRadius[0] + 1;
+      for( SizeValueType row = rowStart; row < rowEnd; ++row )
+        {
+        unsigned short *distance = &m_Distance[row * nx];
+        SizeValueType   d = farDistance;
+        for( SizeValueType x = 0; x < nx; ++x )
+          {
+          if( this->GetMaskBit(row, x) != m_InvertMask )
+            {
+            d = 0;
+            }
+          else if( d < farDistance )
+            {
+            ++d;
+            }
+          distance[x] = static_cast<unsigned short>( d );
+          }
+        d = farDistance;
+        for( SizeValueType x = nx; x-- > 0; )
+          {
+          if( this->GetMaskBit(row, x) != m_InvertMask )
+            {
+            d = 0;
+            }
+          else if( d < farDistance )
+            {
+            ++d;
+            }
+          distance[x] = std::min(distance[x], static_cast<unsigned short>( d ) );
+          }
+        }
+      }
+      break;
+    case DISTANCE_Y_STAGE:
+      {
+      // Rank of the smallest in plane distance to a source voxel
+      const SizeValueType        ry = m_BallRadius[1];
+      const unsigned short       farRank = static_cast<unsigned short>( m_BallValues.size() - 1 );
+      std::vector<unsigned short> slice(nx * ny);
+      for( SizeValueType z = zStart; z < zEnd; ++z )
+        {
+        unsigned short *distance = &m_Distance[z * ny * nx];
+        std::copy(distance, distance + nx * ny, slice.begin() );
+        for( SizeValueType y = 0; y < ny; ++y )
+          {
+          unsigned short *rank = distance + y * nx;
+          std::fill(rank, rank + nx, farRank);
+          const SizeValueType yBegin = ( y > ry ) ? y - ry : 0;
+          const SizeValueType yEnd = std::min(ny, y + ry + 1);
+          for( SizeValueType yy = yBegin; yy < yEnd; ++yy )
+            {
+            const SizeValueType   dy = ( yy > y ) ? yy - y : y - yy;
+            const unsigned short *rowDistance = &slice[yy * nx];
+            for( SizeValueType x = 0; x < nx; ++x )
+              {
+              rank[x] = std::min(rank[x], m_BallRank[rowDistance[x] * ( ry + 1 ) + dy]);
+              }
+            }
+          }
+        }
+      }
+      break;
+    case DILATE_Z_STAGE:
+      {
+      const SizeValueType        rz = m_BallRadius[2];
+      std::vector<unsigned char> inside(nx);
+      for( SizeValueType z = zStart; z < zEnd; ++z )
+        {
+        const SizeValueType zBegin = ( z > rz ) ? z - rz : 0;
+        const SizeValueType zStop = std::min(m_Size[2], z + rz + 1);
+        for( SizeValueType y = 0; y < ny; ++y )
+          {
+          std::fill(inside.begin(), inside.end(), 0);
+          for( SizeValueType zz = zBegin; zz < zStop; ++zz )
+            {
+            const SizeValueType   dz = ( zz > z ) ? zz - z : z - zz;
+            const uint64_t        offset = m_BallCoefficient[2] * dz * dz;
+            const unsigned short *rank = &m_Distance[( zz * ny + y ) * nx];
+            for( SizeValueType x = 0; x < nx; ++x )
+              {
+              if( m_BallValues[rank[x]] + offset <= m_BallScale )
+                {
+                inside[x] = 1;
+                }
+              }
+            }
+          const SizeValueType row = z * ny + y;
+          this->SetMaskBits(row, 0, nx, false);
+          MaskWordType *words = &m_Mask[row * m_WordsPerRow];
+          for( SizeValueType x = 0; x < nx; ++x )
+            {
+            if( ( inside[x] != 0 ) != m_InvertMask )
+              {
+              words[x >> 6] |= MaskWordType(1) << ( x & 63 );
+              }
+            }
+          }
+        }
+      }
+      break;
+    case OUTPUT_STAGE:
+      {
+      OutputPixelType *     output = this->GetOutput()->GetBufferPointer();
+      const OutputPixelType insideValue = static_cast<OutputPixelType>( m_InsideValue );
+      const OutputPixelType outsideValue = static_cast<OutputPixelType>( m_OutsideValue );
+      for( SizeValueType row = rowStart; row < rowEnd; ++row )
+        {
+        OutputPixelType *line = output + row * nx;
+        for( SizeValueType x = 0; x < nx; ++x )
+          {
+          line[x] = this->GetMaskBit(row, x) ? insideValue : outsideValue;
+          }
+        }
+      }
+      break;
     }
+}
+
+template <class TInputImage, class TOutputImage>
+SizeValueType
+LargestForegroundFilledMaskImageFilter<TInputImage, TOutputImage>
+::ScanRuns(const SizeValueType row, RunType *runs) const
+{
+  SizeValueType count = 0;
+  SizeValueType begin = 0;
+  bool          inRun = false;
+
+  for( SizeValueType x = 0; x < m_Size[0]; ++x )
     {
-    const typename IntegerImageType::IndexType SeedLocation = { { IndImageSize[0] - 1, IndImageSize[1] - 1, 0 } };
-    seededConnectedThresholdFilter->SetSeed(SeedLocation);
+    const bool selected = this->GetMaskBit(row, x) != m_LabelBackground;
+    if( selected && !inRun )
+      {
+      begin = x;
+      inRun = true;
+      }
+    else if( !selected && inRun )
+      {
+      if( runs )
+        {
+        runs[count].Begin = static_cast<unsigned int>( begin );
+        runs[count].End = static_cast<unsigned int>( x );
+        }
+      ++count;
+      inRun = false;
+      }
     }
+  if( inRun )
     {
-    const typename IntegerImageType::IndexType SeedLocation = { { 0, 0, IndImageSize[2] - 1 } };
-    seededConnectedThresholdFilter->SetSeed(SeedLocation);
+    if( runs )
+      {
+      runs[count].Begin = static_cast<unsigned int>( begin );
+      runs[count].End = static_cast<unsigned int>( m_Size[0] );
+      }
+    ++count;
     }
+  return count;
+}
+
+template <class TInputImage, class TOutputImage>
+void
+LargestForegroundFilledMaskImageFilter<TInputImage, TOutputImage>
+::LabelRuns(const bool background)
+{
+  m_LabelBackground = background;
+  m_RowRunOffsets.assign(m_NumberOfRows + 1, 0);
+  this->ExecuteStage(COUNT_RUNS_STAGE);
+  for( SizeValueType row = 0; row < m_NumberOfRows; ++row )
     {
-    const typename IntegerImageType::IndexType SeedLocation = { { IndImageSize[0] - 1, 0, IndImageSize[2] - 1 } };
-    seededConnectedThresholdFilter->SetSeed(SeedLocation);
+    m_RowRunOffsets[row + 1] += m_RowRunOffsets[row];
     }
+  m_Runs.resize(m_RowRunOffsets[m_NumberOfRows]);
+  m_RunParent.resize(m_Runs.size() );
+  this->ExecuteStage(EXTRACT_RUNS_STAGE);
+  this->ExecuteStage(UNION_RUNS_STAGE);
+
+  // Merge the components across the slab boundaries
+  const SizeValueType ny = m_Size[1];
+  const SizeValueType slices = m_Size[2];
+  const SizeValueType chunk = ( slices + m_NumberOfSlabs - 1 ) / m_NumberOfSlabs;
+  for( SizeValueType z = chunk; z < slices; z += chunk )
     {
-    const typename IntegerImageType::IndexType SeedLocation = { { 0, IndImageSize[1] - 1, IndImageSize[2] - 1 } };
-    seededConnectedThresholdFilter->SetSeed(SeedLocation);
+    for( SizeValueType y = 0; y < ny; ++y )
+      {
+      this->UnionRows(z * ny + y, ( z - 1 ) * ny + y);
+      }
     }
+
+  // The parent of a run never comes after it, so one forward pass flattens
+  // the trees.
+  for( SizeValueType r = 0; r < m_RunParent.size(); ++r )
     {
-    const typename IntegerImageType::IndexType SeedLocation =
-      { { IndImageSize[0] - 1, IndImageSize[1] - 1, IndImageSize[2] - 1 } };
-    seededConnectedThresholdFilter->SetSeed(SeedLocation);
+    m_RunParent[r] = m_RunParent[m_RunParent[r]];
     }
+}
 
-  seededConnectedThresholdFilter->SetReplaceValue(100);
-  seededConnectedThresholdFilter->SetUpper(0);
-  seededConnectedThresholdFilter->SetLower(0);
-  seededConnectedThresholdFilter->SetInput( ErodeFilter->GetOutput() );
-  seededConnectedThresholdFilter->Update();
+template <class TInputImage, class TOutputImage>
+SizeValueType
+LargestForegroundFilledMaskImageFilter<TInputImage, TOutputImage>
+::FindRoot(SizeValueType run)
+{
+  while( m_RunParent[run] != run )
+    {
+    m_RunParent[run] = m_RunParent[m_RunParent[run]];
+    run = m_RunParent[run];
+    }
+  return run;
+}
+
+template <class TInputImage, class TOutputImage>
+void
+LargestForegroundFilledMaskImageFilter<TInputImage, TOutputImage>
+::UnionRows(const SizeValueType rowA, const SizeValueType rowB)
+{
+  SizeValueType       a = m_RowRunOffsets[rowA];
+  const SizeValueType aEnd = m_RowRunOffsets[rowA + 1];
+  SizeValueType       b = m_RowRunOffsets[rowB];
+  const SizeValueType bEnd = m_RowRunOffsets[rowB + 1];
 
-  typename IntegerImageType::Pointer dilateMask = ITK_NULLPTR;
+  while( a < aEnd && b < bEnd )
     {
-    typename ThresholdFilterType::Pointer FinalThreshold =
-      ThresholdFilterType::New();
-    FinalThreshold->SetInput( seededConnectedThresholdFilter->GetOutput() );
-    FinalThreshold->SetInsideValue(this->m_OutsideValue);
-    FinalThreshold->SetOutsideValue(this->m_InsideValue);
-    FinalThreshold->SetLowerThreshold(100);
-    FinalThreshold->SetUpperThreshold(100);
-    FinalThreshold->Update();
-
-    if( m_DilateSize > 0.0 )
+    const RunType & runA = m_Runs[a];
+    const RunType & runB = m_Runs[b];
+    if( runA.Begin < runB.End && runB.Begin < runA.End )
       {
-      // Dilate to get some background to better drive BSplineRegistration
-      typedef itk::BinaryDilateImageFilter<IntegerImageType, IntegerImageType,
-                                           myKernelType> DilateType;
-
-      myKernelType dilateBall;
-      typename myKernelType::SizeType dilateBallSize;
-      for( unsigned int d = 0; d < 3; ++d )
+      const SizeValueType rootA = this->FindRoot(a);
+      const SizeValueType rootB = this->FindRoot(b);
+      if( rootA < rootB )
+        {
+        m_RunParent[rootB] = rootA;
+        }
+      else if( rootB < rootA )
         {
-        const unsigned int DilateVoxels =
-          vnl_math_ceil( m_DilateSize / ( FinalThreshold->GetOutput()->GetSpacing()[d] ) );
-        dilateBallSize[d] = DilateVoxels;
+        m_RunParent[rootA] = rootB;
         }
-      dilateBall.SetRadius(dilateBallSize);
-      dilateBall.CreateStructuringElement();
-
-      typename DilateType::Pointer dil = DilateType::New();
-      dil->SetDilateValue(this->m_InsideValue);
-      dil->SetKernel(dilateBall);
-      dil->SetInput( FinalThreshold->GetOutput() );
-      dil->Update();
-      dilateMask = dil->GetOutput();
+      }
+    if( runA.End < runB.End )
+      {
+      ++a;
       }
     else
       {
-      dilateMask = FinalThreshold->GetOutput();
+      ++b;
       }
     }
+}
 
-  typedef CastImageFilter<IntegerImageType, OutputImageType> outputCasterType;
-  typename outputCasterType::Pointer outputCaster = outputCasterType::New();
-  outputCaster->SetInput(dilateMask);
+template <class TInputImage, class TOutputImage>
+void
+LargestForegroundFilledMaskImageFilter<TInputImage, TOutputImage>
+::SetMaskBits(const SizeValueType row, const SizeValueType begin, const SizeValueType end, const bool value)
+{
+  MaskWordType *words = &m_Mask[row * m_WordsPerRow];
+
+  for( SizeValueType x = begin; x < end; )
+    {
+    const SizeValueType bit = x & 63;
+    const SizeValueType count = std::min<SizeValueType>(64 - bit, end - x);
+    const MaskWordType  bits = ( count == 64 ? ~MaskWordType(0) : ( MaskWordType(1) << count ) - 1 ) << bit;
+    if( value )
+      {
+      words[x >> 6] |= bits;
+      }
+    else
+      {
+      words[x >> 6] &= ~bits;
+      }
+    x += count;
+    }
+}
+
+template <class TInputImage, class TOutputImage>
+void
+LargestForegroundFilledMaskImageFilter<TInputImage, TOutputImage>
+::DilateMask(const SizeValueType radius[3], const bool invert)
+{
+  if( radius[0] == 0 && radius[1] == 0 && radius[2] == 0 )
+    {
+    return;
+    }
+  // The distances and the ranks of the in plane distances are stored as
+  // unsigned short, which bounds the radius
+  SizeValueType clampedRadius[3];
+  for( unsigned int d = 0; d < 3; ++d )
+    {
+    clampedRadius[d] = radius[d];
+    if( radius[d] > 255 )
+      {
+      std::cout << "WARNING:  Structuring element radius " << radius[d]
+                << " is too large, it is clamped to 255 voxels" << std::endl;
+      clampedRadius[d] = 255;
+      }
+    }
+  radius = clampedRadius;
+
+  // As in BinaryBallStructuringElement, the ball is the ellipsoid with semi
+  // axes radius + 0.5: o is inside when sum_d 4 o_d^2 / (2 radius_d + 1)^2
+  // <= 1.  Over the common denominator the test is exact in integers.
+  m_BallScale = 1;
+  uint64_t axis[3];
+  for( unsigned int d = 0; d < 3; ++d )
+    {
+    m_BallRadius[d] = radius[d];
+    axis[d] = ( 2 * radius[d] + 1 ) * ( 2 * radius[d] + 1 );
+    uint64_t a = m_BallScale;
+    uint64_t b = axis[d];
+    while( b != 0 )
+      {
+      const uint64_t t = a % b;
+      a = b;
+      b = t;
+      }
+    m_BallScale = m_BallScale / a * axis[d];
+    }
+  for( unsigned int d = 0; d < 3; ++d )
+    {
+    m_BallCoefficient[d] = 4 * ( m_BallScale / axis[d] );
+    }
+
+  // Sorted in plane distances that fit in the ball, followed by one value
+  // that does not fit for the offsets past the radius.
+  const SizeValueType rx = radius[0];
+  const SizeValueType ry = radius[1];
+  m_BallValues.clear();
+  for( SizeValueType dx = 0; dx <= rx; ++dx )
+    {
+    for( SizeValueType dy = 0; dy <= ry; ++dy )
+      {
+      const uint64_t value = m_BallCoefficient[0] * dx * dx + m_BallCoefficient[1] * dy * dy;
+      if( value <= m_BallScale )
+        {
+        m_BallValues.push_back(value);
+        }
+      }
+    }
+  std::sort(m_BallValues.begin(), m_BallValues.end() );
+  m_BallValues.erase(std::unique(m_BallValues.begin(), m_BallValues.end() ), m_BallValues.end() );
+  m_BallValues.push_back(m_BallScale + 1);
+  if( m_BallValues.size() > NumericTraits<unsigned short>::max() )
+    {
+    itkExceptionMacro(<< "Structuring element is too large");
+    }
+
+  const unsigned short farRank = static_cast<unsigned short>( m_BallValues.size() - 1 );
+  m_BallRank.assign( ( rx + 2 ) * ( ry + 1 ), farRank);
+  for( SizeValueType dx = 0; dx <= rx; ++dx )
+    {
+    for( SizeValueType dy = 0; dy <= ry; ++dy )
+      {
+      const uint64_t value = m_BallCoefficient[0] * dx * dx + m_BallCoefficient[1] * dy * dy;
+      if( value <= m_BallScale )
+        {
+        m_BallRank[dx * ( ry + 1 ) + dy] = static_cast<unsigned short>(
+            std::lower_bound(m_BallValues.begin(), m_BallValues.end(), value) - m_BallValues.begin() );
+        }
+      }
+    }
 
-  outputCaster->GraftOutput( this->GetOutput() );
-  outputCaster->Update();
-  this->GraftOutput( outputCaster->GetOutput() );
-  //  typename OutputImageType::Pointer outputMaskImage =
-  // outputCaster->GetOutput();
-  //  return outputMaskImage;
+  m_InvertMask = invert;
+  m_Distance.resize(m_NumberOfRows * m_Size[0]);
+  this->ExecuteStage(DISTANCE_X_STAGE);
+  this->ExecuteStage(DISTANCE_Y_STAGE);
+  this->ExecuteStage(DILATE_Z_STAGE);
 }
 }
 #endif // itkLargestForegroundFilledMaskImageFilter_hxx
@@ -0,0 +1,166 @@
+/*=========================================================================
+ *
+ *  Copyright SINAPSE: Scalable Informatics for Neuroscience, Processing and Software Engineering
+ *            The University of Iowa
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#ifndef __itkMaximumProbabilityLabelImageFilter_h
+#define __itkMaximumProbabilityLabelImageFilter_h
+
+#include "itkImageToImageFilter.h"
+#include <vector>
+
+namespace itk
+{
+/** \class MaximumProbabilityLabelImageFilter
+ *
+ * \brief Labels each voxel with the class of largest probability.
+ *
+ * The inputs are the probability maps of the classes, one per input.  Each
+ * voxel of the output receives the label code of the class with the largest
+ * probability (the first one on ties), or:
+ *  - the background label where the optional mask is zero,
+ *  - the below threshold label where the largest probability is not above
+ *    the inclusion threshold.
+ *
+ * The second output is a foreground mask: one where the mask is set, the
+ * selected class is a foreground class and its probability is at least the
+ * minimum foreground probability, zero elsewhere.
+ *
+ * The number of voxels given to each label is counted in the same pass, so
+ * no statistics filter has to be run on the result.
+ *
+ * The maps are processed one row at a time in slabs of the output, with
+ * the classes in the outer loop and the voxels of the row in the inner
+ * loop, so each map is read as a contiguous stream and the compiler can
+ * vectorize the running maximum and argmax.
+ *
+ * \ingroup ITKBRAINSFilterPack
+ */
+template <typename TProbabilityImage, typename TLabelImage>
+class ITK_EXPORT MaximumProbabilityLabelImageFilter :
+  public ImageToImageFilter<TProbabilityImage, TLabelImage>
+{
+public:
+  /** Standard class typedefs. */
+  typedef MaximumProbabilityLabelImageFilter                 Self;
+  typedef ImageToImageFilter<TProbabilityImage, TLabelImage> Superclass;
+  typedef SmartPointer<Self>                                 Pointer;
+  typedef SmartPointer<const Self>                           ConstPointer;
+
+  /** Method for creation through the object factory. */
+  itkNewMacro(Self);
+
+  /** Run-time type information (and related methods) */
+  itkTypeMacro(MaximumProbabilityLabelImageFilter, ImageToImageFilter);
+
+  itkStaticConstMacro(ImageDimension, unsigned int, TLabelImage::ImageDimension);
+
+  typedef TProbabilityImage                                             ProbabilityImageType;
+  typedef typename ProbabilityImageType::PixelType                      ProbabilityPixelType;
+  typedef TLabelImage                                                   LabelImageType;
+  typedef typename LabelImageType::PixelType                            LabelPixelType;
+  typedef typename LabelImageType::RegionType                           OutputImageRegionType;
+  typedef Image<unsigned char, itkGetStaticConstMacro(ImageDimension)> MaskImageType;
+  typedef std::vector<LabelPixelType>                                   LabelCodeVectorType;
+  typedef std::vector<bool>                                             ForegroundClassVectorType;
+
+  /** Probability map of class i */
+  void SetProbabilityImage(unsigned int i, const ProbabilityImageType *image)
+  {
+    this->SetNthInput(i, const_cast<ProbabilityImageType *>( image ) );
+  }
+
+  /** Only the voxels where this mask is not zero are labeled */
+  itkSetConstObjectMacro(MaskImage, MaskImageType);
+  itkGetConstObjectMacro(MaskImage, MaskImageType);
+
+  /** Label of each class, the index of the class by default */
+  void SetLabelCodes(const LabelCodeVectorType & codes)
+  {
+    this->m_LabelCodes = codes;
+    this->Modified();
+  }
+
+  /** Foreground flag of each class, none by default */
+  void SetForegroundClasses(const ForegroundClassVectorType & foreground)
+  {
+    this->m_ForegroundClasses = foreground;
+    this->Modified();
+  }
+
+  itkSetMacro(BackgroundLabel, LabelPixelType);
+  itkGetConstMacro(BackgroundLabel, LabelPixelType);
+
+  itkSetMacro(BelowThresholdLabel, LabelPixelType);
+  itkGetConstMacro(BelowThresholdLabel, LabelPixelType);
+
+  /** Voxels whose largest probability is not above this value get the
+   * below threshold label.  No voxel is excluded by default. */
+  itkSetMacro(InclusionThreshold, double);
+  itkGetConstMacro(InclusionThreshold, double);
+
+  itkSetMacro(MinimumForegroundProbability, double);
+  itkGetConstMacro(MinimumForegroundProbability, double);
+
+  MaskImageType * GetForegroundMask();
+
+  /** Number of voxels labeled with the given value by the last update */
+  SizeValueType GetLabelCount(const LabelPixelType label) const;
+
+protected:
+  MaximumProbabilityLabelImageFilter();
+  virtual ~MaximumProbabilityLabelImageFilter() {}
+
+  typedef ProcessObject::DataObjectPointerArraySizeType DataObjectPointerArraySizeType;
+  using Superclass::MakeOutput;
+  DataObject::Pointer MakeOutput(DataObjectPointerArraySizeType idx) ITK_OVERRIDE;
+
+  void BeforeThreadedGenerateData() ITK_OVERRIDE;
+
+  void ThreadedGenerateData(const OutputImageRegionType & outputRegionForThread,
+                            ThreadIdType threadId) ITK_OVERRIDE;
+
+  void AfterThreadedGenerateData() ITK_OVERRIDE;
+
+  void PrintSelf(std::ostream &, Indent) const ITK_OVERRIDE;
+
+private:
+  ITK_DISALLOW_COPY_AND_ASSIGN(MaximumProbabilityLabelImageFilter);
+
+  typedef std::vector<SizeValueType> CountVectorType;
+
+  typename MaskImageType::ConstPointer m_MaskImage;
+  LabelCodeVectorType                  m_LabelCodes;
+  ForegroundClassVectorType            m_ForegroundClasses;
+  LabelPixelType                       m_BackgroundLabel;
+  LabelPixelType                       m_BelowThresholdLabel;
+  double                               m_InclusionThreshold;
+  double                               m_MinimumForegroundProbability;
+
+  // Working state of one update
+  LabelCodeVectorType m_ClassLabels;
+  // Voxels per class, then the background and below threshold voxels
+  CountVectorType              m_Counts;
+  std::vector<CountVectorType> m_ThreadCounts;
+};
+
+} // end namespace itk
+
+#ifndef ITK_MANUAL_INSTANTIATION
+#include "itkMaximumProbabilityLabelImageFilter.hxx"
+#endif
+
+#endif
@@ -0,0 +1,264 @@
+/*=========================================================================
+ *
+ *  Copyright SINAPSE: Scalable Informatics for Neuroscience, Processing and Software Engineering
+ *            The University of Iowa
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#ifndef __itkMaximumProbabilityLabelImageFilter_hxx
+#define __itkMaximumProbabilityLabelImageFilter_hxx
+
+#include "itkMaximumProbabilityLabelImageFilter.h"
+#include "itkImageRegionConstIteratorWithIndex.h"
+#include "itkNumericTraits.h"
+#include <algorithm>
+
+namespace itk
+{
+template <typename TProbabilityImage, typename TLabelImage>
+MaximumProbabilityLabelImageFilter<TProbabilityImage, TLabelImage>
+::MaximumProbabilityLabelImageFilter() :
+  m_MaskImage(ITK_NULLPTR),
+  m_BackgroundLabel(NumericTraits<LabelPixelType>::ZeroValue() ),
+  m_BelowThresholdLabel(NumericTraits<LabelPixelType>::ZeroValue() ),
+  m_InclusionThreshold(-NumericTraits<double>::max() ),
+  m_MinimumForegroundProbability(0.0)
+{
+  this->SetNumberOfRequiredOutputs(2);
+  this->SetNthOutput(1, this->MakeOutput(1) );
+}
+
+template <typename TProbabilityImage, typename TLabelImage>
+DataObject::Pointer
+MaximumProbabilityLabelImageFilter<TProbabilityImage, TLabelImage>
+::MakeOutput(DataObjectPointerArraySizeType idx)
+{
+  if( idx == 1 )
+    {
+    return MaskImageType::New().GetPointer();
+    }
+  return Superclass::MakeOutput(idx);
+}
+
+template <typename TProbabilityImage, typename TLabelImage>
+typename MaximumProbabilityLabelImageFilter<TProbabilityImage, TLabelImage>::MaskImageType *
+MaximumProbabilityLabelImageFilter<TProbabilityImage, TLabelImage>
+::GetForegroundMask()
+{
+  return dynamic_cast<MaskImageType *>( this->ProcessObject::GetOutput(1) );
+}
+
+template <typename TProbabilityImage, typename TLabelImage>
+SizeValueType
+MaximumProbabilityLabelImageFilter<TProbabilityImage, TLabelImage>
+::GetLabelCount(const LabelPixelType label) const
+{
+  const size_t  numberOfClasses = this->m_ClassLabels.size();
+  SizeValueType count = 0;
+  if( this->m_Counts.size() != numberOfClasses + 2 )
+    {
+    return count;
+    }
+  for( size_t c = 0; c < numberOfClasses; ++c )
+    {
+    if( this->m_ClassLabels[c] == label )
+      {
+      count += this->m_Counts[c];
+      }
+    }
+  if( this->m_BackgroundLabel == label )
+    {
+    count += this->m_Counts[numberOfClasses];
+    }
+  if( this->m_BelowThresholdLabel == label )
+    {
+    count += this->m_Counts[numberOfClasses + 1];
+    }
+  return count;
+}
+
+template <typename TProbabilityImage, typename TLabelImage>
+void
+MaximumProbabilityLabelImageFilter<TProbabilityImage, TLabelImage>
+::BeforeThreadedGenerateData()
+{
+  const unsigned int numberOfClasses = this->GetNumberOfIndexedInputs();
+  if( numberOfClasses == 0 )
+    {
+    itkExceptionMacro(<< "At least one probability image is required");
+    }
+  const OutputImageRegionType & region = this->GetOutput()->GetRequestedRegion();
+  for( unsigned int c = 0; c < numberOfClasses; ++c )
+    {
+    if( this->GetInput(c) == ITK_NULLPTR || !this->GetInput(c)->GetBufferedRegion().IsInside(region) )
+      {
+      itkExceptionMacro(<< "Probability image " << c << " does not cover the output region");
+      }
+    }
+  if( this->m_MaskImage.IsNotNull() && !this->m_MaskImage->GetBufferedRegion().IsInside(region) )
+    {
+    itkExceptionMacro(<< "The mask does not cover the output region");
+    }
+  if( !this->m_ForegroundClasses.empty() && this->m_ForegroundClasses.size() != numberOfClasses )
+    {
+    itkExceptionMacro(<< "Expected " << numberOfClasses << " foreground flags, got "
+                      << this->m_ForegroundClasses.size() );
+    }
+  if( this->m_LabelCodes.empty() )
+    {
+    this->m_ClassLabels.resize(numberOfClasses);
+    for( unsigned int c = 0; c < numberOfClasses; ++c )
+      {
+      this->m_ClassLabels[c] = static_cast<LabelPixelType>( c );
+      }
+    }
+  else if( this->m_LabelCodes.size() == numberOfClasses )
+    {
+    this->m_ClassLabels = this->m_LabelCodes;
+    }
+  else
+    {
+    itkExceptionMacro(<< "Expected " << numberOfClasses << " label codes, got " << this->m_LabelCodes.size() );
+    }
+  this->m_ThreadCounts.assign(this->GetNumberOfThreads(), CountVectorType(numberOfClasses + 2, 0) );
+}
+
+template <typename TProbabilityImage, typename TLabelImage>
+void
+MaximumProbabilityLabelImageFilter<TProbabilityImage, TLabelImage>
+::ThreadedGenerateData(const OutputImageRegionType & outputRegionForThread, ThreadIdType threadId)
+{
+  const unsigned int numberOfClasses = this->GetNumberOfIndexedInputs();
+  const SizeValueType backgroundIndex = numberOfClasses;
+  const SizeValueType belowThresholdIndex = numberOfClasses + 1;
+  const SizeValueType rowLength = outputRegionForThread.GetSize(0);
+  if( rowLength == 0 )
+    {
+    return;
+    }
+  LabelImageType *         output = this->GetOutput();
+  MaskImageType *          foreground = this->GetForegroundMask();
+  const MaskImageType *    mask = this->m_MaskImage.GetPointer();
+  CountVectorType &        counts = this->m_ThreadCounts[threadId];
+  const LabelPixelType *   classLabels = &this->m_ClassLabels[0];
+  std::vector<char>        isForeground(numberOfClasses, 0);
+  for( unsigned int c = 0; c < numberOfClasses && !this->m_ForegroundClasses.empty(); ++c )
+    {
+    isForeground[c] = this->m_ForegroundClasses[c];
+    }
+
+  std::vector<const ProbabilityPixelType *> rows(numberOfClasses);
+  std::vector<ProbabilityPixelType>         best(rowLength);
+  std::vector<unsigned int>                 argmax(rowLength);
+
+  OutputImageRegionType rowStarts = outputRegionForThread;
+  rowStarts.SetSize(0, 1);
+  for( ImageRegionConstIteratorWithIndex<LabelImageType> rowIt(output, rowStarts); !rowIt.IsAtEnd(); ++rowIt )
+    {
+    const typename LabelImageType::IndexType & rowIndex = rowIt.GetIndex();
+    LabelPixelType *                           labels = output->GetBufferPointer() + output->ComputeOffset(rowIndex);
+    unsigned char *                            foregroundRow =
+      foreground->GetBufferPointer() + foreground->ComputeOffset(rowIndex);
+    const unsigned char *maskRow = ( mask != ITK_NULLPTR )
+      ? mask->GetBufferPointer() + mask->ComputeOffset(rowIndex) : ITK_NULLPTR;
+
+    if( maskRow != ITK_NULLPTR
+        && std::count(maskRow, maskRow + rowLength, 0) == static_cast<std::ptrdiff_t>( rowLength ) )
+      {
+      std::fill(labels, labels + rowLength, this->m_BackgroundLabel);
+      std::fill(foregroundRow, foregroundRow + rowLength, 0);
+      counts[backgroundIndex] += rowLength;
+      continue;
+      }
+
+    // Running maximum and argmax over the classes
+    for( unsigned int c = 0; c < numberOfClasses; ++c )
+      {
+      rows[c] = this->GetInput(c)->GetBufferPointer() + this->GetInput(c)->ComputeOffset(rowIndex);
+      }
+    std::copy(rows[0], rows[0] + rowLength, best.begin() );
+    std::fill(argmax.begin(), argmax.end(), 0);
+    ProbabilityPixelType *b = &best[0];
+    unsigned int *        a = &argmax[0];
+    for( unsigned int c = 1; c < numberOfClasses; ++c )
+      {
+      const ProbabilityPixelType *p = rows[c];
+      for( SizeValueType i = 0; i < rowLength; ++i )
+        {
+        const bool greater = p[i] > b[i];
+        b[i] = greater ? p[i] : b[i];
+        a[i] = greater ? c : a[i];
+        }
+      }
+
+    for( SizeValueType i = 0; i < rowLength; ++i )
+      {
+      if( maskRow != ITK_NULLPTR && maskRow[i] == 0 )
+        {
+        labels[i] = this->m_BackgroundLabel;
+        foregroundRow[i] = 0;
+        ++counts[backgroundIndex];
+        continue;
+        }
+      const double       maximum = static_cast<double>( b[i] );
+      const unsigned int c = a[i];
+      if( maximum > this->m_InclusionThreshold )
+        {
+        labels[i] = classLabels[c];
+        ++counts[c];
+        }
+      else
+        {
+        labels[i] = this->m_BelowThresholdLabel;
+        ++counts[belowThresholdIndex];
+        }
+      foregroundRow[i] = ( isForeground[c] && !( maximum < this->m_MinimumForegroundProbability ) ) ? 1 : 0;
+      }
+    }
+}
+
+template <typename TProbabilityImage, typename TLabelImage>
+void
+MaximumProbabilityLabelImageFilter<TProbabilityImage, TLabelImage>
+::AfterThreadedGenerateData()
+{
+  this->m_Counts.assign(this->GetNumberOfIndexedInputs() + 2, 0);
+  for( size_t t = 0; t < this->m_ThreadCounts.size(); ++t )
+    {
+    for( size_t k = 0; k < this->m_Counts.size(); ++k )
+      {
+      this->m_Counts[k] += this->m_ThreadCounts[t][k];
+      }
+    }
+  this->m_ThreadCounts.clear();
+}
+
+template <typename TProbabilityImage, typename TLabelImage>
+void
+MaximumProbabilityLabelImageFilter<TProbabilityImage, TLabelImage>
+::PrintSelf(std::ostream & os, Indent indent) const
+{
+  Superclass::PrintSelf(os, indent);
+  os << indent << "MaskImage: " << this->m_MaskImage.GetPointer() << std::endl;
+  os << indent << "BackgroundLabel: "
+     << static_cast<typename NumericTraits<LabelPixelType>::PrintType>( this->m_BackgroundLabel ) << std::endl;
+  os << indent << "BelowThresholdLabel: "
+     << static_cast<typename NumericTraits<LabelPixelType>::PrintType>( this->m_BelowThresholdLabel ) << std::endl;
+  os << indent << "InclusionThreshold: " << this->m_InclusionThreshold << std::endl;
+  os << indent << "MinimumForegroundProbability: " << this->m_MinimumForegroundProbability << std::endl;
+}
+
+} // end namespace itk
+
+#endif
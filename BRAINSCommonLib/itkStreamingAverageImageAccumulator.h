@@ -0,0 +1,216 @@
+/*=========================================================================
+ *
+ *  Copyright SINAPSE: Scalable Informatics for Neuroscience, Processing and Software Engineering
+ *            The University of Iowa
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#ifndef __itkStreamingAverageImageAccumulator_h
+#define __itkStreamingAverageImageAccumulator_h
+
+#include "itkImage.h"
+#include "itkImageSource.h"
+#include "itkMultiThreader.h"
+#include "itkObject.h"
+#include <vector>
+
+namespace itk
+{
+/** \class StreamingAverageImageAccumulator
+ *
+ * \brief Pixelwise weighted average of an arbitrary number of images that
+ * are added one at a time.
+ *
+ * itk::AverageImageFilter needs all of its inputs in memory at once.  This
+ * accumulator keeps only running per pixel sums, so averaging many
+ * registered images is bounded by the size of one image:
+ *
+ *  - AddImage() adds an image that is already in memory.
+ *  - AddImageSource() updates a source (typically an ImageFileReader) one
+ *    slab of slices at a time, so only one slab of each input is resident
+ *    when the file format supports streaming.
+ *
+ * The weighted sum and sum of squares are accumulated in TAccumulate, with
+ * Kahan compensated summation unless UseCompensatedSummation is turned off.
+ * When NumberOfHistogramBins is non zero, a per pixel histogram with that
+ * many bins over [HistogramMinimum, HistogramMaximum] is also accumulated,
+ * from which the median and trimmed mean are estimated to within one bin.
+ * Values outside the histogram range count in the first or last bin, NaN
+ * values are not counted.
+ * The histograms use NumberOfHistogramBins floats per pixel.
+ *
+ * All inputs must have the same largest possible region, origin, spacing
+ * and direction as the first one (or the image given to Initialize()).
+ * Only scalar pixel types are supported; for integer output pixel types
+ * the results are converted by a cast, as in itk::AverageImageFilter.
+ *
+ * \ingroup ITKBRAINSFilterPack
+ */
+template <typename TInputImage, typename TOutputImage = TInputImage, typename TAccumulate = double>
+class ITK_EXPORT StreamingAverageImageAccumulator : public Object
+{
+public:
+  /** Standard class typedefs. */
+  typedef StreamingAverageImageAccumulator Self;
+  typedef Object                           Superclass;
+  typedef SmartPointer<Self>               Pointer;
+  typedef SmartPointer<const Self>         ConstPointer;
+
+  /** Method for creation through the object factory. */
+  itkNewMacro(Self);
+
+  /** Run-time type information (and related methods) */
+  itkTypeMacro(StreamingAverageImageAccumulator, Object);
+
+  itkStaticConstMacro(ImageDimension, unsigned int, TInputImage::ImageDimension);
+
+  typedef TInputImage                            InputImageType;
+  typedef TOutputImage                           OutputImageType;
+  typedef typename InputImageType::PixelType     InputPixelType;
+  typedef typename OutputImageType::PixelType    OutputPixelType;
+  typedef typename OutputImageType::Pointer      OutputImagePointer;
+  typedef typename InputImageType::RegionType    RegionType;
+  typedef ImageBase<TInputImage::ImageDimension> ImageBaseType;
+  typedef ImageSource<InputImageType>            InputImageSourceType;
+  typedef TAccumulate                            AccumulateType;
+
+  /** Use Kahan compensated summation, on by default.  Takes effect at the
+   * next Initialize(). */
+  itkSetMacro(UseCompensatedSummation, bool);
+  itkGetConstMacro(UseCompensatedSummation, bool);
+  itkBooleanMacro(UseCompensatedSummation);
+
+  /** Number of bins of the per pixel histograms, 0 (no histograms) by
+   * default.  The histogram settings must be set before the first image is
+   * added. */
+  itkSetMacro(NumberOfHistogramBins, unsigned int);
+  itkGetConstMacro(NumberOfHistogramBins, unsigned int);
+  itkSetMacro(HistogramMinimum, double);
+  itkGetConstMacro(HistogramMinimum, double);
+  itkSetMacro(HistogramMaximum, double);
+  itkGetConstMacro(HistogramMaximum, double);
+
+  /** Number of slabs AddImageSource() splits each input into, 8 by default */
+  itkSetClampMacro(NumberOfStreamDivisions, unsigned int, 1, NumericTraits<unsigned int>::max() );
+  itkGetConstMacro(NumberOfStreamDivisions, unsigned int);
+
+  /** Number of threads used to accumulate and to compute the results */
+  itkSetClampMacro(NumberOfThreads, ThreadIdType, 1, ITK_MAX_THREADS);
+  itkGetConstMacro(NumberOfThreads, ThreadIdType);
+
+  /** Sum of the weights of the images added so far */
+  itkGetConstMacro(WeightSum, double);
+
+  itkGetConstMacro(NumberOfImages, unsigned int);
+
+  /** Discard the sums and take the image information of the average from
+   * the reference.  Called with the first image otherwise. */
+  void Initialize(const ImageBaseType *reference);
+
+  /** Add an image whose buffered region covers the whole average */
+  void AddImage(const InputImageType *image, const double weight = 1.0);
+
+  /** Update the source slab by slab and add each slab */
+  void AddImageSource(InputImageSourceType *source, const double weight = 1.0);
+
+  /** Weighted mean of the images added so far */
+  OutputImagePointer GetMeanImage();
+
+  /** Weighted population variance of the images added so far */
+  OutputImagePointer GetVarianceImage();
+
+  /** Weighted median, interpolated within the histogram bins */
+  OutputImagePointer GetMedianImage();
+
+  /** Weighted mean of the values between the trimFraction and 1 -
+   * trimFraction quantiles, with the values of each bin at its center */
+  OutputImagePointer GetTrimmedMeanImage(const double trimFraction);
+
+protected:
+  StreamingAverageImageAccumulator();
+  virtual ~StreamingAverageImageAccumulator() {}
+
+  void PrintSelf(std::ostream&, Indent) const ITK_OVERRIDE;
+
+private:
+  ITK_DISALLOW_COPY_AND_ASSIGN(StreamingAverageImageAccumulator);
+
+  typedef std::vector<AccumulateType> AccumulateVectorType;
+
+  enum StageType
+    {
+    ACCUMULATE_STAGE,
+    MEAN_STAGE,
+    VARIANCE_STAGE,
+    MEDIAN_STAGE,
+    TRIMMED_MEAN_STAGE
+    };
+
+  struct ThreadStruct
+    {
+    Self *                Accumulator;
+    StageType             Stage;
+    SizeValueType         RangeSize;
+    const InputImageType *Image;
+    RegionType            Region;
+    AccumulateType        Weight;
+    OutputPixelType *     Output;
+    double                TrimFraction;
+    };
+
+  static ITK_THREAD_RETURN_TYPE StageThreaderCallback(void *arg);
+
+  void ExecuteStage(ThreadStruct & str);
+
+  /** Check that the image matches the information of the average */
+  void VerifyInformation(const ImageBaseType *image) const;
+
+  /** Add the region of the image, in parallel over its slowest dimension */
+  void AccumulateRegion(const InputImageType *image, const RegionType & region, const double weight);
+
+  void ThreadedAccumulate(const ThreadStruct & str, const SizeValueType start, const SizeValueType end);
+
+  void ThreadedResult(const ThreadStruct & str, const SizeValueType start, const SizeValueType end);
+
+  OutputImagePointer ComputeResult(const StageType stage, const double trimFraction);
+
+  bool         m_UseCompensatedSummation;
+  unsigned int m_NumberOfHistogramBins;
+  double       m_HistogramMinimum;
+  double       m_HistogramMaximum;
+  unsigned int m_NumberOfStreamDivisions;
+  ThreadIdType m_NumberOfThreads;
+  double       m_WeightSum;
+  unsigned int m_NumberOfImages;
+
+  /** Information of the average, with no buffer */
+  OutputImagePointer m_Reference;
+  RegionType         m_Region;
+
+  AccumulateVectorType m_Sum;
+  AccumulateVectorType m_SumCompensation;
+  AccumulateVectorType m_SumOfSquares;
+  AccumulateVectorType m_SumOfSquaresCompensation;
+  std::vector<float>   m_Histograms;   // [pixel][bin]
+
+  MultiThreader::Pointer m_Threader;
+};
+
+} // end namespace itk
+
+#ifndef ITK_MANUAL_INSTANTIATION
+#include "itkStreamingAverageImageAccumulator.hxx"
+#endif
+
+#endif
@@ -0,0 +1,515 @@
+/*=========================================================================
+ *
+ *  Copyright SINAPSE: Scalable Informatics for Neuroscience, Processing and Software Engineering
+ *            The University of Iowa
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#ifndef __itkStreamingAverageImageAccumulator_hxx
+#define __itkStreamingAverageImageAccumulator_hxx
+
+#include "itkStreamingAverageImageAccumulator.h"
+#include "itkImageRegionConstIteratorWithIndex.h"
+#include "itkNumericTraits.h"
+#include "vnl/vnl_math.h"
+#include <algorithm>
+#include <cmath>
+
+namespace itk
+{
+template <typename TInputImage, typename TOutputImage, typename TAccumulate>
+StreamingAverageImageAccumulator<TInputImage, TOutputImage, TAccumulate>
+::StreamingAverageImageAccumulator() :
+  m_UseCompensatedSummation(true),
+  m_NumberOfHistogramBins(0),
+  m_HistogramMinimum(0.0),
+  m_HistogramMaximum(0.0),
+  m_NumberOfStreamDivisions(8),
+  m_NumberOfThreads(MultiThreader::GetGlobalDefaultNumberOfThreads() ),
+  m_WeightSum(0.0),
+  m_NumberOfImages(0)
+{
+  this->m_Threader = MultiThreader::New();
+}
+
+template <typename TInputImage, typename TOutputImage, typename TAccumulate>
+void
+StreamingAverageImageAccumulator<TInputImage, TOutputImage, TAccumulate>
+::Initialize(const ImageBaseType *reference)
+{
+  if( this->m_NumberOfHistogramBins > 0 && !( this->m_HistogramMaximum > this->m_HistogramMinimum ) )
+    {
+    itkExceptionMacro(<< "HistogramMaximum must be larger than HistogramMinimum");
+    }
+
+  this->m_Reference = OutputImageType::New();
+  this->m_Reference->CopyInformation(reference);
+  this->m_Region = reference->GetLargestPossibleRegion();
+  this->m_Reference->SetRegions(this->m_Region);
+
+  const SizeValueType numberOfPixels = this->m_Region.GetNumberOfPixels();
+  this->m_Sum.assign(numberOfPixels, NumericTraits<AccumulateType>::ZeroValue() );
+  this->m_SumOfSquares.assign(numberOfPixels, NumericTraits<AccumulateType>::ZeroValue() );
+  if( this->m_UseCompensatedSummation )
+    {
+    this->m_SumCompensation.assign(numberOfPixels, NumericTraits<AccumulateType>::ZeroValue() );
+    this->m_SumOfSquaresCompensation.assign(numberOfPixels, NumericTraits<AccumulateType>::ZeroValue() );
+    }
+  else
+    {
+    AccumulateVectorType().swap(this->m_SumCompensation);
+    AccumulateVectorType().swap(this->m_SumOfSquaresCompensation);
+    }
+  if( this->m_NumberOfHistogramBins > 0 )
+    {
+    this->m_Histograms.assign(numberOfPixels * this->m_NumberOfHistogramBins, 0.0F);
+    }
+  else
+    {
+    std::vector<float>().swap(this->m_Histograms);
+    }
+  this->m_WeightSum = 0.0;
+  this->m_NumberOfImages = 0;
+}
+
+template <typename TInputImage, typename TOutputImage, typename TAccumulate>
+void
+StreamingAverageImageAccumulator<TInputImage, TOutputImage, TAccumulate>
+::VerifyInformation(const ImageBaseType *image) const
+{
+  if( image->GetLargestPossibleRegion() != this->m_Region )
+    {
+    itkExceptionMacro(<< "Image region " << image->GetLargestPossibleRegion()
+                      << " does not match the region of the average " << this->m_Region);
+    }
+  const double tolerance = 1.0e-6 * this->m_Reference->GetSpacing().GetVnlVector().max_value();
+  for( unsigned int d = 0; d < ImageDimension; ++d )
+    {
+    if( std::fabs(image->GetOrigin()[d] - this->m_Reference->GetOrigin()[d]) > tolerance
+        || std::fabs(image->GetSpacing()[d] - this->m_Reference->GetSpacing()[d]) > tolerance )
+      {
+      itkExceptionMacro(<< "Image origin or spacing does not match the average");
+      }
+    for( unsigned int e = 0; e < ImageDimension; ++e )
+      {
+      if( std::fabs(image->GetDirection()[d][e] - this->m_Reference->GetDirection()[d][e]) > 1.0e-6 )
+        {
+        itkExceptionMacro(<< "Image direction does not match the average");
+        }
+      }
+    }
+}
+
+template <typename TInputImage, typename TOutputImage, typename TAccumulate>
+void
+StreamingAverageImageAccumulator<TInputImage, TOutputImage, TAccumulate>
+::AddImage(const InputImageType *image, const double weight)
+{
+  if( image == ITK_NULLPTR )
+    {
+    itkExceptionMacro(<< "Null image");
+    }
+  if( this->m_Reference.IsNull() )
+    {
+    this->Initialize(image);
+    }
+  this->VerifyInformation(image);
+  if( !image->GetBufferedRegion().IsInside(this->m_Region) )
+    {
+    itkExceptionMacro(<< "Buffered region " << image->GetBufferedRegion()
+                      << " does not cover the average; use AddImageSource() to stream it");
+    }
+
+  this->AccumulateRegion(image, this->m_Region, weight);
+  this->m_WeightSum += weight;
+  ++this->m_NumberOfImages;
+}
+
+template <typename TInputImage, typename TOutputImage, typename TAccumulate>
+void
+StreamingAverageImageAccumulator<TInputImage, TOutputImage, TAccumulate>
+::AddImageSource(InputImageSourceType *source, const double weight)
+{
+  if( source == ITK_NULLPTR )
+    {
+    itkExceptionMacro(<< "Null image source");
+    }
+  source->UpdateOutputInformation();
+  InputImageType *image = source->GetOutput();
+  if( this->m_Reference.IsNull() )
+    {
+    this->Initialize(image);
+    }
+  this->VerifyInformation(image);
+
+  // Slabs along the slowest dimension, as in StreamingImageFilter
+  const unsigned int  slowDimension = ImageDimension - 1;
+  const SizeValueType numberOfSlices = this->m_Region.GetSize(slowDimension);
+  const SizeValueType numberOfSlabs =
+    std::max<SizeValueType>(1, std::min<SizeValueType>(this->m_NumberOfStreamDivisions, numberOfSlices) );
+  for( SizeValueType s = 0; s < numberOfSlabs; ++s )
+    {
+    const SizeValueType start = s * numberOfSlices / numberOfSlabs;
+    const SizeValueType end = ( s + 1 ) * numberOfSlices / numberOfSlabs;
+    RegionType          slab = this->m_Region;
+    slab.SetIndex(slowDimension, this->m_Region.GetIndex(slowDimension) + start);
+    slab.SetSize(slowDimension, end - start);
+
+    image->SetRequestedRegion(slab);
+    image->PropagateRequestedRegion();
+    image->UpdateOutputData();
+
+    // Formats that cannot stream a region deliver the whole image at once
+    if( image->GetBufferedRegion().IsInside(this->m_Region) )
+      {
+      this->AccumulateRegion(image, this->m_Region, weight);
+      break;
+      }
+    if( !image->GetBufferedRegion().IsInside(slab) )
+      {
+      itkExceptionMacro(<< "Source did not produce the requested region " << slab);
+      }
+    this->AccumulateRegion(image, slab, weight);
+    }
+  image->ReleaseData();
+
+  this->m_WeightSum += weight;
+  ++this->m_NumberOfImages;
+}
+
+template <typename TInputImage, typename TOutputImage, typename TAccumulate>
+void
+StreamingAverageImageAccumulator<TInputImage, TOutputImage, TAccumulate>
+::AccumulateRegion(const InputImageType *image, const RegionType & region, const double weight)
+{
+  ThreadStruct str;
+
+  str.Accumulator = this;
+  str.Stage = ACCUMULATE_STAGE;
+  str.RangeSize = region.GetSize(ImageDimension - 1);
+  str.Image = image;
+  str.Region = region;
+  str.Weight = static_cast<AccumulateType>( weight );
+  str.Output = ITK_NULLPTR;
+  str.TrimFraction = 0.0;
+  this->ExecuteStage(str);
+}
+
+template <typename TInputImage, typename TOutputImage, typename TAccumulate>
+void
+StreamingAverageImageAccumulator<TInputImage, TOutputImage, TAccumulate>
+::ExecuteStage(ThreadStruct & str)
+{
+  if( str.RangeSize == 0 )
+    {
+    return;
+    }
+  const ThreadIdType numberOfThreads =
+    static_cast<ThreadIdType>( std::min<SizeValueType>(this->m_NumberOfThreads, str.RangeSize) );
+  this->m_Threader->SetNumberOfThreads(numberOfThreads);
+  this->m_Threader->SetSingleMethod(this->StageThreaderCallback, &str);
+  this->m_Threader->SingleMethodExecute();
+}
+
+template <typename TInputImage, typename TOutputImage, typename TAccumulate>
+ITK_THREAD_RETURN_TYPE
+StreamingAverageImageAccumulator<TInputImage, TOutputImage, TAccumulate>
+::StageThreaderCallback(void *arg)
+{
+  const ThreadIdType threadId = ( (MultiThreader::ThreadInfoStruct *)(arg) )->ThreadID;
+  const ThreadIdType threadCount = ( (MultiThreader::ThreadInfoStruct *)(arg) )->NumberOfThreads;
+  ThreadStruct *     str = (ThreadStruct *)( ( (MultiThreader::ThreadInfoStruct *)(arg) )->UserData);
+
+  const SizeValueType chunk = ( str->RangeSize + threadCount - 1 ) / threadCount;
+  const SizeValueType start = std::min(str->RangeSize, threadId * chunk);
+  const SizeValueType end = std::min(str->RangeSize, start + chunk);
+  if( start < end )
+    {
+    if( str->Stage == ACCUMULATE_STAGE )
+      {
+      str->Accumulator->ThreadedAccumulate(*str, start, end);
+      }
+    else
+      {
+      str->Accumulator->ThreadedResult(*str, start, end);
+      }
+    }
+  return ITK_THREAD_RETURN_VALUE;
+}
+
+template <typename TInputImage, typename TOutputImage, typename TAccumulate>
+void
+StreamingAverageImageAccumulator<TInputImage, TOutputImage, TAccumulate>
+::ThreadedAccumulate(const ThreadStruct & str, const SizeValueType start, const SizeValueType end)
+{
+  const unsigned int slowDimension = ImageDimension - 1;
+  RegionType         slab = str.Region;
+
+  slab.SetIndex(slowDimension, str.Region.GetIndex(slowDimension) + start);
+  slab.SetSize(slowDimension, end - start);
+  const SizeValueType rowLength = slab.GetSize(0);
+  if( rowLength == 0 || slab.GetNumberOfPixels() == 0 )
+    {
+    return;
+    }
+
+  // The compensation terms are allocated by Initialize() when enabled
+  const AccumulateType w = str.Weight;
+  const bool           compensated = !this->m_SumCompensation.empty();
+  const unsigned int   numberOfBins = this->m_NumberOfHistogramBins;
+  const double         binScale = ( numberOfBins > 0 )
+    ? numberOfBins / ( this->m_HistogramMaximum - this->m_HistogramMinimum ) : 0.0;
+  const float          histogramWeight = static_cast<float>( w );
+
+  RegionType rowStarts = slab;
+  rowStarts.SetSize(0, 1);
+  for( ImageRegionConstIteratorWithIndex<InputImageType> rowIt(str.Image, rowStarts); !rowIt.IsAtEnd(); ++rowIt )
+    {
+    const typename InputImageType::IndexType & rowIndex = rowIt.GetIndex();
+    const InputPixelType *                     in = str.Image->GetBufferPointer() + str.Image->ComputeOffset(rowIndex);
+    const OffsetValueType                      offset = this->m_Reference->ComputeOffset(rowIndex);
+    AccumulateType *                           sum = &this->m_Sum[offset];
+    AccumulateType *                           sumOfSquares = &this->m_SumOfSquares[offset];
+
+    if( compensated )
+      {
+      AccumulateType *sumC = &this->m_SumCompensation[offset];
+      AccumulateType *sumOfSquaresC = &this->m_SumOfSquaresCompensation[offset];
+      for( SizeValueType i = 0; i < rowLength; ++i )
+        {
+        const AccumulateType x = static_cast<AccumulateType>( in[i] );
+        const AccumulateType y = w * x - sumC[i];
+        const AccumulateType t = sum[i] + y;
+        sumC[i] = ( t - sum[i] ) - y;
+        sum[i] = t;
+
+        const AccumulateType y2 = w * x * x - sumOfSquaresC[i];
+        const AccumulateType t2 = sumOfSquares[i] + y2;
+        sumOfSquaresC[i] = ( t2 - sumOfSquares[i] ) - y2;
+        sumOfSquares[i] = t2;
+        }
+      }
+    else
+      {
+      for( SizeValueType i = 0; i < rowLength; ++i )
+        {
+        const AccumulateType x = static_cast<AccumulateType>( in[i] );
+        sum[i] += w * x;
+        sumOfSquares[i] += w * x * x;
+        }
+      }
+
+    if( numberOfBins > 0 )
+      {
+      // NaN is left out of the histograms; the position is clamped before
+      // the cast, which is undefined for values out of range
+      const double lastBin = numberOfBins - 1;
+      float *      histogram = &this->m_Histograms[offset * numberOfBins];
+      for( SizeValueType i = 0; i < rowLength; ++i, histogram += numberOfBins )
+        {
+        const double position = ( static_cast<double>( in[i] ) - this->m_HistogramMinimum ) * binScale;
+        if( vnl_math_isnan(position) )
+          {
+          continue;
+          }
+        const unsigned int bin = ( position <= 0.0 ) ? 0
+          : ( position >= lastBin ) ? numberOfBins - 1 : static_cast<unsigned int>( position );
+        histogram[bin] += histogramWeight;
+        }
+      }
+    }
+}
+
+template <typename TInputImage, typename TOutputImage, typename TAccumulate>
+void
+StreamingAverageImageAccumulator<TInputImage, TOutputImage, TAccumulate>
+::ThreadedResult(const ThreadStruct & str, const SizeValueType start, const SizeValueType end)
+{
+  const bool         compensated = !this->m_SumCompensation.empty();
+  const double       weightSum = this->m_WeightSum;
+  const unsigned int numberOfBins = this->m_NumberOfHistogramBins;
+  const double       binWidth = ( numberOfBins > 0 )
+    ? ( this->m_HistogramMaximum - this->m_HistogramMinimum ) / numberOfBins : 0.0;
+
+  for( SizeValueType p = start; p < end; ++p )
+    {
+    double value = 0.0;
+    switch( str.Stage )
+      {
+      case MEAN_STAGE:
+      case VARIANCE_STAGE:
+        {
+        if( weightSum == 0.0 )
+          {
+          break;
+          }
+        // The compensation terms hold the negated rounding error of the sums
+        const double sum = compensated
+          ? static_cast<double>( this->m_Sum[p] ) - static_cast<double>( this->m_SumCompensation[p] )
+          : static_cast<double>( this->m_Sum[p] );
+        const double mean = sum / weightSum;
+        if( str.Stage == MEAN_STAGE )
+          {
+          value = mean;
+          break;
+          }
+        const double sumOfSquares = compensated
+          ? static_cast<double>( this->m_SumOfSquares[p] ) - static_cast<double>( this->m_SumOfSquaresCompensation[p] )
+          : static_cast<double>( this->m_SumOfSquares[p] );
+        value = std::max(0.0, sumOfSquares / weightSum - mean * mean);
+        break;
+        }
+      case MEDIAN_STAGE:
+      case TRIMMED_MEAN_STAGE:
+        {
+        const float *histogram = &this->m_Histograms[p * numberOfBins];
+        double       total = 0.0;
+        for( unsigned int b = 0; b < numberOfBins; ++b )
+          {
+          total += histogram[b];
+          }
+        if( total <= 0.0 )
+          {
+          break;
+          }
+        if( str.Stage == MEDIAN_STAGE )
+          {
+          const double half = 0.5 * total;
+          double       cumulative = 0.0;
+          for( unsigned int b = 0; b < numberOfBins; ++b )
+            {
+            if( histogram[b] > 0.0F && cumulative + histogram[b] >= half )
+              {
+              value = this->m_HistogramMinimum + ( b + ( half - cumulative ) / histogram[b] ) * binWidth;
+              break;
+              }
+            cumulative += histogram[b];
+            }
+          break;
+          }
+        // Keep the weight between the lower and upper cut of each bin
+        const double lowerCut = str.TrimFraction * total;
+        const double upperCut = ( 1.0 - str.TrimFraction ) * total;
+        double       cumulative = 0.0;
+        double       keptSum = 0.0;
+        double       kept = 0.0;
+        for( unsigned int b = 0; b < numberOfBins && cumulative < upperCut; ++b )
+          {
+          const double binKept = std::min(cumulative + histogram[b], upperCut) - std::max(cumulative, lowerCut);
+          if( binKept > 0.0 )
+            {
+            keptSum += binKept * ( this->m_HistogramMinimum + ( b + 0.5 ) * binWidth );
+            kept += binKept;
+            }
+          cumulative += histogram[b];
+          }
+        value = ( kept > 0.0 ) ? keptSum / kept : 0.0;
+        break;
+        }
+      default:
+        break;
+      }
+    // instead of casting to output type, we should support rounding if the
+    // output type is an integer type, as noted in AverageImageFilter.
+    str.Output[p] = static_cast<OutputPixelType>( value );
+    }
+}
+
+template <typename TInputImage, typename TOutputImage, typename TAccumulate>
+typename StreamingAverageImageAccumulator<TInputImage, TOutputImage, TAccumulate>::OutputImagePointer
+StreamingAverageImageAccumulator<TInputImage, TOutputImage, TAccumulate>
+::ComputeResult(const StageType stage, const double trimFraction)
+{
+  if( this->m_Reference.IsNull() )
+    {
+    itkExceptionMacro(<< "No image has been added");
+    }
+  if( ( stage == MEDIAN_STAGE || stage == TRIMMED_MEAN_STAGE ) && this->m_Histograms.empty() )
+    {
+    itkExceptionMacro(<< "The median and trimmed mean need NumberOfHistogramBins to be set before adding images");
+    }
+  if( trimFraction < 0.0 || trimFraction >= 0.5 )
+    {
+    itkExceptionMacro(<< "Trim fraction " << trimFraction << " must be in [0, 0.5)");
+    }
+
+  OutputImagePointer result = OutputImageType::New();
+  result->CopyInformation(this->m_Reference);
+  result->SetRegions(this->m_Region);
+  result->Allocate();
+
+  ThreadStruct str;
+  str.Accumulator = this;
+  str.Stage = stage;
+  str.RangeSize = this->m_Region.GetNumberOfPixels();
+  str.Image = ITK_NULLPTR;
+  str.Region = this->m_Region;
+  str.Weight = NumericTraits<AccumulateType>::ZeroValue();
+  str.Output = result->GetBufferPointer();
+  str.TrimFraction = trimFraction;
+  this->ExecuteStage(str);
+  return result;
+}
+
+template <typename TInputImage, typename TOutputImage, typename TAccumulate>
+typename StreamingAverageImageAccumulator<TInputImage, TOutputImage, TAccumulate>::OutputImagePointer
+StreamingAverageImageAccumulator<TInputImage, TOutputImage, TAccumulate>
+::GetMeanImage()
+{
+  return this->ComputeResult(MEAN_STAGE, 0.0);
+}
+
+template <typename TInputImage, typename TOutputImage, typename TAccumulate>
+typename StreamingAverageImageAccumulator<TInputImage, TOutputImage, TAccumulate>::OutputImagePointer
+StreamingAverageImageAccumulator<TInputImage, TOutputImage, TAccumulate>
+::GetVarianceImage()
+{
+  return this->ComputeResult(VARIANCE_STAGE, 0.0);
+}
+
+template <typename TInputImage, typename TOutputImage, typename TAccumulate>
+typename StreamingAverageImageAccumulator<TInputImage, TOutputImage, TAccumulate>::OutputImagePointer
+StreamingAverageImageAccumulator<TInputImage, TOutputImage, TAccumulate>
+::GetMedianImage()
+{
+  return this->ComputeResult(MEDIAN_STAGE, 0.0);
+}
+
+template <typename TInputImage, typename TOutputImage, typename TAccumulate>
+typename StreamingAverageImageAccumulator<TInputImage, TOutputImage, TAccumulate>::OutputImagePointer
+StreamingAverageImageAccumulator<TInputImage, TOutputImage, TAccumulate>
+::GetTrimmedMeanImage(const double trimFraction)
+{
+  return this->ComputeResult(TRIMMED_MEAN_STAGE, trimFraction);
+}
+
+template <typename TInputImage, typename TOutputImage, typename TAccumulate>
+void
+StreamingAverageImageAccumulator<TInputImage, TOutputImage, TAccumulate>
+::PrintSelf(std::ostream& os, Indent indent) const
+{
+  Superclass::PrintSelf(os, indent);
+  os << indent << "UseCompensatedSummation: " << this->m_UseCompensatedSummation << std::endl;
+  os << indent << "NumberOfHistogramBins: " << this->m_NumberOfHistogramBins << std::endl;
+  os << indent << "HistogramMinimum: " << this->m_HistogramMinimum << std::endl;
+  os << indent << "HistogramMaximum: " << this->m_HistogramMaximum << std::endl;
+  os << indent << "NumberOfStreamDivisions: " << this->m_NumberOfStreamDivisions << std::endl;
+  os << indent << "NumberOfThreads: " << this->m_NumberOfThreads << std::endl;
+  os << indent << "NumberOfImages: " << this->m_NumberOfImages << std::endl;
+  os << indent << "WeightSum: " << this->m_WeightSum << std::endl;
+}
+
+} // end namespace itk
+
+#endif
@@ -16,7 +16,9 @@
  *  limitations under the License.
  *
  *=========================================================================*/
+#include <algorithm>
 #include <iostream>
+#include <vector>
 #include "itkImage.h"
 #include "itkImageFileReader.h"
 #include "itkImageFileWriter.h"
@@ -27,38 +29,149 @@
 #include "itkCastImageFilter.h"
 #include "itkFixedArray.h"
 #include "itkThresholdImageFilter.h"
-#include "itkImageDuplicator.h"
 #include "itkMaximumRatioDecisionRule.h"
 #include "itkVariableSizeMatrix.h"
 #include "itkConstrainedValueDifferenceImageFilter.h"
 #include "itkImageRegionConstIterator.h"
 #include "itkLabelStatisticsImageFilter.h"
+#include "itkMultiThreader.h"
 #include "linear.h"
 #include "LogisticRegression.h"
 #include "BRAINSContinuousClassCLP.h"
 #include <BRAINSCommonLib.h>
 
+namespace
+{
+const unsigned int Dimension = 3;
+const unsigned int featureCount = 2; // T1 and T2
+
+typedef itk::Image<unsigned int, Dimension> ShortImageType;
+
+const ShortImageType::PixelType grayMatterDiscreteValue = 2;
+const ShortImageType::PixelType basalGrayMatterDiscreteValue = 3;
+const ShortImageType::PixelType whiteMatterDiscreteValue = 1;
+const ShortImageType::PixelType csfDiscreteValue = 4;
+const ShortImageType::PixelType airDiscreteValue = 0;
+const ShortImageType::PixelType veinousBloodDiscreteValue = 5;
+const ShortImageType::PixelType allStandInDiscreteValue = 9;
+
+/* Voxels classified together by one thread */
+const size_t classificationBlockSize = 4096;
+
+template <class PixelType>
+struct ClassificationThreadStruct
+  {
+  const LogisticRegression<PixelType> *WhiteVsCSF;
+  const LogisticRegression<PixelType> *WhiteVsGray;
+  const LogisticRegression<PixelType> *GrayVsCSF;
+  const LogisticRegression<PixelType> *VeinousBloodVsAll;
+  const PixelType *                    T1;
+  const PixelType *                    T2;
+  const ShortImageType::PixelType *    Discrete;
+  PixelType *                          Output;
+  size_t                               NumberOfVoxels;
+  };
+
+/* Continuous class of one voxel from the pairwise class probabilities, each
+ * pair given as (first label, second label). */
+template <class PixelType>
+PixelType ContinuousClass(const ShortImageType::PixelType discretePixelValue,
+                          const double *whiteVsCSF, const double *whiteVsGray,
+                          const double *grayVsCSF, const double *veinousBloodVsAll)
+{
+  const PixelType outputAirPixelValue = 0;
+  const PixelType outputOtherPixelValue = 9;
+
+  if( discretePixelValue == airDiscreteValue )
+    {
+    return outputAirPixelValue;
+    }
+  if( whiteVsCSF[0] > whiteVsCSF[1] )
+    {
+    if( whiteVsGray[0] < whiteVsGray[1] )
+      {
+      if( grayVsCSF[0] < grayVsCSF[1] )
+        {
+        // Output voxel is other
+        return outputOtherPixelValue;
+        }
+      //// White is more likely, check for veinous blood?
+      if( veinousBloodVsAll[0] > veinousBloodVsAll[1] )
+        {
+        return outputOtherPixelValue;
+        }
+      // white vs gray
+      return static_cast<PixelType>(130 + (120 * whiteVsGray[0]) );
+      }
+    // White is more likely, check for veinous blood?
+    if( veinousBloodVsAll[0] < veinousBloodVsAll[1] )
+      {
+      return static_cast<PixelType>(veinousBloodVsAll[0] * 100);
+      }
+    // white vs gray
+    return static_cast<PixelType>(130 + 120 * whiteVsGray[0]);
+    }
+  if( grayVsCSF[0] < grayVsCSF[1] && whiteVsGray[0] > whiteVsGray[1] )
+    {
+    // Output voxel is other
+    return outputOtherPixelValue;
+    }
+  // CSF Vs Gray
+  return static_cast<PixelType>(10 + 120 * grayVsCSF[0]);
+}
+
+/* Classify a contiguous share of the voxels block by block, each model
+ * classifying a whole block at once. */
+template <class PixelType>
+ITK_THREAD_RETURN_TYPE ClassificationThreaderCallback(void *arg)
+{
+  itk::MultiThreader::ThreadInfoStruct * info = static_cast<itk::MultiThreader::ThreadInfoStruct *>(arg);
+  const ClassificationThreadStruct<PixelType> *str =
+    static_cast<const ClassificationThreadStruct<PixelType> *>(info->UserData);
+
+  const size_t chunk = ( str->NumberOfVoxels + info->NumberOfThreads - 1 ) / info->NumberOfThreads;
+  const size_t start = std::min(str->NumberOfVoxels, info->ThreadID * chunk);
+  const size_t end = std::min(str->NumberOfVoxels, start + chunk);
+
+  std::vector<double> probabilities(8 * classificationBlockSize);
+  double * const      whiteVsCSF = &probabilities[0];
+  double * const      whiteVsGray = whiteVsCSF + 2 * classificationBlockSize;
+  double * const      grayVsCSF = whiteVsGray + 2 * classificationBlockSize;
+  double * const      veinousBloodVsAll = grayVsCSF + 2 * classificationBlockSize;
+  for( size_t blockStart = start; blockStart < end; blockStart += classificationBlockSize )
+    {
+    const size_t           count = std::min(classificationBlockSize, end - blockStart);
+    const PixelType * const features[featureCount] = { str->T1 + blockStart, str->T2 + blockStart };
+
+    str->WhiteVsCSF->ClassifySamples(features, count, whiteVsCSF, whiteVsCSF + classificationBlockSize);
+    str->WhiteVsGray->ClassifySamples(features, count, whiteVsGray, whiteVsGray + classificationBlockSize);
+    str->GrayVsCSF->ClassifySamples(features, count, grayVsCSF, grayVsCSF + classificationBlockSize);
+    str->VeinousBloodVsAll->ClassifySamples(features, count, veinousBloodVsAll,
+                                            veinousBloodVsAll + classificationBlockSize);
+    for( size_t i = 0; i < count; ++i )
+      {
+      const double whiteVsCSFPair[2] = { whiteVsCSF[i], whiteVsCSF[classificationBlockSize + i] };
+      const double whiteVsGrayPair[2] = { whiteVsGray[i], whiteVsGray[classificationBlockSize + i] };
+      const double grayVsCSFPair[2] = { grayVsCSF[i], grayVsCSF[classificationBlockSize + i] };
+      const double veinousBloodVsAllPair[2] =
+        { veinousBloodVsAll[i], veinousBloodVsAll[classificationBlockSize + i] };
+      str->Output[blockStart + i] = ContinuousClass<PixelType>(str->Discrete[blockStart + i], whiteVsCSFPair,
+                                                               whiteVsGrayPair, grayVsCSFPair, veinousBloodVsAllPair);
+      }
+    }
+  return ITK_THREAD_RETURN_VALUE;
+}
+}
+
 template <class PixelType>
 int ContinuousClassification(std::string t1VolumeName, std::string T2VolumeName,
                              std::string discreteVolumeName, std::string outputVolumeName)
 {
-  // typedef float PixelType;
-  const unsigned int Dimension = 3;
-
   typedef typename itk::Image<PixelType,  Dimension>    ImageType;
-  typedef typename itk::Image<unsigned int, Dimension>  ShortImageType;
   typedef typename itk::ImageFileReader<ImageType>      ReaderType;
   typedef typename itk::ImageFileReader<ShortImageType> ShortReaderType;
   typedef typename itk::ImageFileWriter<ImageType>      WriterType;
 
-  static const typename ShortImageType::PixelType grayMatterDiscreteValue = 2;
-  static const typename ShortImageType::PixelType basalGrayMatterDiscreteValue = 3;
-  static const typename ShortImageType::PixelType whiteMatterDiscreteValue = 1;
-  static const typename ShortImageType::PixelType csfDiscreteValue = 4;
-  static const typename ShortImageType::PixelType airDiscreteValue = 0;
-  static const typename ShortImageType::PixelType veinousBloodDiscreteValue = 5;
-  static const typename ShortImageType::PixelType allStandInDiscreteValue = 9;
-
   typename ReaderType::Pointer t1Reader = ReaderType::New();
   typename ReaderType::Pointer t2Reader = ReaderType::New();
   typename ShortReaderType::Pointer discreteReader = ShortReaderType::New();
@@ -89,6 +202,18 @@ int ContinuousClassification(std::string t1VolumeName, std::string T2VolumeName,
     exit(1);
     }
 
+  // The samples are read straight from the buffers, voxel by voxel.
+  const typename ImageType::RegionType region = t1Volume->GetBufferedRegion();
+  if( t2Volume->GetBufferedRegion() != region || discreteVolume->GetBufferedRegion() != region )
+    {
+    std::cout << "ERROR: the T1, T2 and discrete volumes must have the same size" << std::endl;
+    exit(1);
+    }
+  const size_t                            numberOfVoxels = region.GetNumberOfPixels();
+  const PixelType * const                 t1Buffer = t1Volume->GetBufferPointer();
+  const PixelType * const                 t2Buffer = t2Volume->GetBufferPointer();
+  const ShortImageType::PixelType * const discreteBuffer = discreteVolume->GetBufferPointer();
+
   // Use the labelStatistics filter to count the number of voxels for each tissue type.
   // Need this for the logistic regression problem later.
 
@@ -103,7 +228,6 @@ int ContinuousClassification(std::string t1VolumeName, std::string T2VolumeName,
   const unsigned int csfSampleCount = labelStatisticsFilter->GetCount(csfDiscreteValue);
   const unsigned int veinousBloodSampleCount = labelStatisticsFilter->GetCount(veinousBloodDiscreteValue);
 
-  const unsigned int            featureCount = 2; // T1 and T2
   LogisticRegression<PixelType> logisticRegressionWhiteVsCSF = LogisticRegression<PixelType>(featureCount,
                                                                                              csfSampleCount
                                                                                              + whiteMatterSampleCount);
@@ -130,33 +254,19 @@ int ContinuousClassification(std::string t1VolumeName, std::string T2VolumeName,
   unsigned int whiteVsCSFSampleCount = 0;
   unsigned int veinousBloodVsAllSampleCount = 0;
 
-  typedef itk::ImageRegionConstIterator<ImageType> ImageRegionConstIteratorType;
-  ImageRegionConstIteratorType imgItr( t1Volume, t1Volume->GetRequestedRegion() );
-
-  LogisticRegressionSample<PixelType> tempSample = LogisticRegressionSample<PixelType>(featureCount);
-  std::vector<PixelType>              tempFeatures(featureCount);
-  for( imgItr.GoToBegin(); !imgItr.IsAtEnd(); ++imgItr )
+  PixelType tempFeatures[featureCount];
+  for( size_t i = 0; i < numberOfVoxels; ++i )
     {
-    const typename ImageType::IndexType idx = imgItr.GetIndex();
-    const typename ImageType::PixelType t1PixelValue = t1Volume->GetPixel(idx);
-    const typename ImageType::PixelType t2PixelValue = t2Volume->GetPixel(idx);
-    const typename ShortImageType::PixelType discretePixelValue = discreteVolume->GetPixel(idx);
+    const ShortImageType::PixelType discretePixelValue = discreteBuffer[i];
+    tempFeatures[0] = t1Buffer[i];
+    tempFeatures[1] = t2Buffer[i];
 
     if( discretePixelValue == grayMatterDiscreteValue || discretePixelValue == basalGrayMatterDiscreteValue )
       {
-      tempSample.SetLabel(grayMatterDiscreteValue);
-      tempFeatures[0] = t1PixelValue;
-      tempFeatures[1] = t2PixelValue;
-      tempSample.SetSample(tempFeatures);
-      logisticRegressionWhiteVsGray.AddLabeledSample(tempSample);
-
-      tempSample.SetLabel(grayMatterDiscreteValue);
-      tempSample.SetSample(tempFeatures);
-      logisticRegressionGrayVsCSF.AddLabeledSample(tempSample);
-
-      // tempSample.SetLabel(allStandInDiscreteValue);
-      // tempSample.SetSample(tempFeatures);
-      // logisticRegressionVeinousBloodVsAll.AddLabeledSample(tempSample);
+      logisticRegressionWhiteVsGray.AddLabeledSample(tempFeatures, grayMatterDiscreteValue);
+      logisticRegressionGrayVsCSF.AddLabeledSample(tempFeatures, grayMatterDiscreteValue);
+
+      // logisticRegressionVeinousBloodVsAll.AddLabeledSample(tempFeatures, allStandInDiscreteValue);
       // veinousBloodVsAllSampleCount++;
 
       whiteVsGraySampleCount++;
@@ -164,15 +274,8 @@ int ContinuousClassification(std::string t1VolumeName, std::string T2VolumeName,
       }
     else if( discretePixelValue == whiteMatterDiscreteValue )
       {
-      tempSample.SetLabel(whiteMatterDiscreteValue);
-      tempFeatures[0] = t1PixelValue;
-      tempFeatures[1] = t2PixelValue;
-      tempSample.SetSample(tempFeatures);
-      logisticRegressionWhiteVsGray.AddLabeledSample(tempSample);
-
-      tempSample.SetLabel(whiteMatterDiscreteValue);
-      tempSample.SetSample(tempFeatures);
-      logisticRegressionWhiteVsCSF.AddLabeledSample(tempSample);
+      logisticRegressionWhiteVsGray.AddLabeledSample(tempFeatures, whiteMatterDiscreteValue);
+      logisticRegressionWhiteVsCSF.AddLabeledSample(tempFeatures, whiteMatterDiscreteValue);
 
       veinousBloodVsAllSampleCount++;
       whiteVsGraySampleCount++;
@@ -180,19 +283,10 @@ int ContinuousClassification(std::string t1VolumeName, std::string T2VolumeName,
       }
     else if( discretePixelValue == csfDiscreteValue )
       {
-      tempSample.SetLabel(csfDiscreteValue);
-      tempFeatures[0] = t1PixelValue;
-      tempFeatures[1] = t2PixelValue;
-      tempSample.SetSample(tempFeatures);
-      logisticRegressionGrayVsCSF.AddLabeledSample(tempSample);
-
-      tempSample.SetLabel(csfDiscreteValue);
-      tempSample.SetSample(tempFeatures);
-      logisticRegressionWhiteVsCSF.AddLabeledSample(tempSample);
-
-      // tempSample.SetLabel(allStandInDiscreteValue);
-      // tempSample.SetSample(tempFeatures);
-      // logisticRegressionVeinousBloodVsAll.AddLabeledSample(tempSample);
+      logisticRegressionGrayVsCSF.AddLabeledSample(tempFeatures, csfDiscreteValue);
+      logisticRegressionWhiteVsCSF.AddLabeledSample(tempFeatures, csfDiscreteValue);
+
+      // logisticRegressionVeinousBloodVsAll.AddLabeledSample(tempFeatures, allStandInDiscreteValue);
       // veinousBloodVsAllSampleCount++;
 
       csfVsGraySampleCount++;
@@ -200,11 +294,7 @@ int ContinuousClassification(std::string t1VolumeName, std::string T2VolumeName,
       }
     else if( discretePixelValue == veinousBloodDiscreteValue )
       {
-      tempSample.SetLabel(veinousBloodDiscreteValue);
-      tempFeatures[0] = t1PixelValue;
-      tempFeatures[1] = t2PixelValue;
-      tempSample.SetSample(tempFeatures);
-      logisticRegressionVeinousBloodVsAll.AddLabeledSample(tempSample);
+      logisticRegressionVeinousBloodVsAll.AddLabeledSample(tempFeatures, veinousBloodDiscreteValue);
 
       veinousBloodVsAllSampleCount++;
       }
@@ -215,115 +305,30 @@ int ContinuousClassification(std::string t1VolumeName, std::string T2VolumeName,
   logisticRegressionWhiteVsGray.TrainModel();
   logisticRegressionVeinousBloodVsAll.TrainModel();
 
-  typedef typename itk::ImageDuplicator<ImageType> ImageDuplicatorType;
-  typename ImageDuplicatorType::Pointer t1DuplicateImageFilter = ImageDuplicatorType::New();
-  t1DuplicateImageFilter->SetInputImage(t1Reader->GetOutput() );
-  t1DuplicateImageFilter->Update();
-  typename ImageType::Pointer outputImage = t1DuplicateImageFilter->GetModifiableOutput();
-
-  double predictedProbabilityEstimatesWhiteVsGray[2];
-  double predictedProbabilityEstimatesWhiteVsCSF[2];
-  double predictedProbabilityEstimatesGrayVsCSF[2];
-  double predictedProbabilityEstimatesVeinousBloodVsAll[2];
-
-  typename ImageType::PixelType outputAirPixelValue = 0;
-  typename ImageType::PixelType outputOtherPixelValue = 9;
-  typename ImageType::PixelType predictedOutputPixelValue = outputAirPixelValue;
-  for( imgItr.GoToBegin(); !imgItr.IsAtEnd(); ++imgItr )
-    {
-    const typename ImageType::IndexType idx = imgItr.GetIndex();
-    const typename ImageType::PixelType t1PixelValue = t1Reader->GetOutput()->GetPixel(idx);
-    const typename ImageType::PixelType t2PixelValue = t2Reader->GetOutput()->GetPixel(idx);
-    const typename ShortImageType::PixelType discretePixelValue = discreteVolume->GetPixel(idx);
-
-    tempFeatures[0] = t1PixelValue;
-    tempFeatures[1] = t2PixelValue;
-    tempSample.SetSample(tempFeatures);
-    logisticRegressionWhiteVsCSF.ClassifySample(tempSample);
-    predictedProbabilityEstimatesWhiteVsCSF[0] = tempSample.GetLabelProbability(whiteMatterDiscreteValue);
-    predictedProbabilityEstimatesWhiteVsCSF[1] = tempSample.GetLabelProbability(csfDiscreteValue);
-
-    logisticRegressionWhiteVsGray.ClassifySample(tempSample);
-    predictedProbabilityEstimatesWhiteVsGray[0] = tempSample.GetLabelProbability(whiteMatterDiscreteValue);
-    predictedProbabilityEstimatesWhiteVsGray[1] = tempSample.GetLabelProbability(grayMatterDiscreteValue);
-
-    logisticRegressionGrayVsCSF.ClassifySample(tempSample);
-    predictedProbabilityEstimatesGrayVsCSF[0] = tempSample.GetLabelProbability(grayMatterDiscreteValue);
-    predictedProbabilityEstimatesGrayVsCSF[1] = tempSample.GetLabelProbability(csfDiscreteValue);
-
-    logisticRegressionVeinousBloodVsAll.ClassifySample(tempSample);
-    predictedProbabilityEstimatesVeinousBloodVsAll[0] = tempSample.GetLabelProbability(veinousBloodDiscreteValue);
-    predictedProbabilityEstimatesVeinousBloodVsAll[1] = tempSample.GetLabelProbability(allStandInDiscreteValue);
-
-    if( discretePixelValue == airDiscreteValue )
-      {
-      predictedOutputPixelValue = outputAirPixelValue;
-      }
-    else if( predictedProbabilityEstimatesWhiteVsCSF[0] > predictedProbabilityEstimatesWhiteVsCSF[1] )
-      {
-      if( predictedProbabilityEstimatesWhiteVsGray[0] < predictedProbabilityEstimatesWhiteVsGray[1] )
-        {
-        if( predictedProbabilityEstimatesGrayVsCSF[0] < predictedProbabilityEstimatesGrayVsCSF[1] )
-          {
-          // Output voxel is other
-          predictedOutputPixelValue = outputOtherPixelValue;
-          }
-        else
-          {
-          //// White is more likely, check for veinous blood?
-          if( predictedProbabilityEstimatesVeinousBloodVsAll[0] > predictedProbabilityEstimatesVeinousBloodVsAll[1] )
-            {
-            predictedOutputPixelValue = outputOtherPixelValue;
-            }
-          else
-            {
-            // white vs gray
-            predictedOutputPixelValue =
-              static_cast<typename ImageType::PixelType>(130 + (120 * predictedProbabilityEstimatesWhiteVsGray[0]) );
-            }
-          }
-        }
-      else
-        {
-        // White is more likely, check for veinous blood?
-        if( predictedProbabilityEstimatesVeinousBloodVsAll[0] < predictedProbabilityEstimatesVeinousBloodVsAll[1] )
-          {
-          predictedOutputPixelValue = predictedProbabilityEstimatesVeinousBloodVsAll[0] * 100;
-          }
-        else
-          {
-          // white vs gray
-          predictedOutputPixelValue =
-            static_cast<typename ImageType::PixelType>(130 + 120 * predictedProbabilityEstimatesWhiteVsGray[0]);
-          }
-        }
-      }
-    else
-      {
-      if( predictedProbabilityEstimatesGrayVsCSF[0] < predictedProbabilityEstimatesGrayVsCSF[1] )
-        {
-        if( predictedProbabilityEstimatesWhiteVsGray[0] > predictedProbabilityEstimatesWhiteVsGray[1] )
-          {
-          // Output voxel is other
-          predictedOutputPixelValue = outputOtherPixelValue;
-          }
-        else
-          {
-          // CSF Vs Gray
-          predictedOutputPixelValue =
-            static_cast<typename ImageType::PixelType>(10 + 120 * predictedProbabilityEstimatesGrayVsCSF[0]);
-          }
-        }
-      else
-        {
-        // CSF Vs Gray
-        predictedOutputPixelValue =
-          static_cast<typename ImageType::PixelType>(10 + 120 * predictedProbabilityEstimatesGrayVsCSF[0]);
-        }
-      }
+  typename ImageType::Pointer outputImage = ImageType::New();
+  outputImage->CopyInformation(t1Volume);
+  outputImage->SetRegions(region);
+  outputImage->Allocate();
+
+  ClassificationThreadStruct<PixelType> str;
+  str.WhiteVsCSF = &logisticRegressionWhiteVsCSF;
+  str.WhiteVsGray = &logisticRegressionWhiteVsGray;
+  str.GrayVsCSF = &logisticRegressionGrayVsCSF;
+  str.VeinousBloodVsAll = &logisticRegressionVeinousBloodVsAll;
+  str.T1 = t1Buffer;
+  str.T2 = t2Buffer;
+  str.Discrete = discreteBuffer;
+  str.Output = outputImage->GetBufferPointer();
+  str.NumberOfVoxels = numberOfVoxels;
+
+  const size_t numberOfBlocks = ( numberOfVoxels + classificationBlockSize - 1 ) / classificationBlockSize;
+  itk::MultiThreader::Pointer threader = itk::MultiThreader::New();
+  threader->SetNumberOfThreads(
+    static_cast<itk::ThreadIdType>(std::max<size_t>(1, std::min<size_t>(threader->GetNumberOfThreads(),
+                                                                        numberOfBlocks) ) ) );
+  threader->SetSingleMethod(ClassificationThreaderCallback<PixelType>, &str);
+  threader->SingleMethodExecute();
 
-    outputImage->SetPixel(idx, predictedOutputPixelValue);
-    }
   std::cerr << "whiteVsGraySampleCount " << whiteVsGraySampleCount
             << " csfVsGraySampleCount " << csfVsGraySampleCount
             << " whiteVsCSFSampleCount " << whiteVsCSFSampleCount
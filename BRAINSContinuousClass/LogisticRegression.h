@@ -59,23 +59,26 @@ template <typename TSampleType>
 class LogisticRegression
 {
 private:
-  unsigned int          m_sampleCount;
-  unsigned int          m_totalSamples;
-  struct parameter      m_parameters;
-  struct problem        m_problem;
-  struct model *        m_model;
-  struct feature_node * m_featureNodes;
-  unsigned int          m_featureCount;
-  unsigned int          m_classOneLabel;
-  unsigned int          m_classTwoLabel;
-  bool                  m_classOneLabelSet;
-  bool                  m_classTwoLabelSet;
+  unsigned int        m_sampleCount;
+  unsigned int        m_totalSamples;
+  struct parameter    m_parameters;
+  struct model *      m_model;
+  unsigned int        m_featureCount;
+  std::vector<double> m_features; // m_totalSamples rows of m_featureCount values
+  std::vector<int>    m_labels;
+  unsigned int        m_classOneLabel;
+  unsigned int        m_classTwoLabel;
+  bool                m_classOneLabelSet;
+  bool                m_classTwoLabelSet;
 public:
   LogisticRegression(const unsigned int featureCount, const unsigned int sampleCount);
   LogisticRegression(const LogisticRegression & LR);
   ~LogisticRegression();
   void AddLabeledSample(LogisticRegressionSample<TSampleType> const & );
 
+  /** Add a sample given as featureCount consecutive values */
+  void AddLabeledSample(const TSampleType * features, const unsigned int label);
+
   void TrainModel();
 
   void SetClassOneLabel(const unsigned int);
@@ -83,6 +86,12 @@ public:
   void SetClassTwoLabel(const unsigned int);
 
   void ClassifySample(LogisticRegressionSample<TSampleType> &);
+
+  /** Probabilities of the class one and class two labels of count samples.
+   * features[f] points to the count values of feature f.  Thread safe once
+   * the model is trained. */
+  void ClassifySamples(const TSampleType * const * features, const size_t count,
+                       double * classOneProbability, double * classTwoProbability) const;
 };
 #include "LogisticRegression.hxx"
 #endif
@@ -18,6 +18,8 @@
  *=========================================================================*/
 #include "LogisticRegression.h"
 #include "linear.h"
+#include <cassert>
+#include <cmath>
 #include <map>
 #include <vector>
 
@@ -76,60 +78,53 @@ void LogisticRegressionSample<TSampleType>::SetLabel(unsigned int const & label)
 
 template <typename TSampleType>
 LogisticRegression<TSampleType>::LogisticRegression(const unsigned int featureCount, const unsigned int totalSamples) :
+  m_sampleCount(0),
   m_totalSamples(totalSamples),
+  m_model(ITK_NULLPTR),
   m_featureCount(featureCount),
+  m_features(static_cast<size_t>(totalSamples) * featureCount),
+  m_labels(totalSamples),
   m_classOneLabel(0),
   m_classTwoLabel(0),
   m_classOneLabelSet(false),
   m_classTwoLabelSet(false)
 {
-  this->m_sampleCount = 0;
   this->m_parameters.solver_type = L1R_LR;
   this->m_parameters.C = 1;
   this->m_parameters.eps = 0.01;
   this->m_parameters.nr_weight = 0;
   this->m_parameters.weight_label = ITK_NULLPTR;
   this->m_parameters.weight = ITK_NULLPTR;
-  this->m_problem.bias = 1;
-  this->m_problem.n = this->m_problem.bias + this->m_featureCount;
-  this->m_problem.l = this->m_totalSamples;
-  this->m_problem.y = new int[totalSamples];
-  this->m_problem.x = new struct feature_node *[this->m_problem.l];
-  this->m_featureNodes = new struct feature_node[this->m_problem.n * this->m_problem.l];
-  this->m_model = ITK_NULLPTR;
 }
 
 template <typename TSampleType>
 LogisticRegression<TSampleType>::LogisticRegression(const LogisticRegression & LR) :
+  m_sampleCount(0),
   m_totalSamples(LR.m_totalSamples),
+  m_model(ITK_NULLPTR),
   m_featureCount(LR.m_featureCount),
+  m_features(static_cast<size_t>(LR.m_totalSamples) * LR.m_featureCount),
+  m_labels(LR.m_totalSamples),
   m_classOneLabel(0),
   m_classTwoLabel(0),
   m_classOneLabelSet(false),
   m_classTwoLabelSet(false)
 {
-  this->m_sampleCount = 0;
   this->m_parameters.solver_type = L1R_LR;
   this->m_parameters.C = 1;
   this->m_parameters.eps = 0.01;
   this->m_parameters.nr_weight = 0;
   this->m_parameters.weight_label = ITK_NULLPTR;
   this->m_parameters.weight = ITK_NULLPTR;
-  this->m_problem.bias = 1;
-  this->m_problem.n = LR.m_problem.bias + LR.m_featureCount;
-  this->m_problem.l = LR.m_totalSamples;
-  this->m_problem.y = new int[LR.m_totalSamples];
-  this->m_problem.x = new struct feature_node *[LR.m_problem.l];
-  this->m_featureNodes = new struct feature_node[LR.m_problem.n * LR.m_problem.l];
-  this->m_model = ITK_NULLPTR;
 }
 
 template <typename TSampleType>
 LogisticRegression<TSampleType>::~LogisticRegression()
 {
-  delete this->m_problem.y;
-  delete this->m_problem.x;
-  delete this->m_featureNodes;
+  if( this->m_model != ITK_NULLPTR )
+    {
+    free_and_destroy_model(&this->m_model);
+    }
   destroy_param(&this->m_parameters);
 }
 
@@ -139,19 +134,22 @@ void LogisticRegression<TSampleType>::AddLabeledSample(LogisticRegressionSample<
   assert(labeledSample.LabelIsSet() );
 
   std::vector<TSampleType> const * const samples = labeledSample.GetSample();
+  assert(samples->size() >= this->m_featureCount);
+
+  this->AddLabeledSample(&( *samples )[0], labeledSample.GetLabel() );
+}
 
-  struct feature_node * currentNode;
+template <typename TSampleType>
+void LogisticRegression<TSampleType>::AddLabeledSample(const TSampleType * features, const unsigned int label)
+{
+  assert(this->m_sampleCount < this->m_totalSamples);
 
-  this->m_problem.x[this->m_sampleCount] = &this->m_featureNodes[this->m_problem.n * this->m_sampleCount];
-  this->m_problem.y[this->m_sampleCount]  = labeledSample.GetLabel();
-  for( unsigned int i = 0; i < samples->size(); ++i )
+  double * const row = &this->m_features[static_cast<size_t>(this->m_sampleCount) * this->m_featureCount];
+  for( unsigned int i = 0; i < this->m_featureCount; ++i )
     {
-    currentNode = &this->m_featureNodes[this->m_problem.n * this->m_sampleCount + i];
-    currentNode->index = i + 1;
-    currentNode->value = samples->at(i);
+    row[i] = features[i];
     }
-  currentNode = &this->m_featureNodes[this->m_problem.n * this->m_sampleCount + samples->size()];
-  currentNode->index = -1;
+  this->m_labels[this->m_sampleCount] = label;
 
   this->m_sampleCount++;
 }
@@ -160,13 +158,23 @@ template <typename TSampleType>
 void LogisticRegression<TSampleType>::TrainModel()
 {
   assert(this->m_totalSamples >= this->m_sampleCount);
-  if( this->m_totalSamples > this->m_sampleCount )
+
+  // The bias only widens the weight vector, no bias feature is added to the
+  // samples, as in the sparse problem this class used to build.
+  struct dense_problem problem;
+  problem.bias = 1;
+  problem.n = static_cast<int>(problem.bias + this->m_featureCount);
+  problem.l = this->m_sampleCount;
+  problem.y = this->m_labels.empty() ? ITK_NULLPTR : &this->m_labels[0];
+  problem.x = this->m_features.empty() ? ITK_NULLPTR : &this->m_features[0];
+  problem.nr_column = this->m_featureCount;
+
+  if( this->m_model != ITK_NULLPTR )
     {
-    m_problem.l = m_sampleCount;
+    free_and_destroy_model(&this->m_model);
     }
-  this->m_model = train(&this->m_problem, &this->m_parameters);
+  this->m_model = train_dense(&problem, &this->m_parameters);
 }
-
 template <typename TSampleType>
 void LogisticRegression<TSampleType>::SetClassOneLabel(const unsigned int classLabel)
 {
@@ -188,27 +196,57 @@ void LogisticRegression<TSampleType>::ClassifySample(LogisticRegressionSample<TS
   assert(this->m_classTwoLabelSet && this->m_classOneLabelSet);
 
   std::vector<TSampleType> const * const samples = labeledSample.GetSample();
-  struct feature_node *                  sampleToPredict = new struct feature_node[this->m_problem.n];
-  for( unsigned int i = 0; i < samples->size(); ++i )
+  std::vector<const TSampleType *>       features(this->m_featureCount);
+  for( unsigned int i = 0; i < this->m_featureCount; ++i )
     {
-    sampleToPredict[i].index = i + 1;
-    sampleToPredict[i].value = samples->at(i);
+    features[i] = &( *samples )[i];
     }
-  sampleToPredict[samples->size()].index = -1;
 
-  double predictedProbabilities[2];
-  predict_probability(this->m_model, sampleToPredict, predictedProbabilities);
+  double classOneProbability;
+  double classTwoProbability;
+  this->ClassifySamples(&features[0], 1, &classOneProbability, &classTwoProbability);
 
-  if( this->m_classOneLabel > this->m_classTwoLabel )
-    {
-    labeledSample.SetLabelProbability(this->m_classOneLabel, predictedProbabilities[1]);
-    labeledSample.SetLabelProbability(this->m_classTwoLabel, predictedProbabilities[0]);
-    }
-  else
+  labeledSample.SetLabelProbability(this->m_classOneLabel, classOneProbability);
+  labeledSample.SetLabelProbability(this->m_classTwoLabel, classTwoProbability);
+}
+
+template <typename TSampleType>
+void LogisticRegression<TSampleType>::ClassifySamples(const TSampleType * const * features, const size_t count,
+                                                      double * classOneProbability, double * classTwoProbability) const
+{
+  assert(this->m_classTwoLabelSet && this->m_classOneLabelSet);
+  assert(this->m_model != ITK_NULLPTR);
+
+  // Same decision values as predict_probability(): the weights of the
+  // training features in feature order, then the logistic function.  With
+  // two classes liblinear keeps one weight vector; a single class model
+  // (e.g. the veinous blood model trained only on positive samples) always
+  // predicts its class.
+  const int nr_class = this->m_model->nr_class;
+  assert(nr_class <= 2);
+  const int      nr_w = ( nr_class == 2 ) ? 1 : nr_class;
+  const double * w = this->m_model->w;
+  // The first probability goes to the smaller of the two class labels.
+  const bool classOneIsSecond = this->m_classOneLabel > this->m_classTwoLabel;
+
+  for( size_t s = 0; s < count; ++s )
     {
-    labeledSample.SetLabelProbability(this->m_classOneLabel, predictedProbabilities[0]);
-    labeledSample.SetLabelProbability(this->m_classTwoLabel, predictedProbabilities[1]);
+    double dec = 0;
+    for( unsigned int f = 0; f < this->m_featureCount; ++f )
+      {
+      dec += w[f * nr_w] * static_cast<double>(features[f][s]);
+      }
+    const double firstProbability = ( nr_class == 2 ) ? 1 / ( 1 + exp(-dec) ) : 1.0;
+    const double secondProbability = 1. - firstProbability;
+    if( classOneIsSecond )
+      {
+      classOneProbability[s] = secondProbability;
+      classTwoProbability[s] = firstProbability;
+      }
+    else
+      {
+      classOneProbability[s] = firstProbability;
+      classTwoProbability[s] = secondProbability;
+      }
     }
-
-  delete [] sampleToPredict;
 }
@@ -1629,6 +1629,155 @@ static void solve_l1r_l2_svc(
   delete [] xj_sq;
 }
 
+// Column access for the solvers on column format data: the problem
+// transposed to sparse columns, or a dense column major matrix.
+class sparse_column
+{
+public:
+  sparse_column() : x(ITK_NULLPTR)
+  {
+  }
+
+  explicit sparse_column(const feature_node *column) : x(column)
+  {
+  }
+
+  bool valid() const
+  {
+    return x->index != -1;
+  }
+
+  int index() const
+  {
+    return x->index - 1;
+  }
+
+  double value() const
+  {
+    return x->value;
+  }
+
+  void next()
+  {
+    ++x;
+  }
+
+private:
+  const feature_node *x;
+};
+
+class sparse_columns
+{
+public:
+  typedef sparse_column column_type;
+  explicit sparse_columns(const problem *prob_col) : m_prob_col(prob_col)
+  {
+  }
+
+  int l() const
+  {
+    return m_prob_col->l;
+  }
+
+  int n() const
+  {
+    return m_prob_col->n;
+  }
+
+  const int * y() const
+  {
+    return m_prob_col->y;
+  }
+
+  column_type column(int j) const
+  {
+    return column_type(m_prob_col->x[j]);
+  }
+
+private:
+  const problem *m_prob_col;
+};
+
+class dense_column
+{
+public:
+  dense_column() : x(ITK_NULLPTR), i(0), l(0)
+  {
+  }
+
+  dense_column(const double *column, int length) : x(column), i(0), l(length)
+  {
+  }
+
+  bool valid() const
+  {
+    return i < l;
+  }
+
+  int index() const
+  {
+    return i;
+  }
+
+  double value() const
+  {
+    return x[i];
+  }
+
+  void next()
+  {
+    ++i;
+  }
+
+private:
+  const double *x;
+  int           i;
+  int           l;
+};
+
+// l rows and n columns, of which the first nr_column are stored column
+// after column in x_col and the others are zero.
+class dense_columns
+{
+public:
+  typedef dense_column column_type;
+  dense_columns(const double *x_col, int l, int n, int nr_column, const int *y) :
+    m_x_col(x_col), m_l(l), m_n(n), m_nr_column(nr_column), m_y(y)
+  {
+  }
+
+  int l() const
+  {
+    return m_l;
+  }
+
+  int n() const
+  {
+    return m_n;
+  }
+
+  const int * y() const
+  {
+    return m_y;
+  }
+
+  column_type column(int j) const
+  {
+    if( j < m_nr_column )
+      {
+      return column_type(m_x_col + static_cast<size_t>( j ) * m_l, m_l);
+      }
+    return column_type(m_x_col, 0);
+  }
+
+private:
+  const double *m_x_col;
+  int           m_l;
+  int           m_n;
+  int           m_nr_column;
+  const int *   m_y;
+};
+
 // A coordinate descent algorithm for
 // L1-regularized logistic regression problems
 //
@@ -1646,12 +1795,13 @@ static void solve_l1r_l2_svc(
 #define GETI(i) (y[i] + 1)
 // To support weights for instances, use GETI(i) (i)
 
+template <class Columns>
 static void solve_l1r_lr(
-  const problem *prob_col, double *w, double eps,
+  const Columns & prob_col, double *w, double eps,
   double Cp, double Cn)
 {
-  int l = prob_col->l;
-  int w_size = prob_col->n;
+  int l = prob_col.l();
+  int w_size = prob_col.n();
   int j, s, newton_iter = 0, iter = 0;
   int max_newton_iter = 100;
   int max_iter = 1000;
@@ -1682,13 +1832,13 @@ static void solve_l1r_lr(
   double *      exp_wTx_new = new double[l];
   double *      tau = new double[l];
   double *      D = new double[l];
-  feature_node *x;
+  typename Columns::column_type x;
 
   double C[3] = {Cn, 0, Cp};
 
   for( j = 0; j < l; j++ )
     {
-    if( prob_col->y[j] > 0 )
+    if( prob_col.y()[j] > 0 )
       {
       y[j] = 1;
       }
@@ -1708,15 +1858,15 @@ static void solve_l1r_lr(
     wpd[j] = w[j];
     index[j] = j;
     xjneg_sum[j] = 0;
-    x = prob_col->x[j];
-    while( x->index != -1 )
+    x = prob_col.column(j);
+    while( x.valid() )
       {
-      int ind = x->index - 1;
+      int ind = x.index();
       if( y[ind] == -1 )
         {
-        xjneg_sum[j] += C[GETI(ind)] * x->value;
+        xjneg_sum[j] += C[GETI(ind)] * x.value();
         }
-      x++;
+      x.next();
       }
     }
 
@@ -1732,13 +1882,13 @@ static void solve_l1r_lr(
       Grad[j] = 0;
 
       double tmp = 0;
-      x = prob_col->x[j];
-      while( x->index != -1 )
+      x = prob_col.column(j);
+      while( x.valid() )
         {
-        int ind = x->index - 1;
-        Hdiag[j] += x->value * x->value * D[ind];
-        tmp += x->value * tau[ind];
-        x++;
+        int ind = x.index();
+        Hdiag[j] += x.value() * x.value() * D[ind];
+        tmp += x.value() * tau[ind];
+        x.next();
         }
 
       Grad[j] = -tmp + xjneg_sum[j];
@@ -1812,13 +1962,13 @@ static void solve_l1r_lr(
         j = index[s];
         H = Hdiag[j];
 
-        x = prob_col->x[j];
+        x = prob_col.column(j);
         G = Grad[j] + (wpd[j] - w[j]) * nu;
-        while( x->index != -1 )
+        while( x.valid() )
           {
-          int ind = x->index - 1;
-          G += x->value * D[ind] * xTd[ind];
-          x++;
+          int ind = x.index();
+          G += x.value() * D[ind] * xTd[ind];
+          x.next();
           }
 
         double Gp = G + 1;
@@ -1877,12 +2027,12 @@ static void solve_l1r_lr(
 
         wpd[j] += z;
 
-        x = prob_col->x[j];
-        while( x->index != -1 )
+        x = prob_col.column(j);
+        while( x.valid() )
           {
-          int ind = x->index - 1;
-          xTd[ind] += x->value * z;
-          x++;
+          int ind = x.index();
+          xTd[ind] += x.value() * z;
+          x.next();
           }
         }
 
@@ -1992,11 +2142,11 @@ static void solve_l1r_lr(
           {
           continue;
           }
-        x = prob_col->x[i];
-        while( x->index != -1 )
+        x = prob_col.column(i);
+        while( x.valid() )
           {
-          exp_wTx[x->index - 1] += w[i] * x->value;
-          x++;
+          exp_wTx[x.index()] += w[i] * x.value();
+          x.next();
           }
         }
       for( int i = 0; i < l; i++ )
@@ -2249,7 +2399,7 @@ static void train_one(const problem *prob, const parameter *param, double *w, do
       problem       prob_col;
       feature_node *x_space = ITK_NULLPTR;
       transpose(prob, &x_space, &prob_col);
-      solve_l1r_lr(&prob_col, w, eps * min(pos, neg) / prob->l, Cp, Cn);
+      solve_l1r_lr(sparse_columns(&prob_col), w, eps * min(pos, neg) / prob->l, Cp, Cn);
       delete [] prob_col.y;
       delete [] prob_col.x;
       delete [] x_space;
@@ -2422,6 +2572,153 @@ model * train(const problem *prob, const parameter *param)
   return model_;
 }
 
+model * train_dense(const dense_problem *prob, const parameter *param)
+{
+  int       i, j;
+  const int l = prob->l;
+  const int n = prob->n;
+  const int nr_column = prob->nr_column;
+
+  if( param->solver_type != L1R_LR )
+    {
+    // Only the L1-regularized logistic regression has a dense solver, the
+    // other solvers train on the sparse representation.
+    feature_node * x_space = new feature_node[static_cast<size_t>( l ) * ( nr_column + 1 )];
+    feature_node * *x = new feature_node *[l];
+    for( i = 0; i < l; i++ )
+      {
+      x[i] = &x_space[static_cast<size_t>( i ) * ( nr_column + 1 )];
+      for( j = 0; j < nr_column; j++ )
+        {
+        x[i][j].index = j + 1;
+        x[i][j].value = prob->x[static_cast<size_t>( i ) * nr_column + j];
+        }
+      x[i][nr_column].index = -1;
+      }
+    problem sparse_prob;
+    sparse_prob.l = l;
+    sparse_prob.n = n;
+    sparse_prob.y = prob->y;
+    sparse_prob.x = x;
+    sparse_prob.bias = prob->bias;
+    model *model_ = train(&sparse_prob, param);
+    delete [] x;
+    delete [] x_space;
+    return model_;
+    }
+
+  // Same steps as train() for the L1R_LR solver, with the columns of the
+  // permuted samples stored densely instead of transposed feature nodes.
+  model *model_ = Malloc(model, 1);
+  if( prob->bias >= 0 )
+    {
+    model_->nr_feature = n - 1;
+    }
+  else
+    {
+    model_->nr_feature = n;
+    }
+  model_->param = *param;
+  model_->bias = prob->bias;
+
+  int  nr_class;
+  int *label = ITK_NULLPTR;
+  int *start = ITK_NULLPTR;
+  int *count = ITK_NULLPTR;
+  int *perm = Malloc(int, l);
+
+  problem labels_prob;
+  labels_prob.l = l;
+  labels_prob.n = n;
+  labels_prob.y = prob->y;
+  labels_prob.x = ITK_NULLPTR;
+  labels_prob.bias = prob->bias;
+  group_classes(&labels_prob, &nr_class, &label, &start, &count, perm);
+
+  model_->nr_class = nr_class;
+  model_->label = Malloc(int, nr_class);
+  for( i = 0; i < nr_class; i++ )
+    {
+    model_->label[i] = label[i];
+    }
+
+  double *weighted_C = Malloc(double, nr_class);
+  for( i = 0; i < nr_class; i++ )
+    {
+    weighted_C[i] = param->C;
+    }
+  for( i = 0; i < param->nr_weight; i++ )
+    {
+    for( j = 0; j < nr_class; j++ )
+      {
+      if( param->weight_label[i] == label[j] )
+        {
+        break;
+        }
+      }
+    if( j == nr_class )
+      {
+      fprintf(stderr, "WARNING: class label %d specified in weight is not found\n", param->weight_label[i]);
+      }
+    else
+      {
+      weighted_C[j] *= param->weight[i];
+      }
+    }
+
+  double *x_col = new double[static_cast<size_t>( l ) * nr_column];
+  for( i = 0; i < l; i++ )
+    {
+    const double *row = prob->x + static_cast<size_t>( perm[i] ) * nr_column;
+    for( j = 0; j < nr_column; j++ )
+      {
+      x_col[static_cast<size_t>( j ) * l + i] = row[j];
+      }
+    }
+  int *               sub_y = Malloc(int, l);
+  const dense_columns columns(x_col, l, n, nr_column, sub_y);
+
+  if( nr_class == 2 )
+    {
+    model_->w = Malloc(double, n);
+    const int e0 = start[0] + count[0];
+    for( i = 0; i < l; i++ )
+      {
+      sub_y[i] = ( i < e0 ) ? +1 : -1;
+      }
+    solve_l1r_lr(columns, model_->w, param->eps * min(count[0], l - count[0]) / l, weighted_C[0], weighted_C[1]);
+    }
+  else
+    {
+    model_->w = Malloc(double, n * nr_class);
+    double *w = Malloc(double, n);
+    for( int c = 0; c < nr_class; c++ )
+      {
+      const int si = start[c];
+      const int ei = si + count[c];
+      for( i = 0; i < l; i++ )
+        {
+        sub_y[i] = ( i >= si && i < ei ) ? +1 : -1;
+        }
+      solve_l1r_lr(columns, w, param->eps * min(count[c], l - count[c]) / l, weighted_C[c], param->C);
+      for( j = 0; j < n; j++ )
+        {
+        model_->w[j * nr_class + c] = w[j];
+        }
+      }
+    free(w);
+    }
+
+  delete [] x_col;
+  free(sub_y);
+  free(label);
+  free(start);
+  free(count);
+  free(perm);
+  free(weighted_C);
+  return model_;
+}
+
 void cross_validation(const problem *prob, const parameter *param, int nr_fold, int *target)
 {
   int  i;
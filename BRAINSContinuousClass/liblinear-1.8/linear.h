@@ -42,6 +42,17 @@ enum { L2R_LR, L2R_L2LOSS_SVC_DUAL, L2R_L2LOSS_SVC, L2R_L1LOSS_SVC_DUAL, MCSVM_C
                                                                                                                             solver_type
                                                                                                                             */
 
+/* The samples of a problem as a dense row major matrix: l rows of
+ * nr_column values.  Features nr_column + 1 to n are zero. */
+struct dense_problem
+  {
+  int l, n;
+  int *y;
+  const double *x;
+  int nr_column;
+  double bias;            /* < 0 if no bias term */
+  };
+
 struct parameter
   {
   int solver_type;
@@ -66,6 +77,8 @@ struct model
 
 struct model * train(const struct problem *prob, const struct parameter *param);
 
+struct model * train_dense(const struct dense_problem *prob, const struct parameter *param);
+
 void cross_validation(const struct problem *prob, const struct parameter *param, int nr_fold, int *target);
 
 int predict_values(const struct model *model_, const struct feature_node *x, double* dec_values);
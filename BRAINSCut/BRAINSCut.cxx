@@ -18,6 +18,7 @@
  *=========================================================================*/
 #include <string>
 #include <iostream>
+#include <algorithm>
 #include "GenericTransformImage.h"
 #include "itkScaleVersor3DTransform.h"
 #include "itkVersorRigid3DTransform.h"
@@ -37,6 +38,7 @@ int main(int argc, char * *argv)
 {
   PARSE_ARGS;
   BRAINSRegisterAlternateIO();
+  const BRAINSUtils::StackPushITKDefaultNumberOfThreads TempDefaultNumberOfThreadsHolder(numberOfThreads);
 
   if( !netConfiguration.empty() && modelConfigurationFilename.empty() )
     {
@@ -53,6 +55,7 @@ int main(int argc, char * *argv)
   BRAINSCutDataHandler m_dataHandler( modelConfigurationFilename );
 
   BRAINSCutGenerateRegistrations m_registrationGenerator( m_dataHandler );
+  m_registrationGenerator.SetNumberOfConcurrentRegistrations( std::max( 0, numberOfConcurrentRegistrations ) );
   const bool                     m_applyDataSetOff = false;
   const bool                     m_shuffleTrainVector = (NoTrainingVectorShuffling != true );
 
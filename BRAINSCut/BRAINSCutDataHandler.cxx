@@ -19,6 +19,7 @@
 #include "BRAINSCutDataHandler.h"
 #include "XMLConfigurationFileParser.h"
 #include "GenericTransformImage.h"
+#include "BRAINSTransformOptimization.h"
 #include "itkDisplacementFieldTransform.h"
 
 /** constructors */
@@ -296,25 +297,29 @@ BRAINSCutDataHandler
   WorkingImagePointer referenceImage =
     ReadImageByFilename( subject.GetImageFilenameByType(registrationImageTypeToUse) );
 
+  // The same transform maps the three images on the reference grid
+  const GenericTransformType::ConstPointer warpTransform =
+    BRAINSUtils::PrecomposeTransform( genericTransform, referenceImage );
+
   const std::string transoformationPixelType = "float";
 
   warpedSpatialLocationImages.insert( std::pair<std::string, WorkingImagePointer>
                                         ("rho", GenericTransformImage<WorkingImageType,
                                                                       WorkingImageType,
                                                                       DisplacementFieldType>
-                                          ( m_rho, referenceImage, genericTransform.GetPointer(),
+                                          ( m_rho, referenceImage, warpTransform,
                                           0.0, "Linear", transoformationPixelType == "binary") ) );
   warpedSpatialLocationImages.insert( std::pair<std::string, WorkingImagePointer>
                                         ("phi", GenericTransformImage<WorkingImageType,
                                                                       WorkingImageType,
                                                                       DisplacementFieldType>
-                                          ( m_phi, referenceImage, genericTransform.GetPointer(),
+                                          ( m_phi, referenceImage, warpTransform,
                                           0.0, "Linear", transoformationPixelType == "binary") ) );
   warpedSpatialLocationImages.insert( std::pair<std::string, WorkingImagePointer>
                                         ("theta", GenericTransformImage<WorkingImageType,
                                                                         WorkingImageType,
                                                                         DisplacementFieldType>
-                                          ( m_theta, referenceImage, genericTransform.GetPointer(),
+                                          ( m_theta, referenceImage, warpTransform,
                                           0.0, "Linear", transoformationPixelType == "binary") ) );
 }
 
@@ -388,6 +393,10 @@ BRAINSCutDataHandler
   WorkingImagePointer referenceImage =
     ReadImageByFilename( subject.GetImageFilenameByType(registrationImageTypeToUse) );
 
+  // The same transform maps every ROI on the reference grid
+  const GenericTransformType::ConstPointer warpTransform =
+    BRAINSUtils::PrecomposeTransform( genericTransform, referenceImage );
+
   const std::string transformationPixelType = "float";
 
   for( DataSet::StringVectorType::iterator roiTyIt = this->m_roiIDsInOrder.begin();
@@ -402,7 +411,7 @@ BRAINSCutDataHandler
                          (*roiTyIt), GenericTransformImage<WorkingImageType,
                                                            WorkingImageType,
                                                            DisplacementFieldType>
-                         ( currentROI, referenceImage,genericTransform.GetPointer(), 0.0, "Linear",
+                         ( currentROI, referenceImage, warpTransform, 0.0, "Linear",
                            transformationPixelType == "binary") ) );
     }
 }
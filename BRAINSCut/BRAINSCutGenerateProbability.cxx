@@ -20,12 +20,17 @@
 #include "XMLConfigurationFileParser.h"
 #include "BRAINSCutConfiguration.h"
 #include "BRAINSCutDataHandler.h"
+#include "BRAINSRegistrationCache.h"
+#include "BRAINSThreadControl.h"
+#include "itkMutexLockHolder.h"
 
 #include "itkIO.h"
+#include <algorithm>
 
 /** constructors */
 BRAINSCutGenerateProbability
-::BRAINSCutGenerateProbability( BRAINSCutDataHandler& dataHandler)
+::BRAINSCutGenerateProbability( BRAINSCutDataHandler& dataHandler) :
+  nextSubjectAccumulationJob(0)
 {
   myDataHandler =  &dataHandler;
   try
@@ -47,73 +52,76 @@ BRAINSCutGenerateProbability
 /*
  * generate probability maps
  */
-inline WorkingImageType::Pointer
-AddImageToAccumulator( WorkingImageType::Pointer & image, WorkingImageType::Pointer & accumulator )
-{
-  typedef itk::BinaryThresholdImageFilter<WorkingImageType, WorkingImageType> ThresholdFilterType;
-  ThresholdFilterType::Pointer threshold = ThresholdFilterType::New();
-
-  threshold->SetInput( image );
-  threshold->SetInsideValue( 1.0F);
-  threshold->SetOutsideValue( 0.0F );
-  threshold->SetLowerThreshold( 0.1F);
-  threshold->Update();
-
-  typedef itk::AddImageFilter<WorkingImageType, WorkingImageType, WorkingImageType> AddType;
-  AddType::Pointer adder = AddType::New();
-
-  adder->SetInput1( threshold->GetOutput() );
-  adder->SetInput2(accumulator);
-  adder->Update();
-
-  return adder->GetOutput();
-}
-
 void
 BRAINSCutGenerateProbability
 ::GenerateProbabilityMaps()
 {
   /** generating spherical coordinate image does not have to be here */
   GenerateSymmetricalSphericalCoordinateImage();
-  /** iterate through the rois*/
-  for( unsigned int currentROIAt = 0;
-       currentROIAt < myDataHandler->GetROICount();
-       ++currentROIAt )
+
+  const unsigned int numberOfROIs = myDataHandler->GetROICount();
+
+  /** collect the file names of all subjects before the concurrent part */
+  subjectAccumulationJobs.clear();
+  for( std::list<DataSet *>::iterator currentSubjectIt = trainingDataSetList.begin();
+       currentSubjectIt != trainingDataSetList.end();
+       ++currentSubjectIt )
     {
-    WorkingImageType::Pointer currentAccumulatedImages;
-    CreateNewFloatImageFromTemplate( currentAccumulatedImages, myDataHandler->GetAtlasImage() );
-
-    std::string  currentROIID( (myDataHandler->GetROIIDsInOrder() )[currentROIAt] );
-    unsigned int currentROISubjectsCounter = 0;
-    /** iterate through subject */
-    for( std::list<DataSet *>::iterator currentSubjectIt = trainingDataSetList.begin();
-         currentSubjectIt != trainingDataSetList.end();
-         ++currentSubjectIt )
+    SubjectAccumulationJob job;
+    job.RegistrationFilename = myDataHandler->GetSubjectToAtlasRegistrationFilename( *(*currentSubjectIt) );
+    for( unsigned int currentROIAt = 0; currentROIAt < numberOfROIs; ++currentROIAt )
       {
-      ++currentROISubjectsCounter;
-      /** deform ROI to Atlas */
-
-      std::string currentRegistrationFilename =
-        myDataHandler->GetSubjectToAtlasRegistrationFilename( *(*currentSubjectIt) );
-      /*std::string currentRegistrationFilename =
-        (*currentSubjectIt)->GetRegistrationWithID( registrationID )
-        ->GetAttribute<StringValue>( "SubjToAtlasRegistrationFIlename");*/
-
-      std::string currentROIFilename = ( *currentSubjectIt)
-        ->GetMaskFilenameByType( currentROIID );
-
-      WorkingImageType::Pointer currentDeformedROI = ImageWarper<WorkingImageType>( currentRegistrationFilename,
-                                                                                    currentROIFilename,
-                                                                                    myDataHandler->GetAtlasImage() );
-      /** add the deformed roi to accumulator */
-      currentAccumulatedImages =
-        AddImageToAccumulator( currentDeformedROI, currentAccumulatedImages );
-      } /** end of iteration for subject */
+      const std::string currentROIID( (myDataHandler->GetROIIDsInOrder() )[currentROIAt] );
+      job.ROIFilenames.push_back( (*currentSubjectIt)->GetMaskFilenameByType( currentROIID ) );
+      }
+    subjectAccumulationJobs.push_back( job );
+    }
+
+  /** one accumulator per roi, updated in place */
+  roiAccumulators.resize( numberOfROIs );
+  roiAccumulatorLocks.resize( numberOfROIs );
+  for( unsigned int currentROIAt = 0; currentROIAt < numberOfROIs; ++currentROIAt )
+    {
+    CreateNewFloatImageFromTemplate( roiAccumulators[currentROIAt], myDataHandler->GetAtlasImage() );
+    roiAccumulatorLocks[currentROIAt] = itk::MutexLock::New();
+    }
+
+  /** iterate through subjects, several at a time, each with an equal share
+   * of the threads for its resampling */
+  if( !subjectAccumulationJobs.empty() )
+    {
+    const unsigned int threadBudget = itk::MultiThreader::GetGlobalDefaultNumberOfThreads();
+    const unsigned int numberOfConcurrentSubjects =
+      std::max( 1U, std::min<unsigned int>( threadBudget, subjectAccumulationJobs.size() ) );
+
+    itk::MultiThreader::Pointer threader = itk::MultiThreader::New();
+    threader->SetNumberOfThreads( numberOfConcurrentSubjects );
+    const BRAINSUtils::StackPushITKDefaultNumberOfThreads subjectThreads(
+      std::max( 1U, threadBudget / numberOfConcurrentSubjects ) );
+    nextSubjectAccumulationJob = 0;
+    subjectAccumulationErrors.clear();
+    threader->SetSingleMethod( AccumulateSubjectsThreaderCallback, this );
+    threader->SingleMethodExecute();
+    }
+  if( !subjectAccumulationErrors.empty() )
+    {
+    throw BRAINSCutExceptionStringHandler( subjectAccumulationErrors );
+    }
+
+  const unsigned int numberOfSubjects = subjectAccumulationJobs.size();
+  subjectAccumulationJobs.clear();
+  roiAccumulatorLocks.clear();
+
+  /** iterate through the rois*/
+  for( unsigned int currentROIAt = 0; currentROIAt < numberOfROIs; ++currentROIAt )
+    {
+    std::string currentROIID( (myDataHandler->GetROIIDsInOrder() )[currentROIAt] );
 
     /** average the accumulator based on the counts */
     WorkingImagePointer currentProbabilityImage =
-      ImageMultiplyConstant<WorkingImageType>( currentAccumulatedImages,
-                                               1.0F / static_cast<float>( currentROISubjectsCounter ) );
+      ImageMultiplyConstant<WorkingImageType>( roiAccumulators[currentROIAt],
+                                               1.0F / static_cast<float>( numberOfSubjects ) );
+    roiAccumulators[currentROIAt] = ITK_NULLPTR;
 
     /** get roi object */
 
@@ -140,6 +148,133 @@ BRAINSCutGenerateProbability
     /** write image */
     itkUtil::WriteImage<WorkingImageType>( currentSmoothProbabilityImage, currentProbabilityMapFilename );
     } /** end of iteration for roi */
+  roiAccumulators.clear();
+}
+
+ITK_THREAD_RETURN_TYPE
+BRAINSCutGenerateProbability
+::AccumulateSubjectsThreaderCallback( void *arg )
+{
+  BRAINSCutGenerateProbability *self = static_cast<BRAINSCutGenerateProbability *>(
+      ( (itk::MultiThreader::ThreadInfoStruct *)( arg ) )->UserData );
+
+  for( ;; )
+    {
+    size_t next;
+      {
+      const itk::MutexLockHolder<itk::SimpleFastMutexLock> holder( self->subjectAccumulationLock );
+      next = self->nextSubjectAccumulationJob++;
+      }
+    if( next >= self->subjectAccumulationJobs.size() )
+      {
+      break;
+      }
+    // Exceptions can not leave the thread, they are thrown again after all
+    // the subjects are done.
+    std::string errorMessage;
+    try
+      {
+      self->AccumulateSubject( self->subjectAccumulationJobs[next] );
+      }
+    catch( itk::ExceptionObject & e )
+      {
+      std::ostringstream msg;
+      msg << e;
+      errorMessage = msg.str();
+      }
+    catch( BRAINSCutExceptionStringHandler & e )
+      {
+      errorMessage = e.Error();
+      }
+    catch( std::exception & e )
+      {
+      errorMessage = e.what();
+      }
+    if( !errorMessage.empty() )
+      {
+      const itk::MutexLockHolder<itk::SimpleFastMutexLock> holder( self->subjectAccumulationLock );
+      self->subjectAccumulationErrors += self->subjectAccumulationJobs[next].RegistrationFilename
+        + ": " + errorMessage + "\n";
+      }
+    }
+  return ITK_THREAD_RETURN_VALUE;
+}
+
+void
+BRAINSCutGenerateProbability
+::AccumulateSubject( const SubjectAccumulationJob & job )
+{
+  /** the registration is read once for all the rois of the subject */
+  GenericTransformType::Pointer subjectToAtlasTransform = ReadRegistration( job.RegistrationFilename );
+
+  for( unsigned int currentROIAt = 0; currentROIAt < job.ROIFilenames.size(); ++currentROIAt )
+    {
+    /** deform ROI to Atlas */
+    WorkingImageType::Pointer currentDeformedROI =
+      ImageWarper<WorkingImageType>( subjectToAtlasTransform.GetPointer(),
+                                     job.ROIFilenames[currentROIAt],
+                                     myDataHandler->GetAtlasImage() );
+
+    WorkingImageType::Pointer & accumulator = roiAccumulators[currentROIAt];
+    const itk::SizeValueType    numberOfPixels = accumulator->GetBufferedRegion().GetNumberOfPixels();
+    if( currentDeformedROI->GetBufferedRegion().GetNumberOfPixels() != numberOfPixels )
+      {
+      throw BRAINSCutExceptionStringHandler( "Deformed ROI " + job.ROIFilenames[currentROIAt]
+                                             + " does not match the atlas image" );
+      }
+
+    /** add the thresholded roi to its accumulator in place; the sums of
+     * zeros and ones are exact in float, so the order of the subjects does
+     * not matter */
+    const WorkingPixelType *roi = currentDeformedROI->GetBufferPointer();
+    const itk::MutexLockHolder<itk::MutexLock> holder( *roiAccumulatorLocks[currentROIAt] );
+    WorkingPixelType *sum = accumulator->GetBufferPointer();
+    for( itk::SizeValueType i = 0; i < numberOfPixels; ++i )
+      {
+      if( roi[i] >= 0.1F )
+        {
+        sum[i] += 1.0F;
+        }
+      }
+    }
+}
+
+BRAINSCutGenerateProbability::GenericTransformType::Pointer
+BRAINSCutGenerateProbability
+::ReadRegistration( const std::string & RegistrationFilename )
+{
+  const bool useTransform = ( RegistrationFilename.find(".mat") != std::string::npos ||
+                              RegistrationFilename.find(".h5") != std::string::npos ||
+                              RegistrationFilename.find(".hdf5") != std::string::npos ||
+                              RegistrationFilename.find(".txt") != std::string::npos
+                              );
+
+  GenericTransformType::Pointer genericTransform;
+  if( !useTransform )  // that is, it's a warp by deformation field:
+    {
+    typedef itk::Vector<DeformationScalarType, 3>   VectorPixelType;
+    typedef itk::Image<VectorPixelType,  3>         LocalDisplacementFieldType;
+    typedef itk::ImageFileReader<LocalDisplacementFieldType> DefFieldReaderType;
+    DefFieldReaderType::Pointer fieldImageReader = DefFieldReaderType::New();
+    fieldImageReader->SetFileName(RegistrationFilename);
+    fieldImageReader->Update();
+
+    typedef itk::DisplacementFieldTransform<DeformationScalarType, LocalDisplacementFieldType::ImageDimension>
+      DisplacementFieldTransformType;
+    DisplacementFieldTransformType::Pointer dispXfrm = DisplacementFieldTransformType::New();
+    dispXfrm->SetDisplacementField( fieldImageReader->GetOutput() );
+    genericTransform = dispXfrm.GetPointer();
+    }
+  else // there EXIST *mat file.
+    {
+    std::cout << "!!!!!!!!!!!! CAUTION !!!!!!!!!!!!!!!!!!!" << std::endl
+              << "* Mat file exists!" << std::endl
+              << "!!!!!!!!!!!! CAUTION !!!!!!!!!!!!!!!!!!!" << std::endl;
+    // HDF5 is not thread safe
+    const itk::MutexLockHolder<itk::SimpleFastMutexLock> holder( BRAINSUtils::RegistrationCache::GetIOLock() );
+    genericTransform = itk::ReadTransformFromDisk(RegistrationFilename);
+    }
+  return genericTransform;
 }
 
 inline WorkingImageType::IndexType::IndexValueType
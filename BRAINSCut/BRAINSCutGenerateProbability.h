@@ -22,6 +22,9 @@
 #include "BRAINSCutDataHandler.h"
 #include "BRAINSCutConfiguration.h"
 #include "itkDisplacementFieldTransform.h"
+#include "itkMultiThreader.h"
+#include "itkMutexLock.h"
+#include "itkSimpleFastMutexLock.h"
 #include <itkIO.h>
 
 class BRAINSCutGenerateProbability
@@ -31,14 +34,39 @@ public:
 
   void SetTrainingDataSetsList();
 
+  /** Accumulate the deformed ROIs of all the training subjects in one pass
+   * over the subjects.  Several subjects are read and deformed at the same
+   * time, and each deformed ROI is added in place to the sum of its ROI. */
   void GenerateProbabilityMaps();
 
 private:
+  typedef itk::Transform<double, 3, 3> GenericTransformType;
+
+  struct SubjectAccumulationJob
+    {
+    std::string              RegistrationFilename;
+    std::vector<std::string> ROIFilenames; // in the order of the ROI IDs
+    };
+
   BRAINSCutDataHandler* myDataHandler;
 
   /** DataSets */
   std::list<DataSet *> trainingDataSetList;
 
+  /** Working state of GenerateProbabilityMaps() */
+  std::vector<SubjectAccumulationJob>  subjectAccumulationJobs;
+  size_t                               nextSubjectAccumulationJob;
+  std::vector<WorkingImagePointer>     roiAccumulators;
+  std::vector<itk::MutexLock::Pointer> roiAccumulatorLocks;
+  itk::SimpleFastMutexLock             subjectAccumulationLock;
+  std::string                          subjectAccumulationErrors;
+
+  static ITK_THREAD_RETURN_TYPE AccumulateSubjectsThreaderCallback( void *arg );
+
+  void AccumulateSubject( const SubjectAccumulationJob & job );
+
+  GenericTransformType::Pointer ReadRegistration( const std::string & RegistrationFilename );
+
   void GenerateSymmetricalSphericalCoordinateImage();
 
   void CreateNewFloatImageFromTemplate( WorkingImageType::Pointer & PointerToOutputImage,
@@ -48,16 +76,10 @@ private:
                        float & theta);
 
   template <class WarperImageType>
-  typename WarperImageType::Pointer ImageWarper(  const std::string & RegistrationFilename,
+  typename WarperImageType::Pointer ImageWarper(  const GenericTransformType * genericTransform,
                                                   const std::string & ImageName,
                                                   typename WarperImageType::Pointer ReferenceImage  )
   {
-    const bool useTransform = ( RegistrationFilename.find(".mat") != std::string::npos ||
-                                RegistrationFilename.find(".h5") != std::string::npos ||
-                                RegistrationFilename.find(".hdf5") != std::string::npos ||
-                                RegistrationFilename.find(".txt") != std::string::npos
-                                );
-
     typename WarperImageType::Pointer PrincipalOperandImage; // One name for the
                                                              // image to be
                                                              // warped.
@@ -74,51 +96,6 @@ private:
     typedef typename itk::Vector<VectorComponentType, 3> VectorPixelType;
     typedef typename itk::Image<VectorPixelType,  3>     LocalDisplacementFieldType;
 
-    // An empty SmartPointer constructor sets up someImage.IsNull() to represent
-    // a
-    // not-supplied state:
-    typename LocalDisplacementFieldType::Pointer DisplacementField;
-    // An empty SmartPointer constructor sets up someTransform.IsNull() to
-    // represent a not-supplied state:
-    typedef  itk::Transform<double, 3, 3> GenericTransformType;
-    typename GenericTransformType::Pointer genericTransform;
-    // typename WarperImageType::Pointer ReferenceImage;
-    // if there is no *mat file.
-    //
-    // HACK ALERT HACK ALERT
-    // The GenericTransformImage function would apply either a
-    // 'generic' transform or a DisplacementField transform. If both
-    // were non-null, the DisplacementField took precedence. To get
-    // the same behavior with the DisplacementField parameter removed
-    // you have to enforce this 'OR NOT AND' behavior at the point of
-    // call
-    if( !useTransform )  // that is, it's a warp by deformation field:
-      {
-      typedef typename itk::ImageFileReader<LocalDisplacementFieldType> DefFieldReaderType;
-      typename DefFieldReaderType::Pointer fieldImageReader = DefFieldReaderType::New();
-      fieldImageReader->SetFileName(RegistrationFilename);
-      fieldImageReader->Update();
-      DisplacementField = fieldImageReader->GetOutput();
-
-      // Resample deformation filed to reference image size Check that
-      // deformation
-      // field and reference image have same dimensions.
-
-      // and---  ReferenceImage.IsNull() represents the delayed default
-      typedef itk::DisplacementFieldTransform<DeformationScalarType,LocalDisplacementFieldType::ImageDimension>
-        DisplacementFieldTransformType;
-      typename DisplacementFieldTransformType::Pointer dispXfrm =
-        DisplacementFieldTransformType::New();
-      dispXfrm->SetDisplacementField(DisplacementField.GetPointer());
-      genericTransform = dispXfrm.GetPointer();
-      }
-    else // there EXIST *mat file.
-      {
-      std::cout << "!!!!!!!!!!!! CAUTION !!!!!!!!!!!!!!!!!!!" << std::endl
-                << "* Mat file exists!" << std::endl
-                << "!!!!!!!!!!!! CAUTION !!!!!!!!!!!!!!!!!!!" << std::endl;
-      genericTransform = itk::ReadTransformFromDisk(RegistrationFilename);
-      }
     const double defaultValue = 0;
     const typename std::string interpolationMode = "Linear";
     const typename std::string pixelType = "short";
@@ -127,7 +104,7 @@ private:
       GenericTransformImage<WarperImageType, WarperImageType, LocalDisplacementFieldType>(
         PrincipalOperandImage,
         ReferenceImage,
-        genericTransform.GetPointer(),
+        genericTransform,
         defaultValue,
         interpolationMode,
         pixelType == "binary");
@@ -19,14 +19,26 @@
 #include "BRAINSCutGenerateRegistrations.h"
 
 #include "itkBRAINSROIAutoImageFilter.h"
+#include "itkImageIOFactory.h"
+#include "itkMutexLockHolder.h"
 #include "BRAINSFitHelper.h"
+#include "BRAINSCutExceptionStringHandler.h"
+#include "BRAINSRegistrationCache.h"
+#include "BRAINSThreadControl.h"
+#include <algorithm>
+#include <cstdio>
+
+// BSpline grid of the registrations, also used to estimate their cost
+static const int BSplineGridSize[3] = { 28, 20, 24 };
 
 // ----------------------------------------------------- //
 BRAINSCutGenerateRegistrations
 ::BRAINSCutGenerateRegistrations(  BRAINSCutDataHandler& dataHandler ) :
   myDataHandler(ITK_NULLPTR),
   atlasToSubjectRegistraionOn(false),
-  subjectDataSets()
+  subjectDataSets(),
+  numberOfConcurrentRegistrations(1),
+  nextRegistrationJob(0)
 {
   myDataHandler =  &dataHandler;
   myDataHandler->SetRegistrationParameters();
@@ -57,11 +69,20 @@ BRAINSCutGenerateRegistrations
     }
 }
 
+// ----------------------------------------------------- //
+void
+BRAINSCutGenerateRegistrations
+::SetNumberOfConcurrentRegistrations( unsigned int numberOfRegistrations )
+{
+  numberOfConcurrentRegistrations = numberOfRegistrations;
+}
+
 // ----------------------------------------------------- //
 void
 BRAINSCutGenerateRegistrations
 ::GenerateRegistrations()
 {
+  registrationJobs.clear();
   for( std::list<DataSet *>::iterator subjectIt = subjectDataSets.begin();
        subjectIt != subjectDataSets.end();
        ++subjectIt )
@@ -78,43 +99,174 @@ BRAINSCutGenerateRegistrations
     const std::string SubjectBinaryFilename
       ( (*subjectIt)->GetMaskFilenameByType( "RegistrationROI" ) );
 
+    RegistrationJob job;
     if( atlasToSubjectRegistraionOn &&
         (!itksys::SystemTools::FileExists( AtlasToSubjRegistrationFilename.c_str() ) ) )
       {
-      // create directories
-      std::string directory = itksys::SystemTools::GetParentDirectory(
-          SubjectToAtlasRegistrationFilename.c_str() );
-
-      if( !itksys::SystemTools::FileExists( directory.c_str() ) )
-        {
-        itksys::SystemTools::MakeDirectory( directory.c_str() );
-        }
-      CreateTransformFile(  myDataHandler->GetAtlasFilename(),        // moving image
-                            subjectFilename,                          // fixed image
-                            myDataHandler->GetAtlasBinaryFilename(),  // moving ROI
-                            SubjectBinaryFilename,                    // fixed ROI
-                            AtlasToSubjRegistrationFilename,
-                            false );
+      job.MovingImageFilename = myDataHandler->GetAtlasFilename();
+      job.FixedImageFilename = subjectFilename;
+      job.MovingBinaryImageFilename = myDataHandler->GetAtlasBinaryFilename();
+      job.FixedBinaryImageFilename = SubjectBinaryFilename;
+      job.OutputRegName = AtlasToSubjRegistrationFilename;
       }
     else if( (!atlasToSubjectRegistraionOn) &&
              (!itksys::SystemTools::FileExists( SubjectToAtlasRegistrationFilename.c_str() ) ) )
       {
-      // create directories
-      std::string directory = itksys::SystemTools::GetParentDirectory(
-          SubjectToAtlasRegistrationFilename.c_str() );
-
-      if( !itksys::SystemTools::FileExists( directory.c_str() ) )
-        {
-        itksys::SystemTools::MakeDirectory( directory.c_str() );
-        }
-      CreateTransformFile(  subjectFilename,                         // moving image
-                            myDataHandler->GetAtlasFilename(),       // fixed image
-                            SubjectBinaryFilename,                   // moving ROI
-                            myDataHandler->GetAtlasBinaryFilename(), // fixed ROI
-                            SubjectToAtlasRegistrationFilename,
-                            false );
+      job.MovingImageFilename = subjectFilename;
+      job.FixedImageFilename = myDataHandler->GetAtlasFilename();
+      job.MovingBinaryImageFilename = SubjectBinaryFilename;
+      job.FixedBinaryImageFilename = myDataHandler->GetAtlasBinaryFilename();
+      job.OutputRegName = SubjectToAtlasRegistrationFilename;
+      }
+    else
+      {
+      continue;
+      }
+
+    // create directories
+    std::string directory = itksys::SystemTools::GetParentDirectory(
+        SubjectToAtlasRegistrationFilename.c_str() );
+
+    if( !itksys::SystemTools::FileExists( directory.c_str() ) )
+      {
+      itksys::SystemTools::MakeDirectory( directory.c_str() );
+      }
+    job.EstimatedCost = EstimateRegistrationCost( job.FixedImageFilename );
+    registrationJobs.push_back( job );
+    }
+
+  if( registrationJobs.empty() )
+    {
+    return;
+    }
+
+  // Starting the longest registrations first keeps the last ones from
+  // running alone on an otherwise idle node.
+  std::stable_sort( registrationJobs.begin(), registrationJobs.end(), CompareEstimatedCost );
+
+  const unsigned int threadBudget = itk::MultiThreader::GetGlobalDefaultNumberOfThreads();
+  unsigned int       numberOfRegistrations = numberOfConcurrentRegistrations;
+  if( numberOfRegistrations == 0 )
+    {
+    numberOfRegistrations = threadBudget;
+    }
+  numberOfRegistrations = std::max( 1U, std::min<unsigned int>( numberOfRegistrations, registrationJobs.size() ) );
+  std::cout << "Running " << registrationJobs.size() << " registrations, "
+            << numberOfRegistrations << " at a time." << std::endl;
+    {
+    itk::MultiThreader::Pointer threader = itk::MultiThreader::New();
+    threader->SetNumberOfThreads( numberOfRegistrations );
+    const BRAINSUtils::StackPushITKDefaultNumberOfThreads registrationThreads(
+      std::max( 1U, threadBudget / numberOfRegistrations ) );
+    nextRegistrationJob = 0;
+    threader->SetSingleMethod( RegistrationThreaderCallback, this );
+    threader->SingleMethodExecute();
+    }
+
+  std::string errorMessage;
+  for( size_t j = 0; j < registrationJobs.size(); ++j )
+    {
+    if( !registrationJobs[j].ErrorMessage.empty() )
+      {
+      errorMessage += "Registration " + registrationJobs[j].OutputRegName
+        + " failed: " + registrationJobs[j].ErrorMessage + "\n";
+      }
+    }
+  registrationJobs.clear();
+  if( !errorMessage.empty() )
+    {
+    // The completed registrations are kept, a rerun only repeats the failed ones
+    throw BRAINSCutExceptionStringHandler( errorMessage );
+    }
+}
+
+ITK_THREAD_RETURN_TYPE
+BRAINSCutGenerateRegistrations
+::RegistrationThreaderCallback( void *arg )
+{
+  BRAINSCutGenerateRegistrations *self = static_cast<BRAINSCutGenerateRegistrations *>(
+      ( (itk::MultiThreader::ThreadInfoStruct *)( arg ) )->UserData );
+
+  for( ;; )
+    {
+    size_t next;
+      {
+      const itk::MutexLockHolder<itk::SimpleFastMutexLock> holder( self->registrationJobLock );
+      next = self->nextRegistrationJob++;
+      }
+    if( next >= self->registrationJobs.size() )
+      {
+      break;
+      }
+    RegistrationJob & job = self->registrationJobs[next];
+    // Exceptions can not leave the thread, they are reported after all the
+    // registrations are done.
+    try
+      {
+      self->CreateTransformFile( job.MovingImageFilename,
+                                 job.FixedImageFilename,
+                                 job.MovingBinaryImageFilename,
+                                 job.FixedBinaryImageFilename,
+                                 job.OutputRegName,
+                                 false );
+      }
+    catch( itk::ExceptionObject & e )
+      {
+      std::ostringstream msg;
+      msg << e;
+      job.ErrorMessage = msg.str();
+      }
+    catch( BRAINSCutExceptionStringHandler & e )
+      {
+      job.ErrorMessage = e.Error();
+      }
+    catch( std::exception & e )
+      {
+      job.ErrorMessage = e.what();
+      }
+    catch( ... )
+      {
+      job.ErrorMessage = "Unknown exception";
       }
     }
+  return ITK_THREAD_RETURN_VALUE;
+}
+
+double
+BRAINSCutGenerateRegistrations
+::EstimateRegistrationCost( const std::string & FixedImageFilename )
+{
+  // The metric is sampled from the fixed image and every sample visits the
+  // BSpline grid, so the cost is estimated by the product of both sizes.
+  double cost = static_cast<double>( BSplineGridSize[0] ) * BSplineGridSize[1] * BSplineGridSize[2];
+
+  itk::ImageIOBase::Pointer imageIO =
+    itk::ImageIOFactory::CreateImageIO( FixedImageFilename.c_str(), itk::ImageIOFactory::ReadMode );
+  if( imageIO.IsNull() )
+    {
+    return 0.0;
+    }
+  try
+    {
+    imageIO->SetFileName( FixedImageFilename );
+    imageIO->ReadImageInformation();
+    }
+  catch( itk::ExceptionObject & )
+    {
+    return 0.0;
+    }
+  for( unsigned int i = 0; i < imageIO->GetNumberOfDimensions(); ++i )
+    {
+    cost *= imageIO->GetDimensions( i );
+    }
+  return cost;
+}
+
+bool
+BRAINSCutGenerateRegistrations
+::CompareEstimatedCost( const RegistrationJob & a, const RegistrationJob & b )
+{
+  return a.EstimatedCost > b.EstimatedCost;
 }
 
 void
@@ -151,11 +303,7 @@ BRAINSCutGenerateRegistrations
   BSplineRegistrationHelper->SetMaxBSplineDisplacement(4);
 
   // BSpline Grid Size
-  std::vector<int> splineGridSize(3);
-
-  splineGridSize[0] = 28;
-  splineGridSize[1] = 20;
-  splineGridSize[2] = 24;
+  std::vector<int> splineGridSize( BSplineGridSize, BSplineGridSize + 3 );
 
   BSplineRegistrationHelper->SetSplineGridSize( splineGridSize );
 
@@ -296,16 +444,43 @@ BRAINSCutGenerateRegistrations
     BSplineRegistrationHelper->PrintCommandLine(true, "BSplineRegistrationHelper");
     }
 
-  BSplineRegistrationHelper->Update();
-
-  if( verbose == true )
+  // The registration is reused from the registration cache (enabled by the
+  // BRAINS_REGISTRATION_CACHE environment variable).
+  const BRAINSUtils::RegistrationCache                          registrationCache;
+  BRAINSUtils::RegistrationCacheKey                             registrationKey("BRAINSCutGenerateRegistrations");
+  BRAINSUtils::RegistrationCache::GenericTransformType::Pointer registrationTransform;
+  if( registrationCache.IsEnabled() )
     {
-    std::cout << " - Write deformation " << std::endl
-              << " :: " << OutputRegName
-              << std::endl;
+    registrationKey.AddImage("fixed", fixedVolume.GetPointer() );
+    registrationKey.AddImage("moving", movingVolume.GetPointer() );
+    registrationKey.AddMask("fixed mask", BSplineRegistrationHelper->GetFixedBinaryVolume() );
+    registrationKey.AddMask("moving mask", BSplineRegistrationHelper->GetMovingBinaryVolume() );
+    registrationKey.AddParameter("transformType", transformType);
+    registrationKey.AddParameter("splineGridSize", splineGridSize);
+    registrationKey.AddParameter("numberOfIterations", numberOfIterations);
+    registrationKey.AddParameter("minimumStepLength", minimumStepLength);
+    registrationKey.AddParameter("samplingPercentage", BSplineRegistrationHelper->GetSamplingPercentage() );
+    registrationKey.AddParameter("maxBSplineDisplacement", maxBSplineDisplacement);
+    registrationKey.AddParameter("maskInferiorCutOffFromCenter", maskInferiorCutOffFromCenter);
+    registrationKey.AddParameter("translationScale", translationScale);
+    registrationKey.AddParameter("reproportionScale", reproportionalScale);
+    registrationKey.AddParameter("skewScale", skewScale);
+    registrationTransform = registrationCache.FetchTransform(registrationKey);
+    }
+  if( registrationTransform.IsNotNull() )
+    {
+    if( verbose == true )
+      {
+      std::cout << " - Reusing cached registration " << registrationKey.GetDigest() << std::endl;
+      }
     }
-  itk::WriteTransformToDisk<double>( BSplineRegistrationHelper->GetCurrentGenericTransform(),
-                        OutputRegName );
+  else
+    {
+    BSplineRegistrationHelper->Update();
+    registrationTransform = BSplineRegistrationHelper->GetCurrentGenericTransform().GetPointer();
+    registrationCache.StoreTransform(registrationKey, registrationTransform.GetPointer() );
+    }
+
   // Write out Transformed Output As Well
   // - EX. from GenericTransformImage.hxx
 
@@ -316,7 +491,7 @@ BRAINSCutGenerateRegistrations
       fixedVolume.GetPointer(),
       0.0F,
       GetInterpolatorFromString<WorkingImageType>("Linear").GetPointer(),
-      BSplineRegistrationHelper->GetCurrentGenericTransform().GetPointer() );
+      registrationTransform.GetPointer() );
 
   typedef itk::ImageFileWriter<WorkingImageType> DeformedVolumeWriterType;
 
@@ -325,4 +500,29 @@ BRAINSCutGenerateRegistrations
   deformedVolumeWriter->SetFileName( OutputRegName + "_output.nii.gz" );
   deformedVolumeWriter->SetInput( DeformedMovingImage );
   deformedVolumeWriter->Update();
+
+  if( verbose == true )
+    {
+    std::cout << " - Write deformation " << std::endl
+              << " :: " << OutputRegName
+              << std::endl;
+    }
+  // The transform file marks the registration as complete, so it is written
+  // last, and to a temporary file that is renamed once it is complete.
+  std::string partialRegName = itksys::SystemTools::GetFilenamePath( OutputRegName );
+  if( !partialRegName.empty() )
+    {
+    partialRegName += "/";
+    }
+  partialRegName += "partial-" + itksys::SystemTools::GetFilenameName( OutputRegName );
+    {
+    // HDF5 is not thread safe
+    const itk::MutexLockHolder<itk::SimpleFastMutexLock> holder( BRAINSUtils::RegistrationCache::GetIOLock() );
+    itk::WriteTransformToDisk<double>( registrationTransform.GetPointer(), partialRegName );
+    }
+  if( std::rename( partialRegName.c_str(), OutputRegName.c_str() ) != 0 )
+    {
+    itksys::SystemTools::RemoveFile( partialRegName.c_str() );
+    throw BRAINSCutExceptionStringHandler( "Can not write " + OutputRegName );
+    }
 }
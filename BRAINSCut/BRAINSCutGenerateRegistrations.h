@@ -20,6 +20,8 @@
 #define BRAINSCutGenerateRegistrations_h
 
 #include "BRAINSCutDataHandler.h"
+#include "itkMultiThreader.h"
+#include "itkSimpleFastMutexLock.h"
 
 typedef itk::Image<unsigned char, DIMENSION> BinaryImageType;
 typedef BinaryImageType::Pointer             BinaryImagePointer;
@@ -33,15 +35,45 @@ public:
 
   void SetDataSet( bool applyDataSet );
 
+  /** Number of subject registrations run at the same time, each with an
+   * equal share of the ITK default number of threads.  1 (the default)
+   * runs them one after the other; 0 runs as many as there are threads. */
+  void SetNumberOfConcurrentRegistrations( unsigned int numberOfRegistrations );
+
+  /** Registrations whose transform file exists are complete and skipped,
+   * so an interrupted run resumes with the remaining subjects.  The longest
+   * registrations are started first. */
   void GenerateRegistrations();
 
 private:
+  struct RegistrationJob
+    {
+    std::string MovingImageFilename;
+    std::string FixedImageFilename;
+    std::string MovingBinaryImageFilename;
+    std::string FixedBinaryImageFilename;
+    std::string OutputRegName;
+    double      EstimatedCost;
+    std::string ErrorMessage;
+    };
+
   BRAINSCutDataHandler* myDataHandler;
   bool                  atlasToSubjectRegistraionOn;
   std::list<DataSet *>  subjectDataSets;
+  unsigned int          numberOfConcurrentRegistrations;
+
+  std::vector<RegistrationJob> registrationJobs;
+  size_t                       nextRegistrationJob;
+  itk::SimpleFastMutexLock     registrationJobLock;
 
   /** private functions */
 
+  static ITK_THREAD_RETURN_TYPE RegistrationThreaderCallback( void *arg );
+
+  static double EstimateRegistrationCost( const std::string & FixedImageFilename );
+
+  static bool CompareEstimatedCost( const RegistrationJob & a, const RegistrationJob & b );
+
   void  CreateTransformFile(const std::string & MovingImageFilename, const std::string & FixedImageFilename,
                             const std::string & MovingBinaryImageFilename, const std::string & FixedBinaryImageFilename,
                             const std::string & OutputRegName, bool verbose);
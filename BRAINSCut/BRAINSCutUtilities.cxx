@@ -53,7 +53,9 @@ WorkingImagePointer ReadImageByFilename( const std::string  & filename )
 
   WorkingImagePointer readInImage;
 
-  ReadInImagePointer inputImage = itkUtil::ReadImage<ReadInImageType>(filename.c_str() );
+  // A private copy: concurrent registration jobs rescale the same atlas, and
+  // a shared cached image cannot be the input of filters in several threads.
+  ReadInImageType::Pointer inputImage = itkUtil::ReadImage<ReadInImageType>(filename);
 
   readInImage = itkUtil::ScaleAndCast<ReadInImageType,
                                       WorkingImageType>(inputImage,
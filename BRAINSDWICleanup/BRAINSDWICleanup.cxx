@@ -16,16 +16,13 @@
  *  limitations under the License.
  *
  *=========================================================================*/
-#include "itkImageRegionConstIterator.h"
-#include "itkImageRegionIterator.h"
 #include "itkVectorImage.h"
 #include "itkImageFileReader.h"
 #include "itkImageFileWriter.h"
 #include "DWIMetaDataDictionaryValidator.h"
 #include "BRAINSDWICleanupCLP.h"
-#include <list>
+#include "DWIGradientGather.h"
 #include <vector>
-#include <list>
 
 typedef signed short                        PixelType;
 typedef itk::VectorImage<PixelType, 3>      NrrdImageType;
@@ -37,39 +34,6 @@ typedef itk::ImageFileWriter<NrrdImageType> WriterType;
 
 typedef std::vector<std::string> GradStringVector;
 
-template <typename TImage>
-TImage *AllocVecImage(const itk::ImageBase<TImage::ImageDimension> *templateImage, unsigned long vecSize)
-{
-  typename TImage::Pointer p1 = TImage::New();
-  p1->CopyInformation(templateImage);
-  p1->SetRegions(templateImage->GetLargestPossibleRegion());
-  p1->SetNumberOfComponentsPerPixel(vecSize);
-  p1->Allocate();
-  p1.GetPointer()->Register();
-  return p1.GetPointer();
-}
-
-class inBadList
-{
-public:
-  inBadList(const std::vector<int> &list) : valueList(list)
-    {
-    }
-  bool operator() (const int &value)
-    {
-      for(unsigned int i = 0; i < valueList.size(); ++i)
-        {
-        if(valueList[i] == value)
-          {
-          return true;
-          }
-        }
-      return false;
-    }
-private:
-  const std::vector<int> &valueList;
-};
-
 int main(int argc, char *argv[])
 {
   PARSE_ARGS;
@@ -103,19 +67,30 @@ int main(int argc, char *argv[])
   std::cout << "Read Input Image..." << std::endl;
   NrrdImageType::Pointer inImage = imageReader->GetOutput();
 
-  unsigned int numInputGradients = inImage->GetNumberOfComponentsPerPixel();
-  unsigned int newGradientCount = numInputGradients - badGradients.size();
+  const unsigned int numInputGradients = inImage->GetNumberOfComponentsPerPixel();
 
   //
   // make an index list containing the list of gradients/volumes to keep.
-  std::list<int> keepIndices;
+  std::vector<bool> isBad(numInputGradients, false);
+  for(unsigned int i = 0; i < badGradients.size(); ++i)
+    {
+    if(badGradients[i] < 0 || static_cast<unsigned int>(badGradients[i]) >= numInputGradients)
+      {
+      std::cerr << "ERROR: Bad gradient " << badGradients[i] << " is not in the input image, which has "
+                << numInputGradients << " gradients." << std::endl;
+      return 1;
+      }
+    isBad[badGradients[i]] = true;
+    }
+  std::vector<unsigned int> keepIndices;
   for(unsigned int i = 0; i < numInputGradients; ++i)
     {
-    keepIndices.push_back(i); // add all indicies
+    if(!isBad[i])
+      {
+      keepIndices.push_back(i);
+      }
     }
-  // remove the indices in badGradients
-  inBadList pred(badGradients);
-  keepIndices.remove_if(pred);
+  const unsigned int newGradientCount = numInputGradients - badGradients.size();
 
   if( keepIndices.size() != newGradientCount )
     {
@@ -124,23 +99,13 @@ int main(int argc, char *argv[])
     return 1;
     }
 
-  // create output volume
-  NrrdImageType::Pointer outImage = AllocVecImage<NrrdImageType>(inImage,newGradientCount);
-
-  // copy input vector pixels to output, skipping the bad gradients.
-  itk::ImageRegionConstIterator<NrrdImageType> inIt(inImage,inImage->GetLargestPossibleRegion());
-  itk::ImageRegionIterator<NrrdImageType> outIt(outImage,outImage->GetLargestPossibleRegion());
-  for(; !inIt.IsAtEnd(); ++inIt, ++outIt)
-    {
-    NrrdImageType::PixelType inPix = inIt.Get();
-    NrrdImageType::PixelType outpix(newGradientCount);
-    std::list<int>::iterator keepIt = keepIndices.begin();
-    for(unsigned int i = 0; i < newGradientCount; ++i, ++keepIt)
-      {
-      outpix[i] = inPix[*(keepIt)];
-      }
-    outIt.Set(outpix);
-    }
+  // Compact the kept gradients of every voxel in place, the input buffer
+  // becomes the output image.
+  inImage->DisconnectPipeline();
+  const DWIGradientGather gather(numInputGradients, keepIndices);
+  gather.CompactInPlace(inImage->GetBufferPointer(), inImage->GetBufferedRegion().GetNumberOfPixels() );
+  inImage->SetNumberOfComponentsPerPixel(newGradientCount);
+  NrrdImageType::Pointer outImage = inImage;
 
   // deal with gradients in meta data
   DWIMetaDataDictionaryValidator    nrrdMetaDataValidator;
@@ -155,10 +120,9 @@ int main(int argc, char *argv[])
   DWIMetaDataDictionaryValidator::GradientTableType outputGradTable( newGradientCount );
 
   // add the good gradients to the outputGradTable
-  std::list<int>::iterator keepIt = keepIndices.begin();
-  for(unsigned int i = 0; i < keepIndices.size(); ++i, ++keepIt)
+  for(unsigned int i = 0; i < keepIndices.size(); ++i)
     {
-    outputGradTable[i] = inputGradTable[*keepIt];
+    outputGradTable[i] = inputGradTable[keepIndices[i]];
     }
   nrrdMetaDataValidator.SetGradientTable( outputGradTable );
 
@@ -0,0 +1,186 @@
+/*=========================================================================
+ *
+ *  Copyright SINAPSE: Scalable Informatics for Neuroscience, Processing and Software Engineering
+ *            The University of Iowa
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#ifndef __DWIGradientGather_h
+#define __DWIGradientGather_h
+
+#include "itkMultiThreader.h"
+#include "itkIntTypes.h"
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <vector>
+
+/** \class DWIGradientGather
+ *
+ * Compacts a subset of the gradients (vector components) of a DWI buffer
+ * in place.
+ *
+ * The kept components are turned once into runs of consecutive components,
+ * so each voxel is moved with one block move per run instead of component
+ * by component.  Voxels are split across threads.
+ */
+class DWIGradientGather
+{
+public:
+  /** keep lists the input components to keep, in increasing order */
+  DWIGradientGather(const unsigned int numberOfInputComponents, const std::vector<unsigned int> & keep) :
+    m_NumberOfInputComponents(numberOfInputComponents),
+    m_Keep(keep)
+  {
+    for( unsigned int i = 0; i < keep.size(); ++i )
+      {
+      if( !m_Runs.empty() && m_Runs.back().Source + m_Runs.back().Length == keep[i] )
+        {
+        ++m_Runs.back().Length;
+        }
+      else
+        {
+        const RunType run = { keep[i], i, 1 };
+        m_Runs.push_back(run);
+        }
+      }
+  }
+
+  unsigned int GetNumberOfOutputComponents() const
+  {
+    return static_cast<unsigned int>(m_Keep.size() );
+  }
+
+  /** Compact the kept components of the voxels to the start of buffer.
+   * Each thread first compacts its own range of voxels to the start of that
+   * range, then the ranges are moved down in order. */
+  template <typename TPixel>
+  void CompactInPlace(TPixel *buffer, const itk::SizeValueType numberOfVoxels) const
+  {
+    assert( IsOrdered() );
+
+    GatherStruct<TPixel> str = { this, buffer, buffer, numberOfVoxels };
+    const itk::ThreadIdType numberOfThreads = Execute(str);
+
+    const itk::SizeValueType outputComponents = m_Keep.size();
+    for( itk::ThreadIdType t = 1; t < numberOfThreads; ++t )
+      {
+      itk::SizeValueType start;
+      itk::SizeValueType end;
+      ThreadRange(numberOfVoxels, t, numberOfThreads, start, end);
+      memmove(buffer + start * outputComponents, buffer + start * m_NumberOfInputComponents,
+              ( end - start ) * outputComponents * sizeof(TPixel) );
+      }
+  }
+
+private:
+  struct RunType
+    {
+    unsigned int Source;
+    unsigned int Destination;
+    unsigned int Length;
+    };
+
+  template <typename TPixel>
+  struct GatherStruct
+    {
+    const DWIGradientGather *Gather;
+    const TPixel *In;
+    TPixel *Out;
+    itk::SizeValueType NumberOfVoxels;
+    };
+
+  /** true when the kept components are in increasing order, so every run
+   * moves backwards in memory */
+  bool IsOrdered() const
+  {
+    for( unsigned int i = 1; i < m_Keep.size(); ++i )
+      {
+      if( m_Keep[i] <= m_Keep[i - 1] )
+        {
+        return false;
+        }
+      }
+    return true;
+  }
+
+  static void ThreadRange(const itk::SizeValueType numberOfVoxels, const itk::ThreadIdType threadId,
+                          const itk::ThreadIdType numberOfThreads,
+                          itk::SizeValueType & start, itk::SizeValueType & end)
+  {
+    const itk::SizeValueType chunk = ( numberOfVoxels + numberOfThreads - 1 ) / numberOfThreads;
+
+    start = std::min(numberOfVoxels, threadId * chunk);
+    end = std::min(numberOfVoxels, start + chunk);
+  }
+
+  template <typename TPixel>
+  itk::ThreadIdType Execute(GatherStruct<TPixel> & str) const
+  {
+    itk::MultiThreader::Pointer threader = itk::MultiThreader::New();
+    const itk::ThreadIdType numberOfThreads =
+      static_cast<itk::ThreadIdType>(std::max<itk::SizeValueType>(1, std::min<itk::SizeValueType>(
+                                                                      threader->GetNumberOfThreads(),
+                                                                      str.NumberOfVoxels) ) );
+
+    threader->SetNumberOfThreads(numberOfThreads);
+    threader->SetSingleMethod(ThreaderCallback<TPixel>, &str);
+    threader->SingleMethodExecute();
+    return numberOfThreads;
+  }
+
+  template <typename TPixel>
+  static ITK_THREAD_RETURN_TYPE ThreaderCallback(void *arg)
+  {
+    itk::MultiThreader::ThreadInfoStruct * info = static_cast<itk::MultiThreader::ThreadInfoStruct *>(arg);
+    const GatherStruct<TPixel> *           str = static_cast<const GatherStruct<TPixel> *>(info->UserData);
+
+    itk::SizeValueType start;
+    itk::SizeValueType end;
+    ThreadRange(str->NumberOfVoxels, info->ThreadID, info->NumberOfThreads, start, end);
+    if( start < end && !str->Gather->m_Keep.empty() )
+      {
+      // compacted to the start of this thread's own input range
+      str->Gather->GatherVoxels(str->In, str->Out + start * str->Gather->m_NumberOfInputComponents, start, end);
+      }
+    return ITK_THREAD_RETURN_VALUE;
+  }
+
+  /** voxels [start, end) of in to out, out pointing at the output of voxel
+   * start.  With increasing kept components every run moves backwards in
+   * memory, so out may overlap in as long as it does not lead it. */
+  template <typename TPixel>
+  void GatherVoxels(const TPixel *in, TPixel *out, const itk::SizeValueType start, const itk::SizeValueType end) const
+  {
+    const itk::SizeValueType outputComponents = m_Keep.size();
+    const size_t             numberOfRuns = m_Runs.size();
+
+    for( itk::SizeValueType v = start; v < end; ++v )
+      {
+      const TPixel * const inPixel = in + v * m_NumberOfInputComponents;
+      TPixel * const       outPixel = out + ( v - start ) * outputComponents;
+      for( size_t r = 0; r < numberOfRuns; ++r )
+        {
+        const RunType & run = m_Runs[r];
+        memmove(outPixel + run.Destination, inPixel + run.Source, run.Length * sizeof(TPixel) );
+        }
+      }
+  }
+
+  const unsigned int              m_NumberOfInputComponents;
+  const std::vector<unsigned int> m_Keep;
+  std::vector<RunType>            m_Runs;
+};
+
+#endif // __DWIGradientGather_h
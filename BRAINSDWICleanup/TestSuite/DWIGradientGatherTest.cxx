@@ -0,0 +1,97 @@
+/*=========================================================================
+ *
+ *  Copyright SINAPSE: Scalable Informatics for Neuroscience, Processing and Software Engineering
+ *            The University of Iowa
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#include "DWIGradientGather.h"
+
+#include <iostream>
+#include <vector>
+
+/** true when compacting in place matches a component by component copy */
+static bool
+CompactMatchesCopy(const unsigned int numberOfComponents, const std::vector<unsigned int> & keep,
+                   const itk::SizeValueType numberOfVoxels)
+{
+  std::vector<short> buffer(numberOfVoxels * numberOfComponents + 1);
+  for( size_t i = 0; i < buffer.size(); ++i )
+    {
+    buffer[i] = static_cast<short>( i % 30011 );
+    }
+
+  std::vector<short> expected;
+  for( itk::SizeValueType v = 0; v < numberOfVoxels; ++v )
+    {
+    for( size_t k = 0; k < keep.size(); ++k )
+      {
+      expected.push_back(buffer[v * numberOfComponents + keep[k]]);
+      }
+    }
+
+  const DWIGradientGather gather(numberOfComponents, keep);
+  gather.CompactInPlace(&buffer[0], numberOfVoxels);
+
+  bool same = gather.GetNumberOfOutputComponents() == keep.size();
+  for( size_t i = 0; same && i < expected.size(); ++i )
+    {
+    same = buffer[i] == expected[i];
+    }
+  if( !same )
+    {
+    std::cerr << "Keeping " << keep.size() << " of " << numberOfComponents << " components of "
+              << numberOfVoxels << " voxels does not match the copy" << std::endl;
+    }
+  return same;
+}
+
+int main( int, char * [] )
+{
+  // several threads, and voxel counts that do not split evenly across them
+  itk::MultiThreader::SetGlobalDefaultNumberOfThreads(4);
+
+  const unsigned int numberOfComponents = 10;
+  const unsigned int dropFirst[] = { 1, 2, 3, 4, 5, 6, 7, 8, 9 };
+  const unsigned int dropMiddle[] = { 0, 1, 2, 3, 6, 7, 8, 9 };
+  const unsigned int dropLast[] = { 0, 1, 2, 3, 4, 5, 6, 7, 8 };
+  const unsigned int severalRuns[] = { 1, 2, 4, 5, 6, 9 };
+  const unsigned int keepOne[] = { 7 };
+
+  std::vector<std::vector<unsigned int> > keepSets;
+  keepSets.push_back(std::vector<unsigned int>(dropFirst, dropFirst + 9) );
+  keepSets.push_back(std::vector<unsigned int>(dropMiddle, dropMiddle + 8) );
+  keepSets.push_back(std::vector<unsigned int>(dropLast, dropLast + 9) );
+  keepSets.push_back(std::vector<unsigned int>(severalRuns, severalRuns + 6) );
+  keepSets.push_back(std::vector<unsigned int>(keepOne, keepOne + 1) );
+  keepSets.push_back(std::vector<unsigned int>() );
+
+  const itk::SizeValueType voxelCounts[] = { 1, 3, 4, 1003 };
+
+  bool allPass = true;
+  for( size_t s = 0; s < keepSets.size(); ++s )
+    {
+    for( unsigned int c = 0; c < sizeof( voxelCounts ) / sizeof( voxelCounts[0] ); ++c )
+      {
+      allPass = CompactMatchesCopy(numberOfComponents, keepSets[s], voxelCounts[c]) && allPass;
+      }
+    }
+
+  if( !allPass )
+    {
+    return EXIT_FAILURE;
+    }
+  std::cout << "All compactions match" << std::endl;
+  return EXIT_SUCCESS;
+}
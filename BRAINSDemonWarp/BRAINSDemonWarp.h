@@ -245,6 +245,12 @@ public:
     this->Modified();
   }
 
+  void SetRegistrationCacheKey(const BRAINSUtils::RegistrationCacheKey & key)
+  {
+    this->m_Registrator->SetRegistrationCacheKey(key);
+    this->Modified();
+  }
+
 protected:
 
   BRAINSDemonWarp();
@@ -194,6 +194,22 @@ void ThirionFunction(const struct BRAINSDemonWarpAppParameters & command)
     > AppType;
   typename  AppType::Pointer app = AppType::New();
 
+  // Everything but the images that the deformation field depends on, for
+  // the registration cache (enabled by the BRAINS_REGISTRATION_CACHE
+  // environment variable); the registrator adds the preprocessed images.
+  const bool                        useRegistrationCache = BRAINSUtils::RegistrationCache().IsEnabled();
+  BRAINSUtils::RegistrationCacheKey registrationKey("BRAINSDemonWarp");
+  registrationKey.AddParameter("registrationFilterType", command.registrationFilterType);
+  registrationKey.AddParameter("maskProcessingMode", command.maskProcessingMode);
+  registrationKey.AddParameter("maxStepLength", command.maxStepLength);
+  registrationKey.AddParameter("gradientType", command.gradientType);
+  registrationKey.AddParameter("smoothDisplacementFieldSigma", command.smoothDisplacementFieldSigma);
+  registrationKey.AddParameter("smoothingUp", command.smoothingUp);
+  registrationKey.AddParameter("numberOfLevels", command.numberOfLevels);
+  registrationKey.AddParameter("numberOfIterations", command.numberOfIterations);
+  registrationKey.AddParameter("theMovingImageShrinkFactors", command.theMovingImageShrinkFactors);
+  registrationKey.AddParameter("theFixedImageShrinkFactors", command.theFixedImageShrinkFactors);
+
   // Set up the diffeomorphic demons filter with mask
 
   if( command.outputDebug )
@@ -312,6 +328,11 @@ void ThirionFunction(const struct BRAINSDemonWarpAppParameters & command)
 
         actualfilter->SetFixedImageMask( dynamic_cast<SpatialObjectType *>( fixedMask.GetPointer() ) );
         actualfilter->SetMovingImageMask( dynamic_cast<SpatialObjectType *>( movingMask.GetPointer() ) );
+        if( useRegistrationCache )
+          {
+          registrationKey.AddMask("fixed mask", fixedMask.GetPointer() );
+          registrationKey.AddMask("moving mask", movingMask.GetPointer() );
+          }
         }
       else if( command.maskProcessingMode == "ROI" )
         {
@@ -335,6 +356,11 @@ void ThirionFunction(const struct BRAINSDemonWarpAppParameters & command)
             movingVolume);
         actualfilter->SetFixedImageMask(fixedMask);
         actualfilter->SetMovingImageMask(movingMask);
+        if( useRegistrationCache )
+          {
+          registrationKey.AddMask("fixed mask", fixedMask.GetPointer() );
+          registrationKey.AddMask("moving mask", movingMask.GetPointer() );
+          }
         }
       filter = actualfilter;
       }
@@ -546,6 +572,10 @@ void ThirionFunction(const struct BRAINSDemonWarpAppParameters & command)
               << command.backgroundFillValue << "." << std::endl;
     }
   app->SetDefaultPixelValue(command.backgroundFillValue);
+  if( useRegistrationCache )
+    {
+    app->SetRegistrationCacheKey(registrationKey);
+    }
   if( command.outputDebug )
     {
     std::cout << "Running Thirion Registration" << std::endl;
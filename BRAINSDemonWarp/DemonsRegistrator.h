@@ -26,6 +26,7 @@
 #include "itkRecursiveMultiResolutionPyramidImageFilter.h"
 
 #include "itkArray.h"
+#include "BRAINSRegistrationCache.h"
 
 namespace itk
 {
@@ -61,6 +62,10 @@ namespace itk
   *   - output image
   *   - Checkerboard image
   *   - x,y,z components of displacement fields.
+  *
+  * When a registration cache key is set and the registration cache is
+  * enabled, the deformation field is reused from the cache for the same
+  * key, fixed, moving and initial images.
   */
 template <
   class TRealImage,
@@ -220,6 +225,13 @@ public:
     return m_Registration;
   }
 
+  /** Key of everything but the images that the registration depends on */
+  void SetRegistrationCacheKey(const BRAINSUtils::RegistrationCacheKey & key)
+  {
+    m_RegistrationCacheKey = key;
+    m_UseRegistrationCache = true;
+  }
+
 protected:
   DemonsRegistrator();
   ~DemonsRegistrator();
@@ -257,6 +269,9 @@ private:
   bool             m_OutDebug;
   bool             m_UseHistogramMatching;
   std::string      m_InterpolationMode;
+
+  BRAINSUtils::RegistrationCacheKey m_RegistrationCacheKey;
+  bool                              m_UseRegistrationCache;
 };
 }   // namespace itk
 
@@ -105,6 +105,7 @@ DemonsRegistrator<TRealImage, TOutputImage, TFieldValue>::DemonsRegistrator() :
   m_NumberOfLevels(1),
   m_NumberOfIterations(UnsignedIntArray(1) ),
   m_DisplacementField(ITK_NULLPTR),
+  m_Tag(0),
   m_DisplacementBaseName("none"),
   m_WarpedImageName("none"),
   m_CheckerBoardFilename("none"),
@@ -112,7 +113,8 @@ DemonsRegistrator<TRealImage, TOutputImage, TFieldValue>::DemonsRegistrator() :
   m_OutNormalized("OFF"),
   m_OutDebug(false),
   m_UseHistogramMatching(false),
-  m_InterpolationMode("Linear")
+  m_InterpolationMode("Linear"),
+  m_UseRegistrationCache(false)
 {
   //TODO: Needed for ITKv4 registration m_Registration->InPlaceOn();
   // Set up internal registrator with default components
@@ -158,8 +160,24 @@ void DemonsRegistrator<TRealImage, TOutputImage, TFieldValue>::Execute()
   m_MovingImagePyramid->SetNumberOfLevels(m_NumberOfLevels);
   m_MovingImagePyramid->SetStartingShrinkFactors( m_MovingImageShrinkFactors.GetDataPointer() );
 #endif
-  // Setup the registrator
+  // Reuse the deformation field of a previous run when it is in the cache
+  const BRAINSUtils::RegistrationCache registrationCache;
+  BRAINSUtils::RegistrationCacheKey    registrationKey(m_RegistrationCacheKey);
+  const bool                           useRegistrationCache = m_UseRegistrationCache && registrationCache.IsEnabled();
+  if( useRegistrationCache )
+    {
+    registrationKey.AddImage("fixed", m_FixedImage.GetPointer() );
+    registrationKey.AddImage("moving", m_MovingImage.GetPointer() );
+    registrationKey.AddImage("initial", m_InitialDisplacementField.GetPointer() );
+    m_DisplacementField = registrationCache.FetchImage<TDisplacementField>(registrationKey);
+    if( m_DisplacementField.IsNotNull() )
+      {
+      std::cout << "Reusing cached registration " << registrationKey.GetDigest() << std::endl;
+      }
+    }
 
+  // Setup the registrator
+  if( m_DisplacementField.IsNull() )
     {
     // Setup an registration observer
     typedef SimpleMemberCommand<Self> CommandType;
@@ -247,6 +265,10 @@ void DemonsRegistrator<TRealImage, TOutputImage, TFieldValue>::Execute()
         m_Tag = 0;
         }
       m_Registration = ITK_NULLPTR;
+      if( useRegistrationCache )
+        {
+        registrationCache.StoreImage<TDisplacementField>(registrationKey, m_DisplacementField.GetPointer() );
+        }
       }
     catch( itk::ExceptionObject & err )
       {
@@ -17,10 +17,12 @@
  *
  *=========================================================================*/
 #include <sstream>
+#include <limits>
 #include "itkMedianImageFilter.h"
 #include "itkExtractImageFilter.h"
 #include "BRAINSCommonLib.h"
 #include "BRAINSThreadControl.h"
+#include "BRAINSRegistrationCache.h"
 #include "BRAINSFitHelper.h"
 #include "BRAINSFitCLP.h"
 
@@ -537,8 +539,77 @@ int main(int argc, char *argv[])
       {
       myHelper->PrintCommandLine(true, "BF");
       }
-    myHelper->Update();
-    currentGenericTransform = myHelper->GetCurrentGenericTransform();
+
+    // The registration is reused from the registration cache (enabled by the
+    // BRAINS_REGISTRATION_CACHE environment variable) unless the run needs
+    // more from the registration than its transform.
+    const bool preprocessesMovingVolume = histogramMatch
+      || removeIntensityOutliers > std::numeric_limits<float>::epsilon();
+    const BRAINSUtils::RegistrationCache registrationCache;
+    const bool                           useRegistrationCache = registrationCache.IsEnabled()
+      && logFileReport.empty() && outputFixedVolumeROI.empty() && outputMovingVolumeROI.empty()
+      && !UseDebugImageViewer && ( outputVolume.empty() || !preprocessesMovingVolume );
+    BRAINSUtils::RegistrationCacheKey registrationKey("BRAINSFit");
+    GenericTransformType::Pointer     cachedTransform;
+    if( useRegistrationCache )
+      {
+      registrationKey.AddImage("fixed", extractFixedVolume.GetPointer() );
+      registrationKey.AddImage("moving", extractMovingVolume.GetPointer() );
+      registrationKey.AddImage("fixed2", extractFixedVolume2.GetPointer() );
+      registrationKey.AddImage("moving2", extractMovingVolume2.GetPointer() );
+      registrationKey.AddMask("fixed mask", fixedMask.GetPointer() );
+      registrationKey.AddMask("moving mask", movingMask.GetPointer() );
+      registrationKey.AddTransform("initial", currentGenericTransform.GetPointer() );
+      registrationKey.AddParameter("transformType", localTransformType);
+      registrationKey.AddParameter("initializeTransformMode", localInitializeTransformMode);
+      registrationKey.AddParameter("histogramMatch", histogramMatch);
+      registrationKey.AddParameter("removeIntensityOutliers", removeIntensityOutliers);
+      registrationKey.AddParameter("numberOfMatchPoints", numberOfMatchPoints);
+      registrationKey.AddParameter("samplingPercentage", samplingPercentage);
+      registrationKey.AddParameter("numberOfHistogramBins", numberOfHistogramBins);
+      registrationKey.AddParameter("numberOfIterations", numberOfIterations);
+      registrationKey.AddParameter("maximumStepLength", maximumStepLength);
+      registrationKey.AddParameter("minimumStepLength", minimumStepLength);
+      registrationKey.AddParameter("relaxationFactor", relaxationFactor);
+      registrationKey.AddParameter("translationScale", translationScale);
+      registrationKey.AddParameter("reproportionScale", reproportionScale);
+      registrationKey.AddParameter("skewScale", skewScale);
+      registrationKey.AddParameter("backgroundFillValue", backgroundFillValue);
+      registrationKey.AddParameter("maskInferiorCutOffFromCenter", maskInferiorCutOffFromCenter);
+      registrationKey.AddParameter("splineGridSize", BSplineGridSize);
+      registrationKey.AddParameter("costFunctionConvergenceFactor", costFunctionConvergenceFactor);
+      registrationKey.AddParameter("projectedGradientTolerance", projectedGradientTolerance);
+      registrationKey.AddParameter("maxBSplineDisplacement", maxBSplineDisplacement);
+      registrationKey.AddParameter("costMetric", costMetric);
+      registrationKey.AddParameter("useROIBSpline", useROIBSpline);
+      registrationKey.AddParameter("metricSamplingStrategy", metricSamplingStrategy);
+      registrationKey.AddParameter("initializeRegistrationByCurrentGenericTransform",
+                                   initializeRegistrationByCurrentGenericTransform);
+      registrationKey.AddParameter("maximumNumberOfEvaluations", maximumNumberOfEvaluations);
+      registrationKey.AddParameter("maximumNumberOfCorrections", maximumNumberOfCorrections);
+      registrationKey.AddParameter("writeOutputTransformInFloat", writeOutputTransformInFloat);
+      registrationKey.AddParameter("normalizeInputImages", NormalizeInputImages);
+      cachedTransform = registrationCache.FetchTransform(registrationKey);
+      }
+    if( cachedTransform.IsNotNull() )
+      {
+      std::cout << "Reusing cached registration " << registrationKey.GetDigest() << std::endl;
+      currentGenericTransform = dynamic_cast<CompositeTransformType *>( cachedTransform.GetPointer() );
+      if( currentGenericTransform.IsNull() )
+        {
+        currentGenericTransform = CompositeTransformType::New();
+        currentGenericTransform->AddTransform( cachedTransform );
+        }
+      }
+    else
+      {
+      myHelper->Update();
+      currentGenericTransform = myHelper->GetCurrentGenericTransform();
+      if( useRegistrationCache )
+        {
+        registrationCache.StoreTransform(registrationKey, currentGenericTransform.GetPointer() );
+        }
+      }
 
     std::string currentGenericTransformFileType;
     if ( currentGenericTransform.IsNotNull() )
@@ -551,7 +622,11 @@ int main(int argc, char *argv[])
       }
     CompositeTransformType::Pointer outputComposite = static_cast<CompositeTransformType *>( currentGenericTransform.GetPointer() );
 
-    MovingVolumeType::ConstPointer preprocessedMovingVolume = myHelper->GetPreprocessedMovingVolume();
+    // A cached registration did not preprocess the moving volume; the cache
+    // is only used with an output volume when preprocessing is a no-op.
+    MovingVolumeType::ConstPointer preprocessedMovingVolume = cachedTransform.IsNotNull()
+      ? MovingVolumeType::ConstPointer( extractMovingVolume.GetPointer() )
+      : myHelper->GetPreprocessedMovingVolume();
     if( NormalizeInputImages )
       {
       preprocessedMovingVolume = extractMovingVolume; // The resampled image should not be normalized
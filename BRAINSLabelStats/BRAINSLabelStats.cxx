@@ -35,12 +35,11 @@ PURPOSE.  See the above copyright notices for more information.
 #include <string>
 
 #include "itkImage.h"
-#include "itkLabelStatisticsImageFilter.h"
-#include "itkMinimumMaximumImageFilter.h"
 #include "itkImageFileReader.h"
 #include "itkDOMNodeXMLReader.h"
 #include "itkDOMNode.h"
 
+#include "BRAINSLabelStatsEngine.h"
 #include "BRAINSLabelStatsCLP.h"
 
 std::string GetXmlLabelName( std::string fileName, int label )
@@ -143,6 +142,115 @@ std::string GetLabelName( int mode, std::string fileName, int label )
   return "UNKNOWN";
 }
 
+typedef itk::Image<float, 3> ImageType;
+typedef itk::Image<short, 3> LabelType;
+
+typedef BRAINSLabelStats::LabelStatisticsEngine<ImageType, LabelType> StatsEngineType;
+typedef StatsEngineType::LabelStatisticsType                          LabelStatisticsType;
+
+/* Writes one CSV row per label (and per image when there are several
+ * images) as soon as the engine hands the label over. */
+class CSVLabelStatsWriter : public BRAINSLabelStats::LabelStatisticsSink<LabelStatisticsType>
+{
+public:
+  CSVLabelStatsWriter(std::ostream & out, const std::vector<std::string> & prefixValues,
+                      const int mode, const std::string & labelNameFile,
+                      const std::vector<std::string> & imageNames) :
+    m_Out(out),
+    m_PrefixValues(prefixValues),
+    m_Mode(mode),
+    m_LabelNameFile(labelNameFile),
+    m_ImageNames(imageNames)
+  {
+  }
+
+  void WriteHeader(const std::vector<std::string> & prefixNames)
+  {
+    for( size_t i = 0; i < prefixNames.size(); ++i )
+      {
+      m_Out << prefixNames[i] << ", ";
+      }
+    m_Out << "Name, label, ";
+    if( m_ImageNames.size() > 1 )
+      {
+      m_Out << "image, ";
+      }
+    m_Out << "min, max, median, mean, stddev, var, sum, count" << std::endl;
+  }
+
+  virtual void Write(const LabelStatisticsType & stats)
+  {
+    const std::string labelName = GetLabelName(m_Mode, m_LabelNameFile, stats.m_Label);
+
+    for( unsigned int k = 0; k < m_ImageNames.size(); ++k )
+      {
+      const BRAINSLabelStats::ImageStatistics & image = stats.m_Images[k];
+      for( size_t i = 0; i < m_PrefixValues.size(); ++i )
+        {
+        m_Out << m_PrefixValues[i] << ", ";
+        }
+      m_Out << labelName << ", ";
+      m_Out << stats.m_Label << ", ";
+      if( m_ImageNames.size() > 1 )
+        {
+        m_Out << m_ImageNames[k] << ", ";
+        }
+      m_Out << image.m_Minimum << ", ";
+      m_Out << image.m_Maximum << ", ";
+      m_Out << static_cast<float>(image.m_Median) << ", ";
+      m_Out << stats.GetMean(k) << ", ";
+      m_Out << stats.GetSigma(k) << ", ";
+      m_Out << stats.GetVariance(k) << ", ";
+      m_Out << image.m_Sum << ", ";
+      m_Out << stats.m_Count << std::endl;
+      }
+  }
+
+private:
+  std::ostream &                   m_Out;
+  const std::vector<std::string> & m_PrefixValues;
+  const int                        m_Mode;
+  const std::string                m_LabelNameFile;
+  const std::vector<std::string> & m_ImageNames;
+};
+
+/* Check that an image and the label map define the same space */
+bool ImageMatchesLabelSpace(const ImageType *image, const LabelType *label)
+{
+  const ImageType::SizeType    imageSize = image->GetLargestPossibleRegion().GetSize();
+  const ImageType::SpacingType imageSpacing = image->GetSpacing();
+  const ImageType::PointType   imageOrigin = image->GetOrigin();
+  const LabelType::SizeType    labelSize = label->GetLargestPossibleRegion().GetSize();
+  const LabelType::SpacingType labelSpacing = label->GetSpacing();
+  const LabelType::PointType   labelOrigin = label->GetOrigin();
+
+  for( size_t i = 0; i < 3; ++i )
+    {
+    if( imageSize[i] != labelSize[i] )
+      {
+      std::cout << "Error: Image and label size do not match" << std::endl;
+      std::cout << "Image: " << imageSize << std::endl;
+      std::cout << "Label: " << labelSize << std::endl;
+      return false;
+      }
+    if( fabs(labelSpacing[i] - imageSpacing[i]) > 0.01 )
+      {
+      std::cout << "Error: Image and label spacing do not match" << std::endl;
+      std::cout << "Image: " << imageSpacing << std::endl;
+      std::cout << "Label: " << labelSpacing << std::endl;
+      return false;
+      }
+    if( fabs(labelOrigin[i] - imageOrigin[i]) > 0.01 )
+      {
+      std::cout << "Error: Image and label origin do not match" << std::endl;
+      std::cout << "Image: " << imageOrigin << std::endl;
+      std::cout << "Label: " << labelOrigin << std::endl;
+      return false;
+      }
+    }
+  return true;
+}
+
 int main(int argc, char *argv[])
 {
   PARSE_ARGS;
@@ -178,6 +286,10 @@ int main(int argc, char *argv[])
     {
     std::cout << "=====================================================" << std::endl;
     std::cout << "Image: " <<   imageVolume << std::endl;
+    for( size_t i = 0; i < additionalImageVolume.size(); ++i )
+      {
+      std::cout << "Additional Image: " <<   additionalImageVolume[i] << std::endl;
+      }
     std::cout << "Label Map: " <<   labelVolume << std::endl;
     std::cout << "Label Name File: " <<   labelNameFile << std::endl;
     std::cout << "Column Prefix Names: ";
@@ -200,85 +312,42 @@ int main(int argc, char *argv[])
     std::cout << "=====================================================" << std::endl;
     }
 
-  typedef itk::Image<float, 3>            ImageType;
-  typedef itk::ImageFileReader<ImageType> ImageReaderType;
-  ImageReaderType::Pointer imageReader = ImageReaderType::New();
-  imageReader->SetFileName( imageVolume );
-  imageReader->UpdateLargestPossibleRegion();
-
-  ImageType::RegionType  imageRegion;
-  ImageType::SizeType    imageSize;
-  ImageType::SpacingType imageSpacing;
-  ImageType::PointType   imageOrigin;
-  imageRegion = imageReader->GetOutput()->GetLargestPossibleRegion();
-  imageSize = imageRegion.GetSize();
-  imageSpacing = imageReader->GetOutput()->GetSpacing();
-  imageOrigin = imageReader->GetOutput()->GetOrigin();
-
-  typedef itk::Image<short, 3>            LabelType;
   typedef itk::ImageFileReader<LabelType> LabelReaderType;
   LabelReaderType::Pointer labelReader = LabelReaderType::New();
   labelReader->SetFileName( labelVolume );
   labelReader->UpdateLargestPossibleRegion();
 
-  LabelType::RegionType  labelRegion;
-  LabelType::SizeType    labelSize;
-  LabelType::SpacingType labelSpacing;
-  LabelType::PointType   labelOrigin;
-  labelRegion = labelReader->GetOutput()->GetLargestPossibleRegion();
-  labelSize = labelRegion.GetSize();
-  labelSpacing = labelReader->GetOutput()->GetSpacing();
-  labelOrigin = labelReader->GetOutput()->GetOrigin();
-  // Check the Image and Label Map to Make sure they define the same space
-  for( size_t i = 0; i < 3; ++i )
+  StatsEngineType statsEngine;
+  statsEngine.SetLabelImage( labelReader->GetOutput() );
+
+  // All intensity images are processed together in the same passes
+  std::vector<std::string> imageNames(1, imageVolume);
+  imageNames.insert(imageNames.end(), additionalImageVolume.begin(), additionalImageVolume.end() );
+
+  typedef itk::ImageFileReader<ImageType> ImageReaderType;
+  for( size_t i = 0; i < imageNames.size(); ++i )
     {
-    if( imageSize[i] != labelSize[i] )
-      {
-      std::cout << "Error: Image and label size do not match" << std::endl;
-      std::cout << "Image: " << imageSize << std::endl;
-      std::cout << "Label: " << labelSize << std::endl;
-      return EXIT_FAILURE;
-      }
-    if( fabs(labelSpacing[i] - imageSpacing[i]) > 0.01 )
-      {
-      std::cout << "Error: Image and label spacing do not match" << std::endl;
-      std::cout << "Image: " << imageSpacing << std::endl;
-      std::cout << "Label: " << labelSpacing << std::endl;
-      return EXIT_FAILURE;
-      }
-    if( fabs(labelOrigin[i] - imageOrigin[i]) > 0.01 )
+    ImageReaderType::Pointer imageReader = ImageReaderType::New();
+    imageReader->SetFileName( imageNames[i] );
+    imageReader->UpdateLargestPossibleRegion();
+    if( !ImageMatchesLabelSpace( imageReader->GetOutput(), labelReader->GetOutput() ) )
       {
-      std::cout << "Error: Image and label origin do not match" << std::endl;
-      std::cout << "Image: " << imageOrigin << std::endl;
-      std::cout << "Label: " << labelOrigin << std::endl;
       return EXIT_FAILURE;
       }
+    statsEngine.AddImage( imageReader->GetOutput() );
     }
 
-  float minValue;
-  float maxValue;
-  bool  computeGlobalHistogram = false;
-
   if( minMaxType == "manual" )
     {
-    minValue = userDefineMinimum;
-    maxValue = userDefineMaximum;
-    computeGlobalHistogram = true;
+    statsEngine.SetHistogramParameters(numberOfHistogramBins, userDefineMinimum, userDefineMaximum);
     }
   else if( minMaxType == "image" )
     {
-    typedef itk::MinimumMaximumImageFilter<ImageType> MinMaxFilterType;
-    MinMaxFilterType::Pointer minMaxFilter = MinMaxFilterType::New();
-    minMaxFilter->SetInput( imageReader->GetOutput() );
-    minMaxFilter->UpdateLargestPossibleRegion();
-    minValue = minMaxFilter->GetMinimum();
-    maxValue = minMaxFilter->GetMaximum();
-    computeGlobalHistogram = true;
+    statsEngine.SetHistogramParameters(numberOfHistogramBins, StatsEngineType::ImageRange);
     }
   else if( minMaxType == "label" )
     {
-    std::cerr << "ERROR:  label method not yet implemented." << std::endl;
-    return EXIT_FAILURE;
+    statsEngine.SetHistogramParameters(numberOfHistogramBins, StatsEngineType::LabelRange);
     }
   else
     {
@@ -286,66 +355,17 @@ int main(int argc, char *argv[])
     return EXIT_FAILURE;
     }
 
-  typedef itk::LabelStatisticsImageFilter<ImageType, LabelType> StatsFilterType;
-  StatsFilterType::Pointer statsFilter = StatsFilterType::New();
-  statsFilter->SetInput( imageReader->GetOutput() );
-  statsFilter->SetLabelInput( labelReader->GetOutput() );
-  if( computeGlobalHistogram )
+  CSVLabelStatsWriter csvWriter(std::cout, outputPrefixColumnValues, mode, labelNameFile, imageNames);
+  csvWriter.WriteHeader(outputPrefixColumnNames);
+  statsEngine.SetSink(&csvWriter);
+  try
     {
-    statsFilter->UseHistogramsOn();
-    statsFilter->SetHistogramParameters(numberOfHistogramBins, minValue, maxValue);
+    statsEngine.Compute();
     }
-  statsFilter->UpdateLargestPossibleRegion();
-
-  typedef StatsFilterType::ValidLabelValuesContainerType ValidLabelValuesType;
-  typedef StatsFilterType::LabelPixelType                LabelPixelType;
-  for( size_t i = 0; i < outputPrefixColumnNames.size(); ++i )
+  catch( itk::ExceptionObject & err )
     {
-    std::cout << outputPrefixColumnNames[i] << ", ";
-    }
-  std::cout << "Name, label, min, max, median, mean, stddev, var, sum, count" << std::endl;
-  for( ValidLabelValuesType::const_iterator vIt = statsFilter->GetValidLabelValues().begin();
-       vIt != statsFilter->GetValidLabelValues().end();
-       ++vIt )
-    {
-    if( statsFilter->HasLabel(*vIt) )
-      {
-      LabelPixelType labelValue = *vIt;
-
-      std::string labelName = GetLabelName(mode, labelNameFile, labelValue);
-      for( size_t i = 0; i < outputPrefixColumnValues.size(); ++i )
-        {
-        std::cout << outputPrefixColumnValues[i] << ", ";
-        }
-      std::cout << labelName << ", ";
-      std::cout << labelValue << ", ";
-      std::cout << statsFilter->GetMinimum( labelValue ) << ", ";
-      std::cout << statsFilter->GetMaximum( labelValue ) << ", ";
-      float medianValue;
-
-      if( !computeGlobalHistogram )
-        {
-        minValue = statsFilter->GetMinimum( labelValue );
-        maxValue = statsFilter->GetMaximum( labelValue );
-        StatsFilterType::Pointer labelStatsFilter = StatsFilterType::New();
-        labelStatsFilter->SetInput( imageReader->GetOutput() );
-        labelStatsFilter->SetLabelInput( labelReader->GetOutput() );
-        labelStatsFilter->UseHistogramsOn();
-        labelStatsFilter->SetHistogramParameters(numberOfHistogramBins, minValue, maxValue);
-        labelStatsFilter->UpdateLargestPossibleRegion();
-        medianValue = labelStatsFilter->GetMedian( labelValue );
-        }
-      else
-        {
-        medianValue = statsFilter->GetMedian( labelValue );
-        }
-      std::cout << medianValue << ", ";
-      std::cout << statsFilter->GetMean( labelValue ) << ", ";
-      std::cout << statsFilter->GetSigma( labelValue ) << ", ";
-      std::cout << statsFilter->GetVariance( labelValue ) << ", ";
-      std::cout << statsFilter->GetSum( labelValue ) << ", ";
-      std::cout << statsFilter->GetCount( labelValue ) << std::endl;
-      }
+    std::cerr << err << std::endl;
+    return EXIT_FAILURE;
     }
   return EXIT_SUCCESS;
 }
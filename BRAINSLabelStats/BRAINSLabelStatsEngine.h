@@ -0,0 +1,773 @@
+/*=========================================================================
+ *
+ *  Copyright SINAPSE: Scalable Informatics for Neuroscience, Processing and Software Engineering
+ *            The University of Iowa
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#if !defined(__BRAINSLabelStatsEngine_h____)
+#define __BRAINSLabelStatsEngine_h____
+
+/* Statistics of several intensity images within every label of a label map.
+ *
+ * The counts, sums, sums of squares, minima, maxima and bounding boxes of
+ * all the labels and all the images are gathered in one threaded pass over
+ * the voxels, with a thread local accumulator per label that is merged at
+ * the end of the pass.
+ *
+ * When the histogram range is known before that pass, a fixed range or the
+ * [min,max] range of each image, the histograms are filled in the same
+ * pass.  The image ranges are found first with a scan of the intensities
+ * alone, which does not look up the labels.  Each thread then holds one
+ * histogram per label and image.
+ *
+ * The [min,max] range of each label and image is only known at the end of
+ * the first pass, so with that range the histograms are built in a second
+ * pass, label by label with the labels distributed across the threads.
+ * Each label only scans its own bounding box, and a thread only holds the
+ * histograms of the label it is working on.
+ *
+ * The quantiles are computed from the histograms label by label.  The
+ * results of a label are handed to the LabelStatisticsSink as soon as the
+ * label and all the labels before it are complete, so the results are
+ * written in increasing label order while the later labels are still being
+ * processed.
+ *
+ * The statistics are the ones of itk::LabelStatisticsImageFilter, including
+ * its histogram binning (values outside [lower, upper] are not counted, the
+ * upper bound falls in the last bin) and its median, the center of the bin
+ * holding the middle voxel.  Other quantiles are interpolated as in
+ * itk::Statistics::Histogram. */
+
+#include "itkImage.h"
+#include "itkMultiThreader.h"
+#include "itkSimpleFastMutexLock.h"
+#include "itkNumericTraits.h"
+#include "itkMacro.h"
+#include <vector>
+#include <map>
+#include <cmath>
+#include <algorithm>
+
+namespace BRAINSLabelStats
+{
+/* Statistics of one intensity image within one label */
+struct ImageStatistics
+  {
+  double m_Minimum;
+  double m_Maximum;
+  double m_Sum;
+  double m_SumOfSquares;
+  double m_HistogramLowerBound;
+  double m_HistogramUpperBound;
+  double m_Median;
+  std::vector<double>        m_Quantiles;  // one per requested probability
+  std::vector<itk::SizeValueType> m_Histogram; // only kept on request
+
+  ImageStatistics() :
+    m_Minimum(itk::NumericTraits<double>::max() ),
+    m_Maximum(itk::NumericTraits<double>::NonpositiveMin() ),
+    m_Sum(0.0),
+    m_SumOfSquares(0.0),
+    m_HistogramLowerBound(0.0),
+    m_HistogramUpperBound(0.0),
+    m_Median(0.0)
+  {
+  }
+
+  void Add(const double value)
+  {
+    m_Minimum = std::min(m_Minimum, value);
+    m_Maximum = std::max(m_Maximum, value);
+    m_Sum += value;
+    m_SumOfSquares += value * value;
+  }
+
+  void Merge(const ImageStatistics & other)
+  {
+    m_Minimum = std::min(m_Minimum, other.m_Minimum);
+    m_Maximum = std::max(m_Maximum, other.m_Maximum);
+    m_Sum += other.m_Sum;
+    m_SumOfSquares += other.m_SumOfSquares;
+    if( m_Histogram.size() < other.m_Histogram.size() )
+      {
+      m_Histogram.resize(other.m_Histogram.size(), 0);
+      }
+    for( size_t n = 0; n < other.m_Histogram.size(); ++n )
+      {
+      m_Histogram[n] += other.m_Histogram[n];
+      }
+  }
+  };
+
+/* Statistics of all the intensity images within one label */
+template <class TLabelPixel, unsigned int VDimension>
+struct LabelStatistics
+  {
+  typedef itk::Index<VDimension> IndexType;
+
+  TLabelPixel                  m_Label;
+  itk::SizeValueType           m_Count;
+  IndexType                    m_BoundingBoxMinimum;
+  IndexType                    m_BoundingBoxMaximum;
+  std::vector<ImageStatistics> m_Images;
+
+  LabelStatistics(const TLabelPixel label = TLabelPixel(), const unsigned int numberOfImages = 0) :
+    m_Label(label),
+    m_Count(0),
+    m_Images(numberOfImages)
+  {
+    m_BoundingBoxMinimum.Fill(itk::NumericTraits<itk::IndexValueType>::max() );
+    m_BoundingBoxMaximum.Fill(itk::NumericTraits<itk::IndexValueType>::NonpositiveMin() );
+  }
+
+  double GetMean(const unsigned int image) const
+  {
+    return m_Images[image].m_Sum / m_Count;
+  }
+
+  /* Unbiased variance, as in itk::LabelStatisticsImageFilter */
+  double GetVariance(const unsigned int image) const
+  {
+    if( m_Count < 2 )
+      {
+      return itk::NumericTraits<double>::max();
+      }
+    const ImageStatistics & s = m_Images[image];
+    return ( s.m_SumOfSquares - s.m_Sum * s.m_Sum / m_Count ) / ( m_Count - 1 );
+  }
+
+  double GetSigma(const unsigned int image) const
+  {
+    return std::sqrt(this->GetVariance(image) );
+  }
+
+  void Merge(const LabelStatistics & other)
+  {
+    m_Count += other.m_Count;
+    for( unsigned int d = 0; d < VDimension; ++d )
+      {
+      m_BoundingBoxMinimum[d] = std::min(m_BoundingBoxMinimum[d], other.m_BoundingBoxMinimum[d]);
+      m_BoundingBoxMaximum[d] = std::max(m_BoundingBoxMaximum[d], other.m_BoundingBoxMaximum[d]);
+      }
+    for( size_t k = 0; k < m_Images.size(); ++k )
+      {
+      m_Images[k].Merge(other.m_Images[k]);
+      }
+  }
+  };
+
+/* Receives the statistics of each label, in increasing label order.  The
+ * calls are serialized but may come from any thread. */
+template <class TLabelStatistics>
+class LabelStatisticsSink
+{
+public:
+  virtual ~LabelStatisticsSink()
+  {
+  }
+
+  virtual void Write(const TLabelStatistics & stats) = 0;
+};
+
+/* Counts value in a histogram of histogram.size() uniform bins starting at
+ * lower, scale being the number of bins per intensity unit.  Values outside
+ * the range are not counted and the upper bound is in the last bin, as in
+ * itk::Statistics::Histogram. */
+inline void AddToHistogram(std::vector<itk::SizeValueType> & histogram, const double value,
+                           const double lower, const double scale)
+{
+  const double position = ( value - lower ) * scale;
+  const double size = static_cast<double>( histogram.size() );
+
+  if( position >= 0.0 && position < size )
+    {
+    ++histogram[static_cast<size_t>(position)];
+    }
+  else if( position == size )
+    {
+    ++histogram.back();
+    }
+}
+
+/* Median of itk::LabelStatisticsImageFilter::GetMedian(): the center of
+ * the bin where the cumulated frequency first exceeds count / 2 (integer
+ * division), count being the number of voxels of the label. */
+inline double HistogramMedian(const std::vector<itk::SizeValueType> & histogram,
+                              const double lower, const double upper, const itk::SizeValueType count)
+{
+  const size_t size = histogram.size();
+
+  if( size == 0 )
+    {
+    return 0.0;
+    }
+  size_t             bin = 0;
+  itk::SizeValueType total = 0;
+  while( total <= count / 2 && bin < size )
+    {
+    total += histogram[bin];
+    ++bin;
+    }
+  --bin;
+  const double interval = ( upper - lower ) / size;
+  return lower + ( bin + 0.5 ) * interval;
+}
+
+/* Quantile p of the histogram with uniform bins over [lower, upper], with
+ * the bin interpolation of itk::Statistics::Histogram::Quantile(). */
+inline double HistogramQuantile(const std::vector<itk::SizeValueType> & histogram,
+                                const double lower, const double upper, const double p)
+{
+  const size_t size = histogram.size();
+  double       totalFrequency = 0.0;
+
+  for( size_t n = 0; n < size; ++n )
+    {
+    totalFrequency += histogram[n];
+    }
+  if( size == 0 || totalFrequency == 0.0 )
+    {
+    return 0.0;
+    }
+  const double interval = ( upper - lower ) / size;
+  double       cumulated = 0.0;
+  double       p_n = 0.0;
+  double       p_n_prev = 0.0;
+  double       f_n = 0.0;
+  if( p < 0.5 )
+    {
+    size_t n = 0;
+    do
+      {
+      f_n = histogram[n];
+      cumulated += f_n;
+      p_n_prev = p_n;
+      p_n = cumulated / totalFrequency;
+      ++n;
+      }
+    while( n < size && p_n < p );
+    const double binMin = lower + ( n - 1 ) * interval;
+    return binMin + ( ( p - p_n_prev ) / ( f_n / totalFrequency ) ) * interval;
+    }
+  long   n = static_cast<long>(size) - 1;
+  size_t m = 0;
+  p_n = 1.0;
+  do
+    {
+    f_n = histogram[n];
+    cumulated += f_n;
+    p_n_prev = p_n;
+    p_n = 1.0 - cumulated / totalFrequency;
+    --n;
+    ++m;
+    }
+  while( m < size && p_n > p );
+  const double binMax = ( n + 2 == static_cast<long>(size) ) ? upper : lower + ( n + 2 ) * interval;
+  return binMax - ( ( p_n_prev - p ) / ( f_n / totalFrequency ) ) * interval;
+}
+
+template <class TImage, class TLabelImage>
+class LabelStatisticsEngine
+{
+public:
+  typedef TImage                                              ImageType;
+  typedef TLabelImage                                         LabelImageType;
+  typedef typename ImageType::PixelType                       PixelType;
+  typedef typename LabelImageType::PixelType                  LabelPixelType;
+  typedef typename LabelImageType::RegionType                 RegionType;
+  itkStaticConstMacro(Dimension, unsigned int, LabelImageType::ImageDimension);
+  typedef LabelStatistics<LabelPixelType, LabelImageType::ImageDimension> LabelStatisticsType;
+  typedef std::map<LabelPixelType, LabelStatisticsType>       LabelStatisticsMapType;
+  typedef LabelStatisticsSink<LabelStatisticsType>            SinkType;
+
+  enum HistogramRangeType
+    {
+    FixedRange,
+    ImageRange,
+    LabelRange
+    };
+
+  LabelStatisticsEngine() :
+    m_NumberOfHistogramBins(0),
+    m_HistogramRange(FixedRange),
+    m_FuseHistograms(false),
+    m_KeepHistograms(false),
+    m_Sink(ITK_NULLPTR),
+    m_NextLabel(0),
+    m_NextToWrite(0)
+  {
+    m_Quantiles.push_back(0.5);
+  }
+
+  void SetLabelImage(const LabelImageType *labels)
+  {
+    m_LabelImage = labels;
+  }
+
+  /* Images are numbered in the order they are added */
+  void AddImage(const ImageType *image)
+  {
+    m_Images.push_back(image);
+  }
+
+  /* Histograms over [lower, upper) for all labels and images; 0 bins
+   * disables the histograms */
+  void SetHistogramParameters(const unsigned int bins, const double lower, const double upper)
+  {
+    m_NumberOfHistogramBins = bins;
+    m_HistogramRange = FixedRange;
+    m_LowerBounds.assign(1, lower);
+    m_UpperBounds.assign(1, upper);
+  }
+
+  /* Histograms over the [min,max] range of each image (ImageRange) or of
+   * each label within each image (LabelRange) */
+  void SetHistogramParameters(const unsigned int bins, const HistogramRangeType range)
+  {
+    m_NumberOfHistogramBins = bins;
+    m_HistogramRange = range;
+  }
+
+  /* Probabilities of the quantiles computed from each histogram, the
+   * median by default */
+  void SetQuantiles(const std::vector<double> & probabilities)
+  {
+    m_Quantiles = probabilities;
+  }
+
+  void SetKeepHistograms(const bool keep)
+  {
+    m_KeepHistograms = keep;
+  }
+
+  void SetSink(SinkType *sink)
+  {
+    m_Sink = sink;
+  }
+
+  const LabelStatisticsMapType & GetLabelStatistics() const
+  {
+    return m_Statistics;
+  }
+
+  void Compute()
+  {
+    if( m_LabelImage.IsNull() || m_Images.empty() )
+      {
+      itkGenericExceptionMacro(<< "A label image and at least one intensity image are required");
+      }
+    if( m_HistogramRange == FixedRange && m_NumberOfHistogramBins > 0 && m_LowerBounds.empty() )
+      {
+      itkGenericExceptionMacro(<< "No histogram range was set");
+      }
+    m_Region = m_LabelImage->GetBufferedRegion();
+    for( size_t k = 0; k < m_Images.size(); ++k )
+      {
+      if( m_Images[k]->GetBufferedRegion() != m_Region )
+        {
+        itkGenericExceptionMacro(<< "Image " << k << " does not have the same buffered region as the label map");
+        }
+      }
+    m_Statistics.clear();
+    m_Labels.clear();
+
+    itk::MultiThreader::Pointer threader = itk::MultiThreader::New();
+    const itk::ThreadIdType     numberOfThreads = static_cast<itk::ThreadIdType>(
+        std::max<itk::SizeValueType>(1, std::min<itk::SizeValueType>(threader->GetNumberOfThreads(),
+                                                                     m_Region.GetSize(Dimension - 1) ) ) );
+
+    m_FuseHistograms = m_NumberOfHistogramBins > 0 && m_HistogramRange != LabelRange;
+    if( m_FuseHistograms && m_HistogramRange == ImageRange )
+      {
+      // Intensity ranges of the images, without looking up the labels
+      m_ThreadLowerBounds.assign(numberOfThreads,
+                                 std::vector<double>(m_Images.size(), itk::NumericTraits<double>::max() ) );
+      m_ThreadUpperBounds.assign(numberOfThreads,
+                                 std::vector<double>(m_Images.size(), itk::NumericTraits<double>::NonpositiveMin() ) );
+      this->Execute(threader, numberOfThreads, RangeStage);
+      m_LowerBounds = m_ThreadLowerBounds[0];
+      m_UpperBounds = m_ThreadUpperBounds[0];
+      for( itk::ThreadIdType t = 1; t < numberOfThreads; ++t )
+        {
+        for( size_t k = 0; k < m_Images.size(); ++k )
+          {
+          m_LowerBounds[k] = std::min(m_LowerBounds[k], m_ThreadLowerBounds[t][k]);
+          m_UpperBounds[k] = std::max(m_UpperBounds[k], m_ThreadUpperBounds[t][k]);
+          }
+        }
+      m_ThreadLowerBounds.clear();
+      m_ThreadUpperBounds.clear();
+      }
+    else if( m_HistogramRange == FixedRange && m_LowerBounds.size() == 1 )
+      {
+      m_LowerBounds.assign(m_Images.size(), m_LowerBounds[0]);
+      m_UpperBounds.assign(m_Images.size(), m_UpperBounds[0]);
+      }
+
+    // Moments, extrema and bounding boxes of all labels in one pass, and the
+    // histograms when their range is known
+    m_ThreadStatistics.assign(numberOfThreads, LabelStatisticsMapType() );
+    this->Execute(threader, numberOfThreads, StatisticsStage);
+    for( itk::ThreadIdType t = 0; t < numberOfThreads; ++t )
+      {
+      for( typename LabelStatisticsMapType::const_iterator it = m_ThreadStatistics[t].begin();
+           it != m_ThreadStatistics[t].end(); ++it )
+        {
+        typename LabelStatisticsMapType::iterator found = m_Statistics.find(it->first);
+        if( found == m_Statistics.end() )
+          {
+          m_Statistics.insert(*it);
+          }
+        else
+          {
+          found->second.Merge(it->second);
+          }
+        }
+      }
+    m_ThreadStatistics.clear();
+
+    for( typename LabelStatisticsMapType::iterator it = m_Statistics.begin(); it != m_Statistics.end(); ++it )
+      {
+      m_Labels.push_back(&( it->second ) );
+      }
+    m_Completed.assign(m_Labels.size(), false);
+    m_NextLabel = 0;
+    m_NextToWrite = 0;
+
+    // Quantiles label by label, after the histograms of the label range are
+    // built, streaming the results
+    this->Execute(threader,
+                  static_cast<itk::ThreadIdType>(std::max<size_t>(1, std::min<size_t>(numberOfThreads,
+                                                                                      m_Labels.size() ) ) ),
+                  HistogramStage);
+  }
+
+private:
+  enum StageType
+    {
+    RangeStage,
+    StatisticsStage,
+    HistogramStage
+    };
+
+  struct ThreadStruct
+    {
+    LabelStatisticsEngine *Engine;
+    StageType Stage;
+    };
+
+  void Execute(itk::MultiThreader *threader, const itk::ThreadIdType numberOfThreads, const StageType stage)
+  {
+    ThreadStruct str;
+
+    str.Engine = this;
+    str.Stage = stage;
+    threader->SetNumberOfThreads(numberOfThreads);
+    threader->SetSingleMethod(ThreaderCallback, &str);
+    threader->SingleMethodExecute();
+  }
+
+  static ITK_THREAD_RETURN_TYPE ThreaderCallback(void *arg)
+  {
+    itk::MultiThreader::ThreadInfoStruct * info = static_cast<itk::MultiThreader::ThreadInfoStruct *>(arg);
+    ThreadStruct *                         str = static_cast<ThreadStruct *>(info->UserData);
+
+    if( str->Stage == HistogramStage )
+      {
+      str->Engine->ThreadedHistograms();
+      return ITK_THREAD_RETURN_VALUE;
+      }
+
+    // Slabs of whole slices along the slowest axis
+    const itk::SizeValueType slices = str->Engine->m_Region.GetSize(Dimension - 1);
+    const itk::SizeValueType chunk = ( slices + info->NumberOfThreads - 1 ) / info->NumberOfThreads;
+    const itk::SizeValueType start = std::min(slices, info->ThreadID * chunk);
+    const itk::SizeValueType end = std::min(slices, start + chunk);
+    if( start < end )
+      {
+      RegionType slab = str->Engine->m_Region;
+      slab.SetIndex(Dimension - 1, slab.GetIndex(Dimension - 1) + start);
+      slab.SetSize(Dimension - 1, end - start);
+      if( str->Stage == RangeStage )
+        {
+        str->Engine->ThreadedRange(slab, str->Engine->m_ThreadLowerBounds[info->ThreadID],
+                                   str->Engine->m_ThreadUpperBounds[info->ThreadID]);
+        }
+      else
+        {
+        str->Engine->ThreadedStatistics(slab, str->Engine->m_ThreadStatistics[info->ThreadID]);
+        }
+      }
+    return ITK_THREAD_RETURN_VALUE;
+  }
+
+  /* Offset in the buffers of the first voxel of each row of the region */
+  itk::OffsetValueType RowOffset(const typename LabelImageType::IndexType & index) const
+  {
+    return m_LabelImage->ComputeOffset(index);
+  }
+
+  /* Intensity range of each image within a slab of whole slices, which is
+   * contiguous in the buffers */
+  void ThreadedRange(const RegionType & slab, std::vector<double> & lower, std::vector<double> & upper) const
+  {
+    const itk::OffsetValueType offset = this->RowOffset(slab.GetIndex() );
+    const itk::SizeValueType   numberOfPixels = slab.GetNumberOfPixels();
+
+    for( size_t k = 0; k < m_Images.size(); ++k )
+      {
+      const PixelType *pixels = m_Images[k]->GetBufferPointer() + offset;
+      double           minimum = lower[k];
+      double           maximum = upper[k];
+      for( itk::SizeValueType i = 0; i < numberOfPixels; ++i )
+        {
+        const double value = static_cast<double>(pixels[i]);
+        minimum = std::min(minimum, value);
+        maximum = std::max(maximum, value);
+        }
+      lower[k] = minimum;
+      upper[k] = maximum;
+      }
+  }
+
+  void ThreadedStatistics(const RegionType & region, LabelStatisticsMapType & statistics) const
+  {
+    const LabelPixelType *              labels = m_LabelImage->GetBufferPointer();
+    std::vector<const PixelType *>      images(m_Images.size() );
+    const size_t                        numberOfImages = m_Images.size();
+    for( size_t k = 0; k < numberOfImages; ++k )
+      {
+      images[k] = m_Images[k]->GetBufferPointer();
+      }
+    const itk::SizeValueType rowLength = region.GetSize(0);
+    const itk::IndexValueType rowStart = region.GetIndex(0);
+    const itk::SizeValueType numberOfRows = region.GetNumberOfPixels() / std::max<itk::SizeValueType>(1, rowLength);
+    std::vector<double>      scale(numberOfImages, 0.0);
+    for( size_t k = 0; m_FuseHistograms && k < numberOfImages; ++k )
+      {
+      const double range = m_UpperBounds[k] - m_LowerBounds[k];
+      scale[k] = range > 0.0 ? m_NumberOfHistogramBins / range : 0.0;
+      }
+
+    // Labels are spatially coherent, so the last label found is cached
+    LabelStatisticsType *current = ITK_NULLPTR;
+    LabelPixelType       currentLabel = LabelPixelType();
+    typename LabelImageType::IndexType index = region.GetIndex();
+    for( itk::SizeValueType row = 0; row < numberOfRows; ++row )
+      {
+      const itk::OffsetValueType offset = this->RowOffset(index);
+      for( itk::SizeValueType i = 0; i < rowLength; ++i )
+        {
+        const LabelPixelType label = labels[offset + i];
+        if( current == ITK_NULLPTR || label != currentLabel )
+          {
+          typename LabelStatisticsMapType::iterator found = statistics.find(label);
+          if( found == statistics.end() )
+            {
+            found = statistics.insert(std::make_pair(label,
+                                                     LabelStatisticsType(label,
+                                                                         static_cast<unsigned int>(numberOfImages) ) ) )
+              .first;
+            for( size_t k = 0; m_FuseHistograms && k < numberOfImages; ++k )
+              {
+              ImageStatistics & s = found->second.m_Images[k];
+              s.m_HistogramLowerBound = m_LowerBounds[k];
+              s.m_HistogramUpperBound = m_UpperBounds[k];
+              s.m_Histogram.assign(m_NumberOfHistogramBins, 0);
+              }
+            }
+          current = &( found->second );
+          currentLabel = label;
+          }
+        ++current->m_Count;
+        for( size_t k = 0; k < numberOfImages; ++k )
+          {
+          const double value = static_cast<double>(images[k][offset + i]);
+          current->m_Images[k].Add(value);
+          if( m_FuseHistograms )
+            {
+            AddToHistogram(current->m_Images[k].m_Histogram, value, m_LowerBounds[k], scale[k]);
+            }
+          }
+        const itk::IndexValueType x = rowStart + static_cast<itk::IndexValueType>(i);
+        current->m_BoundingBoxMinimum[0] = std::min(current->m_BoundingBoxMinimum[0], x);
+        current->m_BoundingBoxMaximum[0] = std::max(current->m_BoundingBoxMaximum[0], x);
+        for( unsigned int d = 1; d < Dimension; ++d )
+          {
+          current->m_BoundingBoxMinimum[d] = std::min(current->m_BoundingBoxMinimum[d], index[d]);
+          current->m_BoundingBoxMaximum[d] = std::max(current->m_BoundingBoxMaximum[d], index[d]);
+          }
+        }
+      // Next row
+      for( unsigned int d = 1; d < Dimension; ++d )
+        {
+        ++index[d];
+        if( index[d] < region.GetIndex(d) + static_cast<itk::IndexValueType>(region.GetSize(d) ) )
+          {
+          break;
+          }
+        index[d] = region.GetIndex(d);
+        }
+      }
+  }
+
+  void ThreadedHistograms()
+  {
+    const size_t                                    numberOfImages = m_Images.size();
+    std::vector<std::vector<itk::SizeValueType> > histograms(numberOfImages);
+
+    for( ;; )
+      {
+      m_Mutex.Lock();
+      const size_t l = m_NextLabel++;
+      m_Mutex.Unlock();
+      if( l >= m_Labels.size() )
+        {
+        break;
+        }
+      LabelStatisticsType & stats = *m_Labels[l];
+      if( m_NumberOfHistogramBins > 0 )
+        {
+        if( m_FuseHistograms )
+          {
+          for( size_t k = 0; k < numberOfImages; ++k )
+            {
+            histograms[k].swap(stats.m_Images[k].m_Histogram);
+            std::vector<itk::SizeValueType>().swap(stats.m_Images[k].m_Histogram);
+            }
+          }
+        else
+          {
+          this->ComputeHistograms(stats, histograms);
+          }
+        for( size_t k = 0; k < numberOfImages; ++k )
+          {
+          ImageStatistics & s = stats.m_Images[k];
+          s.m_Median = HistogramMedian(histograms[k], s.m_HistogramLowerBound, s.m_HistogramUpperBound,
+                                       stats.m_Count);
+          s.m_Quantiles.resize(m_Quantiles.size() );
+          for( size_t q = 0; q < m_Quantiles.size(); ++q )
+            {
+            s.m_Quantiles[q] = HistogramQuantile(histograms[k], s.m_HistogramLowerBound, s.m_HistogramUpperBound,
+                                                 m_Quantiles[q]);
+            }
+          if( m_KeepHistograms )
+            {
+            s.m_Histogram = histograms[k];
+            }
+          }
+        }
+      this->Complete(l);
+      }
+  }
+
+  /* Histograms of all images within the bounding box of one label, over
+   * the range of the label */
+  void ComputeHistograms(LabelStatisticsType & stats, std::vector<std::vector<itk::SizeValueType> > & histograms) const
+  {
+    const size_t         numberOfImages = m_Images.size();
+    std::vector<double>  lower(numberOfImages);
+    std::vector<double>  scale(numberOfImages);
+    for( size_t k = 0; k < numberOfImages; ++k )
+      {
+      ImageStatistics & s = stats.m_Images[k];
+      s.m_HistogramLowerBound = s.m_Minimum;
+      s.m_HistogramUpperBound = s.m_Maximum;
+      lower[k] = s.m_HistogramLowerBound;
+      const double range = s.m_HistogramUpperBound - s.m_HistogramLowerBound;
+      scale[k] = range > 0.0 ? m_NumberOfHistogramBins / range : 0.0;
+      histograms[k].assign(m_NumberOfHistogramBins, 0);
+      }
+
+    RegionType box;
+    for( unsigned int d = 0; d < Dimension; ++d )
+      {
+      box.SetIndex(d, stats.m_BoundingBoxMinimum[d]);
+      box.SetSize(d, stats.m_BoundingBoxMaximum[d] - stats.m_BoundingBoxMinimum[d] + 1);
+      }
+    const LabelPixelType *labels = m_LabelImage->GetBufferPointer();
+    const itk::SizeValueType rowLength = box.GetSize(0);
+    const itk::SizeValueType numberOfRows = box.GetNumberOfPixels() / rowLength;
+    typename LabelImageType::IndexType index = box.GetIndex();
+    for( itk::SizeValueType row = 0; row < numberOfRows; ++row )
+      {
+      const itk::OffsetValueType offset = this->RowOffset(index);
+      for( itk::SizeValueType i = 0; i < rowLength; ++i )
+        {
+        if( labels[offset + i] != stats.m_Label )
+          {
+          continue;
+          }
+        for( size_t k = 0; k < numberOfImages; ++k )
+          {
+          AddToHistogram(histograms[k], static_cast<double>(m_Images[k]->GetBufferPointer()[offset + i]),
+                         lower[k], scale[k]);
+          }
+        }
+      for( unsigned int d = 1; d < Dimension; ++d )
+        {
+        ++index[d];
+        if( index[d] < box.GetIndex(d) + static_cast<itk::IndexValueType>(box.GetSize(d) ) )
+          {
+          break;
+          }
+        index[d] = box.GetIndex(d);
+        }
+      }
+  }
+
+  /* Mark label l as complete and write all complete labels that are next
+   * in order. */
+  void Complete(const size_t l)
+  {
+    m_Mutex.Lock();
+    m_Completed[l] = true;
+    while( m_NextToWrite < m_Labels.size() && m_Completed[m_NextToWrite] )
+      {
+      if( m_Sink != ITK_NULLPTR )
+        {
+        m_Sink->Write(*m_Labels[m_NextToWrite]);
+        }
+      ++m_NextToWrite;
+      }
+    m_Mutex.Unlock();
+  }
+
+  typename LabelImageType::ConstPointer     m_LabelImage;
+  std::vector<typename ImageType::ConstPointer> m_Images;
+  RegionType                                m_Region;
+
+  unsigned int        m_NumberOfHistogramBins;
+  HistogramRangeType  m_HistogramRange;
+  bool                m_FuseHistograms;     // filled in the first pass
+  std::vector<double> m_LowerBounds;        // one per image
+  std::vector<double> m_UpperBounds;
+  std::vector<double> m_Quantiles;
+  bool                m_KeepHistograms;
+  SinkType *          m_Sink;
+
+  LabelStatisticsMapType              m_Statistics;
+  std::vector<LabelStatisticsMapType> m_ThreadStatistics;
+  std::vector<std::vector<double> >   m_ThreadLowerBounds;
+  std::vector<std::vector<double> >   m_ThreadUpperBounds;
+  std::vector<LabelStatisticsType *>  m_Labels;
+  std::vector<bool>                   m_Completed;
+  size_t                              m_NextLabel;
+  size_t                              m_NextToWrite;
+  itk::SimpleFastMutexLock            m_Mutex;
+};
+} // end namespace BRAINSLabelStats
+
+#endif // __BRAINSLabelStatsEngine_h____
@@ -0,0 +1,162 @@
+/*=========================================================================
+ *
+ *  Copyright SINAPSE: Scalable Informatics for Neuroscience, Processing and Software Engineering
+ *            The University of Iowa
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+/* Compares every column of the BRAINSLabelStats CSV (min, max, median,
+ * mean, stddev, var, sum, count) computed by the LabelStatisticsEngine with
+ * the ones of itk::LabelStatisticsImageFilter, which BRAINSLabelStats used
+ * before, for the manual and the image histogram ranges. */
+#include <itkImage.h>
+#include <itkImageRegionIterator.h>
+#include <itkLabelStatisticsImageFilter.h>
+#include <itkMinimumMaximumImageFilter.h>
+
+#include "BRAINSLabelStatsEngine.h"
+
+#include <iostream>
+#include <cmath>
+
+typedef itk::Image<float, 3>                                               ImageType;
+typedef itk::Image<unsigned int, 3>                                        LabelImageType;
+typedef BRAINSLabelStats::LabelStatisticsEngine<ImageType, LabelImageType> EngineType;
+
+static bool Close(const double a, const double b)
+{
+  return std::fabs(a - b) <= 1e-6 * std::max(1.0, std::max(std::fabs(a), std::fabs(b) ) );
+}
+
+/* The engine uses the given range, or the range of the image when
+ * useImageRange is set, which must then be [lower, upper] */
+static bool CompareWithBaseline(const ImageType *image, const LabelImageType *labels,
+                                const unsigned int bins, const double lower, const double upper,
+                                const bool useImageRange)
+{
+  typedef itk::LabelStatisticsImageFilter<ImageType, LabelImageType> BaselineType;
+  BaselineType::Pointer baseline = BaselineType::New();
+  baseline->SetInput(image);
+  baseline->SetLabelInput(labels);
+  baseline->UseHistogramsOn();
+  baseline->SetHistogramParameters(bins, lower, upper);
+  baseline->Update();
+
+  EngineType engine;
+  engine.SetLabelImage(labels);
+  engine.AddImage(image);
+  if( useImageRange )
+    {
+    engine.SetHistogramParameters(bins, EngineType::ImageRange);
+    }
+  else
+    {
+    engine.SetHistogramParameters(bins, lower, upper);
+    }
+  engine.Compute();
+
+  const EngineType::LabelStatisticsMapType & statistics = engine.GetLabelStatistics();
+  if( statistics.size() != baseline->GetNumberOfLabels() )
+    {
+    std::cerr << "Found " << statistics.size() << " labels instead of " << baseline->GetNumberOfLabels() << std::endl;
+    return false;
+    }
+  bool passed = true;
+  for( EngineType::LabelStatisticsMapType::const_iterator it = statistics.begin(); it != statistics.end(); ++it )
+    {
+    const unsigned int                          label = it->first;
+    const EngineType::LabelStatisticsType &     stats = it->second;
+    const BRAINSLabelStats::ImageStatistics &   s = stats.m_Images[0];
+    if( !baseline->HasLabel(label)
+        || !Close(s.m_Minimum, baseline->GetMinimum(label) )
+        || !Close(s.m_Maximum, baseline->GetMaximum(label) )
+        || !Close(s.m_Median, baseline->GetMedian(label) )
+        || !Close(stats.GetMean(0), baseline->GetMean(label) )
+        || !Close(stats.GetSigma(0), baseline->GetSigma(label) )
+        || !Close(stats.GetVariance(0), baseline->GetVariance(label) )
+        || !Close(s.m_Sum, baseline->GetSum(label) )
+        || stats.m_Count != baseline->GetCount(label) )
+      {
+      std::cerr << "Label " << label << " with " << bins << " bins over [" << lower << ", " << upper << "]: "
+                << s.m_Minimum << ", " << s.m_Maximum << ", " << s.m_Median << ", " << stats.GetMean(0) << ", "
+                << stats.GetSigma(0) << ", " << stats.GetVariance(0) << ", " << s.m_Sum << ", " << stats.m_Count
+                << " instead of "
+                << baseline->GetMinimum(label) << ", " << baseline->GetMaximum(label) << ", "
+                << baseline->GetMedian(label) << ", " << baseline->GetMean(label) << ", "
+                << baseline->GetSigma(label) << ", " << baseline->GetVariance(label) << ", "
+                << baseline->GetSum(label) << ", " << baseline->GetCount(label) << std::endl;
+      passed = false;
+      }
+    }
+  return passed;
+}
+
+int main( int , char * [] )
+{
+  ImageType::SizeType size;
+  size[0] = 23;
+  size[1] = 17;
+  size[2] = 11;
+
+  ImageType::Pointer image = ImageType::New();
+  image->SetRegions(size);
+  image->Allocate();
+  LabelImageType::Pointer labels = LabelImageType::New();
+  labels->SetRegions(size);
+  labels->Allocate();
+
+  // Labels in slabs and blocks, integer intensities in [0, 128] so that the
+  // bins edges are exact and many voxels fall on them, including the maximum
+  itk::ImageRegionIterator<ImageType>      imageIt(image, image->GetLargestPossibleRegion() );
+  itk::ImageRegionIterator<LabelImageType> labelIt(labels, labels->GetLargestPossibleRegion() );
+  unsigned int                             state = 12345;
+  for( ; !imageIt.IsAtEnd(); ++imageIt, ++labelIt )
+    {
+    const ImageType::IndexType index = imageIt.GetIndex();
+    const unsigned int         label = ( index[2] < 3 ) ? 0 : 1 + ( index[0] / 8 ) + 3 * ( index[1] / 9 );
+    state = state * 1103515245u + 12345u;
+    labelIt.Set(label);
+    imageIt.Set(static_cast<float>( 10 * label + ( state >> 16 ) % 64 ) );
+    }
+  ImageType::IndexType first = image->GetLargestPossibleRegion().GetIndex();
+  ImageType::IndexType last;
+  for( unsigned int d = 0; d < 3; ++d )
+    {
+    last[d] = first[d] + static_cast<itk::IndexValueType>(size[d]) - 1;
+    }
+  image->SetPixel(first, 0.0F);
+  image->SetPixel(last, 128.0F);
+
+  typedef itk::MinimumMaximumImageFilter<ImageType> MinMaxType;
+  MinMaxType::Pointer minMax = MinMaxType::New();
+  minMax->SetInput(image);
+  minMax->Update();
+
+  bool passed = true;
+  // --minMaxType image
+  passed &= CompareWithBaseline(image, labels, 128, minMax->GetMinimum(), minMax->GetMaximum(), true);
+  passed &= CompareWithBaseline(image, labels, 256, minMax->GetMinimum(), minMax->GetMaximum(), true);
+  // --minMaxType manual, over the image range and with voxels on both sides
+  // of the range
+  passed &= CompareWithBaseline(image, labels, 128, minMax->GetMinimum(), minMax->GetMaximum(), false);
+  passed &= CompareWithBaseline(image, labels, 32, 20.0, 84.0, false);
+
+  if( !passed )
+    {
+    std::cerr << "BRAINSLabelStatsEngineTest failed" << std::endl;
+    return EXIT_FAILURE;
+    }
+  std::cout << "BRAINSLabelStatsEngineTest passed" << std::endl;
+  return EXIT_SUCCESS;
+}
@@ -27,6 +27,7 @@
 
 #include "GenericTransformImage.h"
 #include "Slicer3LandmarkIO.h"
+#include "BRAINSRegistrationCache.h"
 
 #include "BRAINSLandmarkInitializerCLP.h"
 
@@ -156,6 +157,28 @@ InitializeTransform( int argc, char *argv[] )
         }
       }
     }
+  // The transform is reused from the registration cache (enabled by the
+  // BRAINS_REGISTRATION_CACHE environment variable).
+  const BRAINSUtils::RegistrationCache registrationCache;
+  BRAINSUtils::RegistrationCacheKey    registrationKey("BRAINSLandmarkInitializer");
+  if( registrationCache.IsEnabled() )
+    {
+    registrationKey.AddParameter("outputTransformType", std::string( transform->GetNameOfClass() ) );
+    registrationKey.AddParameter("fixedLandmarks", fixedLmks);
+    registrationKey.AddParameter("movingLandmarks", movingLmks);
+    registrationKey.AddParameter("landmarkWeights", landmarkWgts);
+    registrationKey.AddImage("reference", referenceImage.GetPointer() );
+    registrationKey.AddParameter("bsplineNumberOfControlPoints", bsplineNumberOfControlPoints);
+    BRAINSUtils::RegistrationCache::GenericTransformType::Pointer cachedTransform =
+      registrationCache.FetchTransform(registrationKey);
+    if( cachedTransform.IsNotNull() )
+      {
+      std::cout << "Reusing cached transform " << registrationKey.GetDigest() << std::endl;
+      itk::WriteTransformToDisk<double>( cachedTransform.GetPointer(), outputTransformFilename);
+      return EXIT_SUCCESS;
+      }
+    }
+
   /** set weights */
   if( !inputWeightFilename.empty() )
     {
@@ -183,6 +206,7 @@ InitializeTransform( int argc, char *argv[] )
     }
 
   itk::WriteTransformToDisk<double>( transform, outputTransformFilename);
+  registrationCache.StoreTransform(registrationKey, transform.GetPointer() );
 
   return EXIT_SUCCESS;
 }
@@ -23,8 +23,10 @@
 #include "itkIdentityTransform.h"
 #include "itkResampleImageFilter.h"
 #include "itkLabelImageGaussianInterpolateImageFunction.h"
-#include "itkMultiLabelSTAPLEImageFilter.h"
+#include "itkSparseMultiLabelSTAPLEImageFilter.h"
+#include "itkMultiThreader.h"
 #include "vnl/vnl_matlab_write.h"
+#include <algorithm>
 #include <sstream>
 #include <vector>
 
@@ -47,6 +49,71 @@ printImageStats(const TImage *image)
             << image->GetOrigin()[2] << "]" << std::endl;
 }
 
+typedef itk::Image<unsigned short, 3> USImageType;
+
+/** One rater to resample into the composite volume space */
+struct ResampleJob
+  {
+  typedef itk::ResampleImageFilter<USImageType, USImageType, double> ResampleFilterType;
+  typedef ResampleFilterType::TransformType                          TransformType;
+
+  USImageType::ConstPointer Input;
+  const TransformType *     Transform;
+  USImageType::Pointer      Output;
+  std::string               Error;
+  };
+
+struct ResampleThreadStruct
+  {
+  std::vector<ResampleJob> *Jobs;
+  USImageType::ConstPointer Reference;
+  double                    Sigma[3];
+  itk::ThreadIdType         ThreadsPerJob;
+  };
+
+/** Each thread resamples every n-th rater with its own interpolator, the
+ * label Gaussian interpolator keeps per-call state and cannot be shared. */
+static ITK_THREAD_RETURN_TYPE
+ResampleThreaderCallback(void *arg)
+{
+  const itk::ThreadIdType threadId = ( (itk::MultiThreader::ThreadInfoStruct *)(arg) )->ThreadID;
+  const itk::ThreadIdType threadCount = ( (itk::MultiThreader::ThreadInfoStruct *)(arg) )->NumberOfThreads;
+  ResampleThreadStruct *  str = (ResampleThreadStruct *)( ( (itk::MultiThreader::ThreadInfoStruct *)(arg) )->UserData);
+
+  typedef std::less<itk::NumericTraits<unsigned char>::RealType> ucharLess;
+  typedef itk::LabelImageGaussianInterpolateImageFunction<USImageType, double, ucharLess>
+    InterpolationFunctionType;
+
+  for( size_t i = threadId; i < str->Jobs->size(); i += threadCount )
+    {
+    ResampleJob & job = ( *str->Jobs )[i];
+    try
+      {
+      InterpolationFunctionType::Pointer interpolateFunc =
+        InterpolationFunctionType::New();
+      interpolateFunc->SetParameters(str->Sigma, 4.0);
+
+      // The output grid is copied rather than sharing the reference image
+      // as a pipeline input between threads.
+      ResampleJob::ResampleFilterType::Pointer resampler = ResampleJob::ResampleFilterType::New();
+      resampler->SetInput(job.Input);
+      resampler->SetOutputParametersFromImage(str->Reference.GetPointer() );
+      resampler->SetInterpolator(interpolateFunc);
+      resampler->SetTransform(job.Transform);
+      resampler->SetNumberOfThreads(str->ThreadsPerJob);
+      resampler->Update();
+      job.Output = resampler->GetOutput();
+      }
+    catch( itk::ExceptionObject & err )
+      {
+      std::stringstream msg;
+      msg << err;
+      job.Error = msg.str();
+      }
+    }
+  return ITK_THREAD_RETURN_VALUE;
+}
+
 int main(int argc, char *argv[])
 {
   PARSE_ARGS;
@@ -81,9 +148,10 @@ int main(int argc, char *argv[])
     return 1;
     }
 
-  typedef itk::Image<unsigned short, 3> USImageType;
-
-  typedef std::vector<USImageType::Pointer> ImageList;
+  // The label volumes are the inputs of the concurrent resamplers, so each
+  // one is a private copy; only the composite volume, whose geometry and
+  // pixels are read directly, is shared through the image read cache.
+  typedef std::vector<USImageType::ConstPointer> ImageList;
   ImageList inputLabelVolumes;
   for( std::vector<std::string>::const_iterator it = inputLabelVolume.begin();
        it != inputLabelVolume.end(); ++it )
@@ -99,7 +167,7 @@ int main(int argc, char *argv[])
       std::cerr << err << std::endl;
       return 1;
       }
-    inputLabelVolumes.push_back(labelVolume);
+    inputLabelVolumes.push_back(labelVolume.GetPointer() );
     }
 
   ImageList transformedLabelVolumes;
@@ -116,12 +184,12 @@ int main(int argc, char *argv[])
     }
   else
     {
-    USImageType::Pointer compositeVolume;
+    USImageType::ConstPointer compositeVolume;
     try
       {
       std::cout << "Reading Composite Volume " << inputCompositeT1Volume
                 << std::endl;
-      compositeVolume = itkUtil::ReadImage<USImageType>(inputCompositeT1Volume);
+      compositeVolume = itkUtil::ReadConstImage<USImageType>(inputCompositeT1Volume);
       }
     catch( itk::ExceptionObject & err )
       {
@@ -177,64 +245,62 @@ int main(int argc, char *argv[])
     // NOTE see ANTS/Examples/make_interpolator_snip.tmp line 113 --
     // the sigma defaults to the image spacing apparently, but the
     // sigma can also be specified on the command line.
-    typedef std::less<itk::NumericTraits<unsigned char>::RealType> ucharLess;
-    typedef itk::LabelImageGaussianInterpolateImageFunction<USImageType, double, ucharLess>
-      InterpolationFunctionType;
-    InterpolationFunctionType::Pointer interpolateFunc =
-      InterpolationFunctionType::New();
-    double                   sigma[3];
+    ResampleThreadStruct     str;
     USImageType::SpacingType spacing = compositeVolume->GetSpacing();
     for( unsigned i = 0; i < 3; ++i )
       {
-      sigma[i] = spacing[i];
+      str.Sigma[i] = spacing[i];
       }
-    interpolateFunc->SetParameters(sigma, 4.0);
+    str.Reference = compositeVolume;
 
-    std::vector<std::string>::const_iterator nameIt = inputLabelVolume.begin();
-    TransformListType::const_iterator        xfrmIt = inputTransforms.begin();
-    for( ImageList::const_iterator it = inputLabelVolumes.begin();
-         it != inputLabelVolumes.end(); ++it, ++xfrmIt, ++nameIt )
+    std::vector<ResampleJob>          jobs(inputLabelVolumes.size() );
+    TransformListType::const_iterator xfrmIt = inputTransforms.begin();
+    for( size_t i = 0; i < jobs.size(); ++i, ++xfrmIt )
       {
-      USImageType::Pointer current = (*it);
-
       itk::TransformFileReader::TransformPointer curTransformBase = (*xfrmIt);
-
-      typedef itk::ResampleImageFilter<USImageType, USImageType, double> ResampleFilterType;
-
-      std::cout << "Resampling " << (*nameIt) << std::flush;
-
-      const ResampleFilterType::TransformType *curTransform =
-        dynamic_cast<const ResampleFilterType::TransformType *>(curTransformBase.GetPointer() );
-      if( curTransform == ITK_NULLPTR )
+      jobs[i].Transform = dynamic_cast<const ResampleJob::TransformType *>(curTransformBase.GetPointer() );
+      if( jobs[i].Transform == ITK_NULLPTR )
         {
         std::cerr << "Invalid transform " << curTransformBase << std::endl;
         exit(1);
         }
-      ResampleFilterType::Pointer resampler = ResampleFilterType::New();
-      try
-        {
-        resampler->SetInput(current);
-        resampler->SetUseReferenceImage(true);
-        resampler->SetReferenceImage(compositeVolume);
-        resampler->SetInterpolator(interpolateFunc);
-        resampler->SetTransform(curTransform);
-        resampler->Update();
-        }
-      catch( itk::ExceptionObject & err )
+      jobs[i].Input = inputLabelVolumes[i];
+      }
+    str.Jobs = &jobs;
+
+    // The raters are resampled concurrently, and the threads left over are
+    // shared among the resamplers.
+    const itk::ThreadIdType totalThreads =
+      itk::MultiThreader::GetGlobalDefaultNumberOfThreads();
+    const itk::ThreadIdType concurrentJobs =
+      std::max<itk::ThreadIdType>(1, std::min<itk::ThreadIdType>(totalThreads, jobs.size() ) );
+    str.ThreadsPerJob = std::max<itk::ThreadIdType>(1, totalThreads / concurrentJobs);
+
+    std::cout << "Resampling " << jobs.size() << " label volumes with "
+              << concurrentJobs << " concurrent resamplers" << std::flush;
+    itk::MultiThreader::Pointer threader = itk::MultiThreader::New();
+    threader->SetNumberOfThreads(concurrentJobs);
+    threader->SetSingleMethod(ResampleThreaderCallback, &str);
+    threader->SingleMethodExecute();
+    std::cout << " done." << std::endl;
+
+    for( size_t i = 0; i < jobs.size(); ++i )
+      {
+      if( jobs[i].Error != "" )
         {
-        std::cerr << err << std::endl;
+        std::cerr << "Resampling " << inputLabelVolume[i] << " failed" << std::endl
+                  << jobs[i].Error << std::endl;
         return 1;
         }
-      std::cout << " done." << std::endl;
       if( resampledVolumePrefix != "" )
         {
-        std::string namePart(itksys::SystemTools::GetFilenameName( (*nameIt) ) );
+        std::string namePart(itksys::SystemTools::GetFilenameName(inputLabelVolume[i]) );
         std::string resampledName = resampledVolumePrefix;
         resampledName += namePart;
         std::cerr << "Writing " << resampledName << std::flush;
         try
           {
-          itkUtil::WriteImage<USImageType>(resampler->GetOutput(), resampledName);
+          itkUtil::WriteImage<USImageType>(jobs[i].Output, resampledName);
           }
         catch( itk::ExceptionObject & err )
           {
@@ -243,14 +309,13 @@ int main(int argc, char *argv[])
           }
         std::cerr << " ... done." << std::endl;
         }
-      printImageStats<USImageType>(resampler->GetOutput() );
-      transformedLabelVolumes.push_back(resampler->GetOutput() );
+      printImageStats<USImageType>(jobs[i].Output);
+      transformedLabelVolumes.push_back(jobs[i].Output.GetPointer() );
       }
     }
 
-  typedef itk::MultiLabelSTAPLEImageFilter<USImageType, USImageType> STAPLEFilterType;
+  typedef itk::SparseMultiLabelSTAPLEImageFilter<USImageType, USImageType> STAPLEFilterType;
   STAPLEFilterType::Pointer STAPLEFilter = STAPLEFilterType::New();
-  STAPLEFilter->SetNumberOfThreads(1);
 
   if( labelForUndecidedPixels != -1 )
     {
@@ -274,7 +339,9 @@ int main(int argc, char *argv[])
     }
   USImageType::Pointer output = STAPLEFilter->GetOutput();
 
-  std::cout << " done." << std::endl;
+  std::cout << " done, " << STAPLEFilter->GetElapsedNumberOfIterations()
+            << " iterations, " << STAPLEFilter->GetNumberOfUnanimousPixels()
+            << " unanimous voxels." << std::endl;
 
   try
     {
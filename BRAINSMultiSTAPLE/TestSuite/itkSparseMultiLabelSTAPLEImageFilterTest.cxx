@@ -0,0 +1,249 @@
+/*=========================================================================
+ *
+ *  Copyright SINAPSE: Scalable Informatics for Neuroscience, Processing and Software Engineering
+ *            The University of Iowa
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+/*
+ * Compares SparseMultiLabelSTAPLEImageFilter with the
+ * itk::MultiLabelSTAPLEImageFilter it replaces in BRAINSMultiSTAPLE, on
+ * synthetic raters that disagree with a known segmentation, with dense and
+ * with sparse label values.
+ */
+#include "itkImage.h"
+#include "itkImageRegionConstIterator.h"
+#include "itkImageRegionIterator.h"
+#include "itkImageRegionIteratorWithIndex.h"
+#include "itkMultiLabelSTAPLEImageFilter.h"
+#include "itkSparseMultiLabelSTAPLEImageFilter.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace
+{
+/* Deterministic uniform numbers in [0, 1) */
+class LinearCongruentialGenerator
+{
+public:
+  explicit LinearCongruentialGenerator(unsigned long seed) : m_State(seed) {}
+  double Next()
+  {
+    m_State = ( m_State * 1103515245UL + 12345UL ) & 0x7fffffffUL;
+    return m_State / 2147483648.0;
+  }
+private:
+  unsigned long m_State;
+};
+}
+
+typedef itk::Image<unsigned short, 3>                                           LabelImageType;
+typedef itk::MultiLabelSTAPLEImageFilter<LabelImageType, LabelImageType>       BaselineFilterType;
+typedef itk::SparseMultiLabelSTAPLEImageFilter<LabelImageType, LabelImageType> SparseFilterType;
+typedef std::vector<LabelImageType::Pointer>                                   RaterVectorType;
+
+/* true when both filters find the same labels, confusion matrices and
+ * number of iterations; output is the sparse filter result */
+static bool
+CompareWithBaseline(const RaterVectorType & raters, const std::string & name, LabelImageType::Pointer & output)
+{
+  BaselineFilterType::Pointer baseline = BaselineFilterType::New();
+  SparseFilterType::Pointer   sparse = SparseFilterType::New();
+  for( unsigned int r = 0; r < raters.size(); ++r )
+    {
+    baseline->SetInput(r, raters[r]);
+    sparse->SetInput(r, raters[r]);
+    }
+  baseline->Update();
+  sparse->Update();
+  output = sparse->GetOutput();
+
+  bool passed = true;
+  if( baseline->GetElapsedNumberOfIterations() != sparse->GetElapsedNumberOfIterations() )
+    {
+    std::cerr << name << ": iterations differ: " << baseline->GetElapsedNumberOfIterations() << " vs "
+              << sparse->GetElapsedNumberOfIterations() << std::endl;
+    passed = false;
+    }
+
+  unsigned int mismatches = 0;
+  itk::ImageRegionConstIterator<LabelImageType> bIt(baseline->GetOutput(),
+                                                    baseline->GetOutput()->GetLargestPossibleRegion() );
+  itk::ImageRegionConstIterator<LabelImageType> sIt(sparse->GetOutput(),
+                                                    sparse->GetOutput()->GetLargestPossibleRegion() );
+  for( ; !bIt.IsAtEnd(); ++bIt, ++sIt )
+    {
+    mismatches += ( bIt.Get() != sIt.Get() ) ? 1 : 0;
+    }
+  if( mismatches != 0 )
+    {
+    std::cerr << name << ": " << mismatches << " labels differ from MultiLabelSTAPLEImageFilter" << std::endl;
+    passed = false;
+    }
+
+  for( unsigned int r = 0; r < raters.size(); ++r )
+    {
+    const BaselineFilterType::ConfusionMatrixType & b = baseline->GetConfusionMatrix(r);
+    const SparseFilterType::ConfusionMatrixType     s = sparse->GetConfusionMatrix(r);
+    if( b.rows() != s.rows() || b.cols() != s.cols() )
+      {
+      std::cerr << name << ": confusion matrix " << r << " is " << s.rows() << "x" << s.cols()
+                << " instead of " << b.rows() << "x" << b.cols() << std::endl;
+      passed = false;
+      continue;
+      }
+    for( unsigned int i = 0; i < b.rows(); ++i )
+      {
+      for( unsigned int j = 0; j < b.cols(); ++j )
+        {
+        if( std::fabs(b(i, j) - s(i, j) ) > 1.0e-4 )
+          {
+          std::cerr << name << ": confusion matrix " << r << " (" << i << "," << j << ") differs: "
+                    << b(i, j) << " vs " << s(i, j) << std::endl;
+          passed = false;
+          }
+        }
+      }
+    }
+
+  std::cout << name << ": " << sparse->GetNumberOfUnanimousPixels() << " unanimous pixels, "
+            << sparse->GetElapsedNumberOfIterations() << " iterations" << std::endl;
+  return passed;
+}
+
+static LabelImageType::Pointer
+MakeRater(const LabelImageType::SizeType & size)
+{
+  LabelImageType::Pointer rater = LabelImageType::New();
+  rater->SetRegions(size);
+  rater->Allocate();
+  return rater;
+}
+
+int main( int, char * [] )
+{
+  int status = EXIT_SUCCESS;
+
+  // Concentric shells of the labels 0 to 3, with random rater errors
+    {
+    const unsigned int numberOfRaters = 5;
+    const unsigned int numberOfLabels = 4;
+    const double       errorRates[numberOfRaters] = { 0.05, 0.1, 0.15, 0.2, 0.3 };
+
+    LabelImageType::SizeType size;
+    size.Fill(24);
+
+    LinearCongruentialGenerator generator(20170125);
+    RaterVectorType             raters;
+    for( unsigned int r = 0; r < numberOfRaters; ++r )
+      {
+      LabelImageType::Pointer rater = MakeRater(size);
+      for( itk::ImageRegionIterator<LabelImageType> it(rater, rater->GetLargestPossibleRegion() );
+           !it.IsAtEnd(); ++it )
+        {
+        const LabelImageType::IndexType & index = it.GetIndex();
+        const unsigned int                distance = std::max(std::abs(static_cast<int>( index[0] ) - 12),
+                                                              std::max(std::abs(static_cast<int>( index[1] ) - 12),
+                                                                       std::abs(static_cast<int>( index[2] ) - 12) ) );
+        unsigned short label = static_cast<unsigned short>( std::min(distance / 3, numberOfLabels - 1) );
+        if( generator.Next() < errorRates[r] )
+          {
+          label = static_cast<unsigned short>( generator.Next() * numberOfLabels );
+          }
+        it.Set(label);
+        }
+      raters.push_back(rater);
+      }
+    LabelImageType::Pointer output;
+    if( !CompareWithBaseline(raters, "Shells", output) )
+      {
+      status = EXIT_FAILURE;
+      }
+    }
+
+  // The sparse labels 0, 7 and 200 in slabs along x.  Rater A only says 7
+  // where all the raters say 7 and rater B only says 200 where all the
+  // raters say 200, so where A says 7, B says 200 and C says 0 every label
+  // has a zero weight.  That voxel is a tie, for the vote as for STAPLE,
+  // and gets the undecided label 201.  Voxels where the three raters
+  // disagree are also voting ties that STAPLE resolves.
+    {
+    const unsigned short labels[3] = { 0, 7, 200 };
+
+    LabelImageType::SizeType size;
+    size[0] = 15;
+    size[1] = 10;
+    size[2] = 8;
+
+    LinearCongruentialGenerator generator(20170126);
+    LabelImageType::Pointer     raterA = MakeRater(size);
+    LabelImageType::Pointer     raterB = MakeRater(size);
+    LabelImageType::Pointer     raterC = MakeRater(size);
+    for( itk::ImageRegionIteratorWithIndex<LabelImageType> it(raterA, raterA->GetLargestPossibleRegion() );
+         !it.IsAtEnd(); ++it )
+      {
+      const LabelImageType::IndexType & index = it.GetIndex();
+      const unsigned short              truth = labels[index[0] / 5];
+      const unsigned short              c = ( generator.Next() < 0.2 )
+        ? labels[static_cast<unsigned int>( generator.Next() * 3 )] : truth;
+      unsigned short a = ( generator.Next() < 0.1 ) ? 0 : truth;
+      unsigned short b = ( generator.Next() < 0.1 ) ? 0 : truth;
+      if( truth == 0 )
+        {
+        a = ( generator.Next() < 0.1 ) ? 200 : 0;
+        b = ( generator.Next() < 0.1 ) ? 7 : 0;
+        }
+      else if( truth == 7 )
+        {
+        a = ( b == 7 && c == 7 ) ? 7 : 0;
+        }
+      else
+        {
+        b = ( a == 200 && c == 200 ) ? 200 : 0;
+        }
+      it.Set(a);
+      raterB->SetPixel(index, b);
+      raterC->SetPixel(index, c);
+      }
+
+    LabelImageType::IndexType undecided;
+    undecided[0] = 2;
+    undecided[1] = 4;
+    undecided[2] = 3;
+    raterA->SetPixel(undecided, 7);
+    raterB->SetPixel(undecided, 200);
+    raterC->SetPixel(undecided, 0);
+
+    RaterVectorType raters;
+    raters.push_back(raterA);
+    raters.push_back(raterB);
+    raters.push_back(raterC);
+    LabelImageType::Pointer output;
+    if( !CompareWithBaseline(raters, "Sparse labels", output) )
+      {
+      status = EXIT_FAILURE;
+      }
+    if( output->GetPixel(undecided) != 201 )
+      {
+      std::cerr << "The tied voxel is labeled " << output->GetPixel(undecided) << " instead of 201" << std::endl;
+      status = EXIT_FAILURE;
+      }
+    }
+
+  return status;
+}
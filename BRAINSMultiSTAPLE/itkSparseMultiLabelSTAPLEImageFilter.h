@@ -0,0 +1,224 @@
+/*=========================================================================
+ *
+ *  Copyright SINAPSE: Scalable Informatics for Neuroscience, Processing and Software Engineering
+ *            The University of Iowa
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#ifndef __itkSparseMultiLabelSTAPLEImageFilter_h
+#define __itkSparseMultiLabelSTAPLEImageFilter_h
+
+#include "itkImageToImageFilter.h"
+#include "itkMultiThreader.h"
+#include "vnl/vnl_matrix.h"
+#include <vector>
+
+namespace itk
+{
+/** \class SparseMultiLabelSTAPLEImageFilter
+ *
+ * \brief Multithreaded multi-label STAPLE that only visits the voxels where
+ * the raters disagree.
+ *
+ * This filter computes the same estimate as itk::MultiLabelSTAPLEImageFilter
+ * (prior probabilities from the label frequencies, initial confusion
+ * matrices from majority voting, EM iterations until the confusion matrices
+ * stop changing, ties assigned to the undecided label), organized for
+ * multi-atlas fusion with many raters:
+ *
+ *  - All voxels where every rater assigns the same label share the same
+ *    class weights, so they are reduced to one count per label.  The E-step
+ *    for those voxels is computed once per label and weighted by the count
+ *    in the M-step, which is exact.  Only the disagreeing voxels are visited
+ *    in each iteration, and their rater labels are gathered once into a
+ *    compact array.
+ *  - Labels are remapped to the dense set of labels that actually occur, so
+ *    sparse label values do not inflate the confusion matrices.
+ *  - The E-step and the confusion matrix M-step are fused in one threaded
+ *    pass with thread local confusion matrix accumulators that are merged
+ *    at the end of the pass.
+ *
+ * \par INPUTS
+ * All input volumes must have the same buffered region and an integral
+ * pixel type.
+ *
+ * \par OUTPUTS
+ * The most probable label of each voxel, or the undecided label where two
+ * or more labels are equally probable.
+ *
+ * \ingroup ITKBRAINSFilterPack
+ */
+template <typename TInputImage, typename TOutputImage = TInputImage, typename TWeights = float>
+class ITK_EXPORT SparseMultiLabelSTAPLEImageFilter :
+    public ImageToImageFilter< TInputImage, TOutputImage >
+{
+public:
+  /** Standard class typedefs. */
+  typedef SparseMultiLabelSTAPLEImageFilter               Self;
+  typedef ImageToImageFilter< TInputImage, TOutputImage > Superclass;
+  typedef SmartPointer<Self>                              Pointer;
+  typedef SmartPointer<const Self>                        ConstPointer;
+
+  /** Method for creation through the object factory. */
+  itkNewMacro(Self);
+
+  /** Run-time type information (and related methods) */
+  itkTypeMacro(SparseMultiLabelSTAPLEImageFilter, ImageToImageFilter);
+
+  typedef typename TOutputImage::PixelType OutputPixelType;
+  typedef typename TInputImage::PixelType  InputPixelType;
+  typedef TInputImage                      InputImageType;
+  typedef TOutputImage                     OutputImageType;
+  typedef TWeights                         WeightsType;
+
+  /** Confusion matrix of one rater, indexed [rater label][true label].  The
+   * extra row is reserved for the undecided label, as in
+   * itk::MultiLabelSTAPLEImageFilter. */
+  typedef vnl_matrix<WeightsType> ConfusionMatrixType;
+
+  /** Label assigned to the voxels with a tie, by default the largest
+   * label found in the inputs plus one. */
+  void SetLabelForUndecidedPixels(const OutputPixelType l)
+  {
+    this->m_LabelForUndecidedPixels = l;
+    this->m_HasLabelForUndecidedPixels = true;
+    this->Modified();
+  }
+  itkGetConstMacro(LabelForUndecidedPixels, OutputPixelType);
+
+  /** Iterations stop when no confusion matrix element changes by more
+   * than this value. */
+  itkSetMacro(TerminationUpdateThreshold, WeightsType);
+  itkGetConstMacro(TerminationUpdateThreshold, WeightsType);
+
+  /** Limit on the EM iterations, unlimited by default. */
+  void SetMaximumNumberOfIterations(const unsigned int n)
+  {
+    this->m_MaximumNumberOfIterations = n;
+    this->m_HasMaximumNumberOfIterations = true;
+    this->Modified();
+  }
+  itkGetConstMacro(MaximumNumberOfIterations, unsigned int);
+
+  itkGetConstMacro(ElapsedNumberOfIterations, unsigned int);
+
+  /** Number of voxels where all the raters agree */
+  itkGetConstMacro(NumberOfUnanimousPixels, SizeValueType);
+
+  /** Confusion matrix of rater i in the full label range of the inputs */
+  ConfusionMatrixType GetConfusionMatrix(const unsigned int i) const;
+
+protected:
+  SparseMultiLabelSTAPLEImageFilter();
+  virtual ~SparseMultiLabelSTAPLEImageFilter() {}
+
+  void GenerateInputRequestedRegion() ITK_OVERRIDE;
+
+  void EnlargeOutputRequestedRegion(DataObject *) ITK_OVERRIDE;
+
+  void GenerateData() ITK_OVERRIDE;
+
+  void PrintSelf(std::ostream&, Indent) const ITK_OVERRIDE;
+
+private:
+  ITK_DISALLOW_COPY_AND_ASSIGN(SparseMultiLabelSTAPLEImageFilter);
+
+  typedef std::vector<WeightsType>  WeightsVectorType;
+  typedef std::vector<SizeValueType> CountVectorType;
+  typedef unsigned short            CompactLabelType;
+
+  enum StageType
+    {
+    SCAN_STAGE,
+    GATHER_STAGE,
+    VOTING_STAGE,
+    EM_STAGE,
+    FILL_STAGE,
+    LABEL_STAGE
+    };
+
+  struct ThreadStruct
+    {
+    Self *Filter;
+    StageType Stage;
+    };
+
+  static ITK_THREAD_RETURN_TYPE StageThreaderCallback(void *arg);
+
+  void ExecuteStage(const StageType stage, const ThreadIdType numberOfThreads);
+
+  void ThreadedScan(const SizeValueType start, const SizeValueType end, const ThreadIdType threadId);
+
+  void ThreadedGather(const SizeValueType start, const SizeValueType end);
+
+  void ThreadedVoting(const SizeValueType start, const SizeValueType end, const ThreadIdType threadId);
+
+  void ThreadedEM(const SizeValueType start, const SizeValueType end, const ThreadIdType threadId);
+
+  void ThreadedFill(const SizeValueType start, const SizeValueType end);
+
+  void ThreadedLabel(const SizeValueType start, const SizeValueType end);
+
+  /** W[t] = prior[t] * prod_k conf[k](labels[k], t), normalized to one */
+  void ComputeWeights(const CompactLabelType *raterLabels, WeightsType *W) const;
+
+  /** Index of the largest weight, or -1 on a tie */
+  int MostProbableLabel(const WeightsType *W) const;
+
+  void NormalizeConfusionMatrices(WeightsVectorType & confusion) const;
+
+  void MergeThreadAccumulators(WeightsVectorType & confusion, const ThreadIdType numberOfThreads);
+
+  SizeValueType ConfusionIndex(const unsigned int k, const unsigned int s, const unsigned int t) const
+  {
+    return ( static_cast<SizeValueType>(k) * m_NumberOfLabels + s ) * m_NumberOfLabels + t;
+  }
+
+  OutputPixelType m_LabelForUndecidedPixels;
+  bool            m_HasLabelForUndecidedPixels;
+  WeightsType     m_TerminationUpdateThreshold;
+  unsigned int    m_MaximumNumberOfIterations;
+  bool            m_HasMaximumNumberOfIterations;
+  unsigned int    m_ElapsedNumberOfIterations;
+  SizeValueType   m_NumberOfUnanimousPixels;
+
+  // Working state of one GenerateData() call
+  unsigned int                        m_NumberOfRaters;
+  SizeValueType                       m_NumberOfPixels;
+  SizeValueType                       m_StageRangeSize;
+  std::vector<const InputPixelType *> m_InputBuffers;
+  std::vector<InputPixelType>         m_CompactToLabel;
+  std::vector<CompactLabelType>       m_LabelToCompact;
+  unsigned int                        m_NumberOfLabels;
+  WeightsVectorType                   m_Priors;
+  CountVectorType                     m_UnanimousCount;       // per compact label
+  std::vector<SizeValueType>          m_DisagreeingOffsets;
+  std::vector<CompactLabelType>       m_DisagreeingLabels;    // [voxel][rater]
+  WeightsVectorType                   m_ConfusionMatrices;    // [rater][rater label][true label]
+  std::vector<int>                    m_UnanimousResult;      // per compact label
+
+  // Thread local partial results
+  std::vector<CountVectorType>               m_ThreadLabelCounts;
+  std::vector<CountVectorType>               m_ThreadUnanimousCounts;
+  std::vector<std::vector<SizeValueType> >   m_ThreadDisagreeingOffsets;
+  std::vector<WeightsVectorType>             m_ThreadConfusion;
+};
+
+} // end namespace itk
+
+#ifndef ITK_MANUAL_INSTANTIATION
+#include "itkSparseMultiLabelSTAPLEImageFilter.hxx"
+#endif
+
+#endif
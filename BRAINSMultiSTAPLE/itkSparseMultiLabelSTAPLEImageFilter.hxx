@@ -0,0 +1,594 @@
+/*=========================================================================
+ *
+ *  Copyright SINAPSE: Scalable Informatics for Neuroscience, Processing and Software Engineering
+ *            The University of Iowa
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#ifndef _itkSparseMultiLabelSTAPLEImageFilter_hxx
+#define _itkSparseMultiLabelSTAPLEImageFilter_hxx
+
+#include "itkSparseMultiLabelSTAPLEImageFilter.h"
+#include "itkNumericTraits.h"
+#include <algorithm>
+#include <cmath>
+
+namespace itk
+{
+/** Upper bound on the memory used by the thread local confusion matrix
+ * accumulators; fewer threads are used for the EM pass beyond it. */
+static const SizeValueType SparseSTAPLEAccumulatorBudgetBytes = 512UL * 1024UL * 1024UL;
+
+template <typename TInputImage, typename TOutputImage, typename TWeights>
+SparseMultiLabelSTAPLEImageFilter<TInputImage, TOutputImage, TWeights>
+::SparseMultiLabelSTAPLEImageFilter() :
+  m_LabelForUndecidedPixels(NumericTraits<OutputPixelType>::ZeroValue() ),
+  m_HasLabelForUndecidedPixels(false),
+  m_TerminationUpdateThreshold(1e-5),
+  m_MaximumNumberOfIterations(NumericTraits<unsigned int>::max() ),
+  m_HasMaximumNumberOfIterations(false),
+  m_ElapsedNumberOfIterations(0),
+  m_NumberOfUnanimousPixels(0),
+  m_NumberOfRaters(0),
+  m_NumberOfPixels(0),
+  m_StageRangeSize(0),
+  m_NumberOfLabels(0)
+{
+}
+
+template <typename TInputImage, typename TOutputImage, typename TWeights>
+void
+SparseMultiLabelSTAPLEImageFilter<TInputImage, TOutputImage, TWeights>
+::PrintSelf(std::ostream& os, Indent indent) const
+{
+  Superclass::PrintSelf(os, indent);
+  os << indent << "LabelForUndecidedPixels: "
+     << static_cast<typename NumericTraits<OutputPixelType>::PrintType>(m_LabelForUndecidedPixels) << std::endl;
+  os << indent << "TerminationUpdateThreshold: " << m_TerminationUpdateThreshold << std::endl;
+  os << indent << "MaximumNumberOfIterations: " << m_MaximumNumberOfIterations << std::endl;
+  os << indent << "ElapsedNumberOfIterations: " << m_ElapsedNumberOfIterations << std::endl;
+  os << indent << "NumberOfUnanimousPixels: " << m_NumberOfUnanimousPixels << std::endl;
+}
+
+template <typename TInputImage, typename TOutputImage, typename TWeights>
+void
+SparseMultiLabelSTAPLEImageFilter<TInputImage, TOutputImage, TWeights>
+::GenerateInputRequestedRegion()
+{
+  Superclass::GenerateInputRequestedRegion();
+  for( unsigned int k = 0; k < this->GetNumberOfIndexedInputs(); ++k )
+    {
+    InputImageType *input = const_cast<InputImageType *>( this->GetInput(k) );
+    if( input )
+      {
+      input->SetRequestedRegionToLargestPossibleRegion();
+      }
+    }
+}
+
+template <typename TInputImage, typename TOutputImage, typename TWeights>
+void
+SparseMultiLabelSTAPLEImageFilter<TInputImage, TOutputImage, TWeights>
+::EnlargeOutputRequestedRegion(DataObject *data)
+{
+  Superclass::EnlargeOutputRequestedRegion(data);
+  data->SetRequestedRegionToLargestPossibleRegion();
+}
+
+template <typename TInputImage, typename TOutputImage, typename TWeights>
+typename SparseMultiLabelSTAPLEImageFilter<TInputImage, TOutputImage, TWeights>::ConfusionMatrixType
+SparseMultiLabelSTAPLEImageFilter<TInputImage, TOutputImage, TWeights>
+::GetConfusionMatrix(const unsigned int i) const
+{
+  if( i >= m_NumberOfRaters || m_CompactToLabel.empty() )
+    {
+    itkExceptionMacro(<< "No confusion matrix for rater " << i);
+    }
+  const unsigned int  totalLabelCount = static_cast<unsigned int>(m_CompactToLabel.back() ) + 1;
+  ConfusionMatrixType matrix(totalLabelCount + 1, totalLabelCount, 0.0);
+  for( unsigned int s = 0; s < m_NumberOfLabels; ++s )
+    {
+    for( unsigned int t = 0; t < m_NumberOfLabels; ++t )
+      {
+      matrix(m_CompactToLabel[s], m_CompactToLabel[t]) = m_ConfusionMatrices[this->ConfusionIndex(i, s, t)];
+      }
+    }
+  return matrix;
+}
+
+template <typename TInputImage, typename TOutputImage, typename TWeights>
+void
+SparseMultiLabelSTAPLEImageFilter<TInputImage, TOutputImage, TWeights>
+::ExecuteStage(const StageType stage, const ThreadIdType numberOfThreads)
+{
+  ThreadStruct str;
+
+  str.Filter = this;
+  str.Stage = stage;
+  switch( stage )
+    {
+    case SCAN_STAGE:
+    case FILL_STAGE:
+      m_StageRangeSize = m_NumberOfPixels;
+      break;
+    default:
+      m_StageRangeSize = m_DisagreeingOffsets.size();
+      break;
+    }
+  this->GetMultiThreader()->SetNumberOfThreads(numberOfThreads);
+  this->GetMultiThreader()->SetSingleMethod(this->StageThreaderCallback, &str);
+  this->GetMultiThreader()->SingleMethodExecute();
+}
+
+template <typename TInputImage, typename TOutputImage, typename TWeights>
+ITK_THREAD_RETURN_TYPE
+SparseMultiLabelSTAPLEImageFilter<TInputImage, TOutputImage, TWeights>
+::StageThreaderCallback(void *arg)
+{
+  const ThreadIdType threadId = ( (MultiThreader::ThreadInfoStruct *)(arg) )->ThreadID;
+  const ThreadIdType threadCount = ( (MultiThreader::ThreadInfoStruct *)(arg) )->NumberOfThreads;
+  ThreadStruct *     str = (ThreadStruct *)( ( (MultiThreader::ThreadInfoStruct *)(arg) )->UserData);
+  Self *             filter = str->Filter;
+
+  const SizeValueType chunk = ( filter->m_StageRangeSize + threadCount - 1 ) / threadCount;
+  const SizeValueType start = std::min(filter->m_StageRangeSize, threadId * chunk);
+  const SizeValueType end = std::min(filter->m_StageRangeSize, start + chunk);
+
+  switch( str->Stage )
+    {
+    case SCAN_STAGE:
+      filter->ThreadedScan(start, end, threadId);
+      break;
+    case GATHER_STAGE:
+      filter->ThreadedGather(start, end);
+      break;
+    case VOTING_STAGE:
+      filter->ThreadedVoting(start, end, threadId);
+      break;
+    case EM_STAGE:
+      filter->ThreadedEM(start, end, threadId);
+      break;
+    case FILL_STAGE:
+      filter->ThreadedFill(start, end);
+      break;
+    case LABEL_STAGE:
+      filter->ThreadedLabel(start, end);
+      break;
+    }
+  return ITK_THREAD_RETURN_VALUE;
+}
+
+/** Label histogram, unanimous label histogram and list of disagreeing voxels */
+template <typename TInputImage, typename TOutputImage, typename TWeights>
+void
+SparseMultiLabelSTAPLEImageFilter<TInputImage, TOutputImage, TWeights>
+::ThreadedScan(const SizeValueType start, const SizeValueType end, const ThreadIdType threadId)
+{
+  CountVectorType &             labelCounts = m_ThreadLabelCounts[threadId];
+  CountVectorType &             unanimousCounts = m_ThreadUnanimousCounts[threadId];
+  std::vector<SizeValueType> & disagreeing = m_ThreadDisagreeingOffsets[threadId];
+
+  for( SizeValueType i = start; i < end; ++i )
+    {
+    const InputPixelType first = m_InputBuffers[0][i];
+    bool                 unanimous = true;
+    for( unsigned int k = 0; k < m_NumberOfRaters; ++k )
+      {
+      const InputPixelType label = m_InputBuffers[k][i];
+      const SizeValueType  bin = static_cast<SizeValueType>(label);
+      if( bin >= labelCounts.size() )
+        {
+        labelCounts.resize(bin + 1, 0);
+        }
+      ++labelCounts[bin];
+      unanimous = unanimous && ( label == first );
+      }
+    if( unanimous )
+      {
+      const SizeValueType bin = static_cast<SizeValueType>(first);
+      if( bin >= unanimousCounts.size() )
+        {
+        unanimousCounts.resize(bin + 1, 0);
+        }
+      ++unanimousCounts[bin];
+      }
+    else
+      {
+      disagreeing.push_back(i);
+      }
+    }
+}
+
+/** Copy the compact rater labels of the disagreeing voxels */
+template <typename TInputImage, typename TOutputImage, typename TWeights>
+void
+SparseMultiLabelSTAPLEImageFilter<TInputImage, TOutputImage, TWeights>
+::ThreadedGather(const SizeValueType start, const SizeValueType end)
+{
+  for( SizeValueType j = start; j < end; ++j )
+    {
+    const SizeValueType offset = m_DisagreeingOffsets[j];
+    CompactLabelType *  labels = &m_DisagreeingLabels[j * m_NumberOfRaters];
+    for( unsigned int k = 0; k < m_NumberOfRaters; ++k )
+      {
+      labels[k] = m_LabelToCompact[static_cast<SizeValueType>(m_InputBuffers[k][offset])];
+      }
+    }
+}
+
+/** Majority voting on the disagreeing voxels, counted into the confusion
+ * matrices; voxels with tied votes are left out as in the voting filter. */
+template <typename TInputImage, typename TOutputImage, typename TWeights>
+void
+SparseMultiLabelSTAPLEImageFilter<TInputImage, TOutputImage, TWeights>
+::ThreadedVoting(const SizeValueType start, const SizeValueType end, const ThreadIdType threadId)
+{
+  WeightsVectorType &        confusion = m_ThreadConfusion[threadId];
+  std::vector<unsigned int> votes(m_NumberOfLabels, 0);
+
+  for( SizeValueType j = start; j < end; ++j )
+    {
+    const CompactLabelType *labels = &m_DisagreeingLabels[j * m_NumberOfRaters];
+    std::fill(votes.begin(), votes.end(), 0);
+    for( unsigned int k = 0; k < m_NumberOfRaters; ++k )
+      {
+      ++votes[labels[k]];
+      }
+    unsigned int winner = 0;
+    bool         tie = false;
+    for( unsigned int t = 1; t < m_NumberOfLabels; ++t )
+      {
+      if( votes[t] > votes[winner] )
+        {
+        winner = t;
+        tie = false;
+        }
+      else if( votes[t] == votes[winner] )
+        {
+        tie = true;
+        }
+      }
+    if( tie )
+      {
+      continue;
+      }
+    for( unsigned int k = 0; k < m_NumberOfRaters; ++k )
+      {
+      confusion[this->ConfusionIndex(k, labels[k], winner)] += 1;
+      }
+    }
+}
+
+template <typename TInputImage, typename TOutputImage, typename TWeights>
+void
+SparseMultiLabelSTAPLEImageFilter<TInputImage, TOutputImage, TWeights>
+::ComputeWeights(const CompactLabelType *raterLabels, WeightsType *W) const
+{
+  std::copy(m_Priors.begin(), m_Priors.end(), W);
+  for( unsigned int k = 0; k < m_NumberOfRaters; ++k )
+    {
+    const WeightsType *row = &m_ConfusionMatrices[this->ConfusionIndex(k, raterLabels[k], 0)];
+    for( unsigned int t = 0; t < m_NumberOfLabels; ++t )
+      {
+      W[t] *= row[t];
+      }
+    }
+  WeightsType sum = 0;
+  for( unsigned int t = 0; t < m_NumberOfLabels; ++t )
+    {
+    sum += W[t];
+    }
+  if( sum > 0 )
+    {
+    const WeightsType inverseSum = 1.0 / sum;
+    for( unsigned int t = 0; t < m_NumberOfLabels; ++t )
+      {
+      W[t] *= inverseSum;
+      }
+    }
+}
+
+template <typename TInputImage, typename TOutputImage, typename TWeights>
+int
+SparseMultiLabelSTAPLEImageFilter<TInputImage, TOutputImage, TWeights>
+::MostProbableLabel(const WeightsType *W) const
+{
+  unsigned int winner = 0;
+  bool         tie = false;
+
+  for( unsigned int t = 1; t < m_NumberOfLabels; ++t )
+    {
+    if( W[t] > W[winner] )
+      {
+      winner = t;
+      tie = false;
+      }
+    else if( W[t] == W[winner] )
+      {
+      tie = true;
+      }
+    }
+  return tie ? -1 : static_cast<int>(winner);
+}
+
+/** Fused E-step and M-step over the disagreeing voxels */
+template <typename TInputImage, typename TOutputImage, typename TWeights>
+void
+SparseMultiLabelSTAPLEImageFilter<TInputImage, TOutputImage, TWeights>
+::ThreadedEM(const SizeValueType start, const SizeValueType end, const ThreadIdType threadId)
+{
+  WeightsVectorType & confusion = m_ThreadConfusion[threadId];
+  WeightsVectorType   W(m_NumberOfLabels);
+
+  for( SizeValueType j = start; j < end; ++j )
+    {
+    const CompactLabelType *labels = &m_DisagreeingLabels[j * m_NumberOfRaters];
+    this->ComputeWeights(labels, &W[0]);
+    for( unsigned int k = 0; k < m_NumberOfRaters; ++k )
+      {
+      WeightsType *row = &confusion[this->ConfusionIndex(k, labels[k], 0)];
+      for( unsigned int t = 0; t < m_NumberOfLabels; ++t )
+        {
+        row[t] += W[t];
+        }
+      }
+    }
+}
+
+/** Every voxel gets the result of its first rater's label, which is the
+ * final result for the unanimous voxels. */
+template <typename TInputImage, typename TOutputImage, typename TWeights>
+void
+SparseMultiLabelSTAPLEImageFilter<TInputImage, TOutputImage, TWeights>
+::ThreadedFill(const SizeValueType start, const SizeValueType end)
+{
+  OutputPixelType *out = this->GetOutput()->GetBufferPointer();
+
+  for( SizeValueType i = start; i < end; ++i )
+    {
+    const int result = m_UnanimousResult[m_LabelToCompact[static_cast<SizeValueType>(m_InputBuffers[0][i])]];
+    out[i] = ( result < 0 ) ? m_LabelForUndecidedPixels : static_cast<OutputPixelType>(m_CompactToLabel[result]);
+    }
+}
+
+template <typename TInputImage, typename TOutputImage, typename TWeights>
+void
+SparseMultiLabelSTAPLEImageFilter<TInputImage, TOutputImage, TWeights>
+::ThreadedLabel(const SizeValueType start, const SizeValueType end)
+{
+  OutputPixelType * out = this->GetOutput()->GetBufferPointer();
+  WeightsVectorType W(m_NumberOfLabels);
+
+  for( SizeValueType j = start; j < end; ++j )
+    {
+    this->ComputeWeights(&m_DisagreeingLabels[j * m_NumberOfRaters], &W[0]);
+    const int result = this->MostProbableLabel(&W[0]);
+    out[m_DisagreeingOffsets[j]] =
+      ( result < 0 ) ? m_LabelForUndecidedPixels : static_cast<OutputPixelType>(m_CompactToLabel[result]);
+    }
+}
+
+/** Normalize each column (true label) to a unit probability sum */
+template <typename TInputImage, typename TOutputImage, typename TWeights>
+void
+SparseMultiLabelSTAPLEImageFilter<TInputImage, TOutputImage, TWeights>
+::NormalizeConfusionMatrices(WeightsVectorType & confusion) const
+{
+  for( unsigned int k = 0; k < m_NumberOfRaters; ++k )
+    {
+    for( unsigned int t = 0; t < m_NumberOfLabels; ++t )
+      {
+      WeightsType sum = 0;
+      for( unsigned int s = 0; s < m_NumberOfLabels; ++s )
+        {
+        sum += confusion[this->ConfusionIndex(k, s, t)];
+        }
+      if( sum > 0 )
+        {
+        for( unsigned int s = 0; s < m_NumberOfLabels; ++s )
+          {
+          confusion[this->ConfusionIndex(k, s, t)] /= sum;
+          }
+        }
+      }
+    }
+}
+
+template <typename TInputImage, typename TOutputImage, typename TWeights>
+void
+SparseMultiLabelSTAPLEImageFilter<TInputImage, TOutputImage, TWeights>
+::MergeThreadAccumulators(WeightsVectorType & confusion, const ThreadIdType numberOfThreads)
+{
+  for( ThreadIdType thread = 0; thread < numberOfThreads; ++thread )
+    {
+    WeightsVectorType & local = m_ThreadConfusion[thread];
+    for( SizeValueType i = 0; i < confusion.size(); ++i )
+      {
+      confusion[i] += local[i];
+      }
+    std::fill(local.begin(), local.end(), 0);
+    }
+}
+
+template <typename TInputImage, typename TOutputImage, typename TWeights>
+void
+SparseMultiLabelSTAPLEImageFilter<TInputImage, TOutputImage, TWeights>
+::GenerateData()
+{
+  this->AllocateOutputs();
+
+  m_NumberOfRaters = this->GetNumberOfIndexedInputs();
+  if( m_NumberOfRaters == 0 )
+    {
+    itkExceptionMacro(<< "At least one input is required");
+    }
+  const typename OutputImageType::RegionType region = this->GetOutput()->GetBufferedRegion();
+  m_NumberOfPixels = region.GetNumberOfPixels();
+  m_InputBuffers.resize(m_NumberOfRaters);
+  for( unsigned int k = 0; k < m_NumberOfRaters; ++k )
+    {
+    if( this->GetInput(k)->GetBufferedRegion() != region )
+      {
+      itkExceptionMacro(<< "Input " << k << " does not have the same buffered region as the output");
+      }
+    m_InputBuffers[k] = this->GetInput(k)->GetBufferPointer();
+    }
+  const ThreadIdType numberOfThreads = std::max<ThreadIdType>(1, this->GetNumberOfThreads() );
+
+  // Histograms and disagreeing voxels
+  m_ThreadLabelCounts.assign(numberOfThreads, CountVectorType() );
+  m_ThreadUnanimousCounts.assign(numberOfThreads, CountVectorType() );
+  m_ThreadDisagreeingOffsets.assign(numberOfThreads, std::vector<SizeValueType>() );
+  this->ExecuteStage(SCAN_STAGE, numberOfThreads);
+
+  CountVectorType labelCounts;
+  CountVectorType unanimousCounts;
+  m_DisagreeingOffsets.clear();
+  for( ThreadIdType thread = 0; thread < numberOfThreads; ++thread )
+    {
+    const CountVectorType & localCounts = m_ThreadLabelCounts[thread];
+    labelCounts.resize(std::max(labelCounts.size(), localCounts.size() ), 0);
+    for( SizeValueType l = 0; l < localCounts.size(); ++l )
+      {
+      labelCounts[l] += localCounts[l];
+      }
+    const CountVectorType & localUnanimous = m_ThreadUnanimousCounts[thread];
+    unanimousCounts.resize(std::max(unanimousCounts.size(), localUnanimous.size() ), 0);
+    for( SizeValueType l = 0; l < localUnanimous.size(); ++l )
+      {
+      unanimousCounts[l] += localUnanimous[l];
+      }
+    m_DisagreeingOffsets.insert(m_DisagreeingOffsets.end(),
+                                m_ThreadDisagreeingOffsets[thread].begin(), m_ThreadDisagreeingOffsets[thread].end() );
+    }
+  m_ThreadLabelCounts.clear();
+  m_ThreadUnanimousCounts.clear();
+  m_ThreadDisagreeingOffsets.clear();
+
+  // Dense remapping of the labels present in any rater, priors from the label frequencies
+  m_CompactToLabel.clear();
+  m_LabelToCompact.assign(labelCounts.size(), 0);
+  m_Priors.clear();
+  m_UnanimousCount.clear();
+  const WeightsType totalCount = static_cast<WeightsType>(m_NumberOfRaters) * m_NumberOfPixels;
+  for( SizeValueType l = 0; l < labelCounts.size(); ++l )
+    {
+    if( labelCounts[l] > 0 )
+      {
+      if( m_CompactToLabel.size() > NumericTraits<CompactLabelType>::max() )
+        {
+        itkExceptionMacro(<< "Too many distinct labels");
+        }
+      m_LabelToCompact[l] = static_cast<CompactLabelType>(m_CompactToLabel.size() );
+      m_CompactToLabel.push_back(static_cast<InputPixelType>(l) );
+      m_Priors.push_back(static_cast<WeightsType>(labelCounts[l]) / totalCount);
+      m_UnanimousCount.push_back(l < unanimousCounts.size() ? unanimousCounts[l] : 0);
+      }
+    }
+  m_NumberOfLabels = static_cast<unsigned int>(m_CompactToLabel.size() );
+  m_NumberOfUnanimousPixels = m_NumberOfPixels - m_DisagreeingOffsets.size();
+  if( !m_HasLabelForUndecidedPixels )
+    {
+    m_LabelForUndecidedPixels = static_cast<OutputPixelType>(labelCounts.size() );
+    }
+
+  m_DisagreeingLabels.resize(m_DisagreeingOffsets.size() * m_NumberOfRaters);
+  this->ExecuteStage(GATHER_STAGE, numberOfThreads);
+
+  // The thread local confusion matrices are bounded in memory
+  const SizeValueType confusionSize = static_cast<SizeValueType>(m_NumberOfRaters) * m_NumberOfLabels
+    * m_NumberOfLabels;
+  const ThreadIdType accumulatorThreads = static_cast<ThreadIdType>(
+      std::max<SizeValueType>(1, std::min<SizeValueType>(numberOfThreads,
+                                                         SparseSTAPLEAccumulatorBudgetBytes
+                                                         / ( confusionSize * sizeof(WeightsType) ) ) ) );
+  m_ThreadConfusion.assign(accumulatorThreads, WeightsVectorType(confusionSize, 0) );
+
+  // Initial confusion matrices from majority voting
+  m_ConfusionMatrices.assign(confusionSize, 0);
+  this->ExecuteStage(VOTING_STAGE, accumulatorThreads);
+  this->MergeThreadAccumulators(m_ConfusionMatrices, accumulatorThreads);
+  for( unsigned int s = 0; s < m_NumberOfLabels; ++s )
+    {
+    for( unsigned int k = 0; k < m_NumberOfRaters; ++k )
+      {
+      m_ConfusionMatrices[this->ConfusionIndex(k, s, s)] += m_UnanimousCount[s];
+      }
+    }
+  this->NormalizeConfusionMatrices(m_ConfusionMatrices);
+
+  // EM iterations
+  WeightsVectorType                 updated(confusionSize);
+  WeightsVectorType                 W(m_NumberOfLabels);
+  std::vector<CompactLabelType>     unanimousLabels(m_NumberOfRaters);
+  m_ElapsedNumberOfIterations = 0;
+  while( !m_HasMaximumNumberOfIterations || m_ElapsedNumberOfIterations < m_MaximumNumberOfIterations )
+    {
+    std::fill(updated.begin(), updated.end(), 0);
+    this->ExecuteStage(EM_STAGE, accumulatorThreads);
+    this->MergeThreadAccumulators(updated, accumulatorThreads);
+    // Contribution of all unanimous voxels of each label
+    for( unsigned int s = 0; s < m_NumberOfLabels; ++s )
+      {
+      if( m_UnanimousCount[s] == 0 )
+        {
+        continue;
+        }
+      std::fill(unanimousLabels.begin(), unanimousLabels.end(), static_cast<CompactLabelType>(s) );
+      this->ComputeWeights(&unanimousLabels[0], &W[0]);
+      const WeightsType count = static_cast<WeightsType>(m_UnanimousCount[s]);
+      for( unsigned int k = 0; k < m_NumberOfRaters; ++k )
+        {
+        WeightsType *row = &updated[this->ConfusionIndex(k, s, 0)];
+        for( unsigned int t = 0; t < m_NumberOfLabels; ++t )
+          {
+          row[t] += count * W[t];
+          }
+        }
+      }
+    this->NormalizeConfusionMatrices(updated);
+
+    WeightsType maximumUpdate = 0;
+    for( SizeValueType i = 0; i < confusionSize; ++i )
+      {
+      maximumUpdate = std::max<WeightsType>(maximumUpdate, std::fabs(updated[i] - m_ConfusionMatrices[i]) );
+      }
+    m_ConfusionMatrices.swap(updated);
+    ++m_ElapsedNumberOfIterations;
+    if( maximumUpdate < m_TerminationUpdateThreshold )
+      {
+      break;
+      }
+    }
+  m_ThreadConfusion.clear();
+
+  // Final labelling, once per label for the unanimous voxels
+  m_UnanimousResult.assign(m_NumberOfLabels, -1);
+  for( unsigned int s = 0; s < m_NumberOfLabels; ++s )
+    {
+    std::fill(unanimousLabels.begin(), unanimousLabels.end(), static_cast<CompactLabelType>(s) );
+    this->ComputeWeights(&unanimousLabels[0], &W[0]);
+    m_UnanimousResult[s] = this->MostProbableLabel(&W[0]);
+    }
+  this->ExecuteStage(FILL_STAGE, numberOfThreads);
+  this->ExecuteStage(LABEL_STAGE, numberOfThreads);
+
+  m_InputBuffers.clear();
+  m_DisagreeingLabels.clear();
+  m_DisagreeingOffsets.clear();
+}
+
+} // end namespace itk
+
+#endif
@@ -27,6 +27,7 @@
 
 #include "CreateRandomBSpline.h"
 #include "CombineBSplineWithDisplacement.h"
+#include "RefaceResampleImageFilter.h"
 #include "MaskFromLandmarksFilter.h"
 #include "MaskFromLabelMapFilter.h"
 #include "BRAINSRefacerUtilityFunctions.hxx"
@@ -105,6 +106,9 @@ int main(int argc, char **argv)
   const unsigned int Dimension = 3;
   typedef itk::Image<ProcessPixelType, Dimension> ProcessImageType;
 
+  //Voxels further than this from the brain (in mm) are not deformed
+  const ProcessPixelType maximumDistanceFromBrain = 4096.0;
+
   //Read in subject image
   typedef itk::ImageFileReader<ProcessImageType> ImageReaderType;
   ImageReaderType::Pointer imageReader = ImageReaderType::New();
@@ -181,31 +185,27 @@ int main(int argc, char **argv)
   ProcessImageType::Pointer myDistanceMapFilterImage = distanceMapFilter->GetOutput();
   distanceMapFilter->Update();
 
-  //make the distance map unsigned:
+  //make the distance map unsigned and scale it (only materialized for debugging, the refacing filter applies
+  // the threshold and the scale on the fly)
   typedef itk::ThresholdImageFilter<ProcessImageType> ThresholdFilterType;
   ThresholdFilterType::Pointer distanceThreshold = ThresholdFilterType::New();
   distanceThreshold->SetInput(distanceMapFilter->GetOutput());
   distanceThreshold->SetLower(0.0);
-  distanceThreshold->SetUpper(4096);  //TODO: This should be changed to the max pixel value for the image type??? or will we always be using double for calculations??
+  distanceThreshold->SetUpper(maximumDistanceFromBrain);
   distanceThreshold->SetOutsideValue(0.0);
 
+  typedef itk::MultiplyImageFilter<ProcessImageType, ProcessImageType, ProcessImageType> ScalingFilterType;
+  ScalingFilterType::Pointer distanceMapScaler = ScalingFilterType::New();
+  distanceMapScaler->SetInput(distanceThreshold->GetOutput());
+  distanceMapScaler->SetConstant(scaleDistanceMap);
+
   //Write the distance map to a file so we can see what it did:
   if(debug_Refacer)
     {
     WriteImage(distanceMapFileName, distanceThreshold->GetOutput());
+    std::cout << "Scaling distance map ..." <<std::endl;
+    distanceMapScaler->Update();
     }
-  ProcessImageType::Pointer myDistanceMapPreScaled = distanceThreshold->GetOutput();
-  distanceThreshold->Update();
-
-  //Try to scale distance map
-  typedef itk::MultiplyImageFilter<ProcessImageType, ProcessImageType, ProcessImageType> ScalingFilterType;
-  ScalingFilterType::Pointer distanceMapScaler = ScalingFilterType::New();
-  std::cout << "Scaling distance map ..." <<std::endl;
-  distanceMapScaler->SetInput(myDistanceMapPreScaled);
-  distanceMapScaler->SetConstant(scaleDistanceMap);
-
-  ProcessImageType::Pointer scaledDistanceMap = distanceMapScaler->GetOutput();
-  distanceMapScaler->Update();
 
   //Perform some kind of BSpline on Image
   const int BSplineOrder = 3;
@@ -281,58 +281,49 @@ int main(int argc, char **argv)
     }
 
 
-  typedef itk::Vector<ProcessPixelType, Dimension > VectorPixelType;
-  typedef itk::Image< VectorPixelType, Dimension> DisplacementFieldProcessImageType;
+  if( debug_Refacer )
+    {
+    // The refacing filter never builds the displacement field, build it only to write it out.
+    typedef itk::Vector<ProcessPixelType, Dimension > VectorPixelType;
+    typedef itk::Image< VectorPixelType, Dimension> DisplacementFieldProcessImageType;
 
-  typedef CombineBSplineWithDisplacement<ProcessImageType, DisplacementFieldProcessImageType, ProcessPixelType, 3,3> CombinerType;
+    typedef CombineBSplineWithDisplacement<ProcessImageType, DisplacementFieldProcessImageType, ProcessPixelType, 3,3> CombinerType;
 
-  CombinerType::Pointer combiner = CombinerType::New();
+    CombinerType::Pointer combiner = CombinerType::New();
 
-  std::cout << "Combining bspline with displacement ..." << std::endl;
+    std::cout << "Combining bspline with displacement ..." << std::endl;
 
-  combiner->SetDebug(debug_Refacer);
-  combiner->SetVerbose(verbose_Refacer);
-  combiner->SetBSplineInput(bSpline);
-  combiner->SetInput(subject);
-  combiner->SetDistanceMap(distanceMapScaler->GetOutput());
-  combiner->Update();
+    combiner->SetDebug(debug_Refacer);
+    combiner->SetVerbose(verbose_Refacer);
+    combiner->SetBSplineInput(bSpline);
+    combiner->SetInput(subject);
+    combiner->SetDistanceMap(distanceMapScaler->GetOutput());
+    combiner->Update();
 
-  //write the new displacement image
-  DisplacementFieldProcessImageType* composedDisplacementField_rawPtr = combiner->GetComposedImage();
-  if( debug_Refacer )
-    {
+    //write the new displacement image
+    DisplacementFieldProcessImageType* composedDisplacementField_rawPtr = combiner->GetComposedImage();
     WriteImage(smoothDisplacementName, composedDisplacementField_rawPtr);
-    }
-  typedef itk::DisplacementFieldTransform<ProcessPixelType, Dimension> FinalTransformType;
-  FinalTransformType::Pointer finalTransform = FinalTransformType::New();
-  finalTransform->SetDisplacementField(composedDisplacementField_rawPtr);
 
-  if( debug_Refacer )
-    {
+    typedef itk::DisplacementFieldTransform<ProcessPixelType, Dimension> FinalTransformType;
+    FinalTransformType::Pointer finalTransform = FinalTransformType::New();
+    finalTransform->SetDisplacementField(composedDisplacementField_rawPtr);
     WriteTransform(finalTransformFileName, finalTransform);
     }
 
-  // Apply transform to image with resampler:
-  typedef itk::ResampleImageFilter<ProcessImageType, ProcessImageType> ResampleFilterType;
-  ResampleFilterType::Pointer resampler = ResampleFilterType::New();
-
-  typedef itk::LinearInterpolateImageFunction<ProcessImageType, ProcessPixelType > InterpolatorType;
-  InterpolatorType::Pointer interpolater = InterpolatorType::New();
-
-  ProcessImageType::RegionType subjectRegion = subject->GetBufferedRegion();
+  // Apply the attenuated bspline to the image in one resampling pass:
+  typedef RefaceResampleImageFilter<ProcessImageType, BSplineOrder> RefaceFilterType;
+  RefaceFilterType::Pointer refacer = RefaceFilterType::New();
 
   std::cout << "Refacing image ..." << std::endl;
 
-  resampler->SetInterpolator(interpolater);
-  resampler->SetReferenceImage(imageReader->GetOutput());
-  resampler->UseReferenceImageOn();
-  resampler->SetOutputStartIndex(subjectRegion.GetIndex());
-
-  resampler->SetInput(imageReader->GetOutput());
-  resampler->SetTransform(finalTransform);
+  refacer->SetInput(imageReader->GetOutput());
+  refacer->SetBSplineTransform(bSpline);
+  refacer->SetDistanceMap(distanceMapFilter->GetOutput());
+  refacer->SetDistanceScale(scaleDistanceMap);
+  refacer->SetMaximumDistance(maximumDistanceFromBrain);
 
-  //WriteImage(deformedImageName, resampler->GetOutput());
-  ConvertAndSave<ProcessImageType, Dimension>( deformedImageName, resampler->GetOutput(), originalComponentType_ENUM);
+  //WriteImage(deformedImageName, refacer->GetOutput());
+  ConvertAndSave<ProcessImageType, Dimension>( deformedImageName, refacer->GetOutput(), originalComponentType_ENUM);
 
   //write the difference Image
   if( debug_Refacer )
@@ -341,7 +332,7 @@ int main(int argc, char **argv)
     typedef itk::SubtractImageFilter<ProcessImageType, ProcessImageType> SubtractFilter;
     SubtractFilter::Pointer subtractFilter = SubtractFilter::New();
     subtractFilter->SetInput1(subject);
-    subtractFilter->SetInput2(resampler->GetOutput());
+    subtractFilter->SetInput2(refacer->GetOutput());
     WriteImage( diffImageName, subtractFilter->GetOutput());
     }
 
@@ -0,0 +1,151 @@
+//
+// Resampling of the subject image by the attenuated random BSpline in one pass.
+//
+
+#ifndef BRAINSTOOLS_REFACERESAMPLEIMAGEFILTER_H
+#define BRAINSTOOLS_REFACERESAMPLEIMAGEFILTER_H
+
+#include <itkImageToImageFilter.h>
+#include <itkBSplineTransform.h>
+#include <itkLinearInterpolateImageFunction.h>
+#include <itkImageRegionIteratorWithIndex.h>
+#include <itkImageRegionConstIterator.h>
+
+/** Deforms the input image by the displacement of a BSpline transform
+ * attenuated by the distance to the brain, without any intermediate image.
+ *
+ * For each output voxel at point p, with d the distance map value of the
+ * voxel, the output is the linear interpolation of the input at
+ *
+ *   p + s * d' * ( T(p) - p ),   d' = d if 0 <= d <= MaximumDistance, else 0
+ *
+ * where T is the BSpline transform and s the distance scale.  This is what
+ * the chain of threshold and multiply filters, the BSpline displacement
+ * field, its attenuated components and the displacement field transform
+ * resampling computed, evaluated per voxel instead of materializing each
+ * step.  Voxels with no attenuated displacement (the brain and the voxels
+ * beyond MaximumDistance) are copied without evaluating the transform.
+ * The distance map must share the grid of the input image.
+ */
+template< typename TImage, unsigned int NBSplineOrder = 3 >
+class RefaceResampleImageFilter : public itk::ImageToImageFilter< TImage, TImage >
+{
+public:
+  typedef RefaceResampleImageFilter                Self;
+  typedef itk::ImageToImageFilter< TImage, TImage > Superclass;
+  typedef itk::SmartPointer< Self >                Pointer;
+
+  itkNewMacro(Self);
+  itkTypeMacro(RefaceResampleImageFilter, ImageToImageFilter);
+
+  typedef TImage                                ImageType;
+  typedef typename ImageType::PixelType         PixelType;
+  typedef typename ImageType::RegionType        RegionType;
+  typedef typename ImageType::PointType         PointType;
+  itkStaticConstMacro(Dimension, unsigned int, TImage::ImageDimension);
+
+  typedef itk::BSplineTransform< double, TImage::ImageDimension, NBSplineOrder > BSplineType;
+  typedef typename BSplineType::ConstPointer                                    BSplineConstPointer;
+
+  typedef itk::LinearInterpolateImageFunction< ImageType, double > InterpolatorType;
+
+  itkSetConstObjectMacro(BSplineTransform, BSplineType);
+  itkGetConstObjectMacro(BSplineTransform, BSplineType);
+
+  /** Signed distance to the brain, positive outside */
+  itkSetInputMacro(DistanceMap, ImageType);
+  itkGetInputMacro(DistanceMap, ImageType);
+
+  itkSetMacro(DistanceScale, double);
+  itkGetConstMacro(DistanceScale, double);
+
+  /** Voxels further from the brain are not deformed, no limit by default */
+  itkSetMacro(MaximumDistance, double);
+  itkGetConstMacro(MaximumDistance, double);
+
+protected:
+  RefaceResampleImageFilter() :
+    m_DistanceScale(1.0),
+    m_MaximumDistance(itk::NumericTraits< double >::max() )
+  {
+    this->AddRequiredInputName("DistanceMap");
+  }
+  ~RefaceResampleImageFilter(){};
+
+  void GenerateInputRequestedRegion() ITK_OVERRIDE
+  {
+    Superclass::GenerateInputRequestedRegion();
+    // Any input voxel may be needed to interpolate a deformed point
+    ImageType * input = const_cast< ImageType * >( this->GetInput() );
+    if( input )
+      {
+      input->SetRequestedRegionToLargestPossibleRegion();
+      }
+  }
+
+  void BeforeThreadedGenerateData() ITK_OVERRIDE
+  {
+    if( this->m_BSplineTransform.IsNull() )
+      {
+      itkExceptionMacro(<< "BSplineTransform is not set");
+      }
+    if( this->GetDistanceMap()->GetLargestPossibleRegion() != this->GetInput()->GetLargestPossibleRegion() )
+      {
+      itkExceptionMacro(<< "The distance map must have the same grid as the input image");
+      }
+    this->m_Interpolator = InterpolatorType::New();
+    this->m_Interpolator->SetInputImage(this->GetInput() );
+  }
+
+  void ThreadedGenerateData(const RegionType & outputRegionForThread, itk::ThreadIdType) ITK_OVERRIDE
+  {
+    const ImageType * input = this->GetInput();
+    ImageType *       output = this->GetOutput();
+    const double      scale = this->m_DistanceScale;
+    const double      maximumDistance = this->m_MaximumDistance;
+
+    itk::ImageRegionIteratorWithIndex< ImageType > outIt(output, outputRegionForThread);
+    itk::ImageRegionConstIterator< ImageType >     inIt(input, outputRegionForThread);
+    itk::ImageRegionConstIterator< ImageType >     distanceIt(this->GetDistanceMap(), outputRegionForThread);
+    for( ; !outIt.IsAtEnd(); ++outIt, ++inIt, ++distanceIt )
+      {
+      const double distance = distanceIt.Get();
+      if( distance <= 0.0 || distance > maximumDistance || scale == 0.0 )
+        {
+        outIt.Set(inIt.Get() );
+        continue;
+        }
+      const double attenuation = scale * distance;
+
+      PointType point;
+      output->TransformIndexToPhysicalPoint(outIt.GetIndex(), point);
+      const PointType bSplinePoint = this->m_BSplineTransform->TransformPoint(point);
+      PointType       deformedPoint;
+      for( unsigned int i = 0; i < Dimension; ++i )
+        {
+        deformedPoint[i] = point[i] + attenuation * ( bSplinePoint[i] - point[i] );
+        }
+
+      typename InterpolatorType::ContinuousIndexType continuousIndex;
+      input->TransformPhysicalPointToContinuousIndex(deformedPoint, continuousIndex);
+      if( this->m_Interpolator->IsInsideBuffer(continuousIndex) )
+        {
+        outIt.Set(static_cast< PixelType >( this->m_Interpolator->EvaluateAtContinuousIndex(continuousIndex) ) );
+        }
+      else
+        {
+        outIt.Set(itk::NumericTraits< PixelType >::ZeroValue() );
+        }
+      }
+  }
+
+private:
+  ITK_DISALLOW_COPY_AND_ASSIGN(RefaceResampleImageFilter);
+
+  BSplineConstPointer                     m_BSplineTransform;
+  double                                  m_DistanceScale;
+  double                                  m_MaximumDistance;
+  typename InterpolatorType::Pointer      m_Interpolator;
+};
+
+#endif //BRAINSTOOLS_REFACERESAMPLEIMAGEFILTER_H
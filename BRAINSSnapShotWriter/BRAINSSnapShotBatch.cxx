@@ -0,0 +1,670 @@
+/*=========================================================================
+ *
+ *  Copyright SINAPSE: Scalable Informatics for Neuroscience, Processing and Software Engineering
+ *            The University of Iowa
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#include "BRAINSSnapShotBatch.h"
+
+#include "itkImage.h"
+#include "itkImageFileReader.h"
+#include "itkImageFileWriter.h"
+#include "itkTileImageFilter.h"
+#include "itkLabelOverlayImageFilter.h"
+#include "itkFlipImageFilter.h"
+#include "itkMultiThreader.h"
+#include "itkSimpleFastMutexLock.h"
+#include "itkRGBPixel.h"
+
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <algorithm>
+#include <map>
+
+namespace
+{
+typedef itk::Image<float, 3>                 VolumeType;
+typedef itk::Image<float, 2>                 SliceType;
+typedef itk::Image<unsigned char, 2>         GreySliceType;
+typedef itk::RGBPixel<unsigned char>         RGBPixelType;
+typedef itk::Image<RGBPixelType, 2>          RGBSliceType;
+typedef itk::ImageFileReader<VolumeType>     VolumeReaderType;
+
+/* Largest number of voxels used to find the grey level window */
+const size_t MaximumWindowSamples = 65536;
+
+/* The requested slices of one volume file, in the display orientation of
+ * BRAINSSnapShotWriter (third axis flipped). */
+struct VolumeSlices
+  {
+  std::vector<SliceType::Pointer> Slices;   // one per plane
+  float                           WindowMinimum;
+  float                           WindowMaximum;
+  std::string                     Error;
+  bool                            Loaded;
+  unsigned int                    RemainingUses;
+  itk::SimpleFastMutexLock        LoadLock;
+
+  VolumeSlices() :
+    WindowMinimum(0.0F),
+    WindowMaximum(1.0F),
+    Loaded(false),
+    RemainingUses(0)
+  {
+  }
+  };
+
+struct SubjectType
+  {
+  std::string              OutputFilename;
+  std::vector<std::string> Volumes;
+  std::vector<std::string> Masks;
+  };
+
+std::string Trim(const std::string & s)
+{
+  const std::string::size_type first = s.find_first_not_of(" \t\r\n");
+
+  if( first == std::string::npos )
+    {
+    return "";
+    }
+  return s.substr(first, s.find_last_not_of(" \t\r\n") - first + 1);
+}
+
+std::vector<std::string> Split(const std::string & s, const char separator)
+{
+  std::vector<std::string> fields;
+  std::stringstream        stream(s);
+  std::string              field;
+
+  while( std::getline(stream, field, separator) )
+    {
+    field = Trim(field);
+    if( !field.empty() )
+      {
+      fields.push_back(field);
+      }
+    }
+  return fields;
+}
+
+bool ReadManifest(const std::string & manifestFilename, std::vector<SubjectType> & subjects)
+{
+  std::ifstream manifest(manifestFilename.c_str() );
+
+  if( !manifest.is_open() )
+    {
+    std::cout << "ERROR: Could not open manifest " << manifestFilename << std::endl;
+    return false;
+    }
+  std::string  line;
+  unsigned int lineNumber = 0;
+  while( std::getline(manifest, line) )
+    {
+    ++lineNumber;
+    line = Trim(line);
+    if( line.empty() || line[0] == '#' )
+      {
+      continue;
+      }
+    std::vector<std::string> columns;
+    std::stringstream        stream(line);
+    std::string              column;
+    while( std::getline(stream, column, ',') )
+      {
+      columns.push_back(Trim(column) );
+      }
+    if( columns.size() < 2 || columns.size() > 3 || columns[0].empty() )
+      {
+      std::cout << "ERROR: " << manifestFilename << ":" << lineNumber
+                << ": expected outputFilename,volumes[,masks]" << std::endl;
+      return false;
+      }
+    SubjectType subject;
+    subject.OutputFilename = columns[0];
+    subject.Volumes = Split(columns[1], ';');
+    if( columns.size() == 3 )
+      {
+      subject.Masks = Split(columns[2], ';');
+      }
+    if( subject.Volumes.empty() )
+      {
+      std::cout << "ERROR: " << manifestFilename << ":" << lineNumber
+                << ": at least one volume is required" << std::endl;
+      return false;
+      }
+    subjects.push_back(subject);
+    }
+  return true;
+}
+
+/* Slice index in the file for the requested slice of a plane; the slice is
+ * found in the display orientation, from the information of the flipped
+ * volume only, and mapped back to the file */
+itk::IndexValueType FileSliceIndex(const VolumeType *volume, const SnapShotBatchOptions & options,
+                                   const size_t i)
+{
+  typedef itk::FlipImageFilter<VolumeType> FlipType;
+  itk::FixedArray<bool, 3> flipAxes;
+  flipAxes[0] = false;
+  flipAxes[1] = false;
+  flipAxes[2] = true;
+  FlipType::Pointer flipper = FlipType::New();
+  flipper->SetInput(volume);
+  flipper->SetFlipAxes(flipAxes);
+  flipper->UpdateOutputInformation();
+
+  const int                 plane = options.PlaneDirections[i];
+  const itk::IndexValueType size = static_cast<itk::IndexValueType>(
+      volume->GetLargestPossibleRegion().GetSize(plane) );
+  const itk::IndexValueType displayIndex = DisplaySliceIndex(flipper->GetOutput(), options, i);
+  return ( plane == 2 ) ? size - 1 - displayIndex : displayIndex;
+}
+
+/* Copy one slice of a buffered volume to a 2D image, flipping the third axis */
+SliceType::Pointer CopySlice(const VolumeType *volume, const int plane, const itk::IndexValueType fileIndex)
+{
+  const VolumeType::RegionType largest = volume->GetLargestPossibleRegion();
+  unsigned int                 axes[2];
+  unsigned int                 n = 0;
+
+  for( unsigned int d = 0; d < 3; ++d )
+    {
+    if( static_cast<int>(d) != plane )
+      {
+      axes[n++] = d;
+      }
+    }
+  SliceType::RegionType  region;
+  SliceType::SpacingType spacing;
+  for( unsigned int d = 0; d < 2; ++d )
+    {
+    region.SetSize(d, largest.GetSize(axes[d]) );
+    spacing[d] = volume->GetSpacing()[axes[d]];
+    }
+  SliceType::Pointer slice = SliceType::New();
+  slice->SetRegions(region);
+  slice->SetSpacing(spacing);
+  slice->Allocate();
+
+  VolumeType::IndexType fileIdx = largest.GetIndex();
+  fileIdx[plane] += fileIndex;
+  float *out = slice->GetBufferPointer();
+  for( itk::SizeValueType j = 0; j < region.GetSize(1); ++j )
+    {
+    for( itk::SizeValueType i = 0; i < region.GetSize(0); ++i )
+      {
+      const itk::SizeValueType ij[2] = { i, j };
+      for( unsigned int d = 0; d < 2; ++d )
+        {
+        const itk::SizeValueType axisSize = largest.GetSize(axes[d]);
+        fileIdx[axes[d]] = largest.GetIndex(axes[d])
+          + static_cast<itk::IndexValueType>( ( axes[d] == 2 ) ? axisSize - 1 - ij[d] : ij[d]);
+        }
+      *out++ = volume->GetPixel(fileIdx);
+      }
+    }
+  return slice;
+}
+
+/* Grey level window from percentiles of a strided sample of the slices */
+void ComputeWindow(VolumeSlices & entry, const SnapShotBatchOptions & options)
+{
+  size_t total = 0;
+
+  for( size_t p = 0; p < entry.Slices.size(); ++p )
+    {
+    total += entry.Slices[p]->GetBufferedRegion().GetNumberOfPixels();
+    }
+  const size_t       stride = std::max<size_t>(1, total / MaximumWindowSamples);
+  std::vector<float> samples;
+  samples.reserve(total / stride + entry.Slices.size() );
+  for( size_t p = 0; p < entry.Slices.size(); ++p )
+    {
+    const float *buffer = entry.Slices[p]->GetBufferPointer();
+    const size_t count = entry.Slices[p]->GetBufferedRegion().GetNumberOfPixels();
+    for( size_t i = 0; i < count; i += stride )
+      {
+      samples.push_back(buffer[i]);
+      }
+    }
+  if( samples.empty() )
+    {
+    return;
+    }
+  const size_t lower = static_cast<size_t>(options.WindowLowerPercentile / 100.0 * ( samples.size() - 1 ) );
+  const size_t upper = static_cast<size_t>(options.WindowUpperPercentile / 100.0 * ( samples.size() - 1 ) );
+  std::nth_element(samples.begin(), samples.begin() + lower, samples.end() );
+  entry.WindowMinimum = samples[lower];
+  std::nth_element(samples.begin(), samples.begin() + upper, samples.end() );
+  entry.WindowMaximum = samples[upper];
+  if( entry.WindowMaximum <= entry.WindowMinimum )
+    {
+    entry.WindowMaximum = entry.WindowMinimum + 1.0F;
+    }
+}
+
+void LoadVolumeSlices(const std::string & filename, const SnapShotBatchOptions & options, VolumeSlices & entry)
+{
+  try
+    {
+    VolumeReaderType::Pointer reader = VolumeReaderType::New();
+    reader->SetFileName(filename);
+    reader->UpdateOutputInformation();
+    VolumeType::Pointer          volume = reader->GetOutput();
+    const VolumeType::RegionType largest = volume->GetLargestPossibleRegion();
+    // Formats that cannot stream a region are read once as a whole
+    const bool streaming = reader->GetImageIO()->CanStreamRead();
+    if( !streaming )
+      {
+      reader->Update();
+      }
+    for( size_t i = 0; i < options.PlaneDirections.size(); ++i )
+      {
+      const int plane = options.PlaneDirections[i];
+      if( plane < 0 || plane > 2 )
+        {
+        entry.Error = "Extracting plane should be 0, 1 or 2";
+        return;
+        }
+      const itk::IndexValueType fileIndex = FileSliceIndex(volume, options, i);
+      if( fileIndex < 0 || fileIndex >= static_cast<itk::IndexValueType>(largest.GetSize(plane) ) )
+        {
+        std::ostringstream msg;
+        msg << "Slice " << fileIndex << " of plane " << plane << " is outside of " << filename;
+        entry.Error = msg.str();
+        return;
+        }
+      if( streaming )
+        {
+        VolumeType::RegionType sliceRegion = largest;
+        sliceRegion.SetIndex(plane, largest.GetIndex(plane) + fileIndex);
+        sliceRegion.SetSize(plane, 1);
+        volume->SetRequestedRegion(sliceRegion);
+        reader->Update();
+        }
+      entry.Slices.push_back(CopySlice(volume, plane, fileIndex) );
+      }
+    ComputeWindow(entry, options);
+    }
+  catch( itk::ExceptionObject & e )
+    {
+    entry.Error = std::string("Could not read image ") + filename + ": " + e.what();
+    }
+}
+
+/* Slices of the volumes, shared between the subjects that list the same file */
+class SliceCache
+{
+public:
+  SliceCache(const SnapShotBatchOptions & options) :
+    m_Options(options)
+  {
+  }
+
+  ~SliceCache()
+  {
+    for( EntryMapType::iterator it = m_Entries.begin(); it != m_Entries.end(); ++it )
+      {
+      delete it->second;
+      }
+  }
+
+  /* Register one future use of the file, before any Acquire() */
+  void AddUse(const std::string & filename)
+  {
+    EntryMapType::iterator it = m_Entries.find(filename);
+
+    if( it == m_Entries.end() )
+      {
+      it = m_Entries.insert(std::make_pair(filename, new VolumeSlices) ).first;
+      }
+    ++it->second->RemainingUses;
+  }
+
+  const VolumeSlices & Acquire(const std::string & filename)
+  {
+    m_Lock.Lock();
+    VolumeSlices *entry = m_Entries[filename];
+    m_Lock.Unlock();
+
+    // Only the first user reads the file, the others wait for it
+    entry->LoadLock.Lock();
+    if( !entry->Loaded )
+      {
+      LoadVolumeSlices(filename, m_Options, *entry);
+      entry->Loaded = true;
+      }
+    entry->LoadLock.Unlock();
+    return *entry;
+  }
+
+  /* The slices are dropped once the last subject using them is done */
+  void Release(const std::string & filename)
+  {
+    m_Lock.Lock();
+    VolumeSlices *entry = m_Entries[filename];
+    if( --entry->RemainingUses == 0 )
+      {
+      entry->Slices.clear();
+      }
+    m_Lock.Unlock();
+  }
+
+private:
+  typedef std::map<std::string, VolumeSlices *> EntryMapType;
+
+  const SnapShotBatchOptions & m_Options;
+  EntryMapType                 m_Entries;
+  itk::SimpleFastMutexLock     m_Lock;
+};
+
+GreySliceType::Pointer WindowSlice(const SliceType *slice, const float minimum, const float maximum)
+{
+  GreySliceType::Pointer grey = GreySliceType::New();
+
+  grey->SetRegions(slice->GetBufferedRegion() );
+  grey->SetSpacing(slice->GetSpacing() );
+  grey->Allocate();
+  const float          scale = 255.0F / ( maximum - minimum );
+  const float *        in = slice->GetBufferPointer();
+  unsigned char *      out = grey->GetBufferPointer();
+  const size_t         count = slice->GetBufferedRegion().GetNumberOfPixels();
+  for( size_t i = 0; i < count; ++i )
+    {
+    const float value = ( in[i] - minimum ) * scale;
+    out[i] = static_cast<unsigned char>( value <= 0.0F ? 0.0F : ( value >= 255.0F ? 255.0F : value + 0.5F ) );
+    }
+  return grey;
+}
+
+/* Mask values as labels: the mask value itself for a single mask, the
+ * number of the last mask that covers the voxel otherwise. */
+GreySliceType::Pointer CombineMasks(const std::vector<const VolumeSlices *> & masks, const size_t plane)
+{
+  GreySliceType::Pointer labels = GreySliceType::New();
+
+  labels->SetRegions(masks[0]->Slices[plane]->GetBufferedRegion() );
+  labels->SetSpacing(masks[0]->Slices[plane]->GetSpacing() );
+  labels->Allocate();
+  labels->FillBuffer(0);
+  unsigned char *out = labels->GetBufferPointer();
+  const size_t   count = labels->GetBufferedRegion().GetNumberOfPixels();
+  for( size_t m = 0; m < masks.size(); ++m )
+    {
+    const float *in = masks[m]->Slices[plane]->GetBufferPointer();
+    for( size_t i = 0; i < count; ++i )
+      {
+      if( masks.size() == 1 )
+        {
+        out[i] = static_cast<unsigned char>(in[i]);
+        }
+      else if( in[i] > 0 )
+        {
+        out[i] = static_cast<unsigned char>(m + 1);
+        }
+      }
+    }
+  return labels;
+}
+
+RGBSliceType::Pointer GreyToRGB(const GreySliceType *grey)
+{
+  RGBSliceType::Pointer rgb = RGBSliceType::New();
+
+  rgb->SetRegions(grey->GetBufferedRegion() );
+  rgb->SetSpacing(grey->GetSpacing() );
+  rgb->Allocate();
+  const unsigned char *in = grey->GetBufferPointer();
+  RGBPixelType *       out = rgb->GetBufferPointer();
+  const size_t         count = grey->GetBufferedRegion().GetNumberOfPixels();
+  for( size_t i = 0; i < count; ++i )
+    {
+    out[i].Fill(in[i]);
+    }
+  return rgb;
+}
+
+/* Composite, tile and write the snapshot of one subject */
+std::string RenderSubject(const SubjectType & subject, const std::vector<const VolumeSlices *> & volumes,
+                          const std::vector<const VolumeSlices *> & masks, const size_t numberOfPlanes)
+{
+  typedef itk::LabelOverlayImageFilter<GreySliceType, GreySliceType, RGBSliceType> LabelOverlayFilter;
+  typedef itk::TileImageFilter<RGBSliceType, RGBSliceType>                          TileFilterType;
+  typedef itk::ImageFileWriter<RGBSliceType>                                        RGBFileWriterType;
+
+  TileFilterType::Pointer          tileFilter = TileFilterType::New();
+  itk::FixedArray<unsigned int, 2> layout;
+  layout[0] = volumes.size();
+  layout[1] = 0;
+  tileFilter->SetLayout(layout);
+  tileFilter->SetDefaultPixelValue(128);
+
+  for( size_t plane = 0; plane < numberOfPlanes; ++plane )
+    {
+    GreySliceType::Pointer labelSlice;
+    if( !masks.empty() )
+      {
+      for( size_t m = 0; m < masks.size(); ++m )
+        {
+        if( masks[m]->Slices[plane]->GetBufferedRegion() != volumes[0]->Slices[plane]->GetBufferedRegion() )
+          {
+          return "Mask and volume slices do not have the same size";
+          }
+        }
+      labelSlice = CombineMasks(masks, plane);
+      }
+    for( size_t i = 0; i < volumes.size(); ++i )
+      {
+      GreySliceType::Pointer greySlice =
+        WindowSlice(volumes[i]->Slices[plane], volumes[i]->WindowMinimum, volumes[i]->WindowMaximum);
+      RGBSliceType::Pointer rgbSlice;
+      if( labelSlice.IsNotNull() )
+        {
+        if( greySlice->GetBufferedRegion() != labelSlice->GetBufferedRegion() )
+          {
+          return "Mask and volume slices do not have the same size";
+          }
+        LabelOverlayFilter::Pointer rgbComposer = LabelOverlayFilter::New();
+        rgbComposer->SetNumberOfThreads(1);
+        rgbComposer->SetLabelImage(labelSlice);
+        rgbComposer->SetInput(greySlice);
+        rgbComposer->SetOpacity(.5F);
+        rgbComposer->Update();
+        rgbSlice = rgbComposer->GetOutput();
+        }
+      else
+        {
+        rgbSlice = GreyToRGB(greySlice);
+        }
+      tileFilter->SetInput(i + plane * volumes.size(), rgbSlice);
+      }
+    }
+
+  RGBFileWriterType::Pointer rgbFileWriter = RGBFileWriterType::New();
+  rgbFileWriter->SetInput(tileFilter->GetOutput() );
+  rgbFileWriter->SetFileName(subject.OutputFilename);
+  rgbFileWriter->Update();
+  return "";
+}
+
+struct BatchThreadStruct
+  {
+  const std::vector<SubjectType> *Subjects;
+  const SnapShotBatchOptions *    Options;
+  SliceCache *                    Cache;
+  size_t                          NextSubject;
+  unsigned int                    NumberOfFailures;
+  itk::SimpleFastMutexLock        Lock;
+  };
+
+ITK_THREAD_RETURN_TYPE BatchThreaderCallback(void *arg)
+{
+  BatchThreadStruct *str = static_cast<BatchThreadStruct *>(
+      static_cast<itk::MultiThreader::ThreadInfoStruct *>(arg)->UserData);
+
+  for( ;; )
+    {
+    str->Lock.Lock();
+    const size_t s = str->NextSubject++;
+    str->Lock.Unlock();
+    if( s >= str->Subjects->size() )
+      {
+      break;
+      }
+    const SubjectType &             subject = ( *str->Subjects )[s];
+    std::vector<const VolumeSlices *> volumes;
+    std::vector<const VolumeSlices *> masks;
+    std::string                     error;
+    for( size_t i = 0; i < subject.Volumes.size(); ++i )
+      {
+      volumes.push_back(&str->Cache->Acquire(subject.Volumes[i]) );
+      if( error.empty() )
+        {
+        error = volumes.back()->Error;
+        }
+      }
+    for( size_t i = 0; i < subject.Masks.size(); ++i )
+      {
+      masks.push_back(&str->Cache->Acquire(subject.Masks[i]) );
+      if( error.empty() )
+        {
+        error = masks.back()->Error;
+        }
+      }
+    if( error.empty() )
+      {
+      try
+        {
+        error = RenderSubject(subject, volumes, masks, str->Options->PlaneDirections.size() );
+        }
+      catch( itk::ExceptionObject & e )
+        {
+        error = e.what();
+        }
+      }
+    for( size_t i = 0; i < subject.Volumes.size(); ++i )
+      {
+      str->Cache->Release(subject.Volumes[i]);
+      }
+    for( size_t i = 0; i < subject.Masks.size(); ++i )
+      {
+      str->Cache->Release(subject.Masks[i]);
+      }
+
+    str->Lock.Lock();
+    if( error.empty() )
+      {
+      std::cout << "Wrote " << subject.OutputFilename << std::endl;
+      }
+    else
+      {
+      ++str->NumberOfFailures;
+      std::cout << "ERROR: " << subject.OutputFilename << ": " << error << std::endl;
+      }
+    str->Lock.Unlock();
+    }
+  return ITK_THREAD_RETURN_VALUE;
+}
+} // end anonymous namespace
+
+itk::IndexValueType DisplaySliceIndex(const itk::ImageBase<3> *displayImage, const SnapShotBatchOptions & options,
+                                      const size_t i)
+{
+  const int                         plane = options.PlaneDirections[i];
+  const itk::ImageBase<3>::RegionType largest = displayImage->GetLargestPossibleRegion();
+  const itk::IndexValueType          size = static_cast<itk::IndexValueType>(largest.GetSize(plane) );
+
+  if( !options.SliceIndices.empty() )
+    {
+    return options.SliceIndices[i];
+    }
+  if( !options.SlicePhysicalPoints.empty() )
+    {
+    itk::ImageBase<3>::PointType point;
+    point.Fill(options.SlicePhysicalPoints[i]);
+    itk::ImageBase<3>::IndexType index;
+    displayImage->TransformPhysicalPointToIndex(point, index);
+    return index[plane] - largest.GetIndex(plane);
+    }
+  return std::min<itk::IndexValueType>(size - 1, static_cast<itk::IndexValueType>(options.SlicePercents[i]) * size / 100);
+}
+
+int RunSnapShotBatch(const std::string & manifestFilename, const SnapShotBatchOptions & options)
+{
+  const size_t numberOfPlanes = options.PlaneDirections.size();
+
+  if( numberOfPlanes == 0 )
+    {
+    std::cout << "Input Plane Direction is required " << std::endl;
+    return EXIT_FAILURE;
+    }
+  // Slice positions by index, then physical point, then percent
+  const size_t numberOfSlices = !options.SliceIndices.empty() ? options.SliceIndices.size() :
+    ( !options.SlicePhysicalPoints.empty() ? options.SlicePhysicalPoints.size() : options.SlicePercents.size() );
+  if( numberOfSlices != numberOfPlanes )
+    {
+    std::cout << "Number of input slice number should be equal input plane direction." << std::endl;
+    return EXIT_FAILURE;
+    }
+  for( size_t i = 0; i < options.SlicePercents.size(); ++i )
+    {
+    if( options.SlicePercents[i] < 0 || options.SlicePercents[i] > 100 )
+      {
+      std::cout << "ERROR: Percent has to be between 0 and 100 " << std::endl;
+      return EXIT_FAILURE;
+      }
+    }
+
+  std::vector<SubjectType> subjects;
+  if( !ReadManifest(manifestFilename, subjects) )
+    {
+    return EXIT_FAILURE;
+    }
+
+  SliceCache cache(options);
+  for( size_t s = 0; s < subjects.size(); ++s )
+    {
+    for( size_t i = 0; i < subjects[s].Volumes.size(); ++i )
+      {
+      cache.AddUse(subjects[s].Volumes[i]);
+      }
+    for( size_t i = 0; i < subjects[s].Masks.size(); ++i )
+      {
+      cache.AddUse(subjects[s].Masks[i]);
+      }
+    }
+
+  BatchThreadStruct str;
+  str.Subjects = &subjects;
+  str.Options = &options;
+  str.Cache = &cache;
+  str.NextSubject = 0;
+  str.NumberOfFailures = 0;
+
+  itk::MultiThreader::Pointer threader = itk::MultiThreader::New();
+  const itk::ThreadIdType     concurrent = ( options.NumberOfConcurrentSubjects > 0 ) ?
+    options.NumberOfConcurrentSubjects : threader->GetNumberOfThreads();
+  threader->SetNumberOfThreads(static_cast<itk::ThreadIdType>(
+                                 std::max<size_t>(1, std::min<size_t>(concurrent, subjects.size() ) ) ) );
+  threader->SetSingleMethod(BatchThreaderCallback, &str);
+  threader->SingleMethodExecute();
+
+  std::cout << subjects.size() - str.NumberOfFailures << " of " << subjects.size()
+            << " snapshots written" << std::endl;
+  return ( str.NumberOfFailures == 0 ) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
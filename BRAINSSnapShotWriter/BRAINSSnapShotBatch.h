@@ -0,0 +1,78 @@
+/*=========================================================================
+ *
+ *  Copyright SINAPSE: Scalable Informatics for Neuroscience, Processing and Software Engineering
+ *            The University of Iowa
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#ifndef __BRAINSSnapShotBatch_h
+#define __BRAINSSnapShotBatch_h
+
+/*
+ * Batch QC snapshot rendering for many subjects.
+ *
+ * The manifest has one subject per line:
+ *
+ *   outputFilename,volume1[;volume2...][,mask1[;mask2...]]
+ *
+ * Empty lines and lines starting with '#' are ignored.  All subjects share
+ * the planes and slice positions given on the command line.
+ *
+ * Only the requested slices are read (the whole volume is read once when
+ * the file format cannot stream a region), and the grey level window of
+ * each volume is taken from percentiles of a sample of its slices rather
+ * than from a rescale of the whole volume.  Subjects are rendered and
+ * written concurrently; the slices of volumes listed by several subjects
+ * (e.g. a common atlas) are read once and shared until the last subject
+ * that needs them is done.
+ */
+
+#include "itkImageBase.h"
+
+#include <string>
+#include <vector>
+
+struct SnapShotBatchOptions
+  {
+  std::vector<int>   PlaneDirections;
+  std::vector<int>   SliceIndices;
+  std::vector<int>   SlicePercents;
+  std::vector<float> SlicePhysicalPoints;
+  /* Lower and upper percentiles of the grey level window */
+  double             WindowLowerPercentile;
+  double             WindowUpperPercentile;
+  unsigned int       NumberOfConcurrentSubjects;
+
+  SnapShotBatchOptions() :
+    WindowLowerPercentile(1.0),
+    WindowUpperPercentile(99.0),
+    NumberOfConcurrentSubjects(0)
+  {
+  }
+  };
+
+/* Index, from the start of the largest possible region, of the requested
+ * slice i of the options in an image that is in the display orientation of
+ * the snapshots (third axis flipped with itk::FlipImageFilter): the slice
+ * index itself, the percent of the number of slices of the plane, or the
+ * index of the physical point with the same coordinate along all axes.
+ * Both the single and the batch modes use this conversion. */
+itk::IndexValueType DisplaySliceIndex(const itk::ImageBase<3> *displayImage, const SnapShotBatchOptions & options,
+                                      size_t i);
+
+/* Render the snapshots of all subjects of the manifest, returning
+ * EXIT_SUCCESS only when every snapshot was written. */
+int RunSnapShotBatch(const std::string & manifestFilename, const SnapShotBatchOptions & options);
+
+#endif // __BRAINSSnapShotBatch_h
@@ -31,6 +31,7 @@
 #include "itkNearestNeighborInterpolateImageFunction.h"
 
 
+#include "BRAINSSnapShotBatch.h"
 #include "BRAINSSnapShotWriterCLP.h"
 
 /*
@@ -63,56 +64,37 @@ ExtractIndexType GetSliceIndexToExtract(
     exit(EXIT_FAILURE);
   }
 
-  ExtractIndexType sliceIndexToExtract;
-  if (!inputSliceToExtractInIndex.empty())
-  {
-    for (size_t i = 0; i < inputSliceToExtractInIndex.size(); i++)
-    {
-      sliceIndexToExtract.push_back(inputSliceToExtractInIndex[i]);
-    }
-  }
-  else if (!inputSliceToExtractInPhysicalPoint.empty())
+  for (size_t i = 0; i < inputSliceToExtractInPercent.size(); i++)
   {
-    for (unsigned int i = 0; i < inputSliceToExtractInPhysicalPoint.size(); i++)
+    if (inputSliceToExtractInPercent[i] < 0.0F ||
+        inputSliceToExtractInPercent[i] > 100.0F)
     {
-      typename TImageType::PointType physicalPoints;
-      typename TImageType::IndexType dummyIndex;
-      for (unsigned int p = 0; p < physicalPoints.Size(); p++)
-      {
-        // fill the same value
-        physicalPoints[p] = inputSliceToExtractInPhysicalPoint[i];
-      }
-      referenceImage->TransformPhysicalPointToIndex(physicalPoints,
-                                                    dummyIndex);
-
-      std::cout << inputSliceToExtractInPhysicalPoint[i]
-      << "-->"
-      << dummyIndex[planes[i]]
+      std::cout << "ERROR: Percent has to be between 0 and 100 "
       << std::endl;
-      sliceIndexToExtract.push_back(dummyIndex[planes[i]]);
+      exit(EXIT_FAILURE);
     }
   }
-  else if (!inputSliceToExtractInPercent.empty())
+
+  SnapShotBatchOptions options;
+  options.PlaneDirections = planes;
+  options.SliceIndices = inputSliceToExtractInIndex;
+  options.SlicePercents = inputSliceToExtractInPercent;
+  options.SlicePhysicalPoints = inputSliceToExtractInPhysicalPoint;
+
+  ExtractIndexType sliceIndexToExtract;
+  for (size_t i = 0; i < planes.size(); i++)
   {
-    for (unsigned int i = 0; i < inputSliceToExtractInPercent.size(); i++)
+    const itk::IndexValueType index = DisplaySliceIndex(referenceImage.GetPointer(), options, i);
+    if (inputSliceToExtractInIndex.empty())
     {
-      if (inputSliceToExtractInPercent[i] < 0.0F ||
-          inputSliceToExtractInPercent[i] > 100.0F)
-      {
-        std::cout << "ERROR: Percent has to be between 0 and 100 "
-        << std::endl;
-        exit(EXIT_FAILURE);
-      }
-      unsigned int size = (referenceImage->GetBufferedRegion()).GetSize()[planes[i]];
-      unsigned int index =
-        static_cast<unsigned int>((float) inputSliceToExtractInPercent[i] / 100.0F) * size;
-
-      std::cout << inputSliceToExtractInPercent[i]
+      std::cout << ( inputSliceToExtractInPhysicalPoint.empty()
+                     ? static_cast<float>(inputSliceToExtractInPercent[i])
+                     : inputSliceToExtractInPhysicalPoint[i] )
       << "-->"
       << index
       << std::endl;
-      sliceIndexToExtract.push_back(index);
     }
+    sliceIndexToExtract.push_back(index);
   }
 
   return sliceIndexToExtract;
@@ -318,6 +300,28 @@ main(int argc, char **argv)
   PARSE_ARGS;
   BRAINSRegisterAlternateIO();
 
+  if (!inputManifest.empty())
+  {
+    SnapShotBatchOptions options;
+    options.PlaneDirections = inputPlaneDirection;
+    options.SliceIndices = inputSliceToExtractInIndex;
+    options.SlicePercents = inputSliceToExtractInPercent;
+    options.SlicePhysicalPoints = inputSliceToExtractInPhysicalPoint;
+    if (intensityWindowPercentiles.size() != 2 ||
+        intensityWindowPercentiles[0] < 0.0F ||
+        intensityWindowPercentiles[1] > 100.0F ||
+        intensityWindowPercentiles[0] >= intensityWindowPercentiles[1])
+    {
+      std::cout << "ERROR: intensityWindowPercentiles has to be two increasing percentiles"
+      << std::endl;
+      exit(EXIT_FAILURE);
+    }
+    options.WindowLowerPercentile = intensityWindowPercentiles[0];
+    options.WindowUpperPercentile = intensityWindowPercentiles[1];
+    options.NumberOfConcurrentSubjects = numberOfConcurrentSubjects;
+    return RunSnapShotBatch(inputManifest, options);
+  }
+
   if (inputVolumes.empty())
   {
     std::cout << "Input image volume is required "
@@ -1,9 +1,9 @@
 #include "SRTypes.h"
 #include "FFTWUpsample.h"
-
-#include <cblas.h>
+#include "WeightedTVSolver.h"
 
 #include <itkTimeProbe.h>
+#include <itkCommand.h>
 
 #include "MathUtils.h"
 
@@ -14,83 +14,6 @@
 #include <itkGradientMagnitudeImageFilter.h>
 #include <itkBinaryFunctorImageFilter.h>
 
-//Special override for CVImageType
-PrecisionType * GetFirstPointer(CVImageType::Pointer in)
-{
-  CVType * firstCovariantVectorX = in->GetBufferPointer();
-  return  firstCovariantVectorX->GetDataPointer();
-}
-
-PrecisionType * GetFirstPointer(HalfHermetianImageType::Pointer in)
-{
-  return reinterpret_cast<PrecisionType *>(in->GetBufferPointer());
-}
-
-
-template<typename ImagePointerType>
-PrecisionType * GetFirstPointer(ImagePointerType in)
-{
-  return in->GetBufferPointer();
-}
-
-
-//Implement out = c*(a*x + y), y is output, and is corrupted
-template<typename ImagePointerType>
-void AddAllElements(ImagePointerType &OutImg,
-                           const PrecisionType aScaler,
-                           ImagePointerType &xImg, ImagePointerType &yImg,
-                           const PrecisionType cScaler= 1.0F)
-{
-  const size_t N = xImg->GetLargestPossibleRegion().GetNumberOfPixels()*xImg->GetNumberOfComponentsPerPixel();
-  PrecisionType * x =  GetFirstPointer(xImg);
-  PrecisionType * y =  GetFirstPointer(yImg);
-  cblas_saxpy(N,aScaler,x,1,y,1);
-
-  PrecisionType * Out=  GetFirstPointer(OutImg);
-  if(cScaler != 1.0F)
-  {
-  cblas_sscal(N,cScaler,y,1);
-  }
-  if( OutImg.GetPointer() != yImg.GetPointer())
-  {
-    ImagePointerType temp = OutImg;
-    OutImg = yImg;
-    yImg = temp; //Sanity Check to induce failures if variable is needed in future.
-    //yImg has been corrupted by processing here.
-  }
-}
-
-//Implement out = x*y, y, and y is corrupted
-template<typename ImagePointerType>
-void MultiplyVectors(ImagePointerType &OutImg,
-                           ImagePointerType &xImg, ImagePointerType &yImg)
-{
-  const size_t N = xImg->GetLargestPossibleRegion().GetNumberOfPixels()*xImg->GetNumberOfComponentsPerPixel();
-  PrecisionType * x_Start = GetFirstPointer(xImg);
-  const PrecisionType * x_End = x_Start+N;
-  const PrecisionType * y = GetFirstPointer(yImg);
-  PrecisionType * o = GetFirstPointer(OutImg);
-  //HACK ADD open_MP here
-  //HACK end = x+N : while x < end
-  for(PrecisionType *x = x_Start; x < x_End; ++x)
-  {
-    (*o) = (*y) * (*x);
-    ++o;
-    ++y;
-  }
-}
-
-template <typename ImageTypePointer>
-void Duplicate(ImageTypePointer & Y, ImageTypePointer &YminusL)
-{
-  const size_t N= Y->GetLargestPossibleRegion().GetNumberOfPixels() *Y->GetNumberOfComponentsPerPixel();
-  const PrecisionType * firstInput = GetFirstPointer(Y);
-  const PrecisionType * lastInput = firstInput + N;
-  PrecisionType * firstOutput = GetFirstPointer(YminusL);
-  std::copy(firstInput,lastInput,firstOutput);
-}
-
-
 #include <itkVectorMagnitudeImageFilter.h>
 
 FloatImageType::Pointer ComputeSqrtMu(FloatImageType::Pointer mu)
@@ -102,22 +25,6 @@ FloatImageType::Pointer ComputeSqrtMu(FloatImageType::Pointer mu)
   return sqrtFilter->GetOutput();
 }
 
-// (2*mu+gam)^{-1}
-static CVImageType::Pointer ComputeInvTwoMuPlusGamma( FloatImageType::Pointer edgemask,  const PrecisionType gam)
-{
-  CVImageType::Pointer repMu = CreateEmptyImage<CVImageType>(edgemask);
-  itk::ImageRegionIterator<CVImageType> cvIt(repMu,repMu->GetLargestPossibleRegion());
-  itk::ImageRegionConstIterator<FloatImageType> muIt(edgemask,edgemask->GetLargestPossibleRegion());
-  CVImageType::PixelType temp;
-  while(!muIt.IsAtEnd())
-  {
-    cvIt.Set( 1.0 / ( 2.0*muIt.Value() + gam) );
-    ++cvIt;
-    ++muIt;
-  }
-  return repMu;
-}
-
 static HalfHermetianImageType::Pointer GetAFP_of_b(FloatImageType::Pointer norm01_lowres, FloatImageType::Pointer edgemask)
 {
   FloatImageType::Pointer upsampledB = IdentityResampleByFFT(norm01_lowres, edgemask.GetPointer());
@@ -167,6 +74,21 @@ FloatImageType::Pointer TwoAtb =DeepImageCopy<FloatImageType>(Atb);
 return opIC(TwoAtb,TwoAtb,'*',2.0);
 }
 
+//Print the per iteration timing and convergence of the solver
+class IterationReporter
+{
+public:
+  IterationReporter(WeightedTVSolver * solver) : m_Solver(solver) {}
+  void Report()
+  {
+    std::cout << "Iteration : " << m_Solver->GetCurrentIteration()
+              << " residual: " << m_Solver->GetResidualNorm()
+              << " time: " << m_Solver->GetLastIterationTime() << "s" << std::endl;
+  }
+private:
+  WeightedTVSolver * m_Solver;
+};
+
 /*
 OPWEIGHTEDL2: Solves weighted L2 regularized inverse problems.
 Minimizes the cost function
@@ -220,22 +142,6 @@ FloatImageType::Pointer OpWeightedL2(FloatImageType::Pointer norm01_lowres, Floa
   FloatImageType::Pointer X = DeepImageCopy<FloatImageType>(Atb);
   Atb = nullptr; //Save memory here
 
-  CVImageType::Pointer DX = GetGradient(X);
-  CVImageType::Pointer L = CreateEmptyImage<CVImageType>(DX);
-  CVImageType::Pointer Y = CreateEmptyImage<CVImageType>(DX);
-  //CVImageType::Pointer WDX = CreateEmptyImage<CVImageType>(DX);
-  CVImageType::Pointer residue = CreateEmptyImage<CVImageType>(DX);
-  CVImageType::Pointer YminusL = CreateEmptyImage<CVImageType>(DX);
-  FloatImageType::Pointer tempValue=CreateEmptyImage<FloatImageType>(DX);
-
-  std::vector<PrecisionType> resvec(Niter,0);
-  std::vector<PrecisionType> cost(Niter,0);
-
-#ifdef USE_WRITE_DEGUBBING
-  itk::ComplexToModulusImageFilter<HalfHermetianImageType,FloatImageType>::Pointer cpx2abs =
-  itk::ComplexToModulusImageFilter<HalfHermetianImageType,FloatImageType>::New();
-#endif
-
   CVImageType::Pointer gradIm = GetGradient(p_image);
   FloatImageType::Pointer divIm = GetDivergence(gradIm);
   HalfHermetianImageType::Pointer DtDhat = GetForwardFFT(divIm);
@@ -249,95 +155,29 @@ FloatImageType::Pointer OpWeightedL2(FloatImageType::Pointer norm01_lowres, Floa
     TwoTimesAtAhatPlusLamGamDtDhat = opII(TwoTimesAtAhatPlusLamGamDtDhat,TwoTimesAtAhat,'+',TwoTimesAtAhatPlusLamGamDtDhat);
   }
   p_image = nullptr; //Save memory
-
-  const bool edgemask_ActualXDimensionIsOdd = edgemask->GetLargestPossibleRegion().GetSize()[0] % 2 == 1;
-
-  CVImageType::Pointer InvTwoMuPlusGamma = ComputeInvTwoMuPlusGamma(edgemask,gam);
-  //FloatImageType::Pointer SqrtMu = ComputeSqrtMu(edgemask);
-
-#define USE_BLAS_WRAPPERS
-#ifdef USE_BLAS_WRAPPERS
-#else
-  typedef itk::AddImageFilter<CVImageType,CVImageType> CVImageAdder;
-  CVImageAdder::Pointer dxPlusL = CVImageAdder::New();
-#endif
-
-  itk::TimeProbe tp;
-  tp.Start();
-
-  HalfHermetianImageType::Pointer tempRatioFC = CreateEmptyImage<HalfHermetianImageType>(DtDhat);
-
-  for (size_t i=0; i < Niter; ++i)
-  {
-    std::cout << "Iteration : " << i << std::endl;
-
-#ifdef USE_BLAS_WRAPPERS
-    //Z = 1.0*L+DX
-    AddAllElements(DX,1.0F,L,DX,gam);//DX destroyed
-    CVImageType::Pointer & Z = DX;
-#else
-    //Z = opII(Z,DX,'+',L);
-    dxPlusL->SetInput1(DX);
-    dxPlusL->SetInput2(L);
-    dxPlusL->SetInPlace(true);
-    dxPlusL->Update();
-    CVImageType::Pointer Z=dxPlusL->GetOutput();
-    MultiplyCVByScalar(Z,gam);
-#endif
-#ifdef USE_BLAS_WRAPPERS
-    //Y=InvTwoMuPlusGamm.*Z
-    MultiplyVectors(Y,InvTwoMuPlusGamma,Z);
-#else
-    Y = opII(Y,Z,'*',InvTwoMuPlusGamma);
-#endif
-
-    // X Subprob
-    // Numerator = 2*Atb+lambda*gam*SRdiv(Y-L))
-#ifdef USE_BLAS_WRAPPERS
-    //YminusL = 1.0F* SRdiv( -1.0F*L + Y)
-    Duplicate(Y,YminusL);
-    AddAllElements(YminusL,-1.0F,L,YminusL,1.0F);
-#else
-    YminusL=opII(YminusL,Y,'-',L);
-#endif
-    FloatImageType::Pointer tempNumerator=GetDivergence(YminusL);
-#ifdef USE_BLAS_WRAPPERS
-    //lambd*gam*tempNumerator+TwoAtb
-    Duplicate(TwoAtb,tempValue);
-    AddAllElements(tempValue,lambda*gam,tempNumerator,tempValue,1.0F);
-    HalfHermetianImageType::Pointer tempNumeratorFC = GetForwardFFT(tempValue);
-#else
-    tempNumerator=opIC(tempNumerator,lambda*gam,'*',tempNumerator);
-    tempNumerator=opII(tempNumerator,TwoAtb,'+',tempNumerator);
-    HalfHermetianImageType::Pointer tempNumeratorFC = GetForwardFFT(tempNumerator);
-#endif
-
-    //KEEP
-    tempRatioFC = opII_scalar(tempRatioFC,tempNumeratorFC,'/',TwoTimesAtAhatPlusLamGamDtDhat);
-
-    X = GetInverseFFT(tempRatioFC,edgemask_ActualXDimensionIsOdd,1.0); //TODO: Determine scale factor here. X
-
-    // should be on same dynamic range as b
-    DX = GetGradient(X);
-    residue = opII(residue, DX, '-', Y); //TODO:  Implement math graph output here
-    L = opII(L,L,'+',residue);
-
-    //
-    resvec[i] = 0; //TODO: Figure out the math for here
-    if ( i > 900000 )
-    {
-      tp.Stop();
-      std::cout << " Only iterations " << tp.GetTotal() << tp.GetUnit() << std::endl;
-      return X;
-    }
-    if( i > 99 ) //HACK: Cutting this function short
-    {
-      return X;
-    }
-    //WDX = opII_CVmult(WDX,SqrtMu,'*',DX);
-    //diff = opII(diff,A_fhp(X,norm01_lowres.GetPointer()),'-',b_FC);
-    //
-    //cost[i] = 0; //TODO: Need to figure out math for here
-  }
+  gradIm = nullptr;
+  divIm = nullptr;
+  DtDhat = nullptr;
+
+  // All work buffers and FFT plans are created once, and reused by every iteration.
+  WeightedTVSolver::Pointer solver = WeightedTVSolver::New();
+  solver->SetLambda(lambda);
+  solver->SetGamma(gam);
+  solver->SetMaximumNumberOfIterations(Niter);
+  solver->SetTolerance(tol);
+  solver->Initialize(TwoAtb, X, edgemask, TwoTimesAtAhatPlusLamGamDtDhat);
+  TwoAtb = nullptr;
+  X = nullptr;
+  TwoTimesAtAhatPlusLamGamDtDhat = nullptr;
+
+  typedef itk::SimpleMemberCommand<IterationReporter> ReporterCommandType;
+  IterationReporter reporter(solver);
+  ReporterCommandType::Pointer reportCommand = ReporterCommandType::New();
+  reportCommand->SetCallbackFunction(&reporter, &IterationReporter::Report);
+  solver->AddObserver(itk::IterationEvent(), reportCommand);
+
+  X = solver->Solve();
+  std::cout << " Iterations " << solver->GetCurrentIteration()
+            << " took " << solver->GetTotalIterationTime() << "s" << std::endl;
   return X;
 }
@@ -0,0 +1,300 @@
+//
+// Iterative core of the edge based weighted TV super resolution solver.
+//
+#include "WeightedTVSolver.h"
+
+#include <itkImageRegionConstIterator.h>
+#include <itkImageRegionConstIteratorWithIndex.h>
+#include <itkEventObject.h>
+#include <itkTimeProbe.h>
+#include <itkFFTWGlobalConfiguration.h>
+
+#include <algorithm>
+#include <cmath>
+
+WeightedTVSolver::WeightedTVSolver() :
+  m_Lambda(1e-3F),
+  m_Gamma(1.0F),
+  m_MaximumNumberOfIterations(100),
+  m_Tolerance(1e-8F),
+  m_NumberOfThreads(itk::MultiThreader::GetGlobalDefaultNumberOfThreads()),
+  m_CurrentIteration(0),
+  m_LastIterationTime(0.0),
+  m_TotalIterationTime(0.0),
+  m_ResidualNorm(0.0),
+  m_NumberOfPixels(0),
+  m_NumberOfSpectrumPixels(0),
+  m_ForwardPlan(ITK_NULLPTR),
+  m_InversePlan(ITK_NULLPTR),
+  m_PlansCreated(false)
+{
+  m_Size[0] = m_Size[1] = m_Size[2] = 0;
+}
+
+WeightedTVSolver::~WeightedTVSolver()
+{
+  this->DestroyPlans();
+}
+
+void WeightedTVSolver::DestroyPlans()
+{
+  if( m_PlansCreated )
+  {
+    FFTWProxyType::DestroyPlan(m_ForwardPlan);
+    FFTWProxyType::DestroyPlan(m_InversePlan);
+    m_PlansCreated = false;
+  }
+}
+
+void WeightedTVSolver::Initialize(FloatImageType::Pointer TwoAtb,
+                                  FloatImageType::Pointer initialX,
+                                  FloatImageType::Pointer edgemask,
+                                  HalfHermetianImageType::Pointer denominator)
+{
+  const FloatImageType::SizeType size = TwoAtb->GetLargestPossibleRegion().GetSize();
+  for( size_t d = 0; d < 3; ++d )
+  {
+    m_Size[d] = size[d];
+  }
+  m_NumberOfPixels = m_Size[0] * m_Size[1] * m_Size[2];
+  // r2c only stores the non-redundant half of the fastest varying dimension
+  const size_t halfX = m_Size[0] / 2 + 1;
+  m_NumberOfSpectrumPixels = halfX * m_Size[1] * m_Size[2];
+
+  m_X = CreateEmptyImage<FloatImageType>(TwoAtb);
+  m_TwoAtb.assign(TwoAtb->GetBufferPointer(), TwoAtb->GetBufferPointer() + m_NumberOfPixels);
+  m_Numerator.assign(m_NumberOfPixels, 0.0F);
+  m_Spectrum.assign(m_NumberOfSpectrumPixels, ComplexType(0.0F, 0.0F));
+  m_Y.assign(3 * m_NumberOfPixels, 0.0F);
+  m_L.assign(3 * m_NumberOfPixels, 0.0F);
+  m_YminusL.assign(3 * m_NumberOfPixels, 0.0F);
+
+  // (2*mu+gam)^{-1} is the same for the three gradient components, store it once.
+  m_InvTwoMuPlusGamma.resize(m_NumberOfPixels);
+  {
+    const PrecisionType * mu = edgemask->GetBufferPointer();
+    for( size_t i = 0; i < m_NumberOfPixels; ++i )
+    {
+      m_InvTwoMuPlusGamma[i] = 1.0F / ( 2.0F * mu[i] + m_Gamma );
+    }
+  }
+
+  // Keep only the half spectrum of the denominator, laid out as the r2c output.
+  m_Denominator.resize(m_NumberOfSpectrumPixels);
+  {
+    const ComplexType * fullDenominator = denominator->GetBufferPointer();
+    for( size_t z = 0; z < m_Size[2]; ++z )
+    {
+      for( size_t y = 0; y < m_Size[1]; ++y )
+      {
+        const ComplexType * fullRow = fullDenominator + ( z * m_Size[1] + y ) * m_Size[0];
+        std::copy(fullRow, fullRow + halfX, &m_Denominator[( z * m_Size[1] + y ) * halfX]);
+      }
+    }
+  }
+
+  // FFTW dimensions are given slowest to fastest varying
+  this->DestroyPlans();
+  int n[3];
+  n[0] = static_cast<int>(m_Size[2]);
+  n[1] = static_cast<int>(m_Size[1]);
+  n[2] = static_cast<int>(m_Size[0]);
+  const unsigned int planRigor = itk::FFTWGlobalConfiguration::GetPlanRigor();
+  // Planning may overwrite the buffers, so all buffers are filled after this point.
+  m_ForwardPlan = FFTWProxyType::Plan_dft_r2c(3, n, &m_Numerator[0],
+                                              reinterpret_cast<FFTWProxyType::ComplexType *>(&m_Spectrum[0]),
+                                              planRigor, m_NumberOfThreads, false);
+  m_InversePlan = FFTWProxyType::Plan_dft_c2r(3, n,
+                                              reinterpret_cast<FFTWProxyType::ComplexType *>(&m_Spectrum[0]),
+                                              m_X->GetBufferPointer(),
+                                              planRigor, m_NumberOfThreads, true);
+  m_PlansCreated = true;
+
+  std::copy(initialX->GetBufferPointer(), initialX->GetBufferPointer() + m_NumberOfPixels, m_X->GetBufferPointer());
+  m_ThreadResidual.assign(m_NumberOfThreads, 0.0);
+  m_ResidualHistory.clear();
+  m_CurrentIteration = 0;
+  m_TotalIterationTime = 0.0;
+}
+
+FloatImageType::Pointer WeightedTVSolver::Solve()
+{
+  if( !m_PlansCreated )
+  {
+    itkExceptionMacro(<< "Initialize must be called before Solve");
+  }
+  // Initial Y and Y-L from the gradient of the initial estimate, L == 0
+  this->RunPass(DUAL_UPDATE_PASS, true);
+
+  for( m_CurrentIteration = 0; m_CurrentIteration < m_MaximumNumberOfIterations; ++m_CurrentIteration )
+  {
+    itk::TimeProbe tp;
+    tp.Start();
+
+    // X Subprob: X = IFFT( FFT(2*Atb+lambda*gam*SRdiv(Y-L)) / (2*AtA+lambda*gam*DtD) )
+    this->RunPass(NUMERATOR_PASS);
+    FFTWProxyType::Execute(m_ForwardPlan);
+    this->RunPass(RATIO_PASS);
+    FFTWProxyType::Execute(m_InversePlan);
+
+    // Shrinkage and Lagrange multiplier updates with the new X
+    this->RunPass(DUAL_UPDATE_PASS, false);
+
+    tp.Stop();
+    m_LastIterationTime = tp.GetTotal();
+    m_TotalIterationTime += m_LastIterationTime;
+
+    double residual = 0.0;
+    for( size_t t = 0; t < m_ThreadResidual.size(); ++t )
+    {
+      residual += m_ThreadResidual[t];
+    }
+    m_ResidualNorm = std::sqrt(residual / static_cast<double>(3 * m_NumberOfPixels));
+    m_ResidualHistory.push_back(static_cast<PrecisionType>(m_ResidualNorm));
+
+    this->InvokeEvent(itk::IterationEvent());
+    if( m_ResidualNorm < m_Tolerance )
+    {
+      ++m_CurrentIteration;
+      break;
+    }
+  }
+  return m_X;
+}
+
+void WeightedTVSolver::RunPass(const PassType pass, const bool firstUpdate)
+{
+  ThreadStruct str;
+  str.Solver = this;
+  str.Pass = pass;
+  str.FirstUpdate = firstUpdate;
+
+  std::fill(m_ThreadResidual.begin(), m_ThreadResidual.end(), 0.0);
+  itk::MultiThreader::Pointer threader = itk::MultiThreader::New();
+  threader->SetNumberOfThreads(m_NumberOfThreads);
+  threader->SetSingleMethod(PassThreaderCallback, &str);
+  threader->SingleMethodExecute();
+}
+
+ITK_THREAD_RETURN_TYPE WeightedTVSolver::PassThreaderCallback(void *arg)
+{
+  itk::MultiThreader::ThreadInfoStruct * info = static_cast<itk::MultiThreader::ThreadInfoStruct *>(arg);
+  ThreadStruct * str = static_cast<ThreadStruct *>(info->UserData);
+  WeightedTVSolver * self = str->Solver;
+  const itk::ThreadIdType threadId = info->ThreadID;
+  const itk::ThreadIdType threadCount = info->NumberOfThreads;
+
+  if( str->Pass == RATIO_PASS )
+  {
+    const size_t chunk = ( self->m_NumberOfSpectrumPixels + threadCount - 1 ) / threadCount;
+    const size_t start = std::min(self->m_NumberOfSpectrumPixels, threadId * chunk);
+    const size_t end = std::min(self->m_NumberOfSpectrumPixels, start + chunk);
+    self->ThreadedRatio(start, end);
+    return ITK_THREAD_RETURN_VALUE;
+  }
+
+  // Slabs of whole z slices
+  const size_t slabs = ( self->m_Size[2] + threadCount - 1 ) / threadCount;
+  const size_t zStart = std::min(self->m_Size[2], threadId * slabs);
+  const size_t zEnd = std::min(self->m_Size[2], zStart + slabs);
+  if( str->Pass == NUMERATOR_PASS )
+  {
+    self->ThreadedNumerator(zStart, zEnd);
+  }
+  else
+  {
+    self->ThreadedDualUpdate(zStart, zEnd, str->FirstUpdate, threadId);
+  }
+  return ITK_THREAD_RETURN_VALUE;
+}
+
+// numerator = 2*Atb + lambda*gam*(-div(Y-L)), with a periodic backward difference divergence
+void WeightedTVSolver::ThreadedNumerator(const size_t zStart, const size_t zEnd)
+{
+  const size_t nx = m_Size[0];
+  const size_t ny = m_Size[1];
+  const size_t nz = m_Size[2];
+  const PrecisionType scale = m_Lambda * m_Gamma;
+  const PrecisionType * W = &m_YminusL[0];
+
+  for( size_t z = zStart; z < zEnd; ++z )
+  {
+    const size_t zPrev = ( z == 0 ) ? nz - 1 : z - 1;
+    for( size_t y = 0; y < ny; ++y )
+    {
+      const size_t yPrev = ( y == 0 ) ? ny - 1 : y - 1;
+      const size_t row = ( z * ny + y ) * nx;
+      const size_t rowYPrev = ( z * ny + yPrev ) * nx;
+      const size_t rowZPrev = ( zPrev * ny + y ) * nx;
+      for( size_t x = 0; x < nx; ++x )
+      {
+        const size_t xPrev = ( x == 0 ) ? nx - 1 : x - 1;
+        const size_t i = row + x;
+        const PrecisionType div =
+          ( W[3 * i + 0] - W[3 * ( row + xPrev ) + 0] )
+          + ( W[3 * i + 1] - W[3 * ( rowYPrev + x ) + 1] )
+          + ( W[3 * i + 2] - W[3 * ( rowZPrev + x ) + 2] );
+        m_Numerator[i] = m_TwoAtb[i] - scale * div;
+      }
+    }
+  }
+}
+
+// ratio = numerator / denominator, with the 1/N normalization of the inverse FFT folded in
+void WeightedTVSolver::ThreadedRatio(const size_t start, const size_t end)
+{
+  const PrecisionType inverseN = 1.0F / static_cast<PrecisionType>(m_NumberOfPixels);
+  const ComplexType zero(0.0F, 0.0F);
+  for( size_t i = start; i < end; ++i )
+  {
+    const ComplexType & den = m_Denominator[i];
+    m_Spectrum[i] = ( den != zero ) ? ( m_Spectrum[i] / den ) * inverseN : zero;
+  }
+}
+
+// DX = grad(X) with periodic forward differences,
+// L = L + (DX - Y), Y = gam*(DX+L)/(2*mu+gam), YminusL = Y - L
+void WeightedTVSolver::ThreadedDualUpdate(const size_t zStart, const size_t zEnd, const bool firstUpdate,
+                                          const itk::ThreadIdType threadId)
+{
+  const size_t nx = m_Size[0];
+  const size_t ny = m_Size[1];
+  const size_t nz = m_Size[2];
+  const PrecisionType * X = m_X->GetBufferPointer();
+  double residual = 0.0;
+
+  for( size_t z = zStart; z < zEnd; ++z )
+  {
+    const size_t zNext = ( z + 1 == nz ) ? 0 : z + 1;
+    for( size_t y = 0; y < ny; ++y )
+    {
+      const size_t yNext = ( y + 1 == ny ) ? 0 : y + 1;
+      const size_t row = ( z * ny + y ) * nx;
+      const size_t rowYNext = ( z * ny + yNext ) * nx;
+      const size_t rowZNext = ( zNext * ny + y ) * nx;
+      for( size_t x = 0; x < nx; ++x )
+      {
+        const size_t xNext = ( x + 1 == nx ) ? 0 : x + 1;
+        const size_t i = row + x;
+        PrecisionType DX[3];
+        DX[0] = X[row + xNext] - X[i];
+        DX[1] = X[rowYNext + x] - X[i];
+        DX[2] = X[rowZNext + x] - X[i];
+        const PrecisionType shrink = m_Gamma * m_InvTwoMuPlusGamma[i];
+        for( size_t c = 0; c < 3; ++c )
+        {
+          const size_t k = 3 * i + c;
+          if( !firstUpdate )
+          {
+            const PrecisionType residue = DX[c] - m_Y[k];
+            residual += static_cast<double>(residue) * residue;
+            m_L[k] += residue;
+          }
+          m_Y[k] = shrink * ( DX[c] + m_L[k] );
+          m_YminusL[k] = m_Y[k] - m_L[k];
+        }
+      }
+    }
+  }
+  m_ThreadResidual[threadId] = residual;
+}
@@ -0,0 +1,157 @@
+//
+// Iterative core of the edge based weighted TV super resolution solver.
+//
+#ifndef WeightedTVSolver_h_
+#define WeightedTVSolver_h_
+
+#include "SRTypes.h"
+
+#include <itkObject.h>
+#include <itkObjectFactory.h>
+#include <itkMultiThreader.h>
+#include <itkFFTWCommon.h>
+
+#include <complex>
+#include <vector>
+
+/**
+ * @brief Preallocated, plan reusing implementation of the OPWEIGHTEDL2 iterations.
+ *
+ * All real, covariant vector and complex work buffers are allocated once in
+ * Initialize(), and the FFTW r2c/c2r plans are created once for those buffers
+ * and reused for every iteration.  Each iteration is computed with three
+ * multithreaded passes over the volume, plus the two FFT executions:
+ *
+ *   1. numerator = 2*Atb - lambda*gam*div(Y-L)            (written into the FFT input)
+ *   2. ratio     = FFT(numerator) / (2*AtA + lambda*gam*DtD) / N   (in place on the spectrum)
+ *   3. DX = grad(X), L += DX - Y, Y = gam*(DX+L)/(2*mu+gam), W = Y-L   (shrinkage/dual update)
+ *
+ * The gradient and divergence are the forward and backward periodic
+ * differences without spacing used by GetGradient()/GetDivergence().
+ *
+ * An itk::IterationEvent is invoked after every iteration.  Observers can
+ * query GetCurrentIteration(), GetLastIterationTime() and GetResidualNorm()
+ * for per iteration timing and convergence tracking.
+ */
+class WeightedTVSolver : public itk::Object
+{
+public:
+  typedef WeightedTVSolver              Self;
+  typedef itk::Object                   Superclass;
+  typedef itk::SmartPointer<Self>       Pointer;
+  typedef itk::SmartPointer<const Self> ConstPointer;
+
+  itkNewMacro(Self);
+  itkTypeMacro(WeightedTVSolver, itk::Object);
+
+  typedef std::complex<PrecisionType> ComplexType;
+
+  itkSetMacro(Lambda, PrecisionType);
+  itkGetConstMacro(Lambda, PrecisionType);
+  itkSetMacro(Gamma, PrecisionType);
+  itkGetConstMacro(Gamma, PrecisionType);
+  itkSetMacro(MaximumNumberOfIterations, unsigned int);
+  itkGetConstMacro(MaximumNumberOfIterations, unsigned int);
+  /** Iterations stop when the RMS of the residual DX-Y falls below this value */
+  itkSetMacro(Tolerance, PrecisionType);
+  itkGetConstMacro(Tolerance, PrecisionType);
+  itkSetMacro(NumberOfThreads, itk::ThreadIdType);
+  itkGetConstMacro(NumberOfThreads, itk::ThreadIdType);
+
+  itkGetConstMacro(CurrentIteration, unsigned int);
+  /** Wall clock seconds spent in the last completed iteration */
+  itkGetConstMacro(LastIterationTime, double);
+  /** Wall clock seconds spent in all iterations so far */
+  itkGetConstMacro(TotalIterationTime, double);
+  /** RMS of DX-Y after the last completed iteration */
+  itkGetConstMacro(ResidualNorm, double);
+
+  /** RMS residual recorded after each completed iteration */
+  const std::vector<PrecisionType> & GetResidualHistory() const
+  {
+    return m_ResidualHistory;
+  }
+
+  /**
+   * Allocate all work buffers and FFTW plans.
+   * @param TwoAtb Twice the back projected measurements, also defines the output grid
+   * @param initialX Starting estimate of the high resolution image
+   * @param edgemask The edge weights mu
+   * @param denominator Full complex spectrum of 2*AtA+lambda*gam*DtD
+   */
+  void Initialize(FloatImageType::Pointer TwoAtb,
+                  FloatImageType::Pointer initialX,
+                  FloatImageType::Pointer edgemask,
+                  HalfHermetianImageType::Pointer denominator);
+
+  /** Run the iterations, returning the recovered image */
+  FloatImageType::Pointer Solve();
+
+protected:
+  WeightedTVSolver();
+  ~WeightedTVSolver();
+
+private:
+  WeightedTVSolver(const Self &); // purposely not implemented
+  void operator=(const Self &);   // purposely not implemented
+
+  enum PassType
+    {
+    NUMERATOR_PASS,
+    RATIO_PASS,
+    DUAL_UPDATE_PASS
+    };
+
+  struct ThreadStruct
+    {
+    WeightedTVSolver *Solver;
+    PassType Pass;
+    bool FirstUpdate;
+    };
+
+  void RunPass(const PassType pass, const bool firstUpdate = false);
+  static ITK_THREAD_RETURN_TYPE PassThreaderCallback(void *arg);
+
+  void ThreadedNumerator(const size_t zStart, const size_t zEnd);
+  void ThreadedRatio(const size_t start, const size_t end);
+  void ThreadedDualUpdate(const size_t zStart, const size_t zEnd, const bool firstUpdate,
+                          const itk::ThreadIdType threadId);
+
+  void DestroyPlans();
+
+  typedef itk::fftw::Proxy<PrecisionType> FFTWProxyType;
+
+  PrecisionType      m_Lambda;
+  PrecisionType      m_Gamma;
+  unsigned int       m_MaximumNumberOfIterations;
+  PrecisionType      m_Tolerance;
+  itk::ThreadIdType  m_NumberOfThreads;
+
+  unsigned int m_CurrentIteration;
+  double       m_LastIterationTime;
+  double       m_TotalIterationTime;
+  double       m_ResidualNorm;
+
+  std::vector<PrecisionType> m_ResidualHistory;
+
+  size_t m_Size[3];
+  size_t m_NumberOfPixels;
+  size_t m_NumberOfSpectrumPixels;
+
+  FloatImageType::Pointer    m_X;          // The real output of the c2r plan
+  std::vector<PrecisionType> m_TwoAtb;
+  std::vector<PrecisionType> m_InvTwoMuPlusGamma;
+  std::vector<PrecisionType> m_Numerator;  // The real input of the r2c plan
+  std::vector<ComplexType>   m_Spectrum;   // The complex output of r2c and input of c2r
+  std::vector<ComplexType>   m_Denominator; // Non-redundant half of the denominator spectrum
+  std::vector<PrecisionType> m_Y;          // Interleaved 3-vector images
+  std::vector<PrecisionType> m_L;
+  std::vector<PrecisionType> m_YminusL;
+  std::vector<double>        m_ThreadResidual;
+
+  FFTWProxyType::PlanType m_ForwardPlan;
+  FFTWProxyType::PlanType m_InversePlan;
+  bool                    m_PlansCreated;
+};
+
+#endif // WeightedTVSolver_h_
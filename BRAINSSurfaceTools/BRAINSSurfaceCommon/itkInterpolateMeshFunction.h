@@ -21,6 +21,7 @@
 
 #include "itkMeshFunction.h"
 #include "itkPointLocator2.h"
+#include "itkSimpleFastMutexLock.h"
 
 namespace itk
 {
@@ -93,7 +94,7 @@ public:
 
   /** Prepare internal data structures of the PointLocator. This method must be
    * called before performing any call to Evaluate. */
-  void Initialize();
+  virtual void Initialize();
 
 protected:
   InterpolateMeshFunction();
@@ -106,7 +107,9 @@ protected:
 
   typedef typename PointLocatorType::InstanceIdentifierVectorType InstanceIdentifierVectorType;
 
-  /** Searches the k-nearest neighbors */
+  /** Searches the k-nearest neighbors. The searches are serialized because
+   * the Kd-Tree keeps the state of the current search, so that Evaluate()
+   * can be called from several threads. */
   void Search(const PointType & query, unsigned int numberOfNeighborsRequested,
               InstanceIdentifierVectorType& result) const;
 
@@ -120,6 +123,8 @@ private:
   ITK_DISALLOW_COPY_AND_ASSIGN(InterpolateMeshFunction);
 
   PointLocatorPointer m_PointLocator;
+
+  mutable SimpleFastMutexLock m_SearchLock;
 };
 } // end namespace itk
 
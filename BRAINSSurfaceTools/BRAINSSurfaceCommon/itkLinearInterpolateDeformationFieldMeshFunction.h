@@ -97,6 +97,7 @@ protected:
   void PrintSelf(std::ostream& os, Indent indent) const ITK_OVERRIDE;
 
   typedef typename Superclass::InstanceIdentifierVectorType InstanceIdentifierVectorType;
+  typedef typename Superclass::TriangleWeightsType          TriangleWeightsType;
 private:
   ITK_DISALLOW_COPY_AND_ASSIGN(LinearInterpolateDeformationFieldMeshFunction);
 };
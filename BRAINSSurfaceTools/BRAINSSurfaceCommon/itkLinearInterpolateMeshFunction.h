@@ -22,6 +22,7 @@
 #include "itkInterpolateMeshFunction.h"
 #include "itkTriangleBasisSystem.h"
 #include "itkTriangleBasisSystemCalculator.h"
+#include "itkSphericalTriangleLocator.h"
 
 namespace itk
 {
@@ -32,6 +33,11 @@ namespace itk
  * point, and then will compute on it the output value using linear
  * interpolation among the values at the points of the cell.
  *
+ * The triangle is looked up in a SphericalTriangleLocator built by
+ * Initialize(), and in the triangles around the nearest mesh points when
+ * the locator does not resolve the point.  Evaluate() keeps no state between
+ * calls and can be called concurrently from several threads.
+ *
  * \sa VectorLinearInterpolateMeshFunction
  * \ingroup MeshFunctions MeshInterpolators
  *
@@ -96,9 +102,25 @@ public:
 
   typedef typename Superclass::InstanceIdentifierVectorType InstanceIdentifierVectorType;
 
+  /** Interpolation weights of a point in a triangle and the basis of the
+   * triangle used to compute derivatives. */
+  struct TriangleWeightsType
+    {
+    VectorType U12;
+    VectorType U32;
+    RealType   Weights[MeshDimension];
+    };
+
+  typedef SphericalTriangleLocator<TInputMesh> TriangleLocatorType;
+
   /** Find the triangle that contains the input point. Return the point Ids of the triangle vertices. */
   virtual bool FindTriangle( const PointType& point, InstanceIdentifierVectorType & pointIds ) const;
 
+  /** Find the triangle that contains the input point. Return the point Ids
+   * of the triangle vertices and the interpolation weights of the point. */
+  bool FindTriangle( const PointType& point, InstanceIdentifierVectorType & pointIds,
+                     TriangleWeightsType & weights ) const;
+
   /** Find the first triangle touching the closest point to the input point,
    * and return the point Ids of the triangle vertices. Note that this triangle
    * will not necessarily contain the input point. Thie method is a good fallback
@@ -123,27 +145,33 @@ public:
   itkSetMacro( UseNearestNeighborInterpolationAsBackup, bool );
   itkGetConstMacro( UseNearestNeighborInterpolationAsBackup, bool );
   itkBooleanMacro( UseNearestNeighborInterpolationAsBackup );
+
+  /** When this boolean flag is ON (the default), Initialize() builds a
+   * spherical bucket grid over the triangles of the mesh, which finds the
+   * triangle of a point in constant expected time. */
+  itkSetMacro( UseTriangleLocator, bool );
+  itkGetConstMacro( UseTriangleLocator, bool );
+  itkBooleanMacro( UseTriangleLocator );
+
+  /** Get the triangle locator built by Initialize(). */
+  itkGetConstObjectMacro( TriangleLocator, TriangleLocatorType );
+
+  /** Prepare the point locator and the triangle locator. The Sphere Center
+   * must be set before this call for the triangle locator to be used. */
+  virtual void Initialize() ITK_OVERRIDE;
+
 protected:
   LinearInterpolateMeshFunction();
   ~LinearInterpolateMeshFunction();
 
   void PrintSelf(std::ostream& os, Indent indent) const ITK_OVERRIDE;
 
-  virtual bool ComputeWeights( const PointType & point, const InstanceIdentifierVectorType & pointIds ) const;
-
-  const RealType & GetInterpolationWeight( unsigned int ) const;
+  virtual bool ComputeWeights( const PointType & point, const InstanceIdentifierVectorType & pointIds,
+                               TriangleWeightsType & weights ) const;
 
 private:
   ITK_DISALLOW_COPY_AND_ASSIGN(LinearInterpolateMeshFunction);
 
-  mutable VectorType m_V12;
-  mutable VectorType m_V32;
-
-  mutable VectorType m_U12;
-  mutable VectorType m_U32;
-
-  mutable RealType m_InterpolationWeights[MeshDimension];
-
   itkStaticConstMacro( SurfaceDimension, unsigned int, 2 );
 
   typedef TriangleBasisSystem<VectorType, SurfaceDimension>                  TriangleBasisSystemType;
@@ -153,6 +181,9 @@ private:
 
   bool      m_UseNearestNeighborInterpolationAsBackup;
   PointType m_SphereCenter;
+
+  bool                                  m_UseTriangleLocator;
+  typename TriangleLocatorType::Pointer m_TriangleLocator;
 };
 } // end namespace itk
 
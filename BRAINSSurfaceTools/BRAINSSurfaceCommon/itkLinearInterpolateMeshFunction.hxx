@@ -36,6 +36,7 @@ LinearInterpolateMeshFunction<TInputMesh>
   this->m_TriangleBasisSystemCalculator = TriangleBasisSystemCalculatorType::New();
   this->m_SphereCenter.Fill( 0.0 );
   this->m_UseNearestNeighborInterpolationAsBackup = false;
+  this->m_UseTriangleLocator = true;
 }
 
 /**
@@ -56,6 +57,31 @@ LinearInterpolateMeshFunction<TInputMesh>
 ::PrintSelf( std::ostream& os, Indent indent) const
 {
   this->Superclass::PrintSelf( os, indent );
+  os << indent << "SphereCenter: " << this->m_SphereCenter << std::endl;
+  os << indent << "UseNearestNeighborInterpolationAsBackup: "
+     << this->m_UseNearestNeighborInterpolationAsBackup << std::endl;
+  os << indent << "UseTriangleLocator: " << this->m_UseTriangleLocator << std::endl;
+}
+
+/**
+ * Prepare the point locator and the triangle locator
+ */
+template <class TInputMesh>
+void
+LinearInterpolateMeshFunction<TInputMesh>
+::Initialize()
+{
+  this->Superclass::Initialize();
+
+  this->m_TriangleLocator = ITK_NULLPTR;
+
+  if( this->m_UseTriangleLocator )
+    {
+    this->m_TriangleLocator = TriangleLocatorType::New();
+    this->m_TriangleLocator->SetMesh( this->GetInputMesh() );
+    this->m_TriangleLocator->SetSphereCenter( this->m_SphereCenter );
+    this->m_TriangleLocator->Initialize();
+    }
 }
 
 /**
@@ -67,8 +93,9 @@ LinearInterpolateMeshFunction<TInputMesh>
 ::EvaluateDerivative( const PointType& point, DerivativeType & derivative ) const
 {
   InstanceIdentifierVectorType pointIds(3);
+  TriangleWeightsType          weights;
 
-  if( this->FindTriangle( point, pointIds ) )
+  if( this->FindTriangle( point, pointIds, weights ) )
     {
     PixelType pixelValue1 = itk::NumericTraits<PixelType>::ZeroValue();
     PixelType pixelValue2 = itk::NumericTraits<PixelType>::ZeroValue();
@@ -79,7 +106,7 @@ LinearInterpolateMeshFunction<TInputMesh>
     this->GetPointData( pointIds[2], &pixelValue3 );
 
     this->GetDerivativeFromPixelsAndBasis(
-      pixelValue1, pixelValue2, pixelValue3, m_U12, m_U32, derivative);
+      pixelValue1, pixelValue2, pixelValue3, weights.U12, weights.U32, derivative);
     }
   else
     {
@@ -87,6 +114,11 @@ LinearInterpolateMeshFunction<TInputMesh>
       {
       this->FindTriangleOfClosestPoint( point, pointIds );
 
+      // The basis is left null when the triangle faces away from the point.
+      weights.U12.Fill( 0.0 );
+      weights.U32.Fill( 0.0 );
+      this->ComputeWeights( point, pointIds, weights );
+
       PixelType pixelValue1 = itk::NumericTraits<PixelType>::ZeroValue();
       PixelType pixelValue2 = itk::NumericTraits<PixelType>::ZeroValue();
       PixelType pixelValue3 = itk::NumericTraits<PixelType>::ZeroValue();
@@ -96,7 +128,7 @@ LinearInterpolateMeshFunction<TInputMesh>
       this->GetPointData( pointIds[2], &pixelValue3 );
 
       this->GetDerivativeFromPixelsAndBasis(
-        pixelValue1, pixelValue2, pixelValue3, m_U12, m_U32, derivative);
+        pixelValue1, pixelValue2, pixelValue3, weights.U12, weights.U32, derivative);
       }
     else
       {
@@ -157,8 +189,9 @@ LinearInterpolateMeshFunction<TInputMesh>
 ::Evaluate( const PointType& point ) const
 {
   InstanceIdentifierVectorType pointIds(3);
+  TriangleWeightsType          weights;
 
-  bool foundTriangle = this->FindTriangle( point, pointIds );
+  bool foundTriangle = this->FindTriangle( point, pointIds, weights );
 
   if( !foundTriangle )
     {
@@ -172,7 +205,7 @@ LinearInterpolateMeshFunction<TInputMesh>
 
       PixelType pixelValue0 = itk::NumericTraits<PixelType>::ZeroValue();
 
-      this->GetPointData( pointIds[0], &pixelValue0 );
+      this->GetPointData( closestPointIds[0], &pixelValue0 );
 
       return pixelValue0;
       }
@@ -198,9 +231,9 @@ LinearInterpolateMeshFunction<TInputMesh>
   RealType pixelValueReal3 = static_cast<RealType>( pixelValue3 );
 
   RealType returnValue =
-    pixelValueReal1 * m_InterpolationWeights[0]
-    + pixelValueReal2 * m_InterpolationWeights[1]
-    + pixelValueReal3 * m_InterpolationWeights[2];
+    pixelValueReal1 * weights.Weights[0]
+    + pixelValueReal2 * weights.Weights[1]
+    + pixelValueReal3 * weights.Weights[2];
 
   return returnValue;
 }
@@ -213,6 +246,47 @@ bool
 LinearInterpolateMeshFunction<TInputMesh>
 ::FindTriangle( const PointType& point, InstanceIdentifierVectorType & pointIds ) const
 {
+  TriangleWeightsType weights;
+
+  return this->FindTriangle( point, pointIds, weights );
+}
+
+template <class TInputMesh>
+bool
+LinearInterpolateMeshFunction<TInputMesh>
+::FindTriangle( const PointType& point, InstanceIdentifierVectorType & pointIds,
+                TriangleWeightsType & weights ) const
+{
+  //
+  // First try the triangles registered in the bucket of the point. The
+  // locator is ignored when the Sphere Center changed after Initialize().
+  //
+  if( this->m_TriangleLocator.IsNotNull()
+      && this->m_TriangleLocator->GetSphereCenter() == this->m_SphereCenter )
+    {
+    typedef typename TriangleLocatorType::TriangleIdentifier TriangleIdentifier;
+
+    const TriangleIdentifier * candidate;
+    const TriangleIdentifier * candidateEnd;
+
+    this->m_TriangleLocator->FindCandidateTriangles( point, candidate, candidateEnd );
+
+    for( ; candidate != candidateEnd; ++candidate )
+      {
+      const typename InputMeshType::PointIdentifier * trianglePointIds =
+        this->m_TriangleLocator->GetTrianglePointIds( *candidate );
+
+      pointIds[0] = trianglePointIds[0];
+      pointIds[1] = trianglePointIds[1];
+      pointIds[2] = trianglePointIds[2];
+
+      if( this->ComputeWeights( point, pointIds, weights ) )
+        {
+        return true;
+        }
+      }
+    }
+
   //
   // start numberOfNeighbors with a certain value
   // increase it to another value if cannot find triangle
@@ -265,7 +339,7 @@ LinearInterpolateMeshFunction<TInputMesh>
         pointIds[1] = temp1->GetDestination();
         pointIds[2] = temp2->GetDestination();
 
-        const bool isInside = this->ComputeWeights( point, pointIds );
+        const bool isInside = this->ComputeWeights( point, pointIds, weights );
 
         if( isInside )
           {
@@ -319,7 +393,8 @@ template <class TInputMesh>
 bool
 LinearInterpolateMeshFunction<TInputMesh>
 ::ComputeWeights( const PointType & inputPoint,
-                  const InstanceIdentifierVectorType & pointIds ) const
+                  const InstanceIdentifierVectorType & pointIds,
+                  TriangleWeightsType & weights ) const
 {
   const InputMeshType * mesh = this->GetInputMesh();
 
@@ -370,23 +445,20 @@ LinearInterpolateMeshFunction<TInputMesh>
   this->m_TriangleBasisSystemCalculator->CalculateBasis(
     ppt1, ppt2, ppt3, triangleBasisSystem, orthogonalBasisSytem );
 
-  m_U12 = triangleBasisSystem.GetVector(0);
-  m_U32 = triangleBasisSystem.GetVector(1);
-
-  m_V12 = orthogonalBasisSytem.GetVector(0);
-  m_V32 = orthogonalBasisSytem.GetVector(1);
+  weights.U12 = triangleBasisSystem.GetVector(0);
+  weights.U32 = triangleBasisSystem.GetVector(1);
 
   //
   // Project inputPoint to plane, by using the dual vector base
   //
   // Compute components of the input point in the 2D
-  // space defined by m_V12 and m_V32
+  // space defined by the orthogonal basis
   //
   // VectorType xo = inputPoint - pt2;
   VectorType xo = inputPoint - ppt2;
 
-  const double u12p = xo * m_U12;
-  const double u32p = xo * m_U32;
+  const double u12p = xo * weights.U12;
+  const double u32p = xo * weights.U32;
 
   /* ---------------never used
   VectorType x12 = m_V12 * u12p;
@@ -414,9 +486,9 @@ LinearInterpolateMeshFunction<TInputMesh>
 
   bool isInside = false;
 
-  m_InterpolationWeights[0] = b1;
-  m_InterpolationWeights[1] = b2;
-  m_InterpolationWeights[2] = b3;
+  weights.Weights[0] = b1;
+  weights.Weights[1] = b2;
+  weights.Weights[2] = b3;
 
   //
   // Since the three barycentric coordinates are interdependent
@@ -438,17 +510,6 @@ LinearInterpolateMeshFunction<TInputMesh>
   return isInside;
 }
 
-/**
- * Return interpolate weight values. This is provided as a convenience for
- * derived classes.
- */
-template <class TInputMesh>
-const typename LinearInterpolateMeshFunction<TInputMesh>::RealType
-& LinearInterpolateMeshFunction<TInputMesh>
-::GetInterpolationWeight( unsigned int index ) const
-  {
-  return this->m_InterpolationWeights[index];
-  }
 } // end namespace itk
 
 #endif
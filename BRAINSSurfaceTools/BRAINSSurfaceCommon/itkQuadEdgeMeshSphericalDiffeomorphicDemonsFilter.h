@@ -27,7 +27,10 @@
 #include "itkTriangleBasisSystem.h"
 #include "itkVectorContainer.h"
 #include "itkVector.h"
+#include "itkVersor.h"
+#include "itkMultiThreader.h"
 #include "itkTimeProbesCollectorBase.h"
+#include <vector>
 
 namespace itk
 {
@@ -282,6 +285,8 @@ private:
 
   void InitializeFixedNodesSigmas();
 
+  void BuildNodeNeighborhoods();
+
   void ComputeBasisSystemAtEveryNode();
 
   void ComputeInitialArrayOfDestinationPoints();
@@ -340,6 +345,11 @@ private:
 
   void SwapOldAndNewTangetFieldContainers();
 
+  typedef Versor<double> VersorType;
+
+  /** Rotation that carries tangent vectors at sourcePoint to destinationPoint */
+  VersorType ParallelTransportVersor(const PointType & sourcePoint, const PointType & destinationPoint) const;
+
   void ParalelTransport(const PointType sourcePoint, const PointType destinationPoint,
                         const TangentVectorType & inputVector, TangentVectorType & transportedVector ) const;
 
@@ -348,6 +358,54 @@ private:
   virtual PointType InterpolateDestinationFieldAtPoint(const DestinationPointContainerType * destinationField,
                                                        const PointType & point );
 
+  /** The node-wise computations are split among threads by ranges of nodes.
+   * Every stage only writes the entries of the nodes in its own range, and
+   * reads the fixed mesh through the flat arrays built by
+   * BuildNodeNeighborhoods(), so no stage touches the mesh containers. */
+  enum NodeStageType
+    {
+    BASIS_SYSTEM_STAGE,
+    NEIGHBORHOOD_STAGE,
+    MAPPED_MOVING_VALUE_STAGE,
+    VELOCITY_STAGE,
+    SCALING_STAGE,
+    SQUARING_STAGE,
+    COMPOSE_STAGE,
+    TANGENT_STAGE,
+    SMOOTHING_STAGE,
+    DEFORMATION_STAGE
+    };
+
+  struct ThreadStruct
+    {
+    Self *Filter;
+    NodeStageType Stage;
+    };
+
+  static ITK_THREAD_RETURN_TYPE NodeStageThreaderCallback(void *arg);
+
+  void ExecuteNodeStage(const NodeStageType stage);
+
+  void ThreadedComputeBasisSystems(const PointIdentifier start, const PointIdentifier end);
+
+  void ThreadedComputeNeighborhoods(const PointIdentifier start, const PointIdentifier end, const ThreadIdType threadId);
+
+  void ThreadedComputeMappedMovingValues(const PointIdentifier start, const PointIdentifier end);
+
+  void ThreadedComputeVelocityField(const PointIdentifier start, const PointIdentifier end, const ThreadIdType threadId);
+
+  void ThreadedScaleVelocityField(const PointIdentifier start, const PointIdentifier end);
+
+  void ThreadedSquareDisplacementField(const PointIdentifier start, const PointIdentifier end);
+
+  void ThreadedComposeDeformationUpdate(const PointIdentifier start, const PointIdentifier end);
+
+  void ThreadedConvertDeformationToTangentVectors(const PointIdentifier start, const PointIdentifier end);
+
+  void ThreadedSmoothTangentVectors(const PointIdentifier start, const PointIdentifier end);
+
+  void ThreadedConvertTangentVectorsToDeformation(const PointIdentifier start, const PointIdentifier end);
+
   virtual void ProjectPointToSphereSurface( PointType & point ) const;
 
   MovingMeshConstPointer m_MovingMesh;
@@ -496,6 +554,22 @@ private:
 
   /** Container of lengths corresponding to the shortest edge of every node. */
   ShortestLengthContainerPointer m_ShortestEdgeLengthPerPoint;
+
+  /** Flat copies of the nodes and values of the fixed mesh at the initial
+   * destination points, indexed by point identifier. */
+  std::vector<PointType>          m_NodePoints;
+  std::vector<FixedPixelRealType> m_NodeValues;
+
+  /** Neighbors of every node in the order of the edge ring of the node, in
+   * compressed rows: the neighbors of node i are m_NeighborIds[k] for k in
+   * [m_NeighborOffsets[i], m_NeighborOffsets[i+1]).  m_NeighborTransports[k]
+   * carries the tangent vectors of neighbor k to node i. */
+  std::vector<SizeValueType>   m_NeighborOffsets;
+  std::vector<PointIdentifier> m_NeighborIds;
+  std::vector<VersorType>      m_NeighborTransports;
+
+  /** Per thread partial reductions of the current stage */
+  std::vector<double> m_ThreadAccumulators;
 };
 }
 
@@ -266,6 +266,7 @@ QuadEdgeMeshSphericalDiffeomorphicDemonsFilter<TFixedMesh, TMovingMesh, TOutputM
   this->AllocateInternalArrays();
   this->ComputeInitialArrayOfDestinationPoints();
   this->InitializeFixedNodesSigmas();
+  this->BuildNodeNeighborhoods();
   this->ComputeBasisSystemAtEveryNode();
   this->ComputeShortestEdgeLength();
   this->ComposeDestinationPointsOutputPointSet();
@@ -286,6 +287,78 @@ QuadEdgeMeshSphericalDiffeomorphicDemonsFilter<TFixedMesh, TMovingMesh, TOutputM
   this->m_Chronometer.Stop("DataPostProcessing");
 }
 
+template <class TFixedMesh, class TMovingMesh, class TOutputMesh>
+void
+QuadEdgeMeshSphericalDiffeomorphicDemonsFilter<TFixedMesh, TMovingMesh, TOutputMesh>
+::ExecuteNodeStage(const NodeStageType stage)
+{
+  ThreadStruct str;
+
+  str.Filter = this;
+  str.Stage = stage;
+
+  const ThreadIdType numberOfThreads = this->GetNumberOfThreads();
+
+  this->m_ThreadAccumulators.assign( numberOfThreads, 0.0 );
+
+  this->GetMultiThreader()->SetNumberOfThreads( numberOfThreads );
+  this->GetMultiThreader()->SetSingleMethod( this->NodeStageThreaderCallback, &str );
+  this->GetMultiThreader()->SingleMethodExecute();
+
+  this->m_ThreadAccumulators.resize( this->GetMultiThreader()->GetNumberOfThreads() );
+}
+
+template <class TFixedMesh, class TMovingMesh, class TOutputMesh>
+ITK_THREAD_RETURN_TYPE
+QuadEdgeMeshSphericalDiffeomorphicDemonsFilter<TFixedMesh, TMovingMesh, TOutputMesh>
+::NodeStageThreaderCallback(void *arg)
+{
+  const ThreadIdType threadId = ( (MultiThreader::ThreadInfoStruct *)(arg) )->ThreadID;
+  const ThreadIdType threadCount = ( (MultiThreader::ThreadInfoStruct *)(arg) )->NumberOfThreads;
+  ThreadStruct *     str = (ThreadStruct *)( ( (MultiThreader::ThreadInfoStruct *)(arg) )->UserData);
+  Self *             filter = str->Filter;
+
+  const PointIdentifier numberOfNodes = filter->m_NodePoints.size();
+  const PointIdentifier chunk = ( numberOfNodes + threadCount - 1 ) / threadCount;
+  const PointIdentifier start = std::min( numberOfNodes, threadId * chunk );
+  const PointIdentifier end = std::min( numberOfNodes, start + chunk );
+
+  switch( str->Stage )
+    {
+    case BASIS_SYSTEM_STAGE:
+      filter->ThreadedComputeBasisSystems( start, end );
+      break;
+    case NEIGHBORHOOD_STAGE:
+      filter->ThreadedComputeNeighborhoods( start, end, threadId );
+      break;
+    case MAPPED_MOVING_VALUE_STAGE:
+      filter->ThreadedComputeMappedMovingValues( start, end );
+      break;
+    case VELOCITY_STAGE:
+      filter->ThreadedComputeVelocityField( start, end, threadId );
+      break;
+    case SCALING_STAGE:
+      filter->ThreadedScaleVelocityField( start, end );
+      break;
+    case SQUARING_STAGE:
+      filter->ThreadedSquareDisplacementField( start, end );
+      break;
+    case COMPOSE_STAGE:
+      filter->ThreadedComposeDeformationUpdate( start, end );
+      break;
+    case TANGENT_STAGE:
+      filter->ThreadedConvertDeformationToTangentVectors( start, end );
+      break;
+    case SMOOTHING_STAGE:
+      filter->ThreadedSmoothTangentVectors( start, end );
+      break;
+    case DEFORMATION_STAGE:
+      filter->ThreadedConvertTangentVectorsToDeformation( start, end );
+      break;
+    }
+  return ITK_THREAD_RETURN_VALUE;
+}
+
 template <class TFixedMesh, class TMovingMesh, class TOutputMesh>
 void
 QuadEdgeMeshSphericalDiffeomorphicDemonsFilter<TFixedMesh, TMovingMesh, TOutputMesh>::ChronometerReport(
@@ -367,25 +440,21 @@ template <class TFixedMesh, class TMovingMesh, class TOutputMesh>
 void
 QuadEdgeMeshSphericalDiffeomorphicDemonsFilter<TFixedMesh, TMovingMesh, TOutputMesh>::ComputeBasisSystemAtEveryNode()
 {
-  const PointIdentifier numberOfNodes = this->m_FixedMeshAtInitialDestinationPoints->GetNumberOfPoints();
-
-  typedef typename TFixedMesh::PointsContainer PointsContainer;
-  const PointsContainer * points = this->m_FixedMeshAtInitialDestinationPoints->GetPoints();
+  this->ExecuteNodeStage( BASIS_SYSTEM_STAGE );
+}
 
-  typedef typename TFixedMesh::QEPrimal EdgeType;
-  for( PointIdentifier pointId1 = 0; pointId1 < numberOfNodes; pointId1++ )
+template <class TFixedMesh, class TMovingMesh, class TOutputMesh>
+void
+QuadEdgeMeshSphericalDiffeomorphicDemonsFilter<TFixedMesh, TMovingMesh, TOutputMesh>
+::ThreadedComputeBasisSystems(const PointIdentifier start, const PointIdentifier end)
+{
+  for( PointIdentifier pointId1 = start; pointId1 < end; pointId1++ )
     {
-    const EdgeType * edge = this->m_FixedMeshAtInitialDestinationPoints->FindEdge( pointId1 );
-
-    if( !edge )
-      {
-      itkExceptionMacro("FindEdge() returned NULL for pointId " << pointId1 );
-      }
-
-    PointIdentifier pointId2 = edge->GetDestination();
+    // The first neighbor is the destination of the edge of the node
+    const PointIdentifier pointId2 = this->m_NeighborIds[this->m_NeighborOffsets[pointId1]];
 
-    const PointType point1 = points->GetElement( pointId1 );
-    const PointType point2 = points->GetElement( pointId2 );
+    const PointType & point1 = this->m_NodePoints[pointId1];
+    const PointType & point2 = this->m_NodePoints[pointId2];
 
     const VectorType v12    = point1 - point2;
 
@@ -404,10 +473,77 @@ QuadEdgeMeshSphericalDiffeomorphicDemonsFilter<TFixedMesh, TMovingMesh, TOutputM
     basis.SetVector( 0, w12 );
     basis.SetVector( 1, u12 );
 
-    this->m_BasisSystemAtNode->SetElement( pointId1, basis );
+    this->m_BasisSystemAtNode->ElementAt( pointId1 ) = basis;
     }
 }
 
+template <class TFixedMesh, class TMovingMesh, class TOutputMesh>
+void
+QuadEdgeMeshSphericalDiffeomorphicDemonsFilter<TFixedMesh, TMovingMesh, TOutputMesh>
+::BuildNodeNeighborhoods()
+{
+  const PointIdentifier numberOfNodes = this->m_FixedMeshAtInitialDestinationPoints->GetNumberOfPoints();
+
+  const FixedPointsContainer *    points = this->m_FixedMeshAtInitialDestinationPoints->GetPoints();
+  const FixedPointDataContainer * pointData = this->m_FixedMeshAtInitialDestinationPoints->GetPointData();
+
+  this->m_NodePoints.resize( numberOfNodes );
+  this->m_NodeValues.resize( numberOfNodes );
+
+  FixedPointsConstIterator pointItr = points->Begin();
+  FixedPointsConstIterator pointEnd = points->End();
+
+  while( pointItr != pointEnd )
+    {
+    if( pointItr.Index() >= numberOfNodes )
+      {
+      itkExceptionMacro("Point identifier " << pointItr.Index() << " is out of the range of the fixed mesh nodes");
+      }
+    this->m_NodePoints[pointItr.Index()] = pointItr.Value();
+    ++pointItr;
+    }
+
+  FixedPointDataConstIterator fixedPointDataItr = pointData->Begin();
+  FixedPointDataConstIterator fixedPointDataEnd = pointData->End();
+
+  while( fixedPointDataItr != fixedPointDataEnd )
+    {
+    if( fixedPointDataItr.Index() < numberOfNodes )
+      {
+      this->m_NodeValues[fixedPointDataItr.Index()] = fixedPointDataItr.Value();
+      }
+    ++fixedPointDataItr;
+    }
+
+  typedef typename FixedMeshType::QEPrimal EdgeType;
+
+  this->m_NeighborOffsets.resize( numberOfNodes + 1 );
+  this->m_NeighborIds.clear();
+  this->m_NeighborIds.reserve( 6 * numberOfNodes );
+  for( PointIdentifier pointId = 0; pointId < numberOfNodes; pointId++ )
+    {
+    this->m_NeighborOffsets[pointId] = this->m_NeighborIds.size();
+
+    const EdgeType * edgeToFirstNeighborPoint = this->m_FixedMeshAtInitialDestinationPoints->FindEdge( pointId );
+
+    if( !edgeToFirstNeighborPoint )
+      {
+      itkExceptionMacro("FindEdge() returned NULL for pointId " << pointId );
+      }
+
+    const EdgeType * edgeToNeighborPoint = edgeToFirstNeighborPoint;
+    do
+      {
+      this->m_NeighborIds.push_back( edgeToNeighborPoint->GetDestination() );
+      edgeToNeighborPoint = edgeToNeighborPoint->GetOnext();
+      }
+    while( edgeToNeighborPoint != edgeToFirstNeighborPoint );
+    }
+  this->m_NeighborOffsets[numberOfNodes] = this->m_NeighborIds.size();
+
+  this->m_NeighborTransports.resize( this->m_NeighborIds.size() );
+}
+
 template <class TFixedMesh, class TMovingMesh, class TOutputMesh>
 void
 QuadEdgeMeshSphericalDiffeomorphicDemonsFilter<TFixedMesh, TMovingMesh,
@@ -455,8 +591,8 @@ QuadEdgeMeshSphericalDiffeomorphicDemonsFilter<TFixedMesh, TMovingMesh, TOutputM
   this->m_ScalarInterpolator->Initialize();
 
   this->m_DeformationInterpolator->SetInputMesh( this->m_FixedMeshAtInitialDestinationPoints );
-  this->m_DeformationInterpolator->Initialize();
   this->m_DeformationInterpolator->SetSphereCenter( this->m_SphereCenter );
+  this->m_DeformationInterpolator->Initialize();
 }
 
 template <class TFixedMesh, class TMovingMesh, class TOutputMesh>
@@ -582,17 +718,20 @@ void
 QuadEdgeMeshSphericalDiffeomorphicDemonsFilter<TFixedMesh, TMovingMesh,
                                                TOutputMesh>::ComputeMappedMovingValueAtEveryNode()
 {
-  DestinationPointIterator pointItr = this->m_DestinationPoints->Begin();
-  DestinationPointIterator pointEnd = this->m_DestinationPoints->End();
+  this->ExecuteNodeStage( MAPPED_MOVING_VALUE_STAGE );
+}
 
-  ResampledMovingValuesContainerIterator resampledArrayItr = this->m_ResampledMovingValuesContainer->Begin();
+template <class TFixedMesh, class TMovingMesh, class TOutputMesh>
+void
+QuadEdgeMeshSphericalDiffeomorphicDemonsFilter<TFixedMesh, TMovingMesh, TOutputMesh>
+::ThreadedComputeMappedMovingValues(const PointIdentifier start, const PointIdentifier end)
+{
+  const ScalarInterpolatorType * interpolator = this->m_ScalarInterpolator;
 
-  while( pointItr != pointEnd )
+  for( PointIdentifier pointId = start; pointId < end; pointId++ )
     {
-    resampledArrayItr.Value() = this->m_ScalarInterpolator->Evaluate( pointItr.Value() );
-
-    ++pointItr;
-    ++resampledArrayItr;
+    this->m_ResampledMovingValuesContainer->ElementAt( pointId ) =
+      interpolator->Evaluate( this->m_DestinationPoints->ElementAt( pointId ) );
     }
 }
 
@@ -629,23 +768,24 @@ QuadEdgeMeshSphericalDiffeomorphicDemonsFilter<TFixedMesh, TMovingMesh, TOutputM
 {
   const PointIdentifier numberOfNodes = this->m_FixedMeshAtInitialDestinationPoints->GetNumberOfPoints();
 
-  const FixedPointsContainer * points = this->m_FixedMeshAtInitialDestinationPoints->GetPoints();
-
-  FixedPointsConstIterator pointItr = points->Begin();
-
-  const FixedPointDataContainer * pointData = this->m_FixedMeshAtInitialDestinationPoints->GetPointData();
-
-  FixedPointDataConstIterator fixedPointDataItr = pointData->Begin();
+  this->ExecuteNodeStage( VELOCITY_STAGE );
 
-  BasisSystemContainerIterator basisItr = this->m_BasisSystemAtNode->Begin();
-
-  NodeSigmaContainerConstIterator sigmaItr = this->m_FixedNodesSigmas->Begin();
+  double sumOfSquaredDifferences = 0.0;
+  for( size_t t = 0; t < this->m_ThreadAccumulators.size(); t++ )
+    {
+    sumOfSquaredDifferences += this->m_ThreadAccumulators[t];
+    }
 
-  VelocityVectorIterator velocityItr = this->m_VelocityField->Begin();
+  const double averageOfSquaredDifferences = sumOfSquaredDifferences / numberOfNodes;
 
-  ResampledMovingValuesContainerIterator resampledArrayItr =
-    this->m_ResampledMovingValuesContainer->Begin();
+  this->m_MetricValue = averageOfSquaredDifferences;
+}
 
+template <class TFixedMesh, class TMovingMesh, class TOutputMesh>
+void
+QuadEdgeMeshSphericalDiffeomorphicDemonsFilter<TFixedMesh, TMovingMesh, TOutputMesh>
+::ThreadedComputeVelocityField(const PointIdentifier start, const PointIdentifier end, const ThreadIdType threadId)
+{
   typedef vnl_matrix_fixed<double, 3, 3> VnlMatrix33Type;
   typedef vnl_vector_fixed<double, 2>    VnlVector2Type;
   typedef vnl_vector_fixed<double, 3>    VnlVector3Type;
@@ -684,9 +824,9 @@ QuadEdgeMeshSphericalDiffeomorphicDemonsFilter<TFixedMesh, TMovingMesh, TOutputM
   double sumOfSquaredDifferences = 0.0;
 
   const double sigmaX2 = ( this->m_SigmaX * this->m_SigmaX );
-  for( PointIdentifier pointId = 0; pointId < numberOfNodes; pointId++ )
+  for( PointIdentifier pointId = start; pointId < end; pointId++ )
     {
-    vectorToCenter = pointItr.Value() - this->m_SphereCenter;
+    vectorToCenter = this->m_NodePoints[pointId] - this->m_SphereCenter;
 
     vectorToCenter.Normalize();
 
@@ -709,11 +849,11 @@ QuadEdgeMeshSphericalDiffeomorphicDemonsFilter<TFixedMesh, TMovingMesh, TOutputM
 
     destinationJacobian = this->m_NodeVectorJacobianCalculator->Evaluate( pointId );
 
-    const BasisSystemType &   basis = basisItr.Value();
+    const BasisSystemType &   basis = this->m_BasisSystemAtNode->ElementAt( pointId );
     const VectorType &        v0 = basis.GetVector(0);
     const VectorType &        v1 = basis.GetVector(1);
-    const MovingPixelRealType Mv = resampledArrayItr.Value();
-    const FixedPixelRealType  Fv = fixedPointDataItr.Value();
+    const MovingPixelRealType Mv = this->m_ResampledMovingValuesContainer->ElementAt( pointId );
+    const FixedPixelRealType  Fv = this->m_NodeValues[pointId];
     for( unsigned int i = 0; i < 3; i++ )
       {
       En(i, 0) = v0[i];
@@ -739,7 +879,8 @@ QuadEdgeMeshSphericalDiffeomorphicDemonsFilter<TFixedMesh, TMovingMesh, TOutputM
     // The general form of this addition would involve two weights,
     // representing the variance of each term at this node.
     //
-    const double sigmaN2 = sigmaItr.Value() * sigmaItr.Value();
+    const double sigma = this->m_FixedNodesSigmas->ElementAt( pointId );
+    const double sigmaN2 = sigma * sigma;
 
     Gn2Sn2m2 = mn2 / sigmaN2 + Gn2Sn2 / sigmaX2;
 
@@ -757,19 +898,10 @@ QuadEdgeMeshSphericalDiffeomorphicDemonsFilter<TFixedMesh, TMovingMesh, TOutputM
 
     sumOfSquaredDifferences += ( Fv - Mv ) * ( Fv - Mv ) / sigmaN2;
 
-    velocityItr.Value() = Vn;
-
-    ++velocityItr;
-    ++sigmaItr;
-    ++basisItr;
-    ++resampledArrayItr;
-    ++fixedPointDataItr;
-    ++pointItr;
+    this->m_VelocityField->ElementAt( pointId ) = Vn;
     }
 
-  const double averageOfSquaredDifferences = sumOfSquaredDifferences / numberOfNodes;
-
-  this->m_MetricValue = averageOfSquaredDifferences;
+  this->m_ThreadAccumulators[threadId] = sumOfSquaredDifferences;
 }
 
 template <class TFixedMesh, class TMovingMesh, class TOutputMesh>
@@ -826,36 +958,44 @@ template <class TFixedMesh, class TMovingMesh, class TOutputMesh>
 void
 QuadEdgeMeshSphericalDiffeomorphicDemonsFilter<TFixedMesh, TMovingMesh, TOutputMesh>::ComputeShortestEdgeLength()
 {
-  double shortestLength = NumericTraits<double>::max();
-
-  typedef typename FixedMeshType::QEPrimal EdgeType;
-
-  const FixedPointsContainer * points = this->m_FixedMeshAtInitialDestinationPoints->GetPoints();
+  this->ExecuteNodeStage( NEIGHBORHOOD_STAGE );
 
-  FixedPointsConstIterator pointItr = points->Begin();
-  FixedPointsConstIterator pointEnd = points->End();
+  double shortestLength = NumericTraits<double>::max();
+  for( size_t t = 0; t < this->m_ThreadAccumulators.size(); t++ )
+    {
+    if( this->m_ThreadAccumulators[t] < shortestLength )
+      {
+      shortestLength = this->m_ThreadAccumulators[t];
+      }
+    }
 
-  ShortestLengthContainerIterator shortestEdgeItr = this->m_ShortestEdgeLengthPerPoint->Begin();
+  this->m_ShortestEdgeLength = shortestLength;
+  // std::cout << "m_ShortestEdgeLength = " << this->m_ShortestEdgeLength << std::endl;
 
-  while( pointItr != pointEnd )
+  if( this->m_ShortestEdgeLength < vnl_math::eps )
     {
-    EdgeType * edge1 = this->m_FixedMeshAtInitialDestinationPoints->FindEdge( pointItr.Index() );
+    itkExceptionMacro("The shortest edge length is too close to zero = " << shortestLength );
+    }
+}
 
-    EdgeType * temp1 = ITK_NULLPTR;
-    EdgeType * temp2 = edge1;
+/** Shortest edge of every node, and the parallel transport from each
+ * neighbor to the node, which does not change during the iterations. */
+template <class TFixedMesh, class TMovingMesh, class TOutputMesh>
+void
+QuadEdgeMeshSphericalDiffeomorphicDemonsFilter<TFixedMesh, TMovingMesh, TOutputMesh>
+::ThreadedComputeNeighborhoods(const PointIdentifier start, const PointIdentifier end, const ThreadIdType threadId)
+{
+  double shortestLength = NumericTraits<double>::max();
 
-    const PointType & point = pointItr.Value();
+  for( PointIdentifier pointId = start; pointId < end; pointId++ )
+    {
+    const PointType & point = this->m_NodePoints[pointId];
 
     double localShortestLength = NumericTraits<double>::max();
 
-    do
+    for( SizeValueType k = this->m_NeighborOffsets[pointId]; k < this->m_NeighborOffsets[pointId + 1]; k++ )
       {
-      temp1 = temp2;
-      temp2 = temp1->GetOnext();
-
-      const PointIdentifier neighborPointId = temp1->GetDestination();
-
-      const PointType & neighborPoint = points->GetElement( neighborPointId );
+      const PointType & neighborPoint = this->m_NodePoints[this->m_NeighborIds[k]];
 
       const double distance = point.EuclideanDistanceTo( neighborPoint );
 
@@ -863,27 +1003,19 @@ QuadEdgeMeshSphericalDiffeomorphicDemonsFilter<TFixedMesh, TMovingMesh, TOutputM
         {
         localShortestLength = distance;
         }
+
+      this->m_NeighborTransports[k] = this->ParallelTransportVersor( neighborPoint, point );
       }
-    while( temp2 != edge1 );
 
-    shortestEdgeItr.Value() = localShortestLength;
+    this->m_ShortestEdgeLengthPerPoint->ElementAt( pointId ) = localShortestLength;
 
     if( localShortestLength < shortestLength )
       {
       shortestLength = localShortestLength;
       }
-
-    ++pointItr;
-    ++shortestEdgeItr;
     }
 
-  this->m_ShortestEdgeLength = shortestLength;
-  // std::cout << "m_ShortestEdgeLength = " << this->m_ShortestEdgeLength << std::endl;
-
-  if( this->m_ShortestEdgeLength < vnl_math::eps )
-    {
-    itkExceptionMacro("The shortest edge length is too close to zero = " << shortestLength );
-    }
+  this->m_ThreadAccumulators[threadId] = shortestLength;
 }
 
 template <class TFixedMesh, class TMovingMesh, class TOutputMesh>
@@ -915,6 +1047,20 @@ template <class TFixedMesh, class TMovingMesh, class TOutputMesh>
 void
 QuadEdgeMeshSphericalDiffeomorphicDemonsFilter<TFixedMesh, TMovingMesh,
                                                TOutputMesh>::ComputeDeformationByScalingAndSquaring()
+{
+  this->ExecuteNodeStage( SCALING_STAGE );
+
+  for( unsigned int i = 0; i < this->m_ScalingAndSquaringNumberOfIterations; i++ )
+    {
+    this->ExecuteNodeStage( SQUARING_STAGE );
+    this->SwapOldAndNewDisplacementFieldContainers();
+    }
+}
+
+template <class TFixedMesh, class TMovingMesh, class TOutputMesh>
+void
+QuadEdgeMeshSphericalDiffeomorphicDemonsFilter<TFixedMesh, TMovingMesh, TOutputMesh>
+::ThreadedScaleVelocityField(const PointIdentifier start, const PointIdentifier end)
 {
   unsigned long powerOfTwo = 1;
 
@@ -922,51 +1068,34 @@ QuadEdgeMeshSphericalDiffeomorphicDemonsFilter<TFixedMesh, TMovingMesh,
 
   const double scalingFactor = 1.0 / powerOfTwo;
 
-  DestinationPointIterator displacementItr = this->m_DisplacementField->Begin();
-  DestinationPointIterator displacementEnd = this->m_DisplacementField->End();
-
-  VelocityVectorConstIterator velocityItr = this->m_VelocityField->Begin();
-
-  const FixedPointsContainer * points = this->m_FixedMeshAtInitialDestinationPoints->GetPoints();
-
-  FixedPointsConstIterator pointItr = points->Begin();
-
   PointType destinationPoint;
 
-  while( displacementItr != displacementEnd )
+  for( PointIdentifier pointId = start; pointId < end; pointId++ )
     {
-    destinationPoint = pointItr.Value() +  velocityItr.Value() * scalingFactor;
+    destinationPoint = this->m_NodePoints[pointId] + this->m_VelocityField->ElementAt( pointId ) * scalingFactor;
 
     this->ProjectPointToSphereSurface( destinationPoint );
 
-    displacementItr.Value() = destinationPoint;
-
-    ++displacementItr;
-    ++pointItr;
-    ++velocityItr;
+    this->m_DisplacementField->ElementAt( pointId ) = destinationPoint;
     }
-  for( unsigned int i = 0; i < this->m_ScalingAndSquaringNumberOfIterations; i++ )
-    {
-    DestinationPointConstIterator oldDisplacementItr = this->m_DisplacementField->Begin();
-    DestinationPointConstIterator oldDisplacementEnd = this->m_DisplacementField->End();
-
-    DestinationPointIterator newDisplacementItr = this->m_DisplacementFieldSwap->Begin();
-
-    while( oldDisplacementItr != oldDisplacementEnd )
-      {
-      destinationPoint = oldDisplacementItr.Value();
+}
 
-      this->ProjectPointToSphereSurface( destinationPoint );
+template <class TFixedMesh, class TMovingMesh, class TOutputMesh>
+void
+QuadEdgeMeshSphericalDiffeomorphicDemonsFilter<TFixedMesh, TMovingMesh, TOutputMesh>
+::ThreadedSquareDisplacementField(const PointIdentifier start, const PointIdentifier end)
+{
+  PointType destinationPoint;
 
-      newDisplacementItr.Value() =
-        this->InterpolateDestinationFieldAtPoint(
-          this->m_DisplacementField, destinationPoint );
+  for( PointIdentifier pointId = start; pointId < end; pointId++ )
+    {
+    destinationPoint = this->m_DisplacementField->ElementAt( pointId );
 
-      ++newDisplacementItr;
-      ++oldDisplacementItr;
-      }
+    this->ProjectPointToSphereSurface( destinationPoint );
 
-    this->SwapOldAndNewDisplacementFieldContainers();
+    this->m_DisplacementFieldSwap->ElementAt( pointId ) =
+      this->InterpolateDestinationFieldAtPoint(
+        this->m_DisplacementField, destinationPoint );
     }
 }
 
@@ -995,14 +1124,18 @@ void
 QuadEdgeMeshSphericalDiffeomorphicDemonsFilter<TFixedMesh, TMovingMesh,
                                                TOutputMesh>::ComposeDeformationUpdateWithPreviousDeformation()
 {
-  DestinationPointConstIterator displacementItr = this->m_DisplacementField->Begin();
-  DestinationPointConstIterator displacementEnd = this->m_DisplacementField->End();
-
-  DestinationPointIterator newDestinationPointItr = this->m_DestinationPointsSwap->Begin();
+  this->ExecuteNodeStage( COMPOSE_STAGE );
+  this->SwapOldAndNewDestinationPointContainers();
+}
 
-  while( displacementItr != displacementEnd )
+template <class TFixedMesh, class TMovingMesh, class TOutputMesh>
+void
+QuadEdgeMeshSphericalDiffeomorphicDemonsFilter<TFixedMesh, TMovingMesh, TOutputMesh>
+::ThreadedComposeDeformationUpdate(const PointIdentifier start, const PointIdentifier end)
+{
+  for( PointIdentifier pointId = start; pointId < end; pointId++ )
     {
-    PointType point = displacementItr.Value();
+    PointType point = this->m_DisplacementField->ElementAt( pointId );
 
     this->ProjectPointToSphereSurface( point );
 
@@ -1011,13 +1144,8 @@ QuadEdgeMeshSphericalDiffeomorphicDemonsFilter<TFixedMesh, TMovingMesh,
 
     this->ProjectPointToSphereSurface( destinationPoint );
 
-    newDestinationPointItr.Value() = destinationPoint;
-
-    ++newDestinationPointItr;
-    ++displacementItr;
+    this->m_DestinationPointsSwap->ElementAt( pointId ) = destinationPoint;
     }
-
-  this->SwapOldAndNewDestinationPointContainers();
 }
 
 template <class TFixedMesh, class TMovingMesh, class TOutputMesh>
@@ -1029,7 +1157,8 @@ QuadEdgeMeshSphericalDiffeomorphicDemonsFilter<TFixedMesh, TMovingMesh,
 {
   PointType interpolatedDestinationPoint;
 
-  const bool found = this->m_DeformationInterpolator->Evaluate( destinationField, point, interpolatedDestinationPoint );
+  const bool found = this->m_DeformationInterpolator->Evaluate(
+      destinationField, point, interpolatedDestinationPoint );
 
   if( !found )
     {
@@ -1101,118 +1230,95 @@ void
 QuadEdgeMeshSphericalDiffeomorphicDemonsFilter<TFixedMesh, TMovingMesh,
                                                TOutputMesh>::ConvertDeformationFieldToTangentVectorField()
 {
-  DestinationPointIterator dstPointItr = this->m_DestinationPoints->Begin();
-  DestinationPointIterator dstPointEnd = this->m_DestinationPoints->End();
-
-  const FixedPointsContainer * points = this->m_FixedMeshAtInitialDestinationPoints->GetPoints();
-
-  FixedPointsConstIterator pointItr = points->Begin();
-
-  TangentVectorIterator tangentItr = this->m_TangentVectorField->Begin();
+  this->ExecuteNodeStage( TANGENT_STAGE );
+}
 
+template <class TFixedMesh, class TMovingMesh, class TOutputMesh>
+void
+QuadEdgeMeshSphericalDiffeomorphicDemonsFilter<TFixedMesh, TMovingMesh, TOutputMesh>
+::ThreadedConvertDeformationToTangentVectors(const PointIdentifier start, const PointIdentifier end)
+{
   const double factor = -1.0 / this->m_SphereRadius;
 
-  while( dstPointItr != dstPointEnd )
+  for( PointIdentifier pointId = start; pointId < end; pointId++ )
     {
-    VectorType vectorToCenter = pointItr.Value() - this->m_SphereCenter;
+    VectorType vectorToCenter = this->m_NodePoints[pointId] - this->m_SphereCenter;
 
     vectorToCenter.Normalize();
 
-    tangentItr.Value() =
-      CrossProduct( vectorToCenter,
-                    CrossProduct( vectorToCenter, dstPointItr.Value().GetVectorFromOrigin() ) );
+    TangentVectorType & tangent = this->m_TangentVectorField->ElementAt( pointId );
 
-    tangentItr.Value() *= factor;
+    tangent =
+      CrossProduct( vectorToCenter,
+                    CrossProduct( vectorToCenter, this->m_DestinationPoints->ElementAt( pointId ).GetVectorFromOrigin() ) );
 
-    ++dstPointItr;
-    ++tangentItr;
-    ++pointItr;
+    tangent *= factor;
     }
 }
 
 template <class TFixedMesh, class TMovingMesh, class TOutputMesh>
 void
 QuadEdgeMeshSphericalDiffeomorphicDemonsFilter<TFixedMesh, TMovingMesh, TOutputMesh>::SmoothTangentVectorField()
+{
+  for( unsigned int iter = 0; iter < this->m_MaximumNumberOfSmoothingIterations; ++iter )
+    {
+    this->ExecuteNodeStage( SMOOTHING_STAGE );
+    this->SwapOldAndNewTangetFieldContainers();
+    }
+}
+
+template <class TFixedMesh, class TMovingMesh, class TOutputMesh>
+void
+QuadEdgeMeshSphericalDiffeomorphicDemonsFilter<TFixedMesh, TMovingMesh, TOutputMesh>
+::ThreadedSmoothTangentVectors(const PointIdentifier start, const PointIdentifier end)
 {
   const double weightFactor = std::exp( -1.0 / ( 2.0 * this->m_Lambda ) );
 
-  const FixedPointsContainer * points = this->m_FixedMeshAtInitialDestinationPoints->GetPoints();
+  const TangentVectorContainer * tangentField = this->m_TangentVectorField;
 
   TangentVectorType smoothedVector;
   TangentVectorType transportedTangentVector;
 
-  for( unsigned int iter = 0; iter < this->m_MaximumNumberOfSmoothingIterations; ++iter )
-    {
-    typedef typename OutputMeshType::QEPrimal EdgeType;
-
-    TangentVectorIterator tangentItr = this->m_TangentVectorField->Begin();
-    TangentVectorIterator tangentEnd = this->m_TangentVectorField->End();
-
-    TangentVectorIterator smoothedTangentItr = this->m_TangentVectorFieldSwap->Begin();
+  typedef typename NumericTraits<TangentVectorType>::AccumulateType AccumulatePixelType;
 
-    FixedPointsConstIterator pointItr = points->Begin();
-
-    typedef typename NumericTraits<TangentVectorType>::AccumulateType AccumulatePixelType;
+  for( PointIdentifier pointId = start; pointId < end; pointId++ )
+    {
+    const TangentVectorType & centralTangentVector = tangentField->ElementAt( pointId );
 
-    while( tangentItr != tangentEnd )
+    AccumulatePixelType tangentVectorSum;
+    for( unsigned int k = 0; k < PointDimension; k++ )
       {
-      const TangentVectorType & centralTangentVector = tangentItr.Value();
-
-      const EdgeType * edgeToFirstNeighborPoint =
-        this->m_FixedMeshAtInitialDestinationPoints->FindEdge( tangentItr.Index() );
-      const EdgeType * edgeToNeighborPoint = edgeToFirstNeighborPoint;
-
-      AccumulatePixelType tangentVectorSum;
-      for( unsigned int k = 0; k < PointDimension; k++ )
-        {
-        tangentVectorSum[k] = centralTangentVector[k];
-        }
-
-      unsigned int numberOfNeighbors = 0;
-
-      do
-        {
-        const PointIdentifier     neighborPointId = edgeToNeighborPoint->GetDestination();
-        const PointType &         neighborPoint = points->GetElement( neighborPointId );
-        const TangentVectorType & neighborTangentVector =
-          this->m_TangentVectorField->GetElement( neighborPointId );
-
-        this->ParalelTransport( neighborPoint, pointItr.Value(),
-                                neighborTangentVector, transportedTangentVector );
-        for( unsigned int k = 0; k < PointDimension; k++ )
-          {
-          tangentVectorSum[k] += weightFactor * transportedTangentVector[k];
-          }
-
-        numberOfNeighbors++;
-
-        edgeToNeighborPoint = edgeToNeighborPoint->GetOnext();
-        }
-      while( edgeToNeighborPoint != edgeToFirstNeighborPoint );
+      tangentVectorSum[k] = centralTangentVector[k];
+      }
 
-      const double normalizationFactor = 1.0 / ( 1.0 + numberOfNeighbors * weightFactor );
+    const SizeValueType firstNeighbor = this->m_NeighborOffsets[pointId];
+    const SizeValueType endNeighbor = this->m_NeighborOffsets[pointId + 1];
+    for( SizeValueType n = firstNeighbor; n < endNeighbor; n++ )
+      {
+      transportedTangentVector =
+        this->m_NeighborTransports[n].Transform( tangentField->ElementAt( this->m_NeighborIds[n] ) );
       for( unsigned int k = 0; k < PointDimension; k++ )
         {
-        smoothedVector[k] = tangentVectorSum[k] * normalizationFactor;
+        tangentVectorSum[k] += weightFactor * transportedTangentVector[k];
         }
+      }
 
-      smoothedTangentItr.Value() = smoothedVector;
+    const unsigned int numberOfNeighbors = static_cast<unsigned int>( endNeighbor - firstNeighbor );
 
-      ++tangentItr;
-      ++smoothedTangentItr;
-      ++pointItr;
+    const double normalizationFactor = 1.0 / ( 1.0 + numberOfNeighbors * weightFactor );
+    for( unsigned int k = 0; k < PointDimension; k++ )
+      {
+      smoothedVector[k] = tangentVectorSum[k] * normalizationFactor;
       }
 
-    this->SwapOldAndNewTangetFieldContainers();
+    this->m_TangentVectorFieldSwap->ElementAt( pointId ) = smoothedVector;
     }
 }
 
 template <class TFixedMesh, class TMovingMesh, class TOutputMesh>
-void
-QuadEdgeMeshSphericalDiffeomorphicDemonsFilter<TFixedMesh, TMovingMesh, TOutputMesh>::ParalelTransport(
-  const PointType sourcePoint, const PointType destinationPoint,
-  const TangentVectorType & inputVector,
-  TangentVectorType & transportedVector ) const
+typename QuadEdgeMeshSphericalDiffeomorphicDemonsFilter<TFixedMesh, TMovingMesh, TOutputMesh>::VersorType
+QuadEdgeMeshSphericalDiffeomorphicDemonsFilter<TFixedMesh, TMovingMesh, TOutputMesh>
+::ParallelTransportVersor(const PointType & sourcePoint, const PointType & destinationPoint) const
 {
   VectorType vsrc = sourcePoint - this->m_SphereCenter;
   VectorType vdst = destinationPoint - this->m_SphereCenter;
@@ -1224,12 +1330,20 @@ QuadEdgeMeshSphericalDiffeomorphicDemonsFilter<TFixedMesh, TMovingMesh, TOutputM
 
   double angle = std::atan2( scaledSinus, scaledCosinus );
 
-  typedef Versor<double> VersorType;
-
   VersorType versor;
   versor.Set( axis, angle );
 
-  transportedVector = versor.Transform( inputVector );
+  return versor;
+}
+
+template <class TFixedMesh, class TMovingMesh, class TOutputMesh>
+void
+QuadEdgeMeshSphericalDiffeomorphicDemonsFilter<TFixedMesh, TMovingMesh, TOutputMesh>::ParalelTransport(
+  const PointType sourcePoint, const PointType destinationPoint,
+  const TangentVectorType & inputVector,
+  TangentVectorType & transportedVector ) const
+{
+  transportedVector = this->ParallelTransportVersor( sourcePoint, destinationPoint ).Transform( inputVector );
 }
 
 template <class TFixedMesh, class TMovingMesh, class TOutputMesh>
@@ -1237,27 +1351,27 @@ void
 QuadEdgeMeshSphericalDiffeomorphicDemonsFilter<TFixedMesh, TMovingMesh,
                                                TOutputMesh>::ConvertTangentVectorFieldToDeformationField()
 {
-  TangentVectorIterator tangentItr = this->m_TangentVectorField->Begin();
-  TangentVectorIterator tangentEnd = this->m_TangentVectorField->End();
-
-  DestinationPointIterator dstPointItr = this->m_DestinationPoints->Begin();
-
-  const FixedPointsContainer * points = this->m_FixedMeshAtInitialDestinationPoints->GetPoints();
-
-  FixedPointsConstIterator pointItr = points->Begin();
+  this->ExecuteNodeStage( DEFORMATION_STAGE );
+}
 
-  typedef Versor<double> VersorType;
+template <class TFixedMesh, class TMovingMesh, class TOutputMesh>
+void
+QuadEdgeMeshSphericalDiffeomorphicDemonsFilter<TFixedMesh, TMovingMesh, TOutputMesh>
+::ThreadedConvertTangentVectorsToDeformation(const PointIdentifier start, const PointIdentifier end)
+{
   VersorType versor;
 
   const double normEpsilon = itk::NumericTraits<double>::min();
 
-  while( tangentItr != tangentEnd )
+  for( PointIdentifier pointId = start; pointId < end; pointId++ )
     {
-    VectorType vectorToCenter = pointItr.Value() - this->m_SphereCenter;
+    const PointType & point = this->m_NodePoints[pointId];
+
+    VectorType vectorToCenter = point - this->m_SphereCenter;
 
     vectorToCenter.Normalize();
 
-    const VectorType & tangent = tangentItr.Value();
+    const VectorType & tangent = this->m_TangentVectorField->ElementAt( pointId );
 
     const double sinTheta = tangent.GetNorm();
 
@@ -1269,16 +1383,12 @@ QuadEdgeMeshSphericalDiffeomorphicDemonsFilter<TFixedMesh, TMovingMesh,
 
       versor.Set( axis, theta );
 
-      dstPointItr.Value() = versor.Transform( pointItr.Value() );
+      this->m_DestinationPoints->ElementAt( pointId ) = versor.Transform( point );
       }
     else
       {
-      dstPointItr.Value() = pointItr.Value();
+      this->m_DestinationPoints->ElementAt( pointId ) = point;
       }
-
-    ++dstPointItr;
-    ++tangentItr;
-    ++pointItr;
     }
 }
 
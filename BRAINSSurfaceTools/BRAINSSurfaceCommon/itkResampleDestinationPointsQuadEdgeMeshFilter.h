@@ -22,6 +22,8 @@
 #include "itkMeshToMeshFilter.h"
 #include "itkLinearInterpolateDeformationFieldMeshFunction.h"
 #include "itkTransform.h"
+#include "itkMultiThreader.h"
+#include <vector>
 
 namespace itk
 {
@@ -35,6 +37,9 @@ namespace itk
  * points that would correspond to the locations indicated by the points of the
  * reference mesh.
  *
+ * The points of the reference mesh are evaluated concurrently by the threads
+ * of the filter.
+ *
  * \ingroup MeshFilters
  *
  */
@@ -149,11 +154,27 @@ private:
 
   void ProjectPointToSphereSurface( OutputPointType & point ) const;
 
+  struct ThreadStruct
+    {
+    Self *Filter;
+    };
+
+  static ITK_THREAD_RETURN_TYPE EvaluateThreaderCallback(void *arg);
+
+  /** Map the reference points [start, end) through the transform and
+   * interpolate the destination points at them. */
+  void ThreadedEvaluate(const SizeValueType start, const SizeValueType end);
+
   TransformPointerType    m_Transform;           // Coordinate transform to use
   InterpolatorPointerType m_Interpolator;        // Image function for
 
   OutputPointType m_SphereCenter;
   double          m_SphereRadius;
+
+  // Working state of one GenerateData() call
+  const InputPointsContainer *                        m_InputPoints;
+  std::vector<typename TransformType::InputPointType> m_EvaluationPoints;
+  std::vector<OutputPointType>                        m_EvaluatedPoints;
 };
 }
 
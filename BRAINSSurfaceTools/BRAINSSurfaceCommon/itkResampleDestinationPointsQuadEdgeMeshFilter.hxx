@@ -23,6 +23,7 @@
 #include "itkProgressReporter.h"
 #include "itkIdentityTransform.h"
 #include "itkNumericTraitsVectorPixel.h"
+#include <algorithm>
 
 namespace itk
 {
@@ -43,6 +44,8 @@ ResampleDestinationPointsQuadEdgeMeshFilter<TInputMesh, TFixedMesh, TReferenceMe
 
   this->m_SphereCenter.Fill( 0.0 );
   this->m_SphereRadius = 1.0;
+
+  this->m_InputPoints = ITK_NULLPTR;
 }
 
 template <class TInputMesh, class TFixedMesh, class TReferenceMesh, class TOutputMesh>
@@ -174,36 +177,85 @@ ResampleDestinationPointsQuadEdgeMeshFilter<TInputMesh, TFixedMesh, TReferenceMe
   ReferencePointsContainerConstIterator referenceItr = referencePoints->Begin();
   ReferencePointsContainerConstIterator referenceEnd = referencePoints->End();
 
+  //
+  // Gather the reference points in a contiguous array, evaluate them
+  // concurrently, and scatter the results into the output points.
+  //
+  this->m_InputPoints = inputPoints;
+  this->m_EvaluationPoints.resize( referencePoints->Size() );
+  this->m_EvaluatedPoints.resize( referencePoints->Size() );
+
+  for( SizeValueType i = 0; referenceItr != referenceEnd; ++i, ++referenceItr )
+    {
+    this->m_EvaluationPoints[i].CastFrom( referenceItr.Value() );
+    }
+
+  ThreadStruct str;
+  str.Filter = this;
+
+  this->GetMultiThreader()->SetNumberOfThreads( this->GetNumberOfThreads() );
+  this->GetMultiThreader()->SetSingleMethod( this->EvaluateThreaderCallback, &str );
+  this->GetMultiThreader()->SingleMethodExecute();
+
   OutputPointsContainerIterator outputPointItr = points->Begin();
 
-  typedef typename TransformType::InputPointType InputPointType;
-  typedef typename InterpolatorType::PointType   TransformInputPointType;
+  for( SizeValueType i = 0; i < this->m_EvaluatedPoints.size(); ++i )
+    {
+    outputPointItr.Value() = this->m_EvaluatedPoints[i];
+
+    progress.CompletedPixel();
+
+    ++outputPointItr;
+    }
+
+  this->m_InputPoints = ITK_NULLPTR;
+  this->m_EvaluationPoints.clear();
+  this->m_EvaluatedPoints.clear();
+}
+
+template <class TInputMesh, class TFixedMesh, class TReferenceMesh, class TOutputMesh>
+ITK_THREAD_RETURN_TYPE
+ResampleDestinationPointsQuadEdgeMeshFilter<TInputMesh, TFixedMesh, TReferenceMesh, TOutputMesh>
+::EvaluateThreaderCallback(void *arg)
+{
+  const ThreadIdType threadId = ( (MultiThreader::ThreadInfoStruct *)(arg) )->ThreadID;
+  const ThreadIdType threadCount = ( (MultiThreader::ThreadInfoStruct *)(arg) )->NumberOfThreads;
+  ThreadStruct *     str = (ThreadStruct *)( ( (MultiThreader::ThreadInfoStruct *)(arg) )->UserData);
+  Self *             filter = str->Filter;
+
+  const SizeValueType numberOfPoints = filter->m_EvaluationPoints.size();
+  const SizeValueType chunk = ( numberOfPoints + threadCount - 1 ) / threadCount;
+  const SizeValueType start = std::min( numberOfPoints, threadId * chunk );
+  const SizeValueType end = std::min( numberOfPoints, start + chunk );
 
-  InputPointType inputPoint;
+  filter->ThreadedEvaluate( start, end );
+
+  return ITK_THREAD_RETURN_VALUE;
+}
+
+template <class TInputMesh, class TFixedMesh, class TReferenceMesh, class TOutputMesh>
+void
+ResampleDestinationPointsQuadEdgeMeshFilter<TInputMesh, TFixedMesh, TReferenceMesh, TOutputMesh>
+::ThreadedEvaluate(const SizeValueType start, const SizeValueType end)
+{
+  typedef typename InterpolatorType::PointType TransformInputPointType;
 
   TransformInputPointType pointToEvaluate;
   TransformInputPointType evaluatedPoint;
 
   OutputPointType resultingPoint;
 
-  while( referenceItr != referenceEnd )
+  for( SizeValueType i = start; i < end; ++i )
     {
-    inputPoint.CastFrom( referenceItr.Value() );
-
-    pointToEvaluate.CastFrom( this->m_Transform->TransformPoint( inputPoint ) );
+    pointToEvaluate.CastFrom( this->m_Transform->TransformPoint( this->m_EvaluationPoints[i] ) );
 
-    this->m_Interpolator->Evaluate( inputPoints, pointToEvaluate, evaluatedPoint );
+    this->m_Interpolator->Evaluate( this->m_InputPoints, pointToEvaluate, evaluatedPoint );
 
     resultingPoint.CastFrom( evaluatedPoint );
 
     this->ProjectPointToSphereSurface( resultingPoint );
 
-    outputPointItr.Value() = resultingPoint;
-
-    progress.CompletedPixel();
-
-    ++outputPointItr;
-    ++referenceItr;
+    this->m_EvaluatedPoints[i] = resultingPoint;
     }
 }
 } // end namespace itk
@@ -22,6 +22,8 @@
 #include "itkQuadEdgeMeshToQuadEdgeMeshFilter.h"
 #include "itkInterpolateMeshFunction.h"
 #include "itkTransform.h"
+#include "itkMultiThreader.h"
+#include <vector>
 
 namespace itk
 {
@@ -30,6 +32,10 @@ namespace itk
  * \brief This resamples the scalar values of one QuadEdgeMesh into another one
  * via a user-provided Transform and Interpolator.
  *
+ * The points of the reference mesh are evaluated concurrently by the threads
+ * of the filter, sharing the Interpolator, whose Evaluate() method must
+ * therefore be reentrant once the interpolator has been initialized.
+ *
  * \ingroup MeshFilters
  *
  */
@@ -95,6 +101,7 @@ public:
   /** Interpolator typedef. */
   typedef InterpolateMeshFunction<InputMeshType> InterpolatorType;
   typedef typename InterpolatorType::Pointer     InterpolatorPointerType;
+  typedef typename InterpolatorType::OutputType  InterpolatorOutputType;
 
   /** Set Mesh whose grid will define the geometry and topology of the output Mesh.
    *  In a registration scenario, this will typically be the Fixed mesh. */
@@ -150,8 +157,24 @@ private:
 
   virtual void CopyReferenceMeshToOutputMeshCellData();
 
+  struct ThreadStruct
+    {
+    Self *Filter;
+    };
+
+  static ITK_THREAD_RETURN_TYPE EvaluateThreaderCallback(void *arg);
+
+  /** Map the points [start, end) through the transform and interpolate the
+   * input mesh at them. */
+  void ThreadedEvaluate(const SizeValueType start, const SizeValueType end);
+
   TransformPointerType    m_Transform;          // Coordinate transform to use
   InterpolatorPointerType m_Interpolator;       // Image function for
+
+  // Points of the reference mesh and their interpolated values, stored
+  // contiguously during GenerateData().
+  std::vector<OutputPointType>        m_EvaluationPoints;
+  std::vector<InterpolatorOutputType> m_EvaluatedValues;
 };
 }
 
@@ -23,6 +23,7 @@
 #include "itkProgressReporter.h"
 #include "itkVersor.h"
 #include "itkNumericTraitsVectorPixel.h"
+#include <algorithm>
 
 namespace itk
 {
@@ -104,30 +105,83 @@ ResampleQuadEdgeMeshFilter<TInputMesh, TOutputMesh>
   typedef typename OutputMeshType::PointsContainer::ConstIterator PointIterator;
   typedef typename OutputMeshType::PointDataContainer::Iterator   PointDataIterator;
 
+  //
+  // Gather the points in a contiguous array, evaluate them concurrently, and
+  // scatter the values into the point data.
+  //
+  this->m_EvaluationPoints.resize( numberOfPoints );
+  this->m_EvaluatedValues.resize( numberOfPoints );
+
   PointIterator pointItr = points->Begin();
   PointIterator pointEnd = points->End();
 
+  for( SizeValueType i = 0; pointItr != pointEnd && i < numberOfPoints; ++i, ++pointItr )
+    {
+    this->m_EvaluationPoints[i].CastFrom( pointItr.Value() );
+    }
+
+  ThreadStruct str;
+  str.Filter = this;
+
+  this->GetMultiThreader()->SetNumberOfThreads( this->GetNumberOfThreads() );
+  this->GetMultiThreader()->SetSingleMethod( this->EvaluateThreaderCallback, &str );
+  this->GetMultiThreader()->SingleMethodExecute();
+
   PointDataIterator pointDataItr = pointData->Begin();
   PointDataIterator pointDataEnd = pointData->End();
 
+  for( SizeValueType i = 0; pointDataItr != pointDataEnd && i < numberOfPoints; ++i, ++pointDataItr )
+    {
+    pointDataItr.Value() = this->m_EvaluatedValues[i];
+
+    progress.CompletedPixel();
+    }
+
+  this->m_EvaluationPoints.clear();
+  this->m_EvaluatedValues.clear();
+}
+
+// ---------------------------------------------------------------------
+template <class TInputMesh, class TOutputMesh>
+ITK_THREAD_RETURN_TYPE
+ResampleQuadEdgeMeshFilter<TInputMesh, TOutputMesh>
+::EvaluateThreaderCallback(void *arg)
+{
+  const ThreadIdType threadId = ( (MultiThreader::ThreadInfoStruct *)(arg) )->ThreadID;
+  const ThreadIdType threadCount = ( (MultiThreader::ThreadInfoStruct *)(arg) )->NumberOfThreads;
+  ThreadStruct *     str = (ThreadStruct *)( ( (MultiThreader::ThreadInfoStruct *)(arg) )->UserData);
+  Self *             filter = str->Filter;
+
+  const SizeValueType numberOfPoints = filter->m_EvaluationPoints.size();
+  const SizeValueType chunk = ( numberOfPoints + threadCount - 1 ) / threadCount;
+  const SizeValueType start = std::min( numberOfPoints, threadId * chunk );
+  const SizeValueType end = std::min( numberOfPoints, start + chunk );
+
+  filter->ThreadedEvaluate( start, end );
+
+  return ITK_THREAD_RETURN_VALUE;
+}
+
+// ---------------------------------------------------------------------
+template <class TInputMesh, class TOutputMesh>
+void
+ResampleQuadEdgeMeshFilter<TInputMesh, TOutputMesh>
+::ThreadedEvaluate(const SizeValueType start, const SizeValueType end)
+{
   typedef typename TransformType::OutputPointType MappedPointType;
+  typedef typename InterpolatorType::PointType    InterpolatorPointType;
 
-  OutputPointType inputPoint;
-  OutputPointType pointToEvaluate;
+  typename TransformType::InputPointType inputPoint;
+  InterpolatorPointType                  pointToEvaluate;
 
-  while( pointItr != pointEnd && pointDataItr != pointDataEnd )
+  for( SizeValueType i = start; i < end; ++i )
     {
-    inputPoint.CastFrom( pointItr.Value() );
+    inputPoint.CastFrom( this->m_EvaluationPoints[i] );
 
-    MappedPointType transformedPoint = this->m_Transform->TransformPoint( inputPoint );
+    const MappedPointType transformedPoint = this->m_Transform->TransformPoint( inputPoint );
 
     pointToEvaluate.CastFrom( transformedPoint );
-    pointDataItr.Value() = this->m_Interpolator->Evaluate( pointToEvaluate );
-
-    progress.CompletedPixel();
-
-    ++pointItr;
-    ++pointDataItr;
+    this->m_EvaluatedValues[i] = this->m_Interpolator->Evaluate( pointToEvaluate );
     }
 }
 
@@ -0,0 +1,146 @@
+/*=========================================================================
+ *
+ *  Copyright SINAPSE: Scalable Informatics for Neuroscience, Processing and Software Engineering
+ *            The University of Iowa
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#ifndef __itkSphericalTriangleLocator_h
+#define __itkSphericalTriangleLocator_h
+
+#include "itkObject.h"
+#include <vector>
+
+namespace itk
+{
+/** \class SphericalTriangleLocator
+ * \brief Accelerate the search for the triangle of a spherical mesh that
+ * contains a point.
+ *
+ * The directions from the sphere center are divided in a latitude-longitude
+ * grid of buckets, and every triangle is registered in the buckets that
+ * overlap the spherical cap bounding the triangle.  A query only visits the
+ * few triangles registered in the bucket of the point, which takes constant
+ * expected time regardless of the size of the mesh.
+ *
+ * The locator is not modified by the queries, and can therefore be shared by
+ * several threads once Initialize() has been called.
+ *
+ */
+template <class TMesh>
+class SphericalTriangleLocator : public Object
+{
+public:
+  /** Standard class typedefs. */
+  typedef SphericalTriangleLocator Self;
+  typedef Object                   Superclass;
+  typedef SmartPointer<Self>       Pointer;
+  typedef SmartPointer<const Self> ConstPointer;
+
+  /** Method for creation through the object factory. */
+  itkNewMacro(Self);
+
+  /** Standard part of every itk Object. */
+  itkTypeMacro(SphericalTriangleLocator, Object);
+
+  /** Typedefs related to the Mesh type */
+  typedef TMesh                              MeshType;
+  typedef typename MeshType::ConstPointer    MeshConstPointer;
+  typedef typename MeshType::PointType       PointType;
+  typedef typename MeshType::PointIdentifier PointIdentifier;
+  typedef typename PointType::VectorType     VectorType;
+
+  /** Index of a triangle in the locator. */
+  typedef unsigned int TriangleIdentifier;
+
+  /** Connect the Mesh whose triangles will be located. */
+  itkSetConstObjectMacro( Mesh, MeshType );
+  itkGetConstObjectMacro( Mesh, MeshType );
+
+  /** Set Sphere Center. The buckets are defined on the directions from this
+   * point. */
+  itkSetMacro( SphereCenter, PointType );
+  itkGetConstMacro( SphereCenter, PointType );
+
+  /** Number of triangles per bucket used to size the grid, one by default.
+   * Each triangle is registered in all the buckets it overlaps. */
+  itkSetMacro( TrianglesPerBucket, double );
+  itkGetConstMacro( TrianglesPerBucket, double );
+
+  /** Pre-Compute the bucket grid from the triangles of the Mesh. */
+  void Initialize();
+
+  /** Return in [begin, end) the triangles that may contain the point. The
+   * range is empty when the locator has not been initialized. */
+  void FindCandidateTriangles( const PointType & point, const TriangleIdentifier * & begin,
+                               const TriangleIdentifier * & end ) const;
+
+  /** Return the three point identifiers of a triangle. */
+  const PointIdentifier * GetTrianglePointIds( TriangleIdentifier triangle ) const
+  {
+    return &this->m_TrianglePointIds[3 * triangle];
+  }
+
+  TriangleIdentifier GetNumberOfTriangles() const
+  {
+    return static_cast<TriangleIdentifier>( this->m_TrianglePointIds.size() / 3 );
+  }
+
+protected:
+  SphericalTriangleLocator();
+  ~SphericalTriangleLocator();
+  virtual void PrintSelf(std::ostream& os, Indent indent) const ITK_OVERRIDE;
+
+private:
+  ITK_DISALLOW_COPY_AND_ASSIGN(SphericalTriangleLocator);
+
+  /** Latitude and longitude of the direction from the sphere center. */
+  void ComputeLatitudeLongitude( const VectorType & direction, double & latitude, double & longitude ) const;
+
+  unsigned int GetLatitudeBucket( double latitude ) const;
+
+  /** Buckets overlapped by the bounding cap of a triangle. The longitude
+   * range may start at a negative bucket and wraps around. */
+  struct BucketRange
+    {
+    unsigned int LatitudeBegin;
+    unsigned int LatitudeEnd;
+    int          LongitudeBegin;
+    unsigned int NumberOfLongitudes;
+    };
+
+  unsigned int GetLongitudeBucket( double longitude ) const;
+
+  MeshConstPointer m_Mesh;
+  PointType        m_SphereCenter;
+  double           m_TrianglesPerBucket;
+
+  unsigned int m_NumberOfLatitudeBuckets;
+  unsigned int m_NumberOfLongitudeBuckets;
+
+  // Point identifiers of the triangles, three per triangle.
+  std::vector<PointIdentifier> m_TrianglePointIds;
+
+  // Triangles of bucket b are m_BucketTriangles[m_BucketOffsets[b]] to
+  // m_BucketTriangles[m_BucketOffsets[b + 1] - 1].
+  std::vector<SizeValueType>      m_BucketOffsets;
+  std::vector<TriangleIdentifier> m_BucketTriangles;
+};
+} // end namespace itk
+
+#ifndef ITK_MANUAL_INSTANTIATION
+#include "itkSphericalTriangleLocator.hxx"
+#endif
+
+#endif
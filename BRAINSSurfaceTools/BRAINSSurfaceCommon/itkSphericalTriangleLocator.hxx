@@ -0,0 +1,310 @@
+/*=========================================================================
+ *
+ *  Copyright SINAPSE: Scalable Informatics for Neuroscience, Processing and Software Engineering
+ *            The University of Iowa
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#ifndef __itkSphericalTriangleLocator_hxx
+#define __itkSphericalTriangleLocator_hxx
+
+#include "itkSphericalTriangleLocator.h"
+#include "itkMath.h"
+#include <algorithm>
+#include <cmath>
+
+namespace itk
+{
+template <class TMesh>
+SphericalTriangleLocator<TMesh>
+::SphericalTriangleLocator()
+{
+  this->m_SphereCenter.Fill( 0.0 );
+  this->m_TrianglesPerBucket = 1.0;
+  this->m_NumberOfLatitudeBuckets = 0;
+  this->m_NumberOfLongitudeBuckets = 0;
+}
+
+template <class TMesh>
+SphericalTriangleLocator<TMesh>
+::~SphericalTriangleLocator()
+{
+}
+
+template <class TMesh>
+void
+SphericalTriangleLocator<TMesh>
+::Initialize()
+{
+  if( this->m_Mesh.IsNull() )
+    {
+    itkExceptionMacro("Mesh is missing");
+    }
+
+  this->m_TrianglePointIds.clear();
+  this->m_BucketOffsets.clear();
+  this->m_BucketTriangles.clear();
+
+  const typename MeshType::CellsContainer *  cells = this->m_Mesh->GetCells();
+  const typename MeshType::PointsContainer * points = this->m_Mesh->GetPoints();
+
+  if( cells && points )
+    {
+    typename MeshType::CellsContainer::ConstIterator cellItr = cells->Begin();
+    typename MeshType::CellsContainer::ConstIterator cellEnd = cells->End();
+
+    while( cellItr != cellEnd )
+      {
+      const typename MeshType::CellType * cell = cellItr.Value();
+      if( cell->GetNumberOfPoints() == 3 )
+        {
+        typename MeshType::CellType::PointIdConstIterator pointIdItr = cell->PointIdsBegin();
+        for( unsigned int k = 0; k < 3; ++k, ++pointIdItr )
+          {
+          this->m_TrianglePointIds.push_back( *pointIdItr );
+          }
+        }
+      ++cellItr;
+      }
+    }
+
+  const TriangleIdentifier numberOfTriangles = this->GetNumberOfTriangles();
+
+  const double numberOfBuckets =
+    std::max( 1.0, numberOfTriangles / std::max( this->m_TrianglesPerBucket, 1e-3 ) );
+
+  // Longitude buckets are twice as many as the latitude buckets, so that the
+  // buckets are about square at the equator.
+  this->m_NumberOfLatitudeBuckets =
+    std::max( 1u, static_cast<unsigned int>( vcl_floor( vcl_sqrt( numberOfBuckets / 2.0 ) + 0.5 ) ) );
+  this->m_NumberOfLongitudeBuckets = 2 * this->m_NumberOfLatitudeBuckets;
+
+  const double pi = vnl_math::pi;
+  const double halfPi = vnl_math::pi_over_2;
+
+  // The range of buckets overlapped by the bounding cap of every triangle.
+  // Degenerate triangles are registered nowhere.
+  std::vector<BucketRange> ranges( numberOfTriangles );
+
+  for( TriangleIdentifier t = 0; t < numberOfTriangles; ++t )
+    {
+    BucketRange & range = ranges[t];
+    range.LatitudeBegin = 0;
+    range.LatitudeEnd = 0;
+    range.LongitudeBegin = 0;
+    range.NumberOfLongitudes = 0;
+
+    const PointIdentifier * pointIds = this->GetTrianglePointIds( t );
+
+    VectorType vertex[3];
+    VectorType center;
+    center.Fill( 0.0 );
+
+    bool degenerate = false;
+    for( unsigned int k = 0; k < 3; ++k )
+      {
+      vertex[k] = points->ElementAt( pointIds[k] ) - this->m_SphereCenter;
+      const double norm = vertex[k].GetNorm();
+      if( norm <= 0.0 )
+        {
+        degenerate = true;
+        break;
+        }
+      vertex[k] /= norm;
+      center += vertex[k];
+      }
+
+    const double centerNorm = center.GetNorm();
+    if( degenerate || centerNorm <= 0.0 )
+      {
+      continue;
+      }
+    center /= centerNorm;
+
+    double minimumCosine = 1.0;
+    for( unsigned int k = 0; k < 3; ++k )
+      {
+      minimumCosine = std::min( minimumCosine, static_cast<double>( center * vertex[k] ) );
+      }
+
+    // Angular radius of the cap, enlarged to cover the tolerance used by the
+    // interpolators to accept points on the edges of the triangle.
+    double radius = vcl_acos( std::max( -1.0, minimumCosine ) );
+    radius = radius * 1.01 + 1e-9;
+
+    double latitude;
+    double longitude;
+    this->ComputeLatitudeLongitude( center, latitude, longitude );
+
+    range.LatitudeBegin = this->GetLatitudeBucket( std::max( latitude - radius, -halfPi ) );
+    range.LatitudeEnd = this->GetLatitudeBucket( std::min( latitude + radius, halfPi ) ) + 1;
+
+    range.NumberOfLongitudes = this->m_NumberOfLongitudeBuckets;
+
+    if( vcl_fabs( latitude ) + radius < halfPi )
+      {
+      const double halfWidth = vcl_asin( std::min( 1.0, vcl_sin( radius ) / vcl_cos( latitude ) ) );
+      const double bucketsPerRadian = this->m_NumberOfLongitudeBuckets / ( 2.0 * pi );
+
+      const int first = static_cast<int>( vcl_floor( ( longitude - halfWidth + pi ) * bucketsPerRadian ) );
+      const int last = static_cast<int>( vcl_floor( ( longitude + halfWidth + pi ) * bucketsPerRadian ) );
+
+      if( last - first + 1 < static_cast<int>( this->m_NumberOfLongitudeBuckets ) )
+        {
+        range.LongitudeBegin = first;
+        range.NumberOfLongitudes = last - first + 1;
+        }
+      }
+    }
+
+  // Bucket the triangles in two passes: count, then fill.
+  const SizeValueType totalNumberOfBuckets =
+    static_cast<SizeValueType>( this->m_NumberOfLatitudeBuckets ) * this->m_NumberOfLongitudeBuckets;
+
+  this->m_BucketOffsets.assign( totalNumberOfBuckets + 1, 0 );
+
+  const int numberOfLongitudeBuckets = this->m_NumberOfLongitudeBuckets;
+
+  for( unsigned int pass = 0; pass < 2; ++pass )
+    {
+    for( TriangleIdentifier t = 0; t < numberOfTriangles; ++t )
+      {
+      const BucketRange & range = ranges[t];
+      for( unsigned int i = range.LatitudeBegin; i < range.LatitudeEnd; ++i )
+        {
+        for( unsigned int j = 0; j < range.NumberOfLongitudes; ++j )
+          {
+          const int longitudeBucket =
+            ( ( range.LongitudeBegin + static_cast<int>( j ) ) % numberOfLongitudeBuckets
+              + numberOfLongitudeBuckets ) % numberOfLongitudeBuckets;
+          const SizeValueType bucket =
+            static_cast<SizeValueType>( i ) * this->m_NumberOfLongitudeBuckets + longitudeBucket;
+          if( pass == 0 )
+            {
+            ++this->m_BucketOffsets[bucket + 1];
+            }
+          else
+            {
+            this->m_BucketTriangles[this->m_BucketOffsets[bucket]++] = t;
+            }
+          }
+        }
+      }
+
+    if( pass == 0 )
+      {
+      for( SizeValueType b = 0; b < totalNumberOfBuckets; ++b )
+        {
+        this->m_BucketOffsets[b + 1] += this->m_BucketOffsets[b];
+        }
+      this->m_BucketTriangles.resize( this->m_BucketOffsets[totalNumberOfBuckets] );
+      }
+    else
+      {
+      // The fill pass advanced every offset to the beginning of the next bucket.
+      for( SizeValueType b = totalNumberOfBuckets; b > 0; --b )
+        {
+        this->m_BucketOffsets[b] = this->m_BucketOffsets[b - 1];
+        }
+      this->m_BucketOffsets[0] = 0;
+      }
+    }
+}
+
+template <class TMesh>
+void
+SphericalTriangleLocator<TMesh>
+::FindCandidateTriangles( const PointType & point, const TriangleIdentifier * & begin,
+                          const TriangleIdentifier * & end ) const
+{
+  begin = ITK_NULLPTR;
+  end = ITK_NULLPTR;
+
+  if( this->m_BucketTriangles.empty() )
+    {
+    return;
+    }
+
+  const VectorType direction = point - this->m_SphereCenter;
+
+  if( direction.GetNorm() <= 0.0 )
+    {
+    return;
+    }
+
+  double latitude;
+  double longitude;
+  this->ComputeLatitudeLongitude( direction, latitude, longitude );
+
+  const SizeValueType bucket =
+    static_cast<SizeValueType>( this->GetLatitudeBucket( latitude ) ) * this->m_NumberOfLongitudeBuckets
+    + this->GetLongitudeBucket( longitude );
+
+  const TriangleIdentifier * triangles = &this->m_BucketTriangles[0];
+
+  begin = triangles + this->m_BucketOffsets[bucket];
+  end = triangles + this->m_BucketOffsets[bucket + 1];
+}
+
+template <class TMesh>
+void
+SphericalTriangleLocator<TMesh>
+::ComputeLatitudeLongitude( const VectorType & direction, double & latitude, double & longitude ) const
+{
+  const double norm = direction.GetNorm();
+  const double sine = std::max( -1.0, std::min( 1.0, direction[2] / norm ) );
+
+  latitude = vcl_asin( sine );
+  longitude = vcl_atan2( static_cast<double>( direction[1] ), static_cast<double>( direction[0] ) );
+}
+
+template <class TMesh>
+unsigned int
+SphericalTriangleLocator<TMesh>
+::GetLatitudeBucket( double latitude ) const
+{
+  const double position = ( latitude + vnl_math::pi_over_2 ) / vnl_math::pi * this->m_NumberOfLatitudeBuckets;
+  const int    bucket = static_cast<int>( vcl_floor( position ) );
+
+  return static_cast<unsigned int>( std::max( 0, std::min( bucket,
+                                                           static_cast<int>( this->m_NumberOfLatitudeBuckets ) - 1 ) ) );
+}
+
+template <class TMesh>
+unsigned int
+SphericalTriangleLocator<TMesh>
+::GetLongitudeBucket( double longitude ) const
+{
+  const double position = ( longitude + vnl_math::pi ) / ( 2.0 * vnl_math::pi ) * this->m_NumberOfLongitudeBuckets;
+  const int    bucket = static_cast<int>( vcl_floor( position ) );
+
+  return static_cast<unsigned int>( std::max( 0, std::min( bucket,
+                                                           static_cast<int>( this->m_NumberOfLongitudeBuckets ) - 1 ) ) );
+}
+
+template <class TMesh>
+void
+SphericalTriangleLocator<TMesh>
+::PrintSelf( std::ostream& os, Indent indent) const
+{
+  this->Superclass::PrintSelf( os, indent );
+  os << indent << "SphereCenter: " << this->m_SphereCenter << std::endl;
+  os << indent << "TrianglesPerBucket: " << this->m_TrianglesPerBucket << std::endl;
+  os << indent << "NumberOfTriangles: " << this->GetNumberOfTriangles() << std::endl;
+  os << indent << "NumberOfLatitudeBuckets: " << this->m_NumberOfLatitudeBuckets << std::endl;
+  os << indent << "NumberOfLongitudeBuckets: " << this->m_NumberOfLongitudeBuckets << std::endl;
+}
+} // end namespace itk
+
+#endif
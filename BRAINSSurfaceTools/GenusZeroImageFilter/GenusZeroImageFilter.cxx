@@ -46,13 +46,210 @@ Version:   $Revision: 1.4 $
 
 #include <vtkITKImageWriter.h>
 
+#include "genus0.h"
+#include "itkIO.h"
+#include "itkMultiThreader.h"
+#include "itkSimpleFastMutexLock.h"
+#include "BRAINSThreadControl.h"
+
+#include <algorithm>
 #include <map>
 #include <string>
+#include <vector>
+
+namespace
+{
+typedef itk::Image<unsigned short, 3> LabelMapType;
+
+/* The voxels changed by the topology correction of one label */
+struct LabelCorrectionJob
+  {
+  unsigned short      Label;
+  std::vector<size_t> AddedVoxels;
+  std::vector<size_t> RemovedVoxels;
+  bool                Failed;
+  };
+
+struct LabelCorrectionThreadStruct
+  {
+  const unsigned short *            Input;
+  int                               Dims[3];
+  bool                              ConnectedComponent;
+  std::vector<LabelCorrectionJob> * Jobs;
+  size_t                            NextJob;
+  itk::SimpleFastMutexLock          JobLock;
+  };
+
+/* Labels are handed out one at a time, since the cost of a label depends on
+ * its size and topology. */
+ITK_THREAD_RETURN_TYPE
+LabelCorrectionThreaderCallback(void *arg)
+{
+  LabelCorrectionThreadStruct *str =
+    (LabelCorrectionThreadStruct *)( ( (itk::MultiThreader::ThreadInfoStruct *)(arg) )->UserData);
+
+  const size_t totlen = static_cast<size_t>( str->Dims[0] ) * str->Dims[1] * str->Dims[2];
+  for( ;; )
+    {
+    str->JobLock.Lock();
+    const size_t i = str->NextJob++;
+    str->JobLock.Unlock();
+    if( i >= str->Jobs->size() )
+      {
+      break;
+      }
+    LabelCorrectionJob & job = ( *str->Jobs )[i];
+
+    genus0parameters g0[1];
+    genus0init(g0);
+    g0->input = const_cast<unsigned short *>( str->Input );
+    for( int d = 0; d < 3; d++ )
+      {
+      g0->dims[d] = str->Dims[d];
+      }
+    g0->value = job.Label;
+    g0->alt_value = job.Label;
+    g0->contour_value = job.Label;
+    g0->alt_contour_value = job.Label;
+    g0->return_surface = 0;
+    g0->connectivity = 6;
+    g0->connected_component = str->ConnectedComponent;
+    if( genus0(g0) )
+      {
+      job.Failed = true;
+      genus0destruct(g0);
+      continue;
+      }
+    for( size_t v = 0; v < totlen; ++v )
+      {
+      const bool wasLabel = ( str->Input[v] == job.Label );
+      const bool isLabel = ( g0->output[v] == job.Label );
+      if( isLabel && !wasLabel )
+        {
+        job.AddedVoxels.push_back(v);
+        }
+      else if( wasLabel && !isLabel )
+        {
+        job.RemovedVoxels.push_back(v);
+        }
+      }
+    genus0destruct(g0);
+    }
+  return ITK_THREAD_RETURN_VALUE;
+}
+
+/* Correct every label of a label map with its own genus0 call, several
+ * labels concurrently, and merge the changes in the order of the labels. */
+int CorrectLabelMap(const std::string & inputVolume, const std::string & outputVolume,
+                    const std::vector<int> & labelValues, const bool connectedComponent,
+                    const int numberOfThreads)
+{
+  LabelMapType::Pointer labelMap;
+  try
+    {
+    labelMap = itkUtil::ReadImage<LabelMapType>(inputVolume);
+    }
+  catch( itk::ExceptionObject & err )
+    {
+    std::cerr << err << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  const LabelMapType::SizeType size = labelMap->GetLargestPossibleRegion().GetSize();
+
+  std::vector<LabelCorrectionJob> jobs(labelValues.size() );
+  for( size_t i = 0; i < labelValues.size(); ++i )
+    {
+    if( labelValues[i] <= 0 || labelValues[i] >= 65535 )
+      {
+      std::cerr << "Label value " << labelValues[i] << " is out of range." << std::endl;
+      return EXIT_FAILURE;
+      }
+    jobs[i].Label = static_cast<unsigned short>( labelValues[i] );
+    jobs[i].Failed = false;
+    }
+
+  LabelCorrectionThreadStruct str;
+  str.Input = labelMap->GetBufferPointer();
+  for( unsigned int d = 0; d < 3; d++ )
+    {
+    str.Dims[d] = static_cast<int>( size[d] );
+    }
+  str.ConnectedComponent = connectedComponent;
+  str.Jobs = &jobs;
+  str.NextJob = 0;
+
+  const BRAINSUtils::StackPushITKDefaultNumberOfThreads TempDefaultNumberOfThreadsHolder(numberOfThreads);
+  itk::MultiThreader::Pointer threader = itk::MultiThreader::New();
+  threader->SetNumberOfThreads( std::min<itk::ThreadIdType>( threader->GetNumberOfThreads(),
+                                                             static_cast<itk::ThreadIdType>( jobs.size() ) ) );
+  std::cout << "Correcting " << jobs.size() << " labels with " << threader->GetNumberOfThreads()
+            << " threads." << std::endl;
+  threader->SetSingleMethod(LabelCorrectionThreaderCallback, &str);
+  threader->SingleMethodExecute();
+
+  LabelMapType::Pointer corrected = LabelMapType::New();
+  corrected->CopyInformation(labelMap);
+  corrected->SetRegions(labelMap->GetLargestPossibleRegion() );
+  corrected->Allocate();
+  const size_t          totlen = labelMap->GetLargestPossibleRegion().GetNumberOfPixels();
+  unsigned short *      out = corrected->GetBufferPointer();
+  const unsigned short *in = labelMap->GetBufferPointer();
+  std::copy(in, in + totlen, out);
+
+  bool failed = false;
+  for( size_t i = 0; i < jobs.size(); ++i )
+    {
+    const LabelCorrectionJob & job = jobs[i];
+    if( job.Failed )
+      {
+      std::cerr << "Error when executing genus0 for label " << job.Label << "." << std::endl;
+      failed = true;
+      continue;
+      }
+    std::cout << "label " << job.Label << ": " << job.AddedVoxels.size() << " voxels added, "
+              << job.RemovedVoxels.size() << " voxels removed" << std::endl;
+    for( size_t k = 0; k < job.RemovedVoxels.size(); ++k )
+      {
+      if( out[job.RemovedVoxels[k]] == job.Label )
+        {
+        out[job.RemovedVoxels[k]] = 0;
+        }
+      }
+    for( size_t k = 0; k < job.AddedVoxels.size(); ++k )
+      {
+      out[job.AddedVoxels[k]] = job.Label;
+      }
+    }
+
+  try
+    {
+    itkUtil::WriteImage<LabelMapType>(corrected, outputVolume);
+    }
+  catch( itk::ExceptionObject & err )
+    {
+    std::cerr << err << std::endl;
+    return EXIT_FAILURE;
+    }
+  return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+} // end anonymous namespace
 
 int main(int argc, char * argv[])
 {
   PARSE_ARGS;
 
+  if( !labelValues.empty() )
+    {
+    if( computeSurface || cutLoops || connectivityModel != 6 )
+      {
+      std::cerr << "--labelValues only supports the 6 connectivity volume correction without --cutLoops."
+                << std::endl;
+      return EXIT_FAILURE;
+      }
+    return CorrectLabelMap(inputVolume, outputVolume, labelValues, connectedComponent, numberOfThreads);
+    }
+
   bool debug = true;
 
   // vtk and helper variables
@@ -1,24 +1,39 @@
 #include "genus0.h"
 #include <iostream>
+#include <string.h>
 
 #include "itkMacro.h" //Needed for ITK_NULLPTR
 
-static int    verbose, invconnectivity, connectivity, autocrop[3][2];
-static int    img_horiz, img_vert, img_depth; /*,paddeddims[3];*/
-static size_t paddeddims[3];                  /* CHANGE MN */
-static int    nbrs[6], offs[27], nbrs18[18], nbrs26[26], pass[27];
-static int    elist18[27][19], elist[27][7], elist26[27][27];
-static int *  status, *cm, cm_size, que_size, *que, que_len, que_pos;
-static int    maxlevels, comp_count = 10, cut_loops;
-static int    calloced = 0, max_calloced = 32;
-static int *  persist = ITK_NULLPTR;
-
-static void * *       calloc_list = ITK_NULLPTR;
-static unsigned char *zpic;
-static float          voxelsize[3], *fzpic, fzpicmax;
-
-static size_t *g_axis_len, *g_stride;
-static float * g_deltax, *g_tmp, *g_tmp_row, * *g_j, *g_x, * *g_recip, * *g_square;
+/* Allocation arena of one genus0() call.  Every block is a plain calloc()
+ * block so that the persistent outputs can be released by genus0destruct()
+ * after the arena itself is gone. */
+struct genus0arena
+  {
+  void * *blocks;
+  int *   persist;
+  int     count, capacity;
+  };
+
+/* All the working state of one genus0() call.  Nothing is kept in file
+ * scope, so independent calls may run concurrently in different threads. */
+struct genus0context
+  {
+  int    verbose, invconnectivity, connectivity, autocrop[3][2];
+  int    img_horiz, img_vert, img_depth;
+  size_t paddeddims[3];                  /* CHANGE MN */
+  int    nbrs[6], offs[27], nbrs18[18], nbrs26[26], pass[27];
+  int    elist18[27][19], elist[27][7], elist26[27][27];
+  int *  status, *cm, cm_size, que_size, *que, que_len, que_pos;
+  int    maxlevels, comp_count, cut_loops;
+
+  genus0arena arena;
+
+  unsigned char *zpic;
+  float          voxelsize[3], *fzpic, fzpicmax;
+
+  size_t *g_axis_len, *g_stride;
+  float * g_deltax, *g_tmp, *g_tmp_row, * *g_j, *g_x, * *g_recip, * *g_square;
+  };
 
 static void print_msg(const char *msg)
 {
@@ -38,120 +53,120 @@ static void basic_free(void *ptr)
     }
 }
 
-static void Gfree(void *ptr)
+static void Gfree(genus0context *ctx, void *ptr)
 {
   int i, j;
 
-  /* free something in the calloc_list */
-  for( i = 0; i < calloced; i++ )
+  /* free something in the calloc_list, searching from the most recent
+     block since blocks are mostly freed in reverse order */
+  for( i = ctx->arena.count - 1; i >= 0; i-- )
     {
-    if( calloc_list[i] == ptr )
+    if( ctx->arena.blocks[i] == ptr )
       {
       basic_free(ptr);
-      for( j = i + 1; j < calloced; j++ )
+      for( j = i + 1; j < ctx->arena.count; j++ )
         {
-        calloc_list[j - 1] = calloc_list[j];
-        persist[j - 1] = persist[j];
+        ctx->arena.blocks[j - 1] = ctx->arena.blocks[j];
+        ctx->arena.persist[j - 1] = ctx->arena.persist[j];
         }
-      calloced--;
+      ctx->arena.count--;
       break;
       }
     }
 }
 
-static void Gfree_all(int keep_persist)
+static void Gfree_all(genus0context *ctx, int keep_persist)
 {
   int i;
 
-  if( calloc_list == ITK_NULLPTR )
+  if( ctx->arena.blocks == ITK_NULLPTR )
     {
     return;                      /* already done freeing all */
     }
-  for( i = 0; i < calloced; i++ )
+  for( i = ctx->arena.count - 1; i >= 0; i-- )
     {
-    if( ( !keep_persist ) || ( persist[i] == 0 ) )
+    if( ( !keep_persist ) || ( ctx->arena.persist[i] == 0 ) )
       {
-      Gfree(calloc_list[i]);
-      i--; /* don't advance i, since we compressed the list */
+      Gfree(ctx, ctx->arena.blocks[i]);
       }
     }
-  if( calloc_list != ITK_NULLPTR )
+  if( ctx->arena.blocks != ITK_NULLPTR )
     {
-    basic_free(calloc_list);
+    basic_free(ctx->arena.blocks);
     }
-  calloc_list = ITK_NULLPTR;
-  if( persist != ITK_NULLPTR )
+  ctx->arena.blocks = ITK_NULLPTR;
+  if( ctx->arena.persist != ITK_NULLPTR )
     {
-    basic_free(persist);
+    basic_free(ctx->arena.persist);
     }
-  persist = ITK_NULLPTR;
+  ctx->arena.persist = ITK_NULLPTR;
 }
 
-static void error_msg(const char *msg, int line)
+static void error_msg(genus0context *ctx, const char *msg, int line)
 {
   char line_msg[100];
 
-  if( calloc_list == ITK_NULLPTR )
+  if( ctx->arena.blocks == ITK_NULLPTR )
     {
     return;                      /* must have been an error already */
     }
   print_msg(msg);
   sprintf(line_msg, "Line: %d.\n", line);
   print_msg(line_msg);
-  Gfree_all(0);
+  Gfree_all(ctx, 0);
 }
 
-static void * Gcalloc(size_t nelem, size_t elsize, int make_persist)
+static void * Gcalloc(genus0context *ctx, size_t nelem, size_t elsize, int make_persist)
 {
   void * *cl;
   int *   p, j;
 
-  if( calloced == max_calloced )  /* we need more room */
+  if( ctx->arena.count == ctx->arena.capacity )  /* we need more room */
     {
-    cl = calloc_list;
-    calloc_list = (void * *)basic_calloc( max_calloced * 2, sizeof( void * ) );
-    if( calloc_list == ITK_NULLPTR )
+    cl = ctx->arena.blocks;
+    ctx->arena.blocks = (void * *)basic_calloc( ctx->arena.capacity * 2, sizeof( void * ) );
+    if( ctx->arena.blocks == ITK_NULLPTR )
       {
-      calloc_list = cl;
-      error_msg("Memory error.\n", __LINE__);
+      ctx->arena.blocks = cl;
+      error_msg(ctx, "Memory error.\n", __LINE__);
       return ITK_NULLPTR;
       }
-    for( j = 0; j < calloced; j++ )
+    for( j = 0; j < ctx->arena.count; j++ )
       {
-      calloc_list[j] = cl[j];
+      ctx->arena.blocks[j] = cl[j];
       }
     basic_free(cl);
 
-    p = persist;
-    persist = (int *)basic_calloc( max_calloced * 2, sizeof( int ) );
-    if( persist == ITK_NULLPTR )
+    p = ctx->arena.persist;
+    ctx->arena.persist = (int *)basic_calloc( ctx->arena.capacity * 2, sizeof( int ) );
+    if( ctx->arena.persist == ITK_NULLPTR )
       {
-      persist = p;
-      error_msg("Memory error.\n", __LINE__);
+      ctx->arena.persist = p;
+      error_msg(ctx, "Memory error.\n", __LINE__);
       return ITK_NULLPTR;
       }
-    for( j = 0; j < calloced; j++ )
+    for( j = 0; j < ctx->arena.count; j++ )
       {
-      persist[j] = p[j];
+      ctx->arena.persist[j] = p[j];
       }
     basic_free(p);
-    max_calloced *= 2;
+    ctx->arena.capacity *= 2;
     }
 
-  calloc_list[calloced] = basic_calloc(nelem, elsize);
-  if( calloc_list[calloced] == ITK_NULLPTR )
+  ctx->arena.blocks[ctx->arena.count] = basic_calloc(nelem, elsize);
+  if( ctx->arena.blocks[ctx->arena.count] == ITK_NULLPTR )
     {
-    error_msg("Memory error.\n", __LINE__);
+    error_msg(ctx, "Memory error.\n", __LINE__);
     return ITK_NULLPTR;
     }
   else
     {
-    persist[calloced] = make_persist;
+    ctx->arena.persist[ctx->arena.count] = make_persist;
     }
-  return calloc_list[calloced++];
+  return ctx->arena.blocks[ctx->arena.count++];
 }
 
-static void calc_elist(void)
+static void calc_elist(genus0context *ctx)
 {
   int vv, i, j, k, h, i1, j1, k1, count, thecase;
   int cases[6][3] = {{-1, 0, 0}, {1, 0, 0}, {0, -1, 0}, {0, 1, 0}, {0, 0, -1}, {0, 0, 1}};
@@ -177,11 +192,11 @@ static void calc_elist(void)
             vv = i1 + j1 * 3 + k1 * 9;
             if( vv != 13 )
               {
-              elist[h][++count] = vv;
+              ctx->elist[h][++count] = vv;
               }
             }
           }
-        elist[h][0] = count;
+        ctx->elist[h][0] = count;
         h++;
         }
       }
@@ -225,11 +240,11 @@ static void calc_elist(void)
             vv = i1 + j1 * 3 + k1 * 9;
             if( vv != 13 )
               {
-              elist18[h][++count] = vv;
+              ctx->elist18[h][++count] = vv;
               }
             }
           }
-        elist18[h][0] = count;
+        ctx->elist18[h][0] = count;
         h++;
         }
       }
@@ -270,31 +285,31 @@ static void calc_elist(void)
             vv = i1 + j1 * 3 + k1 * 9;
             if( vv != 13 )
               {
-              elist26[h][++count] = vv;
+              ctx->elist26[h][++count] = vv;
               }
             }
           }
-        elist26[h][0] = count;
+        ctx->elist26[h][0] = count;
         h++;
         }
       }
     }
 }
 
-static void process_row(int axis, float *start)
+static void process_row(genus0context *ctx, int axis, float *start)
 {
   register size_t len;
   register float *p, *p2, *p3, *p_end, pv, p2v, * *jp, * *j2p, * *j_end, *x2p;
   register float  x, x0, x2, *recip, *square, dx;
 
-  dx = g_deltax[axis];
+  dx = ctx->g_deltax[axis];
   if( dx < 0.f )
     {
     dx = -dx;
     }
-  j_end = g_j;
+  j_end = ctx->g_j;
   p = start;
-  p_end = start + g_axis_len[axis];
+  p_end = start + ctx->g_axis_len[axis];
 
   do
     {
@@ -305,21 +320,21 @@ static void process_row(int axis, float *start)
     }
   while( ++p != p_end );
 
-  if( j_end == g_j )
+  if( j_end == ctx->g_j )
     {
     return;
     }
-  jp = j2p = g_j;
-  x2p = g_x;
-  *g_x = -FLT_MAX;
+  jp = j2p = ctx->g_j;
+  x2p = ctx->g_x;
+  *ctx->g_x = -FLT_MAX;
   if( ++jp != j_end )
     {
     pv = *( p = *jp );
     p2v = *( p2 = *j2p );
     x2 = -FLT_MAX;
     x0 = dx * ( p - start );
-    square = g_square[axis];
-    recip = g_recip[axis];
+    square = ctx->g_square[axis];
+    recip = ctx->g_recip[axis];
     while( 1 )
       {
       len = p - p2;
@@ -346,8 +361,8 @@ static void process_row(int axis, float *start)
       }
     }
 
-  len = g_axis_len[axis];
-  p = p_end = g_tmp_row + len;
+  len = ctx->g_axis_len[axis];
+  p = p_end = ctx->g_tmp_row + len;
   p3 = start + len;
   while( len-- )
     {
@@ -372,24 +387,24 @@ static void process_row(int axis, float *start)
   return;
 }
 
-static void recursive_add_dist_squared(int axis, float *start)
+static void recursive_add_dist_squared(genus0context *ctx, int axis, float *start)
 {
   size_t len;
   float *p, *p_end, *p2, *p2_end, *p3;
 
   if( axis == 0 )
     {
-    process_row(0, start);
+    process_row(ctx, 0, start);
     return;
     }
 
-  len = g_stride[axis];
+  len = ctx->g_stride[axis];
   p = start;
   p_end = p + len;
-  p2_end = g_tmp + g_axis_len[axis];
+  p2_end = ctx->g_tmp + ctx->g_axis_len[axis];
   while( p != p_end )
     {
-    p2 = g_tmp;
+    p2 = ctx->g_tmp;
     p3 = p;
     while( p2 != p2_end )
       {
@@ -397,8 +412,8 @@ static void recursive_add_dist_squared(int axis, float *start)
       p3 += len;
       }
 
-    process_row(axis, g_tmp);
-    p2 = g_tmp;
+    process_row(ctx, axis, ctx->g_tmp);
+    p2 = ctx->g_tmp;
     p3 = p++;
     while( p2 != p2_end )
       {
@@ -408,17 +423,17 @@ static void recursive_add_dist_squared(int axis, float *start)
     }
 
   p = start;
-  len = g_axis_len[axis];
+  len = ctx->g_axis_len[axis];
   while( len-- )
     {
-    recursive_add_dist_squared(axis - 1, p);
-    p += g_stride[axis];
+    recursive_add_dist_squared(ctx, axis - 1, p);
+    p += ctx->g_stride[axis];
     }
 
   return;
 }
 
-static int dist_squared(
+static int dist_squared(genus0context *ctx,
   int rank,
   size_t *axis_len,
   float *deltax,
@@ -433,7 +448,7 @@ static int dist_squared(
 
   if( !( rank >= 0 ) )
     {
-    error_msg("Error during distance transform.\n", __LINE__); return 1;
+    error_msg(ctx, "Error during distance transform.\n", __LINE__); return 1;
     }
   if( rank == 0 )
     {
@@ -441,10 +456,10 @@ static int dist_squared(
     return 0;
     }
 
-  g_stride = (size_t *)Gcalloc(rank, sizeof( size_t ), 0);
-  if( g_stride == ITK_NULLPTR )
+  ctx->g_stride = (size_t *)Gcalloc(ctx, rank, sizeof( size_t ), 0);
+  if( ctx->g_stride == ITK_NULLPTR )
     {
-    error_msg("Memory error.\n", __LINE__); return 1;
+    error_msg(ctx, "Memory error.\n", __LINE__); return 1;
     }
 
   max_axis_len = 2;
@@ -463,36 +478,36 @@ static int dist_squared(
       {
       max_axis_len = axis_len[i];
       }
-    g_stride[i] = data_len;
+    ctx->g_stride[i] = data_len;
     data_len *= axis_len[i];
     }
 
-  g_tmp = (float *)Gcalloc(max_axis_len, sizeof( float ), 0);
-  if( g_tmp == ITK_NULLPTR )
+  ctx->g_tmp = (float *)Gcalloc(ctx, max_axis_len, sizeof( float ), 0);
+  if( ctx->g_tmp == ITK_NULLPTR )
     {
-    error_msg("Memory error.\n", __LINE__); return 1;
+    error_msg(ctx, "Memory error.\n", __LINE__); return 1;
     }
 
-  g_tmp_row = (float *)Gcalloc(max_axis_len, sizeof( float ), 0);
-  if( g_tmp_row == ITK_NULLPTR )
+  ctx->g_tmp_row = (float *)Gcalloc(ctx, max_axis_len, sizeof( float ), 0);
+  if( ctx->g_tmp_row == ITK_NULLPTR )
     {
-    error_msg("Memory error.\n", __LINE__); return 1;
+    error_msg(ctx, "Memory error.\n", __LINE__); return 1;
     }
 
-  g_j = (float * *)Gcalloc(max_axis_len, sizeof( float * ), 0);
-  if( g_j == ITK_NULLPTR )
+  ctx->g_j = (float * *)Gcalloc(ctx, max_axis_len, sizeof( float * ), 0);
+  if( ctx->g_j == ITK_NULLPTR )
     {
-    error_msg("Memory error.\n", __LINE__); return 1;
+    error_msg(ctx, "Memory error.\n", __LINE__); return 1;
     }
 
-  g_x = (float *)Gcalloc(max_axis_len, sizeof( float ), 0);
-  if( g_x == ITK_NULLPTR )
+  ctx->g_x = (float *)Gcalloc(ctx, max_axis_len, sizeof( float ), 0);
+  if( ctx->g_x == ITK_NULLPTR )
     {
-    error_msg("Memory error.\n", __LINE__); return 1;
+    error_msg(ctx, "Memory error.\n", __LINE__); return 1;
     }
 
   p = outdist_squared;
-  len = g_stride[rank - 1];
+  len = ctx->g_stride[rank - 1];
   while( len-- )
     {
     *p++ = ( *inimage++ == inobject ) ? 0.f : FLT_MAX;
@@ -504,7 +519,7 @@ static int dist_squared(
     {
     ftmp = -ftmp;
     }
-  len = data_len - g_stride[rank - 1];
+  len = data_len - ctx->g_stride[rank - 1];
   while( len-- )
     {
     if( *inimage++ == inobject )
@@ -521,34 +536,34 @@ static int dist_squared(
 
   if( rank > 1 )
     {
-    g_axis_len = axis_len;
-    g_deltax = deltax;
+    ctx->g_axis_len = axis_len;
+    ctx->g_deltax = deltax;
 
-    g_recip = (float * *)Gcalloc(rank - 1, sizeof( float * ), 0);
-    if( g_recip == ITK_NULLPTR )
+    ctx->g_recip = (float * *)Gcalloc(ctx, rank - 1, sizeof( float * ), 0);
+    if( ctx->g_recip == ITK_NULLPTR )
       {
-      error_msg("Memory error.\n", __LINE__); return 1;
+      error_msg(ctx, "Memory error.\n", __LINE__); return 1;
       }
-    g_square = (float * *)Gcalloc(rank - 1, sizeof( float * ), 0);
-    if( g_square == ITK_NULLPTR )
+    ctx->g_square = (float * *)Gcalloc(ctx, rank - 1, sizeof( float * ), 0);
+    if( ctx->g_square == ITK_NULLPTR )
       {
-      error_msg("Memory error.\n", __LINE__); return 1;
+      error_msg(ctx, "Memory error.\n", __LINE__); return 1;
       }
     for( i = 0; i < rank - 1; i++ )
       {
-      g_recip[i] = g_square[i] = ITK_NULLPTR;
+      ctx->g_recip[i] = ctx->g_square[i] = ITK_NULLPTR;
       }
     for( i = 0; i < rank - 1; i++ )
       {
-      g_recip[i] = (float *)Gcalloc(axis_len[i] + 1, sizeof( float ), 0);
-      if( g_recip[i] == ITK_NULLPTR )
+      ctx->g_recip[i] = (float *)Gcalloc(ctx, axis_len[i] + 1, sizeof( float ), 0);
+      if( ctx->g_recip[i] == ITK_NULLPTR )
         {
-        error_msg("Memory error.\n", __LINE__); return 1;
+        error_msg(ctx, "Memory error.\n", __LINE__); return 1;
         }
-      g_square[i] = (float *)Gcalloc(axis_len[i] + 1, sizeof( float ), 0);
-      if( g_square[i] == ITK_NULLPTR )
+      ctx->g_square[i] = (float *)Gcalloc(ctx, axis_len[i] + 1, sizeof( float ), 0);
+      if( ctx->g_square[i] == ITK_NULLPTR )
         {
-        error_msg("Memory error.\n", __LINE__); return 1;
+        error_msg(ctx, "Memory error.\n", __LINE__); return 1;
         }
 
       len = axis_len[i];
@@ -560,14 +575,14 @@ static int dist_squared(
           {
           ftmp2 = -ftmp2;
           }
-        g_recip[i][len] = 0.5f / ftmp2;
-        g_square[i][len] = ftmp2 * ftmp2;
+        ctx->g_recip[i][len] = 0.5f / ftmp2;
+        ctx->g_square[i][len] = ftmp2 * ftmp2;
         }
       while( --len );
       }
     while( p2 != outdist_squared )
       {
-      len = g_stride[rank - 1];
+      len = ctx->g_stride[rank - 1];
       while( len-- )
         {
         --p2;
@@ -582,10 +597,10 @@ static int dist_squared(
           }
         }
 
-      recursive_add_dist_squared(rank - 2, p);
+      recursive_add_dist_squared(ctx, rank - 2, p);
       }
 
-    len = g_stride[rank - 1];
+    len = ctx->g_stride[rank - 1];
     while( len-- )
       {
       if( *--p != FLT_MAX )
@@ -594,14 +609,14 @@ static int dist_squared(
         }
       }
 
-    recursive_add_dist_squared(rank - 2, p);
+    recursive_add_dist_squared(ctx, rank - 2, p);
     for( i = 0; i < rank - 1; i++ )
       {
-      Gfree(g_recip[i]);
-      Gfree(g_square[i]);
+      Gfree(ctx, ctx->g_recip[i]);
+      Gfree(ctx, ctx->g_square[i]);
       }
-    Gfree(g_recip);
-    Gfree(g_square);
+    Gfree(ctx, ctx->g_recip);
+    Gfree(ctx, ctx->g_square);
     }
   else
     {
@@ -625,11 +640,11 @@ static int dist_squared(
       *p *= *p;
       }
     }
-  Gfree(g_stride);
-  Gfree(g_tmp);
-  Gfree(g_tmp_row);
-  Gfree(g_j);
-  Gfree(g_x);
+  Gfree(ctx, ctx->g_stride);
+  Gfree(ctx, ctx->g_tmp);
+  Gfree(ctx, ctx->g_tmp_row);
+  Gfree(ctx, ctx->g_j);
+  Gfree(ctx, ctx->g_x);
   return 0;
 }
 
@@ -644,7 +659,7 @@ static int sub2ind(int horiz, int vert, int depth, int _img_horiz, int _img_vert
 
 // static int get_cc(unsigned char * zpic, int *que, int * status, int *dims,
 // int *ac, int connectivity)
-static int get_cc(unsigned char *_zpic, int *_que, int *_status, size_t *dims, int *ac, int _connectivity)
+static int get_cc(genus0context *ctx, unsigned char *_zpic, int *_que, int *_status, size_t *dims, int *ac, int _connectivity)
 {
   int i, *_offs, nbrs6[6], _nbrs18[18], *g_counts;
   int j, k, h, vox, c, w, groups, _que_pos, _que_len;
@@ -705,7 +720,7 @@ static int get_cc(unsigned char *_zpic, int *_que, int *_status, size_t *dims, i
             {
             if( _zpic[woffsh = w + _offs[h]] == 1 )
               {
-              _zpic[que[_que_len++] = woffsh] = 2;
+              _zpic[_que[_que_len++] = woffsh] = 2;
               }
             }
 
@@ -728,10 +743,10 @@ static int get_cc(unsigned char *_zpic, int *_que, int *_status, size_t *dims, i
         } /* for loop through voxels */
       }
     }
-  g_counts = (int *)Gcalloc(groups + 1, sizeof( int ), 0);
+  g_counts = (int *)Gcalloc(ctx, groups + 1, sizeof( int ), 0);
   if( g_counts == ITK_NULLPTR )
     {
-    error_msg("Memory error.\n", __LINE__); return 1;
+    error_msg(ctx, "Memory error.\n", __LINE__); return 1;
     }
   for( i = 0; i < vox; i++ )
     {
@@ -799,51 +814,51 @@ static int get_cc(unsigned char *_zpic, int *_que, int *_status, size_t *dims, i
       }
     }
 
-  Gfree(g_counts);
+  Gfree(ctx, g_counts);
   return 0;
 }
 
-static int set_up(genus0parameters *g0)
+static int set_up(genus0context *ctx, genus0parameters *g0)
 {
   int            i, j, h, k, totlen, hz, *pad, ac[6];
   unsigned short value, *input;
   float *        m, minvoxelsize;
 
   /* set some global variables */
-  verbose = ( g0->verbose != 0 );
-  if( verbose )
+  ctx->verbose = ( g0->verbose != 0 );
+  if( ctx->verbose )
     {
     print_msg("Setting up...\n");
     }
 
   if( ( input = g0->input ) == ITK_NULLPTR )
     {
-    error_msg("No input volume.\n", __LINE__); return 1;
+    error_msg(ctx, "No input volume.\n", __LINE__); return 1;
     }
 
   if( ( g0->dims[0] <= 0 ) || ( g0->dims[1] <= 0 ) || ( g0->dims[2] <= 0 ) )
     {
-    error_msg("Bad input volume dimensions.\n", __LINE__); return 1;
+    error_msg(ctx, "Bad input volume dimensions.\n", __LINE__); return 1;
     }
 
-  calloc_list = (void * *)basic_calloc( max_calloced, sizeof( void * ) );
-  if( calloc_list == ITK_NULLPTR )
+  ctx->arena.blocks = (void * *)basic_calloc( ctx->arena.capacity, sizeof( void * ) );
+  if( ctx->arena.blocks == ITK_NULLPTR )
     {
-    error_msg("Memory error.\n", __LINE__); return 1;
+    error_msg(ctx, "Memory error.\n", __LINE__); return 1;
     }
 
-  persist = (int *)basic_calloc( max_calloced, sizeof( int ) );
-  if( persist == ITK_NULLPTR )
+  ctx->arena.persist = (int *)basic_calloc( ctx->arena.capacity, sizeof( int ) );
+  if( ctx->arena.persist == ITK_NULLPTR )
     {
-    error_msg("Memory error.\n", __LINE__); return 1;
+    error_msg(ctx, "Memory error.\n", __LINE__); return 1;
     }
 
   if( ( g0->connectivity != 6 ) && ( g0->connectivity != 18 ) )
     {
     g0->connectivity = 6;
     }
-  connectivity = g0->connectivity;
-  invconnectivity = ( g0->connectivity == 6 ) ? 18 : 6;
+  ctx->connectivity = g0->connectivity;
+  ctx->invconnectivity = ( g0->connectivity == 6 ) ? 18 : 6;
 
   pad = g0->pad;
   for( i = 0; i < 3; i++ )
@@ -855,7 +870,7 @@ static int set_up(genus0parameters *g0)
     }
 
   g0->biggest_component = ( g0->biggest_component != 0 );
-  cut_loops = g0->cut_loops = ( g0->cut_loops != 0 );
+  ctx->cut_loops = g0->cut_loops = ( g0->cut_loops != 0 );
   g0->return_surface = ( g0->return_surface != 0 );
   g0->return_adjusted_label_map = ( g0->return_adjusted_label_map != 0 );
 
@@ -863,7 +878,7 @@ static int set_up(genus0parameters *g0)
   /* get cropping limits */
   for( k = 0; k < 3; k++ )
     {
-    autocrop[k][0] = ( g0->dims )[k]; autocrop[k][1] = 0;
+    ctx->autocrop[k][0] = ( g0->dims )[k]; ctx->autocrop[k][1] = 0;
     }
   for( k = h = 0; k < ( g0->dims[2] ); k++ )
     {
@@ -873,29 +888,29 @@ static int set_up(genus0parameters *g0)
         {
         if( input[h] == value )
           {
-          if( autocrop[0][0] > i )
+          if( ctx->autocrop[0][0] > i )
             {
-            autocrop[0][0] = i;
+            ctx->autocrop[0][0] = i;
             }
-          if( autocrop[0][1] < i )
+          if( ctx->autocrop[0][1] < i )
             {
-            autocrop[0][1] = i;
+            ctx->autocrop[0][1] = i;
             }
-          if( autocrop[1][0] > j )
+          if( ctx->autocrop[1][0] > j )
             {
-            autocrop[1][0] = j;
+            ctx->autocrop[1][0] = j;
             }
-          if( autocrop[1][1] < j )
+          if( ctx->autocrop[1][1] < j )
             {
-            autocrop[1][1] = j;
+            ctx->autocrop[1][1] = j;
             }
-          if( autocrop[2][0] > k )
+          if( ctx->autocrop[2][0] > k )
             {
-            autocrop[2][0] = k;
+            ctx->autocrop[2][0] = k;
             }
-          if( autocrop[2][1] < k )
+          if( ctx->autocrop[2][1] < k )
             {
-            autocrop[2][1] = k;
+            ctx->autocrop[2][1] = k;
             }
           }
         h++;
@@ -903,98 +918,98 @@ static int set_up(genus0parameters *g0)
       }
     }
 
-  if( ( autocrop[0][0] > autocrop[0][1] ) || ( autocrop[1][0] > autocrop[1][1] )
-      || ( autocrop[2][0] > autocrop[2][1] ) )
+  if( ( ctx->autocrop[0][0] > ctx->autocrop[0][1] ) || ( ctx->autocrop[1][0] > ctx->autocrop[1][1] )
+      || ( ctx->autocrop[2][0] > ctx->autocrop[2][1] ) )
     {
-    error_msg("No data in volume matches specified value.\n", __LINE__); return 1;
+    error_msg(ctx, "No data in volume matches specified value.\n", __LINE__); return 1;
     }
 
   /* calculate cropped dimensions, and total length */
-  img_horiz = autocrop[0][1] - autocrop[0][0] + 1 + pad[0] * 2;
-  img_vert = autocrop[1][1] - autocrop[1][0] + 1 + pad[1] * 2;
-  img_depth = autocrop[2][1] - autocrop[2][0] + 1 + pad[2] * 2;
-  totlen = img_horiz * img_vert * img_depth;
-  paddeddims[0] = img_horiz; paddeddims[1] = img_vert; paddeddims[2] = img_depth;
+  ctx->img_horiz = ctx->autocrop[0][1] - ctx->autocrop[0][0] + 1 + pad[0] * 2;
+  ctx->img_vert = ctx->autocrop[1][1] - ctx->autocrop[1][0] + 1 + pad[1] * 2;
+  ctx->img_depth = ctx->autocrop[2][1] - ctx->autocrop[2][0] + 1 + pad[2] * 2;
+  totlen = ctx->img_horiz * ctx->img_vert * ctx->img_depth;
+  ctx->paddeddims[0] = ctx->img_horiz; ctx->paddeddims[1] = ctx->img_vert; ctx->paddeddims[2] = ctx->img_depth;
 
-  if( ( zpic = (unsigned char *)Gcalloc(totlen, sizeof( unsigned char ), 0) ) == ITK_NULLPTR )
+  if( ( ctx->zpic = (unsigned char *)Gcalloc(ctx, totlen, sizeof( unsigned char ), 0) ) == ITK_NULLPTR )
     {
-    error_msg("Memory error.\n", __LINE__); return 1;
+    error_msg(ctx, "Memory error.\n", __LINE__); return 1;
     }
-  for( k = 0; k < ( img_depth - pad[2] * 2 ); k++ )
+  for( k = 0; k < ( ctx->img_depth - pad[2] * 2 ); k++ )
     {
-    for( j = 0; j < ( img_vert - pad[1] * 2 ); j++ )
+    for( j = 0; j < ( ctx->img_vert - pad[1] * 2 ); j++ )
       {
-      for( i = 0; i < ( img_horiz - pad[0] * 2 ); i++ )
+      for( i = 0; i < ( ctx->img_horiz - pad[0] * 2 ); i++ )
         {
-        h = sub2ind(pad[0] + i, pad[1] + j, pad[2] + k, img_horiz, img_vert);
-        hz = sub2ind(autocrop[0][0] + i, autocrop[1][0] + j, autocrop[2][0] + k, g0->dims[0], g0->dims[1]);
-        zpic[h] = (int)( input[hz] == value );
+        h = sub2ind(pad[0] + i, pad[1] + j, pad[2] + k, ctx->img_horiz, ctx->img_vert);
+        hz = sub2ind(ctx->autocrop[0][0] + i, ctx->autocrop[1][0] + j, ctx->autocrop[2][0] + k, g0->dims[0], g0->dims[1]);
+        ctx->zpic[h] = (int)( input[hz] == value );
         }
       }
     }
 
-  que = ITK_NULLPTR;
-  status = ITK_NULLPTR;
+  ctx->que = ITK_NULLPTR;
+  ctx->status = ITK_NULLPTR;
 
   if( g0->connected_component )
     {
-    que_size = totlen;
-    if( ( que = (int *)Gcalloc(que_size, sizeof( int ), 0) ) == ITK_NULLPTR )
+    ctx->que_size = totlen;
+    if( ( ctx->que = (int *)Gcalloc(ctx, ctx->que_size, sizeof( int ), 0) ) == ITK_NULLPTR )
       {
-      error_msg("Memory error.\n", __LINE__); return 1;
+      error_msg(ctx, "Memory error.\n", __LINE__); return 1;
       }
 
     /* initialize voxel status */
-    if( ( status = (int *)Gcalloc(totlen, sizeof( int ), 0) ) == ITK_NULLPTR )
+    if( ( ctx->status = (int *)Gcalloc(ctx, totlen, sizeof( int ), 0) ) == ITK_NULLPTR )
       {
-      error_msg("Memory error.\n", __LINE__); return 1;
+      error_msg(ctx, "Memory error.\n", __LINE__); return 1;
       }
 
     /* zpic is binary. return connected component */
-    if( get_cc(zpic, que, status, paddeddims, ac, g0->connectivity) )
+    if( get_cc(ctx, ctx->zpic, ctx->que, ctx->status, ctx->paddeddims, ac, g0->connectivity) )
       {
-      error_msg("Connected component error.\n", __LINE__); return 1;
+      error_msg(ctx, "Connected component error.\n", __LINE__); return 1;
       }
 
     /* now we can crop zpic even more */
-    autocrop[0][0] += ac[0] - pad[0];
-    autocrop[0][1] = autocrop[0][0] + ( ac[1] - ac[0] );
+    ctx->autocrop[0][0] += ac[0] - pad[0];
+    ctx->autocrop[0][1] = ctx->autocrop[0][0] + ( ac[1] - ac[0] );
 
-    autocrop[1][0] += ac[2] - pad[1];
-    autocrop[1][1] = autocrop[1][0] + ( ac[3] - ac[2] );
+    ctx->autocrop[1][0] += ac[2] - pad[1];
+    ctx->autocrop[1][1] = ctx->autocrop[1][0] + ( ac[3] - ac[2] );
 
-    autocrop[2][0] += ac[4] - pad[2];
-    autocrop[2][1] = autocrop[2][0] + ( ac[5] - ac[4] );
+    ctx->autocrop[2][0] += ac[4] - pad[2];
+    ctx->autocrop[2][1] = ctx->autocrop[2][0] + ( ac[5] - ac[4] );
 
-    img_horiz = autocrop[0][1] - autocrop[0][0] + 1 + pad[0] * 2;
-    img_vert = autocrop[1][1] - autocrop[1][0] + 1 + pad[1] * 2;
-    img_depth = autocrop[2][1] - autocrop[2][0] + 1 + pad[2] * 2;
-    totlen = img_horiz * img_vert * img_depth;
+    ctx->img_horiz = ctx->autocrop[0][1] - ctx->autocrop[0][0] + 1 + pad[0] * 2;
+    ctx->img_vert = ctx->autocrop[1][1] - ctx->autocrop[1][0] + 1 + pad[1] * 2;
+    ctx->img_depth = ctx->autocrop[2][1] - ctx->autocrop[2][0] + 1 + pad[2] * 2;
+    totlen = ctx->img_horiz * ctx->img_vert * ctx->img_depth;
 
     h = 0;
-    for( k = 0; k < img_depth; k++ )
+    for( k = 0; k < ctx->img_depth; k++ )
       {
-      for( j = 0; j < img_vert; j++ )
+      for( j = 0; j < ctx->img_vert; j++ )
         {
-        for( i = 0; i < img_horiz; i++ )
+        for( i = 0; i < ctx->img_horiz; i++ )
           {
-          hz = sub2ind(ac[0] - pad[0] + i, ac[2] - pad[1] + j, ac[4] - pad[2] + k, paddeddims[0], paddeddims[1]);
-          zpic[h++] = zpic[hz];
+          hz = sub2ind(ac[0] - pad[0] + i, ac[2] - pad[1] + j, ac[4] - pad[2] + k, ctx->paddeddims[0], ctx->paddeddims[1]);
+          ctx->zpic[h++] = ctx->zpic[hz];
           }
         }
       }
-    paddeddims[0] = img_horiz;  paddeddims[1] = img_vert; paddeddims[2] = img_depth;
+    ctx->paddeddims[0] = ctx->img_horiz;  ctx->paddeddims[1] = ctx->img_vert; ctx->paddeddims[2] = ctx->img_depth;
     }
 
   if( ( m = g0->ijk2ras ) == ITK_NULLPTR )
     {
-    voxelsize[0] = voxelsize[1] = voxelsize[2] = 1.0;
+    ctx->voxelsize[0] = ctx->voxelsize[1] = ctx->voxelsize[2] = 1.0;
     }
   else
     {
     for( i = 0; i < 3; i++ )
       {
-      voxelsize[i] = sqrt(m[0 + i] * m[0 + i] + m[4 + i] * m[4 + i] + m[8 + i] * m[8 + i]);
+      ctx->voxelsize[i] = sqrt(m[0 + i] * m[0 + i] + m[4 + i] * m[4 + i] + m[8 + i] * m[8 + i]);
       }
     }
   for( i = 0; i < 3; i++ )
@@ -1006,16 +1021,16 @@ static int set_up(genus0parameters *g0)
     }
   for( i = 0; i < 3; i++ )
     {
-    voxelsize[i] *= ( g0->extraijkscale )[i];
+    ctx->voxelsize[i] *= ( g0->extraijkscale )[i];
     }
-  minvoxelsize = voxelsize[0];
-  if( minvoxelsize > voxelsize[1] )
+  minvoxelsize = ctx->voxelsize[0];
+  if( minvoxelsize > ctx->voxelsize[1] )
     {
-    minvoxelsize = voxelsize[1];
+    minvoxelsize = ctx->voxelsize[1];
     }
-  if( minvoxelsize > voxelsize[2] )
+  if( minvoxelsize > ctx->voxelsize[2] )
     {
-    minvoxelsize = voxelsize[2];
+    minvoxelsize = ctx->voxelsize[2];
     }
   if( minvoxelsize <= 0.0 )
     {
@@ -1023,9 +1038,9 @@ static int set_up(genus0parameters *g0)
     }
 
   /* calculate a bunch of offsets to face-sharing voxel neighbors */
-  nbrs[0] = -1;                    nbrs[1] = -nbrs[0];
-  nbrs[2] = -img_horiz;            nbrs[3] = -nbrs[2];
-  nbrs[4] = -( img_horiz * img_vert ); nbrs[5] = -nbrs[4];
+  ctx->nbrs[0] = -1;                    ctx->nbrs[1] = -ctx->nbrs[0];
+  ctx->nbrs[2] = -ctx->img_horiz;            ctx->nbrs[3] = -ctx->nbrs[2];
+  ctx->nbrs[4] = -( ctx->img_horiz * ctx->img_vert ); ctx->nbrs[5] = -ctx->nbrs[4];
   for( k = h = 0; k < 3; k++ )
     {
     for( j = 0; j < 3; j++ )
@@ -1033,7 +1048,7 @@ static int set_up(genus0parameters *g0)
       for( i = 0; i < 3; i++ )    /* calculate offsets for all 27 voxels in
                                     neighborhood */
         {
-        offs[h++] = sub2ind(i, j, k, img_horiz, img_vert) - sub2ind(1, 1, 1, img_horiz, img_vert);
+        ctx->offs[h++] = sub2ind(i, j, k, ctx->img_horiz, ctx->img_vert) - sub2ind(1, 1, 1, ctx->img_horiz, ctx->img_vert);
         }
       }
     }
@@ -1049,7 +1064,7 @@ static int set_up(genus0parameters *g0)
                                                            for all 18
                                                            neighboring voxels */
             {
-            nbrs18[h++] = sub2ind(i, j, k, img_horiz, img_vert) - sub2ind(1, 1, 1, img_horiz, img_vert);
+            ctx->nbrs18[h++] = sub2ind(i, j, k, ctx->img_horiz, ctx->img_vert) - sub2ind(1, 1, 1, ctx->img_horiz, ctx->img_vert);
             }
           }
         }
@@ -1064,160 +1079,160 @@ static int set_up(genus0parameters *g0)
         if( ( i != 1 ) || ( j != 1 ) || ( k != 1 ) )  /* calculate offsets for
                                                         26 neighboring voxels */
           {
-          nbrs26[h++] = sub2ind(i, j, k, img_horiz, img_vert) - sub2ind(1, 1, 1, img_horiz, img_vert);
+          ctx->nbrs26[h++] = sub2ind(i, j, k, ctx->img_horiz, ctx->img_vert) - sub2ind(1, 1, 1, ctx->img_horiz, ctx->img_vert);
           }
         }
       }
     }
 
   /* even more offsets */
-  calc_elist();
+  calc_elist(ctx);
   for( i = 0; i < 27; i++ )
     {
-    pass[i] = 1;
+    ctx->pass[i] = 1;
     }
 
   if( !( g0->any_genus ) )
     {
-    que_size = totlen;
-    if( que == ITK_NULLPTR )  /* might have already calloced it above ... */
+    ctx->que_size = totlen;
+    if( ctx->que == ITK_NULLPTR )  /* might have already calloced it above ... */
       {
-      if( ( que = (int *)Gcalloc(que_size, sizeof( int ), 0) ) == ITK_NULLPTR )
+      if( ( ctx->que = (int *)Gcalloc(ctx, ctx->que_size, sizeof( int ), 0) ) == ITK_NULLPTR )
         {
-        error_msg("Memory error.\n", __LINE__); return 1;
+        error_msg(ctx, "Memory error.\n", __LINE__); return 1;
         }
       }
 
-    if( ( fzpic = (float *)Gcalloc(totlen, sizeof( float ), 0) ) == ITK_NULLPTR )
+    if( ( ctx->fzpic = (float *)Gcalloc(ctx, totlen, sizeof( float ), 0) ) == ITK_NULLPTR )
       {
-      error_msg("Memory error.\n", __LINE__); return 1;
+      error_msg(ctx, "Memory error.\n", __LINE__); return 1;
       }
 
-    paddeddims[0] = img_horiz; paddeddims[1] = img_vert; paddeddims[2] = img_depth;
+    ctx->paddeddims[0] = ctx->img_horiz; ctx->paddeddims[1] = ctx->img_vert; ctx->paddeddims[2] = ctx->img_depth;
 
     /* calculate distance transform */
     /* sets fzpic to dist from {zpic=(1-cut_loops)} */
-    if( dist_squared(3, paddeddims, voxelsize, (char *)zpic, (char)( 1 - g0->cut_loops ), fzpic) )
+    if( dist_squared(ctx, 3, ctx->paddeddims, ctx->voxelsize, (char *)ctx->zpic, (char)( 1 - g0->cut_loops ), ctx->fzpic) )
       {
-      error_msg("Memory error.\n", __LINE__); return 1;
+      error_msg(ctx, "Memory error.\n", __LINE__); return 1;
       }
 
-    fzpicmax = 0.0;
+    ctx->fzpicmax = 0.0;
     for( i = 0; i < totlen; i++ )
       {
-      fzpic[i] = sqrt(fzpic[i]);
-      if( fzpic[i] > fzpicmax )
+      ctx->fzpic[i] = sqrt(ctx->fzpic[i]);
+      if( ctx->fzpic[i] > ctx->fzpicmax )
         {
-        fzpicmax = fzpic[i];
+        ctx->fzpicmax = ctx->fzpic[i];
         }
       }
 
-    maxlevels = (int)( fzpicmax / minvoxelsize + 2.5 );
+    ctx->maxlevels = (int)( ctx->fzpicmax / minvoxelsize + 2.5 );
     // std::cout << "Max Levels " << maxlevels << std::endl;
 
     /* Formula for cm_size.  certain to be <= totlen + 12 */
-    cm_size = totlen + 12;
+    ctx->cm_size = totlen + 12;
     // std::cout << "CM Size " << cm_size << std::endl;
-    if( ( cm = (int *)Gcalloc(cm_size, sizeof( int ), 0) ) == ITK_NULLPTR )
+    if( ( ctx->cm = (int *)Gcalloc(ctx, ctx->cm_size, sizeof( int ), 0) ) == ITK_NULLPTR )
       {
-      error_msg("Memory error.\n", __LINE__); return 1;
+      error_msg(ctx, "Memory error.\n", __LINE__); return 1;
       }
 
     /* initialize voxel status */
-    if( status == ITK_NULLPTR )  /* might have already calloced it above ... */
+    if( ctx->status == ITK_NULLPTR )  /* might have already calloced it above ... */
       {
-      if( ( status = (int *)Gcalloc(totlen, sizeof( int ), 0) ) == ITK_NULLPTR )
+      if( ( ctx->status = (int *)Gcalloc(ctx, totlen, sizeof( int ), 0) ) == ITK_NULLPTR )
         {
-        error_msg("Memory error.\n", __LINE__); return 1;
+        error_msg(ctx, "Memory error.\n", __LINE__); return 1;
         }
       }
     for( i = 0; i < totlen; i++ )
       {
-      status[i] = ( zpic[i] == g0->cut_loops ) ? 0 : 3; /* 3 if not wanted
+      ctx->status[i] = ( ctx->zpic[i] == g0->cut_loops ) ? 0 : 3; /* 3 if not wanted
                                                           component */
       }
     // std::cout << "RESET STATUS" << std::endl;
     /* set status of double boundary to 4 */
-    for( i = 0; i < img_horiz; i++ )
+    for( i = 0; i < ctx->img_horiz; i++ )
       {
-      for( j = 0; j < img_vert; j++ )
+      for( j = 0; j < ctx->img_vert; j++ )
         {
-        status[sub2ind(i, j, 0, img_horiz, img_vert)] = 4;
-        status[sub2ind(i, j, img_depth - 1, img_horiz, img_vert)] = 4;
+        ctx->status[sub2ind(i, j, 0, ctx->img_horiz, ctx->img_vert)] = 4;
+        ctx->status[sub2ind(i, j, ctx->img_depth - 1, ctx->img_horiz, ctx->img_vert)] = 4;
         }
       }
-    for( i = 0; i < img_horiz; i++ )
+    for( i = 0; i < ctx->img_horiz; i++ )
       {
-      for( j = 0; j < img_depth; j++ )
+      for( j = 0; j < ctx->img_depth; j++ )
         {
-        status[sub2ind(i, 0, j, img_horiz, img_vert)] = 4;
-        status[sub2ind(i, img_vert - 1, j, img_horiz, img_vert)] = 4;
+        ctx->status[sub2ind(i, 0, j, ctx->img_horiz, ctx->img_vert)] = 4;
+        ctx->status[sub2ind(i, ctx->img_vert - 1, j, ctx->img_horiz, ctx->img_vert)] = 4;
         }
       }
-    for( i = 0; i < img_vert; i++ )
+    for( i = 0; i < ctx->img_vert; i++ )
       {
-      for( j = 0; j < img_depth; j++ )
+      for( j = 0; j < ctx->img_depth; j++ )
         {
-        status[sub2ind(0, i, j, img_horiz, img_vert)] = 4;
-        status[sub2ind(img_horiz - 1, i, j, img_horiz, img_vert)] = 4;
+        ctx->status[sub2ind(0, i, j, ctx->img_horiz, ctx->img_vert)] = 4;
+        ctx->status[sub2ind(ctx->img_horiz - 1, i, j, ctx->img_horiz, ctx->img_vert)] = 4;
         }
       }
     /* set fzpic of single boundary to fzpicmax */
-    for( i = 1; i < img_horiz - 1; i++ )
+    for( i = 1; i < ctx->img_horiz - 1; i++ )
       {
-      for( j = 1; j < img_vert - 1; j++ )
+      for( j = 1; j < ctx->img_vert - 1; j++ )
         {
-        fzpic[sub2ind(i, j, 1, img_horiz, img_vert)] = fzpicmax;
-        fzpic[sub2ind(i, j, img_depth - 2, img_horiz, img_vert)] = fzpicmax;
+        ctx->fzpic[sub2ind(i, j, 1, ctx->img_horiz, ctx->img_vert)] = ctx->fzpicmax;
+        ctx->fzpic[sub2ind(i, j, ctx->img_depth - 2, ctx->img_horiz, ctx->img_vert)] = ctx->fzpicmax;
         }
       }
-    for( i = 1; i < img_horiz - 1; i++ )
+    for( i = 1; i < ctx->img_horiz - 1; i++ )
       {
-      for( j = 1; j < img_depth - 1; j++ )
+      for( j = 1; j < ctx->img_depth - 1; j++ )
         {
-        fzpic[sub2ind(i, 1, j, img_horiz, img_vert)] = fzpicmax;
-        fzpic[sub2ind(i, img_vert - 2, j, img_horiz, img_vert)] = fzpicmax;
+        ctx->fzpic[sub2ind(i, 1, j, ctx->img_horiz, ctx->img_vert)] = ctx->fzpicmax;
+        ctx->fzpic[sub2ind(i, ctx->img_vert - 2, j, ctx->img_horiz, ctx->img_vert)] = ctx->fzpicmax;
         }
       }
-    for( i = 1; i < img_vert - 1; i++ )
+    for( i = 1; i < ctx->img_vert - 1; i++ )
       {
-      for( j = 1; j < img_depth - 1; j++ )
+      for( j = 1; j < ctx->img_depth - 1; j++ )
         {
-        fzpic[sub2ind(1, i, j, img_horiz, img_vert)] = fzpicmax;
-        fzpic[sub2ind(img_horiz - 2, i, j, img_horiz, img_vert)] = fzpicmax;
+        ctx->fzpic[sub2ind(1, i, j, ctx->img_horiz, ctx->img_vert)] = ctx->fzpicmax;
+        ctx->fzpic[sub2ind(ctx->img_horiz - 2, i, j, ctx->img_horiz, ctx->img_vert)] = ctx->fzpicmax;
         }
       }
     } /* if (!(g0->any_genus)) */
   else
     {
-    if( que != ITK_NULLPTR )
+    if( ctx->que != ITK_NULLPTR )
       {
-      Gfree(que);              /* don't need the que if not doing topology
+      Gfree(ctx, ctx->que);              /* don't need the que if not doing topology
                                  correction */
       }
     }
   return 0;    /* no error */
 }
 
-static int truecm(int st) /* return true component, set cm[st] to true comp */
+static int truecm(genus0context *ctx, int st) /* return true component, set cm[st] to true comp */
 {
   int s0, s1;
 
   // std::cout << std::endl << "In True CM " << st << " " << cm[st] <<
   // std::endl;
-  if( cm[st] != st )
+  if( ctx->cm[st] != st )
     {
     s0 = st;
     // std::cout << "S0 " << s0 << std::endl;
-    while( cm[st] != st )
+    while( ctx->cm[st] != st )
       {
-      st = cm[st];
+      st = ctx->cm[st];
       // std::cout << "While Loop 1 " << st << std::endl;
       }
 
-    while( cm[s0] != st )
+    while( ctx->cm[s0] != st )
       {
-      s1 = cm[s0]; cm[s0] = st; s0 = s1;             /*std::cout << "While loop
+      s1 = ctx->cm[s0]; ctx->cm[s0] = st; s0 = s1;             /*std::cout << "While loop
                                                        2 " << s0 <<
                                                        std::endl;*/
       }
@@ -1225,16 +1240,16 @@ static int truecm(int st) /* return true component, set cm[st] to true comp */
   return st;
 }
 
-static int truecmvx(int vx) /* return true component of voxel */
+static int truecmvx(genus0context *ctx, int vx) /* return true component of voxel */
 {
-  return status[vx] = truecm(status[vx]);
+  return ctx->status[vx] = truecm(ctx, ctx->status[vx]);
 }
 
-static int test18(int qqp, int *nc)
+static int test18(genus0context *ctx, int qqp, int *nc)
 {
   int        elQqpj, stqqpn, i, j, ec_count = 0, ec[27], found_another = 1;
   int        st[19], Que_len, Que_pos, Que[27], Qqp;
-  static int idx[18] = {1, 3, 4, 5, 7, 9, 10, 11, 12, 14, 15, 16, 17, 19, 21, 22, 23, 25};
+  static const int idx[18] = {1, 3, 4, 5, 7, 9, 10, 11, 12, 14, 15, 16, 17, 19, 21, 22, 23, 25};
 
   for( i = 0; i < 27; i++ )
     {
@@ -1242,12 +1257,12 @@ static int test18(int qqp, int *nc)
     }
   for( i = 0; i < 18; i++ )  /* for each 18 neighbor */
     {
-    if( status[qqp + nbrs18[i]] > 10 )  /* if nbr is in an Mcubes component */
+    if( ctx->status[qqp + ctx->nbrs18[i]] > 10 )  /* if nbr is in an Mcubes component */
       {
       if( !ec[idx[i]] )  /* if not assigned an edge component */
         {
         /* create new edge component */
-        stqqpn = truecmvx(qqp + nbrs18[i]);
+        stqqpn = truecmvx(ctx, qqp + ctx->nbrs18[i]);
         st[++ec_count] = stqqpn; /* remember the status associated with the new
                                    component */
 
@@ -1258,10 +1273,10 @@ static int test18(int qqp, int *nc)
         while( Que_pos < Que_len )
           {
           Qqp = Que[Que_pos];
-          for( j = 1; j <= elist18[Qqp][0]; j++ )  /* for each nbr of Qqp */
+          for( j = 1; j <= ctx->elist18[Qqp][0]; j++ )  /* for each nbr of Qqp */
             {
-            elQqpj = elist18[Qqp][j];
-            if( ( status[qqp + offs[elQqpj]] > 10 ) && ( !ec[elQqpj] ) )
+            elQqpj = ctx->elist18[Qqp][j];
+            if( ( ctx->status[qqp + ctx->offs[elQqpj]] > 10 ) && ( !ec[elQqpj] ) )
               {
               ec[Que[Que_len++] = elQqpj] = ec_count; /* add nbr to que */
               }
@@ -1287,53 +1302,53 @@ static int test18(int qqp, int *nc)
   return found_another;
 }
 
-static int test6(int qqp, int *nc)
+static int test6(genus0context *ctx, int qqp, int *nc)
 {
   int        elQqpj, stqqpn, i, j, ec_count = 0, ec[27], found_another = 1;
   int        st[7], Que_len, Que_pos, Que[27], Qqp;
-  static int idx[6] = {12, 14, 10, 16, 4, 22};
+  static const int idx[6] = {12, 14, 10, 16, 4, 22};
 
   for( i = 0; i < 27; i++ )
     {
     ec[i] = 0;
     }
 
-  pass[1] = pass[3] = pass[5] = pass[7] = pass[9] = pass[11] = pass[15] = pass[17]
-                  = pass[19] = pass[21] = pass[23]
-                          = pass[25] = 0;
-  if( status[qqp + offs[4]] > 10 )
+  ctx->pass[1] = ctx->pass[3] = ctx->pass[5] = ctx->pass[7] = ctx->pass[9] = ctx->pass[11] = ctx->pass[15] = ctx->pass[17]
+                  = ctx->pass[19] = ctx->pass[21] = ctx->pass[23]
+                          = ctx->pass[25] = 0;
+  if( ctx->status[qqp + ctx->offs[4]] > 10 )
     {
-    pass[1] = pass[3] = pass[5] = pass[7] = 1;
+    ctx->pass[1] = ctx->pass[3] = ctx->pass[5] = ctx->pass[7] = 1;
     }
-  if( status[qqp + offs[10]] > 10 )
+  if( ctx->status[qqp + ctx->offs[10]] > 10 )
     {
-    pass[1] = pass[9] = pass[11] = pass[19] = 1;
+    ctx->pass[1] = ctx->pass[9] = ctx->pass[11] = ctx->pass[19] = 1;
     }
-  if( status[qqp + offs[12]] > 10 )
+  if( ctx->status[qqp + ctx->offs[12]] > 10 )
     {
-    pass[3] = pass[9] = pass[15] = pass[21] = 1;
+    ctx->pass[3] = ctx->pass[9] = ctx->pass[15] = ctx->pass[21] = 1;
     }
-  if( status[qqp + offs[14]] > 10 )
+  if( ctx->status[qqp + ctx->offs[14]] > 10 )
     {
-    pass[5] = pass[11] = pass[17] = pass[23] = 1;
+    ctx->pass[5] = ctx->pass[11] = ctx->pass[17] = ctx->pass[23] = 1;
     }
-  if( status[qqp + offs[16]] > 10 )
+  if( ctx->status[qqp + ctx->offs[16]] > 10 )
     {
-    pass[7] = pass[15] = pass[17] = pass[25] = 1;
+    ctx->pass[7] = ctx->pass[15] = ctx->pass[17] = ctx->pass[25] = 1;
     }
-  if( status[qqp + offs[22]] > 10 )
+  if( ctx->status[qqp + ctx->offs[22]] > 10 )
     {
-    pass[19] = pass[21] = pass[23] = pass[25] = 1;
+    ctx->pass[19] = ctx->pass[21] = ctx->pass[23] = ctx->pass[25] = 1;
     }
   for( i = 0; i < 6; i++ )  /* for each neighbor */
     {
-    if( status[qqp + nbrs[i]] > 10 )  /* if nbr is in an Mcubes component */
+    if( ctx->status[qqp + ctx->nbrs[i]] > 10 )  /* if nbr is in an Mcubes component */
       {
       if( !ec[idx[i]] )  /* if not assigned an edge component */
         {
         /* create new edge component */
 
-        stqqpn = truecmvx(qqp + nbrs[i]);
+        stqqpn = truecmvx(ctx, qqp + ctx->nbrs[i]);
         st[++ec_count] = stqqpn; /* remember the status associated with the new
                                    component */
 
@@ -1344,10 +1359,10 @@ static int test6(int qqp, int *nc)
         while( Que_pos < Que_len )
           {
           Qqp = Que[Que_pos];
-          for( j = 1; j <= elist[Qqp][0]; j++ )  /* for each nbr of Qqp */
+          for( j = 1; j <= ctx->elist[Qqp][0]; j++ )  /* for each nbr of Qqp */
             {
-            elQqpj = elist[Qqp][j];
-            if( ( status[qqp + offs[elQqpj]] > 10 ) && ( !ec[elQqpj] ) && pass[elQqpj] )
+            elQqpj = ctx->elist[Qqp][j];
+            if( ( ctx->status[qqp + ctx->offs[elQqpj]] > 10 ) && ( !ec[elQqpj] ) && ctx->pass[elQqpj] )
               {
               ec[Que[Que_len++] = elQqpj] = ec_count; /* add nbr to que */
               }
@@ -1372,29 +1387,29 @@ static int test6(int qqp, int *nc)
   return found_another;
 }
 
-static int cmtostat(void)
+static int cmtostat(genus0context *ctx)
 {
   int  j, i, *cmremap = ITK_NULLPTR, *ccount = ITK_NULLPTR, totlen;
   char msg[200];
 
   // std::cout << "COUNT SIZE " << comp_count << std::endl;
-  if( ( cmremap = (int *)Gcalloc(comp_count + 1, sizeof( int ), 0) ) == ITK_NULLPTR )
+  if( ( cmremap = (int *)Gcalloc(ctx, ctx->comp_count + 1, sizeof( int ), 0) ) == ITK_NULLPTR )
     {
-    error_msg("Memory error.\n", __LINE__); return 1;
+    error_msg(ctx, "Memory error.\n", __LINE__); return 1;
     }
-  if( ( ccount = (int *)Gcalloc(comp_count + 1, sizeof( int ), 0) ) == ITK_NULLPTR )
+  if( ( ccount = (int *)Gcalloc(ctx, ctx->comp_count + 1, sizeof( int ), 0) ) == ITK_NULLPTR )
     {
-    error_msg("Memory error.\n", __LINE__); return 1;
+    error_msg(ctx, "Memory error.\n", __LINE__); return 1;
     }
   // std::cout << "Input comp_count " << comp_count << std::endl;
-  for( i = 11; i <= comp_count; i++ )
+  for( i = 11; i <= ctx->comp_count; i++ )
     {
-    ccount[truecm(i)]++;
+    ccount[truecm(ctx, i)]++;
     // std::cout << i << " TRUE CM " << truecm(i);
     // std::cout << " CCOUNT " << ccount[truecm(i)] << std::endl;
     }
   j = 10;
-  for( i = 11; i <= comp_count; i++ )
+  for( i = 11; i <= ctx->comp_count; i++ )
     {
     if( ccount[i] )
       {
@@ -1406,106 +1421,106 @@ static int cmtostat(void)
       // std::cout << " cmremap " << cmremap[i] << std::endl;
       }
     }
-  totlen = img_horiz * img_vert * img_depth;
+  totlen = ctx->img_horiz * ctx->img_vert * ctx->img_depth;
   for( i = 0; i < totlen; i++ )
     {
-    if( status[i] > 10 )
+    if( ctx->status[i] > 10 )
       {
       // std::cout << "Set Status I " << i << " " << status[i] << " " <<
       // cm[status[i]] << " " << cmremap[cm[status[i]]] << std::endl;
-      status[i] = cmremap[cm[status[i]]];
+      ctx->status[i] = cmremap[ctx->cm[ctx->status[i]]];
       }
     }
-  if( verbose )
+  if( ctx->verbose )
     {
-    sprintf(msg, "Components reduced from %u to %u.\n", comp_count - 10, j - 10);
+    sprintf(msg, "Components reduced from %u to %u.\n", ctx->comp_count - 10, j - 10);
     print_msg(msg);
     }
-  comp_count = j;
+  ctx->comp_count = j;
   // std::cout << "Set comp_count " << comp_count << std::endl;
-  for( i = 11; i <= comp_count; i++ )
+  for( i = 11; i <= ctx->comp_count; i++ )
     {
-    cm[i] = i;
+    ctx->cm[i] = i;
     }
-  Gfree(cmremap);
-  Gfree(ccount);
+  Gfree(ctx, cmremap);
+  Gfree(ctx, ccount);
   return 0;
 }
 
-static void find_component(int level)
+static void find_component(genus0context *ctx, int level)
 {
   int i, qqp, qqpni, vox, nc;
   int found_another, *nbrs0, totlen;
 
-  int   ( *test )(int, int *);
+  int   ( *test )(genus0context *, int, int *);
   float flevel;
   int   theconnectivity;
 
   // std::cout << "find_component: " << level << std::endl;
-  if( cut_loops )
+  if( ctx->cut_loops )
     {
-    theconnectivity = connectivity;
+    theconnectivity = ctx->connectivity;
     }
   else
     {
-    theconnectivity = invconnectivity;
+    theconnectivity = ctx->invconnectivity;
     }
 
-  totlen = img_horiz * img_vert * img_depth;
-  nbrs0 = nbrs; test = test6;
+  totlen = ctx->img_horiz * ctx->img_vert * ctx->img_depth;
+  nbrs0 = ctx->nbrs; test = test6;
 
   // std::cout << "totlen: " << totlen << std::endl;
   // std::cout << "theconnectivity: " << theconnectivity << std::endl;
 
   if( theconnectivity == 18 )
     {
-    nbrs0 = nbrs18; test = test18;
+    nbrs0 = ctx->nbrs18; test = test18;
     }
 
-  flevel = ( level - 1.0 ) / ( maxlevels - 1.0 ) * fzpicmax;
+  flevel = ( level - 1.0 ) / ( ctx->maxlevels - 1.0 ) * ctx->fzpicmax;
   // std::cout << "flevel: " << flevel << std::endl;
   for( vox = 0; vox < totlen; vox++ )
     {
     /* if level good and voxel unprocessed */
-    if( ( fzpic[vox] >= flevel ) && ( status[vox] == 0 ) )
+    if( ( ctx->fzpic[vox] >= flevel ) && ( ctx->status[vox] == 0 ) )
       {
-      que_len = que_pos = 0;
-      que[que_len] = vox; /* add it to que */
-      que_len++; if( que_len == que_size )
+      ctx->que_len = ctx->que_pos = 0;
+      ctx->que[ctx->que_len] = vox; /* add it to que */
+      ctx->que_len++; if( ctx->que_len == ctx->que_size )
         {
-        que_len = 0;
+        ctx->que_len = 0;
         }
-      status[vox] = 2; /* mark as on que */
-      while( que_pos != que_len )
+      ctx->status[vox] = 2; /* mark as on que */
+      while( ctx->que_pos != ctx->que_len )
         {
-        qqp = que[que_pos];
+        qqp = ctx->que[ctx->que_pos];
         /* check if can add */
         nc = 0;
-        found_another = test(qqp, &nc);
+        found_another = test(ctx, qqp, &nc);
         /* if you can, add it, and combine components if needed */
         if( found_another )
           {
           if( nc == 0 )  /* if no neighboring component */
             {
-            comp_count++;
-            cm[comp_count] = comp_count;
-            status[qqp] = comp_count;
+            ctx->comp_count++;
+            ctx->cm[ctx->comp_count] = ctx->comp_count;
+            ctx->status[qqp] = ctx->comp_count;
             // std::cout << "QQP Status " << qqp << " " << comp_count <<
             // std::endl;
             }
           else
             {
-            status[qqp] = nc; /* there was this true component nc */
+            ctx->status[qqp] = nc; /* there was this true component nc */
             for( i = 0; i < theconnectivity; i++ )
               {
               qqpni = qqp + nbrs0[i];   /* for each nbr */
-              if( status[qqpni] > 10 )  /* if part of a component */
+              if( ctx->status[qqpni] > 10 )  /* if part of a component */
                 {
-                if( truecmvx(qqpni) != nc )  /* if not the same component as qqp
+                if( truecmvx(ctx, qqpni) != nc )  /* if not the same component as qqp
                                                */
                   {
-                  cm[status[qqpni]] = nc;
-                  status[qqpni] = nc;
+                  ctx->cm[ctx->status[qqpni]] = nc;
+                  ctx->status[qqpni] = nc;
                   // std::cout << "QQPNI Status " << qqpni << " " <<
                   // status[qqpni] << std::endl;
                   }
@@ -1516,25 +1531,25 @@ static void find_component(int level)
           for( i = 0; i < theconnectivity; i++ )
             {
             qqpni = qqp + nbrs0[i];
-            if( ( fzpic[qqpni] >= flevel ) && ( status[qqpni] == 0 ) )
+            if( ( ctx->fzpic[qqpni] >= flevel ) && ( ctx->status[qqpni] == 0 ) )
               {
-              que[que_len] = qqpni; /* add it to que */
-              que_len++; if( que_len == que_size )
+              ctx->que[ctx->que_len] = qqpni; /* add it to que */
+              ctx->que_len++; if( ctx->que_len == ctx->que_size )
                 {
-                que_len = 0;
+                ctx->que_len = 0;
                 }
-              status[qqpni] = 2; /* mark as on que */
+              ctx->status[qqpni] = 2; /* mark as on que */
               }
             } /* for i */
           }   /* if found another */
         else
           {
-          status[qqp] = 0;
+          ctx->status[qqp] = 0;
           }
         /* move to next point in que */
-        que_pos++; if( que_pos == que_size )
+        ctx->que_pos++; if( ctx->que_pos == ctx->que_size )
           {
-          que_pos = 0;
+          ctx->que_pos = 0;
           }
         } /* while que not empty */
 
@@ -1542,7 +1557,7 @@ static void find_component(int level)
     }   /* end for vox */
 }       /* end find_component */
 
-static int GetSurf(unsigned char *J, unsigned char val, int *dims, int _connectivity,
+static int GetSurf(genus0context *ctx, unsigned char *J, unsigned char val, int *dims, int _connectivity,
                    int * *Tris, float * *Verts, int *Tri_count, int *Vert_count, genus0parameters *g0)
 {
   unsigned char *_status, *cidx, *pidx;
@@ -1611,16 +1626,16 @@ static int GetSurf(unsigned char *J, unsigned char val, int *dims, int _connecti
   cells = id1 * cellplane;
   cellplanem[0] = 0; cellplanem[1] = cellplane; cellplanem[2] = ( cellplane << 1 );
 
-  v_idx = (int *)Gcalloc(cellplane * 3 * 2, sizeof( int ), 0);
+  v_idx = (int *)Gcalloc(ctx, cellplane * 3 * 2, sizeof( int ), 0);
   if( v_idx == ITK_NULLPTR )
     {
-    error_msg("Memory error.\n", __LINE__); return 1;
+    error_msg(ctx, "Memory error.\n", __LINE__); return 1;
     }
 
-  _status = (unsigned char *)Gcalloc(cells, sizeof( unsigned char ), 0);
+  _status = (unsigned char *)Gcalloc(ctx, cells, sizeof( unsigned char ), 0);
   if( _status == ITK_NULLPTR )
     {
-    error_msg("Memory error.\n", __LINE__); return 1;
+    error_msg(ctx, "Memory error.\n", __LINE__); return 1;
     }
   // std::cout << "Cells: " << cells << std::endl;
   // std::cout << "cellplane: " << cellplane << std::endl;
@@ -1715,16 +1730,16 @@ static int GetSurf(unsigned char *J, unsigned char val, int *dims, int _connecti
   vert_count_times2 = vert_count * 2; /* just twice vert_count */
 
   /* allocate memory for tris and verts */
-  tris = (int *)Gcalloc(tri_count * 3, sizeof( int ), g0->return_surface);
+  tris = (int *)Gcalloc(ctx, tri_count * 3, sizeof( int ), g0->return_surface);
   if( tris == ITK_NULLPTR )
     {
-    error_msg("Memory error.\n", __LINE__); return 1;
+    error_msg(ctx, "Memory error.\n", __LINE__); return 1;
     }
 
-  verts = (float *)Gcalloc(vert_count * 3, sizeof( float ), g0->return_surface);
+  verts = (float *)Gcalloc(ctx, vert_count * 3, sizeof( float ), g0->return_surface);
   if( verts == ITK_NULLPTR )
     {
-    error_msg("Memory error.\n", __LINE__); return 1;
+    error_msg(ctx, "Memory error.\n", __LINE__); return 1;
     }
 
   *Tris = tris;
@@ -1811,17 +1826,17 @@ static int GetSurf(unsigned char *J, unsigned char val, int *dims, int _connecti
 
   if( _status != ITK_NULLPTR )
     {
-    Gfree(_status);
+    Gfree(ctx, _status);
     }
   if( v_idx != ITK_NULLPTR )
     {
-    Gfree(v_idx);
+    Gfree(ctx, v_idx);
     }
 
   return 0;    /* return with success _status */
 } /*end!*/
 
-static int big_component(int *Tris, float *Verts, int *Vert_count, int *Tri_count)
+static int big_component(genus0context *ctx, int *Tris, float *Verts, int *Vert_count, int *Tri_count)
 {
   int    ov, ot, tri_count, vert_count, *v_count, *tp, *v_ran, *v_idx, u0, v0, i, j, *tris, w;
   int *  _que, _que_pos, _que_len, *component, _comp_count, *c_count, tc[3], k, qqp, vt, *tr;
@@ -1833,14 +1848,14 @@ static int big_component(int *Tris, float *Verts, int *Vert_count, int *Tri_coun
   tris = Tris;
   verts = Verts;
 
-  if( verbose )
+  if( ctx->verbose )
     {
     print_msg("Extracting component with largest number of vertices...\n");
     }
 
-  if( ( v_count = (int *)Gcalloc(vert_count, sizeof( int ), 0) ) == ITK_NULLPTR )
+  if( ( v_count = (int *)Gcalloc(ctx, vert_count, sizeof( int ), 0) ) == ITK_NULLPTR )
     {
-    error_msg("Memory error.\n", __LINE__); return 1;
+    error_msg(ctx, "Memory error.\n", __LINE__); return 1;
     }
 
   tp = tris;
@@ -1851,9 +1866,9 @@ static int big_component(int *Tris, float *Verts, int *Vert_count, int *Tri_coun
     v_count[*( tp++ )]++;
     }
 
-  if( ( v_ran = (int *)Gcalloc(vert_count + 1, sizeof( int ), 0) ) == ITK_NULLPTR )
+  if( ( v_ran = (int *)Gcalloc(ctx, vert_count + 1, sizeof( int ), 0) ) == ITK_NULLPTR )
     {
-    error_msg("Memory error.\n", __LINE__); return 1;
+    error_msg(ctx, "Memory error.\n", __LINE__); return 1;
     }
 
   v_ran[0] = 0;
@@ -1863,9 +1878,9 @@ static int big_component(int *Tris, float *Verts, int *Vert_count, int *Tri_coun
     v_count[i] = 0;
     }
 
-  if( ( v_idx = (int *)Gcalloc(v_ran[vert_count], sizeof( int ), 0) ) == ITK_NULLPTR )
+  if( ( v_idx = (int *)Gcalloc(ctx, v_ran[vert_count], sizeof( int ), 0) ) == ITK_NULLPTR )
     {
-    error_msg("Memory error.\n", __LINE__); return 1;
+    error_msg(ctx, "Memory error.\n", __LINE__); return 1;
     }
 
   tp = tris;
@@ -1886,9 +1901,9 @@ static int big_component(int *Tris, float *Verts, int *Vert_count, int *Tri_coun
     component[i] = 0;
     }
 
-  if( ( _que = (int *)Gcalloc(vert_count, sizeof( int ), 0) ) == ITK_NULLPTR )
+  if( ( _que = (int *)Gcalloc(ctx, vert_count, sizeof( int ), 0) ) == ITK_NULLPTR )
     {
-    error_msg("Memory error.\n", __LINE__); return 1;
+    error_msg(ctx, "Memory error.\n", __LINE__); return 1;
     }
 
   tc[0] = 0; tc[1] = tri_count; tc[2] = tri_count * 2;
@@ -1925,9 +1940,9 @@ static int big_component(int *Tris, float *Verts, int *Vert_count, int *Tri_coun
 
   if( _comp_count > 1 )
     {
-    if( ( c_count = (int *)Gcalloc(1 + _comp_count, sizeof( int ), 0) ) == ITK_NULLPTR )
+    if( ( c_count = (int *)Gcalloc(ctx, 1 + _comp_count, sizeof( int ), 0) ) == ITK_NULLPTR )
       {
-      error_msg("Memory error.\n", __LINE__); return 1;
+      error_msg(ctx, "Memory error.\n", __LINE__); return 1;
       }
     for( i = 0; i < vert_count; i++ )
       {
@@ -1942,7 +1957,7 @@ static int big_component(int *Tris, float *Verts, int *Vert_count, int *Tri_coun
         j = i; k = c_count[i];
         }
       }
-    Gfree(c_count);
+    Gfree(ctx, c_count);
 
     k = j; /* k is number of largest component */
     j = 0;
@@ -2006,15 +2021,15 @@ static int big_component(int *Tris, float *Verts, int *Vert_count, int *Tri_coun
   *Vert_count = vert_count;
   *Tri_count = tri_count;
 
-  Gfree(_que);
-  Gfree(v_count);
-  Gfree(v_ran);
-  Gfree(v_idx);
+  Gfree(ctx, _que);
+  Gfree(ctx, v_count);
+  Gfree(ctx, v_ran);
+  Gfree(ctx, v_idx);
 
   return 0;
 }
 
-static int save_image(genus0parameters *g0)
+static int save_image(genus0context *ctx, genus0parameters *g0)
 {
   int             i, j, k, totlen, h, h1, sti;
   int *           pad, dims[3], origlen, vo[3];
@@ -2024,42 +2039,42 @@ static int save_image(genus0parameters *g0)
   float *         m, *verts, hv[3];
 
   pad = g0->pad;
-  totlen = img_horiz * img_vert * img_depth;
+  totlen = ctx->img_horiz * ctx->img_vert * ctx->img_depth;
 
   if( !( g0->any_genus ) )  /* if we made topological corrections */
     {
     j = 0;
     for( i = 0; i < totlen; i++ )
       {
-      zp = zpic[i];                                    /* original zpic value */
-      sti = ( status[i] <= 10 );                       /* not part of a
+      zp = ctx->zpic[i];                                    /* original zpic value */
+      sti = ( ctx->status[i] <= 10 );                       /* not part of a
                                                          component */
-      zpic[i] = ( g0->cut_loops ) ? ( 1 - sti ) : sti; /* switch to complement
+      ctx->zpic[i] = ( g0->cut_loops ) ? ( 1 - sti ) : sti; /* switch to complement
                                                          */
-      if( ( zp == g0->cut_loops ) && ( status[i] <= 10 ) && ( status[i] != 4 ) )
+      if( ( zp == g0->cut_loops ) && ( ctx->status[i] <= 10 ) && ( ctx->status[i] != 4 ) )
         {
         // std::cout << "Modify " << i << " zp : " << zp << " sti: " << sti << "
         // zpic[i] " << (int)(zpic[i]) << std::endl;
-        status[i] = 1; /* we wanted this one */
+        ctx->status[i] = 1; /* we wanted this one */
         j++;
         }
       else
         {
-        status[i] = 0;
+        ctx->status[i] = 0;
         }
       }
-    if( verbose )
+    if( ctx->verbose )
       {
       sprintf(msg, "Made %d adjustments.\n", j); print_msg(msg);
       }
-    Gfree(que);
-    Gfree(cm);
-    Gfree(fzpic);
+    Gfree(ctx, ctx->que);
+    Gfree(ctx, ctx->cm);
+    Gfree(ctx, ctx->fzpic);
     }
 
   /* Get the surface ! */
-  dims[0] = img_horiz; dims[1] = img_vert; dims[2] = img_depth;
-  if( GetSurf(zpic, 1, dims, g0->connectivity,
+  dims[0] = ctx->img_horiz; dims[1] = ctx->img_vert; dims[2] = ctx->img_depth;
+  if( GetSurf(ctx, ctx->zpic, 1, dims, g0->connectivity,
               &( g0->triangles ), &( g0->vertices ),
               &( g0->tri_count ), &( g0->vert_count ), g0) )
     {
@@ -2071,9 +2086,9 @@ static int save_image(genus0parameters *g0)
     {
     if( ( g0->tri_count > 0 ) && ( g0->vert_count > 0 ) )
       {
-      if( big_component( g0->triangles, g0->vertices, &( g0->vert_count ), &( g0->tri_count ) ) )
+      if( big_component(ctx, g0->triangles, g0->vertices, &( g0->vert_count ), &( g0->tri_count ) ) )
         {
-        error_msg("Error getting surface components.\n", __LINE__); return 1;
+        error_msg(ctx, "Error getting surface components.\n", __LINE__); return 1;
         }
       }
     }
@@ -2084,9 +2099,9 @@ static int save_image(genus0parameters *g0)
     origlen = ( g0->dims[0] ) * ( g0->dims[1] ) * ( g0->dims[2] );
     if( output == ITK_NULLPTR )  /* they didn't allocate.  So we need to */
       {
-      if( ( output = (unsigned short *)Gcalloc(origlen, sizeof( unsigned short ), 1) ) == ITK_NULLPTR )
+      if( ( output = (unsigned short *)Gcalloc(ctx, origlen, sizeof( unsigned short ), 1) ) == ITK_NULLPTR )
         {
-        error_msg("Memory error.\n", __LINE__); return 1;
+        error_msg(ctx, "Memory error.\n", __LINE__); return 1;
         }
       g0->calloced_output = 1;
       }
@@ -2098,15 +2113,15 @@ static int save_image(genus0parameters *g0)
       }
     if( !( g0->any_genus ) )
       {
-      for( k = 0; k < ( img_depth - pad[2] * 2 ); k++ )
+      for( k = 0; k < ( ctx->img_depth - pad[2] * 2 ); k++ )
         {
-        for( j = 0; j < ( img_vert - pad[1] * 2 ); j++ )
+        for( j = 0; j < ( ctx->img_vert - pad[1] * 2 ); j++ )
           {
-          for( i = 0; i < ( img_horiz - pad[0] * 2 ); i++ )
+          for( i = 0; i < ( ctx->img_horiz - pad[0] * 2 ); i++ )
             {
-            h1 = sub2ind(pad[0] + i, pad[1] + j, pad[2] + k, img_horiz, img_vert);
-            h = sub2ind(autocrop[0][0] + i, autocrop[1][0] + j, autocrop[2][0] + k, g0->dims[0], g0->dims[1]);
-            if( status[h1] )
+            h1 = sub2ind(pad[0] + i, pad[1] + j, pad[2] + k, ctx->img_horiz, ctx->img_vert);
+            h = sub2ind(ctx->autocrop[0][0] + i, ctx->autocrop[1][0] + j, ctx->autocrop[2][0] + k, g0->dims[0], g0->dims[1]);
+            if( ctx->status[h1] )
               {
               output[h] = g0->alt_value;
               }
@@ -2141,13 +2156,13 @@ static int save_image(genus0parameters *g0)
         }
       i = sub2ind(pos[0], pos[1], pos[2], dims[0], dims[1]); /* index into zpic
                                                                */
-      if( zpic[i] == 0 )
+      if( ctx->zpic[i] == 0 )
         {
         pos[j]++;               /* subscript into boundary voxel of zpic */
         }
       for( i = 0; i < 3; i++ )
         {
-        pos[i] += autocrop[i][0] - pad[i];             /* subscript into
+        pos[i] += ctx->autocrop[i][0] - pad[i];             /* subscript into
                                                          boundary voxel of input
                                                          */
         }
@@ -2162,7 +2177,7 @@ static int save_image(genus0parameters *g0)
     {
     for( i = 0; i < 3; i++ )
       {
-      verts[h + vo[i]] += autocrop[i][0] - pad[i];
+      verts[h + vo[i]] += ctx->autocrop[i][0] - pad[i];
       }
     }
 
@@ -2181,19 +2196,19 @@ static int save_image(genus0parameters *g0)
       }
     }
 
-  Gfree(zpic);
+  Gfree(ctx, ctx->zpic);
   if( !( g0->any_genus ) )
     {
-    Gfree(status);
+    Gfree(ctx, ctx->status);
     }
   if( !( g0->return_surface ) )  /* don't return surface if they didn't want it
                                    */
     {
-    Gfree(g0->vertices); g0->vertices = ITK_NULLPTR;
-    Gfree(g0->triangles); g0->triangles = ITK_NULLPTR;
+    Gfree(ctx, g0->vertices); g0->vertices = ITK_NULLPTR;
+    Gfree(ctx, g0->triangles); g0->triangles = ITK_NULLPTR;
     }
 
-  if( verbose )
+  if( ctx->verbose )
     {
     sprintf(msg, "Vertices: %d  Triangles: %d\n", g0->vert_count, g0->tri_count);
     print_msg(msg);
@@ -2228,51 +2243,63 @@ extern void genus0init(genus0parameters *g0)
   g0->calloced_output = 0; /* private */
 }
 
+static void genus0contextinit(genus0context *ctx)
+{
+  memset(ctx, 0, sizeof( genus0context ) );
+  ctx->comp_count = 10;
+  ctx->arena.blocks = ITK_NULLPTR;
+  ctx->arena.persist = ITK_NULLPTR;
+  ctx->arena.count = 0;
+  ctx->arena.capacity = 32;
+}
+
 extern int genus0(genus0parameters *g0)
 {
-  int thistenth, lasttenth, level;
+  int           thistenth, lasttenth, level;
+  genus0context ctx[1]; /* working state of this call only */
 
-  if( set_up(g0) )
+  genus0contextinit(ctx);
+  if( set_up(ctx, g0) )
     {
-    Gfree_all(0); return 1;
+    Gfree_all(ctx, 0); return 1;
     }
   if( !( g0->any_genus ) )
     {
-    if( verbose )
+    if( ctx->verbose )
       {
       printf("Starting main process...\n");
       }
     lasttenth = 0;
-    for( level = maxlevels; level >= 1; level-- )  /* [maxlevels...1] */
+    for( level = ctx->maxlevels; level >= 1; level-- )  /* [maxlevels...1] */
       {
-      find_component(level);
-      thistenth = (int)( ( (float)( maxlevels - level ) ) / ( maxlevels - 1.0 ) * 10.0 + 0.5 );
+      find_component(ctx, level);
+      thistenth = (int)( ( (float)( ctx->maxlevels - level ) ) / ( ctx->maxlevels - 1.0 ) * 10.0 + 0.5 );
       if( thistenth != lasttenth )
         {
         lasttenth = thistenth;
-        if( verbose )
+        if( ctx->verbose )
           {
           printf("Done with %d percent.\n", thistenth * 10);
           }
         if( thistenth < 10 )
           {
-          if( cmtostat() )
+          if( cmtostat(ctx) )
             {
-            Gfree_all(0); return 1;
+            Gfree_all(ctx, 0); return 1;
             }
           }
         }
       }
-    if( cmtostat() )
+    if( cmtostat(ctx) )
       {
-      Gfree_all(0); return 1;
+      Gfree_all(ctx, 0); return 1;
       }
     }
-  if( save_image(g0) )
+  if( save_image(ctx, g0) )
     {
-    Gfree_all(0); return 1;
+    Gfree_all(ctx, 0); return 1;
     }
-  Gfree_all(1); /* isn't really be needed, if we've freed our calloc's */
+  Gfree_all(ctx, 1); /* isn't really be needed, if we've freed our calloc's */
   return 0;     /* normal, error free return */
 }
 
@@ -121,7 +121,12 @@ extern void genus0init(genus0parameters *g0);         /* Initialize fields in
 extern int genus0(genus0parameters *g0);              /* Call the algorithm.  Do
                                                         the work.  Returns 0 on
                                                         success, 1 on failure.
-                                                        */
+                                                        All the working state
+                                                        and allocations live in
+                                                        a context private to
+                                                        the call, so different
+                                                        *g0 may be processed
+                                                        concurrently. */
 
 extern void genus0destruct(genus0parameters *g0);     /* Frees *vertices and
                                                         *triangles, and frees
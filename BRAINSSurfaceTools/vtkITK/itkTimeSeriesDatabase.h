@@ -5,8 +5,12 @@
 #include <itkImage.h>
 #include <itkArray.h>
 #include <itkImageSource.h>
+#include <itkMultiThreader.h>
+#include <itkSimpleMutexLock.h>
+#include <itkConditionVariable.h>
 #include <iostream>
 #include <fstream>
+#include <deque>
 #include <itkTimeSeriesDatabaseHelper.h>
 
 #define TimeSeriesBlockSize 16
@@ -24,6 +28,12 @@ namespace itk
  * The main idea behind TimeSeriesDatabase is to have a representation of a 4 dimensional dataset that
  * is larger than main memory, but may still be accessed in a rapid manner.  Though not strictly
  * ITK conforming, this initial pass is strictly 4 dimensional datasets.
+ *
+ * The blocks are read with positional reads into a sharded LRU cache, so
+ * GenerateData and GetVoxelTimeSeries may be called from several threads.
+ * When consecutive block accesses follow a constant stride (e.g. along x
+ * while reading a volume, or along time while reading a time course), a
+ * background thread reads the next PrefetchDepth blocks along that stride.
  */
 template <class TPixel> class TimeSeriesDatabase : public ImageSource<Image<TPixel,3> > {
 public:
@@ -94,6 +104,20 @@ public:
    */
   void GetVoxelTimeSeries ( typename OutputImageType::IndexType idx, ArrayType& array );
 
+  /** Set the number of blocks read ahead along the access direction, 0
+   * disables prefetching.  It takes effect at the next Connect.
+   */
+  itkSetMacro ( PrefetchDepth, unsigned int );
+  itkGetConstMacro ( PrefetchDepth, unsigned int );
+
+  /** Cache statistics since the last Connect or ResetCacheStatistics.
+   * Blocks read ahead and found later count as hits.
+   */
+  unsigned long GetNumberOfCacheHits() const;
+  unsigned long GetNumberOfCacheMisses() const;
+  unsigned long GetNumberOfPrefetchedBlocks() const;
+  void ResetCacheStatistics();
+
   /** Set the size of the cache in MiB (1 MiB = 2^20 bytes)
    */
   void SetCacheSizeInMiB ( float sz );
@@ -133,17 +157,50 @@ protected:
   std::string m_Filename;
   unsigned int m_CurrentImage;
 
-  std::vector<StreamPtr> m_DatabaseFiles;
+  typedef itk::TimeSeriesDatabaseHelper::counted_ptr<TimeSeriesDatabaseHelper::BlockFile> BlockFilePtr;
+  std::vector<BlockFilePtr> m_DatabaseFiles;
   std::vector<std::string> m_DatabaseFileNames;
   unsigned long m_BlocksPerFile;
+  /// One past the largest block index
+  unsigned long m_NumberOfBlocks;
 
-  /// our cache
-  struct CacheBlock
+  /// our cache, the blocks are reference counted so that a block
+  /// evicted by one thread stays valid for the threads still reading it
+  class CacheBlock : public LightObject
   {
+  public:
+    typedef CacheBlock               Self;
+    typedef SmartPointer<Self>       Pointer;
+    typedef SmartPointer<const Self> ConstPointer;
+    itkSimpleNewMacro(Self);
+
     TPixel data[TimeSeriesBlockSize*TimeSeriesBlockSize*TimeSeriesBlockSize];
   };
-  TimeSeriesDatabaseHelper::LRUCache<unsigned long, CacheBlock> m_Cache;
-  CacheBlock* GetCacheBlock ( unsigned long index );
+  typedef typename CacheBlock::ConstPointer CacheBlockPointer;
+  TimeSeriesDatabaseHelper::ShardedLRUCache<unsigned long, CacheBlockPointer> m_Cache;
+  CacheBlockPointer GetCacheBlock ( unsigned long index );
+  /// Read a block from the database files, returns false if the read failed.
+  bool ReadBlock ( unsigned long index, CacheBlock* block );
+
+  /// Prefetching
+  void StartPrefetching();
+  void StopPrefetching();
+  /// Queue the blocks following index if the accesses follow a constant stride
+  void SchedulePrefetch ( unsigned long index );
+  void PrefetchBlocks();
+  static ITK_THREAD_RETURN_TYPE PrefetchThreaderCallback ( void* arg );
+
+  unsigned int m_PrefetchDepth;
+  MultiThreader::Pointer m_PrefetchThreader;
+  int m_PrefetchThreadId;
+  bool m_StopPrefetching;
+  std::deque<unsigned long> m_PrefetchQueue;
+  unsigned long m_NumberOfPrefetchedBlocks;
+  mutable SimpleMutexLock m_PrefetchLock;
+  ConditionVariable::Pointer m_PrefetchCondition;
+  /// Stride detection of the block accesses, guarded by m_PrefetchLock
+  unsigned long m_LastAccessedBlock;
+  long m_LastAccessStride;
 };
 
 } // end namespace itk
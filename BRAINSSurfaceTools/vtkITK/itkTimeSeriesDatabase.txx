@@ -54,18 +54,21 @@ template <class TPixel>
 bool TimeSeriesDatabase<TPixel>::IsOpen () const
 {
   if ( this->m_DatabaseFiles.size() == 0 ) { return false; }
-  return const_cast<std::fstream*>(this->m_DatabaseFiles[0].get())->is_open();
+  return this->m_DatabaseFiles[0]->is_open();
 }
 
 template <class TPixel>
 void TimeSeriesDatabase<TPixel>::Disconnect ()
 {
-  for ( int idx = 0; idx < this->m_DatabaseFiles.size(); idx++ )
+  // The prefetch thread reads from the files
+  this->StopPrefetching();
+  for ( ::size_t idx = 0; idx < this->m_DatabaseFiles.size(); idx++ )
     {
     this->m_DatabaseFiles[idx]->close();
     }
   this->m_DatabaseFiles.clear();
   this->m_DatabaseFileNames.clear();
+  this->m_Cache.clear();
 }
 
 template <class TPixel>
@@ -129,8 +132,16 @@ void TimeSeriesDatabase<TPixel>::Connect ( const char* filename )
     o >> Filename;
     // std::cout << "Reading file " << idx << " " << Filename << std::endl;
     this->m_DatabaseFileNames.push_back ( Filename );
-    this->m_DatabaseFiles.push_back ( StreamPtr ( new std::fstream ( Filename.c_str(), ::std::ios::in | ::std::ios::binary ) ) );
+    BlockFilePtr file ( new TimeSeriesDatabaseHelper::BlockFile );
+    file->open ( Filename.c_str() );
+    this->m_DatabaseFiles.push_back ( file );
     }
+  this->m_NumberOfBlocks = 1 + (unsigned long) m_BlocksPerImage[0] * m_BlocksPerImage[1] * m_BlocksPerImage[2] * m_Dimensions[3];
+
+  // Blocks of a previous database must not be served
+  this->m_Cache.clear();
+  this->m_NumberOfPrefetchedBlocks = 0;
+  this->StartPrefetching();
   /*
   std::cout << "ImageSize: " << m_OutputRegion.GetSize() << endl;
   std::cout << "ImageOrigin: " << m_OutputOrigin << endl;
@@ -184,23 +195,191 @@ template <class TPixel>
 
 
 template <class TPixel>
-typename TimeSeriesDatabase<TPixel>::CacheBlock* TimeSeriesDatabase<TPixel>::GetCacheBlock ( unsigned long index )
+bool TimeSeriesDatabase<TPixel>::ReadBlock ( unsigned long index, CacheBlock* block )
 {
-  CacheBlock* Buffer = this->m_Cache.find ( index );
-  if ( Buffer == ITK_NULLPTR ) {
-    // Fill it in
-    CacheBlock B;
-    int FileIdx = this->CalculateFileIndex ( index );
+  unsigned int FileIdx = this->CalculateFileIndex ( index );
+  if ( FileIdx >= this->m_DatabaseFiles.size() )
+    {
+    return false;
+    }
+  const ::std::streamoff position = this->CalculatePosition ( index, this->m_BlocksPerFile );
+  return this->m_DatabaseFiles[FileIdx]->read ( block->data, TimeSeriesVolumeBlockSize * sizeof ( TPixel ), position );
+}
+
 
-    this->m_DatabaseFiles[FileIdx]->seekg ( this->CalculatePosition ( index, this->m_BlocksPerFile ) );
-    this->m_DatabaseFiles[FileIdx]->read ( reinterpret_cast<char*> ( B.data ), TimeSeriesVolumeBlockSize * sizeof ( TPixel ) );
-    this->m_Cache.insert ( index, B );
-    Buffer = this->m_Cache.find ( index );
+template <class TPixel>
+typename TimeSeriesDatabase<TPixel>::CacheBlockPointer TimeSeriesDatabase<TPixel>::GetCacheBlock ( unsigned long index )
+{
+  this->SchedulePrefetch ( index );
+
+  CacheBlockPointer Buffer;
+  if ( !this->m_Cache.find ( index, Buffer ) ) {
+    // Fill it in
+    typename CacheBlock::Pointer B = CacheBlock::New();
+    if ( !this->ReadBlock ( index, B ) )
+      {
+      itkExceptionMacro ( "TimeSeriesDatabase::GetCacheBlock: failed to read block " << index );
+      }
+    Buffer = B.GetPointer();
+    this->m_Cache.insert ( index, Buffer );
   }
   return Buffer;
 }
 
 
+template <class TPixel>
+void TimeSeriesDatabase<TPixel>::SchedulePrefetch ( unsigned long index )
+{
+  if ( this->m_PrefetchThreadId < 0 )
+    {
+    return;
+    }
+  this->m_PrefetchLock.Lock();
+  const long stride = (long) index - (long) this->m_LastAccessedBlock;
+  if ( stride != 0 && stride == this->m_LastAccessStride )
+    {
+    // Two steps with the same stride, read ahead along it.  Only the block
+    // PrefetchDepth steps ahead is new once the sequence is established.
+    unsigned int first = this->m_PrefetchQueue.empty() ? 1 : this->m_PrefetchDepth;
+    for ( unsigned int k = first; k <= this->m_PrefetchDepth; k++ )
+      {
+      const long ahead = (long) index + stride * (long) k;
+      if ( ahead < 1 || ahead >= (long) this->m_NumberOfBlocks )
+        {
+        break;
+        }
+      this->m_PrefetchQueue.push_back ( (unsigned long) ahead );
+      }
+    // Keep the queue short when the consumers outrun the prefetching
+    while ( this->m_PrefetchQueue.size() > 4 * this->m_PrefetchDepth )
+      {
+      this->m_PrefetchQueue.pop_front();
+      }
+    this->m_PrefetchCondition->Signal();
+    }
+  if ( stride != 0 )
+    {
+    this->m_LastAccessStride = stride;
+    }
+  this->m_LastAccessedBlock = index;
+  this->m_PrefetchLock.Unlock();
+}
+
+
+template <class TPixel>
+void TimeSeriesDatabase<TPixel>::PrefetchBlocks()
+{
+  this->m_PrefetchLock.Lock();
+  while ( true )
+    {
+    while ( this->m_PrefetchQueue.empty() && !this->m_StopPrefetching )
+      {
+      this->m_PrefetchCondition->Wait ( &this->m_PrefetchLock );
+      }
+    if ( this->m_StopPrefetching )
+      {
+      break;
+      }
+    const unsigned long index = this->m_PrefetchQueue.front();
+    this->m_PrefetchQueue.pop_front();
+    this->m_PrefetchLock.Unlock();
+
+    bool prefetched = false;
+    if ( !this->m_Cache.contains ( index ) )
+      {
+      typename CacheBlock::Pointer B = CacheBlock::New();
+      if ( this->ReadBlock ( index, B ) )
+        {
+        this->m_Cache.insert ( index, CacheBlockPointer ( B.GetPointer() ) );
+        prefetched = true;
+        }
+      }
+
+    this->m_PrefetchLock.Lock();
+    if ( prefetched )
+      {
+      this->m_NumberOfPrefetchedBlocks++;
+      }
+    }
+  this->m_PrefetchLock.Unlock();
+}
+
+
+template <class TPixel>
+ITK_THREAD_RETURN_TYPE TimeSeriesDatabase<TPixel>::PrefetchThreaderCallback ( void* arg )
+{
+  Self* self = static_cast<Self*> ( ( (MultiThreader::ThreadInfoStruct *)(arg) )->UserData );
+  self->PrefetchBlocks();
+  return ITK_THREAD_RETURN_VALUE;
+}
+
+
+template <class TPixel>
+void TimeSeriesDatabase<TPixel>::StartPrefetching()
+{
+  this->StopPrefetching();
+  if ( this->m_PrefetchDepth == 0 )
+    {
+    return;
+    }
+  this->m_PrefetchLock.Lock();
+  this->m_StopPrefetching = false;
+  this->m_PrefetchQueue.clear();
+  this->m_LastAccessedBlock = 0;
+  this->m_LastAccessStride = 0;
+  this->m_PrefetchLock.Unlock();
+  this->m_PrefetchThreadId = static_cast<int>( this->m_PrefetchThreader->SpawnThread ( PrefetchThreaderCallback, this ) );
+}
+
+
+template <class TPixel>
+void TimeSeriesDatabase<TPixel>::StopPrefetching()
+{
+  if ( this->m_PrefetchThreadId < 0 )
+    {
+    return;
+    }
+  this->m_PrefetchLock.Lock();
+  this->m_StopPrefetching = true;
+  this->m_PrefetchQueue.clear();
+  this->m_PrefetchCondition->Broadcast();
+  this->m_PrefetchLock.Unlock();
+  this->m_PrefetchThreader->TerminateThread ( this->m_PrefetchThreadId );
+  this->m_PrefetchThreadId = -1;
+}
+
+
+template <class TPixel>
+unsigned long TimeSeriesDatabase<TPixel>::GetNumberOfCacheHits() const
+{
+  return this->m_Cache.hits();
+}
+
+template <class TPixel>
+unsigned long TimeSeriesDatabase<TPixel>::GetNumberOfCacheMisses() const
+{
+  return this->m_Cache.misses();
+}
+
+template <class TPixel>
+unsigned long TimeSeriesDatabase<TPixel>::GetNumberOfPrefetchedBlocks() const
+{
+  this->m_PrefetchLock.Lock();
+  const unsigned long count = this->m_NumberOfPrefetchedBlocks;
+  this->m_PrefetchLock.Unlock();
+  return count;
+}
+
+template <class TPixel>
+void TimeSeriesDatabase<TPixel>::ResetCacheStatistics()
+{
+  this->m_Cache.reset_statistics();
+  this->m_PrefetchLock.Lock();
+  this->m_NumberOfPrefetchedBlocks = 0;
+  this->m_PrefetchLock.Unlock();
+}
+
+
 template <class TPixel>
 void TimeSeriesDatabase<TPixel>::GetVoxelTimeSeries ( typename OutputImageType::IndexType idx, ArrayType& array )
 {
@@ -209,16 +388,16 @@ void TimeSeriesDatabase<TPixel>::GetVoxelTimeSeries ( typename OutputImageType::
   Size<3> CurrentBlock;
   Size<3> Offset;
   for ( int i = 0; i < 3; i++ ) {
-    if ( idx[i] < 0 || idx[i] > this->m_OutputRegion.Size[i] ) {
-      throw 1;
+    if ( idx[i] < 0 || idx[i] >= static_cast<IndexValueType>( this->m_OutputRegion.GetSize(i) ) ) {
+      itkExceptionMacro ( "TimeSeriesDatabase::GetVoxelTimeSeries: index " << idx << " is outside the volume" );
     }
-    CurrentBlock[i] = reinterpret_cast<unsigned long> ( idx[i] / (double)TimeSeriesBlockSize );
+    CurrentBlock[i] = idx[i] / TimeSeriesBlockSize;
     Offset[i] = idx[i] % TimeSeriesBlockSize;
   }
   unsigned long offset = Offset[0] + Offset[1] * TimeSeriesBlockSize + Offset[2] * TimeSeriesBlockSizeP2;
-  array = ArrayType ( this->m_Dimensions[3] );
-  for ( int volume = 0; volume < this->m_Dimensions[3]; volume++ ) {
-    CacheBlock* cache = this->GetCacheBlock ( CurrentBlock, volume );
+  array.SetSize ( this->m_Dimensions[3] );
+  for ( unsigned int volume = 0; volume < this->m_Dimensions[3]; volume++ ) {
+    CacheBlockPointer cache = this->GetCacheBlock ( this->CalculateIndex ( CurrentBlock, volume ) );
     array[volume] = cache->data[offset];
   }
 }
@@ -275,7 +454,7 @@ void TimeSeriesDatabase<TPixel>::GenerateData()
         typename OutputImageType::RegionType BR, IR;
         if ( print ) {  std::cout << "For Block Index: " << CurrentBlock << std::endl; }
         unsigned long index = this->CalculateIndex ( CurrentBlock, this->m_CurrentImage );
-        CacheBlock* Buffer = this->GetCacheBlock ( index );
+        CacheBlockPointer Buffer = this->GetCacheBlock ( index );
         if ( this->CalculateIntersection ( CurrentBlock, Region, BR, IR ) ) {
           // Just iterate over whole block
           // Good we can use an iterator!
@@ -290,7 +469,7 @@ void TimeSeriesDatabase<TPixel>::GenerateData()
           BlockRegion.SetIndex ( BlockIndex );
           ImageRegionIterator<OutputImageType> it ( output, IR );
           it.GoToBegin();
-          TPixel* ptr = Buffer->data;
+          const TPixel* ptr = Buffer->data;
           while ( !it.IsAtEnd() ) {
             it.Set ( *ptr );
             ++it;
@@ -569,7 +748,7 @@ void TimeSeriesDatabase<TPixel>::SetCacheSizeInMiB ( float sz )
 {
   // How many blocks is this?
   double BlockSizeInMiB = sizeof ( TPixel ) * TimeSeriesVolumeBlockSize / ( 1024*1024.);
-  unsigned long int blocks = (unsigned long int) ceil ( sz * BlockSizeInMiB );
+  unsigned long int blocks = (unsigned long int) ceil ( sz / BlockSizeInMiB );
   this->m_Cache.set_maxsize ( blocks );
 }
 
@@ -579,11 +758,22 @@ template <class TPixel>
 TimeSeriesDatabase<TPixel>::TimeSeriesDatabase () : m_Cache ( 1024 ){
   this->m_Dimensions.SetSize ( 4 );
   this->m_BlocksPerImage.SetSize ( 4 );
+  this->m_BlocksPerFile = 1;
+  this->m_NumberOfBlocks = 0;
+  this->m_PrefetchDepth = 4;
+  this->m_PrefetchThreader = MultiThreader::New();
+  this->m_PrefetchThreadId = -1;
+  this->m_StopPrefetching = false;
+  this->m_NumberOfPrefetchedBlocks = 0;
+  this->m_PrefetchCondition = ConditionVariable::New();
+  this->m_LastAccessedBlock = 0;
+  this->m_LastAccessStride = 0;
 }
 
 template <class TPixel>
 TimeSeriesDatabase<TPixel>::~TimeSeriesDatabase () {
   // m_Cache.statistics ( std::cout );
+  this->Disconnect();
 }
 
 
@@ -613,6 +803,8 @@ TimeSeriesDatabase<TPixel>
     os << indent << "Database is closed." << "\n";
   }
 
+  os << indent << "PrefetchDepth: " << this->m_PrefetchDepth << "\n";
+  os << indent << "Prefetched blocks: " << this->GetNumberOfPrefetchedBlocks() << "\n";
   this->m_Cache.statistics ( os );
 }
 
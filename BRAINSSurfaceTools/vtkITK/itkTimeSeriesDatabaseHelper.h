@@ -6,6 +6,15 @@
 #include <string>
 #include <cstdarg>
 #include <cassert>
+#include <cstdio>
+#include <vector>
+#include "itkSimpleFastMutexLock.h"
+#if defined(_WIN32)
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
 
 namespace itk {
   namespace TimeSeriesDatabaseHelper {
@@ -354,6 +363,280 @@ namespace itk {
         ulong finds_hit;
         ulong removed;
       } stats;
+#endif
+    };
+
+    /// A cache that may be used concurrently from several threads.
+    ///
+    /// The keys are spread over several LRUCache shards, each with its
+    /// own lock, so that threads looking up different keys seldom wait
+    /// for each other. Values are returned by copy, so value_type should
+    /// be cheap to copy and safe to share between threads (e.g. an
+    /// itk::SmartPointer). The maximal size is divided evenly among the
+    /// shards, and each shard evicts its own least recently used items.
+    ///
+    /// Unlike LRUCache, the hit/miss counters are always kept.
+    ///
+    template <typename key_type, typename value_type>
+      class ShardedLRUCache
+    {
+    public:
+      /// Create a new cache.
+      ///
+      /// \param maxsize_ maximal size of the cache
+      /// \param numshards_ number of independently locked shards
+      ///
+    ShardedLRUCache(unsigned maxsize_ = 100, unsigned numshards_ = 16)
+      : maxsize(maxsize_)
+      {
+        if (numshards_ == 0)
+          numshards_ = 1;
+        for (unsigned i = 0; i < numshards_; ++i)
+          shards.push_back(new shard);
+        set_maxsize(maxsize_);
+      }
+
+      ~ShardedLRUCache()
+        {
+          for (size_t i = 0; i < shards.size(); ++i)
+            delete shards[i];
+        }
+
+      void set_maxsize ( unsigned maxsize_ ) {
+        maxsize = maxsize_;
+        const unsigned shardsize = (maxsize_ + shards.size() - 1) / shards.size();
+        for (size_t i = 0; i < shards.size(); ++i)
+          {
+            shards[i]->lock.Lock();
+            shards[i]->cache.set_maxsize(shardsize > 0 ? shardsize : 1);
+            shards[i]->lock.Unlock();
+          }
+      }
+
+      unsigned get_maxsize () const {
+        return maxsize;
+      }
+
+      /// Clear the cache and its statistics.
+      ///
+      void clear()
+      {
+        for (size_t i = 0; i < shards.size(); ++i)
+          {
+            shards[i]->lock.Lock();
+            shards[i]->cache.clear();
+            shards[i]->hits = shards[i]->misses = 0;
+            shards[i]->lock.Unlock();
+          }
+      }
+
+      /// Inserts a key/value pair to the cache.
+      ///
+      void insert(const key_type& key, const value_type& value)
+      {
+        shard & s = get_shard(key);
+        s.lock.Lock();
+        s.cache.insert(key, value);
+        s.lock.Unlock();
+      }
+
+      /// Looks for a key in the cache, copying its value when found.
+      /// The lookup is counted as a hit or a miss.
+      ///
+      bool find(const key_type& key, value_type& value)
+      {
+        shard & s = get_shard(key);
+        s.lock.Lock();
+        const value_type* valptr = s.cache.find(key);
+        if (valptr)
+          {
+            value = *valptr;
+            s.hits++;
+          }
+        else
+          {
+            s.misses++;
+          }
+        s.lock.Unlock();
+        return valptr != ITK_NULLPTR;
+      }
+
+      /// Is the key in the cache ? Not counted in the statistics.
+      ///
+      bool contains(const key_type& key)
+      {
+        shard & s = get_shard(key);
+        s.lock.Lock();
+        const bool found = s.cache.find(key) != ITK_NULLPTR;
+        s.lock.Unlock();
+        return found;
+      }
+
+      unsigned long hits() const
+      {
+        unsigned long total = 0;
+        for (size_t i = 0; i < shards.size(); ++i)
+          {
+            shards[i]->lock.Lock();
+            total += shards[i]->hits;
+            shards[i]->lock.Unlock();
+          }
+        return total;
+      }
+
+      unsigned long misses() const
+      {
+        unsigned long total = 0;
+        for (size_t i = 0; i < shards.size(); ++i)
+          {
+            shards[i]->lock.Lock();
+            total += shards[i]->misses;
+            shards[i]->lock.Unlock();
+          }
+        return total;
+      }
+
+      void reset_statistics()
+      {
+        for (size_t i = 0; i < shards.size(); ++i)
+          {
+            shards[i]->lock.Lock();
+            shards[i]->hits = shards[i]->misses = 0;
+            shards[i]->lock.Unlock();
+          }
+      }
+
+      void statistics(ostream& ostr = cerr) const
+      {
+        const unsigned long h = hits();
+        const unsigned long m = misses();
+        ostr << "ShardedLRUCache statistics\n";
+        ostr << "Shards: " << shards.size() << " Max size: " << maxsize << "\n";
+        ostr << "Hits: " << h << " Misses: " << m << "\n";
+      }
+
+    private:
+      struct shard
+      {
+        shard() : hits(0), misses(0) {}
+
+        LRUCache<key_type, value_type> cache;
+        mutable itk::SimpleFastMutexLock lock;
+        unsigned long hits;
+        unsigned long misses;
+      };
+
+      shard & get_shard(const key_type& key)
+      {
+        return *shards[static_cast<size_t>(key) % shards.size()];
+      }
+
+      /// Not implemented.
+      ShardedLRUCache(const ShardedLRUCache&);
+      ShardedLRUCache& operator=(const ShardedLRUCache&);
+
+      unsigned maxsize;
+      std::vector<shard*> shards;
+    };
+
+    /// A read only file supporting concurrent positional reads.
+    ///
+    /// On POSIX systems the reads use pread(), which does not move a
+    /// shared file position, so several threads may read different
+    /// blocks at the same time. Elsewhere a seek and a read are done
+    /// under a lock.
+    ///
+    class BlockFile
+    {
+    public:
+    BlockFile()
+#if defined(_WIN32)
+      : file(ITK_NULLPTR)
+#else
+      : descriptor(-1)
+#endif
+      {
+      }
+
+      ~BlockFile()
+        {
+          close();
+        }
+
+      bool open(const char* filename)
+      {
+        close();
+#if defined(_WIN32)
+        file = fopen(filename, "rb");
+#else
+        descriptor = ::open(filename, O_RDONLY);
+#endif
+        return is_open();
+      }
+
+      bool is_open() const
+      {
+#if defined(_WIN32)
+        return file != ITK_NULLPTR;
+#else
+        return descriptor >= 0;
+#endif
+      }
+
+      void close()
+      {
+#if defined(_WIN32)
+        if (file)
+          {
+            fclose(file);
+            file = ITK_NULLPTR;
+          }
+#else
+        if (descriptor >= 0)
+          {
+            ::close(descriptor);
+            descriptor = -1;
+          }
+#endif
+      }
+
+      /// Read size bytes at offset, returns false on a short read.
+      ///
+      bool read(void* buffer, size_t size, long long offset)
+      {
+#if defined(_WIN32)
+        lock.Lock();
+        bool ok = file && _fseeki64(file, offset, SEEK_SET) == 0
+          && fread(buffer, 1, size, file) == size;
+        lock.Unlock();
+        return ok;
+#else
+        char* ptr = static_cast<char*>(buffer);
+        while (size > 0)
+          {
+            const ssize_t count = ::pread(descriptor, ptr, size, static_cast<off_t>(offset));
+            if (count <= 0)
+              {
+                return false;
+              }
+            ptr += count;
+            offset += count;
+            size -= count;
+          }
+        return true;
+#endif
+      }
+
+    private:
+      /// Not implemented.
+      BlockFile(const BlockFile&);
+      BlockFile& operator=(const BlockFile&);
+
+#if defined(_WIN32)
+      FILE* file;
+      itk::SimpleFastMutexLock lock;
+#else
+      int descriptor;
 #endif
     };
   }
@@ -39,6 +39,36 @@
 #include "itkImageFileWriter.h"
 #include <BRAINSCommonLib.h>
 
+static int HemisphereModeFromString(const std::string & mode)
+{
+  if( mode == "right" )
+    {
+    return vtkTalairachConversion::right;
+    }
+  else if( mode == "left" )
+    {
+    return vtkTalairachConversion::left;
+    }
+  return vtkTalairachConversion::both;
+}
+
+/* Box definitions are read up to the first empty line */
+static std::list<std::string> ReadTalairachBoxFile(const std::string & filename)
+{
+  std::list<std::string> boxes;
+  ifstream               fin( filename.c_str() );
+  std::string            line;
+  getline(fin, line);
+
+  while( !line.empty() )
+    {
+    boxes.push_back( line );
+    line.clear();
+    getline(fin, line);
+    }
+  return boxes;
+}
+
 int main(int argc, char *argv[])
 {
   PARSE_ARGS;
@@ -47,10 +77,23 @@ int main(int argc, char *argv[])
   const int dimension = 3;
   typedef itk::Image<unsigned char, dimension> ImageType;
   typedef itk::ImageFileReader<ImageType>      ImageReaderType;
+  typedef itk::ImageFileWriter<ImageType>      ImageWriterType;
 
+  if( talairachBoxes.size() != outputVolumes.size() )
+    {
+    std::cerr << "ERROR: talairachBoxes and outputVolumes must have the same number of elements" << std::endl;
+    return EXIT_FAILURE;
+    }
+  if( !hemisphereModes.empty() && hemisphereModes.size() != 1 && hemisphereModes.size() != talairachBoxes.size() )
+    {
+    std::cerr << "ERROR: hemisphereModes must have one element, or one element per talairachBoxes element" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  /* Only the physical space of the input image is used */
   ImageReaderType::Pointer reader = ImageReaderType::New();
   reader->SetFileName(inputVolume);
-  reader->Update();
+  reader->UpdateOutputInformation();
 
   vtkStructuredGrid *talairach;
   const std::string extension = vtksys::SystemTools::LowerCase( vtksys::SystemTools::GetFilenameLastExtension( talairachParameters ) );
@@ -73,38 +116,39 @@ int main(int argc, char *argv[])
   vtkTalairachConversion *tConv = vtkTalairachConversion::New();
   tConv->SetImageInformation( reader->GetOutput() );
   tConv->SetTalairachGrid( talairach );
-  if( hemisphereMode == "right" )
-    {
-    tConv->SetHemisphereMode( vtkTalairachConversion::right );
-    }
-  else if( hemisphereMode == "left" )
-    {
-    tConv->SetHemisphereMode( vtkTalairachConversion::left );
-    }
-  else
-    {
-    tConv->SetHemisphereMode( vtkTalairachConversion::both );
-    }
+  tConv->SetHemisphereMode( HemisphereModeFromString( hemisphereMode ) );
   tConv->SetSegmentationMode( expand );
 
-  ifstream    fin( talairachBox.c_str() );
-  std::string line;
-  getline(fin, line);
-
-  while( !line.empty() )
+  if( !talairachBox.empty() )
     {
-    tConv->AddTalairachBox( line );
-    line.clear();
-    getline(fin, line);
+    const std::list<std::string> boxes = ReadTalairachBoxFile( talairachBox );
+    for( std::list<std::string>::const_iterator it = boxes.begin(); it != boxes.end(); ++it )
+      {
+      tConv->AddTalairachBox( *it );
+      }
+
+    tConv->Update();
+
+    ImageWriterType::Pointer writer = ImageWriterType::New();
+    writer->SetFileName( outputVolume );
+    writer->SetInput( tConv->GetImage() );
+    writer->Update();
     }
 
-  tConv->Update();
-
-  typedef itk::ImageFileWriter<ImageType> ImageWriterType;
-  ImageWriterType::Pointer writer = ImageWriterType::New();
-  writer->SetFileName( outputVolume );
-  writer->SetInput( tConv->GetImage() );
-  writer->Update();
+  /* All masks of the list share the grid and the image information */
+  for( size_t i = 0; i < talairachBoxes.size(); ++i )
+    {
+    int mode = tConv->GetHemisphereMode();
+    if( !hemisphereModes.empty() )
+      {
+      mode = HemisphereModeFromString( hemisphereModes[hemisphereModes.size() == 1 ? 0 : i] );
+      }
+
+    ImageWriterType::Pointer writer = ImageWriterType::New();
+    writer->SetFileName( outputVolumes[i] );
+    writer->SetInput( tConv->GenerateMask( ReadTalairachBoxFile( talairachBoxes[i] ), mode ) );
+    writer->Update();
+    }
 
   return EXIT_SUCCESS;
 }
@@ -20,12 +20,15 @@
 #include "itkImageFileReader.h"
 #include "itkImageRegionIterator.h"
 #include "itkImageFileWriter.h"
-#include "itkImageRegionIteratorWithIndex.h"
 #include "itkImage.h"
 #include "itkPoint.h"
+#include "itkMultiThreader.h"
 #include "vtkStructuredGrid.h"
 
 #include "vtkPoints.h"
+#include <algorithm>
+#include <cstring>
+#include <sstream>
 
 #define PR(x) std::cout << #x " = " << x << "\n"; // a simple print macro for
                                                    // use when debugging
@@ -34,6 +37,64 @@
 #define TALAIRACH_Y_POINTS 12
 #define TALAIRACH_Z_POINTS 15
 
+namespace
+{
+struct MaskFillThreadStruct
+  {
+  vtkTalairachConversion::ImageType::PixelType *    Buffer;
+  vtkTalairachConversion::ImageType::IndexType      BufferIndex;
+  vtkTalairachConversion::ImageType::SizeType       BufferSize;
+  const std::vector<vtkTalairachConversion::ImageType::RegionType> *Regions;
+  };
+
+/* Zero a contiguous share of the slices, then set the rows of every box
+ * that crosses them; the shares do not overlap, so no locking is needed */
+ITK_THREAD_RETURN_TYPE MaskFillThreaderCallback(void *arg)
+{
+  itk::MultiThreader::ThreadInfoStruct *info = static_cast<itk::MultiThreader::ThreadInfoStruct *>(arg);
+  const MaskFillThreadStruct *          str = static_cast<const MaskFillThreadStruct *>(info->UserData);
+
+  const itk::IndexValueType sizeX = str->BufferSize[0];
+  const itk::IndexValueType sizeY = str->BufferSize[1];
+  const itk::IndexValueType sizeZ = str->BufferSize[2];
+  const itk::IndexValueType chunk = ( sizeZ + info->NumberOfThreads - 1 ) / info->NumberOfThreads;
+  const itk::IndexValueType zStart = std::min(sizeZ, static_cast<itk::IndexValueType>( info->ThreadID ) * chunk);
+  const itk::IndexValueType zEnd = std::min(sizeZ, zStart + chunk);
+  if( zStart >= zEnd )
+    {
+    return ITK_THREAD_RETURN_VALUE;
+    }
+
+  const size_t sliceLength = static_cast<size_t>( sizeX ) * sizeY;
+  memset(str->Buffer + zStart * sliceLength, 0, ( zEnd - zStart ) * sliceLength);
+
+  const std::vector<vtkTalairachConversion::ImageType::RegionType> & regions = *str->Regions;
+  for( size_t r = 0; r < regions.size(); ++r )
+    {
+    const vtkTalairachConversion::ImageType::IndexType & index = regions[r].GetIndex();
+    const vtkTalairachConversion::ImageType::SizeType &  size = regions[r].GetSize();
+    if( size[0] == 0 || size[1] == 0 )
+      {
+      continue;
+      }
+    const itk::IndexValueType x = index[0] - str->BufferIndex[0];
+    const itk::IndexValueType y = index[1] - str->BufferIndex[1];
+    const itk::IndexValueType z = index[2] - str->BufferIndex[2];
+    const itk::IndexValueType boxZStart = std::max(zStart, z);
+    const itk::IndexValueType boxZEnd = std::min(zEnd, z + static_cast<itk::IndexValueType>( size[2] ) );
+    for( itk::IndexValueType k = boxZStart; k < boxZEnd; ++k )
+      {
+      vtkTalairachConversion::ImageType::PixelType *row = str->Buffer + k * sliceLength + y * sizeX + x;
+      for( itk::SizeValueType j = 0; j < size[1]; ++j, row += sizeX )
+        {
+        memset(row, 1, size[0]);
+        }
+      }
+    }
+  return ITK_THREAD_RETURN_VALUE;
+}
+}
+
 vtkStandardNewMacro(vtkTalairachConversion);
 
 vtkTalairachConversion::vtkTalairachConversion()
@@ -181,26 +242,50 @@ vtkStructuredGrid * vtkTalairachConversion::GetTalairachGrid()
   return this->TalairachGrid;
 }
 
-void vtkTalairachConversion::ProcessBOX(bool _left)
+void vtkTalairachConversion::CacheGridCoordinates()
 {
-  std::list<std::string>::iterator it;
+  /* The boxes only use the grid coordinates along the first row of
+   * points in each direction; look them up once per mask */
+  this->GridX.resize(TALAIRACH_X_POINTS);
+  for( int i = 0; i < TALAIRACH_X_POINTS; i++ )
+    {
+    this->GridX[i] = this->TalairachGrid->GetPoint(i)[0];
+    }
+  this->GridY.resize(TALAIRACH_Y_POINTS);
+  for( int i = 0; i < TALAIRACH_Y_POINTS; i++ )
+    {
+    this->GridY[i] = this->TalairachGrid->GetPoint(i * TALAIRACH_X_POINTS)[1];
+    }
+  this->GridZ.resize(TALAIRACH_Z_POINTS);
+  for( int i = 0; i < TALAIRACH_Z_POINTS; i++ )
+    {
+    this->GridZ[i] = this->TalairachGrid->GetPoint(i * TALAIRACH_X_POINTS * TALAIRACH_Y_POINTS)[2];
+    }
+}
 
-  for( it = TalairachBoxList.begin(); it != TalairachBoxList.end(); ++it )
+void vtkTalairachConversion::ProcessBOX(const std::list<std::string> & boxList, bool _left, RegionListType & regions)
+{
+  std::list<std::string>::const_iterator it;
+
+  const ImageType::RegionType::SizeType imageSize
+    = this->MaskImage->GetLargestPossibleRegion().GetSize();
+
+  for( it = boxList.begin(); it != boxList.end(); ++it )
     {
     /* Requested information is 3 alphanumeric coordinate pairs
      * given in the form of six whitespace-delimited tokens per
      * line; this vector will store one line's worth at a time */
     std::vector<std::string> tokens;
-
-    tokens.clear();
-    for( int i = 0; i < 6; i++ )
+    std::string              buf;
+    std::stringstream        ss(*it);
+    while( ss >> buf )
       {
-      std::string       buf;
-      std::stringstream ss(*it);
-      while( ss >> buf )
-        {
-        tokens.push_back(buf);
-        }
+      tokens.push_back(buf);
+      }
+    if( tokens.size() < 6 )
+      {
+      std::cout << "WARNING: Skipping incomplete Talairach box definition: " << *it << std::endl;
+      continue;
       }
 
     // std::cout << "============================================" << std::endl;
@@ -283,16 +368,16 @@ void vtkTalairachConversion::ProcessBOX(bool _left)
       }
 
     /* Base the Distance on the High Resolution Grid */
-    yStart1 = this->TalairachGrid->GetPoint(yGridStartIndex * TALAIRACH_X_POINTS)[1];
-    yStart2 = this->TalairachGrid->GetPoint( ( yGridStartIndex + 1 ) * TALAIRACH_X_POINTS )[1];
+    yStart1 = this->GridY.at(yGridStartIndex);
+    yStart2 = this->GridY.at(yGridStartIndex + 1);
     vtkTalairachConversion::ImageType::PointType regionStart;
     regionStart.Fill(0.0);
     regionStart[1] = yStart1 + boxDistancePercentage * ( yStart2 - yStart1 );
 
     if( ( this->SegmentationMode ) && ( yGridStartIndex == 0 ) && ( boxDistancePercentage == 0.0 ) )
       {
-      yStart1 = this->TalairachGrid->GetPoint(yGridStartIndex * TALAIRACH_X_POINTS)[1];
-      yStart2 = this->TalairachGrid->GetPoint( ( yGridStartIndex + 1 ) * TALAIRACH_X_POINTS )[1];
+      yStart1 = this->GridY.at(yGridStartIndex);
+      yStart2 = this->GridY.at(yGridStartIndex + 1);
       regionStart[1] -= ( yStart2 - yStart1 );
       }
 
@@ -363,8 +448,8 @@ void vtkTalairachConversion::ProcessBOX(bool _left)
       }
 
     /* Base the Distance on the High Resolution Grid */
-    yEnd1 = this->TalairachGrid->GetPoint(yGridEndIndex * TALAIRACH_X_POINTS)[1];
-    yEnd2 = this->TalairachGrid->GetPoint( ( yGridEndIndex + 1 ) * TALAIRACH_X_POINTS )[1];
+    yEnd1 = this->GridY.at(yGridEndIndex);
+    yEnd2 = this->GridY.at(yGridEndIndex + 1);
 
     ImageType::PointType regionEnd;
     regionEnd.Fill(0.0);
@@ -372,8 +457,8 @@ void vtkTalairachConversion::ProcessBOX(bool _left)
 
     if( ( this->SegmentationMode ) && ( yGridEndIndex == 10 ) && ( boxDistancePercentage == 1.0 ) )
       {
-      yEnd1 = this->TalairachGrid->GetPoint(yGridEndIndex * TALAIRACH_X_POINTS)[1];
-      yEnd2 = this->TalairachGrid->GetPoint( ( yGridEndIndex + 1 ) * TALAIRACH_X_POINTS )[1];
+      yEnd1 = this->GridY.at(yGridEndIndex);
+      yEnd2 = this->GridY.at(yGridEndIndex + 1);
       regionEnd[1] += ( yEnd2 - yEnd1 );
       }
 
@@ -417,8 +502,8 @@ void vtkTalairachConversion::ProcessBOX(bool _left)
         }
 
       /* Base the Distance on the High Resolution Grid */
-      xStart1 = this->TalairachGrid->GetPoint(xGridStartIndex)[0];
-      xStart2 = this->TalairachGrid->GetPoint( xGridStartIndex + 1)[0];
+      xStart1 = this->GridX.at(xGridStartIndex);
+      xStart2 = this->GridX.at(xGridStartIndex + 1);
       regionStart[0] = xStart1 + boxDistancePercentage * ( xStart2 - xStart1 );
       }
     else
@@ -451,8 +536,8 @@ void vtkTalairachConversion::ProcessBOX(bool _left)
         }
 
       /* Base the Distance on the High Resolution Grid */
-      xEnd1 = this->TalairachGrid->GetPoint(xGridEndIndex)[0];
-      xEnd2 = this->TalairachGrid->GetPoint( xGridEndIndex - 1)[0];
+      xEnd1 = this->GridX.at(xGridEndIndex);
+      xEnd2 = this->GridX.at(xGridEndIndex - 1);
       regionEnd[0] = xEnd1 + boxDistancePercentage * ( xEnd2 - xEnd1 );
       }
 
@@ -489,8 +574,8 @@ void vtkTalairachConversion::ProcessBOX(bool _left)
         }
 
       /* Base the Distance on the High Resolution Grid */
-      xEnd1 = this->TalairachGrid->GetPoint(xGridEndIndex)[0];
-      xEnd2 = this->TalairachGrid->GetPoint( xGridEndIndex + 1)[0];
+      xEnd1 = this->GridX.at(xGridEndIndex);
+      xEnd2 = this->GridX.at(xGridEndIndex + 1);
       regionEnd[0] = xEnd1 + boxDistancePercentage * ( xEnd2 - xEnd1 );
       if( ( this->SegmentationMode ) && ( xGridEndIndex == 7 ) && ( boxDistancePercentage == 1.0 ) )
         {
@@ -529,8 +614,8 @@ void vtkTalairachConversion::ProcessBOX(bool _left)
         }
 
       /* Base the Distance on the High Resolution Grid */
-      xStart1 = this->TalairachGrid->GetPoint(xGridStartIndex)[0];
-      xStart2 = this->TalairachGrid->GetPoint( xGridStartIndex - 1)[0];
+      xStart1 = this->GridX.at(xGridStartIndex);
+      xStart2 = this->GridX.at(xGridStartIndex - 1);
       regionStart[0] = xStart1 + boxDistancePercentage * ( xStart2 - xStart1 );
       if( ( this->SegmentationMode ) && ( xGridStartIndex == 1 ) && ( boxDistancePercentage == 1.0 ) )
         {
@@ -573,8 +658,8 @@ void vtkTalairachConversion::ProcessBOX(bool _left)
     // std::cout << "zEndIndex: " << zGridEndIndex << std::endl;
 
     /* Base the Distance on the High Resolution Grid */
-    zEnd1 = this->TalairachGrid->GetPoint(zGridEndIndex * TALAIRACH_X_POINTS * TALAIRACH_Y_POINTS)[2];
-    zEnd2 = this->TalairachGrid->GetPoint( ( zGridEndIndex - 1 ) * TALAIRACH_X_POINTS * TALAIRACH_Y_POINTS )[2];
+    zEnd1 = this->GridZ.at(zGridEndIndex);
+    zEnd2 = this->GridZ.at(zGridEndIndex - 1);
     // std::cout << "zEnd1: " << zEnd1 << " " << zEnd2 << std::endl;
     regionEnd[2] = zEnd1 + boxDistancePercentage * ( zEnd2 - zEnd1 );
     if( ( this->SegmentationMode ) && ( zGridEndIndex == 14 ) && ( boxDistancePercentage == 0.0 ) )
@@ -613,8 +698,8 @@ void vtkTalairachConversion::ProcessBOX(bool _left)
     // std::cout << "distance1: " << distance << std::endl;
 
     /* Base the Distance on the High Resolution Grid */
-    zStart1 = this->TalairachGrid->GetPoint(zGridStartIndex * TALAIRACH_X_POINTS * TALAIRACH_Y_POINTS)[2];
-    zStart2 = this->TalairachGrid->GetPoint( ( zGridStartIndex - 1 ) * TALAIRACH_X_POINTS * TALAIRACH_Y_POINTS )[2];
+    zStart1 = this->GridZ.at(zGridStartIndex);
+    zStart2 = this->GridZ.at(zGridStartIndex - 1);
     // std::cout << "zStart1: " << zStart1 << " " << zStart2 << std::endl;
     regionStart[2] = zStart1 + boxDistancePercentage * ( zStart2 - zStart1 );
     if( ( this->SegmentationMode ) && ( zGridStartIndex == 1 ) && ( boxDistancePercentage == 1.0 ) )
@@ -633,8 +718,6 @@ void vtkTalairachConversion::ProcessBOX(bool _left)
     this->MaskImage->TransformPhysicalPointToIndex(regionEnd, gridEnd);
 
     /* Make sure that the boxes are within the image space */
-    ImageType::RegionType::SizeType imageSize
-      = this->MaskImage->GetLargestPossibleRegion().GetSize();
     for( int i = 0; i < 3; i++ )
       {
       if( gridStart[i] < 0 )
@@ -696,15 +779,43 @@ void vtkTalairachConversion::ProcessBOX(bool _left)
 
     // std::cout << "Region Size: " << gridSize << std::endl;
     // std::cout << "============================================" << std::endl;
-    typedef itk::ImageRegionIteratorWithIndex<ImageType> IteratorType;
-    IteratorType itr(this->MaskImage, testRegion);
-    for( itr.GoToBegin(); !itr.IsAtEnd(); ++itr )
-      {
-      itr.Set(1);
-      }
+    regions.push_back(testRegion);
     }
 }
 
+void vtkTalairachConversion::ComputeRegions(const std::list<std::string> & boxList, int hemisphereMode,
+                                            RegionListType & regions)
+{
+  this->CacheGridCoordinates();
+
+  regions.clear();
+  if( hemisphereMode == right || hemisphereMode == both )
+    {
+    this->ProcessBOX(boxList, false, regions);
+    }
+
+  if( hemisphereMode == left || hemisphereMode == both )
+    {
+    this->ProcessBOX(boxList, true, regions);
+    }
+}
+
+void vtkTalairachConversion::FillMask(ImageType *mask, const RegionListType & regions)
+{
+  MaskFillThreadStruct str;
+  str.Buffer = mask->GetBufferPointer();
+  str.BufferIndex = mask->GetBufferedRegion().GetIndex();
+  str.BufferSize = mask->GetBufferedRegion().GetSize();
+  str.Regions = &regions;
+
+  itk::MultiThreader::Pointer threader = itk::MultiThreader::New();
+  threader->SetNumberOfThreads( std::min( static_cast<itk::SizeValueType>( threader->GetNumberOfThreads() ),
+                                          std::max( static_cast<itk::SizeValueType>( str.BufferSize[2] ),
+                                                    static_cast<itk::SizeValueType>( 1 ) ) ) );
+  threader->SetSingleMethod(MaskFillThreaderCallback, &str);
+  threader->SingleMethodExecute();
+}
+
 void vtkTalairachConversion::SetImageInformation(ImageType::Pointer exampleImage)
 {
   this->MaskImage->SetOrigin( exampleImage->GetOrigin() );
@@ -718,18 +829,25 @@ vtkTalairachConversion::ImageType::Pointer vtkTalairachConversion::GetImage()
   return this->MaskImage;
 }
 
-void vtkTalairachConversion::Update()
+vtkTalairachConversion::ImageType::Pointer
+vtkTalairachConversion::GenerateMask(const std::list<std::string> & talairachBoxes, int hemisphereMode)
 {
-  this->MaskImage->Allocate();
-  this->MaskImage->FillBuffer(0);
+  RegionListType regions;
+  this->ComputeRegions(talairachBoxes, hemisphereMode, regions);
+
+  ImageType::Pointer mask = ImageType::New();
+  mask->CopyInformation(this->MaskImage);
+  mask->SetRegions( this->MaskImage->GetLargestPossibleRegion() );
+  mask->Allocate();
+  this->FillMask(mask, regions);
+  return mask;
+}
 
-  if( this->HemisphereMode == right || this->HemisphereMode == both )
-    {
-    ProcessBOX(false);
-    }
+void vtkTalairachConversion::Update()
+{
+  RegionListType regions;
+  this->ComputeRegions(this->TalairachBoxList, this->HemisphereMode, regions);
 
-  if( this->HemisphereMode == left || this->HemisphereMode == both )
-    {
-    ProcessBOX(true);
-    }
+  this->MaskImage->Allocate();
+  this->FillMask(this->MaskImage, regions);
 }
@@ -25,6 +25,7 @@
 #include "itkImage.h"
 #include <list>
 #include <string>
+#include <vector>
 
 class vtkStructuredGrid;
 
@@ -61,6 +62,13 @@ public:
    * prior to running this function */
   void GenerateImage();
 
+  /* Description:
+   * Create a new binary mask image from the given box definitions and
+   * hemisphere mode, with the image information and segmentation mode
+   * currently set; the box list and mask of Update() are not modified,
+   * so many masks can be generated from one talairach grid */
+  ImageType::Pointer GenerateMask(const std::list<std::string> & talairachBoxes, int hemisphereMode);
+
   /* Description:
    * Returns the binary mask image generated from the talairach grids;
    * returned as an ITK image */
@@ -129,12 +137,24 @@ protected:
   vtkTalairachConversion();
   ~vtkTalairachConversion();
 
+  typedef std::vector<ImageType::RegionType> RegionListType;
+
   /* Description:
    * Process a box file to calculate the regions of active masking */
-  void ProcessBOX(bool _left);
+  void ProcessBOX(const std::list<std::string> & boxList, bool _left, RegionListType & regions);
+
+  /* Description:
+   * Calculate the regions of all boxes in the hemispheres of the mode */
+  void ComputeRegions(const std::list<std::string> & boxList, int hemisphereMode, RegionListType & regions);
+
+  /* Description:
+   * Clear the mask and set the regions, in parallel over the slices */
+  void FillMask(ImageType *mask, const RegionListType & regions);
 
 private:
 
+  void CacheGridCoordinates();
+
   vtkStructuredGrid *    TalairachGrid;
   std::list<std::string> TalairachBoxList;
 
@@ -142,6 +162,11 @@ private:
   int  HemisphereMode;
 
   ImageType::Pointer MaskImage;
+
+  /* Grid coordinates along each axis, cached from the talairach grid */
+  std::vector<double> GridX;
+  std::vector<double> GridY;
+  std::vector<double> GridZ;
 };
 
 #endif
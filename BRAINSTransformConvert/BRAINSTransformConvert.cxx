@@ -22,7 +22,7 @@
 #include "itkImageFileReader.h"
 #include "itkBSplineDeformableTransform.h"
 #include "itkIO.h"
-#include "itkImageRegionIterator.h"
+#include "itkBRAINSTransformToDisplacementFieldFilter.h"
 #include "GenericTransformImage.h"
 #include "itkTranslationTransform.h"
 #include "itkCompositeTransform.h"
@@ -289,22 +289,22 @@ DoConversion( int argc, char *argv[] )
       std::cerr << "Can't read Reference Volume " << referenceVolume << std::endl;
       return EXIT_FAILURE;
       }
-    // Allocate Displacement Field
     typedef itk::Vector<float, 3>     VectorType;
     typedef itk::Image<VectorType, 3> DisplacementFieldType;
-    DisplacementFieldType::Pointer displacementField =
-      itkUtil::AllocateImageFromExample<ReferenceImageType, DisplacementFieldType>(referenceImage);
-
-    typedef itk::ImageRegionIterator<DisplacementFieldType> DisplacementIteratorType;
-    for( DisplacementIteratorType it(displacementField, displacementField->GetLargestPossibleRegion() );
-         !it.IsAtEnd(); ++it )
+    typedef itk::BRAINSTransformToDisplacementFieldFilter<DisplacementFieldType, TScalarType> DisplacementFilterType;
+    typename DisplacementFilterType::Pointer displacementFilter = DisplacementFilterType::New();
+    displacementFilter->SetReferenceImage(referenceImage);
+    displacementFilter->SetTransform(inputXfrm);
+    DisplacementFieldType::Pointer displacementField;
+    try
       {
-      DisplacementFieldType::IndexType dispIndex = it.GetIndex();
-      DisplacementFieldType::PointType fixedPoint, movingPoint;
-      displacementField->TransformIndexToPhysicalPoint(dispIndex, fixedPoint);
-      movingPoint = inputXfrm->TransformPoint(fixedPoint);
-      VectorType displacement = movingPoint - fixedPoint;
-      it.Set(displacement);
+      displacementFilter->Update();
+      displacementField = displacementFilter->GetOutput();
+      }
+    catch( itk::ExceptionObject & err )
+      {
+      std::cerr << "Error computing the displacement field: " << err << std::endl;
+      return EXIT_FAILURE;
       }
 
     try
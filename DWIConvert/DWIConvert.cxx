@@ -76,6 +76,7 @@ int main(int argc, char *argv[])
     dWIConvert.setfMRIOutput (fMRIOutput);
     dWIConvert.setTranspose (transpose);
     dWIConvert.setAllowLossyConversion (allowLossyConversion);
+    dWIConvert.setUseCompression (useCompression);
     dWIConvert.setUseIdentityMeasurementFrame (useIdentityMeaseurementFrame);
     dWIConvert.setUseBMatrixGradientDirections (useBMatrixGradientDirections);
 
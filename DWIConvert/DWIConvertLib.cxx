@@ -29,6 +29,7 @@ DWIConvert::DWIConvert()
     m_fMRIOutput = false; //default: false
     m_transpose = false; //default:false
     m_allowLossyConversion = false; //defualt: false
+    m_useCompression = false; //default: false
     m_useIdentityMeasurementFrame = false; //default: false
     m_useBMatrixGradientDirections = false; //default: false
 
@@ -161,6 +162,8 @@ int DWIConvert::write(const std::string& outputVolume)
     m_converter->ConvertBVectorsToIdentityMeasurementFrame();
   }
 
+  m_converter->SetUseCompression(m_useCompression);
+
   std::string outputVolumeHeaderName(m_outputVolume);
   { // concatenate with outputDirectory
     if( m_outputVolume.find("/") == std::string::npos &&
@@ -395,6 +398,14 @@ void DWIConvert::setAllowLossyConversion(bool allowLossyConversion) {
   m_allowLossyConversion = allowLossyConversion;
 }
 
+bool DWIConvert::isUseCompression() const {
+  return m_useCompression;
+}
+
+void DWIConvert::setUseCompression(bool useCompression) {
+  m_useCompression = useCompression;
+}
+
 bool DWIConvert::isUseIdentityMeasurementFrame() const {
   return m_useIdentityMeasurementFrame;
 }
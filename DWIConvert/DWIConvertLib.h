@@ -64,6 +64,10 @@ public:
 
     void setAllowLossyConversion(bool allowLossyConversion);
 
+    bool isUseCompression() const;
+
+    void setUseCompression(bool useCompression);
+
     bool isUseIdentityMeasurementFrame() const;
 
     void setUseIdentityMeasurementFrame(bool useIdentityMeasurementFrame);
@@ -113,6 +117,7 @@ private:
     bool m_fMRIOutput; //default: false
     bool m_transpose; //default:false
     bool m_allowLossyConversion; //defualt: false
+    bool m_useCompression; //default: false
     bool m_useIdentityMeasurementFrame; //default: false
     bool m_useBMatrixGradientDirections; //default: false
 
@@ -3,10 +3,102 @@
 //
 
 #include "DWIConverter.h"
+#include "DWIStreamingWriter.h"
 #include "itkFlipImageFilter.h"
+#include "itkByteSwapper.h"
+#include "itkNumericTraits.h"
+#include "itksys/SystemTools.hxx"
+#include "nifti1_io.h"
+
+namespace
+{
+/** stream the image data one slab (e.g. one gradient volume) at a time,
+ *  only a slab is ever copied when the bytes have to be swapped */
+void WriteSlabs(DWIStreamingWriter & writer, const PixelValueType *buffer, const size_t slabSize,
+                const size_t numberOfSlabs, const bool littleEndian)
+{
+  const bool swap = littleEndian && itk::ByteSwapper<PixelValueType>::SystemIsBigEndian();
+  std::vector<PixelValueType> swapped;
+  for( size_t slab = 0; slab < numberOfSlabs; ++slab )
+  {
+    const PixelValueType *data = buffer + slab * slabSize;
+    if( swap )
+    {
+      swapped.assign(data, data + slabSize);
+      itk::ByteSwapper<PixelValueType>::SwapRangeFromSystemToLittleEndian(&swapped[0], slabSize);
+      data = &swapped[0];
+    }
+    writer.Write(data, slabSize * sizeof(PixelValueType));
+  }
+}
+
+/** NIfTI-1 header of a 4D image, with the qform and sform both set from
+ *  the LPS geometry of the image converted to RAS */
+nifti_1_header MakeNIfTIHeader(const Volume4DType *img4D)
+{
+  nifti_1_header hdr;
+  memset(&hdr, 0, sizeof(hdr));
+  hdr.sizeof_hdr = sizeof(nifti_1_header);
+
+  const Volume4DType::SizeType    size = img4D->GetLargestPossibleRegion().GetSize();
+  const Volume4DType::SpacingType spacing = img4D->GetSpacing();
+  hdr.dim[0] = 4;
+  for( unsigned i = 0; i < 4; ++i )
+  {
+    // NIfTI-1 stores the dimensions as short
+    if( size[i] > static_cast<Volume4DType::SizeValueType>( itk::NumericTraits<short>::max() ) )
+    {
+      itkGenericExceptionMacro( << "Dimension " << i << " of size " << size[i]
+                                << " exceeds the NIfTI-1 limit of " << itk::NumericTraits<short>::max() );
+    }
+    hdr.dim[i + 1] = static_cast<short>(size[i]);
+    hdr.pixdim[i + 1] = static_cast<float>(spacing[i]);
+  }
+  for( unsigned i = 5; i < 8; ++i )
+  {
+    hdr.dim[i] = 1;
+  }
+  hdr.datatype = DT_INT16;
+  hdr.bitpix = 8 * sizeof(PixelValueType);
+  hdr.vox_offset = 352; // header and the empty extension flag
+  hdr.scl_slope = 1;
+  hdr.xyzt_units = NIFTI_UNITS_MM | NIFTI_UNITS_SEC;
+  hdr.qform_code = NIFTI_XFORM_SCANNER_ANAT;
+  hdr.sform_code = NIFTI_XFORM_SCANNER_ANAT;
+  strncpy(hdr.magic, "n+1", sizeof(hdr.magic));
+
+  const Volume4DType::DirectionType direction = img4D->GetDirection();
+  const Volume4DType::PointType     origin = img4D->GetOrigin();
+  mat44 ijkToRAS;
+  memset(&ijkToRAS, 0, sizeof(ijkToRAS));
+  for( unsigned i = 0; i < 3; ++i )
+  {
+    const double toRAS = ( i < 2 ) ? -1.0 : 1.0;
+    for( unsigned j = 0; j < 3; ++j )
+    {
+      ijkToRAS.m[i][j] = static_cast<float>(toRAS * direction[i][j] * spacing[j]);
+    }
+    ijkToRAS.m[i][3] = static_cast<float>(toRAS * origin[i]);
+  }
+  ijkToRAS.m[3][3] = 1.0f;
+  nifti_mat44_to_quatern(ijkToRAS, &hdr.quatern_b, &hdr.quatern_c, &hdr.quatern_d,
+                         &hdr.qoffset_x, &hdr.qoffset_y, &hdr.qoffset_z,
+                         ITK_NULLPTR, ITK_NULLPTR, ITK_NULLPTR, &hdr.pixdim[0]);
+  for( unsigned j = 0; j < 4; ++j )
+  {
+    hdr.srow_x[j] = ijkToRAS.m[0][j];
+    hdr.srow_y[j] = ijkToRAS.m[1][j];
+    hdr.srow_z[j] = ijkToRAS.m[2][j];
+  }
+  return hdr;
+}
+}
+
 DWIConverter::DWIConverter( const FileNamesContainer &inputFileNames, const bool FSLFileFormatHorizontalBy3Rows )
         :
         m_InputFileNames(inputFileNames),
+        m_allowLossyConversion(false),
+        m_UseCompression(false),
         m_FSLFileFormatHorizontalBy3Rows(FSLFileFormatHorizontalBy3Rows),
         m_SlicesPerVolume(0),
         m_NSlice(0),
@@ -116,6 +208,17 @@ Volume4DType::Pointer DWIConverter::OrientForFSLConventions( const bool toFSL)
   //
   // FSL wants the second and third dimensions flipped with regards to LPS orientation
   // FSL wants the second and third dimeinsions flipped with regards to LPS orientation
+  bool anyAxisFlip = false;
+  for(size_t i=0; i< Volume4DType::ImageDimension; ++i)
+  {
+    anyAxisFlip = anyAxisFlip || arrayAxisFlip[i];
+  }
+  if( !anyAxisFlip )
+  {
+    // Already in the desired layout, keep sharing the buffer
+    this->m_Volume = FourDToThreeDImage(image4D);
+    return image4D;
+  }
   myFlipper->SetFlipAxes(arrayAxisFlip);
   myFlipper->FlipAboutOriginOff();  //Flip the image and direction cosignes
   // this is similar to a transform of [1 0 0; 0 -1 0; 0 0 -1]
@@ -311,15 +414,14 @@ void DWIConverter::ManualWriteNRRDFile(
   if( extensionPos != std::string::npos )
   {
     outputVolumeDataName = outputVolumeHeaderName.substr(0, extensionPos);
-    outputVolumeDataName += ".raw";
+    outputVolumeDataName += this->m_UseCompression ? ".raw.gz" : ".raw";
   }
 
   itk::NumberToString<double> DoubleConvert;
-  std::ofstream header;
+  std::ostringstream header;
   // std::string headerFileName = outputDir + "/" + outputFileName;
 
   const double maxBvalue = this->GetMaxBValue();
-  header.open(outputVolumeHeaderName.c_str(), std::ios_base::out | std::ios_base::binary);
   header << "NRRD0005" << std::endl
          << std::setprecision(17) << std::scientific;
 
@@ -361,7 +463,7 @@ void DWIConverter::ManualWriteNRRDFile(
   header << "kinds: space space space list" << std::endl;
 
   header << "endian: little" << std::endl;
-  header << "encoding: raw" << std::endl;
+  header << "encoding: " << ( this->m_UseCompression ? "gzip" : "raw" ) << std::endl;
   header << "space units: \"mm\" \"mm\" \"mm\"" << std::endl;
 
   const DWIConverter::Volume3DUnwrappedType::PointType ImageOrigin = this->GetOrigin();
@@ -417,32 +519,37 @@ void DWIConverter::ManualWriteNRRDFile(
   }
   // write data in the same file is .nrrd was chosen
   header << std::endl;;
-  if (nrrdSingleFileFormat) {
-    unsigned long nVoxels = this->GetDiffusionVolume()->GetBufferedRegion().GetNumberOfPixels();
-    header.write(reinterpret_cast<char*>(this->GetDiffusionVolume()->GetBufferPointer()),
-                 nVoxels*sizeof(short));
-  }
-  else {
-    // if we're writing out NRRD, and the split header/data NRRD
-    // format is used, write out the image as a raw volume.
-    itk::ImageFileWriter<DWIConverter::Volume3DUnwrappedType>::Pointer
-            rawWriter = itk::ImageFileWriter<DWIConverter::Volume3DUnwrappedType>::New();
-    itk::RawImageIO<PixelValueType,3>::Pointer rawIO
-            = itk::RawImageIO<PixelValueType,3>::New();
-    rawWriter->SetImageIO(rawIO);
-    rawIO->SetByteOrderToLittleEndian();
-    rawWriter->SetFileName(outputVolumeDataName.c_str());
-    rawWriter->SetInput(this->GetDiffusionVolume());
-    try {
-      rawWriter->Update();
+
+  // The data is streamed from the diffusion volume one gradient volume at
+  // a time, right after the header or into the detached data file.
+  const DWIConverter::Volume3DUnwrappedType::SizeType size = this->GetDiffusionVolume()->GetBufferedRegion().GetSize();
+  const size_t gradientVolumeSize = size[0] * size[1] * this->GetSlicesPerVolume();
+  try
+  {
+    DWIStreamingWriter headerWriter;
+    headerWriter.Open(outputVolumeHeaderName);
+    headerWriter.Write(header.str());
+    if (nrrdSingleFileFormat) {
+      headerWriter.SetCompression(this->m_UseCompression);
+      WriteSlabs(headerWriter, this->GetDiffusionVolume()->GetBufferPointer(), gradientVolumeSize,
+                 this->GetNVolume(), true);
     }
-    catch (itk::ExceptionObject& excp) {
-      std::cerr << "Exception thrown while writing the series to"
-                << outputVolumeDataName << " " << excp << std::endl;
-      std::cerr << excp << std::endl;
+    else {
+      DWIStreamingWriter dataWriter;
+      dataWriter.Open(outputVolumeDataName);
+      dataWriter.SetCompression(this->m_UseCompression);
+      WriteSlabs(dataWriter, this->GetDiffusionVolume()->GetBufferPointer(), gradientVolumeSize,
+                 this->GetNVolume(), true);
+      dataWriter.Close();
     }
+    headerWriter.Close();
+  }
+  catch (itk::ExceptionObject& excp) {
+    std::cerr << "Exception thrown while writing "
+              << outputVolumeHeaderName << std::endl;
+    std::cerr << excp << std::endl;
+    throw;
   }
-  header.close();
   return;
 }
 
@@ -497,7 +604,9 @@ Volume4DType::Pointer DWIConverter::ThreeDToFourDImage(Volume3DUnwrappedType::Po
   img4D->SetDirection(direction4D);
   img4D->SetSpacing(spacing4D);
   img4D->SetOrigin(origin4D);
-  img4D->Allocate();
+  // Both layouts are the same in memory, the 4D image is a view of the
+  // 3D buffer rather than a copy of it.
+  img4D->SetPixelContainer(img->GetPixelContainer());
 
   {
     img4D->SetMetaDataDictionary(img->GetMetaDataDictionary());
@@ -508,10 +617,6 @@ Volume4DType::Pointer DWIConverter::ThreeDToFourDImage(Volume3DUnwrappedType::Po
     itk::EncapsulateMetaData<double>( thisDic, "NRRD_thicknesses", GetThickness());
   }
 
-  const size_t bytecount = img4D->GetLargestPossibleRegion().GetNumberOfPixels()
-                           * sizeof(PixelValueType);
-
-  memcpy(img4D->GetBufferPointer(), img->GetBufferPointer(), bytecount);
   return img4D;
 }
 
@@ -565,7 +670,7 @@ DWIConverter::Volume3DUnwrappedType::Pointer DWIConverter::FourDToThreeDImage(Vo
   img->SetDirection(direction3D);
   img->SetSpacing(spacing3D);
   img->SetOrigin(origin3D);
-  img->Allocate();
+  img->SetPixelContainer(img4D->GetPixelContainer());
 
   {
     img->SetMetaDataDictionary(img4D->GetMetaDataDictionary());
@@ -576,10 +681,6 @@ DWIConverter::Volume3DUnwrappedType::Pointer DWIConverter::FourDToThreeDImage(Vo
     itk::EncapsulateMetaData<double>( thisDic, "NRRD_thicknesses", GetThickness());
   }
 
-  const size_t bytecount = img->GetLargestPossibleRegion().GetNumberOfPixels()
-                           * sizeof(PixelValueType);
-
-  memcpy(img->GetBufferPointer(), img4D->GetBufferPointer(), bytecount);
   return img;
 }
 
@@ -594,18 +695,21 @@ void DWIConverter::WriteFSLFormattedFileSet(const std::string& outputVolumeHeade
                                       << std::endl);
   }
 
-  {
-    //Set the qform and sfrom codes for the MetaDataDictionary.
-    itk::MetaDataDictionary & thisDic = img4D->GetMetaDataDictionary();
-    itk::EncapsulateMetaData< std::string >( thisDic, "qform_code_name", "NIFTI_XFORM_SCANNER_ANAT" );
-    itk::EncapsulateMetaData< std::string >( thisDic, "sform_code_name", "NIFTI_XFORM_SCANNER_ANAT" );
-  }
-  itk::ImageFileWriter<Volume4DType>::Pointer imgWriter = itk::ImageFileWriter<Volume4DType>::New();
-  imgWriter->SetInput( img4D );
-  imgWriter->SetFileName( outputVolumeHeaderName.c_str() );
+  // The header and the data are streamed straight from the 4D image
+  // buffer, a .nii.gz file is compressed on several threads.
+  const bool compressed = itksys::SystemTools::StringEndsWith(outputVolumeHeaderName.c_str(), ".nii.gz");
+  const nifti_1_header niftiHeader = MakeNIfTIHeader(img4D);
+  const char niftiExtension[4] = { 0, 0, 0, 0 };
+  const Volume4DType::SizeType size4D = img4D->GetBufferedRegion().GetSize();
   try
   {
-    imgWriter->Update();
+    DWIStreamingWriter imgWriter;
+    imgWriter.Open(outputVolumeHeaderName);
+    imgWriter.SetCompression(compressed);
+    imgWriter.Write(&niftiHeader, sizeof(niftiHeader));
+    imgWriter.Write(niftiExtension, sizeof(niftiExtension));
+    WriteSlabs(imgWriter, img4D->GetBufferPointer(), size4D[0] * size4D[1] * size4D[2], size4D[3], false);
+    imgWriter.Close();
   }
   catch( itk::ExceptionObject & excp )
   {
@@ -651,6 +755,8 @@ void DWIConverter::WriteFSLFormattedFileSet(const std::string& outputVolumeHeade
 
 void DWIConverter::SetAllowLossyConversion(const bool newValue) { this->m_allowLossyConversion = newValue; }
 
+void DWIConverter::SetUseCompression(const bool newValue) { this->m_UseCompression = newValue; }
+
 double DWIConverter::ComputeMaxBvalue(const std::vector<double> &bValues) const
 {
   double maxBvalue(0.0);
@@ -190,6 +190,12 @@ public:
    */
   void SetAllowLossyConversion(const bool newValue);
 
+  /**
+   * @brief Gzip the NRRD data, NIfTI files are compressed when their name ends in .nii.gz
+   * @param useCompression (default false)
+   */
+  void SetUseCompression(const bool newValue);
+
   //add by Hui Xie
   Volume3DUnwrappedType::Pointer getVolumePointer();
   double readThicknessFromDict();
@@ -207,6 +213,7 @@ protected:
    */
   const FileNamesContainer  m_InputFileNames;
   bool m_allowLossyConversion; // Allow type-cast conversion from float to short storage format
+  bool m_UseCompression; // gzip the NRRD output data
 
 
   /** double conversion instance, for optimal printing of numbers as  text */
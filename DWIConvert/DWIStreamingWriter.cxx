@@ -0,0 +1,175 @@
+/*=========================================================================
+ *
+ *  Copyright SINAPSE: Scalable Informatics for Neuroscience, Processing and Software Engineering
+ *            The University of Iowa
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#include "DWIStreamingWriter.h"
+#include "itkMacro.h"
+#include "itk_zlib.h"
+#include <algorithm>
+#include <cstring>
+
+DWIStreamingWriter::DWIStreamingWriter() :
+  m_Compress(false),
+  m_BlockSize(1024 * 1024),
+  m_NumberOfThreads(itk::MultiThreader::GetGlobalDefaultNumberOfThreads() ),
+  m_CompressionFailed(false)
+{
+}
+
+DWIStreamingWriter::~DWIStreamingWriter()
+{
+  if( this->m_Stream.is_open() )
+  {
+    try
+    {
+      this->Close();
+    }
+    catch( itk::ExceptionObject & excp )
+    {
+      std::cerr << excp << std::endl;
+    }
+  }
+}
+
+void DWIStreamingWriter::Open(const std::string & fileName)
+{
+  this->m_FileName = fileName;
+  this->m_Stream.open(fileName.c_str(), std::ios_base::out | std::ios_base::binary | std::ios_base::trunc);
+  if( !this->m_Stream.is_open() )
+  {
+    itkGenericExceptionMacro(<< "Can not open " << fileName << " for writing");
+  }
+  // enough pending data to keep every thread busy with one block
+  this->m_Pending.reserve(this->m_BlockSize * this->m_NumberOfThreads);
+}
+
+void DWIStreamingWriter::Close()
+{
+  this->FlushPending();
+  this->m_Stream.close();
+  if( this->m_Stream.fail() )
+  {
+    itkGenericExceptionMacro(<< "Error writing " << this->m_FileName);
+  }
+}
+
+void DWIStreamingWriter::SetCompression(const bool compress)
+{
+  this->FlushPending();
+  this->m_Compress = compress;
+}
+
+void DWIStreamingWriter::SetCompressionBlockSize(const size_t blockSize)
+{
+  this->FlushPending();
+  this->m_BlockSize = std::max<size_t>(blockSize, 64 * 1024);
+}
+
+void DWIStreamingWriter::Write(const void *data, const size_t numberOfBytes)
+{
+  if( !this->m_Compress )
+  {
+    this->m_Stream.write(static_cast<const char *>(data), numberOfBytes);
+    return;
+  }
+
+  const size_t batchSize = this->m_BlockSize * this->m_NumberOfThreads;
+  const char * next = static_cast<const char *>(data);
+  size_t       remaining = numberOfBytes;
+  while( remaining > 0 )
+  {
+    const size_t count = std::min(remaining, batchSize - this->m_Pending.size() );
+    this->m_Pending.insert(this->m_Pending.end(), next, next + count);
+    next += count;
+    remaining -= count;
+    if( this->m_Pending.size() == batchSize )
+    {
+      this->FlushPending();
+    }
+  }
+}
+
+void DWIStreamingWriter::FlushPending()
+{
+  if( this->m_Pending.empty() )
+  {
+    return;
+  }
+
+  const size_t numberOfBlocks = ( this->m_Pending.size() + this->m_BlockSize - 1 ) / this->m_BlockSize;
+  this->m_CompressedBlocks.resize(numberOfBlocks);
+  this->m_CompressionFailed = false;
+
+  ThreadStruct str;
+  str.Writer = this;
+  str.NumberOfBlocks = numberOfBlocks;
+  itk::MultiThreader::Pointer threader = itk::MultiThreader::New();
+  threader->SetNumberOfThreads(
+    static_cast<itk::ThreadIdType>(std::min<size_t>(this->m_NumberOfThreads, numberOfBlocks) ) );
+  threader->SetSingleMethod(CompressThreaderCallback, &str);
+  threader->SingleMethodExecute();
+
+  if( this->m_CompressionFailed )
+  {
+    itkGenericExceptionMacro(<< "Error compressing the data of " << this->m_FileName);
+  }
+  for( size_t block = 0; block < numberOfBlocks; ++block )
+  {
+    const std::vector<unsigned char> & compressed = this->m_CompressedBlocks[block];
+    this->m_Stream.write(reinterpret_cast<const char *>(&compressed[0]), compressed.size() );
+  }
+  this->m_Pending.clear();
+}
+
+ITK_THREAD_RETURN_TYPE DWIStreamingWriter::CompressThreaderCallback(void *arg)
+{
+  itk::MultiThreader::ThreadInfoStruct *info = static_cast<itk::MultiThreader::ThreadInfoStruct *>(arg);
+  ThreadStruct *str = static_cast<ThreadStruct *>(info->UserData);
+
+  for( size_t block = info->ThreadID; block < str->NumberOfBlocks; block += info->NumberOfThreads )
+  {
+    str->Writer->CompressBlock(block);
+  }
+  return ITK_THREAD_RETURN_VALUE;
+}
+
+void DWIStreamingWriter::CompressBlock(const size_t block)
+{
+  const size_t start = block * this->m_BlockSize;
+  const size_t count = std::min(this->m_BlockSize, this->m_Pending.size() - start);
+  std::vector<unsigned char> & compressed = this->m_CompressedBlocks[block];
+
+  z_stream strm;
+  memset(&strm, 0, sizeof(strm) );
+  // 15 + 16 window bits: a gzip header and trailer around the deflate data
+  if( deflateInit2(&strm, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK )
+  {
+    this->m_CompressionFailed = true;
+    return;
+  }
+  compressed.resize(deflateBound(&strm, count) );
+  strm.next_in = reinterpret_cast<Bytef *>(&this->m_Pending[start]);
+  strm.avail_in = static_cast<uInt>(count);
+  strm.next_out = &compressed[0];
+  strm.avail_out = static_cast<uInt>(compressed.size() );
+  if( deflate(&strm, Z_FINISH) != Z_STREAM_END )
+  {
+    this->m_CompressionFailed = true;
+  }
+  compressed.resize(strm.total_out);
+  deflateEnd(&strm);
+}
@@ -0,0 +1,90 @@
+/*=========================================================================
+ *
+ *  Copyright SINAPSE: Scalable Informatics for Neuroscience, Processing and Software Engineering
+ *            The University of Iowa
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#ifndef __DWIStreamingWriter_h
+#define __DWIStreamingWriter_h
+
+#include <fstream>
+#include <string>
+#include <vector>
+#include "itkMultiThreader.h"
+
+/** Writes a converted DWI file piece by piece as the data is handed over.
+ *
+ *  Bytes are either written as they are (e.g. a NRRD header) or gzip
+ *  compressed.  Compressed data is cut into blocks that are deflated on
+ *  several threads, each block a complete gzip member.  The members are
+ *  written in order, and a sequence of gzip members is itself a valid gzip
+ *  file that zlib based readers (NrrdIO, znzlib, gunzip) read as a single
+ *  stream.
+ */
+class DWIStreamingWriter
+{
+public:
+  DWIStreamingWriter();
+  ~DWIStreamingWriter();
+
+  /** open the output file, throws if it can not be created */
+  void Open(const std::string & fileName);
+
+  /** flush the pending compressed data and close the file */
+  void Close();
+
+  /** compress the bytes written from now on, the data written before is
+   *  flushed first */
+  void SetCompression(const bool compress);
+
+  /** size of the independently compressed blocks, 1 MiB by default */
+  void SetCompressionBlockSize(const size_t blockSize);
+
+  void Write(const void *data, const size_t numberOfBytes);
+
+  void Write(const std::string & text)
+  {
+    this->Write(text.data(), text.size() );
+  }
+
+private:
+  // not implemented
+  DWIStreamingWriter(const DWIStreamingWriter &);
+  void operator=(const DWIStreamingWriter &);
+
+  struct ThreadStruct
+  {
+    DWIStreamingWriter *Writer;
+    size_t              NumberOfBlocks;
+  };
+
+  static ITK_THREAD_RETURN_TYPE CompressThreaderCallback(void *arg);
+
+  /** deflate the pending bytes and append them to the file */
+  void FlushPending();
+
+  void CompressBlock(const size_t block);
+
+  std::string                             m_FileName;
+  std::ofstream                           m_Stream;
+  bool                                    m_Compress;
+  size_t                                  m_BlockSize;
+  itk::ThreadIdType                       m_NumberOfThreads;
+  std::vector<char>                       m_Pending;
+  std::vector<std::vector<unsigned char> > m_CompressedBlocks;
+  bool                                    m_CompressionFailed;
+};
+
+#endif // __DWIStreamingWriter_h
@@ -2,6 +2,46 @@
 // Created by Hui Xie on 12/19/16.
 //
 #include "SiemensDWIConverter.h"
+#include "itkMultiThreader.h"
+#include <cstring>
+
+namespace
+{
+/** the slices of a mosaic image and where they go in the de-mosaiced volume */
+struct DeMosaicThreadStruct
+{
+  const PixelValueType *     Mosaic;
+  PixelValueType *           Volume;
+  /** offset in the mosaic buffer of the first voxel of each slice */
+  const std::vector<size_t> *TileOffsets;
+  size_t                     MosaicRowLength;
+  size_t                     SliceRowLength;
+  size_t                     SliceRows;
+};
+
+/** copy a contiguous share of the slices, one row at a time */
+ITK_THREAD_RETURN_TYPE DeMosaicThreaderCallback(void *arg)
+{
+  itk::MultiThreader::ThreadInfoStruct *info = static_cast<itk::MultiThreader::ThreadInfoStruct *>(arg);
+  const DeMosaicThreadStruct *str = static_cast<const DeMosaicThreadStruct *>(info->UserData);
+
+  const size_t numberOfSlices = str->TileOffsets->size();
+  const size_t chunk = ( numberOfSlices + info->NumberOfThreads - 1 ) / info->NumberOfThreads;
+  const size_t start = std::min(numberOfSlices, info->ThreadID * chunk);
+  const size_t end = std::min(numberOfSlices, start + chunk);
+  const size_t rowBytes = str->SliceRowLength * sizeof(PixelValueType);
+  for( size_t k = start; k < end; ++k )
+  {
+    const PixelValueType *tile = str->Mosaic + ( *str->TileOffsets )[k];
+    PixelValueType *slice = str->Volume + k * str->SliceRows * str->SliceRowLength;
+    for( size_t row = 0; row < str->SliceRows; ++row )
+    {
+      memcpy(slice + row * str->SliceRowLength, tile + row * str->MosaicRowLength, rowBytes);
+    }
+  }
+  return ITK_THREAD_RETURN_VALUE;
+}
+}
 
 SiemensDWIConverter::SiemensDWIConverter (DWIDICOMConverterBase::DCMTKFileVector &allHeaders,
 DWIConverter::FileNamesContainer &inputFileNames,
@@ -477,19 +517,12 @@ void SiemensDWIConverter::DeMosaic()
   );
 
 
-  Volume3DUnwrappedType::RegionType dmRegion = this->m_Volume->GetLargestPossibleRegion();
-  dmRegion.SetSize(2, 1);
-  region.SetSize(0, dmSize[0]);
-  region.SetSize(1, dmSize[1]);
-  region.SetSize(2, 1);
-
-  for( unsigned int k = 0; k < original_slice_number; ++k )
+  // The tile of each slice is found once, then the rows of the tiles are
+  // copied straight into the buffer that is written out.
+  const unsigned int numberOfSlices = std::min<unsigned int>(original_slice_number, dmSize[2]);
+  std::vector<size_t> tileOffsets(numberOfSlices);
+  for( unsigned int k = 0; k < numberOfSlices; ++k )
   {
-    unsigned int new_k = k /* - bad_slice_counter */;
-
-    dmRegion.SetIndex(2, new_k);
-    itk::ImageRegionIteratorWithIndex<Volume3DUnwrappedType> dmIt( this->m_Volume, dmRegion );
-
     // figure out the mosaic region for this slice
     int sliceIndex = k;
 
@@ -498,16 +531,24 @@ void SiemensDWIConverter::DeMosaic()
     sliceIndex -= slcMosaic * m_SlicesPerVolume;
     int colMosaic = sliceIndex / this->m_MMosaic;
     int rawMosaic = sliceIndex - this->m_MMosaic * colMosaic;
-    region.SetIndex( 0, rawMosaic * dmSize[0] );
-    region.SetIndex( 1, colMosaic * dmSize[1] );
-    region.SetIndex( 2, slcMosaic );
-
-    itk::ImageRegionConstIteratorWithIndex<Volume3DUnwrappedType> imIt( previousImage, region );
-    for( dmIt.GoToBegin(), imIt.GoToBegin(); !dmIt.IsAtEnd(); ++dmIt, ++imIt )
-    {
-      dmIt.Set( imIt.Get() );
-    }
+    tileOffsets[k] = ( static_cast<size_t>( slcMosaic ) * size[1] + colMosaic * dmSize[1] ) * size[0]
+      + rawMosaic * dmSize[0];
   }
+
+  DeMosaicThreadStruct str;
+  str.Mosaic = previousImage->GetBufferPointer();
+  str.Volume = this->m_Volume->GetBufferPointer();
+  str.TileOffsets = &tileOffsets;
+  str.MosaicRowLength = size[0];
+  str.SliceRowLength = dmSize[0];
+  str.SliceRows = dmSize[1];
+
+  itk::MultiThreader::Pointer threader = itk::MultiThreader::New();
+  threader->SetNumberOfThreads(
+    static_cast<itk::ThreadIdType>( std::max<unsigned int>(1, std::min<unsigned int>(threader->GetNumberOfThreads(),
+                                                                                     numberOfSlices) ) ) );
+  threader->SetSingleMethod(DeMosaicThreaderCallback, &str);
+  threader->SingleMethodExecute();
 }
 
 unsigned int SiemensDWIConverter::ConvertFromCharPtr(const char *s)
@@ -0,0 +1,285 @@
+/*=========================================================================
+ *
+ *  Copyright SINAPSE: Scalable Informatics for Neuroscience, Processing and Software Engineering
+ *            The University of Iowa
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+/*
+ * Round trip of the streamed DWIConvert writers: a small synthetic DWI is
+ * written as .nii, .nii.gz, a gzip compressed detached .nhdr and a .nrrd,
+ * and each file is read back through itk::ImageFileReader.  The NIfTI files
+ * are compared with the output of the ITK NIfTI writer that DWIConvert used
+ * before, including the qform and the sform; the NRRD files with the input.
+ */
+#include "DWIConvertLib.h"
+#include "DWIMetaDataDictionaryValidator.h"
+#include "itkImageFileReader.h"
+#include "itkImageFileWriter.h"
+#include "itkImageRegionConstIterator.h"
+#include "itkImageRegionIteratorWithIndex.h"
+#include "itkMetaDataObject.h"
+#include "nifti1_io.h"
+#include <cmath>
+#include <iostream>
+#include <limits>
+
+typedef itk::VectorImage<PixelValueType, 3> VectorImageType;
+
+static VectorImageType::Pointer MakeDWI()
+{
+  const unsigned int numberOfGradients = 5;
+
+  VectorImageType::SizeType size;
+  size[0] = 6;
+  size[1] = 5;
+  size[2] = 4;
+  VectorImageType::SpacingType spacing;
+  spacing[0] = 1.5;
+  spacing[1] = 2.0;
+  spacing[2] = 2.5;
+  VectorImageType::PointType origin;
+  origin[0] = 10.0;
+  origin[1] = -20.0;
+  origin[2] = 30.0;
+  // rotated about the superior axis, so the FSL orientation flips an axis
+  const double                  angle = std::atan(1.0) / 1.5; // 30 degrees
+  VectorImageType::DirectionType direction;
+  direction.SetIdentity();
+  direction[0][0] = std::cos(angle);
+  direction[0][1] = -std::sin(angle);
+  direction[1][0] = std::sin(angle);
+  direction[1][1] = std::cos(angle);
+
+  VectorImageType::Pointer image = VectorImageType::New();
+  image->SetRegions(size);
+  image->SetSpacing(spacing);
+  image->SetOrigin(origin);
+  image->SetDirection(direction);
+  image->SetVectorLength(numberOfGradients);
+  image->Allocate();
+
+  VectorImageType::PixelType pixel(numberOfGradients);
+  for( itk::ImageRegionIteratorWithIndex<VectorImageType> it(image, image->GetLargestPossibleRegion() );
+       !it.IsAtEnd(); ++it )
+    {
+    const VectorImageType::IndexType index = it.GetIndex();
+    for( unsigned int g = 0; g < numberOfGradients; ++g )
+      {
+      pixel[g] = static_cast<PixelValueType>( ( index[0] + 7 * index[1] + 31 * index[2] ) * ( g + 1 ) % 3000 - 1000 );
+      }
+    it.Set(pixel);
+    }
+
+  DWIMetaDataDictionaryValidator validator;
+  std::vector<std::string>       centerings(4, std::string("cell") );
+  centerings[3] = "???";
+  validator.SetCenterings(centerings);
+  std::vector<double> thicknesses(4, std::numeric_limits<double>::quiet_NaN() );
+  thicknesses[2] = spacing[2];
+  validator.SetThicknesses(thicknesses);
+  DWIMetaDataDictionaryValidator::RotationMatrixType measurementFrame;
+  measurementFrame.SetIdentity();
+  validator.SetMeasurementFrame(measurementFrame);
+  validator.SetModality("DWMRI");
+  validator.SetBValue(1000.0);
+  DWIMetaDataDictionaryValidator::GradientTableType gradients(numberOfGradients);
+  for( unsigned int g = 0; g < numberOfGradients; ++g )
+    {
+    for( unsigned int i = 0; i < 3; ++i )
+      {
+      gradients[g][i] = 0.0;
+      }
+    }
+  gradients[1][0] = 1.0;
+  gradients[2][1] = 1.0;
+  gradients[3][2] = 1.0;
+  gradients[4][0] = std::sqrt(0.5);
+  gradients[4][1] = std::sqrt(0.5);
+  validator.SetGradientTable(gradients);
+  image->SetMetaDataDictionary(validator.GetMetaDataDictionary() );
+  return image;
+}
+
+template <typename TImage>
+static typename TImage::Pointer ReadBack(const std::string & fileName)
+{
+  typedef itk::ImageFileReader<TImage> ReaderType;
+  typename ReaderType::Pointer reader = ReaderType::New();
+  reader->SetFileName(fileName);
+  reader->Update();
+  return reader->GetOutput();
+}
+
+/** true when the voxels and the geometry of both images are the same */
+template <typename TImage>
+static bool SameImage(const TImage *image, const TImage *reference, const std::string & name)
+{
+  const double tolerance = 1.0e-4;
+  bool         same = image->GetLargestPossibleRegion().GetSize() == reference->GetLargestPossibleRegion().GetSize()
+    && image->GetNumberOfComponentsPerPixel() == reference->GetNumberOfComponentsPerPixel();
+  for( unsigned int i = 0; same && i < TImage::ImageDimension; ++i )
+    {
+    same = std::fabs(image->GetOrigin()[i] - reference->GetOrigin()[i]) < tolerance
+      && std::fabs(image->GetSpacing()[i] - reference->GetSpacing()[i]) < tolerance;
+    for( unsigned int j = 0; same && j < TImage::ImageDimension; ++j )
+      {
+      same = std::fabs(image->GetDirection()[i][j] - reference->GetDirection()[i][j]) < tolerance;
+      }
+    }
+  if( !same )
+    {
+    std::cerr << name << ": the size or the geometry differs" << std::endl;
+    return false;
+    }
+
+  itk::ImageRegionConstIterator<TImage> it(image, image->GetLargestPossibleRegion() );
+  itk::ImageRegionConstIterator<TImage> refIt(reference, reference->GetLargestPossibleRegion() );
+  for( ; !it.IsAtEnd(); ++it, ++refIt )
+    {
+    if( it.Get() != refIt.Get() )
+      {
+      std::cerr << name << ": the voxels differ" << std::endl;
+      return false;
+      }
+    }
+  return true;
+}
+
+/** true when both NIfTI headers have the same qform and sform */
+static bool SameNIfTITransforms(const std::string & fileName, const std::string & referenceName)
+{
+  nifti_image *nim = nifti_image_read(fileName.c_str(), 0);
+  nifti_image *ref = nifti_image_read(referenceName.c_str(), 0);
+  bool         same = nim != ITK_NULLPTR && ref != ITK_NULLPTR
+    && nim->qform_code == ref->qform_code && nim->sform_code == ref->sform_code;
+
+  for( unsigned int i = 0; same && i < 4; ++i )
+    {
+    for( unsigned int j = 0; same && j < 4; ++j )
+      {
+      same = std::fabs(nim->qto_xyz.m[i][j] - ref->qto_xyz.m[i][j]) < 1.0e-4
+        && std::fabs(nim->sto_xyz.m[i][j] - ref->sto_xyz.m[i][j]) < 1.0e-4;
+      }
+    }
+  nifti_image_free(nim);
+  nifti_image_free(ref);
+  if( !same )
+    {
+    std::cerr << fileName << ": the qform or the sform differs from " << referenceName << std::endl;
+    }
+  return same;
+}
+
+static int Convert(const std::string & inputName, const std::string & outputName, const bool useCompression)
+{
+  DWIConvert converter;
+
+  converter.setInputFileType(inputName, "");
+  converter.setOutputVolume(outputName);
+  converter.setUseCompression(useCompression);
+  if( converter.read() != EXIT_SUCCESS )
+    {
+    return EXIT_FAILURE;
+    }
+  return converter.write(outputName);
+}
+
+int main(int argc, char *argv[])
+{
+  if( argc < 2 )
+    {
+    std::cerr << "Usage: " << argv[0] << " outputDirectory" << std::endl;
+    return EXIT_FAILURE;
+    }
+  const std::string directory = std::string(argv[1]) + "/";
+  const std::string inputName = directory + "DWIConvertWriteRoundTripInput.nrrd";
+  const std::string referenceName = directory + "DWIConvertWriteRoundTripReference.nii";
+
+  bool allPass = true;
+  try
+    {
+    VectorImageType::Pointer input = MakeDWI();
+      {
+      itk::ImageFileWriter<VectorImageType>::Pointer writer = itk::ImageFileWriter<VectorImageType>::New();
+      writer->SetInput(input);
+      writer->SetFileName(inputName);
+      writer->Update();
+      }
+
+    // The FSL image written by the ITK NIfTI writer, as DWIConvert did
+    // before the header was written by hand
+      {
+      DWIConvert reference;
+      reference.setInputFileType(inputName, "");
+      reference.setOutputVolume(referenceName);
+      if( reference.read() != EXIT_SUCCESS )
+        {
+        return EXIT_FAILURE;
+        }
+      DWIConverter *converter = reference.getConverter();
+      converter->ConvertBVectorsToIdentityMeasurementFrame();
+      converter->ConvertToMutipleBValuesUnitScaledBVectors();
+      Volume4DType::Pointer     img4D = converter->OrientForFSLConventions();
+      itk::MetaDataDictionary & thisDic = img4D->GetMetaDataDictionary();
+      itk::EncapsulateMetaData<std::string>( thisDic, "qform_code_name", "NIFTI_XFORM_SCANNER_ANAT" );
+      itk::EncapsulateMetaData<std::string>( thisDic, "sform_code_name", "NIFTI_XFORM_SCANNER_ANAT" );
+      itk::ImageFileWriter<Volume4DType>::Pointer writer = itk::ImageFileWriter<Volume4DType>::New();
+      writer->SetInput(img4D);
+      writer->SetFileName(referenceName);
+      writer->Update();
+      }
+    Volume4DType::Pointer referenceImage = ReadBack<Volume4DType>(referenceName);
+
+    const char * const niftiNames[] = { "DWIConvertWriteRoundTrip.nii", "DWIConvertWriteRoundTrip.nii.gz" };
+    for( unsigned int i = 0; i < 2; ++i )
+      {
+      const std::string outputName = directory + niftiNames[i];
+      if( Convert(inputName, outputName, false) != EXIT_SUCCESS )
+        {
+        std::cerr << "Writing " << outputName << " failed" << std::endl;
+        allPass = false;
+        continue;
+        }
+      allPass = SameImage<Volume4DType>(ReadBack<Volume4DType>(outputName), referenceImage, outputName) && allPass;
+      allPass = SameNIfTITransforms(outputName, referenceName) && allPass;
+      }
+
+    const char * const nrrdNames[] = { "DWIConvertWriteRoundTrip.nhdr", "DWIConvertWriteRoundTrip.nrrd" };
+    for( unsigned int i = 0; i < 2; ++i )
+      {
+      const std::string outputName = directory + nrrdNames[i];
+      // the detached header is written with gzip compressed data
+      if( Convert(inputName, outputName, i == 0) != EXIT_SUCCESS )
+        {
+        std::cerr << "Writing " << outputName << " failed" << std::endl;
+        allPass = false;
+        continue;
+        }
+      allPass = SameImage<VectorImageType>(ReadBack<VectorImageType>(outputName), input, outputName) && allPass;
+      }
+    }
+  catch( itk::ExceptionObject & e )
+    {
+    std::cerr << e << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  if( !allPass )
+    {
+    return EXIT_FAILURE;
+    }
+  std::cout << "All round trips pass" << std::endl;
+  return EXIT_SUCCESS;
+}
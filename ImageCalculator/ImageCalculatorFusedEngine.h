@@ -0,0 +1,638 @@
+/*=========================================================================
+ *
+ *  Copyright SINAPSE: Scalable Informatics for Neuroscience, Processing and Software Engineering
+ *            The University of Iowa
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#if !defined(__ImageCalculatorFusedEngine_h____)
+#define __ImageCalculatorFusedEngine_h____
+
+/* The fused engine evaluates the whole chain of per-voxel ImageCalculator
+ * operations (input filters, the binary accumulation operation, the
+ * avg/var normalization, the output cast and the output filters) without
+ * allocating an intermediate image for each step.
+ *
+ * Every operation is compiled into a small program of voxel instructions.
+ * A program is executed over cache sized blocks of contiguous voxels, with
+ * each instruction being a tight loop over the block so that the compiler
+ * can vectorize it.  The image buffer is split across the ITK threads.
+ *
+ * Only the neighborhood operations (gaussian smoothing) force the
+ * materialization of an image; the instructions before the smoothing are
+ * fused into the pass that produces the image to be smoothed and the
+ * instructions after it are fused into the consuming pass.
+ *
+ * The arithmetic of every instruction is identical to the functor and
+ * ITK filter it replaces, including the cast back to the storage type
+ * after each step, so results are bit-for-bit identical to the
+ * non fused pipeline. */
+
+#include "itkImage.h"
+#include "itkMultiThreader.h"
+#include "itkNumericTraits.h"
+#include <metaCommand.h>
+#include <vector>
+#include <string>
+#include <sstream>
+#include <cmath>
+#include <algorithm>
+
+namespace ImageCalculatorFused
+{
+/** Number of voxels processed by one instruction before moving on to the
+ * next instruction.  Small enough to keep the block in L1 for every
+ * supported pixel type. */
+const size_t BlockSize = 1024;
+
+enum VoxelOperationCode
+  {
+  MultiplyConstant,
+  DivideConstant,
+  AddConstant,
+  SubtractConstant,
+  Binarize,
+  Square,
+  SquareRoot
+  };
+
+enum AccumulateOperationCode
+  {
+  AccumulateMultiply,
+  AccumulateAdd,
+  AccumulateSubtract,
+  AccumulateDivide
+  };
+
+template <class PixelType>
+struct VoxelOperation
+  {
+  VoxelOperationCode m_Code;
+  PixelType          m_Value;
+  };
+
+/* A straight line list of per-voxel instructions. */
+template <class PixelType>
+class VoxelOperationProgram
+{
+public:
+  void Append(const VoxelOperationCode code, const PixelType value = PixelType() )
+  {
+    VoxelOperation<PixelType> op;
+
+    op.m_Code = code;
+    op.m_Value = value;
+    this->m_Operations.push_back(op);
+  }
+
+  void Append(const VoxelOperationProgram & other)
+  {
+    this->m_Operations.insert(this->m_Operations.end(), other.m_Operations.begin(), other.m_Operations.end() );
+  }
+
+  bool Empty() const
+  {
+    return this->m_Operations.empty();
+  }
+
+  /* Execute all instructions in place over one block of voxels. */
+  void Execute(PixelType * const block, const size_t n) const
+  {
+    for( typename std::vector<VoxelOperation<PixelType> >::const_iterator it = this->m_Operations.begin();
+         it != this->m_Operations.end(); ++it )
+      {
+      const PixelType value = it->m_Value;
+      switch( it->m_Code )
+        {
+        case MultiplyConstant:
+          for( size_t i = 0; i < n; ++i )
+            {
+            block[i] = static_cast<PixelType>(block[i] * value);
+            }
+          break;
+        case DivideConstant:
+          for( size_t i = 0; i < n; ++i )
+            {
+            block[i] = static_cast<PixelType>(block[i] / value);
+            }
+          break;
+        case AddConstant:
+          for( size_t i = 0; i < n; ++i )
+            {
+            block[i] = static_cast<PixelType>(block[i] + value);
+            }
+          break;
+        case SubtractConstant:
+          for( size_t i = 0; i < n; ++i )
+            {
+            block[i] = static_cast<PixelType>(block[i] - value);
+            }
+          break;
+        case Binarize:
+          for( size_t i = 0; i < n; ++i )
+            {
+            block[i] = static_cast<PixelType>(block[i] > 0 ? 255 : 0);
+            }
+          break;
+        case Square:
+          for( size_t i = 0; i < n; ++i )
+            {
+            block[i] = static_cast<PixelType>(block[i] * block[i]);
+            }
+          break;
+        case SquareRoot:
+          for( size_t i = 0; i < n; ++i )
+            {
+            block[i] = static_cast<PixelType>(std::sqrt(static_cast<double>(block[i]) ) );
+            }
+          break;
+        }
+      }
+  }
+
+private:
+  std::vector<VoxelOperation<PixelType> > m_Operations;
+};
+
+/* The compiled form of the -if* or -of* command line filters.  The
+ * instructions are split around the (optional) gaussian smoothing, which
+ * is the only operation that needs a neighborhood. */
+template <class PixelType>
+struct FilterStage
+  {
+  FilterStage() : m_HasSmoothing(false), m_Sigma(0.0)
+  {
+  }
+
+  /* Program that is valid when the stage is fused in a single pass */
+  VoxelOperationProgram<PixelType> FusedProgram() const
+  {
+    VoxelOperationProgram<PixelType> program = this->m_PreSmoothing;
+
+    program.Append(this->m_PostSmoothing);
+    return program;
+  }
+
+  VoxelOperationProgram<PixelType> m_PreSmoothing;
+  bool                             m_HasSmoothing;
+  double                           m_Sigma;
+  VoxelOperationProgram<PixelType> m_PostSmoothing;
+  };
+
+/* Compile the filter options given with prefix "I" (input, -if*) or "O"
+ * (output, -of*) in the same order they are applied by Ifilters/Ofilters. */
+template <class PixelType>
+FilterStage<PixelType>
+CompileFilterStage(MetaCommand & command, const std::string & prefix, std::stringstream & effectiveFilters)
+{
+  const std::string lowerPrefix = (prefix == "I") ? "if" : "of";
+
+  FilterStage<PixelType> stage;
+
+  const char * const    constantNames[] = { "MulC", "DivC", "AddC", "SubC" };
+  const char * const    constantFlags[] = { "mulc", "divc", "addc", "subc" };
+  const VoxelOperationCode constantCodes[] = { MultiplyConstant, DivideConstant, AddConstant, SubtractConstant };
+  for( unsigned int i = 0; i < 4; ++i )
+    {
+    const std::string option = prefix + constantNames[i];
+    if( command.GetValueAsString(option, "constant") != "" )
+      {
+      const PixelType temp = static_cast<PixelType>(command.GetValueAsFloat(option, "constant") );
+      effectiveFilters << "-" << lowerPrefix << constantFlags[i] << " " << static_cast<double>(temp) << " ";
+      stage.m_PreSmoothing.Append(constantCodes[i], temp);
+      }
+    }
+
+  if( command.GetValueAsString(prefix + "GaussianSigma", "constant") != "" )
+    {
+    stage.m_HasSmoothing = true;
+    stage.m_Sigma = static_cast<double>(command.GetValueAsFloat(prefix + "GaussianSigma", "constant") );
+    effectiveFilters << "-" << lowerPrefix << "gaussiansigma " << stage.m_Sigma << " ";
+    }
+
+  if( command.GetValueAsBool(prefix + "fbin", lowerPrefix + "bin") )
+    {
+    effectiveFilters << "-" << lowerPrefix << "bin ";
+    stage.m_PostSmoothing.Append(Binarize);
+    }
+  if( command.GetValueAsBool(prefix + "Sqr", lowerPrefix + "sqr") )
+    {
+    effectiveFilters << "-" << lowerPrefix << "sqr ";
+    stage.m_PostSmoothing.Append(Square);
+    }
+  if( command.GetValueAsBool(prefix + "Sqrt", lowerPrefix + "sqrt") )
+    {
+    effectiveFilters << "-" << lowerPrefix << "sqrt ";
+    stage.m_PostSmoothing.Append(SquareRoot);
+    }
+  return stage;
+}
+
+/* Same semantic as itk::Functor::Div */
+template <class PixelType>
+inline PixelType SafeDivide(const PixelType & a, const PixelType & b)
+{
+  if( b != itk::NumericTraits<PixelType>::ZeroValue() )
+    {
+    return static_cast<PixelType>(a / b);
+    }
+  return itk::NumericTraits<PixelType>::max(a);
+}
+
+/* Run kernel(start, end) over [0, numberOfVoxels) split across the default
+ * number of ITK threads. */
+template <class TKernel>
+class ParallelVoxelLoop
+{
+public:
+  static void Run(TKernel & kernel, const size_t numberOfVoxels)
+  {
+    ThreadStruct str;
+
+    str.Kernel = &kernel;
+    str.NumberOfVoxels = numberOfVoxels;
+
+    itk::MultiThreader::Pointer threader = itk::MultiThreader::New();
+    const size_t                maxThreads = std::max<size_t>(1, numberOfVoxels / BlockSize);
+    threader->SetNumberOfThreads(
+      static_cast<itk::ThreadIdType>(std::min<size_t>(threader->GetNumberOfThreads(), maxThreads) ) );
+    threader->SetSingleMethod(ThreaderCallback, &str);
+    threader->SingleMethodExecute();
+  }
+
+private:
+  struct ThreadStruct
+    {
+    TKernel *Kernel;
+    size_t NumberOfVoxels;
+    };
+
+  static ITK_THREAD_RETURN_TYPE ThreaderCallback(void *arg)
+  {
+    itk::MultiThreader::ThreadInfoStruct * info = static_cast<itk::MultiThreader::ThreadInfoStruct *>(arg);
+    ThreadStruct *                         str = static_cast<ThreadStruct *>(info->UserData);
+
+    // Chunks are aligned on block boundaries so that every thread except
+    // the last one works on full blocks.
+    const size_t numberOfBlocks = (str->NumberOfVoxels + BlockSize - 1) / BlockSize;
+    const size_t blocksPerThread = (numberOfBlocks + info->NumberOfThreads - 1) / info->NumberOfThreads;
+    const size_t start = std::min(str->NumberOfVoxels, info->ThreadID * blocksPerThread * BlockSize);
+    const size_t end = std::min(str->NumberOfVoxels, start + blocksPerThread * BlockSize);
+    if( start < end )
+      {
+      ( *str->Kernel )(start, end);
+      }
+    return ITK_THREAD_RETURN_VALUE;
+  }
+};
+
+/* One streaming pass of the accumulation:
+ *   value  = inputProgram(input)
+ *   sqrSum = sqrSum + value * value            (when computing variance)
+ *   acc    = acc (op) value                    (for every requested op)
+ */
+template <class PixelType>
+class AccumulateKernel
+{
+public:
+  const PixelType *                           m_Input;
+  PixelType *                                 m_Accumulator;
+  PixelType *                                 m_SquareSum;
+  const VoxelOperationProgram<PixelType> *    m_Program;
+  const std::vector<AccumulateOperationCode> *m_Operations;
+
+  void operator()(const size_t start, const size_t end) const
+  {
+    PixelType block[BlockSize];
+
+    for( size_t offset = start; offset < end; offset += BlockSize )
+      {
+      const size_t n = std::min(BlockSize, end - offset);
+      std::copy(this->m_Input + offset, this->m_Input + offset + n, block);
+      this->m_Program->Execute(block, n);
+
+      if( this->m_SquareSum != ITK_NULLPTR )
+        {
+        PixelType * const sqr = this->m_SquareSum + offset;
+        for( size_t i = 0; i < n; ++i )
+          {
+          sqr[i] = static_cast<PixelType>(sqr[i] + static_cast<PixelType>(block[i] * block[i]) );
+          }
+        }
+
+      PixelType * const acc = this->m_Accumulator + offset;
+      for( typename std::vector<AccumulateOperationCode>::const_iterator op = this->m_Operations->begin();
+           op != this->m_Operations->end(); ++op )
+        {
+        switch( *op )
+          {
+          case AccumulateMultiply:
+            for( size_t i = 0; i < n; ++i )
+              {
+              acc[i] = static_cast<PixelType>(acc[i] * block[i]);
+              }
+            break;
+          case AccumulateAdd:
+            for( size_t i = 0; i < n; ++i )
+              {
+              acc[i] = static_cast<PixelType>(acc[i] + block[i]);
+              }
+            break;
+          case AccumulateSubtract:
+            for( size_t i = 0; i < n; ++i )
+              {
+              acc[i] = static_cast<PixelType>(acc[i] - block[i]);
+              }
+            break;
+          case AccumulateDivide:
+            for( size_t i = 0; i < n; ++i )
+              {
+              acc[i] = SafeDivide<PixelType>(acc[i], block[i]);
+              }
+            break;
+          }
+        }
+      }
+  }
+};
+
+/* Initializes the accumulator (and the square sum) from the first image. */
+template <class PixelType>
+class InitializeKernel
+{
+public:
+  const PixelType *                        m_Input;
+  PixelType *                              m_Accumulator;
+  PixelType *                              m_SquareSum;
+  const VoxelOperationProgram<PixelType> * m_Program;
+
+  void operator()(const size_t start, const size_t end) const
+  {
+    for( size_t offset = start; offset < end; offset += BlockSize )
+      {
+      const size_t n = std::min(BlockSize, end - offset);
+      PixelType *  acc = this->m_Accumulator + offset;
+      if( this->m_SquareSum != ITK_NULLPTR )
+        {
+        // NOTE: As in the historical pipeline the square sum is seeded from
+        // the first image as read, before the input filters.
+        const PixelType * in = this->m_Input + offset;
+        PixelType *       sqr = this->m_SquareSum + offset;
+        for( size_t i = 0; i < n; ++i )
+          {
+          sqr[i] = static_cast<PixelType>(in[i] * in[i]);
+          }
+        }
+      if( acc != this->m_Input + offset )
+        {
+        std::copy(this->m_Input + offset, this->m_Input + offset + n, acc);
+        }
+      this->m_Program->Execute(acc, n);
+      }
+  }
+};
+
+/* Average and variance normalization of the accumulator. */
+template <class PixelType>
+class NormalizeKernel
+{
+public:
+  PixelType *       m_Accumulator;
+  const PixelType * m_SquareSum;
+  int               m_NumberOfImages;
+  bool              m_Average;
+  bool              m_Variance;
+
+  void operator()(const size_t start, const size_t end) const
+  {
+    PixelType * const acc = this->m_Accumulator;
+    const int         nimgs = this->m_NumberOfImages;
+
+    if( this->m_Average )
+      {
+      for( size_t i = start; i < end; ++i )
+        {
+        acc[i] = static_cast<PixelType>(acc[i] / nimgs);
+        }
+      }
+    if( this->m_Variance )
+      {
+      const PixelType numberOfImages = static_cast<PixelType>(nimgs);
+      const PixelType denominator = static_cast<PixelType>(nimgs * nimgs - nimgs);
+      for( size_t i = start; i < end; ++i )
+        {
+        const PixelType numSqr = static_cast<PixelType>(this->m_SquareSum[i] * numberOfImages);
+        const PixelType accSqr = static_cast<PixelType>(acc[i] * acc[i]);
+        const PixelType diff = static_cast<PixelType>(numSqr - accSqr);
+        acc[i] = static_cast<PixelType>(diff / denominator);
+        }
+      }
+  }
+};
+
+/* Cast to the output type fused with the output filter program. */
+template <class InPixelType, class OutPixelType>
+class CastKernel
+{
+public:
+  const InPixelType *                         m_Input;
+  OutPixelType *                              m_Output;
+  const VoxelOperationProgram<OutPixelType> * m_Program;
+
+  void operator()(const size_t start, const size_t end) const
+  {
+    for( size_t offset = start; offset < end; offset += BlockSize )
+      {
+      const size_t         n = std::min(BlockSize, end - offset);
+      const InPixelType *  in = this->m_Input + offset;
+      OutPixelType * const out = this->m_Output + offset;
+      for( size_t i = 0; i < n; ++i )
+        {
+        out[i] = static_cast<OutPixelType>(in[i]);
+        }
+      this->m_Program->Execute(out, n);
+      }
+  }
+};
+
+template <class ImageType>
+typename ImageType::Pointer
+AllocateLike(const ImageType * reference)
+{
+  typename ImageType::Pointer image = ImageType::New();
+  image->CopyInformation(reference);
+  image->SetRegions(reference->GetLargestPossibleRegion() );
+  image->Allocate();
+  return image;
+}
+
+template <class ImageType>
+size_t NumberOfVoxels(const ImageType * image)
+{
+  return image->GetBufferedRegion().GetNumberOfPixels();
+}
+
+/* Applies a program to an image in place. */
+template <class ImageType>
+void ExecuteInPlace(ImageType * image, const VoxelOperationProgram<typename ImageType::PixelType> & program)
+{
+  typedef typename ImageType::PixelType PixelType;
+  if( program.Empty() )
+    {
+    return;
+    }
+  CastKernel<PixelType, PixelType> kernel;
+  kernel.m_Input = image->GetBufferPointer();
+  kernel.m_Output = image->GetBufferPointer();
+  kernel.m_Program = &program;
+  ParallelVoxelLoop<CastKernel<PixelType, PixelType> >::Run(kernel, NumberOfVoxels(image) );
+}
+
+/* Streams input images into an accumulator image, one pass per input
+ * image, with no other intermediate image unless a neighborhood operation
+ * was requested on the inputs. */
+template <class ImageType>
+class FusedAccumulator
+{
+public:
+  typedef typename ImageType::PixelType PixelType;
+  typedef typename ImageType::Pointer   ImagePointer;
+  typedef ImagePointer (*SmoothingFunctionType)(ImagePointer, const double);
+
+  FusedAccumulator(const FilterStage<PixelType> & inputStage,
+                   const std::vector<AccumulateOperationCode> & operations,
+                   const bool accumulateSquares,
+                   SmoothingFunctionType smoothing) :
+    m_InputStage(inputStage),
+    m_Operations(operations),
+    m_AccumulateSquares(accumulateSquares),
+    m_Smoothing(smoothing),
+    m_NumberOfImages(0)
+  {
+    if( this->m_InputStage.m_HasSmoothing )
+      {
+      this->m_StreamingProgram = this->m_InputStage.m_PostSmoothing;
+      }
+    else
+      {
+      this->m_StreamingProgram = this->m_InputStage.FusedProgram();
+      }
+  }
+
+  void Accumulate(const ImagePointer & input)
+  {
+    if( this->m_NumberOfImages == 0 )
+      {
+      this->Initialize(input);
+      }
+    else
+      {
+      const ImagePointer          source = this->PrepareInput(input);
+      AccumulateKernel<PixelType> kernel;
+      kernel.m_Input = source->GetBufferPointer();
+      kernel.m_Accumulator = this->m_Accumulator->GetBufferPointer();
+      kernel.m_SquareSum = this->m_AccumulateSquares ? this->m_SquareSum->GetBufferPointer() : ITK_NULLPTR;
+      kernel.m_Program = &this->m_StreamingProgram;
+      kernel.m_Operations = &this->m_Operations;
+      ParallelVoxelLoop<AccumulateKernel<PixelType> >::Run(kernel, NumberOfVoxels(source.GetPointer() ) );
+      }
+    ++this->m_NumberOfImages;
+  }
+
+  /* The accumulator after the input filters, used for the consistency
+   * checks done between the inputs. */
+  const ImageType * GetAccumulator() const
+  {
+    return this->m_Accumulator.GetPointer();
+  }
+
+  ImagePointer Finalize(const bool average, const bool variance)
+  {
+    if( average || ( variance && this->m_AccumulateSquares ) )
+      {
+      NormalizeKernel<PixelType> kernel;
+      kernel.m_Accumulator = this->m_Accumulator->GetBufferPointer();
+      kernel.m_SquareSum = this->m_AccumulateSquares ? this->m_SquareSum->GetBufferPointer() : ITK_NULLPTR;
+      kernel.m_NumberOfImages = this->m_NumberOfImages;
+      kernel.m_Average = average;
+      kernel.m_Variance = variance && this->m_AccumulateSquares;
+      ParallelVoxelLoop<NormalizeKernel<PixelType> >::Run(kernel, NumberOfVoxels(this->m_Accumulator.GetPointer() ) );
+      }
+    this->m_SquareSum = ITK_NULLPTR;
+    return this->m_Accumulator;
+  }
+
+private:
+  void Initialize(const ImagePointer & input)
+  {
+    if( this->m_AccumulateSquares )
+      {
+      this->m_SquareSum = AllocateLike<ImageType>(input.GetPointer() );
+      }
+    if( this->m_InputStage.m_HasSmoothing )
+      {
+      // The smoothed buffer becomes the accumulator.
+      this->m_Accumulator = this->PrepareInput(input);
+      ExecuteInPlace<ImageType>(this->m_Accumulator, this->m_InputStage.m_PostSmoothing);
+      if( this->m_AccumulateSquares )
+        {
+        VoxelOperationProgram<PixelType> square;
+        square.Append(Square);
+        CastKernel<PixelType, PixelType> kernel;
+        kernel.m_Input = input->GetBufferPointer();
+        kernel.m_Output = this->m_SquareSum->GetBufferPointer();
+        kernel.m_Program = &square;
+        ParallelVoxelLoop<CastKernel<PixelType, PixelType> >::Run(kernel, NumberOfVoxels(input.GetPointer() ) );
+        }
+      return;
+      }
+    this->m_Accumulator = AllocateLike<ImageType>(input.GetPointer() );
+    InitializeKernel<PixelType> kernel;
+    kernel.m_Input = input->GetBufferPointer();
+    kernel.m_Accumulator = this->m_Accumulator->GetBufferPointer();
+    kernel.m_SquareSum = this->m_AccumulateSquares ? this->m_SquareSum->GetBufferPointer() : ITK_NULLPTR;
+    kernel.m_Program = &this->m_StreamingProgram;
+    ParallelVoxelLoop<InitializeKernel<PixelType> >::Run(kernel, NumberOfVoxels(input.GetPointer() ) );
+  }
+
+  /* When the input filters contain a smoothing step the pre smoothing
+   * instructions are applied while copying into the buffer that is then
+   * smoothed; otherwise the input is consumed directly. */
+  ImagePointer PrepareInput(const ImagePointer & input) const
+  {
+    if( !this->m_InputStage.m_HasSmoothing )
+      {
+      return input;
+      }
+    ImagePointer filtered = AllocateLike<ImageType>(input.GetPointer() );
+    CastKernel<PixelType, PixelType> kernel;
+    kernel.m_Input = input->GetBufferPointer();
+    kernel.m_Output = filtered->GetBufferPointer();
+    kernel.m_Program = &this->m_InputStage.m_PreSmoothing;
+    ParallelVoxelLoop<CastKernel<PixelType, PixelType> >::Run(kernel, NumberOfVoxels(input.GetPointer() ) );
+    return this->m_Smoothing(filtered, this->m_InputStage.m_Sigma);
+  }
+
+  FilterStage<PixelType>               m_InputStage;
+  VoxelOperationProgram<PixelType>     m_StreamingProgram;
+  std::vector<AccumulateOperationCode> m_Operations;
+  bool                                 m_AccumulateSquares;
+  SmoothingFunctionType                m_Smoothing;
+  int                                  m_NumberOfImages;
+  ImagePointer                         m_Accumulator;
+  ImagePointer                         m_SquareSum;
+};
+} // end namespace ImageCalculatorFused
+
+#endif // __ImageCalculatorFusedEngine_h____
@@ -40,6 +40,7 @@
 #include <iostream>
 #include <cmath>
 #include "ImageCalculatorUtils.h"
+#include "ImageCalculatorFusedEngine.h"
 #include <metaCommand.h>
 
 #define FunctorClassDeclare(name, op)                    \
@@ -245,76 +246,6 @@ Ifilters( typename ImageType::Pointer input,  MetaCommand command )
   return IntermediateImage;
 }
 
-/* This function if called performs arithmetic operation with a constant value
- * to all the pixels in tee output image.*/
-template <class ImageType>
-typename ImageType::Pointer
-Ofilters( typename ImageType::Pointer input, MetaCommand command )
-{
-  typedef typename ImageType::PixelType PixelType;
-  std::stringstream EffectiveOutputFilters;
-  typename ImageType::Pointer IntermediateImage = input;
-  /*Multiplies a constant value to all the pixels of the Output image.*/
-  if( command.GetValueAsString("OMulC", "constant") != "" )
-    {
-    const PixelType temp = static_cast<PixelType>(command.GetValueAsFloat("OMulC", "constant") );
-    EffectiveOutputFilters << "-ofmulc " << static_cast<double>(temp) << " ";
-    FunctorProcess(mult, temp);
-    }
-  /*Divides a constant value from all the pixels of the Output image.*/
-  if( command.GetValueAsString("ODivC", "constant") != "" )
-    {
-    const PixelType temp = static_cast<PixelType>(command.GetValueAsFloat("ODivC", "constant") );
-    EffectiveOutputFilters << "-ofdivc " << static_cast<double>(temp) << " ";
-    FunctorProcess(divide, temp);
-    }
-
-  /*Adds a constant value to all the pixels of the Output image.*/
-  if( command.GetValueAsString("OAddC", "constant") != "" )
-    {
-    const PixelType temp = static_cast<PixelType>(command.GetValueAsFloat("OAddC", "constant") );
-    EffectiveOutputFilters << "-ofaddc " << static_cast<double>(temp) << " ";
-    FunctorProcess(add, temp);
-    }
-
-  /*Subtracts a constant value from all the pixels of the Output image.*/
-  if( command.GetValueAsString("OSubC", "constant") != "" )
-    {
-    const PixelType temp = static_cast<PixelType>(command.GetValueAsFloat("OSubC", "constant") );
-    EffectiveOutputFilters << "-ofsubc " << static_cast<double>(temp) << " ";
-    FunctorProcess(subtract, temp);
-    }
-  /*Gaussian Filters output image with value of sigma image.*/
-  if( command.GetValueAsString("OGaussianSigma", "constant") != "" )
-    {
-    const double temp = static_cast<double>(command.GetValueAsFloat("OGaussianSigma", "constant") );
-    EffectiveOutputFilters << "-ofgaussiansigma " << static_cast<double>(temp) << " ";
-    IntermediateImage = DoGaussian<ImageType>(IntermediateImage, temp);
-    }
-
-  /*Make Binary Output image.*/
-  if( command.GetValueAsBool("Ofbin", "ofbin") )
-    {
-    EffectiveOutputFilters << "-ofbin ";
-    FunctorProcess2(binarydecimate);
-    }
-  /*Squares the pixels of the Output image.*/
-  if( command.GetValueAsBool("OSqr", "ofsqr") )
-    {
-    EffectiveOutputFilters << "-ofsqr ";
-    FunctorProcess2(square);
-    }
-  /*Takes the square root of the pixels in the Output image.*/
-  if( command.GetValueAsBool("OSqrt", "ofsqrt") )
-    {
-    EffectiveOutputFilters << "-ofsqrt ";
-    FunctorProcess2(squareroot);
-    }
-  // return typename itk::Image< PixelType, ImageType::ImageDimension >::Pointer();
-  std::cout << "--Storage type effective output filter options:  " <<  EffectiveOutputFilters.str() <<  std::endl;
-  return IntermediateImage;
-}
-
 /*statfilters performs user specified statistical operations on the output image.*/
 template <class ImageType>
 void statfilters( const typename ImageType::Pointer AccImage, MetaCommand command)
@@ -560,22 +491,40 @@ void statfilters( const typename ImageType::Pointer AccImage, MetaCommand comman
 }
 
 /*This function is called when the user wants to write the ouput image to a file. The output image is typecasted to the
-  user specified data type. */
+  user specified data type. The cast and the output filters are evaluated in a single fused pass. */
 template <class InPixelType, class PixelType, unsigned int ImageDims>
 void ProcessOutputStage( const typename itk::Image<InPixelType, ImageDims>::Pointer AccImage,
                          const std::string & outputImageFilename, MetaCommand command)
 {
-  typedef itk::Image<InPixelType, ImageDims>                    InputImageType;
-  typedef itk::Image<PixelType, ImageDims>                      OutputImageType;
-  typedef itk::CastImageFilter<InputImageType, OutputImageType> CastToOutputFilterType;
-  typename CastToOutputFilterType::Pointer ToOutputTypeFilter = CastToOutputFilterType::New();
+  typedef itk::Image<PixelType, ImageDims> OutputImageType;
 
-  typedef itk::ImageFileWriter<OutputImageType> WriterType;
-  ToOutputTypeFilter->SetInput( AccImage );
-  ToOutputTypeFilter->Update();
+  std::stringstream                                   EffectiveOutputFilters;
+  const ImageCalculatorFused::FilterStage<PixelType> outputStage =
+    ImageCalculatorFused::CompileFilterStage<PixelType>(command, "O", EffectiveOutputFilters);
+  std::cout << "--Storage type effective output filter options:  " <<  EffectiveOutputFilters.str() <<  std::endl;
 
-  typename OutputImageType::Pointer OutputImage = Ofilters<OutputImageType>(ToOutputTypeFilter->GetOutput(), command);
+  typename OutputImageType::Pointer OutputImage = OutputImageType::New();
+  OutputImage->CopyInformation(AccImage);
+  OutputImage->SetRegions(AccImage->GetLargestPossibleRegion() );
+  OutputImage->Allocate();
 
+  const ImageCalculatorFused::VoxelOperationProgram<PixelType> castProgram =
+    outputStage.m_HasSmoothing ? outputStage.m_PreSmoothing : outputStage.FusedProgram();
+  typedef ImageCalculatorFused::CastKernel<InPixelType, PixelType> CastKernelType;
+  CastKernelType castKernel;
+  castKernel.m_Input = AccImage->GetBufferPointer();
+  castKernel.m_Output = OutputImage->GetBufferPointer();
+  castKernel.m_Program = &castProgram;
+  ImageCalculatorFused::ParallelVoxelLoop<CastKernelType>::Run(castKernel,
+                                                               ImageCalculatorFused::NumberOfVoxels(
+                                                                 OutputImage.GetPointer() ) );
+  if( outputStage.m_HasSmoothing )
+    {
+    OutputImage = DoGaussian<OutputImageType>(OutputImage, outputStage.m_Sigma);
+    ImageCalculatorFused::ExecuteInPlace<OutputImageType>(OutputImage, outputStage.m_PostSmoothing);
+    }
+
+  typedef itk::ImageFileWriter<OutputImageType> WriterType;
   typename  WriterType::Pointer writer = WriterType::New();
   writer->SetFileName(outputImageFilename);
   writer->SetInput(OutputImage);
@@ -623,32 +572,13 @@ private:
   }
 };
 
-/*This function reads in the input images and writes the output image ,
- * delegating the computations to other functions*/
 template <class ImageType>
-void ImageCalculatorReadWrite( MetaCommand & command )
+typename ImageType::Pointer
+ReadInputImage( const std::string & filename )
 {
-  // Replace backslash blank with a unique string
-  std::string tempFilenames = command.GetValueAsString("in");
-
-  ReplaceSubWithSub(tempFilenames, "\\ ", "BACKSLASH_BLANK");
-
-  // Now split into separate filenames
-  string_tokenizer InputList(tempFilenames, " ");
-  // Finally, return the blanks to the filenames
-  for( size_t i = 0; i < InputList.size(); ++i )
-    {
-    ReplaceSubWithSub(InputList[i], "BACKSLASH_BLANK", " ");
-    }
-
   typedef itk::ImageFileReader<ImageType> ReaderType;
-  typedef typename ImageType::PixelType   PixelType;
-  // Read the first Image
   typename ReaderType::Pointer reader = ReaderType::New();
-  reader->SetFileName(InputList.at(0).c_str() );
-
-  std::cout << "Reading 1st Image..." << InputList.at(0).c_str() << std::endl;
-
+  reader->SetFileName( filename.c_str() );
   try
     {
     reader->Update();
@@ -658,33 +588,63 @@ void ImageCalculatorReadWrite( MetaCommand & command )
     std::cerr << "Error reading the series " << excp << std::endl;
     throw;
     }
+  return reader->GetOutput();
+}
+
+/* Check whether the image dimensions, the spacing and the orientation are the same. */
+template <class ImageType>
+void CheckImagesAreCompatible( const ImageType * AccImage, const ImageType * image )
+{
+  if( (AccImage->GetLargestPossibleRegion().GetSize() != image->GetLargestPossibleRegion().GetSize() ) )
+    {
+    itkGenericExceptionMacro(<< "Error:: The size of the images don't match.");
+    }
+
+  vnl_vector_fixed<double, 3> spacingDifference(0.0);
+  for( unsigned int d = 0; d < ImageType::ImageDimension && d < 3; ++d )
+    {
+    spacingDifference[d] = AccImage->GetSpacing()[d] - image->GetSpacing()[d];
+    }
+
+  if( spacingDifference.two_norm() > 0.0001 ) // HACK:  Should be a percentage of the actual spacing size.
+    {
+    itkGenericExceptionMacro(<< "ERROR:: The pixel spacing of the images are not close enough.");
+    }
+  else if( AccImage->GetSpacing() != image->GetSpacing() )
+    {
+    std::cout << "WARNING: ::The pixel spacing of the images don't match exactly. \n";
+    }
+  if( AccImage->GetDirection() != image->GetDirection() )
+    {
+    itkGenericExceptionMacro(<< "Error:: The orientation of the images are different.");
+    }
+}
+
+/* Accumulates the input images with one filter per operation.  Needed when
+ * every image is histogram matched to the current accumulator. */
+template <class ImageType>
+typename ImageType::Pointer
+AccumulateWithHistogramMatching( const string_tokenizer & InputList, MetaCommand & command )
+{
+  typedef typename ImageType::PixelType PixelType;
+
+  std::cout << "Reading 1st Image..." << InputList.at(0).c_str() << std::endl;
+  typename ImageType::Pointer FirstImage = ReadInputImage<ImageType>(InputList.at(0) );
 
   // Create an Accumulator Image.
-  typename ImageType::Pointer AccImage = Ifilters<ImageType>(reader->GetOutput(), command);
+  typename ImageType::Pointer AccImage = Ifilters<ImageType>(FirstImage, command);
 
   /*For variance image first step is to square the input image.*/
   typename ImageType::Pointer SqrImageSum;
   if( command.GetValueAsBool("Var", "var") )
     {
-    SqrImageSum = Imul<ImageType>(reader->GetOutput(), reader->GetOutput() );
+    SqrImageSum = Imul<ImageType>(FirstImage, FirstImage );
     }
   /* Accumulator contains the first image initially and is updated by the next image at each count */
   for( unsigned int currimage = 1; currimage < InputList.size(); ++currimage )
     {
     std::cout << "Reading image.... " << InputList.at(currimage).c_str() << std::endl;
-
-    typename ReaderType::Pointer reader2 = ReaderType::New();
-    reader2->SetFileName( InputList.at(currimage).c_str() );
-    try
-      {
-      reader2->Update();
-      }
-    catch( itk::ExceptionObject & excp )
-      {
-      std::cerr << "Error reading the series " << excp << std::endl;
-      throw;
-      }
-    typename ImageType::Pointer SubSequentImage = reader2->GetOutput();
+    typename ImageType::Pointer SubSequentImage = ReadInputImage<ImageType>(InputList.at(currimage) );
 
     // Check whether the image dimensions and the spacing are the same.
     if( (AccImage->GetLargestPossibleRegion().GetSize() != SubSequentImage->GetLargestPossibleRegion().GetSize() ) )
@@ -694,32 +654,13 @@ void ImageCalculatorReadWrite( MetaCommand & command )
 
     /*If the accumulator buffer is not empty, then every subsequent image is histogram equalized to the current
       accumulator buffer.*/
-    if( command.GetValueAsString("IHisteq", "constant") != "" && AccImage.IsNotNull() )
-      {
-      const int NumOfMatchPoints = static_cast<int>(command.GetValueAsInt("IHisteq", "constant") );
-      EffectiveInputFilters << "-ifhisteq " << static_cast<int>(NumOfMatchPoints) << " ";
-      SubSequentImage = DoHisteq<ImageType>(AccImage, reader2->GetOutput(), NumOfMatchPoints);
-      }
+    const int NumOfMatchPoints = static_cast<int>(command.GetValueAsInt("IHisteq", "constant") );
+    EffectiveInputFilters << "-ifhisteq " << static_cast<int>(NumOfMatchPoints) << " ";
+    SubSequentImage = DoHisteq<ImageType>(AccImage, SubSequentImage, NumOfMatchPoints);
 
     typename ImageType::Pointer image = Ifilters<ImageType>(SubSequentImage, command);
 
-    vnl_vector_fixed<double, 3> spacingDifference;
-    spacingDifference[0] = AccImage->GetSpacing()[0] - image->GetSpacing()[0];
-    spacingDifference[1] = AccImage->GetSpacing()[1] - image->GetSpacing()[1];
-    spacingDifference[2] = AccImage->GetSpacing()[2] - image->GetSpacing()[2];
-
-    if( spacingDifference.two_norm() > 0.0001 ) // HACK:  Should be a percentage of the actual spacing size.
-      {
-      itkGenericExceptionMacro(<< "ERROR:: The pixel spacing of the images are not close enough.");
-      }
-    else if( AccImage->GetSpacing() != image->GetSpacing() )
-      {
-      std::cout << "WARNING: ::The pixel spacing of the images don't match exactly. \n";
-      }
-    if( AccImage->GetDirection() != image->GetDirection() )
-      {
-      itkGenericExceptionMacro(<< "Error:: The orientation of the images are different.");
-      }
+    CheckImagesAreCompatible<ImageType>(AccImage, image);
 
     // Do the math for the Accumulator image and the image read in for each iteration.
     /*Call the multiplication function*/
@@ -780,6 +721,101 @@ void ImageCalculatorReadWrite( MetaCommand & command )
     AccImage = Isub<ImageType>(NumSqrImageSum, AccImage);
     AccImage = ImageDivideConstant<ImageType>(AccImage, static_cast<PixelType>(NumImages * NumImages - NumImages) );
     }
+  return AccImage;
+}
+
+/* Accumulates the input images with the fused engine: the input filters
+ * and the requested operations are applied while streaming each image
+ * into the accumulator, without intermediate images. */
+template <class ImageType>
+typename ImageType::Pointer
+AccumulateFused( const string_tokenizer & InputList, MetaCommand & command )
+{
+  typedef typename ImageType::PixelType PixelType;
+
+  const ImageCalculatorFused::FilterStage<PixelType> inputStage =
+    ImageCalculatorFused::CompileFilterStage<PixelType>(command, "I", EffectiveInputFilters);
+  std::cout << "--Storage type effective  input filter options:  " <<  EffectiveInputFilters.str() <<  std::endl;
+
+  // Same order as the historical pipeline: mul, add, sub, div, avg, var.
+  std::vector<ImageCalculatorFused::AccumulateOperationCode> operations;
+  if( command.GetValueAsBool("Mul", "mul") )
+    {
+    operations.push_back(ImageCalculatorFused::AccumulateMultiply);
+    }
+  if( command.GetValueAsBool("Add", "add") )
+    {
+    operations.push_back(ImageCalculatorFused::AccumulateAdd);
+    }
+  if( command.GetValueAsBool("Sub", "sub") )
+    {
+    operations.push_back(ImageCalculatorFused::AccumulateSubtract);
+    }
+  if( command.GetValueAsBool("Div", "div") )
+    {
+    operations.push_back(ImageCalculatorFused::AccumulateDivide);
+    }
+  if( command.GetValueAsBool("Avg", "avg") )
+    {
+    operations.push_back(ImageCalculatorFused::AccumulateAdd);
+    }
+  const bool variance = command.GetValueAsBool("Var", "var");
+  if( variance )
+    {
+    operations.push_back(ImageCalculatorFused::AccumulateAdd);
+    }
+
+  ImageCalculatorFused::FusedAccumulator<ImageType> accumulator(inputStage, operations, variance,
+                                                                &DoGaussian<ImageType>);
+  for( unsigned int currimage = 0; currimage < InputList.size(); ++currimage )
+    {
+    if( currimage == 0 )
+      {
+      std::cout << "Reading 1st Image..." << InputList.at(0).c_str() << std::endl;
+      }
+    else
+      {
+      std::cout << "Reading image.... " << InputList.at(currimage).c_str() << std::endl;
+      }
+    typename ImageType::Pointer image = ReadInputImage<ImageType>(InputList.at(currimage) );
+    if( currimage > 0 )
+      {
+      CheckImagesAreCompatible<ImageType>(accumulator.GetAccumulator(), image);
+      }
+    accumulator.Accumulate(image);
+    }
+  return accumulator.Finalize(command.GetValueAsBool("Avg", "avg"), variance);
+}
+
+/*This function reads in the input images and writes the output image ,
+ * delegating the computations to other functions*/
+template <class ImageType>
+void ImageCalculatorReadWrite( MetaCommand & command )
+{
+  // Replace backslash blank with a unique string
+  std::string tempFilenames = command.GetValueAsString("in");
+
+  ReplaceSubWithSub(tempFilenames, "\\ ", "BACKSLASH_BLANK");
+
+  // Now split into separate filenames
+  string_tokenizer InputList(tempFilenames, " ");
+  // Finally, return the blanks to the filenames
+  for( size_t i = 0; i < InputList.size(); ++i )
+    {
+    ReplaceSubWithSub(InputList[i], "BACKSLASH_BLANK", " ");
+    }
+
+  typedef typename ImageType::PixelType PixelType;
+
+  typename ImageType::Pointer AccImage;
+  if( command.GetValueAsString("IHisteq", "constant") != "" && InputList.size() > 1 )
+    {
+    AccImage = AccumulateWithHistogramMatching<ImageType>(InputList, command);
+    }
+  else
+    {
+    AccImage = AccumulateFused<ImageType>(InputList, command);
+    }
 
   const std::string OutType(command.GetValueAsString("OutputPixelType", "PixelType" ) );
 